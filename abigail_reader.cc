@@ -21,34 +21,44 @@
 #include "abigail_reader.h"
 
 #include <fcntl.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
 #include <algorithm>
 #include <array>
+#include <cctype>
+#include <charconv>
 #include <cstddef>
 #include <cstdint>
+#include <deque>
 #include <functional>
 #include <iomanip>
 #include <ios>
-#include <map>
 #include <memory>
 #include <optional>
 #include <set>
 #include <sstream>
 #include <string>
 #include <string_view>
+#include <system_error>
 #include <type_traits>
 #include <unordered_map>
+#include <unordered_set>
 #include <utility>
 #include <vector>
 
 #include <libxml/parser.h>
 #include <libxml/tree.h>
+#include <libxml/xmlreader.h>
 #include "error.h"
 #include "file_descriptor.h"
+#include "flat_map.h"
 #include "graph.h"
+#include "hashing.h"
 #include "metrics.h"
+#include "parallel.h"
 #include "scope.h"
+#include "substitution.h"
 #include "type_normalisation.h"
 
 namespace stg {
@@ -95,27 +105,84 @@ xmlNodePtr GetOnlyChild(xmlNodePtr element) {
   return child;
 }
 
+// Find an attribute by name.
+xmlAttrPtr FindAttribute(xmlNodePtr node, std::string_view name) {
+  for (auto* attribute = node->properties; attribute;
+       attribute = attribute->next) {
+    if (FromLibxml(attribute->name) == name) {
+      return attribute;
+    }
+  }
+  return nullptr;
+}
+
+// Get an attribute value without copying it, if it is held as a single text
+// node, as is usual.
+std::optional<std::string_view> GetAttributeText(xmlAttrPtr attribute) {
+  const xmlNode* text = attribute->children;
+  if (text == nullptr) {
+    return {std::string_view()};
+  }
+  if (text->type == XML_TEXT_NODE && text->next == nullptr) {
+    return {FromLibxml(text->content)};
+  }
+  return {};
+}
+
+// Get an attribute value. This is a view of libxml-owned text unless the value
+// is held in pieces, in which case it is assembled in the buffer.
+std::string_view GetAttributeValue(xmlAttrPtr attribute, std::string& buffer) {
+  const auto text = GetAttributeText(attribute);
+  if (text) {
+    return *text;
+  }
+  xmlChar* value = xmlNodeListGetString(attribute->doc, attribute->children, 1);
+  buffer = value ? FromLibxml(value) : std::string_view();
+  xmlFree(value);
+  return buffer;
+}
+
+// Get an optional attribute value, see GetAttributeValue.
+std::optional<std::string_view> GetAttributeView(
+    xmlNodePtr node, const char* name, std::string& buffer) {
+  const xmlAttrPtr attribute = FindAttribute(node, name);
+  if (attribute == nullptr) {
+    return {};
+  }
+  return {GetAttributeValue(attribute, buffer)};
+}
+
+// Get an attribute value, see GetAttributeValue.
+std::string_view GetAttributeViewOrDie(
+    xmlNodePtr node, const char* name, std::string& buffer) {
+  const auto value = GetAttributeView(node, name, buffer);
+  if (!value) {
+    Die() << "element '" << GetName(node)
+          << "' missing attribute '" << name << "'";
+  }
+  return *value;
+}
+
 // Get an optional attribute.
 std::optional<std::string> GetAttribute(xmlNodePtr node, const char* name) {
-  std::optional<std::string> result;
-  xmlChar* attribute = xmlGetProp(node, ToLibxml(name));
-  if (attribute) {
-    result.emplace(FromLibxml(attribute));
-    xmlFree(attribute);
+  std::string buffer;
+  const auto value = GetAttributeView(node, name, buffer);
+  if (!value) {
+    return {};
   }
-  return result;
+  return {std::string(*value)};
 }
 
 // Get an attribute.
 std::string GetAttributeOrDie(xmlNodePtr node, const char* name) {
-  xmlChar* attribute = xmlGetProp(node, ToLibxml(name));
-  if (!attribute) {
-    Die() << "element '" << GetName(node)
-          << "' missing attribute '" << name << "'";
-  }
-  const std::string result(FromLibxml(attribute));
-  xmlFree(attribute);
-  return result;
+  std::string buffer;
+  return std::string(GetAttributeViewOrDie(node, name, buffer));
+}
+
+// Get the name of an element, qualified by a scope.
+std::string GetScopedNameOrDie(const Scope& scope, xmlNodePtr element) {
+  std::string buffer;
+  return ScopedName(scope, GetAttributeViewOrDie(element, "name", buffer));
 }
 
 // Set an attribute value.
@@ -140,19 +207,36 @@ void MoveNode(xmlNodePtr node, xmlNodePtr destination) {
   xmlAddChild(destination, node);
 }
 
+// Parse a number, which must occupy the whole value.
 template <typename T>
-std::optional<T> Parse(const std::string& value) {
+std::optional<T> ParseNumber(std::string_view value, int base) {
   T result;
-  std::istringstream is(value);
-  is >> std::noskipws >> result;
-  if (is && is.eof()) {
+  const char* end = value.data() + value.size();
+  const auto [ptr, error] = std::from_chars(value.data(), end, result, base);
+  if (error == std::errc() && ptr == end) {
     return {result};
   }
   return {};
 }
 
+template <typename T>
+std::optional<T> Parse(std::string_view value) {
+  return ParseNumber<T>(value, 10);
+}
+
 template <>
-std::optional<bool> Parse<bool>(const std::string& value) {
+std::optional<std::string> Parse<std::string>(std::string_view value) {
+  // a non-empty word
+  if (value.empty() || std::any_of(value.begin(), value.end(), [](char c) {
+        return std::isspace(static_cast<unsigned char>(c));
+      })) {
+    return {};
+  }
+  return {std::string(value)};
+}
+
+template <>
+std::optional<bool> Parse<bool>(std::string_view value) {
   if (value == "yes") {
     return {true};
   } else if (value == "no") {
@@ -163,7 +247,7 @@ std::optional<bool> Parse<bool>(const std::string& value) {
 
 template <>
 std::optional<ElfSymbol::SymbolType> Parse<ElfSymbol::SymbolType>(
-    const std::string& value) {
+    std::string_view value) {
   if (value == "object-type") {
     return {ElfSymbol::SymbolType::OBJECT};
   } else if (value == "func-type") {
@@ -180,7 +264,7 @@ std::optional<ElfSymbol::SymbolType> Parse<ElfSymbol::SymbolType>(
 
 template <>
 std::optional<ElfSymbol::Binding> Parse<ElfSymbol::Binding>(
-    const std::string& value) {
+    std::string_view value) {
   if (value == "global-binding") {
     return {ElfSymbol::Binding::GLOBAL};
   } else if (value == "local-binding") {
@@ -195,7 +279,7 @@ std::optional<ElfSymbol::Binding> Parse<ElfSymbol::Binding>(
 
 template <>
 std::optional<ElfSymbol::Visibility> Parse<ElfSymbol::Visibility>(
-    const std::string& value) {
+    std::string_view value) {
   if (value == "default-visibility") {
     return {ElfSymbol::Visibility::DEFAULT};
   } else if (value == "protected-visibility") {
@@ -209,19 +293,22 @@ std::optional<ElfSymbol::Visibility> Parse<ElfSymbol::Visibility>(
 }
 
 template <>
-std::optional<ElfSymbol::CRC> Parse<ElfSymbol::CRC>(const std::string& value) {
-  uint32_t number;
-  std::istringstream is(value);
-  is >> std::noskipws >> std::hex >> number;
-  if (is && is.eof()) {
-    return std::make_optional<ElfSymbol::CRC>(number);
+std::optional<ElfSymbol::CRC> Parse<ElfSymbol::CRC>(std::string_view value) {
+  // the 0x prefix is optional
+  if (value.size() > 2 && value[0] == '0'
+      && (value[1] == 'x' || value[1] == 'X')) {
+    value.remove_prefix(2);
+  }
+  const auto number = ParseNumber<uint32_t>(value, 16);
+  if (number) {
+    return std::make_optional<ElfSymbol::CRC>(*number);
   }
   return std::nullopt;
 }
 
 template <typename T>
 T GetParsedValueOrDie(xmlNodePtr element, const char* name,
-                      const std::string& value, const std::optional<T>& parse) {
+                      std::string_view value, const std::optional<T>& parse) {
   if (parse) {
     return *parse;
   }
@@ -232,13 +319,15 @@ T GetParsedValueOrDie(xmlNodePtr element, const char* name,
 
 template <typename T>
 T ReadAttributeOrDie(xmlNodePtr element, const char* name) {
-  const auto value = GetAttributeOrDie(element, name);
+  std::string buffer;
+  const auto value = GetAttributeViewOrDie(element, name, buffer);
   return GetParsedValueOrDie(element, name, value, Parse<T>(value));
 }
 
 template <typename T>
 std::optional<T> ReadAttribute(xmlNodePtr element, const char* name) {
-  const auto value = GetAttribute(element, name);
+  std::string buffer;
+  const auto value = GetAttributeView(element, name, buffer);
   if (value) {
     return {GetParsedValueOrDie(element, name, *value, Parse<T>(*value))};
   }
@@ -247,7 +336,8 @@ std::optional<T> ReadAttribute(xmlNodePtr element, const char* name) {
 
 template <typename T>
 T ReadAttribute(xmlNodePtr element, const char* name, const T& default_value) {
-  const auto value = GetAttribute(element, name);
+  std::string buffer;
+  const auto value = GetAttributeView(element, name, buffer);
   if (value) {
     return GetParsedValueOrDie(element, name, *value, Parse<T>(*value));
   }
@@ -256,31 +346,25 @@ T ReadAttribute(xmlNodePtr element, const char* name, const T& default_value) {
 
 template <typename T>
 T ReadAttribute(xmlNodePtr element, const char* name,
-                std::function<std::optional<T>(const std::string&)> parse) {
-  const auto value = GetAttributeOrDie(element, name);
+                std::function<std::optional<T>(std::string_view)> parse) {
+  std::string buffer;
+  const auto value = GetAttributeViewOrDie(element, name, buffer);
   return GetParsedValueOrDie(element, name, value, parse(value));
 }
 
-// Remove non-element nodes, recursively.
+// Remove a non-element node, returning whether it was removed.
 //
 // This simplifies subsequent manipulation. This should only remove comment,
 // text and possibly CDATA nodes.
-void StripNonElements(xmlNodePtr node) {
+bool StripNonElement(xmlNodePtr node) {
   switch (node->type) {
     case XML_COMMENT_NODE:
     case XML_TEXT_NODE:
     case XML_CDATA_SECTION_NODE:
       RemoveNode(node);
-      break;
-    case XML_ELEMENT_NODE: {
-      xmlNodePtr child = Child(node);
-      while (child) {
-        xmlNodePtr next = Next(child);
-        StripNonElements(child);
-        child = next;
-      }
-      break;
-    }
+      return true;
+    case XML_ELEMENT_NODE:
+      return false;
     default:
       Die() << "unexpected XML node type: " << node->type;
   }
@@ -297,14 +381,14 @@ bool SubOrEqualTree(bool also_equal, xmlNodePtr left, xmlNodePtr right) {
   }
 
   // Attributes may be missing on the left, but must match otherwise.
+  std::string left_buffer;
+  std::string right_buffer;
   size_t left_attributes = 0;
   for (auto* p = left->properties; p; p = p->next) {
     ++left_attributes;
-    const auto attribute = FromLibxml(p->name);
-    const char* attribute_name = attribute.data();
-    const auto left_value = GetAttributeOrDie(left, attribute_name);
-    const auto right_value = GetAttribute(right, attribute_name);
-    if (!right_value || left_value != right_value.value()) {
+    const xmlAttrPtr q = FindAttribute(right, FromLibxml(p->name));
+    if (q == nullptr || GetAttributeValue(p, left_buffer)
+                        != GetAttributeValue(q, right_buffer)) {
       return false;
     }
   }
@@ -346,6 +430,28 @@ bool EqualTree(xmlNodePtr left, xmlNodePtr right) {
   return SubOrEqualTree(true, left, right);
 }
 
+namespace {
+
+// Hash an XML element structurally, consistently with EqualTree: attribute
+// order is ignored.
+HashValue64 TreeHash(xmlNodePtr node) {
+  const Hash64 hash;
+  // attributes are combined commutatively
+  std::string buffer;
+  uint64_t attributes = 0;
+  for (auto* p = node->properties; p; p = p->next) {
+    attributes +=
+        hash(FromLibxml(p->name), hash(GetAttributeValue(p, buffer))).value;
+  }
+  HashValue64 children(0);
+  for (auto* child = Child(node); child; child = Next(child)) {
+    children = hash(children, TreeHash(child));
+  }
+  return hash(GetName(node), attributes, children);
+}
+
+}  // namespace
+
 // Find a maximal XML element if one exists.
 std::optional<size_t> MaximalTree(const std::vector<xmlNodePtr>& nodes) {
   if (nodes.empty()) {
@@ -406,9 +512,6 @@ void StripLocationInfo(xmlNodePtr node) {
     UnsetAttribute(node, "line");
     UnsetAttribute(node, "column");
   }
-  for (auto* child = Child(node); child; child = Next(child)) {
-    StripLocationInfo(child);
-  }
 }
 
 // Remove access attribute.
@@ -429,9 +532,6 @@ void StripAccess(xmlNodePtr node) {
   if (Contains(has_access, GetName(node))) {
     UnsetAttribute(node, "access");
   }
-  for (auto* child = Child(node); child; child = Next(child)) {
-    StripAccess(child);
-  }
 }
 
 // Elements corresponding to named types that can be anonymous or marked as
@@ -458,10 +558,6 @@ void StripReachabilityAttributes(xmlNodePtr node) {
   } else if (Contains(kNamedTypes, node_name)) {
     UnsetAttribute(node, "is-non-reachable");
   }
-
-  for (auto* child = Child(node); child; child = Next(child)) {
-    StripReachabilityAttributes(child);
-  }
 }
 
 // Fix bad DWARF -> ELF links caused by size zero symbol confusion.
@@ -471,50 +567,41 @@ void StripReachabilityAttributes(xmlNodePtr node) {
 //
 // 573623: ffffffc0122383c0   256 OBJECT  GLOBAL DEFAULT   33 vm_node_stat
 // 573960: ffffffc0122383c0     0 OBJECT  GLOBAL DEFAULT   33 vm_numa_stat
-void FixBadDwarfElfLinks(xmlNodePtr root) {
-  std::unordered_map<std::string, size_t> elf_links;
-
-  // See which ELF symbol IDs have multiple declarations.
-  const std::function<void(xmlNodePtr)> count = [&](xmlNodePtr node) {
-    if (GetName(node) == "var-decl") {
-      const auto symbol_id = GetAttribute(node, "elf-symbol-id");
-      if (symbol_id) {
-        ++elf_links[symbol_id.value()];
-      }
+//
+// The fix needs the number of declarations linked to each ELF symbol id, across
+// the whole document.
+using ElfLinks = std::unordered_map<std::string, size_t>;
+
+// Count a var-decl element's link to an ELF symbol, if any.
+void CountElfLink(xmlNodePtr node, ElfLinks& elf_links) {
+  if (GetName(node) == "var-decl") {
+    const auto symbol_id = GetAttribute(node, "elf-symbol-id");
+    if (symbol_id) {
+      ++elf_links[symbol_id.value()];
     }
+  }
+}
 
-    for (auto* child = Child(node); child; child = Next(child)) {
-      count(child);
-    }
-  };
-  count(root);
-
-  // Fix up likely bad links from DWARF declaration to ELF symbol.
-  const std::function<void(xmlNodePtr)> fix = [&](xmlNodePtr node) {
-    if (GetName(node) == "var-decl") {
-      const auto name = GetAttributeOrDie(node, "name");
-      const auto mangled_name = GetAttribute(node, "mangled-name");
-      const auto symbol_id = GetAttribute(node, "elf-symbol-id");
-      if (mangled_name && symbol_id && name != symbol_id.value()
-          && elf_links[symbol_id.value()] > 1) {
-        if (mangled_name.value() == name) {
-          Warn() << "fixing up ELF symbol for '" << name
-                 << "' (was '" << symbol_id.value() << "')";
-          SetAttribute(node, "elf-symbol-id", name);
-        } else if (mangled_name.value() == symbol_id.value()) {
-          Warn() << "fixing up mangled name and ELF symbol for '" << name
-                 << "' (was '" << symbol_id.value() << "')";
-          SetAttribute(node, "mangled-name", name);
-          SetAttribute(node, "elf-symbol-id", name);
-        }
+// Fix up a likely bad link from DWARF declaration to ELF symbol.
+void FixBadDwarfElfLink(xmlNodePtr node, const ElfLinks& elf_links) {
+  if (GetName(node) == "var-decl") {
+    const auto name = GetAttributeOrDie(node, "name");
+    const auto mangled_name = GetAttribute(node, "mangled-name");
+    const auto symbol_id = GetAttribute(node, "elf-symbol-id");
+    if (mangled_name && symbol_id && name != symbol_id.value()
+        && elf_links.at(symbol_id.value()) > 1) {
+      if (mangled_name.value() == name) {
+        Warn() << "fixing up ELF symbol for '" << name
+               << "' (was '" << symbol_id.value() << "')";
+        SetAttribute(node, "elf-symbol-id", name);
+      } else if (mangled_name.value() == symbol_id.value()) {
+        Warn() << "fixing up mangled name and ELF symbol for '" << name
+               << "' (was '" << symbol_id.value() << "')";
+        SetAttribute(node, "mangled-name", name);
+        SetAttribute(node, "elf-symbol-id", name);
       }
     }
-
-    for (auto* child = Child(node); child; child = Next(child)) {
-      fix(child);
-    }
-  };
-  fix(root);
+  }
 }
 
 // Tidy anonymous types in various ways.
@@ -540,7 +627,7 @@ void FixBadDwarfElfLinks(xmlNodePtr root) {
 // the typedef that refers to it.
 //
 // We don't care about these attributes and they may cause comparison issues.
-void TidyAnonymousTypes(xmlNodePtr node) {
+void TidyAnonymousType(xmlNodePtr node) {
   if (Contains(kNamedTypes, GetName(node))) {
     const bool is_anon = ReadAttribute<bool>(node, "is-anonymous", false);
     const auto naming_attribute = GetAttribute(node, "naming-typedef-id");
@@ -554,55 +641,177 @@ void TidyAnonymousTypes(xmlNodePtr node) {
       UnsetAttribute(node, "naming-typedef-id");
     }
   }
+}
 
+// Remove duplicate members of a struct or union.
+//
+// The members themselves should already have been cleaned and tidied.
+void RemoveDuplicateMembers(xmlNodePtr node) {
+  const auto node_name = GetName(node);
+  if (node_name != "class-decl" && node_name != "union-decl") {
+    return;
+  }
+  // Remove identical duplicate members, bucketing them by hash so that only
+  // members with equal hashes need to be compared.
+  std::unordered_map<HashValue64, std::vector<xmlNodePtr>> buckets;
+  xmlNodePtr child = Child(node);
+  while (child) {
+    xmlNodePtr next = Next(child);
+    auto& members = buckets[TreeHash(child)];
+    const bool duplicate = std::any_of(
+        members.begin(), members.end(),
+        [&](xmlNodePtr member) { return EqualTree(child, member); });
+    if (duplicate) {
+      RemoveNode(child);
+    } else {
+      members.push_back(child);
+    }
+    child = next;
+  }
+}
+
+// Clean a single element, in the ways described above.
+//
+// If elf_links is set, this also counts any ELF symbol link.
+//
+// Returns false if the node was removed.
+bool CleanNode(xmlNodePtr node, ElfLinks* elf_links) {
+  if (StripNonElement(node)) {
+    return false;
+  }
+  StripLocationInfo(node);
+  StripAccess(node);
+  StripReachabilityAttributes(node);
+  if (elf_links != nullptr) {
+    CountElfLink(node, *elf_links);
+  }
+  return true;
+}
+
+// Tidy a single element, in the ways described above, before its children.
+void TidyNode(xmlNodePtr node, const ElfLinks& elf_links) {
+  FixBadDwarfElfLink(node, elf_links);
+  TidyAnonymousType(node);
+}
+
+// Clean a tree, in a single walk.
+void CleanTree(xmlNodePtr node, ElfLinks* elf_links) {
+  if (!CleanNode(node, elf_links)) {
+    return;
+  }
+  xmlNodePtr child = Child(node);
+  while (child) {
+    xmlNodePtr next = Next(child);
+    CleanTree(child, elf_links);
+    child = next;
+  }
+}
+
+// Tidy a cleaned tree, in a single walk. Duplicate members are removed once
+// all of the members have been tidied.
+void TidyTree(xmlNodePtr node, const ElfLinks& elf_links) {
+  TidyNode(node, elf_links);
   for (auto* child = Child(node); child; child = Next(child)) {
-    TidyAnonymousTypes(child);
+    TidyTree(child, elf_links);
   }
+  RemoveDuplicateMembers(node);
 }
 
-// Remove duplicate members.
-void RemoveDuplicateMembers(xmlNodePtr root) {
-  std::vector<xmlNodePtr> types;
+// Clean and tidy a tree, in a single walk, given the ELF symbol link counts of
+// the whole document.
+void CleanAndTidyTree(xmlNodePtr node, const ElfLinks& elf_links) {
+  if (!CleanNode(node, nullptr)) {
+    return;
+  }
+  TidyNode(node, elf_links);
+  xmlNodePtr child = Child(node);
+  while (child) {
+    xmlNodePtr next = Next(child);
+    CleanAndTidyTree(child, elf_links);
+    child = next;
+  }
+  RemoveDuplicateMembers(node);
+}
 
-  // find all structs and unions
-  std::function<void(xmlNodePtr)> dfs = [&](xmlNodePtr node) {
-    const auto node_name = GetName(node);
-    // preorder in case we delete a nested element
-    for (auto* child = Child(node); child; child = Next(child)) {
-      dfs(child);
-    }
-    if (node_name == "class-decl" || node_name == "union-decl") {
-      types.push_back(node);
-    }
+// Convenience typedef referring to a namespace scope.
+using NamespaceScope = std::vector<std::string>;
+
+// Eliminate non-conflicting / report conflicting duplicate definitions of a
+// single type, given the namespace scopes in which they occur.
+//
+// Removed definitions are set to null.
+void HandleDuplicateType(const std::string& id,
+                         const std::set<NamespaceScope>& scopes,
+                         std::vector<xmlNodePtr>& definitions) {
+  if (scopes.size() > 1) {
+    Warn() << "conflicting scopes found for type '" << id << '\'';
+    return;
+  }
+
+  const auto remove = [&](size_t ix) {
+    RemoveNode(definitions[ix]);
+    definitions[ix] = nullptr;
   };
-  dfs(root);
 
-  for (const auto& node : types) {
-    // partition members by node name
-    std::map<std::string_view, std::vector<xmlNodePtr>> member_map;
-    for (auto* child = Child(node); child; child = Next(child)) {
-      member_map[GetName(child)].push_back(child);
+  const auto possible_maximal = MaximalTree(definitions);
+  if (possible_maximal) {
+    // Remove all but the maximal definition.
+    const size_t maximal = possible_maximal.value();
+    for (size_t ix = 0; ix < definitions.size(); ++ix) {
+      if (ix != maximal) {
+        remove(ix);
+      }
     }
-    // for each kind of member...
-    for (auto& [name, members] : member_map) {
-      // ... remove identical duplicate members - O(n^2)
-      for (size_t i = 0; i < members.size(); ++i) {
-        xmlNodePtr& i_node = members[i];
-        bool duplicate = false;
-        for (size_t j = 0; j < i; ++j) {
-          const xmlNodePtr& j_node = members[j];
-          if (j_node != nullptr && EqualTree(i_node, j_node)) {
-            duplicate = true;
-            break;
-          }
-        }
-        if (duplicate) {
-          RemoveNode(i_node);
-          i_node = nullptr;
+    return;
+  }
+
+  // As a rare alternative, check for a stray anonymous member that has been
+  // separated from the main definition.
+  size_t strays = 0;
+  std::optional<size_t> stray;
+  std::optional<size_t> non_stray;
+  for (size_t ix = 0; ix < definitions.size(); ++ix) {
+    auto node = definitions[ix];
+    auto member = Child(node);
+    if (member && !Next(member) && GetName(member) == "data-member") {
+      auto decl = Child(member);
+      if (decl && !Next(decl) && GetName(decl) == "var-decl") {
+        auto name = GetAttribute(decl, "name");
+        if (name && name.value().empty()) {
+          ++strays;
+          stray = ix;
+          continue;
         }
       }
     }
+    non_stray = ix;
+  }
+  if (strays + 1 == definitions.size() && stray.has_value()
+      && non_stray.has_value()) {
+    const auto stray_index = stray.value();
+    const auto non_stray_index = non_stray.value();
+    bool good = true;
+    for (size_t ix = 0; ix < definitions.size(); ++ix) {
+      if (ix == stray_index || ix == non_stray_index) {
+        continue;
+      }
+      if (EqualTree(definitions[stray_index], definitions[ix])) {
+        // it doesn't hurt if we remove exact duplicates and then fail
+        remove(ix);
+      } else {
+        good = false;
+        break;
+      }
+    }
+    if (good) {
+      MoveNode(Child(definitions[stray_index]), definitions[non_stray_index]);
+      remove(stray_index);
+      return;
+    }
   }
+
+  Warn() << "unresolvable duplicate definitions found for type '" << id
+         << '\'';
 }
 
 // Eliminate non-conflicting / report conflicting duplicate definitions.
@@ -623,16 +832,14 @@ void RemoveDuplicateMembers(xmlNodePtr root) {
 // definitions with different effective names, these are considered to be
 // *conflicting* duplicate definitions. TODO: update text
 void HandleDuplicateTypes(xmlNodePtr root) {
-  // Convenience typedef referring to a namespace scope.
-  using namespace_scope = std::vector<std::string>;
   // map of type-id to pair of set of namespace scopes and vector of
   // xmlNodes
   std::unordered_map<
       std::string,
       std::pair<
-          std::set<namespace_scope>,
+          std::set<NamespaceScope>,
           std::vector<xmlNodePtr>>> types;
-  namespace_scope namespaces;
+  NamespaceScope namespaces;
 
   // find all type occurrences
   std::function<void(xmlNodePtr)> dfs = [&](xmlNodePtr node) {
@@ -665,123 +872,309 @@ void HandleDuplicateTypes(xmlNodePtr root) {
   };
   dfs(root);
 
-  for (const auto& [id, scopes_and_definitions] : types) {
-    const auto& [scopes, definitions] = scopes_and_definitions;
-
-    if (scopes.size() > 1) {
-      Warn() << "conflicting scopes found for type '" << id << '\'';
-      continue;
+  for (auto& [id, scopes_and_definitions] : types) {
+    auto& [scopes, definitions] = scopes_and_definitions;
+    if (definitions.size() > 1) {
+      HandleDuplicateType(id, scopes, definitions);
     }
+  }
+}
 
-    const auto possible_maximal = MaximalTree(definitions);
-    if (possible_maximal) {
-      // Remove all but the maximal definition.
-      const size_t maximal = possible_maximal.value();
-      for (size_t ix = 0; ix < definitions.size(); ++ix) {
-        if (ix != maximal) {
-          RemoveNode(definitions[ix]);
-        }
-      }
-      continue;
-    }
+}  // namespace
 
-    // As a rare alternative, check for a stray anonymous member that has been
-    // separated from the main definition.
-    size_t strays = 0;
-    std::optional<size_t> stray;
-    std::optional<size_t> non_stray;
-    for (size_t ix = 0; ix < definitions.size(); ++ix) {
-      auto node = definitions[ix];
-      auto member = Child(node);
-      if (member && !Next(member) && GetName(member) == "data-member") {
-        auto decl = Child(member);
-        if (decl && !Next(decl) && GetName(decl) == "var-decl") {
-          auto name = GetAttribute(decl, "name");
-          if (name && name.value().empty()) {
-            ++strays;
-            stray = ix;
-            continue;
+// Remove XML nodes and attributes that are neither used or wanted.
+void Clean(xmlNodePtr root) {
+  CleanTree(root, nullptr);
+}
+
+namespace {
+
+// Elements that contain scope elements.
+const std::array<std::string_view, 4> kScopes = {
+  "abi-corpus-group",
+  "abi-corpus",
+  "abi-instr",
+  "namespace-decl",
+};
+
+// Walk the elements of a document in document order, without building it.
+//
+// enter(element, ancestors) is called for each element reached and returns
+// whether its children should also be walked, in which case leave(element
+// name) is called after them. The element only has its attributes and is only
+// valid during the call to enter, but its subtree can be expanded.
+template <typename Enter, typename Leave>
+void Walk(xmlTextReaderPtr reader, Enter&& enter, Leave&& leave) {
+  std::vector<std::string> ancestors;
+  int status = xmlTextReaderRead(reader);
+  while (status == 1) {
+    bool descend = true;
+    const int type = xmlTextReaderNodeType(reader);
+    switch (type) {
+      case XML_READER_TYPE_ELEMENT: {
+        xmlNodePtr element = xmlTextReaderCurrentNode(reader);
+        const bool empty = xmlTextReaderIsEmptyElement(reader) == 1;
+        std::string name(GetName(element));
+        descend = enter(element, ancestors);
+        if (descend) {
+          if (empty) {
+            leave(name);
+          } else {
+            ancestors.push_back(std::move(name));
           }
         }
+        break;
       }
-      non_stray = ix;
-    }
-    if (strays + 1 == definitions.size() && stray.has_value()
-        && non_stray.has_value()) {
-      const auto stray_index = stray.value();
-      const auto non_stray_index = non_stray.value();
-      bool good = true;
-      for (size_t ix = 0; ix < definitions.size(); ++ix) {
-        if (ix == stray_index || ix == non_stray_index) {
-          continue;
-        }
-        if (EqualTree(definitions[stray_index], definitions[ix])) {
-          // it doesn't hurt if we remove exact duplicates and then fail
-          RemoveNode(definitions[ix]);
-        } else {
-          good = false;
+      case XML_READER_TYPE_END_ELEMENT: {
+        const std::string name = std::move(ancestors.back());
+        ancestors.pop_back();
+        leave(name);
+        break;
+      }
+      case XML_READER_TYPE_TEXT:
+      case XML_READER_TYPE_CDATA:
+      case XML_READER_TYPE_COMMENT:
+      case XML_READER_TYPE_WHITESPACE:
+      case XML_READER_TYPE_SIGNIFICANT_WHITESPACE:
+        break;
+      case XML_READER_TYPE_PROCESSING_INSTRUCTION:
+      case XML_READER_TYPE_DOCUMENT_TYPE:
+        // only outside the root element
+        if (ancestors.empty()) {
           break;
         }
-      }
-      if (good) {
-        MoveNode(Child(definitions[stray_index]), definitions[non_stray_index]);
-        RemoveNode(definitions[stray_index]);
-        continue;
-      }
+        [[fallthrough]];
+      default:
+        Die() << "unexpected XML node type: " << type;
     }
-
-    Warn() << "unresolvable duplicate definitions found for type '" << id
-           << '\'';
+    status = descend ? xmlTextReaderRead(reader) : xmlTextReaderNext(reader);
   }
+  Check(status == 0) << "failed to parse input as XML";
 }
 
-}  // namespace
+using Reader = std::unique_ptr<std::remove_pointer_t<xmlTextReaderPtr>,
+                               void(*)(xmlTextReaderPtr)>;
 
-// Remove XML nodes and attributes that are neither used or wanted.
-void Clean(xmlNodePtr root) {
-  // Strip non-element nodes to simplify other operations.
-  StripNonElements(root);
+Reader OpenReader(const FileDescriptor& fd) {
+  Reader reader(xmlReaderForFd(fd.Value(), nullptr, nullptr, XML_PARSE_NONET),
+                xmlFreeTextReader);
+  Check(reader != nullptr) << "failed to create XML reader";
+  return reader;
+}
+
+// The id of an elf-symbol element, as found in alias and elf-symbol-id
+// attributes.
+std::string GetSymbolId(xmlNodePtr symbol) {
+  std::string id = GetAttributeOrDie(symbol, "name");
+  const auto version =
+      ReadAttribute<std::string>(symbol, "version", std::string());
+  if (!version.empty()) {
+    const bool is_default_version =
+        ReadAttribute<bool>(symbol, "is-default-version", false);
+    id += VersionInfoToString(
+        ElfSymbol::VersionInfo{is_default_version, version});
+  }
+  return id;
+}
 
-  // Strip location information.
-  StripLocationInfo(root);
+// The type ids referred to by the definitions and declarations of a document,
+// from which the definitions reachable from some symbols can be selected.
+class Reachability {
+ public:
+  // Notes an elf-symbol element and its aliases.
+  void AddSymbol(xmlNodePtr symbol) {
+    const auto id = GetSymbolId(symbol);
+    symbols_.push_back(id);
+    const auto alias = GetAttribute(symbol, "alias");
+    if (alias) {
+      std::istringstream is(*alias);
+      std::string item;
+      while (std::getline(is, item, ',')) {
+        alias_to_main_.emplace(item, id);
+      }
+    }
+  }
 
-  // Strip access.
-  StripAccess(root);
+  // Notes an element of an abi-instr or namespace-decl scope, with all its
+  // descendants.
+  void AddDefinition(xmlNodePtr element) {
+    const auto name = GetName(element);
+    const auto type_id = GetAttribute(element, "id");
+    if (type_id) {
+      AddEdges(type_id, element, type_edges_[*type_id]);
+    } else if (name == "var-decl" || name == "function-decl") {
+      const auto symbol_id = GetAttribute(element, "elf-symbol-id");
+      if (!symbol_id) {
+        return;
+      }
+      auto& edges = decl_edges_[*symbol_id];
+      AddEdges({}, element, edges);
+      // the link may yet be fixed up to refer to the declaration's name
+      const auto decl_name = GetAttribute(element, "name");
+      if (decl_name && *decl_name != *symbol_id) {
+        auto& other = decl_edges_[*decl_name];
+        other.insert(other.end(), edges.begin(), edges.end());
+      }
+    }
+  }
 
-  // Strip reachability attributes.
-  StripReachabilityAttributes(root);
-}
+  Selection Select(const Filter& filter) const {
+    Selection selection;
+    std::vector<std::string> pending;
+    const auto follow = [&](const auto& edges, const std::string& from) {
+      const auto it = edges.find(from);
+      if (it != edges.end()) {
+        pending.insert(pending.end(), it->second.begin(), it->second.end());
+      }
+    };
+    for (const auto& id : symbols_) {
+      if (!filter(id)) {
+        continue;
+      }
+      const auto main = alias_to_main_.find(id);
+      const auto& lookup = main != alias_to_main_.end() ? main->second : id;
+      if (selection.symbols.insert(lookup).second) {
+        follow(decl_edges_, lookup);
+      }
+    }
+    while (!pending.empty()) {
+      auto type_id = std::move(pending.back());
+      pending.pop_back();
+      const auto [it, inserted] = selection.types.insert(std::move(type_id));
+      if (inserted) {
+        follow(type_edges_, *it);
+      }
+    }
+    return selection;
+  }
 
-namespace {
+ private:
+  // Adds the type ids an element and its descendants refer to. A type defined
+  // within a definition, such as a member type, is only built along with it
+  // and so refers back to it.
+  void AddEdges(const std::optional<std::string>& owner, xmlNodePtr node,
+                std::vector<std::string>& edges) {
+    if (node->type != XML_ELEMENT_NODE) {
+      return;
+    }
+    const auto type_id = GetAttribute(node, "type-id");
+    if (type_id) {
+      edges.push_back(*type_id);
+    }
+    if (owner) {
+      const auto id = GetAttribute(node, "id");
+      if (id && *id != *owner) {
+        type_edges_[*id].push_back(*owner);
+      }
+    }
+    for (auto* child = Child(node); child; child = Next(child)) {
+      AddEdges(owner, child, edges);
+    }
+  }
 
-// Transform XML elements to improve their semantics.
-void Tidy(xmlNodePtr root) {
-  // Fix bad ELF symbol links
-  FixBadDwarfElfLinks(root);
+  std::vector<std::string> symbols_;
+  std::unordered_map<std::string, std::string> alias_to_main_;
+  // type id to the type ids its definition refers to
+  std::unordered_map<std::string, std::vector<std::string>> type_edges_;
+  // symbol id to the type ids its declarations refer to
+  std::unordered_map<std::string, std::vector<std::string>> decl_edges_;
+};
 
-  // Normalise anonymous type names.
-  // Reanonymise anonymous types.
-  // Discard naming typedef backlinks.
-  TidyAnonymousTypes(root);
+// Notes the symbols and scope elements of a document.
+void AddToReachability(xmlNodePtr node, Reachability& reachability) {
+  const auto name = GetName(node);
+  const bool scope = name == "abi-instr" || name == "namespace-decl";
+  for (auto* child = Child(node); child; child = Next(child)) {
+    if (child->type != XML_ELEMENT_NODE) {
+      continue;
+    }
+    const auto child_name = GetName(child);
+    if (child_name == "elf-symbol") {
+      reachability.AddSymbol(child);
+    } else if (scope && !Contains(kScopes, child_name)) {
+      reachability.AddDefinition(child);
+    } else {
+      AddToReachability(child, reachability);
+    }
+  }
+}
 
-  // Remove duplicate members.
-  RemoveDuplicateMembers(root);
+// Facts about a whole document needed to clean and tidy it piece by piece.
+struct Survey {
+  ElfLinks elf_links;
+  // type id to number of definitions in abi-instr and namespace-decl scopes
+  std::unordered_map<std::string, size_t> definitions;
+  // if wanted, what the symbols and definitions refer to
+  std::optional<Reachability> reachability;
+};
 
-  // Eliminate complete duplicates and extra fragments of types.
-  // Report conflicting duplicate defintions.
-  // Record whether there are conflicting duplicate definitions.
-  HandleDuplicateTypes(root);
+Survey SurveyDocument(const FileDescriptor& fd, bool reachability) {
+  Survey survey;
+  if (reachability) {
+    survey.reachability.emplace();
+  }
+  const Reader reader = OpenReader(fd);
+  const auto in_scope = [](const std::string& name) {
+    return Contains(kScopes, name);
+  };
+  Walk(
+      reader.get(),
+      [&](xmlNodePtr element, const std::vector<std::string>& ancestors) {
+        CountElfLink(element, survey.elf_links);
+        const auto name = GetName(element);
+        if (!ancestors.empty() && !Contains(kScopes, name)
+            && (ancestors.back() == "abi-instr"
+                || ancestors.back() == "namespace-decl")
+            && std::all_of(ancestors.begin(), ancestors.end(), in_scope)) {
+          const auto id = GetAttribute(element, "id");
+          if (id) {
+            ++survey.definitions[*id];
+          }
+          if (survey.reachability) {
+            xmlNodePtr expanded = xmlTextReaderExpand(reader.get());
+            Check(expanded != nullptr) << "failed to parse input as XML";
+            survey.reachability->AddDefinition(expanded);
+          }
+        } else if (survey.reachability && name == "elf-symbol") {
+          survey.reachability->AddSymbol(element);
+        }
+        return true;
+      },
+      [](const std::string&) {});
+  return survey;
 }
 
-std::optional<uint64_t> ParseLength(const std::string& value) {
+std::optional<uint64_t> ParseLength(std::string_view value) {
   if (value == "infinite" || value == "unknown") {
     return {0};
   }
   return Parse<uint64_t>(value);
 }
 
+constexpr std::string_view kNumberedTypeIdPrefix = "type-id-";
+// Beyond this, numbered type ids are not held densely. This bounds the memory
+// that a few stray large numbers can cost.
+constexpr size_t kMaxDenseTypeIdNumber = size_t{1} << 22;
+
+// Get N from a type id of the form type-id-N, if N is small enough to be held
+// densely. Leading zeros would let distinct type ids share an N.
+std::optional<size_t> ParseTypeIdNumber(std::string_view type_id) {
+  if (!type_id.starts_with(kNumberedTypeIdPrefix)) {
+    return {};
+  }
+  type_id.remove_prefix(kNumberedTypeIdPrefix.size());
+  if (type_id.size() > 1 && type_id[0] == '0') {
+    return {};
+  }
+  const auto number = ParseNumber<size_t>(type_id, 10);
+  if (!number || *number >= kMaxDenseTypeIdNumber) {
+    return {};
+  }
+  return number;
+}
+
 std::optional<PointerReference::Kind> ParseReferenceKind(
-    const std::string& value) {
+    std::string_view value) {
   if (value == "lvalue") {
     return {PointerReference::Kind::LVALUE_REFERENCE};
   } else if (value == "rvalue") {
@@ -790,20 +1183,77 @@ std::optional<PointerReference::Kind> ParseReferenceKind(
   return {};
 }
 
+struct MoveNodeValue {
+  template <typename Node>
+  void operator()(Node& node) {
+    graph.Set<Node>(id, std::move(node));
+  }
+
+  Graph& graph;
+  Id id;
+};
+
 }  // namespace
 
-Abigail::Abigail(Graph& graph) : graph_(graph) {}
+Abigail::Abigail(Graph& graph, size_t jobs, bool hash_cons,
+                 const Filter* symbol_filter)
+    : graph_(graph), jobs_(jobs), symbol_filter_(symbol_filter) {
+  if (hash_cons) {
+    consing_.emplace(graph_);
+  }
+}
+
+template <typename Node, typename... Args>
+Id Abigail::Add(Args&&... args) {
+  return consing_ ? consing_->Add<Node>(std::forward<Args>(args)...)
+                  : graph_.Add<Node>(std::forward<Args>(args)...);
+}
 
-Id Abigail::GetNode(const std::string& type_id) {
-  const auto [it, inserted] = type_ids_.insert({type_id, Id(0)});
-  if (inserted) {
-    it->second = graph_.Allocate();
+template <typename Node, typename... Args>
+void Abigail::Set(Id id, Args&&... args) {
+  if (consing_) {
+    consing_->Set<Node>(id, std::forward<Args>(args)...);
+  } else {
+    graph_.Set<Node>(id, std::forward<Args>(args)...);
+  }
+}
+
+Id Abigail::GetNode(std::string_view type_id) {
+  const auto number = ParseTypeIdNumber(type_id);
+  if (number) {
+    if (*number >= numbered_type_ids_.size()) {
+      numbered_type_ids_.resize(*number + 1, Id::kInvalid);
+    }
+    auto& id = numbered_type_ids_[*number];
+    if (id == Id::kInvalid) {
+      id = graph_.Allocate();
+    }
+    return id;
+  }
+  auto it = type_ids_.find(type_id);
+  if (it == type_ids_.end()) {
+    it = type_ids_.emplace(type_id, graph_.Allocate()).first;
   }
   return it->second;
 }
 
+// Calls function(type_id, id) for each allocated type id.
+template <typename Function>
+void Abigail::ForEachTypeId(Function&& function) const {
+  for (size_t number = 0; number < numbered_type_ids_.size(); ++number) {
+    const Id id = numbered_type_ids_[number];
+    if (id != Id::kInvalid) {
+      function(std::string(kNumberedTypeIdPrefix) + std::to_string(number), id);
+    }
+  }
+  for (const auto& [type_id, id] : type_ids_) {
+    function(type_id, id);
+  }
+}
+
 Id Abigail::GetEdge(xmlNodePtr element) {
-  return GetNode(GetAttributeOrDie(element, "type-id"));
+  std::string buffer;
+  return GetNode(GetAttributeViewOrDie(element, "type-id", buffer));
 }
 
 Id Abigail::GetVariadic() {
@@ -814,7 +1264,7 @@ Id Abigail::GetVariadic() {
 }
 
 Function Abigail::MakeFunctionType(xmlNodePtr function) {
-  std::vector<Id> parameters;
+  Ids parameters;
   std::optional<Id> return_type;
   for (auto* child = Child(function); child; child = Next(child)) {
     const auto child_name = GetName(child);
@@ -834,12 +1284,35 @@ Function Abigail::MakeFunctionType(xmlNodePtr function) {
   if (!return_type) {
     Die() << "missing return-type";
   }
-  return Function(*return_type, parameters);
+  return Function(*return_type, std::move(parameters));
 }
 
-Id Abigail::ProcessRoot(xmlNodePtr root) {
-  Clean(root);
-  Tidy(root);
+Id Abigail::ProcessRoot(xmlNodePtr root, Metrics& metrics) {
+  // Node-local transformations are done in as few walks as possible. Fixing
+  // ELF links needs counts over the whole document and handling duplicate
+  // types needs all the definitions of each type.
+  ElfLinks elf_links;
+  {
+    Time t(metrics, "abigail.clean");
+    CleanTree(root, &elf_links);
+  }
+  {
+    Time t(metrics, "abigail.tidy");
+    TidyTree(root, elf_links);
+  }
+  {
+    // Eliminate complete duplicates and extra fragments of types.
+    // Report conflicting duplicate defintions.
+    Time t(metrics, "abigail.duplicate_types");
+    HandleDuplicateTypes(root);
+  }
+  if (symbol_filter_ != nullptr) {
+    Time t(metrics, "abigail.select");
+    Reachability reachability;
+    AddToReachability(root, reachability);
+    selection_ = std::make_shared<const Selection>(
+        reachability.Select(*symbol_filter_));
+  }
   const auto name = GetName(root);
   if (name == "abi-corpus-group") {
     ProcessCorpusGroup(root);
@@ -848,20 +1321,245 @@ Id Abigail::ProcessRoot(xmlNodePtr root) {
   } else {
     Die() << "unrecognised root element '" << name << "'";
   }
-  for (const auto& [type_id, id] : type_ids_) {
+  return Finish(metrics);
+}
+
+Id Abigail::ProcessFile(const std::string& path, Metrics& metrics) {
+  FileDescriptor fd(path.c_str(), O_RDONLY);
+  struct stat st;
+  Check(fstat(fd.Value(), &st) == 0) << "failed to stat '" << path << "'";
+  if (!S_ISREG(st.st_mode)) {
+    // the input cannot be read twice
+    const Document document = Read(path, metrics);
+    xmlNodePtr root = xmlDocGetRootElement(document.get());
+    Check(root) << "XML document has no root element";
+    return ProcessRoot(root, metrics);
+  }
+
+  Survey survey;
+  {
+    Time t(metrics, "abigail.survey");
+    survey = SurveyDocument(fd, symbol_filter_ != nullptr);
+  }
+  if (survey.reachability) {
+    Time t(metrics, "abigail.select");
+    selection_ = std::make_shared<const Selection>(
+        survey.reachability->Select(*symbol_filter_));
+  }
+  Check(lseek(fd.Value(), 0, SEEK_SET) == 0)
+      << "failed to rewind '" << path << "'";
+
+  Time t(metrics, "abigail.stream");
+  // Expanded elements are copied here, until they are no longer needed. Symbol
+  // elements are needed until the symbols are built.
+  Document scratch(xmlNewDoc(nullptr), xmlFreeDoc);
+  xmlNodePtr holder = xmlNewDocNode(scratch.get(), nullptr,
+                                    ToLibxml("scratch"), nullptr);
+  xmlDocSetRootElement(scratch.get(), holder);
+  const Reader reader = OpenReader(fd);
+  const auto copy = [&]() {
+    xmlNodePtr element = xmlTextReaderExpand(reader.get());
+    Check(element != nullptr) << "failed to parse input as XML";
+    xmlNodePtr result = xmlDocCopyNode(element, scratch.get(), 1);
+    Check(result != nullptr) << "failed to copy XML element";
+    xmlAddChild(holder, result);
+    return result;
+  };
+
+  // Types with multiple definitions are deferred until all have been seen.
+  struct Definition {
+    xmlNodePtr element;
+    NamespaceScope namespaces;
+    Scope scope_name;
+  };
+  std::unordered_map<std::string, std::vector<Definition>> pending;
+  NamespaceScope namespaces;
+  std::deque<PushScopeName> push_scope_names;
+
+  const auto process = [&](xmlNodePtr element) {
+    CleanAndTidyTree(element, survey.elf_links);
+    const auto type_id = GetAttribute(element, "id");
+    size_t count = 1;
+    if (type_id) {
+      const auto it = survey.definitions.find(*type_id);
+      if (it != survey.definitions.end()) {
+        count = it->second;
+      }
+    }
+    if (count == 1) {
+      ProcessScopeElement(element);
+      RemoveNode(element);
+      return;
+    }
+    auto& definitions = pending[*type_id];
+    definitions.push_back({element, namespaces, scope_name_});
+    if (definitions.size() < count) {
+      return;
+    }
+    std::set<NamespaceScope> scopes;
+    std::vector<xmlNodePtr> elements;
+    for (const auto& definition : definitions) {
+      scopes.insert(definition.namespaces);
+      elements.push_back(definition.element);
+    }
+    HandleDuplicateType(*type_id, scopes, elements);
+    for (size_t ix = 0; ix < elements.size(); ++ix) {
+      if (elements[ix] != nullptr) {
+        std::swap(scope_name_, definitions[ix].scope_name);
+        ProcessScopeElement(elements[ix]);
+        std::swap(scope_name_, definitions[ix].scope_name);
+        RemoveNode(elements[ix]);
+      }
+    }
+    pending.erase(*type_id);
+  };
+
+  Walk(
+      reader.get(),
+      [&](xmlNodePtr element, const std::vector<std::string>& ancestors) {
+        const auto name = GetName(element);
+        if (ancestors.empty()) {
+          if (name != "abi-corpus-group" && name != "abi-corpus") {
+            Die() << "unrecognised root element '" << name << "'";
+          }
+          return true;
+        }
+        const auto& parent = ancestors.back();
+        if (parent == "abi-corpus-group") {
+          CheckName("abi-corpus", element);
+          return true;
+        }
+        if (parent == "abi-corpus") {
+          if (name == "elf-function-symbols" || name == "elf-variable-symbols"
+              || name == "abi-instr") {
+            return true;
+          } else if (name == "elf-needed") {
+            // ignore this
+            return false;
+          }
+          Die() << "unrecognised abi-corpus child element '" << name << "'";
+        }
+        if (parent == "elf-function-symbols"
+            || parent == "elf-variable-symbols") {
+          CheckName("elf-symbol", element);
+          xmlNodePtr symbol = copy();
+          CleanTree(symbol, nullptr);
+          ProcessSymbol(symbol);
+          return false;
+        }
+        // parent is abi-instr or namespace-decl
+        if (name == "namespace-decl" && !GetAttribute(element, "id")) {
+          const auto namespace_name = GetAttributeOrDie(element, "name");
+          namespaces.push_back(namespace_name);
+          push_scope_names.emplace_back(scope_name_, "namespace",
+                                        namespace_name);
+          return true;
+        }
+        process(copy());
+        return false;
+      },
+      [&](const std::string& name) {
+        if (name == "namespace-decl") {
+          namespaces.pop_back();
+          push_scope_names.pop_back();
+        }
+      });
+  Check(pending.empty()) << "internal error: unresolved duplicate types";
+  return Finish(metrics);
+}
+
+Id Abigail::Finish(Metrics& metrics) {
+  ForEachTypeId([&](const std::string& type_id, Id id) {
     if (!graph_.Is(id)) {
       Warn() << "no definition found for type '" << type_id << "'";
     }
-  }
+  });
   const Id id = BuildSymbols();
+  if (symbol_filter_ != nullptr) {
+    Counter(metrics, "abigail.filtered_symbols") = filtered_symbols_;
+    Counter(metrics, "abigail.skipped_types") = skipped_types_;
+  }
   RemoveUselessQualifiers(graph_, id);
   return id;
 }
 
 void Abigail::ProcessCorpusGroup(xmlNodePtr group) {
+  std::vector<xmlNodePtr> corpora;
   for (auto* corpus = Child(group); corpus; corpus = Next(corpus)) {
     CheckName("abi-corpus", corpus);
-    ProcessCorpus(corpus);
+    corpora.push_back(corpus);
+  }
+  if (jobs_ == 1 || corpora.size() < 2) {
+    for (auto* corpus : corpora) {
+      ProcessCorpus(corpus);
+    }
+    return;
+  }
+  // Only the XML document is shared between the workers and it is not
+  // modified during processing.
+  std::vector<Graph> graphs(corpora.size());
+  std::vector<Abigail> fragments;
+  fragments.reserve(corpora.size());
+  for (auto& graph : graphs) {
+    fragments.emplace_back(graph, 1, consing_.has_value()).selection_ =
+        selection_;
+  }
+  ForEachIndex(jobs_, corpora.size(), [&](size_t, size_t index) {
+    fragments[index].ProcessCorpus(corpora[index]);
+  });
+  for (size_t index = 0; index < corpora.size(); ++index) {
+    Merge(fragments[index]);
+    // release memory early
+    graphs[index] = Graph();
+  }
+}
+
+// Moves the nodes of a fragment into this graph, sharing the nodes of type
+// ids and the variadic parameter type, and merges the symbol information.
+void Abigail::Merge(Abigail& fragment) {
+  Graph& from = fragment.graph_;
+  std::vector<Id> mapping(from.Limit().ix_, Id::kInvalid);
+  fragment.ForEachTypeId([&](const std::string& type_id, Id id) {
+    mapping[id.ix_] = GetNode(type_id);
+  });
+  const auto variadic = fragment.variadic_;
+  if (variadic) {
+    mapping[variadic->ix_] = GetVariadic();
+  }
+  from.ForEach(Id(0), from.Limit(), [&](Id id) {
+    if (mapping[id.ix_] == Id::kInvalid) {
+      mapping[id.ix_] = graph_.Allocate();
+    }
+  });
+  const auto remap = [&](Id& id) {
+    id = mapping[id.ix_];
+  };
+  Substitute substitute(from, remap);
+  from.ForEach(Id(0), from.Limit(), [&](Id id) {
+    if (id != variadic) {
+      substitute(id);
+      MoveNodeValue move{graph_, mapping[id.ix_]};
+      from.Apply<void>(move, id);
+    }
+  });
+
+  skipped_types_ += fragment.skipped_types_;
+  for (auto& [symbol_id, symbol_info] : fragment.symbol_info_map_) {
+    Check(symbol_info_map_.emplace(symbol_id, std::move(symbol_info)).second)
+        << "multiple symbols with id " << symbol_id;
+  }
+  for (const auto& [alias, main] : fragment.alias_to_main_) {
+    Check(alias_to_main_.emplace(alias, main).second)
+        << "multiple aliases with id " << main;
+  }
+  for (const auto& [symbol_id, type_and_name] :
+       fragment.symbol_id_and_full_name_) {
+    const auto& [type, name] = type_and_name;
+    const auto [it, inserted] = symbol_id_and_full_name_.emplace(
+        symbol_id, std::make_pair(mapping[type.ix_], name));
+    if (!inserted) {
+      Die() << "duplicate type for '" << symbol_id << "'";
+    }
   }
 }
 
@@ -939,40 +1637,68 @@ bool Abigail::ProcessUserDefinedType(std::string_view name, Id id,
 
 void Abigail::ProcessScope(xmlNodePtr scope) {
   for (auto* element = Child(scope); element; element = Next(element)) {
-    const auto name = GetName(element);
-    const auto type_id = GetAttribute(element, "id");
-    // all type elements have "id", all non-types do not
+    ProcessScopeElement(element);
+  }
+}
+
+// Whether a scope element is to be built. Elements other than types and
+// declarations, such as namespaces, always are.
+bool Abigail::IsSelected(std::string_view name,
+                         const std::optional<std::string>& type_id,
+                         xmlNodePtr element) const {
+  if (!selection_) {
+    return true;
+  }
+  if (type_id) {
+    return selection_->types.contains(*type_id);
+  }
+  if (name == "var-decl" || name == "function-decl") {
+    const auto symbol_id = GetAttribute(element, "elf-symbol-id");
+    return symbol_id && selection_->symbols.contains(*symbol_id);
+  }
+  return true;
+}
+
+void Abigail::ProcessScopeElement(xmlNodePtr element) {
+  const auto name = GetName(element);
+  const auto type_id = GetAttribute(element, "id");
+  if (!IsSelected(name, type_id, element)) {
     if (type_id) {
-      const auto id = GetNode(*type_id);
-      if (graph_.Is(id)) {
-        Warn() << "duplicate definition of type '" << *type_id << '\'';
-        continue;
-      }
-      if (name == "function-type") {
-        ProcessFunctionType(id, element);
-      } else if (name == "pointer-type-def") {
-        ProcessPointer(id, true, element);
-      } else if (name == "reference-type-def") {
-        ProcessPointer(id, false, element);
-      } else if (name == "qualified-type-def") {
-        ProcessQualified(id, element);
-      } else if (name == "array-type-def") {
-        ProcessArray(id, element);
-      } else if (name == "type-decl") {
-        ProcessTypeDecl(id, element);
-      } else if (!ProcessUserDefinedType(name, id, element)) {
-        Die() << "bad abi-instr type child element '" << name << "'";
-      }
+      ++skipped_types_;
+    }
+    return;
+  }
+  // all type elements have "id", all non-types do not
+  if (type_id) {
+    const auto id = GetNode(*type_id);
+    if (graph_.Is(id)) {
+      Warn() << "duplicate definition of type '" << *type_id << '\'';
+      return;
+    }
+    if (name == "function-type") {
+      ProcessFunctionType(id, element);
+    } else if (name == "pointer-type-def") {
+      ProcessPointer(id, true, element);
+    } else if (name == "reference-type-def") {
+      ProcessPointer(id, false, element);
+    } else if (name == "qualified-type-def") {
+      ProcessQualified(id, element);
+    } else if (name == "array-type-def") {
+      ProcessArray(id, element);
+    } else if (name == "type-decl") {
+      ProcessTypeDecl(id, element);
+    } else if (!ProcessUserDefinedType(name, id, element)) {
+      Die() << "bad abi-instr type child element '" << name << "'";
+    }
+  } else {
+    if (name == "var-decl") {
+      ProcessDecl(true, element);
+    } else if (name == "function-decl") {
+      ProcessDecl(false, element);
+    } else if (name == "namespace-decl") {
+      ProcessNamespace(element);
     } else {
-      if (name == "var-decl") {
-        ProcessDecl(true, element);
-      } else if (name == "function-decl") {
-        ProcessDecl(false, element);
-      } else if (name == "namespace-decl") {
-        ProcessNamespace(element);
-      } else {
-        Die() << "bad abi-instr non-type child element '" << name << "'";
-      }
+      Die() << "bad abi-instr non-type child element '" << name << "'";
     }
   }
 }
@@ -988,10 +1714,10 @@ void Abigail::ProcessNamespace(xmlNodePtr scope) {
 }
 
 Id Abigail::ProcessDecl(bool is_variable, xmlNodePtr decl) {
-  const auto name = scope_name_ + GetAttributeOrDie(decl, "name");
+  const auto name = GetScopedNameOrDie(scope_name_, decl);
   const auto symbol_id = GetAttribute(decl, "elf-symbol-id");
   const auto type = is_variable ? GetEdge(decl)
-                                : graph_.Add<Function>(MakeFunctionType(decl));
+                                : Add<Function>(MakeFunctionType(decl));
   if (symbol_id) {
     // There's a link to an ELF symbol.
     const auto [it, inserted] = symbol_id_and_full_name_.emplace(
@@ -1004,11 +1730,11 @@ Id Abigail::ProcessDecl(bool is_variable, xmlNodePtr decl) {
 }
 
 void Abigail::ProcessFunctionType(Id id, xmlNodePtr function) {
-  graph_.Set<Function>(id, MakeFunctionType(function));
+  Set<Function>(id, MakeFunctionType(function));
 }
 
 void Abigail::ProcessTypedef(Id id, xmlNodePtr type_definition) {
-  const auto name = scope_name_ + GetAttributeOrDie(type_definition, "name");
+  const auto name = GetScopedNameOrDie(scope_name_, type_definition);
   const auto type = GetEdge(type_definition);
   graph_.Set<Typedef>(id, name, type);
 }
@@ -1018,7 +1744,7 @@ void Abigail::ProcessPointer(Id id, bool is_pointer, xmlNodePtr pointer) {
   const auto kind = is_pointer ? PointerReference::Kind::POINTER
                                : ReadAttribute<PointerReference::Kind>(
                                      pointer, "kind", &ParseReferenceKind);
-  graph_.Set<PointerReference>(id, kind, type);
+  Set<PointerReference>(id, kind, type);
 }
 
 void Abigail::ProcessQualified(Id id, xmlNodePtr qualified) {
@@ -1042,9 +1768,9 @@ void Abigail::ProcessQualified(Id id, xmlNodePtr qualified) {
     --count;
     const Qualified node(qualifier, type);
     if (count) {
-      type = graph_.Add<Qualified>(node);
+      type = Add<Qualified>(node);
     } else {
-      graph_.Set<Qualified>(id, node);
+      Set<Qualified>(id, node);
     }
   }
 }
@@ -1074,15 +1800,15 @@ void Abigail::ProcessArray(Id id, xmlNodePtr array) {
     const auto size = *it;
     const Array node(size, type);
     if (count) {
-      type = graph_.Add<Array>(node);
+      type = Add<Array>(node);
     } else {
-      graph_.Set<Array>(id, node);
+      Set<Array>(id, node);
     }
   }
 }
 
 void Abigail::ProcessTypeDecl(Id id, xmlNodePtr type_decl) {
-  const auto name = scope_name_ + GetAttributeOrDie(type_decl, "name");
+  const auto name = GetScopedNameOrDie(scope_name_, type_decl);
   const auto bits = ReadAttribute<size_t>(type_decl, "size-in-bits", 0);
   if (bits % 8) {
     Die() << "size-in-bits is not a multiple of 8";
@@ -1090,11 +1816,11 @@ void Abigail::ProcessTypeDecl(Id id, xmlNodePtr type_decl) {
   const auto bytes = bits / 8;
 
   if (name == "void") {
-    graph_.Set<Special>(id, Special::Kind::VOID);
+    Set<Special>(id, Special::Kind::VOID);
   } else {
     // libabigail doesn't model encoding at all and we don't want to parse names
     // (which will not always work) in an attempt to reconstruct it.
-    graph_.Set<Primitive>(id, name, /* encoding= */ std::nullopt, bytes);
+    Set<Primitive>(id, name, /* encoding= */ std::nullopt, bytes);
   }
 }
 
@@ -1113,7 +1839,7 @@ void Abigail::ProcessStructUnion(Id id, bool is_struct,
   const auto name =
       is_anonymous ? std::string() : GetAttributeOrDie(struct_union, "name");
   const auto full_name =
-      is_anonymous ? std::string() : scope_name_ + name;
+      is_anonymous ? std::string() : ScopedName(scope_name_, name);
   const PushScopeName push_scope_name(scope_name_, kind, name);
   if (forward) {
     graph_.Set<StructUnion>(id, kind, full_name);
@@ -1122,9 +1848,9 @@ void Abigail::ProcessStructUnion(Id id, bool is_struct,
   const auto bits = ReadAttribute<size_t>(struct_union, "size-in-bits", 0);
   const auto bytes = (bits + 7) / 8;
 
-  std::vector<Id> base_classes;
-  std::vector<Id> methods;
-  std::vector<Id> members;
+  Ids base_classes;
+  Ids methods;
+  Ids members;
   for (auto* child = Child(struct_union); child; child = Next(child)) {
     const auto child_name = GetName(child);
     if (child_name == "data-member") {
@@ -1143,15 +1869,15 @@ void Abigail::ProcessStructUnion(Id id, bool is_struct,
     }
   }
 
-  graph_.Set<StructUnion>(id, kind, full_name, bytes, base_classes, methods,
-                          members);
+  graph_.Set<StructUnion>(id, kind, full_name, bytes, std::move(base_classes),
+                          std::move(methods), std::move(members));
 }
 
 void Abigail::ProcessEnum(Id id, xmlNodePtr enumeration) {
   bool forward = ReadAttribute<bool>(enumeration, "is-declaration-only", false);
   const auto name = ReadAttribute<bool>(enumeration, "is-anonymous", false)
                     ? std::string()
-                    : scope_name_ + GetAttributeOrDie(enumeration, "name");
+                    : GetScopedNameOrDie(scope_name_, enumeration);
   if (forward) {
     graph_.Set<Enumeration>(id, name);
     return;
@@ -1162,7 +1888,7 @@ void Abigail::ProcessEnum(Id id, xmlNodePtr enumeration) {
   CheckName("underlying-type", underlying);
   const auto type = GetEdge(underlying);
 
-  std::vector<std::pair<std::string, int64_t>> enumerators;
+  Enumeration::Enumerators enumerators;
   for (auto* enumerator = Next(underlying); enumerator;
        enumerator = Next(enumerator)) {
     CheckName("enumerator", enumerator);
@@ -1170,10 +1896,10 @@ void Abigail::ProcessEnum(Id id, xmlNodePtr enumeration) {
     // libabigail currently supports anything that fits in an int64_t
     const auto enumerator_value =
         ReadAttributeOrDie<int64_t>(enumerator, "value");
-    enumerators.emplace_back(enumerator_name, enumerator_value);
+    enumerators.emplace_back(graph_.Intern(enumerator_name), enumerator_value);
   }
 
-  graph_.Set<Enumeration>(id, name, type, enumerators);
+  graph_.Set<Enumeration>(id, name, type, std::move(enumerators));
 }
 
 Id Abigail::ProcessBaseClass(xmlNodePtr base_class) {
@@ -1205,8 +1931,7 @@ std::optional<Id> Abigail::ProcessDataMember(bool is_struct,
   return {graph_.Add<Member>(name, type, offset, 0)};
 }
 
-void Abigail::ProcessMemberFunction(std::vector<Id>& methods,
-                                    xmlNodePtr method) {
+void Abigail::ProcessMemberFunction(Ids& methods, xmlNodePtr method) {
   xmlNodePtr decl = GetOnlyChild(method);
   CheckName("function-decl", decl);
   // ProcessDecl creates symbol references so must be called unconditionally.
@@ -1267,8 +1992,13 @@ Id Abigail::BuildSymbols() {
         << "found main symbol and alias with id " << main;
   }
   // Build final symbol table, tying symbols to their types.
-  std::map<std::string, Id> symbols;
+  std::vector<std::pair<std::string, Id>> symbols;
+  symbols.reserve(symbol_info_map_.size());
   for (const auto& [id, symbol_info] : symbol_info_map_) {
+    if (symbol_filter_ != nullptr && !(*symbol_filter_)(id)) {
+      ++filtered_symbols_;
+      continue;
+    }
     const auto main = alias_to_main_.find(id);
     const auto lookup = main != alias_to_main_.end() ? main->second : id;
     const auto type_id_and_name_it = symbol_id_and_full_name_.find(lookup);
@@ -1279,9 +2009,9 @@ Id Abigail::BuildSymbols() {
       type_id = {type_id_and_name.first};
       name = {type_id_and_name.second};
     }
-    symbols.insert({id, BuildSymbol(symbol_info, type_id, name)});
+    symbols.emplace_back(id, BuildSymbol(symbol_info, type_id, name));
   }
-  return graph_.Add<Interface>(symbols);
+  return graph_.Add<Interface>(FlatMap<std::string, Id>(std::move(symbols)));
 }
 
 Document Read(const std::string& path, Metrics& metrics) {
@@ -1304,11 +2034,10 @@ Document Read(const std::string& path, Metrics& metrics) {
   return document;
 }
 
-Id Read(Graph& graph, const std::string& path, Metrics& metrics) {
-  const Document document = Read(path, metrics);
-  xmlNodePtr root = xmlDocGetRootElement(document.get());
-  Check(root) << "XML document has no root element";
-  return Abigail(graph).ProcessRoot(root);
+Id Read(Graph& graph, const std::string& path, Metrics& metrics,
+        size_t jobs, bool hash_cons, const Filter* symbol_filter) {
+  return Abigail(graph, jobs, hash_cons, symbol_filter)
+      .ProcessFile(path, metrics);
 }
 
 }  // namespace abixml
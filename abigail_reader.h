@@ -21,17 +21,22 @@
 #ifndef STG_ABIGAIL_READER_H_
 #define STG_ABIGAIL_READER_H_
 
+#include <cstddef>
+#include <functional>
 #include <memory>
 #include <optional>
 #include <string>
 #include <string_view>
 #include <type_traits>
 #include <unordered_map>
+#include <unordered_set>
 #include <utility>
 #include <vector>
 
 #include <libxml/tree.h>
+#include "filter.h"
 #include "graph.h"
+#include "hash_consing.h"
 #include "metrics.h"
 #include "scope.h"
 
@@ -40,7 +45,8 @@ namespace abixml {
 
 // Parser for libabigail's ABI XML format, creating a Symbol-Type Graph.
 //
-// On construction Abigail consumes a libxml node tree and builds a graph.
+// Abigail consumes either a libxml node tree or, piece by piece, an XML file
+// and builds a graph.
 //
 // The parser supports C types only, with C++ types to be added later.
 //
@@ -75,10 +81,30 @@ namespace abixml {
 // post-processing phase.
 //
 // 4. XML anonymous types also have unhelpful names, these are ignored.
+// The definitions to build when only those reachable from the symbols accepted
+// by a symbol filter are wanted: the ids of the types reachable from their
+// declarations and the symbol ids those declarations may link to.
+struct Selection {
+  std::unordered_set<std::string> types;
+  std::unordered_set<std::string> symbols;
+};
+
 class Abigail {
  public:
-  explicit Abigail(Graph& graph);
-  Id ProcessRoot(xmlNodePtr root);
+  // With more than one job, the corpora of a corpus group are processed
+  // concurrently, each into a graph fragment of its own, and then merged.
+  // With hash-consing, identical simple nodes are shared as they are read.
+  // With a symbol filter, only the symbols it accepts are built, together with
+  // the declarations and types they reach.
+  explicit Abigail(Graph& graph, size_t jobs = 1, bool hash_cons = false,
+                   const Filter* symbol_filter = nullptr);
+  Id ProcessRoot(xmlNodePtr root, Metrics& metrics);
+  // Reads the file twice, first to survey the document and then to clean,
+  // tidy and process each element of each scope in turn, without building the
+  // whole tree. Only the definitions of types with duplicate definitions are
+  // retained, until their last one has been read. If the file cannot be read
+  // twice, this falls back to ProcessRoot.
+  Id ProcessFile(const std::string& path, Metrics& metrics);
 
  private:
   struct SymbolInfo {
@@ -88,13 +114,32 @@ class Abigail {
   };
 
   Graph& graph_;
+  size_t jobs_;
+  std::optional<HashConsing> consing_;
+  const Filter* symbol_filter_;
+  // symbols left out by the symbol filter
+  size_t filtered_symbols_ = 0;
+  // if set, only these definitions are built, shared with any fragments
+  std::shared_ptr<const Selection> selection_;
+  // type definitions left out as they are not selected
+  size_t skipped_types_ = 0;
 
   // The STG IR uses a distinct node type for the variadic parameter type; if
   // allocated, this is its STG node id.
   std::optional<Id> variadic_;
+  // Transparent hashing so that type ids can be looked up by std::string_view.
+  struct TypeIdHash {
+    using is_transparent = void;
+    size_t operator()(std::string_view type_id) const {
+      return std::hash<std::string_view>{}(type_id);
+    }
+  };
+
   // Map from libabigail type ids to STG node ids; except for the type of
-  // variadic parameters.
-  std::unordered_map<std::string, Id> type_ids_;
+  // variadic parameters. Type ids are usually of the form type-id-N and these
+  // are held densely, indexed by N, with unallocated entries Id::kInvalid.
+  std::vector<Id> numbered_type_ids_;
+  std::unordered_map<std::string, Id, TypeIdHash, std::equal_to<>> type_ids_;
 
   // symbol id to symbol information
   std::unordered_map<std::string, SymbolInfo> symbol_info_map_;
@@ -108,18 +153,30 @@ class Abigail {
   // Full name of the current scope.
   Scope scope_name_;
 
-  Id GetNode(const std::string& type_id);
+  Id GetNode(std::string_view type_id);
+  template <typename Function>
+  void ForEachTypeId(Function&& function) const;
   Id GetEdge(xmlNodePtr element);
   Id GetVariadic();
+  // These go through hash-consing, if enabled.
+  template <typename Node, typename... Args>
+  Id Add(Args&&... args);
+  template <typename Node, typename... Args>
+  void Set(Id id, Args&&... args);
   Function MakeFunctionType(xmlNodePtr function);
 
   void ProcessCorpusGroup(xmlNodePtr group);
   void ProcessCorpus(xmlNodePtr corpus);
+  void Merge(Abigail& fragment);
   void ProcessSymbols(xmlNodePtr symbols);
   void ProcessSymbol(xmlNodePtr symbol);
 
   bool ProcessUserDefinedType(std::string_view name, Id id, xmlNodePtr decl);
   void ProcessScope(xmlNodePtr scope);
+  bool IsSelected(std::string_view name,
+                  const std::optional<std::string>& type_id,
+                  xmlNodePtr element) const;
+  void ProcessScopeElement(xmlNodePtr element);
 
   void ProcessInstr(xmlNodePtr instr);
   void ProcessNamespace(xmlNodePtr scope);
@@ -137,16 +194,19 @@ class Abigail {
 
   Id ProcessBaseClass(xmlNodePtr base_class);
   std::optional<Id> ProcessDataMember(bool is_struct, xmlNodePtr data_member);
-  void ProcessMemberFunction(std::vector<Id>& methods, xmlNodePtr method);
+  void ProcessMemberFunction(Ids& methods, xmlNodePtr method);
   void ProcessMemberType(xmlNodePtr member_type);
 
   Id BuildSymbol(const SymbolInfo& info,
                  std::optional<Id> type_id,
                  const std::optional<std::string>& name);
   Id BuildSymbols();
+  Id Finish(Metrics& metrics);
 };
 
-Id Read(Graph& graph, const std::string& path, Metrics& metrics);
+Id Read(Graph& graph, const std::string& path, Metrics& metrics,
+        size_t jobs = 1, bool hash_cons = false,
+        const Filter* symbol_filter = nullptr);
 
 // Exposed for testing.
 void Clean(xmlNodePtr root);
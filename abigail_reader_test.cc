@@ -24,10 +24,14 @@
 #include <optional>
 #include <ostream>
 #include <sstream>
+#include <span>
+#include <string>
 #include <vector>
 
 #include <catch2/catch.hpp>
 #include "abigail_reader.h"
+#include "error.h"
+#include "filter.h"
 #include "graph.h"
 #include "metrics.h"
 #include "equality.h"
@@ -48,6 +52,15 @@ stg::Id Read(stg::Graph& graph, const char* input) {
   return stg::abixml::Read(graph, filename_to_path(input), metrics);
 }
 
+// Useless equality cache.
+struct NoCache {
+  static std::optional<bool> Query(const stg::Pair&) {
+    return std::nullopt;
+  }
+  void AllSame(std::span<const stg::Pair>) {}
+  void AllDifferent(std::span<const stg::Pair>) {}
+};
+
 struct EqualTreeTestCase {
   const char* name;
   const char* left;
@@ -210,15 +223,6 @@ TEST_CASE("Tidy") {
       ids.push_back(Read(graph, file));
     }
 
-    // Useless equality cache.
-    struct NoCache {
-      static std::optional<bool> Query(const stg::Pair&) {
-        return std::nullopt;
-      }
-      void AllSame(const std::vector<stg::Pair>&) {}
-      void AllDifferent(const std::vector<stg::Pair>&) {}
-    };
-
     // Check exact equality.
     NoCache cache;
     for (size_t ix = 1; ix < ids.size(); ++ix) {
@@ -227,4 +231,134 @@ TEST_CASE("Tidy") {
   }
 }
 
+TEST_CASE("streaming matches document") {
+  const char* file = GENERATE(
+      "abigail_anonymous_types_0.xml",
+      "abigail_anonymous_types_4.xml",
+      "abigail_bad_dwarf_elf_link_0.xml",
+      "abigail_bad_dwarf_elf_link_2.xml",
+      "abigail_clean.xml",
+      "abigail_dirty.xml",
+      "abigail_duplicate_data_members_0.xml",
+      "abigail_duplicate_types_1.xml",
+      "abigail_duplicate_types_3.xml",
+      "abigail_duplicate_types_5.xml",
+      "abigail_duplicate_types_6.xml",
+      "abigail_duplicate_types_8.xml",
+      "added_removed_symbols_0.xml",
+      "crc_1.xml",
+      "offset_0.xml",
+      "symbol_type_presence_1.xml",
+      "type_declaration_status_0.xml");
+
+  SECTION(file) {
+    stg::Graph graph;
+    const stg::abixml::Document document = Read(file);
+    xmlNodePtr root = xmlDocGetRootElement(document.get());
+    stg::Metrics metrics;
+    const auto id0 = stg::abixml::Abigail(graph).ProcessRoot(root, metrics);
+    const auto id1 = Read(graph, file);
+    NoCache cache;
+    CHECK(stg::Equals<NoCache>(graph, cache)(id0, id1));
+  }
+}
+
+TEST_CASE("corpus group fragments match whole") {
+  const char* file = "abigail_corpus_group_0.xml";
+  const size_t jobs = GENERATE(2, 3, 4);
+  stg::Graph graph;
+  stg::Metrics metrics;
+  const stg::abixml::Document document0 = Read(file);
+  xmlNodePtr root0 = xmlDocGetRootElement(document0.get());
+  const auto id0 = stg::abixml::Abigail(graph).ProcessRoot(root0, metrics);
+  const stg::abixml::Document document1 = Read(file);
+  xmlNodePtr root1 = xmlDocGetRootElement(document1.get());
+  const auto id1 =
+      stg::abixml::Abigail(graph, jobs).ProcessRoot(root1, metrics);
+  NoCache cache;
+  CHECK(stg::Equals<NoCache>(graph, cache)(id0, id1));
+}
+
+struct GetSymbols {
+  std::vector<std::string> operator()(const stg::Interface& x) const {
+    std::vector<std::string> result;
+    for (const auto& [symbol, _] : x.symbols) {
+      result.push_back(symbol);
+    }
+    return result;
+  }
+  template <typename Node>
+  std::vector<std::string> operator()(const Node&) const {
+    stg::Die() << "expected an Interface";
+  }
+};
+
+std::vector<std::string> Symbols(const stg::Graph& graph, stg::Id root) {
+  GetSymbols get_symbols;
+  return graph.Apply<std::vector<std::string>>(get_symbols, root);
+}
+
+size_t Count(const stg::Metrics& metrics, const std::string& name) {
+  size_t count = 0;
+  for (const auto& metric : metrics) {
+    if (metric.name == name) {
+      count += std::get<size_t>(metric.value);
+    }
+  }
+  return count;
+}
+
+struct SymbolFilterTestCase {
+  const char* filter;
+  std::vector<std::string> symbols;
+  size_t nodes;
+  size_t skipped_types;
+};
+
+TEST_CASE("symbol filter") {
+  const char* file = "abigail_corpus_group_0.xml";
+  const auto test = GENERATE(
+      SymbolFilterTestCase{
+          "a_probe",
+          {"a_probe"},
+          // int, char, const char, const char*, struct device, its member,
+          // struct device*, the function type, the symbol and the interface
+          10,
+          // unsigned long
+          1},
+      SymbolFilterTestCase{
+          // an alias, whose declaration is that of jiffies
+          "jiffies_64",
+          {"jiffies_64"},
+          // unsigned long, the symbol and the interface
+          3,
+          6});
+  const auto filter = stg::MakeFilter(test.filter);
+
+  SECTION(test.filter) {
+    // streaming
+    stg::Graph streamed;
+    stg::Metrics metrics;
+    const auto streamed_root = stg::abixml::Read(
+        streamed, filename_to_path(file), metrics, 1, false, filter.get());
+    CHECK(Symbols(streamed, streamed_root) == test.symbols);
+    CHECK(streamed.Limit().ix_ == test.nodes);
+    CHECK(Count(metrics, "abigail.skipped_types") == test.skipped_types);
+
+    // whole document, with the corpora processed serially and concurrently
+    for (const size_t jobs : {1, 2}) {
+      stg::Graph graph;
+      stg::Metrics document_metrics;
+      const stg::abixml::Document document = Read(file);
+      xmlNodePtr root = xmlDocGetRootElement(document.get());
+      const auto id = stg::abixml::Abigail(graph, jobs, false, filter.get())
+                          .ProcessRoot(root, document_metrics);
+      CHECK(Symbols(graph, id) == test.symbols);
+      CHECK(graph.Limit().ix_ == test.nodes);
+      CHECK(Count(document_metrics, "abigail.skipped_types")
+            == test.skipped_types);
+    }
+  }
+}
+
 }  // namespace
@@ -0,0 +1,88 @@
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+// -*- mode: C++ -*-
+//
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License v2.0 with LLVM Exceptions (the
+// "License"); you may not use this file except in compliance with the
+// License.  You may obtain a copy of the License at
+//
+//     https://llvm.org/LICENSE.txt
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef STG_ARENA_H_
+#define STG_ARENA_H_
+
+#include <cstddef>
+#include <memory_resource>
+#include <optional>
+
+#include "metrics.h"
+
+namespace stg {
+
+// A monotonic arena for the temporaries of a phase, which all die together.
+// Allocations from Resource() are bump-allocated from blocks obtained from the
+// general-purpose allocator; deallocation is a no-op and the blocks are
+// released in one go when the arena goes out of scope.
+//
+// The bytes obtained from the general-purpose allocator are recorded under the
+// given metric name. An initial block size of 0 disables the arena: all
+// allocations are passed through, so the two can be compared.
+//
+// The arena is not thread-safe. Concurrent workers may only use containers
+// allocated from it in ways that do not allocate, such as shrinking them.
+class Arena {
+ public:
+  static constexpr size_t kInitialSize = size_t{1} << 16;
+
+  Arena(Metrics& metrics, const char* name, size_t initial_size = kInitialSize)
+      : bytes_(metrics, name) {
+    if (initial_size != 0) {
+      monotonic_.emplace(initial_size, &upstream_);
+    }
+  }
+  Arena(const Arena&) = delete;
+  Arena& operator=(const Arena&) = delete;
+  ~Arena() {
+    bytes_ = upstream_.bytes;
+  }
+
+  std::pmr::memory_resource* Resource() {
+    if (monotonic_) {
+      return &*monotonic_;
+    }
+    return &upstream_;
+  }
+
+ private:
+  // Counts the bytes passing through to the general-purpose allocator.
+  struct Upstream : std::pmr::memory_resource {
+    void* do_allocate(size_t size, size_t alignment) override {
+      bytes += size;
+      return std::pmr::new_delete_resource()->allocate(size, alignment);
+    }
+    void do_deallocate(void* pointer, size_t size, size_t alignment) override {
+      std::pmr::new_delete_resource()->deallocate(pointer, size, alignment);
+    }
+    bool do_is_equal(
+        const std::pmr::memory_resource& other) const noexcept override {
+      return this == &other;
+    }
+
+    size_t bytes = 0;
+  };
+
+  Counter bytes_;
+  Upstream upstream_;
+  std::optional<std::pmr::monotonic_buffer_resource> monotonic_;
+};
+
+}  // namespace stg
+
+#endif  // STG_ARENA_H_
@@ -0,0 +1,56 @@
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+// -*- mode: C++ -*-
+//
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License v2.0 with LLVM Exceptions (the
+// "License"); you may not use this file except in compliance with the
+// License.  You may obtain a copy of the License at
+//
+//     https://llvm.org/LICENSE.txt
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "arena.h"
+
+#include <cstddef>
+#include <memory_resource>
+#include <variant>
+#include <vector>
+
+#include <catch2/catch.hpp>
+#include "metrics.h"
+
+namespace Test {
+
+size_t Fill(size_t initial_size) {
+  stg::Metrics metrics;
+  {
+    stg::Arena arena(metrics, "arena", initial_size);
+    std::pmr::vector<std::pmr::vector<int>> vectors(arena.Resource());
+    for (int i = 0; i < 100; ++i) {
+      auto& vector = vectors.emplace_back();
+      CHECK(vector.get_allocator().resource() == arena.Resource());
+      for (int j = 0; j < i; ++j) {
+        vector.push_back(j);
+      }
+    }
+    CHECK(vectors[99][98] == 98);
+  }
+  REQUIRE(metrics.size() == 1);
+  return std::get<size_t>(metrics[0].value);
+}
+
+TEST_CASE("arena") {
+  const size_t arena = Fill(stg::Arena::kInitialSize);
+  const size_t passthrough = Fill(0);
+  CHECK(arena >= stg::Arena::kInitialSize);
+  // every growth of every vector goes to the general-purpose allocator
+  CHECK(passthrough > 100 * 99 / 2 * sizeof(int));
+}
+
+}  // namespace Test
@@ -0,0 +1,179 @@
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+// -*- mode: C++ -*-
+//
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License v2.0 with LLVM Exceptions (the
+// "License"); you may not use this file except in compliance with the
+// License.  You may obtain a copy of the License at
+//
+//     https://llvm.org/LICENSE.txt
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "async_output.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstddef>
+#include <mutex>
+#include <string>
+
+#include "error.h"
+
+namespace stg {
+
+namespace {
+
+// Writes all the data, returning 0 or the error that stopped it.
+int WriteAll(int fd, const char* data, size_t size) {
+  while (size > 0) {
+    const ssize_t count = write(fd, data, size);
+    if (count < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return errno;
+    }
+    data += count;
+    size -= count;
+  }
+  return 0;
+}
+
+// The standard output is written to where it is, rather than reopened, which
+// would truncate it and, with an offset of its own, write over what is written
+// to it otherwise, such as by earlier outputs.
+int Open(const std::string& filename) {
+  if (filename == "/dev/stdout") {
+    return fcntl(STDOUT_FILENO, F_DUPFD_CLOEXEC, 0);
+  }
+  return open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+              0666);
+}
+
+}  // namespace
+
+AsyncOutput::Buffer::Buffer(const std::string& filename, size_t block_size)
+    : fd_(Open(filename)) {
+  Check(block_size > 0) << "async output needs a non-empty block";
+  if (fd_ < 0) {
+    Die() << "error opening " << '\'' << filename << "': " << Error(errno);
+  }
+  for (auto& block : blocks_) {
+    block.resize(block_size);
+  }
+  setp(blocks_[0].data(), blocks_[0].data() + block_size);
+  writer_ = std::thread([this] { Run(); });
+}
+
+AsyncOutput::Buffer::~Buffer() {
+  if (writer_.joinable()) {
+    Finish();
+  }
+}
+
+int AsyncOutput::Buffer::Finish() {
+  if (writer_.joinable()) {
+    Submit();
+    {
+      const std::lock_guard<std::mutex> lock(mutex_);
+      finished_ = true;
+    }
+    changed_.notify_all();
+    writer_.join();
+    // some filesystems only report write failures on close
+    if (close(fd_) != 0 && error_ == 0) {
+      error_ = errno;
+    }
+  }
+  return error_;
+}
+
+AsyncOutput::Buffer::int_type AsyncOutput::Buffer::overflow(int_type c) {
+  Submit();
+  if (!traits_type::eq_int_type(c, traits_type::eof())) {
+    *pptr() = traits_type::to_char_type(c);
+    pbump(1);
+  }
+  return traits_type::not_eof(c);
+}
+
+// A flush does not wait for the data to be written, only for the writer to
+// take it.
+int AsyncOutput::Buffer::sync() {
+  Submit();
+  return 0;
+}
+
+void AsyncOutput::Buffer::Submit() {
+  const size_t size = pptr() - pbase();
+  if (size == 0) {
+    return;
+  }
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    changed_.wait(lock, [&] { return !busy_; });
+    pending_ = size;
+    busy_ = true;
+    current_ ^= 1;
+  }
+  changed_.notify_all();
+  auto& block = blocks_[current_];
+  setp(block.data(), block.data() + block.size());
+}
+
+void AsyncOutput::Buffer::Run() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    changed_.wait(lock, [&] { return busy_ || finished_; });
+    if (!busy_) {
+      return;
+    }
+    const char* data = blocks_[current_ ^ 1].data();
+    const size_t size = pending_;
+    // after a failure, the rest of the output is dropped
+    const bool failed = error_ != 0;
+    lock.unlock();
+    const int error = failed ? 0 : WriteAll(fd_, data, size);
+    lock.lock();
+    if (error != 0) {
+      error_ = error;
+    }
+    busy_ = false;
+    changed_.notify_all();
+  }
+}
+
+AsyncOutput::AsyncOutput(const std::string& filename, size_t block_size)
+    : std::ostream(nullptr),
+      filename_(filename),
+      buffer_(filename, block_size) {
+  rdbuf(&buffer_);
+}
+
+AsyncOutput::~AsyncOutput() {
+  buffer_.Finish();
+}
+
+void AsyncOutput::Close() {
+  if (closed_) {
+    return;
+  }
+  closed_ = true;
+  const int error = buffer_.Finish();
+  if (error != 0) {
+    Die() << "error writing to " << '\'' << filename_ << "': " << Error(error);
+  }
+  if (!*this) {
+    Die() << "error writing to " << '\'' << filename_ << '\'';
+  }
+}
+
+}  // namespace stg
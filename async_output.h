@@ -0,0 +1,95 @@
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+// -*- mode: C++ -*-
+//
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License v2.0 with LLVM Exceptions (the
+// "License"); you may not use this file except in compliance with the
+// License.  You may obtain a copy of the License at
+//
+//     https://llvm.org/LICENSE.txt
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef STG_ASYNC_OUTPUT_H_
+#define STG_ASYNC_OUTPUT_H_
+
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <ostream>
+#include <streambuf>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace stg {
+
+// An output file that is written by a thread of its own, so that producing
+// output overlaps with writing it out.
+//
+// Output is gathered in one of two large blocks. When that is full, or on a
+// flush, it is handed to the writer thread and the other block is filled
+// meanwhile, waiting only if the writer has yet to finish with it. Close waits
+// for all the writes and fails if any did. The destructor of a stream cannot
+// fail, so it waits for the writes but ignores any failure.
+//
+// The file /dev/stdout stands for the standard output as it is: it is neither
+// reopened nor truncated, so successive outputs to it follow one another.
+class AsyncOutput : public std::ostream {
+ public:
+  static constexpr size_t kBlockSize = 1 << 20;
+
+  explicit AsyncOutput(const std::string& filename,
+                       size_t block_size = kBlockSize);
+  AsyncOutput(const AsyncOutput&) = delete;
+  AsyncOutput& operator=(const AsyncOutput&) = delete;
+  ~AsyncOutput() override;
+
+  void Close();
+
+ private:
+  class Buffer : public std::streambuf {
+   public:
+    Buffer(const std::string& filename, size_t block_size);
+    ~Buffer() override;
+
+    // Waits for all the writes, closes the file and returns the error of the
+    // first write that failed, or of closing, or 0.
+    int Finish();
+
+   protected:
+    int_type overflow(int_type c) override;
+    int sync() override;
+
+   private:
+    // Hands the filled part of the current block to the writer and switches
+    // to the other block.
+    void Submit();
+    void Run();
+
+    int fd_;
+    std::vector<char> blocks_[2];
+    size_t current_ = 0;
+    std::mutex mutex_;
+    std::condition_variable changed_;
+    // the size of the block being written, which is the other one
+    size_t pending_ = 0;
+    bool busy_ = false;
+    bool finished_ = false;
+    int error_ = 0;
+    std::thread writer_;
+  };
+
+  std::string filename_;
+  Buffer buffer_;
+  bool closed_ = false;
+};
+
+}  // namespace stg
+
+#endif  // STG_ASYNC_OUTPUT_H_
@@ -0,0 +1,106 @@
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+// -*- mode: C++ -*-
+//
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License v2.0 with LLVM Exceptions (the
+// "License"); you may not use this file except in compliance with the
+// License.  You may obtain a copy of the License at
+//
+//     https://llvm.org/LICENSE.txt
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "async_output.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cstddef>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include <catch2/catch.hpp>
+#include "error.h"
+
+namespace Test {
+
+std::string ReadBack(const std::filesystem::path& path) {
+  std::ifstream input(path);
+  std::ostringstream contents;
+  contents << input.rdbuf();
+  return contents.str();
+}
+
+TEST_CASE("async output") {
+  const auto path = std::filesystem::temp_directory_path()
+                    / ("stg-async-output-" + std::to_string(getpid()));
+  const size_t block_size = GENERATE(1, 7, 4096);
+  std::string expected;
+  {
+    stg::AsyncOutput output(path.string(), block_size);
+    for (size_t ix = 0; ix < 1000; ++ix) {
+      const auto line = "line " + std::to_string(ix) + '\n';
+      output << line;
+      expected += line;
+      if (ix % 100 == 0) {
+        output << std::flush;
+      }
+    }
+    output.Close();
+    // closing again does nothing
+    output.Close();
+  }
+  CHECK(ReadBack(path) == expected);
+
+  // the destructor waits for the writes too
+  {
+    stg::AsyncOutput output(path.string(), block_size);
+    output << "short";
+  }
+  CHECK(ReadBack(path) == "short");
+  std::filesystem::remove(path);
+}
+
+TEST_CASE("async output to redirected standard output") {
+  const auto path = std::filesystem::temp_directory_path()
+                    / ("stg-async-stdout-" + std::to_string(getpid()));
+  // as with stgdiff > file, one output per candidate
+  std::cout << std::flush;
+  const int saved = dup(STDOUT_FILENO);
+  REQUIRE(saved >= 0);
+  const int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+  REQUIRE(fd >= 0);
+  REQUIRE(dup2(fd, STDOUT_FILENO) == STDOUT_FILENO);
+  close(fd);
+  std::string expected;
+  for (size_t candidate = 1; candidate <= 3; ++candidate) {
+    const auto report = "report " + std::to_string(candidate) + '\n';
+    stg::AsyncOutput output("/dev/stdout", 4);
+    output << report;
+    output.Close();
+    expected += report;
+  }
+  REQUIRE(dup2(saved, STDOUT_FILENO) == STDOUT_FILENO);
+  close(saved);
+  CHECK(ReadBack(path) == expected);
+  std::filesystem::remove(path);
+}
+
+TEST_CASE("async output errors") {
+  if (!std::filesystem::exists("/dev/full")) {
+    return;
+  }
+  stg::AsyncOutput output("/dev/full", 16);
+  output << std::string(100, 'x');
+  CHECK_THROWS_AS(output.Close(), stg::Exception);
+}
+
+}  // namespace Test
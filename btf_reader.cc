@@ -24,9 +24,11 @@
 
 #include <fcntl.h>
 #include <libelf.h>
+#include <unistd.h>
 
 #include <algorithm>
 #include <array>
+#include <atomic>
 #include <cstddef>
 #include <cstdint>
 #include <cstring>
@@ -36,7 +38,9 @@
 #include <sstream>
 #include <string>
 #include <string_view>
+#include <type_traits>
 #include <utility>
+#include <variant>
 #include <vector>
 
 #include <linux/btf.h>
@@ -44,12 +48,19 @@
 #include "error.h"
 #include "graph.h"
 #include "file_descriptor.h"
+#include "filter.h"
+#include "metrics.h"
+#include "parallel.h"
 #include "reader_options.h"
 
 namespace stg {
 
 namespace btf {
 
+// Types are built in chunks, a few chunks per job at a time.
+static constexpr size_t kTypesPerChunk = 1024;
+static constexpr size_t kChunksPerJob = 4;
+
 static constexpr std::array<std::string_view, 3> kVarLinkage = {
     "static",
     "global-alloc",
@@ -82,35 +93,45 @@ const T* Structs::MemoryRange::Pull(size_t count) {
   return reinterpret_cast<const T*>(saved);
 }
 
-Structs::Structs(Graph& graph, const bool verbose)
-    : graph_(graph), verbose_(verbose) {}
+Structs::Structs(Graph& graph, const bool verbose, size_t jobs,
+                 const Filter* symbol_filter, bool select)
+    : graph_(graph), verbose_(verbose), jobs_(verbose ? 1 : jobs),
+      symbol_filter_(symbol_filter), select_(select) {}
+
+Structs::Structs(Graph& graph, const Structs& base, const bool verbose,
+                 size_t jobs, const Filter* symbol_filter)
+    : graph_(graph), base_(&base), type_start_(base.type_limit_),
+      string_start_(base.StringLimit()), type_limit_(type_start_),
+      verbose_(verbose), jobs_(verbose ? 1 : jobs),
+      symbol_filter_(symbol_filter), select_(true) {}
 
-// Get the index of the void type, creating one if needed.
+// Get the index of the void type, noting that it is needed.
 Id Structs::GetVoid() {
-  if (!void_) {
-    void_ = {graph_.Add<Special>(Special::Kind::VOID)};
+  if (!void_used_.load(std::memory_order_relaxed)) {
+    void_used_.store(true, std::memory_order_relaxed);
   }
-  return *void_;
+  return void_;
 }
 
-// Get the index of the variadic parameter type, creating one if needed.
+// Get the index of the variadic parameter type, noting that it is needed.
 Id Structs::GetVariadic() {
-  if (!variadic_) {
-    variadic_ = {graph_.Add<Special>(Special::Kind::VARIADIC)};
+  if (!variadic_used_.load(std::memory_order_relaxed)) {
+    variadic_used_.store(true, std::memory_order_relaxed);
   }
-  return *variadic_;
+  return variadic_;
 }
 
 // Map BTF type index to own index.
 //
-// If there is no existing mapping for a BTF type, create one pointing to a new
-// slot at the end of the array.
-Id Structs::GetIdRaw(uint32_t btf_index) {
-  auto [it, inserted] = btf_type_ids_.insert({btf_index, Id(0)});
-  if (inserted) {
-    it->second = graph_.Allocate();
-  }
-  return it->second;
+// Graph ids are reserved, contiguously, for all the types when the type
+// section is indexed. Types of the base BTF have ids reserved by the base.
+Id Structs::GetIdRaw(uint32_t btf_index) const {
+  if (btf_index < type_start_) {
+    Check(base_ != nullptr) << "internal error: BTF type id out of range";
+    return base_->GetIdRaw(btf_index);
+  }
+  Check(btf_index < type_limit_) << "BTF type id out of range: " << btf_index;
+  return Id(first_type_id_.ix_ + (btf_index - type_start_));
 }
 
 // Translate BTF type id to own type id, for non-parameters.
@@ -178,12 +199,13 @@ void Structs::PrintHeader(const btf_header* header) const {
 }
 
 // vlen: vector length, the number of struct/union members
-std::vector<Id> Structs::BuildMembers(
-    bool kflag, const btf_member* members, size_t vlen) {
-  std::vector<Id> result;
+Ids Structs::BuildMembers(bool kflag, const btf_member* members, size_t vlen,
+                          Id first, Nodes& nodes) {
+  Ids result;
+  result.reserve(vlen);
   for (size_t i = 0; i < vlen; ++i) {
     const auto& raw_member = members[i];
-    const auto name = GetName(raw_member.name_off);
+    const auto name = GetNameView(raw_member.name_off);
     const auto raw_offset = raw_member.offset;
     const auto offset = kflag ? BTF_MEMBER_BIT_OFFSET(raw_offset) : raw_offset;
     const auto bitfield_size = kflag ? BTF_MEMBER_BITFIELD_SIZE(raw_offset) : 0;
@@ -196,19 +218,21 @@ std::vector<Id> Structs::BuildMembers(
       }
       std::cout << '\n';
     }
-    result.push_back(
-        graph_.Add<Member>(name, GetId(raw_member.type),
-                           static_cast<uint64_t>(offset), bitfield_size));
+    const Id id(first.ix_ + i);
+    nodes.Set<Member>(id, name, GetId(raw_member.type),
+                      static_cast<uint64_t>(offset), bitfield_size);
+    result.push_back(id);
   }
   return result;
 }
 
 // vlen: vector length, the number of enum values
-std::vector<std::pair<std::string, int64_t>> Structs::BuildEnums(
+Enumeration::Enumerators Structs::BuildEnums(
     bool is_signed, const struct btf_enum* enums, size_t vlen) {
-  std::vector<std::pair<std::string, int64_t>> result;
+  Enumeration::Enumerators result;
+  result.reserve(vlen);
   for (size_t i = 0; i < vlen; ++i) {
-    const auto name = GetName(enums[i].name_off);
+    const auto name = GetNameView(enums[i].name_off);
     const uint32_t unsigned_value = enums[i].val;
     if (is_signed) {
       const int32_t signed_value = unsigned_value;
@@ -226,11 +250,12 @@ std::vector<std::pair<std::string, int64_t>> Structs::BuildEnums(
   return result;
 }
 
-std::vector<std::pair<std::string, int64_t>> Structs::BuildEnums64(
+Enumeration::Enumerators Structs::BuildEnums64(
     bool is_signed, const struct btf_enum64* enums, size_t vlen) {
-  std::vector<std::pair<std::string, int64_t>> result;
+  Enumeration::Enumerators result;
+  result.reserve(vlen);
   for (size_t i = 0; i < vlen; ++i) {
-    const auto name = GetName(enums[i].name_off);
+    const auto name = GetNameView(enums[i].name_off);
     const uint32_t low = enums[i].val_lo32;
     const uint32_t high = enums[i].val_hi32;
     const uint64_t unsigned_value = (static_cast<uint64_t>(high) << 32) | low;
@@ -252,12 +277,11 @@ std::vector<std::pair<std::string, int64_t>> Structs::BuildEnums64(
 }
 
 // vlen: vector length, the number of parameters
-std::vector<Id> Structs::BuildParams(const struct btf_param* params,
-                                     size_t vlen) {
-  std::vector<Id> result;
+Ids Structs::BuildParams(const struct btf_param* params, size_t vlen) {
+  Ids result;
   result.reserve(vlen);
   for (size_t i = 0; i < vlen; ++i) {
-    const auto name = GetName(params[i].name_off);
+    const auto name = GetNameView(params[i].name_off);
     const auto type = params[i].type;
     if (verbose_) {
       std::cout << "\t'" << (name.empty() ? ANON : name)
@@ -268,13 +292,14 @@ std::vector<Id> Structs::BuildParams(const struct btf_param* params,
   return result;
 }
 
-Id Structs::BuildEnumUnderlyingType(size_t size, bool is_signed) {
+void Structs::BuildEnumUnderlyingType(size_t size, bool is_signed, Id id,
+                                      Nodes& nodes) {
   std::ostringstream os;
   os << (is_signed ? "enum-underlying-signed-" : "enum-underlying-unsigned-")
      << (8 * size);
   const auto encoding = is_signed ? Primitive::Encoding::SIGNED_INTEGER
                                   : Primitive::Encoding::UNSIGNED_INTEGER;
-  return graph_.Add<Primitive>(os.str(), encoding, size);
+  nodes.Set<Primitive>(id, nodes.strings.Intern(os.str()), encoding, size);
 }
 
 Id Structs::BuildTypes(MemoryRange memory) {
@@ -285,36 +310,212 @@ Id Structs::BuildTypes(MemoryRange memory) {
   // Alas, BTF overloads type id 0 to mean both void (for everything but
   // function parameters) and variadic (for function parameters). We determine
   // which is intended and create void and variadic types on demand.
+  void_ = graph_.Allocate();
+  variadic_ = graph_.Allocate();
 
-  // The type section is parsed sequentially and each type's index is its id.
-  uint32_t btf_index = 1;
+  // The type section is indexed sequentially and each type's index is its id.
+  // Split BTF ids carry on from those of the base.
+  std::vector<Type> types;
+  types.reserve((memory.limit - memory.start) / sizeof(struct btf_type));
   while (!memory.Empty()) {
-    const auto* t = memory.Pull<struct btf_type>();
-    BuildOneType(t, btf_index, memory);
-    ++btf_index;
+    const char* start = memory.start;
+    const auto [size, extra] = Extent(memory.Pull<struct btf_type>());
+    memory.Pull<char>(size);
+    types.push_back({{start, memory.start}, Id(extra)});
+  }
+  type_limit_ = type_start_ + types.size();
+
+  // Graph ids are reserved up front for every type and then for the other
+  // nodes each needs, so the types can be built independently.
+  first_type_id_ = graph_.Allocate(types.size());
+  size_t extras = 0;
+  for (auto& type : types) {
+    const size_t extra = type.extra.ix_;
+    type.extra = Id(extras);
+    extras += extra;
+  }
+  const Id first_extra_id = graph_.Allocate(extras);
+  for (auto& type : types) {
+    type.extra = Id(first_extra_id.ix_ + type.extra.ix_);
+  }
+
+  // The graph ids of types not selected are left unused.
+  std::vector<bool> selected;
+  if (symbol_filter_ != nullptr && select_ && !verbose_) {
+    selected = Select(types);
+  }
+
+  // Types are built concurrently, in chunks, but the graph is not thread-safe
+  // so each round of chunks is added to it serially and in order.
+  const size_t chunks = (types.size() + kTypesPerChunk - 1) / kTypesPerChunk;
+  const size_t round = jobs_ * kChunksPerJob;
+  for (size_t first = 0; first < chunks; first += round) {
+    std::vector<Nodes> built(std::min(round, chunks - first));
+    ForEachIndex(jobs_, built.size(), [&](size_t, size_t index) {
+      const size_t begin = (first + index) * kTypesPerChunk;
+      const size_t end = std::min(begin + kTypesPerChunk, types.size());
+      for (size_t ix = begin; ix < end; ++ix) {
+        if (selected.empty() || selected[ix]) {
+          BuildOneType(types[ix], type_start_ + ix, built[index]);
+        }
+      }
+    });
+    for (auto& nodes : built) {
+      AddNodes(nodes);
+    }
+  }
+
+  if (void_used_) {
+    graph_.Set<Special>(void_, Special::Kind::VOID);
+  }
+  if (variadic_used_) {
+    graph_.Set<Special>(variadic_, Special::Kind::VARIADIC);
   }
 
   return BuildSymbols();
 }
 
-void Structs::BuildOneType(const btf_type* t, uint32_t btf_index,
-                           MemoryRange& memory) {
+// The size of the data following a BTF type and the number of graph nodes it
+// needs besides its own.
+std::pair<size_t, size_t> Structs::Extent(const btf_type* t) {
   const auto kind = BTF_INFO_KIND(t->info);
-  const auto vlen = BTF_INFO_VLEN(t->info);
+  const size_t vlen = BTF_INFO_VLEN(t->info);
   Check(kind < NR_BTF_KINDS) << "Unknown BTF kind: " << static_cast<int>(kind);
+  switch (kind) {
+    case BTF_KIND_INT:
+      return {sizeof(uint32_t), 0};
+    case BTF_KIND_FLOAT:
+    case BTF_KIND_PTR:
+    case BTF_KIND_TYPEDEF:
+    case BTF_KIND_VOLATILE:
+    case BTF_KIND_CONST:
+    case BTF_KIND_RESTRICT:
+    case BTF_KIND_FWD:
+    case BTF_KIND_FUNC:
+      return {0, 0};
+    case BTF_KIND_ARRAY:
+      return {sizeof(struct btf_array), 0};
+    case BTF_KIND_STRUCT:
+    case BTF_KIND_UNION:
+      return {vlen * sizeof(struct btf_member), vlen};
+    case BTF_KIND_ENUM:
+      // the synthetic underlying type, if not a forward declaration
+      return {vlen * sizeof(struct btf_enum), vlen ? 1 : 0};
+    case BTF_KIND_ENUM64:
+      return {vlen * sizeof(struct btf_enum64), 1};
+    case BTF_KIND_FUNC_PROTO:
+      return {vlen * sizeof(struct btf_param), 0};
+    case BTF_KIND_VAR:
+      return {sizeof(struct btf_var), 0};
+    case BTF_KIND_DATASEC:
+      return {vlen * sizeof(struct btf_var_secinfo), 0};
+    default:
+      Die() << "Unhandled BTF kind: " << static_cast<int>(kind);
+  }
+}
+
+// Selects the types reachable from the symbols the filter accepts. Types of
+// the base BTF are already built.
+std::vector<bool> Structs::Select(const std::vector<Type>& types) {
+  std::vector<bool> selected(types.size());
+  std::vector<uint32_t> pending;
+  const auto refer = [&](uint32_t btf_index) {
+    // 0 is void or variadic
+    if (btf_index >= type_start_) {
+      pending.push_back(btf_index);
+    }
+  };
+  for (size_t ix = 0; ix < types.size(); ++ix) {
+    const auto* t =
+        reinterpret_cast<const btf_type*>(types[ix].memory.start);
+    const auto kind = BTF_INFO_KIND(t->info);
+    if ((kind == BTF_KIND_FUNC || kind == BTF_KIND_VAR)
+        && (*symbol_filter_)(GetNameView(t->name_off))) {
+      pending.push_back(type_start_ + ix);
+    }
+  }
+  while (!pending.empty()) {
+    const uint32_t btf_index = pending.back();
+    pending.pop_back();
+    Check(btf_index < type_limit_) << "BTF type id out of range: " << btf_index;
+    const size_t ix = btf_index - type_start_;
+    if (selected[ix]) {
+      continue;
+    }
+    selected[ix] = true;
+    MemoryRange memory = types[ix].memory;
+    const auto* t = memory.Pull<struct btf_type>();
+    const auto vlen = BTF_INFO_VLEN(t->info);
+    switch (BTF_INFO_KIND(t->info)) {
+      case BTF_KIND_PTR:
+      case BTF_KIND_TYPEDEF:
+      case BTF_KIND_VOLATILE:
+      case BTF_KIND_CONST:
+      case BTF_KIND_RESTRICT:
+      case BTF_KIND_FUNC:
+      case BTF_KIND_VAR:
+        refer(t->type);
+        break;
+      case BTF_KIND_ARRAY:
+        refer(memory.Pull<struct btf_array>()->type);
+        break;
+      case BTF_KIND_STRUCT:
+      case BTF_KIND_UNION: {
+        const auto* members = memory.Pull<struct btf_member>(vlen);
+        for (size_t i = 0; i < vlen; ++i) {
+          refer(members[i].type);
+        }
+        break;
+      }
+      case BTF_KIND_FUNC_PROTO: {
+        refer(t->type);
+        const auto* params = memory.Pull<struct btf_param>(vlen);
+        for (size_t i = 0; i < vlen; ++i) {
+          refer(params[i].type);
+        }
+        break;
+      }
+      default:
+        break;
+    }
+  }
+  skipped_ = std::count(selected.begin(), selected.end(), false);
+  return selected;
+}
+
+void Structs::AddNodes(Nodes& nodes) {
+  for (auto& [id, value] : nodes.nodes) {
+    std::visit([&, id = id](auto& node) {
+      graph_.Set<std::decay_t<decltype(node)>>(id, std::move(node));
+    }, value);
+  }
+  for (const auto& [name, id] : nodes.symbols) {
+    // without selection, as for base BTF, rejected symbols are still built
+    if (symbol_filter_ != nullptr && !(*symbol_filter_)(name)) {
+      continue;
+    }
+    const bool inserted = btf_symbols_.emplace(name, id).second;
+    Check(inserted) << "duplicate symbol " << name;
+  }
+}
+
+void Structs::BuildOneType(const Type& type, uint32_t btf_index,
+                           Nodes& nodes) {
+  MemoryRange memory = type.memory;
+  const auto* t = memory.Pull<struct btf_type>();
+  const auto kind = BTF_INFO_KIND(t->info);
+  const auto vlen = BTF_INFO_VLEN(t->info);
 
   if (verbose_) {
     std::cout << '[' << btf_index << "] ";
   }
-  // delay allocation of node id as some BTF nodes are skipped
-  auto id = [&]() {
-    return GetIdRaw(btf_index);
-  };
+  // some BTF nodes are skipped, leaving their ids unused
+  const Id id = GetIdRaw(btf_index);
 
   switch (kind) {
     case BTF_KIND_INT: {
       const auto info = *memory.Pull<uint32_t>();
-      const auto name = GetName(t->name_off);
+      const auto name = GetNameView(t->name_off);
       const auto raw_encoding = BTF_INT_ENCODING(info);
       const auto offset = BTF_INT_OFFSET(info);
       const auto bits = BTF_INT_BITS(info);
@@ -344,34 +545,34 @@ void Structs::BuildOneType(const btf_type* t, uint32_t btf_index,
       if (bits != 8 * t->size) {
         Die() << "BTF INT bits != 8 * size";
       }
-      graph_.Set<Primitive>(id(), name, encoding, t->size);
+      nodes.Set<Primitive>(id, name, encoding, t->size);
       break;
     }
     case BTF_KIND_FLOAT: {
-      const auto name = GetName(t->name_off);
+      const auto name = GetNameView(t->name_off);
       if (verbose_) {
         std::cout << "FLOAT '" << name << "'"
                   << " size=" << t->size
                   << '\n';
       }
       const auto encoding = Primitive::Encoding::REAL_NUMBER;
-      graph_.Set<Primitive>(id(), name, encoding, t->size);
+      nodes.Set<Primitive>(id, name, encoding, t->size);
       break;
     }
     case BTF_KIND_PTR: {
       if (verbose_) {
         std::cout << "PTR '" << ANON << "' type_id=" << t->type << '\n';
       }
-      graph_.Set<PointerReference>(id(), PointerReference::Kind::POINTER,
+      nodes.Set<PointerReference>(id, PointerReference::Kind::POINTER,
                                    GetId(t->type));
       break;
     }
     case BTF_KIND_TYPEDEF: {
-      const auto name = GetName(t->name_off);
+      const auto name = GetNameView(t->name_off);
       if (verbose_) {
         std::cout << "TYPEDEF '" << name << "' type_id=" << t->type << '\n';
       }
-      graph_.Set<Typedef>(id(), name, GetId(t->type));
+      nodes.Set<Typedef>(id, name, GetId(t->type));
       break;
     }
     case BTF_KIND_VOLATILE:
@@ -388,7 +589,7 @@ void Structs::BuildOneType(const btf_type* t, uint32_t btf_index,
                       : "RESTRICT")
                   << " '" << ANON << "' type_id=" << t->type << '\n';
       }
-      graph_.Set<Qualified>(id(), qualifier, GetId(t->type));
+      nodes.Set<Qualified>(id, qualifier, GetId(t->type));
       break;
     }
     case BTF_KIND_ARRAY: {
@@ -400,7 +601,7 @@ void Structs::BuildOneType(const btf_type* t, uint32_t btf_index,
                   << " nr_elems=" << array->nelems
                   << '\n';
       }
-      graph_.Set<Array>(id(), array->nelems, GetId(array->type));
+      nodes.Set<Array>(id, array->nelems, GetId(array->type));
       break;
     }
     case BTF_KIND_STRUCT:
@@ -408,7 +609,7 @@ void Structs::BuildOneType(const btf_type* t, uint32_t btf_index,
       const auto struct_union_kind = kind == BTF_KIND_STRUCT
                                      ? StructUnion::Kind::STRUCT
                                      : StructUnion::Kind::UNION;
-      const auto name = GetName(t->name_off);
+      const auto name = GetNameView(t->name_off);
       const bool kflag = BTF_INFO_KFLAG(t->info);
       if (verbose_) {
         std::cout << (kind == BTF_KIND_STRUCT ? "STRUCT" : "UNION")
@@ -417,13 +618,13 @@ void Structs::BuildOneType(const btf_type* t, uint32_t btf_index,
                   << " vlen=" << vlen << '\n';
       }
       const auto* btf_members = memory.Pull<struct btf_member>(vlen);
-      const auto members = BuildMembers(kflag, btf_members, vlen);
-      graph_.Set<StructUnion>(id(), struct_union_kind, name, t->size,
-                              std::vector<Id>(), std::vector<Id>(), members);
+      auto members = BuildMembers(kflag, btf_members, vlen, type.extra, nodes);
+      nodes.Set<StructUnion>(id, struct_union_kind, name, t->size,
+                              Ids(), Ids(), std::move(members));
       break;
     }
     case BTF_KIND_ENUM: {
-      const auto name = GetName(t->name_off);
+      const auto name = GetNameView(t->name_off);
       const bool is_signed = BTF_INFO_KFLAG(t->info);
       if (verbose_) {
         std::cout << "ENUM '" << (name.empty() ? ANON : name) << "'"
@@ -433,22 +634,23 @@ void Structs::BuildOneType(const btf_type* t, uint32_t btf_index,
                   << '\n';
       }
       const auto* enums = memory.Pull<struct btf_enum>(vlen);
-      const auto enumerators = BuildEnums(is_signed, enums, vlen);
+      auto enumerators = BuildEnums(is_signed, enums, vlen);
       // BTF only considers structs and unions as forward-declared types, and
       // does not include forward-declared enums. They are treated as
       // BTF_KIND_ENUMs with vlen set to zero.
       if (vlen) {
         // create a synthetic underlying type
-        const Id underlying = BuildEnumUnderlyingType(t->size, is_signed);
-        graph_.Set<Enumeration>(id(), name, underlying, enumerators);
+        BuildEnumUnderlyingType(t->size, is_signed, type.extra, nodes);
+        nodes.Set<Enumeration>(id, name, type.extra,
+                               std::move(enumerators));
       } else {
         // BTF actually provides size (4), but it's meaningless.
-        graph_.Set<Enumeration>(id(), name);
+        nodes.Set<Enumeration>(id, name);
       }
       break;
     }
     case BTF_KIND_ENUM64: {
-      const auto name = GetName(t->name_off);
+      const auto name = GetNameView(t->name_off);
       const bool is_signed = BTF_INFO_KFLAG(t->info);
       if (verbose_) {
         std::cout << "ENUM64 '" << (name.empty() ? ANON : name) << "'"
@@ -458,14 +660,15 @@ void Structs::BuildOneType(const btf_type* t, uint32_t btf_index,
                   << '\n';
       }
       const auto* enums = memory.Pull<struct btf_enum64>(vlen);
-      const auto enumerators = BuildEnums64(is_signed, enums, vlen);
+      auto enumerators = BuildEnums64(is_signed, enums, vlen);
       // create a synthetic underlying type
-      const Id underlying = BuildEnumUnderlyingType(t->size, is_signed);
-      graph_.Set<Enumeration>(id(), name, underlying, enumerators);
+      BuildEnumUnderlyingType(t->size, is_signed, type.extra, nodes);
+      nodes.Set<Enumeration>(id, name, type.extra,
+                             std::move(enumerators));
       break;
     }
     case BTF_KIND_FWD: {
-      const auto name = GetName(t->name_off);
+      const auto name = GetNameView(t->name_off);
       const auto struct_union_kind = BTF_INFO_KFLAG(t->info)
                                      ? StructUnion::Kind::UNION
                                      : StructUnion::Kind::STRUCT;
@@ -473,11 +676,11 @@ void Structs::BuildOneType(const btf_type* t, uint32_t btf_index,
         std::cout << "FWD '" << name << "' fwd_kind=" << struct_union_kind
                   << '\n';
       }
-      graph_.Set<StructUnion>(id(), struct_union_kind, name);
+      nodes.Set<StructUnion>(id, struct_union_kind, name);
       break;
     }
     case BTF_KIND_FUNC: {
-      const auto name = GetName(t->name_off);
+      const auto name = GetNameView(t->name_off);
       const auto linkage = FunctionLinkage(vlen);
       if (verbose_) {
         std::cout << "FUNC '" << name << "'"
@@ -486,7 +689,7 @@ void Structs::BuildOneType(const btf_type* t, uint32_t btf_index,
                   << '\n';
       }
 
-      graph_.Set<ElfSymbol>(id(), name, std::nullopt, true,
+      nodes.Set<ElfSymbol>(id, name, std::nullopt, true,
                             ElfSymbol::SymbolType::FUNCTION,
                             ElfSymbol::Binding::GLOBAL,
                             ElfSymbol::Visibility::DEFAULT,
@@ -494,9 +697,7 @@ void Structs::BuildOneType(const btf_type* t, uint32_t btf_index,
                             std::nullopt,
                             GetId(t->type),
                             std::nullopt);
-      const bool inserted =
-          btf_symbols_.insert({name, GetIdRaw(btf_index)}).second;
-      Check(inserted) << "duplicate symbol " << name;
+      nodes.symbols.emplace_back(name, id);
       break;
     }
     case BTF_KIND_FUNC_PROTO: {
@@ -507,14 +708,14 @@ void Structs::BuildOneType(const btf_type* t, uint32_t btf_index,
                   << " vlen=" << vlen
                   << '\n';
       }
-      const auto parameters = BuildParams(params, vlen);
-      graph_.Set<Function>(id(), GetId(t->type), parameters);
+      auto parameters = BuildParams(params, vlen);
+      nodes.Set<Function>(id, GetId(t->type), std::move(parameters));
       break;
     }
     case BTF_KIND_VAR: {
       // NOTE: global variables are not yet emitted by pahole -J
       const auto* variable = memory.Pull<struct btf_var>();
-      const auto name = GetName(t->name_off);
+      const auto name = GetNameView(t->name_off);
       const auto linkage = VariableLinkage(variable->linkage);
       if (verbose_) {
         // NOTE: The odd comma is to match bpftool dump.
@@ -524,7 +725,7 @@ void Structs::BuildOneType(const btf_type* t, uint32_t btf_index,
                   << '\n';
       }
 
-      graph_.Set<ElfSymbol>(id(), name, std::nullopt, true,
+      nodes.Set<ElfSymbol>(id, name, std::nullopt, true,
                             ElfSymbol::SymbolType::OBJECT,
                             ElfSymbol::Binding::GLOBAL,
                             ElfSymbol::Visibility::DEFAULT,
@@ -532,9 +733,7 @@ void Structs::BuildOneType(const btf_type* t, uint32_t btf_index,
                             std::nullopt,
                             GetId(t->type),
                             std::nullopt);
-      const bool inserted =
-          btf_symbols_.insert({name, GetIdRaw(btf_index)}).second;
-      Check(inserted) << "duplicate symbol " << name;
+      nodes.symbols.emplace_back(name, id);
       break;
     }
     case BTF_KIND_DATASEC: {
@@ -551,10 +750,15 @@ void Structs::BuildOneType(const btf_type* t, uint32_t btf_index,
       break;
     }
   }
+  Check(memory.Empty()) << "internal error: BTF type data left over";
 }
 
-std::string Structs::GetName(uint32_t name_off) {
-  const char* name_begin = string_section_.start + name_off;
+std::string_view Structs::GetNameView(uint32_t name_off) const {
+  if (name_off < string_start_) {
+    Check(base_ != nullptr) << "internal error: BTF name offset out of range";
+    return base_->GetNameView(name_off);
+  }
+  const char* name_begin = string_section_.start + (name_off - string_start_);
   const char* const limit = string_section_.limit;
   Check(name_begin < limit) << "name offset exceeds string section length";
   const char* name_end = std::find(name_begin, limit, '\0');
@@ -562,6 +766,23 @@ std::string Structs::GetName(uint32_t name_off) {
   return {name_begin, static_cast<size_t>(name_end - name_begin)};
 }
 
+uint32_t Structs::StringLimit() const {
+  return string_start_ + (string_section_.limit - string_section_.start);
+}
+
+bool Structs::IsSplit(std::string_view data) {
+  if (data.size() < sizeof(btf_header)) {
+    return false;
+  }
+  btf_header header;
+  std::memcpy(&header, data.data(), sizeof(header));
+  const size_t string_start = size_t{header.hdr_len} + header.str_off;
+  if (header.str_len == 0) {
+    return true;
+  }
+  return string_start < data.size() && data[string_start] != '\0';
+}
+
 void Structs::PrintStrings(MemoryRange memory) {
   std::cout << "String section:\n";
   while (!memory.Empty()) {
@@ -574,31 +795,106 @@ void Structs::PrintStrings(MemoryRange memory) {
 }
 
 Id Structs::BuildSymbols() {
-  return graph_.Add<Interface>(btf_symbols_);
+  return graph_.Add<Interface>(std::move(btf_symbols_));
 }
 
-Id ReadFile(Graph& graph, const std::string& path, ReadOptions options) {
-  Check(elf_version(EV_CURRENT) != EV_NONE) << "ELF version mismatch";
-  struct ElfDeleter {
-    void operator()(Elf* elf) {
-      elf_end(elf);
+namespace {
+
+// Whether a file starts with the BTF magic number, rather than being ELF.
+bool IsRawBtf(const FileDescriptor& fd) {
+  uint16_t magic;
+  return pread(fd.Value(), &magic, sizeof(magic), 0) == sizeof(magic)
+      && magic == BTF_MAGIC;
+}
+
+struct ElfDeleter {
+  void operator()(Elf* elf) {
+    elf_end(elf);
+  }
+};
+
+}  // namespace
+
+// The BTF data of a file, kept in place for as long as this exists.
+class BtfFile {
+ public:
+  explicit BtfFile(const std::string& path)
+      : fd_(path.c_str(), O_RDONLY),
+        raw_(IsRawBtf(fd_)),
+        // For example, /sys/kernel/btf/vmlinux. Not all kernels support
+        // mapping this.
+        map_(raw_ ? MemoryMap::TryMap(fd_) : std::nullopt) {
+    if (raw_) {
+      if (map_) {
+        data_ = map_->Contents();
+      } else {
+        contents_ = ReadContents(fd_);
+        data_ = contents_;
+      }
+      return;
     }
-  };
-  const FileDescriptor fd(path.c_str(), O_RDONLY);
-  const std::unique_ptr<Elf, ElfDeleter> elf(
-      elf_begin(fd.Value(), ELF_C_READ, nullptr));
-  if (!elf) {
-    const int error_code = elf_errno();
-    const char* error = elf_errmsg(error_code);
-    if (error != nullptr) {
-      Die() << "elf_begin returned error: " << error;
-    } else {
-      Die() << "elf_begin returned error: " << error_code;
+
+    Check(elf_version(EV_CURRENT) != EV_NONE) << "ELF version mismatch";
+    // The .BTF section is used in place, within libelf's mapping of the file.
+    elf_.reset(elf_begin(fd_.Value(), ELF_C_READ_MMAP, nullptr));
+    if (!elf_) {
+      const int error_code = elf_errno();
+      const char* error = elf_errmsg(error_code);
+      if (error != nullptr) {
+        Die() << "elf_begin returned error: " << error;
+      } else {
+        Die() << "elf_begin returned error: " << error_code;
+      }
     }
+    const elf::ElfLoader loader(elf_.get());
+    data_ = loader.GetBtfRawData();
+  }
+
+  std::string_view Data() const {
+    return data_;
+  }
+
+ private:
+  const FileDescriptor fd_;
+  const bool raw_;
+  const std::optional<MemoryMap> map_;
+  std::string contents_;
+  std::unique_ptr<Elf, ElfDeleter> elf_;
+  std::string_view data_;
+};
+
+Id ReadFile(Graph& graph, const std::string& path, ReadOptions options,
+            Metrics* metrics) {
+  const BtfFile file(path);
+  Structs structs(graph, options.Test(ReadOptions::INFO), options.jobs,
+                  options.symbol_filter);
+  const Id root = structs.Process(file.Data());
+  if (metrics != nullptr && options.symbol_filter != nullptr) {
+    Counter(*metrics, "btf.skipped_types") = structs.Skipped();
+  }
+  return root;
+}
+
+Base::Base(Graph& graph, const std::string& path, ReadOptions options)
+    : graph_(graph),
+      options_(options),
+      file_(std::make_unique<BtfFile>(path)),
+      structs_(graph, options.Test(ReadOptions::INFO), options.jobs,
+               options.symbol_filter, false),
+      root_(structs_.Process(file_->Data())) {}
+
+Base::~Base() = default;
+
+Id Base::Read(const std::string& path) {
+  const BtfFile file(path);
+  const bool verbose = options_.Test(ReadOptions::INFO);
+  if (Structs::IsSplit(file.Data())) {
+    return Structs(graph_, structs_, verbose, options_.jobs,
+                   options_.symbol_filter)
+        .Process(file.Data());
   }
-  const elf::ElfLoader loader(elf.get());
-  return Structs(graph, options.Test(ReadOptions::INFO))
-      .Process(loader.GetBtfRawData());
+  return Structs(graph_, verbose, options_.jobs, options_.symbol_filter)
+      .Process(file.Data());
 }
 
 }  // namespace btf
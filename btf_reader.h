@@ -21,17 +21,22 @@
 #ifndef STG_BTF_READER_H_
 #define STG_BTF_READER_H_
 
+#include <atomic>
 #include <cstddef>
 #include <cstdint>
 #include <map>
-#include <optional>
+#include <memory>
 #include <string>
 #include <string_view>
-#include <unordered_map>
+#include <utility>
+#include <variant>
 #include <vector>
 
 #include <linux/btf.h>
+#include "filter.h"
 #include "graph.h"
+#include "interner.h"
+#include "metrics.h"
 #include "reader_options.h"
 
 namespace stg {
@@ -40,9 +45,29 @@ namespace btf {
 // BTF Specification: https://www.kernel.org/doc/html/latest/bpf/btf.html
 class Structs {
  public:
-  explicit Structs(Graph& graph, bool verbose = false);
+  // Types are built by up to jobs threads, except with verbose output. If
+  // symbol_filter is given, the interface only has the symbols it accepts and,
+  // if also select is set and output is not verbose, only the types reachable
+  // from these are built. Base BTF, whose types split BTF may refer to, is
+  // read without selection.
+  explicit Structs(Graph& graph, bool verbose = false, size_t jobs = 1,
+                   const Filter* symbol_filter = nullptr, bool select = true);
+  // For split BTF, whose type ids and string offsets carry on from those of
+  // the base BTF. The base must already have been processed and it and its
+  // data must outlive this.
+  Structs(Graph& graph, const Structs& base, bool verbose = false,
+          size_t jobs = 1, const Filter* symbol_filter = nullptr);
   Id Process(std::string_view data);
 
+  // The number of types not built as they were not selected.
+  size_t Skipped() const {
+    return skipped_;
+  }
+
+  // Whether the data looks like split BTF. Standalone BTF has a string section
+  // starting with the empty string, split BTF shares that of its base.
+  static bool IsSplit(std::string_view data);
+
  private:
   struct MemoryRange {
     const char* start;
@@ -51,41 +76,116 @@ class Structs {
     template <typename T> const T* Pull(size_t count = 1);
   };
 
+  // The data of one BTF type and the first of the graph ids reserved for any
+  // nodes it needs besides its own, such as members.
+  struct Type {
+    MemoryRange memory;
+    Id extra;
+  };
+
+  // Nodes built for some BTF types, to be added to the graph in order.
+  struct Nodes {
+    template <typename Node, typename... Args>
+    void Set(Id id, Args&&... args) {
+      nodes.emplace_back(
+          id, Value(std::in_place_type<Node>, std::forward<Args>(args)...));
+    }
+
+    using Value = std::variant<Primitive, PointerReference, Typedef, Qualified,
+                               Array, Member, StructUnion, Enumeration,
+                               Function, ElfSymbol>;
+    std::vector<std::pair<Id, Value>> nodes;
+    // names view the string section
+    std::vector<std::pair<std::string_view, Id>> symbols;
+    // names made up by the reader; the rest view the string section
+    Interner strings;
+  };
+
   Graph& graph_;
+  const Structs* const base_ = nullptr;
+  // the first type id and string offset of this BTF, non-zero for split BTF
+  const uint32_t type_start_ = 1;
+  const uint32_t string_start_ = 0;
+  // one past the last type id, once indexed
+  uint32_t type_limit_ = 1;
+  // the graph id of the first type, the rest follow contiguously
+  Id first_type_id_ = Id(0);
 
   MemoryRange string_section_;
   const bool verbose_;
+  const size_t jobs_;
+  const Filter* const symbol_filter_;
+  const bool select_;
+  size_t skipped_ = 0;
 
-  std::optional<Id> void_;
-  std::optional<Id> variadic_;
-  std::unordered_map<uint32_t, Id> btf_type_ids_;
+  // void and variadic ids are reserved up front, but only used on demand
+  Id void_ = Id(0);
+  Id variadic_ = Id(0);
+  std::atomic<bool> void_used_ = false;
+  std::atomic<bool> variadic_used_ = false;
   std::map<std::string, Id> btf_symbols_;
 
   Id GetVoid();
   Id GetVariadic();
-  Id GetIdRaw(uint32_t btf_index);
+  Id GetIdRaw(uint32_t btf_index) const;
   Id GetId(uint32_t btf_index);
   Id GetParameterId(uint32_t btf_index);
 
   void PrintHeader(const btf_header* header) const;
   Id BuildTypes(MemoryRange memory);
-  void BuildOneType(const btf_type* t, uint32_t btf_index,
-                    MemoryRange& memory);
+  static std::pair<size_t, size_t> Extent(const btf_type* t);
+  std::vector<bool> Select(const std::vector<Type>& types);
+  void BuildOneType(const Type& type, uint32_t btf_index, Nodes& nodes);
+  void AddNodes(Nodes& nodes);
   Id BuildSymbols();
-  std::vector<Id> BuildMembers(
-      bool kflag, const btf_member* members, size_t vlen);
+  Ids BuildMembers(bool kflag, const btf_member* members, size_t vlen, Id first,
+                   Nodes& nodes);
   Enumeration::Enumerators BuildEnums(
       bool is_signed, const struct btf_enum* enums, size_t vlen);
   Enumeration::Enumerators BuildEnums64(
       bool is_signed, const struct btf_enum64* enums, size_t vlen);
-  std::vector<Id> BuildParams(const struct btf_param* params, size_t vlen);
-  Id BuildEnumUnderlyingType(size_t size, bool is_signed);
-  std::string GetName(uint32_t name_off);
+  Ids BuildParams(const struct btf_param* params, size_t vlen);
+  static void BuildEnumUnderlyingType(size_t size, bool is_signed, Id id,
+                                      Nodes& nodes);
+  // views the string section, which outlives the nodes being built
+  std::string_view GetNameView(uint32_t name_off) const;
+  uint32_t StringLimit() const;
 
   static void PrintStrings(MemoryRange memory);
 };
 
-Id ReadFile(Graph& graph, const std::string& path, ReadOptions options);
+// If metrics are given, the count of types not built as they were not
+// selected is recorded as btf.skipped_types.
+Id ReadFile(Graph& graph, const std::string& path, ReadOptions options,
+            Metrics* metrics = nullptr);
+
+// The BTF data of a file, raw or within ELF.
+class BtfFile;
+
+// Base BTF, such as that of vmlinux, and split BTF on top of it, such as that
+// of kernel modules. The base types are added to the graph once, on
+// construction, and are shared by all the split BTF read.
+class Base {
+ public:
+  Base(Graph& graph, const std::string& path, ReadOptions options);
+  ~Base();
+
+  // The root of the base BTF itself.
+  Id Root() const {
+    return root_;
+  }
+
+  // Reads BTF that is split BTF on top of this base, if it looks like it, and
+  // standalone BTF otherwise.
+  Id Read(const std::string& path);
+
+ private:
+  Graph& graph_;
+  const ReadOptions options_;
+  const std::unique_ptr<BtfFile> file_;
+  Structs structs_;
+  const Id root_;
+};
 
 }  // namespace btf
 }  // namespace stg
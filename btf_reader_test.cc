@@ -0,0 +1,260 @@
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+// -*- mode: C++ -*-
+//
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License v2.0 with LLVM Exceptions (the
+// "License"); you may not use this file except in compliance with the
+// License.  You may obtain a copy of the License at
+//
+//     https://llvm.org/LICENSE.txt
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "btf_reader.h"
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#include <catch2/catch.hpp>
+#include <linux/btf.h>
+#include "btf_writer.h"
+#include "filter.h"
+#include "graph.h"
+#include "proto_writer.h"
+#include "reader_options.h"
+
+namespace Test {
+
+std::string Text(const stg::Graph& graph, stg::Id root) {
+  std::ostringstream os;
+  stg::proto::Writer(graph).Write(root, os);
+  return os.str();
+}
+
+stg::Id Symbol(stg::Graph& graph, const std::string& name, stg::Id id) {
+  return graph.Add<stg::ElfSymbol>(
+      name, std::nullopt, true, stg::ElfSymbol::SymbolType::OBJECT,
+      stg::ElfSymbol::Binding::GLOBAL, stg::ElfSymbol::Visibility::DEFAULT,
+      std::nullopt, std::nullopt, id, std::nullopt);
+}
+
+// The base BTF, written by btf::Write. Types are numbered as they are first
+// referred to, so the variable x is type 1 and int is type 2.
+constexpr uint32_t kBaseTypes = 2;
+constexpr uint32_t kBaseInt = 2;
+
+std::string BaseBtf() {
+  stg::Graph graph;
+  const auto int_type = graph.Add<stg::Primitive>(
+      "int", stg::Primitive::Encoding::SIGNED_INTEGER, 4);
+  const auto root = graph.Add<stg::Interface>(
+      std::map<std::string, stg::Id>{{"x", Symbol(graph, "x", int_type)}});
+  std::ostringstream os;
+  stg::btf::Write(graph, root, os);
+  return os.str();
+}
+
+btf_header Header(std::string_view btf) {
+  btf_header header;
+  REQUIRE(btf.size() >= sizeof(header));
+  std::memcpy(&header, btf.data(), sizeof(header));
+  return header;
+}
+
+// The offset of a string in the string section of standalone BTF.
+uint32_t StringOffset(std::string_view btf, std::string_view name) {
+  const auto header = Header(btf);
+  const auto strings =
+      btf.substr(header.hdr_len + header.str_off, header.str_len);
+  const auto position = strings.find(std::string(1, '\0') + std::string(name)
+                                     + '\0');
+  REQUIRE(position != std::string_view::npos);
+  return position + 1;
+}
+
+// Split BTF, whose type ids and string offsets carry on from those of a base.
+class SplitBtf {
+ public:
+  explicit SplitBtf(std::string_view base)
+      : next_type_(kBaseTypes + 1), string_start_(Header(base).str_len) {}
+
+  uint32_t String(std::string_view name) {
+    const uint32_t offset = string_start_ + strings_.size();
+    strings_.append(name);
+    strings_.push_back('\0');
+    return offset;
+  }
+
+  uint32_t Type(uint32_t name_off, uint32_t kind, uint32_t vlen,
+                uint32_t size_or_type) {
+    Word(name_off);
+    Word(kind << 24 | vlen);
+    Word(size_or_type);
+    return next_type_++;
+  }
+
+  void Word(uint32_t word) {
+    types_.append(reinterpret_cast<const char*>(&word), sizeof(word));
+  }
+
+  std::string Data() const {
+    btf_header header{};
+    header.magic = BTF_MAGIC;
+    header.version = BTF_VERSION;
+    header.hdr_len = sizeof(header);
+    header.type_off = 0;
+    header.type_len = types_.size();
+    header.str_off = header.type_len;
+    header.str_len = strings_.size();
+    std::string data(reinterpret_cast<const char*>(&header), sizeof(header));
+    return data + types_ + strings_;
+  }
+
+ private:
+  uint32_t next_type_;
+  const uint32_t string_start_;
+  std::string types_;
+  std::string strings_;
+};
+
+// Split BTF for
+//
+//   struct S { int x; };
+//   struct S* y;
+//
+// where int and the name x come from the base and the rest is split.
+std::string SplitOnBase(std::string_view base) {
+  SplitBtf split(base);
+  const auto s = split.Type(split.String("S"), BTF_KIND_STRUCT, 1, 4);
+  split.Word(StringOffset(base, "x"));
+  split.Word(kBaseInt);
+  split.Word(0);
+  const auto pointer = split.Type(0, BTF_KIND_PTR, 0, s);
+  split.Type(split.String("y"), BTF_KIND_VAR, 0, pointer);
+  split.Word(BTF_VAR_GLOBAL_ALLOCATED);
+  return split.Data();
+}
+
+std::string Expected() {
+  stg::Graph graph;
+  const auto int_type = graph.Add<stg::Primitive>(
+      "int", stg::Primitive::Encoding::SIGNED_INTEGER, 4);
+  const auto s = graph.Add<stg::StructUnion>(
+      stg::StructUnion::Kind::STRUCT, "S", 4, stg::Ids(), stg::Ids(),
+      stg::Ids{graph.Add<stg::Member>("x", int_type, 0, 0)});
+  const auto pointer = graph.Add<stg::PointerReference>(
+      stg::PointerReference::Kind::POINTER, s);
+  const auto root = graph.Add<stg::Interface>(
+      std::map<std::string, stg::Id>{{"y", Symbol(graph, "y", pointer)}});
+  return Text(graph, root);
+}
+
+TEST_CASE("split BTF detection") {
+  const auto base = BaseBtf();
+  const auto split = SplitOnBase(base);
+  // standalone BTF strings start with the empty string, split BTF ones do not
+  CHECK(!stg::btf::Structs::IsSplit(base));
+  CHECK(stg::btf::Structs::IsSplit(split));
+  // split BTF may have no strings of its own
+  SplitBtf empty(base);
+  CHECK(stg::btf::Structs::IsSplit(empty.Data()));
+  // too short to be either
+  CHECK(!stg::btf::Structs::IsSplit(split.substr(0, sizeof(btf_header) - 1)));
+}
+
+TEST_CASE("split BTF") {
+  const auto base = BaseBtf();
+  stg::Graph graph;
+  stg::btf::Structs base_structs(graph);
+  base_structs.Process(base);
+  const auto root = stg::btf::Structs(graph, base_structs)
+      .Process(SplitOnBase(base));
+  CHECK(Text(graph, root) == Expected());
+}
+
+TEST_CASE("split BTF files") {
+  std::string directory =
+      std::filesystem::temp_directory_path() / "stg-XXXXXX";
+  REQUIRE(mkdtemp(directory.data()) != nullptr);
+  const auto base = BaseBtf();
+  const auto base_path = directory + "/base";
+  const auto split_path = directory + "/split";
+  std::ofstream(base_path) << base;
+  std::ofstream(split_path) << SplitOnBase(base);
+
+  stg::Graph graph;
+  stg::btf::Base base_btf(graph, base_path, stg::ReadOptions());
+  // split BTF is read on top of the base
+  CHECK(Text(graph, base_btf.Read(split_path)) == Expected());
+  // standalone BTF is read by itself
+  stg::Graph standalone;
+  const auto standalone_root =
+      stg::btf::Structs(standalone).Process(base);
+  CHECK(Text(graph, base_btf.Read(base_path))
+        == Text(standalone, standalone_root));
+  CHECK(Text(graph, base_btf.Root()) == Text(standalone, standalone_root));
+
+  std::filesystem::remove_all(directory);
+}
+
+// BTF for int x and long y, written by btf::Write, and, if wanted, what is read
+// from it when only x is selected.
+std::string TwoSymbols(bool with_y) {
+  stg::Graph graph;
+  const auto int_type = graph.Add<stg::Primitive>(
+      "int", stg::Primitive::Encoding::SIGNED_INTEGER, 4);
+  std::map<std::string, stg::Id> symbols{{"x", Symbol(graph, "x", int_type)}};
+  if (with_y) {
+    const auto long_type = graph.Add<stg::Primitive>(
+        "long", stg::Primitive::Encoding::SIGNED_INTEGER, 8);
+    symbols.emplace("y", Symbol(graph, "y", long_type));
+  }
+  const auto root = graph.Add<stg::Interface>(std::move(symbols));
+  if (!with_y) {
+    return Text(graph, root);
+  }
+  std::ostringstream os;
+  stg::btf::Write(graph, root, os);
+  return os.str();
+}
+
+TEST_CASE("symbol filter") {
+  const auto filter = stg::MakeFilter("x");
+  stg::Graph graph;
+  stg::btf::Structs structs(graph, false, 1, filter.get());
+  const auto root = structs.Process(TwoSymbols(true));
+  CHECK(Text(graph, root) == TwoSymbols(false));
+  // neither y nor long is built
+  CHECK(structs.Skipped() == 2);
+  size_t nodes = 0;
+  graph.ForEach(stg::Id(0), graph.Limit(), [&](stg::Id) {
+    ++nodes;
+  });
+  // int, x and the interface
+  CHECK(nodes == 3);
+
+  // base BTF is read without selection
+  stg::Graph base_graph;
+  stg::btf::Structs base(base_graph, false, 1, filter.get(), false);
+  const auto base_root = base.Process(TwoSymbols(true));
+  CHECK(Text(base_graph, base_root) == TwoSymbols(false));
+  CHECK(base.Skipped() == 0);
+}
+
+}  // namespace Test
@@ -0,0 +1,390 @@
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+// -*- mode: C++ -*-
+//
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License v2.0 with LLVM Exceptions (the
+// "License"); you may not use this file except in compliance with the
+// License.  You may obtain a copy of the License at
+//
+//     https://llvm.org/LICENSE.txt
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "btf_writer.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include <linux/btf.h>
+#include "error.h"
+#include "graph.h"
+
+namespace stg {
+namespace btf {
+
+namespace {
+
+// The integer type of array indices, named as pahole does.
+constexpr std::string_view kArrayIndexType = "__ARRAY_SIZE_TYPE__";
+
+uint32_t Narrow(uint64_t value, std::string_view what) {
+  Check(value <= std::numeric_limits<uint32_t>::max())
+      << what << " too large for BTF: " << value;
+  return static_cast<uint32_t>(value);
+}
+
+template <typename Node>
+struct Get {
+  const Node* operator()(const Node& x) {
+    return &x;
+  }
+  template <typename Other>
+  const Node* operator()(const Other&) {
+    return nullptr;
+  }
+};
+
+// Types are numbered as they are first referred to and encoded in that order,
+// as BTF allows references to later types.
+class Encoder {
+ public:
+  explicit Encoder(const Graph& graph) : graph_(graph), strings_(1, '\0') {}
+
+  void Encode(Id root) {
+    const auto* interface = Find<Interface>(root);
+    Check(interface != nullptr) << "BTF can only be written for an interface";
+    std::unordered_set<std::string_view> names;
+    for (const auto& [_, id] : interface->symbols) {
+      const auto* symbol = Find<ElfSymbol>(id);
+      Check(symbol != nullptr) << "interface symbol is not an ELF symbol";
+      if (!symbol->type_id) {
+        continue;
+      }
+      Check(names.insert(symbol->symbol_name).second)
+          << "BTF cannot hold several symbols named "
+          << symbol->symbol_name;
+      Type(id);
+    }
+    for (size_t ix = 0; ix < queue_.size(); ++ix) {
+      if (queue_[ix]) {
+        graph_.Apply<void>(*this, *queue_[ix]);
+      } else {
+        AppendType(kArrayIndexType, BTF_KIND_INT, 0, false, 4);
+        Append<uint32_t>(32);
+      }
+    }
+  }
+
+  void Write(std::ostream& os) const {
+    btf_header header{};
+    header.magic = BTF_MAGIC;
+    header.version = BTF_VERSION;
+    header.hdr_len = sizeof(header);
+    header.type_off = 0;
+    header.type_len = Narrow(types_.size(), "type section");
+    header.str_off = header.type_len;
+    header.str_len = Narrow(strings_.size(), "string section");
+    os.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    os.write(types_.data(), static_cast<std::streamsize>(types_.size()));
+    os.write(strings_.data(), static_cast<std::streamsize>(strings_.size()));
+  }
+
+  void operator()(const Special&) {
+    Die() << "internal error: special type numbered";
+  }
+
+  void operator()(const PointerReference& x) {
+    Check(x.kind == PointerReference::Kind::POINTER)
+        << "BTF cannot describe C++ references";
+    AppendType({}, BTF_KIND_PTR, 0, false, Type(x.pointee_type_id));
+  }
+
+  void operator()(const PointerToMember&) {
+    Die() << "BTF cannot describe pointers to members";
+  }
+
+  void operator()(const Typedef& x) {
+    AppendType(x.name, BTF_KIND_TYPEDEF, 0, false, Type(x.referred_type_id));
+  }
+
+  void operator()(const Qualified& x) {
+    uint32_t kind;
+    switch (x.qualifier) {
+      case Qualifier::CONST:
+        kind = BTF_KIND_CONST;
+        break;
+      case Qualifier::VOLATILE:
+        kind = BTF_KIND_VOLATILE;
+        break;
+      case Qualifier::RESTRICT:
+        kind = BTF_KIND_RESTRICT;
+        break;
+      case Qualifier::ATOMIC:
+        Die() << "BTF cannot describe atomic types";
+    }
+    AppendType({}, kind, 0, false, Type(x.qualified_type_id));
+  }
+
+  void operator()(const Primitive& x) {
+    Check(x.encoding.has_value())
+        << "BTF cannot describe primitive type '" << x.name
+        << "' without an encoding";
+    uint32_t encoding = 0;
+    switch (*x.encoding) {
+      case Primitive::Encoding::REAL_NUMBER:
+        AppendType(x.name, BTF_KIND_FLOAT, 0, false, x.bytesize);
+        return;
+      case Primitive::Encoding::BOOLEAN:
+        encoding = BTF_INT_BOOL;
+        break;
+      case Primitive::Encoding::SIGNED_INTEGER:
+        encoding = BTF_INT_SIGNED;
+        break;
+      case Primitive::Encoding::UNSIGNED_INTEGER:
+        break;
+      case Primitive::Encoding::SIGNED_CHARACTER:
+        encoding = BTF_INT_CHAR | BTF_INT_SIGNED;
+        break;
+      case Primitive::Encoding::UNSIGNED_CHARACTER:
+        encoding = BTF_INT_CHAR;
+        break;
+      case Primitive::Encoding::COMPLEX_NUMBER:
+      case Primitive::Encoding::UTF:
+        Die() << "BTF cannot describe the encoding of primitive type '"
+              << x.name << "'";
+    }
+    Check(x.bytesize <= 16) << "BTF integer type '" << x.name
+                            << "' too large";
+    AppendType(x.name, BTF_KIND_INT, 0, false, x.bytesize);
+    Append<uint32_t>((encoding << 24) | (8 * x.bytesize));
+  }
+
+  void operator()(const Array& x) {
+    AppendType({}, BTF_KIND_ARRAY, 0, false, 0);
+    btf_array array{};
+    array.type = Type(x.element_type_id);
+    array.index_type = ArrayIndexType();
+    array.nelems = Narrow(x.number_of_elements, "number of array elements");
+    Append(array);
+  }
+
+  void operator()(const BaseClass&) {
+    Die() << "BTF cannot describe base classes";
+  }
+
+  void operator()(const Method&) {
+    Die() << "BTF cannot describe methods";
+  }
+
+  void operator()(const Member&) {
+    Die() << "internal error: member numbered";
+  }
+
+  void operator()(const StructUnion& x) {
+    const bool is_union = x.kind == StructUnion::Kind::UNION;
+    if (!x.definition) {
+      AppendType(x.name, BTF_KIND_FWD, 0, is_union, 0);
+      return;
+    }
+    const auto& definition = *x.definition;
+    Check(definition.base_classes.empty())
+        << "BTF cannot describe base classes";
+    Check(definition.methods.empty()) << "BTF cannot describe methods";
+    std::vector<const Member*> members;
+    members.reserve(definition.members.size());
+    bool bitfields = false;
+    for (const auto id : definition.members) {
+      const auto* member = Find<Member>(id);
+      Check(member != nullptr) << "struct or union member is not a member";
+      bitfields |= member->bitsize != 0;
+      members.push_back(member);
+    }
+    AppendType(x.name, is_union ? BTF_KIND_UNION : BTF_KIND_STRUCT,
+               members.size(), bitfields,
+               Narrow(definition.bytesize, "struct or union size"));
+    for (const auto* member : members) {
+      btf_member raw{};
+      raw.name_off = String(member->name);
+      raw.type = Type(member->type_id);
+      if (bitfields) {
+        Check(member->offset < (1 << 24) && member->bitsize < (1 << 8))
+            << "BTF cannot describe the position of member '" << member->name
+            << "'";
+        raw.offset = static_cast<uint32_t>(member->bitsize << 24 |
+                                           member->offset);
+      } else {
+        raw.offset = Narrow(member->offset, "member offset");
+      }
+      Append(raw);
+    }
+  }
+
+  void operator()(const Enumeration& x) {
+    if (!x.definition) {
+      // BTF has no enum declarations, just enums without values.
+      AppendType(x.name, BTF_KIND_ENUM, 0, false, 4);
+      return;
+    }
+    const auto& definition = *x.definition;
+    const auto* underlying = Find<Primitive>(definition.underlying_type_id);
+    Check(underlying != nullptr && underlying->encoding.has_value())
+        << "BTF cannot describe the underlying type of enum '" << x.name
+        << "'";
+    const auto encoding = *underlying->encoding;
+    const bool is_signed = encoding == Primitive::Encoding::SIGNED_INTEGER ||
+                           encoding == Primitive::Encoding::SIGNED_CHARACTER;
+    const auto& enumerators = definition.enumerators;
+    // A definition without values needs ENUM64, as an ENUM without values is
+    // a declaration.
+    bool wide = enumerators.empty();
+    for (const auto& [_, value] : enumerators) {
+      wide |= is_signed ? value < std::numeric_limits<int32_t>::min() ||
+                          value > std::numeric_limits<int32_t>::max()
+                        : value < 0 ||
+                          value > std::numeric_limits<uint32_t>::max();
+    }
+    AppendType(x.name, wide ? BTF_KIND_ENUM64 : BTF_KIND_ENUM,
+               enumerators.size(), is_signed, underlying->bytesize);
+    for (const auto& [name, value] : enumerators) {
+      const auto bits = static_cast<uint64_t>(value);
+      if (wide) {
+        btf_enum64 raw{};
+        raw.name_off = String(name);
+        raw.val_lo32 = static_cast<uint32_t>(bits);
+        raw.val_hi32 = static_cast<uint32_t>(bits >> 32);
+        Append(raw);
+      } else {
+        btf_enum raw{};
+        raw.name_off = String(name);
+        raw.val = static_cast<int32_t>(bits);
+        Append(raw);
+      }
+    }
+  }
+
+  void operator()(const Function& x) {
+    AppendType({}, BTF_KIND_FUNC_PROTO, x.parameters.size(), false,
+               Type(x.return_type_id));
+    for (const auto id : x.parameters) {
+      const auto* special = Find<Special>(id);
+      btf_param raw{};
+      raw.type = special != nullptr && special->kind == Special::Kind::VARIADIC
+                 ? 0 : Type(id);
+      Append(raw);
+    }
+  }
+
+  void operator()(const ElfSymbol& x) {
+    const Id type = *x.type_id;
+    if (x.symbol_type == ElfSymbol::SymbolType::FUNCTION ||
+        x.symbol_type == ElfSymbol::SymbolType::GNU_IFUNC) {
+      Check(Find<Function>(type) != nullptr)
+          << "BTF needs a function type for function symbol "
+          << x.symbol_name;
+      AppendType(x.symbol_name, BTF_KIND_FUNC, BTF_FUNC_GLOBAL, false,
+                 Type(type));
+    } else {
+      AppendType(x.symbol_name, BTF_KIND_VAR, 0, false, Type(type));
+      btf_var raw{};
+      raw.linkage = BTF_VAR_GLOBAL_ALLOCATED;
+      Append(raw);
+    }
+  }
+
+  void operator()(const Interface&) {
+    Die() << "internal error: interface numbered";
+  }
+
+ private:
+  template <typename Node>
+  const Node* Find(Id id) const {
+    Get<Node> get;
+    return graph_.Apply<const Node*>(get, id);
+  }
+
+  // Returns the BTF id of a type, numbering it if new. Type 0 is void.
+  uint32_t Type(Id id) {
+    if (const auto* special = Find<Special>(id)) {
+      Check(special->kind == Special::Kind::VOID)
+          << "BTF can only describe variadic parameters and void";
+      return 0;
+    }
+    const auto [it, inserted] = ids_.emplace(id, 0);
+    if (inserted) {
+      queue_.emplace_back(id);
+      it->second = Narrow(queue_.size(), "number of types");
+    }
+    return it->second;
+  }
+
+  uint32_t ArrayIndexType() {
+    if (!array_index_type_) {
+      queue_.emplace_back();
+      array_index_type_ = Narrow(queue_.size(), "number of types");
+    }
+    return *array_index_type_;
+  }
+
+  uint32_t String(std::string_view string) {
+    if (string.empty()) {
+      return 0;
+    }
+    const auto [it, inserted] = string_offsets_.emplace(string, 0);
+    if (inserted) {
+      it->second = Narrow(strings_.size(), "string section");
+      strings_.append(string);
+      strings_.push_back('\0');
+    }
+    return it->second;
+  }
+
+  template <typename T>
+  void Append(const T& value) {
+    types_.append(reinterpret_cast<const char*>(&value), sizeof(value));
+  }
+
+  void AppendType(std::string_view name, uint32_t kind, size_t vlen,
+                  bool kflag, uint32_t size_or_type) {
+    Check(vlen <= 0xffff) << "too many BTF members or values: " << vlen;
+    btf_type type{};
+    type.name_off = String(name);
+    type.info = (kflag ? 1U << 31 : 0U) | kind << 24 |
+                static_cast<uint32_t>(vlen);
+    type.size = size_or_type;
+    Append(type);
+  }
+
+  const Graph& graph_;
+  std::unordered_map<Id, uint32_t> ids_;
+  // graph ids in BTF id order, from 1, with a gap for the array index type
+  std::vector<std::optional<Id>> queue_;
+  std::optional<uint32_t> array_index_type_;
+  std::string types_;
+  // names point into the graph
+  std::string strings_;
+  std::unordered_map<std::string_view, uint32_t> string_offsets_;
+};
+
+}  // namespace
+
+void Write(const Graph& graph, Id root, std::ostream& os) {
+  Encoder encoder(graph);
+  encoder.Encode(root);
+  encoder.Write(os);
+}
+
+}  // namespace btf
+}  // namespace stg
@@ -0,0 +1,44 @@
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+// -*- mode: C++ -*-
+//
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License v2.0 with LLVM Exceptions (the
+// "License"); you may not use this file except in compliance with the
+// License.  You may obtain a copy of the License at
+//
+//     https://llvm.org/LICENSE.txt
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef STG_BTF_WRITER_H_
+#define STG_BTF_WRITER_H_
+
+#include <ostream>
+
+#include "graph.h"
+
+namespace stg {
+namespace btf {
+
+// Writes the interface at the root as raw BTF, which btf::ReadFile reads back.
+//
+// BTF only describes C types and the types of function and variable symbols,
+// so the output is lossy. Symbols without a type are dropped, as are symbol
+// versions, CRCs, namespaces, binding and visibility, and the Interface types.
+// Enum underlying types are reduced to their size and signedness. Parameter
+// types, but not names, are kept and an array index type is synthesised, as
+// pahole does.
+//
+// C++ references, pointers to members, base classes and methods, and
+// primitive types BTF has no encoding for, are errors.
+void Write(const Graph& graph, Id root, std::ostream& os);
+
+}  // namespace btf
+}  // namespace stg
+
+#endif  // STG_BTF_WRITER_H_
@@ -0,0 +1,174 @@
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+// -*- mode: C++ -*-
+//
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License v2.0 with LLVM Exceptions (the
+// "License"); you may not use this file except in compliance with the
+// License.  You may obtain a copy of the License at
+//
+//     https://llvm.org/LICENSE.txt
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "btf_writer.h"
+
+#include <cstdint>
+#include <map>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <catch2/catch.hpp>
+#include "btf_reader.h"
+#include "error.h"
+#include "graph.h"
+#include "proto_writer.h"
+
+namespace Test {
+
+stg::Id Symbol(stg::Graph& graph, const std::string& name,
+               stg::ElfSymbol::SymbolType type, std::optional<stg::Id> id) {
+  return graph.Add<stg::ElfSymbol>(
+      name, std::nullopt, true, type, stg::ElfSymbol::Binding::GLOBAL,
+      stg::ElfSymbol::Visibility::DEFAULT, std::nullopt, std::nullopt, id,
+      std::nullopt);
+}
+
+std::string Text(const stg::Graph& graph, stg::Id root) {
+  std::ostringstream os;
+  stg::proto::Writer(graph).Write(root, os);
+  return os.str();
+}
+
+std::string WriteBtf(const stg::Graph& graph, stg::Id root) {
+  std::ostringstream os;
+  stg::btf::Write(graph, root, os);
+  return os.str();
+}
+
+// Builds types of every kind BTF can describe, as the BTF reader would.
+stg::Id Build(stg::Graph& graph) {
+  using stg::Primitive;
+  const auto void_type = graph.Add<stg::Special>(stg::Special::Kind::VOID);
+  const auto variadic =
+      graph.Add<stg::Special>(stg::Special::Kind::VARIADIC);
+  const auto int_type = graph.Add<Primitive>(
+      "int", Primitive::Encoding::SIGNED_INTEGER, 4);
+  const auto unsigned_type = graph.Add<Primitive>(
+      "unsigned int", Primitive::Encoding::UNSIGNED_INTEGER, 4);
+  const auto char_type = graph.Add<Primitive>(
+      "char", Primitive::Encoding::SIGNED_CHARACTER, 1);
+  const auto bool_type = graph.Add<Primitive>(
+      "_Bool", Primitive::Encoding::BOOLEAN, 1);
+  const auto double_type = graph.Add<Primitive>(
+      "double", Primitive::Encoding::REAL_NUMBER, 8);
+
+  const auto forward = graph.Add<stg::StructUnion>(
+      stg::StructUnion::Kind::UNION, "U");
+  const auto self = graph.Allocate();
+  const auto self_pointer = graph.Add<stg::PointerReference>(
+      stg::PointerReference::Kind::POINTER, self);
+  const auto chars = graph.Add<stg::Array>(16, char_type);
+  graph.Set<stg::StructUnion>(
+      self, stg::StructUnion::Kind::STRUCT, "S", 40, stg::Ids(), stg::Ids(),
+      stg::Ids{graph.Add<stg::Member>("a", int_type, 0, 0),
+               graph.Add<stg::Member>("b", unsigned_type, 32, 3),
+               graph.Add<stg::Member>("", bool_type, 35, 1),
+               graph.Add<stg::Member>("next", self_pointer, 64, 0),
+               graph.Add<stg::Member>("name", chars, 128, 0),
+               graph.Add<stg::Member>("u", graph.Add<stg::PointerReference>(
+                   stg::PointerReference::Kind::POINTER, forward), 256, 0)});
+  const auto typedef_type = graph.Add<stg::Typedef>("S_t", self);
+  const auto qualified = graph.Add<stg::Qualified>(
+      stg::Qualifier::CONST,
+      graph.Add<stg::Qualified>(stg::Qualifier::VOLATILE, typedef_type));
+
+  const auto small_enum = graph.Add<stg::Enumeration>(
+      "E",
+      graph.Add<Primitive>("enum-underlying-signed-32",
+                           Primitive::Encoding::SIGNED_INTEGER, 4),
+      stg::Enumeration::Enumerators{{"A", 0}, {"B", -1}});
+  const auto wide_enum = graph.Add<stg::Enumeration>(
+      "F",
+      graph.Add<Primitive>("enum-underlying-unsigned-64",
+                           Primitive::Encoding::UNSIGNED_INTEGER, 8),
+      stg::Enumeration::Enumerators{{"C", 1}, {"D", int64_t{1} << 40}});
+  const auto declared_enum = graph.Add<stg::Enumeration>("G");
+
+  const auto f = graph.Add<stg::Function>(
+      int_type, stg::Ids{graph.Add<stg::PointerReference>(
+                             stg::PointerReference::Kind::POINTER, qualified),
+                         variadic});
+  const auto g = graph.Add<stg::Function>(
+      void_type, stg::Ids{small_enum, wide_enum, double_type,
+                          graph.Add<stg::PointerReference>(
+                              stg::PointerReference::Kind::POINTER,
+                              declared_enum)});
+
+  const auto function = stg::ElfSymbol::SymbolType::FUNCTION;
+  const auto object = stg::ElfSymbol::SymbolType::OBJECT;
+  return graph.Add<stg::Interface>(std::map<std::string, stg::Id>{
+      {"f", Symbol(graph, "f", function, f)},
+      {"g", Symbol(graph, "g", function, g)},
+      {"v", Symbol(graph, "v", object, small_enum)}});
+}
+
+TEST_CASE("round trip") {
+  stg::Graph graph;
+  const auto root = Build(graph);
+  const auto btf = WriteBtf(graph, root);
+
+  stg::Graph read;
+  const auto read_root = stg::btf::Structs(read).Process(btf);
+  CHECK(Text(read, read_root) == Text(graph, root));
+  // the output is deterministic
+  CHECK(WriteBtf(read, read_root) == btf);
+}
+
+TEST_CASE("lossy") {
+  stg::Graph graph;
+  const auto int_type = graph.Add<stg::Primitive>(
+      "int", stg::Primitive::Encoding::SIGNED_INTEGER, 4);
+  const auto typed = graph.Add<stg::ElfSymbol>(
+      "x", stg::ElfSymbol::VersionInfo{true, "V1"}, true,
+      stg::ElfSymbol::SymbolType::OBJECT, stg::ElfSymbol::Binding::WEAK,
+      stg::ElfSymbol::Visibility::PROTECTED, stg::ElfSymbol::CRC{0x1234},
+      "NS", int_type, std::nullopt);
+  const auto untyped = Symbol(graph, "y", stg::ElfSymbol::SymbolType::OBJECT,
+                              std::nullopt);
+  const auto root = graph.Add<stg::Interface>(
+      std::map<std::string, stg::Id>{{"x@@V1", typed}, {"y", untyped}});
+
+  stg::Graph expected;
+  const auto expected_root = expected.Add<stg::Interface>(
+      std::map<std::string, stg::Id>{
+          {"x", Symbol(expected, "x", stg::ElfSymbol::SymbolType::OBJECT,
+                       expected.Add<stg::Primitive>(
+                           "int", stg::Primitive::Encoding::SIGNED_INTEGER,
+                           4))}});
+
+  stg::Graph read;
+  const auto read_root =
+      stg::btf::Structs(read).Process(WriteBtf(graph, root));
+  CHECK(Text(read, read_root) == Text(expected, expected_root));
+}
+
+TEST_CASE("not describable") {
+  stg::Graph graph;
+  const auto int_type = graph.Add<stg::Primitive>(
+      "int", stg::Primitive::Encoding::SIGNED_INTEGER, 4);
+  const auto reference = graph.Add<stg::PointerReference>(
+      stg::PointerReference::Kind::LVALUE_REFERENCE, int_type);
+  const auto root = graph.Add<stg::Interface>(std::map<std::string, stg::Id>{
+      {"r", Symbol(graph, "r", stg::ElfSymbol::SymbolType::OBJECT,
+                   reference)}});
+  CHECK_THROWS_AS(WriteBtf(graph, root), stg::Exception);
+}
+
+}  // namespace Test
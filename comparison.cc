@@ -21,21 +21,43 @@
 
 #include "comparison.h"
 
+#include <unistd.h>
+
 #include <algorithm>
 #include <array>
+#include <bit>
+#include <cerrno>
+#include <chrono>
+#include <compare>
 #include <cstddef>
-#include <map>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <initializer_list>
+#include <memory>
+#include <mutex>
+#include <numeric>
 #include <optional>
 #include <ostream>
-#include <sstream>
+#include <span>
 #include <string>
 #include <string_view>
+#include <type_traits>
+#include <unordered_map>
 #include <utility>
+#include <variant>
 #include <vector>
 
 #include "error.h"
+#include "file_descriptor.h"
+#include "filter.h"
+#include "flat_map.h"
 #include "graph.h"
+#include "hashing.h"
+#include "metrics.h"
 #include "order.h"
+#include "parallel.h"
+#include "trace.h"
 
 namespace stg {
 
@@ -44,7 +66,7 @@ struct IgnoreDescriptor {
   Ignore::Value value;
 };
 
-static constexpr std::array<IgnoreDescriptor, 9> kIgnores{{
+static constexpr std::array<IgnoreDescriptor, 10> kIgnores{{
   {"type_declaration_status",  Ignore::TYPE_DECLARATION_STATUS  },
   {"symbol_type_presence",     Ignore::SYMBOL_TYPE_PRESENCE     },
   {"primitive_type_encoding",  Ignore::PRIMITIVE_TYPE_ENCODING  },
@@ -54,6 +76,12 @@ static constexpr std::array<IgnoreDescriptor, 9> kIgnores{{
   {"linux_symbol_crc",         Ignore::SYMBOL_CRC               },
   {"interface_addition",       Ignore::INTERFACE_ADDITION       },
   {"type_definition_addition", Ignore::TYPE_DEFINITION_ADDITION },
+  {"symbol_type_same_crc",     Ignore::SYMBOL_TYPE_SAME_CRC     },
+}};
+
+// in the order qualifier differences are reported
+static constexpr std::array<Qualifier, 4> kQualifiers{{
+  Qualifier::CONST, Qualifier::VOLATILE, Qualifier::RESTRICT, Qualifier::ATOMIC,
 }};
 
 std::optional<Ignore::Value> ParseIgnore(std::string_view ignore) {
@@ -73,12 +101,6 @@ std::ostream& operator<<(std::ostream& os, IgnoreUsage) {
   return os << '\n';
 }
 
-std::string QualifiersMessage(Qualifier qualifier, const std::string& action) {
-  std::ostringstream os;
-  os << "qualifier " << qualifier << ' ' << action;
-  return os.str();
-}
-
 /*
  * We compute a diff for every visited node.
  *
@@ -104,24 +126,168 @@ std::string QualifiersMessage(Qualifier qualifier, const std::string& action) {
  * return true and an edge diff. The node is closed, return the stored value and
  * an edge diff.
  */
-std::pair<bool, std::optional<Comparison>> Compare::operator()(Id id1, Id id2) {
-  const Comparison comparison{{id1}, {id2}};
+
+namespace {
+
+struct IsInterface {
+  bool operator()(const Interface&) const {
+    return true;
+  }
+
+  template <typename Node>
+  bool operator()(const Node&) const {
+    return false;
+  }
+};
+
+bool IsInterfaceNode(const Graph& graph, Id id) {
+  const IsInterface is_interface;
+  return graph.Apply<bool>(is_interface, id);
+}
+
+}  // namespace
+
+template <typename IgnorePolicy>
+bool Compare<IgnorePolicy>::Identical(Id id1, Id id2) {
+  const auto* hash1 = hashes->Find(id1);
+  const auto* hash2 = hashes->Find(id2);
+  if (hash1 == nullptr || hash2 == nullptr || *hash1 != *hash2) {
+    return false;
+  }
+  if (!equals) {
+    equality_cache.emplace(*hashes, metrics);
+    equals.emplace(graph, *equality_cache);
+  }
+  return (*equals)(id1, id2);
+}
+
+template <typename IgnorePolicy>
+const ResolutionTable& Compare<IgnorePolicy>::Resolutions() {
+  if (resolutions == nullptr) {
+    resolutions = &resolution_table.emplace(graph, jobs);
+  }
+  return *resolutions;
+}
+
+template <typename IgnorePolicy>
+std::optional<ComparisonCache::Key> Compare<IgnorePolicy>::CacheKey(
+    const Comparison& comparison) {
+  if (cache == nullptr || digests == nullptr || !comparison.first
+      || !comparison.second) {
+    return {};
+  }
+  const auto it1 = digests->find(*comparison.first);
+  const auto it2 = digests->find(*comparison.second);
+  if (it1 == digests->end() || it2 == digests->end()) {
+    return {};
+  }
+  return {{it1->second, it2->second}};
+}
+
+template <typename IgnorePolicy>
+Compare<IgnorePolicy>::~Compare() {
+  known_counters.Record(known);
+  outcomes_counters.Record(outcomes);
+  outcomes_spilled = outcomes.SpilledBytes();
+  provisional_capacity = provisional.capacity();
+}
+
+template <typename IgnorePolicy>
+std::pair<bool, std::optional<Comparison>> Compare<IgnorePolicy>::operator()(
+    Id id1, Id id2) {
+  const size_t base = stack.size();
+  Outcome outcome;
+  if (!Visit({{id1}, {id2}}, outcome)) {
+    return outcome;
+  }
+  while (true) {
+    Frame& frame = stack.back();
+    if (frame.next < frame.end) {
+      const size_t edge = frame.next++;
+      const Comparison comparison = edges[edge].comparison;
+      // this may push a frame and edges, invalidating references
+      const size_t ix = stack.size() - 1;
+      if (!Visit(comparison, outcome)) {
+        Settle(stack[ix], edge, outcome);
+      }
+      continue;
+    }
+    outcome = Leave();
+    if (stack.size() == base) {
+      return outcome;
+    }
+    Settle(stack.back(), stack.back().next - 1, outcome);
+  }
+}
+
+template <typename IgnorePolicy>
+std::pair<bool, std::optional<Comparison>> Compare<IgnorePolicy>::Follow(
+    Result& result, Id id1, Id id2) {
+  // MaybeAddEdgeDiff adds the edge diff next
+  edges.push_back({{{id1}, {id2}}, result.diff_.details.size(), true});
+  return {true, {edges.back().comparison}};
+}
+
+// Starts a comparison, returning false, with the outcome, if it is already
+// known.
+template <typename IgnorePolicy>
+bool Compare<IgnorePolicy>::Visit(const Comparison& comparison,
+                                  Outcome& outcome) {
+  const Id id1 = *comparison.first;
+  const Id id2 = *comparison.second;
   ++queried;
 
-  // 1. Check if the comparison has an already known result.
-  auto already_known = known.find(comparison);
-  if (already_known != known.end()) {
+  // 1. Check for node identity. Within a single graph, and particularly one
+  // where the inputs have been deduplicated jointly, a node is always equal
+  // to itself, whatever is being ignored.
+  if (id1 == id2) {
+    ++same_node;
+    outcome = {true, {}};
+    return false;
+  }
+
+  // 2. Check if the comparison has an already known result.
+  const bool* already_known = known.Find(comparison);
+  if (already_known == nullptr && shared_known != nullptr) {
+    if (const auto equals = shared_known->Find(comparison)) {
+      already_known = known.Insert(comparison, *equals).first;
+    }
+  }
+  if (already_known != nullptr) {
     // Already visited and closed.
     ++already_compared;
-    if (already_known->second) {
-      return {true, {}};
+    if (*already_known) {
+      outcome = {true, {}};
     } else  {
-      return {false, {comparison}};
+      outcome = {false, {comparison}};
     }
+    return false;
   }
   // Either open or not visited at all
 
-  // 2. Record node with Strongly-Connected Component finder.
+  // 3. Check for structural identity.
+  if (hashes != nullptr && Identical(id1, id2)) {
+    ++hash_skipped;
+    known.Insert(comparison, true);
+    if (shared_known != nullptr) {
+      shared_known->Insert({&comparison, 1}, true);
+    }
+    outcome = {true, {}};
+    return false;
+  }
+
+  // 4. Check for an equivalence found in an earlier run.
+  const auto cache_key = CacheKey(comparison);
+  if (cache_key && cache->Find(*cache_key)) {
+    known.Insert(comparison, true);
+    if (shared_known != nullptr) {
+      shared_known->Insert({&comparison, 1}, true);
+    }
+    outcome = {true, {}};
+    return false;
+  }
+
+  // 5. Record node with Strongly-Connected Component finder.
   auto handle = scc.Open(comparison);
   if (!handle) {
     // Already open.
@@ -130,74 +296,131 @@ std::pair<bool, std::optional<Comparison>> Compare::operator()(Id id1, Id id2) {
     // up not being used and, while it would be nice to be lazier, they encode
     // all the cycling-breaking edges needed to recreate a full diff structure.
     ++being_compared;
-    return {true, {comparison}};
+    outcome = {true, {comparison}};
+    return false;
   }
-  // Comparison opened, need to close it before returning.
+  // Comparison opened, need to close it in Leave.
   ++really_compared;
+  Check(provisional.size() == *handle)
+      << "internal error: provisional diffs out of step";
+  provisional.emplace_back();
 
+  const size_t begin = edges.size();
   Result result;
 
-  const auto [unqualified1, qualifiers1] = ResolveQualifiers(graph, id1);
-  const auto [unqualified2, qualifiers2] = ResolveQualifiers(graph, id2);
-  if (!qualifiers1.empty() || !qualifiers2.empty()) {
-    // 3.1 Qualified type difference.
-    auto it1 = qualifiers1.begin();
-    auto it2 = qualifiers2.begin();
-    const auto end1 = qualifiers1.end();
-    const auto end2 = qualifiers2.end();
-    while (it1 != end1 || it2 != end2) {
-      if (it2 == end2 || (it1 != end1 && *it1 < *it2)) {
-        if (!ignore.Test(Ignore::QUALIFIER)) {
-          result.AddNodeDiff(QualifiersMessage(*it1, "removed"));
-        }
-        ++it1;
-      } else if (it1 == end1 || (it2 != end2 && *it1 > *it2)) {
-        if (!ignore.Test(Ignore::QUALIFIER)) {
-          result.AddNodeDiff(QualifiersMessage(*it2, "added"));
+  const auto& resolutions = Resolutions();
+  const Id unqualified1 = resolutions.Unqualified(id1);
+  const Id unqualified2 = resolutions.Unqualified(id2);
+  const uint8_t qualifiers1 = resolutions.Qualifiers(id1);
+  const uint8_t qualifiers2 = resolutions.Qualifiers(id2);
+  if (qualifiers1 != 0 || qualifiers2 != 0) {
+    // 6.1 Qualified type difference.
+    if (!ignore.Test(Ignore::QUALIFIER)) {
+      for (const auto qualifier : kQualifiers) {
+        const uint8_t bit = 1 << static_cast<int>(qualifier);
+        if ((qualifiers1 & bit) && !(qualifiers2 & bit)) {
+          result.AddNodeDiff(DiffDetail::Kind::QUALIFIER_REMOVED, qualifier,
+                             {});
+        } else if (!(qualifiers1 & bit) && (qualifiers2 & bit)) {
+          result.AddNodeDiff(DiffDetail::Kind::QUALIFIER_ADDED, {}, qualifier);
         }
-        ++it2;
-      } else {
-        ++it1;
-        ++it2;
       }
     }
-    const auto type_diff = (*this)(unqualified1, unqualified2);
+    const auto type_diff = Follow(result, unqualified1, unqualified2);
     result.MaybeAddEdgeDiff("underlying", type_diff);
   } else {
-    const auto [resolved1, typedefs1] = ResolveTypedefs(graph, unqualified1);
-    const auto [resolved2, typedefs2] = ResolveTypedefs(graph, unqualified2);
-    if (unqualified1 != resolved1 || unqualified2 != resolved2) {
-      // 3.2 Typedef difference.
-      result.diff_.holds_changes = !typedefs1.empty() && !typedefs2.empty()
-                                   && typedefs1[0] == typedefs2[0];
-      result.MaybeAddEdgeDiff("resolved", (*this)(resolved1, resolved2));
+    const Id resolved1 = resolutions.Resolved(unqualified1);
+    const Id resolved2 = resolutions.Resolved(unqualified2);
+    const bool typedef1 = unqualified1 != resolved1;
+    const bool typedef2 = unqualified2 != resolved2;
+    if (typedef1 || typedef2) {
+      // 6.2 Typedef difference.
+      result.diff_.holds_changes =
+          typedef1 && typedef2
+          && resolutions.GetTypedef(unqualified1).name
+              == resolutions.GetTypedef(unqualified2).name;
+      result.MaybeAddEdgeDiff("resolved", Follow(result, resolved1, resolved2));
     } else {
-      // 4. Compare nodes, if possible.
+      // 7. Compare nodes, if possible.
       result = graph.Apply2<Result>(*this, unqualified1, unqualified2);
     }
   }
 
-  // 5. Update result and check for a complete Strongly-Connected Component.
-  provisional.insert({comparison, result.diff_});
-  auto comparisons = scc.Close(*handle);
+  stack.push_back({comparison, *handle, std::move(result), begin, begin,
+                   edges.size()});
+  return true;
+}
+
+// Settles the edge diff of a followed edge, given the outcome of its
+// comparison.
+template <typename IgnorePolicy>
+void Compare<IgnorePolicy>::Settle(Frame& frame, size_t edge,
+                                   const Outcome& outcome) {
+  frame.result.equals_ &= outcome.first;
+  if (!outcome.second) {
+    edges[edge].keep = false;
+  }
+}
+
+// Finishes the comparison at the top of the stack, returning its outcome.
+template <typename IgnorePolicy>
+std::pair<bool, std::optional<Comparison>> Compare<IgnorePolicy>::Leave() {
+  Frame frame = std::move(stack.back());
+  stack.pop_back();
+  const Comparison& comparison = frame.comparison;
+  Result& result = frame.result;
+
+  // Drop the edge diffs of the edges that turned out to hold no difference.
+  auto& details = result.diff_.details;
+  size_t kept = 0;
+  size_t edge = frame.begin;
+  for (size_t ix = 0; ix < details.size(); ++ix) {
+    if (edge < frame.end && edges[edge].detail == ix) {
+      if (!edges[edge++].keep) {
+        continue;
+      }
+    }
+    if (kept != ix) {
+      details[kept] = std::move(details[ix]);
+    }
+    ++kept;
+  }
+  details.erase(details.begin() + kept, details.end());
+  edges.erase(edges.begin() + frame.begin, edges.end());
+
+  // 8. Update result and check for a complete Strongly-Connected Component.
+  const size_t handle = frame.handle;
+  provisional[handle] = std::move(result.diff_);
+  auto comparisons = scc.Close(handle);
   auto size = comparisons.size();
   if (size) {
     scc_size.Add(size);
     // Closed SCC.
     //
     // Note that result now incorporates every inequality and difference in the
-    // SCC via the DFS spanning tree.
-    for (auto& c : comparisons) {
+    // SCC via the DFS spanning tree. The SCC's comparisons are those opened
+    // last, in order, so their diffs are at the top of the provisional stack.
+    for (size_t ix = 0; ix < size; ++ix) {
+      const auto& c = comparisons[ix];
       // Record equality / inequality.
-      known.insert({c, result.equals_});
-      const auto it = provisional.find(c);
-      Check(it != provisional.end())
-          << "internal error: missing provisional diffs";
-      if (!result.equals_) {
+      known.Insert(c, result.equals_);
+      if (!result.equals_
+          && (!count_only || IsInterfaceNode(graph, *c.first))) {
         // Record differences.
-        outcomes.insert(*it);
+        outcomes.Insert(c, std::move(provisional[handle + ix]));
+      }
+    }
+    provisional.resize(handle);
+    if (shared_known != nullptr) {
+      shared_known->Insert(comparisons, result.equals_);
+    }
+    // A symbol filter changes the meaning of an Interface comparison.
+    if (result.equals_ && symbol_filter == nullptr) {
+      for (const auto& c : comparisons) {
+        if (const auto key = CacheKey(c)) {
+          cache->Insert(*key);
+        }
       }
-      provisional.erase(it);
     }
     if (result.equals_) {
       equivalent += size;
@@ -212,23 +435,498 @@ std::pair<bool, std::optional<Comparison>> Compare::operator()(Id id1, Id id2) {
   return {result.equals_, {comparison}};
 }
 
-Comparison Compare::Removed(Id id) {
+std::optional<bool> SharedKnown::Find(const Comparison& comparison) const {
+  const std::lock_guard<std::mutex> lock(mutex_);
+  const bool* equals = known_.Find(comparison);
+  return equals != nullptr ? std::make_optional(*equals) : std::nullopt;
+}
+
+void SharedKnown::Insert(std::span<const Comparison> comparisons,
+                         bool equals) {
+  const std::lock_guard<std::mutex> lock(mutex_);
+  for (const auto& comparison : comparisons) {
+    known_.Insert(comparison, equals);
+  }
+}
+
+Known SharedKnown::Release() {
+  const std::lock_guard<std::mutex> lock(mutex_);
+  return std::move(known_);
+}
+
+// An unlinked temporary file, appended to and read concurrently.
+class SpillFile {
+ public:
+  SpillFile() : fd_(Create()) {}
+
+  // Returns the offset of the bytes written.
+  uint64_t Append(std::string_view bytes) {
+    uint64_t offset;
+    {
+      const std::lock_guard<std::mutex> lock(mutex_);
+      offset = size_;
+      size_ += bytes.size();
+    }
+    for (size_t done = 0; done < bytes.size();) {
+      const ssize_t count = pwrite(fd_.Value(), bytes.data() + done,
+                                   bytes.size() - done, offset + done);
+      Check(count > 0) << "failed to spill diffs: " << Error(errno);
+      done += count;
+    }
+    return offset;
+  }
+
+  std::string Read(uint64_t offset, uint64_t size) const {
+    std::string bytes(size, '\0');
+    for (size_t done = 0; done < size;) {
+      const ssize_t count = pread(fd_.Value(), bytes.data() + done,
+                                  size - done, offset + done);
+      Check(count > 0) << "failed to read spilled diffs: " << Error(errno);
+      done += count;
+    }
+    return bytes;
+  }
+
+ private:
+  static FileDescriptor Create() {
+    std::string path =
+        std::filesystem::temp_directory_path() / "stg-diffs-XXXXXX";
+    const int fd = mkstemp(path.data());
+    Check(fd >= 0) << "failed to create " << path << ": " << Error(errno);
+    FileDescriptor result(fd);
+    Check(unlink(path.c_str()) == 0)
+        << "failed to unlink " << path << ": " << Error(errno);
+    return result;
+  }
+
+  const FileDescriptor fd_;
+  std::mutex mutex_;
+  uint64_t size_ = 0;
+};
+
+namespace {
+
+// Diffs are spilled in a simple binary form, only ever read back by the same
+// process. Labels are string literals, so their addresses stay valid.
+template <typename Value>
+void Put(std::string& out, const Value& value) {
+  static_assert(std::is_trivially_copyable_v<Value>);
+  out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+void Put(std::string& out, std::string_view text) {
+  Put(out, uint64_t{text.size()});
+  out.append(text);
+}
+
+void Put(std::string& out, const std::optional<Id>& id) {
+  Put(out, uint64_t{id ? id->ix_ + 1 : 0});
+}
+
+void Put(std::string& out, const DiffDetail::Value& value) {
+  Put(out, uint8_t(value.index()));
+  std::visit([&](const auto& x) {
+    if constexpr (std::is_same_v<std::decay_t<decltype(x)>, std::string>) {
+      Put(out, std::string_view(x));
+    } else {
+      Put(out, x);
+    }
+  }, value);
+}
+
+void Put(std::string& out, const Diff& diff) {
+  Put(out, uint8_t(diff.holds_changes | diff.has_changes << 1));
+  Put(out, uint64_t{diff.details.size()});
+  for (const auto& detail : diff.details) {
+    Put(out, detail.kind_);
+    Put(out, detail.label_.data());
+    Put(out, uint64_t{detail.label_.size()});
+    Put(out, detail.before_);
+    Put(out, detail.after_);
+    Put(out, std::string_view(detail.name_));
+    Put(out, bool(detail.edge_));
+    if (detail.edge_) {
+      Put(out, detail.edge_->first);
+      Put(out, detail.edge_->second);
+    }
+  }
+}
+
+class SpillReader {
+ public:
+  explicit SpillReader(std::string_view in) : in_(in) {}
+
+  template <typename Value>
+  Value Trivial() {
+    static_assert(std::is_trivially_copyable_v<Value>);
+    const auto raw = Take(sizeof(Value));
+    std::array<char, sizeof(Value)> bytes;
+    std::copy(raw.begin(), raw.end(), bytes.begin());
+    return std::bit_cast<Value>(bytes);
+  }
+
+  std::string String() {
+    return std::string(Take(Trivial<uint64_t>()));
+  }
+
+  std::optional<Id> OptionalId() {
+    const auto ix = Trivial<uint64_t>();
+    return ix == 0 ? std::nullopt : std::make_optional(Id(ix - 1));
+  }
+
+  template <size_t Index = 0>
+  DiffDetail::Value Variant(size_t index) {
+    if constexpr (Index < std::variant_size_v<DiffDetail::Value>) {
+      using Alternative = std::variant_alternative_t<Index, DiffDetail::Value>;
+      if (index != Index) {
+        return Variant<Index + 1>(index);
+      }
+      if constexpr (std::is_same_v<Alternative, std::string>) {
+        return DiffDetail::Value(std::in_place_index<Index>, String());
+      } else {
+        return DiffDetail::Value(std::in_place_index<Index>,
+                                 Trivial<Alternative>());
+      }
+    } else {
+      Die() << "internal error: bad spilled diff value";
+    }
+  }
+
+  Diff Read() {
+    Diff diff;
+    const auto flags = Trivial<uint8_t>();
+    diff.holds_changes = flags & 1;
+    diff.has_changes = flags & 2;
+    const auto count = Trivial<uint64_t>();
+    diff.details.reserve(count);
+    for (size_t ix = 0; ix < count; ++ix) {
+      const auto kind = Trivial<DiffDetail::Kind>();
+      const auto* label_data = Trivial<const char*>();
+      const auto label_size = Trivial<uint64_t>();
+      auto before = Variant(Trivial<uint8_t>());
+      auto after = Variant(Trivial<uint8_t>());
+      auto name = String();
+      std::optional<Comparison> edge;
+      if (Trivial<bool>()) {
+        auto first = OptionalId();
+        edge.emplace(first, OptionalId());
+      }
+      diff.Add(kind, std::string_view(label_data, label_size),
+               std::move(before), std::move(after), std::move(name), edge);
+    }
+    Check(in_.empty()) << "internal error: bad spilled diff";
+    return diff;
+  }
+
+ private:
+  std::string_view Take(size_t size) {
+    Check(size <= in_.size()) << "internal error: truncated spilled diff";
+    const auto result = in_.substr(0, size);
+    in_.remove_prefix(size);
+    return result;
+  }
+
+  std::string_view in_;
+};
+
+// An estimate of the memory held by a diff.
+size_t Footprint(const Diff& diff) {
+  size_t bytes = sizeof(uint64_t) + sizeof(Diff)
+                 + diff.details.capacity() * sizeof(DiffDetail);
+  for (const auto& detail : diff.details) {
+    bytes += detail.name_.capacity();
+    for (const auto* value : {&detail.before_, &detail.after_}) {
+      if (const auto* text = std::get_if<std::string>(value)) {
+        bytes += text->capacity();
+      }
+    }
+  }
+  return bytes;
+}
+
+}  // namespace
+
+void Outcomes::SetBudget(size_t budget) {
+  budget_ = budget;
+  if (budget != 0 && !file_) {
+    file_ = std::make_shared<SpillFile>();
+    paged_ = std::make_unique<Paged>();
+  }
+}
+
+Outcomes Outcomes::Fork(size_t shares) const {
+  Outcomes result;
+  if (budget_ != 0) {
+    result.budget_ = std::max<size_t>(1, budget_ / shares);
+    result.file_ = file_;
+    result.paged_ = std::make_unique<Paged>();
+  }
+  return result;
+}
+
+bool Outcomes::Contains(const Comparison& comparison) {
+  return diffs_.Find(comparison) != nullptr
+      || (spilled_.Size() != 0 && spilled_.Find(comparison) != nullptr);
+}
+
+void Outcomes::Insert(const Comparison& comparison, Diff diff) {
+  if (spilled_.Size() != 0 && spilled_.Find(comparison) != nullptr) {
+    return;
+  }
+  const size_t bytes = budget_ != 0 ? Footprint(diff) : 0;
+  if (diffs_.Insert(comparison, std::move(diff)).second) {
+    bytes_ += bytes;
+    if (budget_ != 0 && bytes_ > budget_) {
+      Spill();
+    }
+  }
+}
+
+const Diff& Outcomes::At(const Comparison& comparison) const {
+  if (const auto* diff = diffs_.Find(comparison)) {
+    return *diff;
+  }
+  const auto* location = spilled_.Find(comparison);
+  Check(location != nullptr) << "internal error: missing comparison";
+  const std::lock_guard<std::mutex> lock(paged_->mutex);
+  const auto [it, inserted] = paged_->diffs.try_emplace(comparison);
+  if (inserted) {
+    it->second =
+        SpillReader(file_->Read(location->offset, location->size)).Read();
+  }
+  return it->second;
+}
+
+void Outcomes::Merge(Outcomes&& other) {
+  Check(other.spilled_.Size() == 0 || other.file_ == file_)
+      << "internal error: merging diffs spilled elsewhere";
+  other.spilled_.ForEach([&](const Comparison& comparison,
+                             const Location& location) {
+    if (!Contains(comparison)) {
+      spilled_.Insert(comparison, location);
+    }
+  });
+  other.diffs_.ForEach([&](const Comparison& comparison, Diff& diff) {
+    Insert(comparison, std::move(diff));
+  });
+  spilled_bytes_ += other.spilled_bytes_;
+  lookups_ += other.Lookups();
+  probes_ += other.Probes();
+  other = Outcomes();
+}
+
+void Outcomes::Spill() {
+  std::string bytes;
+  std::vector<std::pair<Comparison, Location>> locations;
+  locations.reserve(diffs_.Size());
+  diffs_.ForEach([&](const Comparison& comparison, const Diff& diff) {
+    const size_t offset = bytes.size();
+    Put(bytes, diff);
+    locations.push_back({comparison, {offset, bytes.size() - offset}});
+  });
+  const uint64_t base = file_->Append(bytes);
+  for (auto& [comparison, location] : locations) {
+    location.offset += base;
+    spilled_.Insert(comparison, location);
+  }
+  spilled_bytes_ += bytes.size();
+  lookups_ += diffs_.Lookups();
+  probes_ += diffs_.Probes();
+  diffs_ = ComparisonMap<Diff>();
+  bytes_ = 0;
+}
+
+namespace {
+
+using Crc = std::optional<ElfSymbol::CRC>;
+
+struct GetSymbolCrc {
+  Crc operator()(const ElfSymbol& x) const {
+    return x.crc;
+  }
+
+  template <typename Node>
+  Crc operator()(const Node&) const {
+    return {};
+  }
+};
+
+// The CRCs of the nodes, if they are symbols that have them.
+std::pair<Crc, Crc> GetCrcs(const Graph& graph, Id id1, Id id2) {
+  const GetSymbolCrc get;
+  return {graph.Apply<Crc>(get, id1), graph.Apply<Crc>(get, id2)};
+}
+
+}  // namespace
+
+/*
+ * Comparing pairs concurrently.
+ *
+ * Each worker has its own Compare state and runs its own DFS. Comparison
+ * outcomes and SCCs do not depend on the order in which they are visited, so
+ * the workers agree on every comparison they have in common. Closed results
+ * are shared so that each SCC is usually only compared once. Once all pairs
+ * are done, the workers' outcomes are merged into ours.
+ *
+ * Pairs are handed out largest first, by estimated subgraph size, so that the
+ * big shared types are explored early, and their results shared, and the long
+ * comparisons do not end up running alone at the end.
+ *
+ * With a deadline, pairs of symbols with changed CRCs, which are the most
+ * likely to differ, are handed out before the others, even when comparing
+ * serially. Pairs are only skipped before they are started, so every result
+ * returned is complete.
+ */
+template <typename IgnorePolicy>
+std::vector<std::optional<std::pair<bool, std::optional<Comparison>>>>
+Compare<IgnorePolicy>::CompareAll(
+    const std::vector<std::pair<Id, Id>>& pairs,
+    std::span<const std::string_view> names) {
+  std::vector<std::optional<std::pair<bool, std::optional<Comparison>>>>
+      results(pairs.size());
+  // A pair may be quick only because an earlier one did its work, so this
+  // finds the pairs that dominate, not necessarily those that are costly.
+  const auto compare_pair = [&](Compare& compare, size_t ix) {
+    const trace::Span span("compare.pair");
+    const auto start = std::chrono::steady_clock::now();
+    const auto& [id1, id2] = pairs[ix];
+    results[ix] = compare(id1, id2);
+    if (!names.empty()) {
+      const uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::steady_clock::now() - start).count();
+      if (compare.slowest_pairs.Wants(ns)) {
+        compare.slowest_pairs.Add(ns, std::string(names[ix]));
+      }
+    }
+  };
+  const bool concurrent = jobs > 1 && pairs.size() > 1;
+  if (!concurrent && !deadline) {
+    for (size_t ix = 0; ix < pairs.size(); ++ix) {
+      compare_pair(*this, ix);
+    }
+    return results;
+  }
+
+  std::vector<size_t> order(pairs.size());
+  {
+    const trace::Span span("compare.schedule");
+    // changed CRCs, then estimated size
+    std::vector<std::pair<bool, size_t>> priorities;
+    priorities.reserve(pairs.size());
+    for (const auto& [id1, id2] : pairs) {
+      bool changed = false;
+      if (deadline) {
+        const auto [crc1, crc2] = GetCrcs(graph, id1, id2);
+        changed = crc1 && crc2 && *crc1 != *crc2;
+      }
+      priorities.emplace_back(changed, EstimateSize(id1, id2));
+    }
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+      return priorities[a] > priorities[b];
+    });
+  }
+
+  if (!concurrent) {
+    for (const size_t ix : order) {
+      if (Expired()) {
+        break;
+      }
+      compare_pair(*this, ix);
+    }
+    return results;
+  }
+
+  const auto& table = Resolutions();
+  SharedKnown shared(std::move(known));
+  // worker metrics must outlive the workers
+  std::vector<Metrics> worker_metrics(jobs);
+  std::vector<std::optional<Compare>> workers(jobs);
+  {
+    Workers utilisation(metrics, "compare.workers");
+    ForEachIndex(jobs, pairs.size(), [&](size_t worker, size_t index) {
+      if (Expired()) {
+        return;
+      }
+      auto& compare = workers[worker];
+      if (!compare) {
+        compare.emplace(graph, ignore, worker_metrics[worker]);
+        compare->shared_known = &shared;
+        compare->resolutions = &table;
+        compare->hashes = hashes;
+        compare->cache = cache;
+        compare->digests = digests;
+        compare->outcomes = outcomes.Fork(jobs);
+        compare->count_only = count_only;
+      }
+      compare_pair(*compare, order[index]);
+    }, &utilisation);
+  }
+  for (auto& compare : workers) {
+    if (compare) {
+      Check(compare->scc.Empty()) << "internal error: SCC state broken";
+      outcomes.Merge(std::move(compare->outcomes));
+    }
+  }
+  known = shared.Release();
+  workers.clear();
+  MergeShards(worker_metrics, metrics);
+  return results;
+}
+
+template <typename IgnorePolicy>
+bool Compare<IgnorePolicy>::Expired() const {
+  return deadline && std::chrono::steady_clock::now() >= *deadline;
+}
+
+template <typename IgnorePolicy>
+size_t Compare<IgnorePolicy>::EstimateSize(Id id1, Id id2) {
+  // Symbols with the same CRCs do not have their types compared.
+  if (ignore.Test(Ignore::SYMBOL_TYPE_SAME_CRC)) {
+    const auto [crc1, crc2] = GetCrcs(graph, id1, id2);
+    if (crc1 && crc2 && *crc1 == *crc2) {
+      return 1;
+    }
+  }
+  // Pairs with equal hashes are almost always found identical, cheaply.
+  if (hashes != nullptr) {
+    const auto* hash1 = hashes->Find(id1);
+    const auto* hash2 = hashes->Find(id2);
+    if (hash1 != nullptr && hash2 != nullptr && *hash1 == *hash2) {
+      return 1;
+    }
+  }
+  if (!subgraph_sizes) {
+    subgraph_sizes.emplace(graph);
+  }
+  return std::max((*subgraph_sizes)(id1), (*subgraph_sizes)(id2));
+}
+
+template <typename IgnorePolicy>
+Comparison Compare<IgnorePolicy>::Removed(Id id) {
   Comparison comparison{{id}, {}};
-  outcomes.insert({comparison, {}});
+  if (!count_only) {
+    outcomes.Insert(comparison, {});
+  }
   return comparison;
 }
 
-Comparison Compare::Added(Id id) {
+template <typename IgnorePolicy>
+Comparison Compare<IgnorePolicy>::Added(Id id) {
   Comparison comparison{{}, {id}};
-  outcomes.insert({comparison, {}});
+  if (!count_only) {
+    outcomes.Insert(comparison, {});
+  }
   return comparison;
 }
 
-Result Compare::Mismatch() {
+template <typename IgnorePolicy>
+Result Compare<IgnorePolicy>::Mismatch() {
   return Result().MarkIncomparable();
 }
 
-Result Compare::operator()(const Special& x1, const Special& x2) {
+template <typename IgnorePolicy>
+Result Compare<IgnorePolicy>::operator()(const Special& x1, const Special& x2) {
   Result result;
   if (x1.kind != x2.kind) {
     return result.MarkIncomparable();
@@ -236,39 +934,48 @@ Result Compare::operator()(const Special& x1, const Special& x2) {
   return result;
 }
 
-Result Compare::operator()(const PointerReference& x1,
-                           const PointerReference& x2) {
+template <typename IgnorePolicy>
+Result Compare<IgnorePolicy>::operator()(const PointerReference& x1,
+                                         const PointerReference& x2) {
   Result result;
   if (x1.kind != x2.kind) {
     return result.MarkIncomparable();
   }
-  const auto type_diff = (*this)(x1.pointee_type_id, x2.pointee_type_id);
+  const auto type_diff =
+      Follow(result, x1.pointee_type_id, x2.pointee_type_id);
   const auto text =
       x1.kind == PointerReference::Kind::POINTER ? "pointed-to" : "referred-to";
   result.MaybeAddEdgeDiff(text, type_diff);
   return result;
 }
 
-Result Compare::operator()(const PointerToMember& x1,
-                           const PointerToMember& x2) {
+template <typename IgnorePolicy>
+Result Compare<IgnorePolicy>::operator()(const PointerToMember& x1,
+                                         const PointerToMember& x2) {
   Result result;
   result.MaybeAddEdgeDiff(
-      "containing", (*this)(x1.containing_type_id, x2.containing_type_id));
-  result.MaybeAddEdgeDiff("", (*this)(x1.pointee_type_id, x2.pointee_type_id));
+      "containing",
+      Follow(result, x1.containing_type_id, x2.containing_type_id));
+  result.MaybeAddEdgeDiff(
+      "", Follow(result, x1.pointee_type_id, x2.pointee_type_id));
   return result;
 }
 
-Result Compare::operator()(const Typedef&, const Typedef&) {
+template <typename IgnorePolicy>
+Result Compare<IgnorePolicy>::operator()(const Typedef&, const Typedef&) {
   // Compare will never attempt to directly compare Typedefs.
   Die() << "internal error: Compare(Typedef)";
 }
 
-Result Compare::operator()(const Qualified&, const Qualified&) {
+template <typename IgnorePolicy>
+Result Compare<IgnorePolicy>::operator()(const Qualified&, const Qualified&) {
   // Compare will never attempt to directly compare Qualifiers.
   Die() << "internal error: Compare(Qualified)";
 }
 
-Result Compare::operator()(const Primitive& x1, const Primitive& x2) {
+template <typename IgnorePolicy>
+Result Compare<IgnorePolicy>::operator()(const Primitive& x1,
+                                         const Primitive& x2) {
   Result result;
   if (x1.name != x2.name) {
     return result.MarkIncomparable();
@@ -281,61 +988,116 @@ Result Compare::operator()(const Primitive& x1, const Primitive& x2) {
   return result;
 }
 
-Result Compare::operator()(const Array& x1, const Array& x2) {
+template <typename IgnorePolicy>
+Result Compare<IgnorePolicy>::operator()(const Array& x1, const Array& x2) {
   Result result;
   result.MaybeAddNodeDiff("number of elements",
                           x1.number_of_elements, x2.number_of_elements);
-  const auto type_diff = (*this)(x1.element_type_id, x2.element_type_id);
+  const auto type_diff =
+      Follow(result, x1.element_type_id, x2.element_type_id);
   result.MaybeAddEdgeDiff("element", type_diff);
   return result;
 }
 
-void Compare::CompareDefined(bool defined1, bool defined2, Result& result) {
+template <typename IgnorePolicy>
+void Compare<IgnorePolicy>::CompareDefined(bool defined1, bool defined2,
+                                           Result& result) {
   if (defined1 != defined2) {
     if (!ignore.Test(Ignore::TYPE_DECLARATION_STATUS)
         && !(ignore.Test(Ignore::TYPE_DEFINITION_ADDITION) && defined2)) {
-      std::ostringstream os;
-      os << "was " << (defined1 ? "fully defined" : "only declared")
-         << ", is now " << (defined2 ? "fully defined" : "only declared");
-      result.AddNodeDiff(os.str());
+      result.AddNodeDiff(DiffDetail::Kind::DEFINITION, defined1, defined2);
     }
   }
 }
 
 namespace {
 
-using KeyIndexPairs = std::vector<std::pair<std::string, size_t>>;
-KeyIndexPairs MatchingKeys(const Graph& graph, const std::vector<Id>& ids) {
+using Key = MatchingKey::Key;
+
+struct KeyHash {
+  size_t operator()(const Key& key) const {
+    return Hash64()(key.name, key.mangled_name, key.method, key.nesting,
+                    key.anonymous).value;
+  }
+};
+
+using KeyIndexPairs = std::vector<std::pair<Key, size_t>>;
+KeyIndexPairs MatchingKeys(const Graph& graph, const Ids& ids) {
   KeyIndexPairs keys;
   const auto size = ids.size();
   keys.reserve(size);
   size_t anonymous_ix = 0;
+  MatchingKey matching_key(graph);
   for (size_t ix = 0; ix < size; ++ix) {
-    auto key = MatchingKey(graph)(ids[ix]);
-    if (key.empty()) {
-      key = "#anon#" + std::to_string(anonymous_ix++);
+    auto key = matching_key(ids[ix]);
+    if (key.Empty()) {
+      key.anonymous = ++anonymous_ix;
     }
     keys.emplace_back(key, ix);
   }
-  std::stable_sort(keys.begin(), keys.end());
   return keys;
 }
 
+// Beyond this many keys, pair up by hashing rather than sorting.
+constexpr size_t kHashJoinKeys = 64;
+
 using MatchedPairs =
     std::vector<std::pair<std::optional<size_t>, std::optional<size_t>>>;
-MatchedPairs PairUp(const KeyIndexPairs& keys1, const KeyIndexPairs& keys2) {
+
+// Pairs up the nth occurrence of each key in the first sequence with the nth
+// occurrence of the same key in the second. The order of the result does not
+// matter, as it is always reordered.
+MatchedPairs PairUp(KeyIndexPairs keys1, KeyIndexPairs keys2) {
   MatchedPairs pairs;
   pairs.reserve(std::max(keys1.size(), keys2.size()));
+  if (keys1.size() + keys2.size() > kHashJoinKeys) {
+    std::unordered_map<Key, std::vector<size_t>, KeyHash> index;
+    index.reserve(keys2.size());
+    for (const auto& [key, ix] : keys2) {
+      index[key].push_back(ix);
+    }
+    std::unordered_map<Key, size_t, KeyHash> used;
+    std::vector<bool> matched2(keys2.size(), false);
+    for (const auto& [key, ix] : keys1) {
+      const auto it = index.find(key);
+      if (it != index.end()) {
+        auto& count = used[key];
+        if (count < it->second.size()) {
+          // in both
+          const size_t ix2 = it->second[count++];
+          matched2[ix2] = true;
+          pairs.push_back({{ix}, {ix2}});
+          continue;
+        }
+      }
+      // removed
+      pairs.push_back({{ix}, {}});
+    }
+    for (const auto& [_, ix] : keys2) {
+      if (!matched2[ix]) {
+        // added
+        pairs.push_back({{}, {ix}});
+      }
+    }
+    return pairs;
+  }
+
+  std::stable_sort(keys1.begin(), keys1.end());
+  std::stable_sort(keys2.begin(), keys2.end());
   auto it1 = keys1.begin();
   auto it2 = keys2.begin();
   const auto end1 = keys1.end();
   const auto end2 = keys2.end();
   while (it1 != end1 || it2 != end2) {
-    if (it2 == end2 || (it1 != end1 && it1->first < it2->first)) {
+    // one three-way comparison per step
+    const auto order = it1 == end1 ? std::strong_ordering::greater
+                       : it2 == end2 ? std::strong_ordering::less
+                       : it1->first <=> it2->first;
+    if (order < 0) {
       // removed
       pairs.push_back({{it1->second}, {}});
       ++it1;
-    } else if (it1 == end1 || (it2 != end2 && it1->first > it2->first)) {
+    } else if (order > 0) {
       // added
       pairs.push_back({{}, {it2->second}});
       ++it2;
@@ -349,11 +1111,11 @@ MatchedPairs PairUp(const KeyIndexPairs& keys1, const KeyIndexPairs& keys2) {
   return pairs;
 }
 
-void CompareNodes(Result& result, Compare& compare, const std::vector<Id>& ids1,
-                  const std::vector<Id>& ids2) {
-  const auto keys1 = MatchingKeys(compare.graph, ids1);
-  const auto keys2 = MatchingKeys(compare.graph, ids2);
-  auto pairs = PairUp(keys1, keys2);
+template <typename IgnorePolicy>
+void CompareNodes(Result& result, Compare<IgnorePolicy>& compare,
+                  const Ids& ids1, const Ids& ids2) {
+  auto pairs = PairUp(MatchingKeys(compare.graph, ids1),
+                      MatchingKeys(compare.graph, ids2));
   Reorder(pairs);
   for (const auto& [index1, index2] : pairs) {
     if (index1 && !index2) {
@@ -368,22 +1130,38 @@ void CompareNodes(Result& result, Compare& compare, const std::vector<Id>& ids1,
       // in both
       const auto& x1 = ids1[*index1];
       const auto& x2 = ids2[*index2];
-      result.MaybeAddEdgeDiff("", compare(x1, x2));
+      result.MaybeAddEdgeDiff("", compare.Follow(result, x1, x2));
     } else {
       Die() << "CompareNodes: impossible pair";
     }
   }
 }
 
-void CompareNodes(Result& result, Compare& compare,
-                  const std::map<std::string, Id>& x1,
-                  const std::map<std::string, Id>& x2,
-                  bool ignore_added) {
-  // Group diffs into removed, added and changed symbols for readability.
-  std::vector<Id> removed;
-  std::vector<Id> added;
-  std::vector<std::pair<Id, Id>> in_both;
-
+// Records just the first difference (in key order, but among symbols with
+// changed CRCs first, if other symbols have their types ignored) and returns
+// whether there was one. Nodes are compared serially, so that nothing is done
+// after the difference is found.
+template <typename IgnorePolicy>
+bool CompareNodesFailFast(Result& result, Compare<IgnorePolicy>& compare,
+                          const FlatMap<std::string, Id>& x1,
+                          const FlatMap<std::string, Id>& x2,
+                          bool ignore_added) {
+  if (compare.ignore.Test(Ignore::SYMBOL_TYPE_SAME_CRC)) {
+    for (const auto& [name, id1] : x1) {
+      const auto it2 = x2.find(name);
+      if (it2 == x2.end()) {
+        continue;
+      }
+      const auto [crc1, crc2] = GetCrcs(compare.graph, id1, it2->second);
+      if (crc1 && crc2 && *crc1 != *crc2) {
+        const auto diff = compare(id1, it2->second);
+        if (!diff.first) {
+          result.MaybeAddEdgeDiff("", diff);
+          return true;
+        }
+      }
+    }
+  }
   auto it1 = x1.begin();
   auto it2 = x2.begin();
   const auto end1 = x1.end();
@@ -391,70 +1169,142 @@ void CompareNodes(Result& result, Compare& compare,
   while (it1 != end1 || it2 != end2) {
     if (it2 == end2 || (it1 != end1 && it1->first < it2->first)) {
       // removed
-      removed.push_back(it1->second);
-      ++it1;
+      result.AddEdgeDiff("", compare.Removed(it1->second));
+      return true;
     } else if (it1 == end1 || (it2 != end2 && it1->first > it2->first)) {
       // added
       if (!ignore_added) {
-        added.push_back(it2->second);
+        result.AddEdgeDiff("", compare.Added(it2->second));
+        return true;
       }
       ++it2;
     } else {
       // in both
-      in_both.emplace_back(it1->second, it2->second);
+      const auto diff = compare(it1->second, it2->second);
+      if (!diff.first) {
+        result.MaybeAddEdgeDiff("", diff);
+        return true;
+      }
       ++it1;
       ++it2;
     }
   }
+  return false;
+}
 
-  for (const auto symbol1 : removed) {
-    result.AddEdgeDiff("", compare.Removed(symbol1));
-  }
-  for (const auto symbol2 : added) {
-    result.AddEdgeDiff("", compare.Added(symbol2));
+// A pair of name-keyed maps of nodes, such as the symbols or the types of two
+// Interfaces.
+using NamedNodes = std::pair<const FlatMap<std::string, Id>&,
+                             const FlatMap<std::string, Id>&>;
+
+template <typename IgnorePolicy>
+void CompareNodes(Result& result, Compare<IgnorePolicy>& compare,
+                  std::initializer_list<NamedNodes> groups,
+                  bool ignore_added) {
+  // Group diffs into removed, added and changed nodes for readability, for each
+  // group in turn. The nodes in both maps of every group are joined by name and
+  // compared together, so they all share the workers and the known results.
+  struct Group {
+    std::vector<Id> removed;
+    std::vector<Id> added;
+    // the range of in_both
+    size_t begin;
+    size_t end;
+  };
+  std::vector<Group> joined;
+  std::vector<std::pair<Id, Id>> in_both;
+  std::vector<std::string_view> in_both_names;
+
+  for (const auto& [x1, x2] : groups) {
+    auto& group = joined.emplace_back();
+    group.begin = in_both.size();
+    auto it1 = x1.begin();
+    auto it2 = x2.begin();
+    const auto end1 = x1.end();
+    const auto end2 = x2.end();
+    while (it1 != end1 || it2 != end2) {
+      if (it2 == end2 || (it1 != end1 && it1->first < it2->first)) {
+        // removed
+        group.removed.push_back(it1->second);
+        ++it1;
+      } else if (it1 == end1 || (it2 != end2 && it1->first > it2->first)) {
+        // added
+        if (!ignore_added) {
+          group.added.push_back(it2->second);
+        }
+        ++it2;
+      } else {
+        // in both
+        in_both.emplace_back(it1->second, it2->second);
+        in_both_names.push_back(it1->first);
+        ++it1;
+        ++it2;
+      }
+    }
+    group.end = in_both.size();
   }
-  for (const auto& [symbol1, symbol2] : in_both) {
-    result.MaybeAddEdgeDiff("", compare(symbol1, symbol2));
+
+  const auto diffs = compare.CompareAll(in_both, in_both_names);
+  for (const auto& group : joined) {
+    for (const auto node1 : group.removed) {
+      result.AddEdgeDiff("", compare.Removed(node1));
+    }
+    for (const auto node2 : group.added) {
+      result.AddEdgeDiff("", compare.Added(node2));
+    }
+    for (size_t ix = group.begin; ix < group.end; ++ix) {
+      if (!diffs[ix]) {
+        compare.skipped.emplace_back(in_both_names[ix]);
+        continue;
+      }
+      if (compare.deadline) {
+        ++compare.completed;
+      }
+      result.MaybeAddEdgeDiff("", *diffs[ix]);
+    }
   }
 }
 
 }  // namespace
 
-Result Compare::operator()(const BaseClass& x1, const BaseClass& x2) {
+template <typename IgnorePolicy>
+Result Compare<IgnorePolicy>::operator()(const BaseClass& x1,
+                                         const BaseClass& x2) {
   Result result;
   result.MaybeAddNodeDiff("inheritance", x1.inheritance, x2.inheritance);
   result.MaybeAddNodeDiff("offset", x1.offset, x2.offset);
-  result.MaybeAddEdgeDiff("", (*this)(x1.type_id, x2.type_id));
+  result.MaybeAddEdgeDiff("", Follow(result, x1.type_id, x2.type_id));
   return result;
 }
 
-Result Compare::operator()(const Member& x1, const Member& x2) {
+template <typename IgnorePolicy>
+Result Compare<IgnorePolicy>::operator()(const Member& x1, const Member& x2) {
   Result result;
   result.MaybeAddNodeDiff("offset", x1.offset, x2.offset);
   if (!ignore.Test(Ignore::MEMBER_SIZE)) {
     const bool bitfield1 = x1.bitsize > 0;
     const bool bitfield2 = x2.bitsize > 0;
     if (bitfield1 != bitfield2) {
-      std::ostringstream os;
-      os << "was " << (bitfield1 ? "a bit-field" : "not a bit-field")
-         << ", is now " << (bitfield2 ? "a bit-field" : "not a bit-field");
-      result.AddNodeDiff(os.str());
+      result.AddNodeDiff(DiffDetail::Kind::BIT_FIELD, bitfield1, bitfield2);
     } else {
       result.MaybeAddNodeDiff("bit-field size", x1.bitsize, x2.bitsize);
     }
   }
-  result.MaybeAddEdgeDiff("", (*this)(x1.type_id, x2.type_id));
+  result.MaybeAddEdgeDiff("", Follow(result, x1.type_id, x2.type_id));
   return result;
 }
 
-Result Compare::operator()(const Method& x1, const Method& x2) {
+template <typename IgnorePolicy>
+Result Compare<IgnorePolicy>::operator()(const Method& x1, const Method& x2) {
   Result result;
   result.MaybeAddNodeDiff("vtable offset", x1.vtable_offset, x2.vtable_offset);
-  result.MaybeAddEdgeDiff("", (*this)(x1.type_id, x2.type_id));
+  result.MaybeAddEdgeDiff("", Follow(result, x1.type_id, x2.type_id));
   return result;
 }
 
-Result Compare::operator()(const StructUnion& x1, const StructUnion& x2) {
+template <typename IgnorePolicy>
+Result Compare<IgnorePolicy>::operator()(const StructUnion& x1,
+                                         const StructUnion& x2) {
   Result result;
   // Compare two anonymous types recursively, not holding diffs.
   // Compare two identically named types recursively, holding diffs.
@@ -480,19 +1330,62 @@ Result Compare::operator()(const StructUnion& x1, const StructUnion& x2) {
   return result;
 }
 
-static KeyIndexPairs MatchingKeys(const Enumeration::Enumerators& enums) {
-  KeyIndexPairs names;
-  const auto size = enums.size();
-  names.reserve(size);
-  for (size_t ix = 0; ix < size; ++ix) {
-    const auto& name = enums[ix].first;
-    names.emplace_back(name, ix);
+// Pairs up the nth occurrence of each enumerator name in the first sequence
+// with the nth occurrence of the same name in the second, in linear time.
+// Enumerator names are interned by the graph, so equal names have the same
+// data pointer.
+static MatchedPairs PairUp(const Enumeration::Enumerators& enums1,
+                           const Enumeration::Enumerators& enums2) {
+  const size_t size1 = enums1.size();
+  const size_t size2 = enums2.size();
+  MatchedPairs pairs;
+  pairs.reserve(std::max(size1, size2));
+  // common case: the same names in the same order
+  size_t common = 0;
+  while (common < size1 && common < size2
+         && enums1[common].first.data() == enums2[common].first.data()) {
+    pairs.push_back({{common}, {common}});
+    ++common;
+  }
+  if (common == size1 && common == size2) {
+    return pairs;
+  }
+  // Index the rest of the second sequence, chaining repeated names in order.
+  std::unordered_map<const char*, size_t> first;
+  first.reserve(size2 - common);
+  std::vector<size_t> next(size2, size2);
+  for (size_t ix = size2; ix > common; --ix) {
+    const auto [it, inserted] = first.try_emplace(enums2[ix - 1].first.data(),
+                                                  ix - 1);
+    if (!inserted) {
+      next[ix - 1] = std::exchange(it->second, ix - 1);
+    }
   }
-  std::stable_sort(names.begin(), names.end());
-  return names;
+  std::vector<bool> matched2(size2, false);
+  for (size_t ix = common; ix < size1; ++ix) {
+    const auto it = first.find(enums1[ix].first.data());
+    if (it != first.end() && it->second < size2) {
+      // in both
+      const size_t ix2 = std::exchange(it->second, next[it->second]);
+      matched2[ix2] = true;
+      pairs.push_back({{ix}, {ix2}});
+    } else {
+      // removed
+      pairs.push_back({{ix}, {}});
+    }
+  }
+  for (size_t ix = common; ix < size2; ++ix) {
+    if (!matched2[ix]) {
+      // added
+      pairs.push_back({{}, {ix}});
+    }
+  }
+  return pairs;
 }
 
-Result Compare::operator()(const Enumeration& x1, const Enumeration& x2) {
+template <typename IgnorePolicy>
+Result Compare<IgnorePolicy>::operator()(const Enumeration& x1,
+                                         const Enumeration& x2) {
   Result result;
   // Compare two anonymous types recursively, not holding diffs.
   // Compare two identically named types recursively, holding diffs.
@@ -508,41 +1401,34 @@ Result Compare::operator()(const Enumeration& x1, const Enumeration& x2) {
 
   if (definition1.has_value() && definition2.has_value()) {
     if (!ignore.Test(Ignore::ENUM_UNDERLYING_TYPE)) {
-      const auto type_diff = (*this)(definition1->underlying_type_id,
-                                     definition2->underlying_type_id);
+      const auto type_diff = Follow(result, definition1->underlying_type_id,
+                                    definition2->underlying_type_id);
       result.MaybeAddEdgeDiff("underlying", type_diff);
     }
 
-    const auto enums1 = definition1->enumerators;
-    const auto enums2 = definition2->enumerators;
-    const auto keys1 = MatchingKeys(enums1);
-    const auto keys2 = MatchingKeys(enums2);
-    auto pairs = PairUp(keys1, keys2);
+    const auto& enums1 = definition1->enumerators;
+    const auto& enums2 = definition2->enumerators;
+    auto pairs = PairUp(enums1, enums2);
     Reorder(pairs);
     for (const auto& [index1, index2] : pairs) {
       if (index1 && !index2) {
         // removed
         const auto& enum1 = enums1[*index1];
-        std::ostringstream os;
-        os << "enumerator '" << enum1.first
-           << "' (" << enum1.second << ") was removed";
-        result.AddNodeDiff(os.str());
+        result.AddNodeDiff(DiffDetail::Kind::ENUMERATOR_REMOVED, enum1.second,
+                           {}, std::string(enum1.first));
       } else if (!index1 && index2) {
         // added
         const auto& enum2 = enums2[*index2];
-        std::ostringstream os;
-        os << "enumerator '" << enum2.first
-           << "' (" << enum2.second << ") was added";
-        result.AddNodeDiff(os.str());
+        result.AddNodeDiff(DiffDetail::Kind::ENUMERATOR_ADDED, {}, enum2.second,
+                           std::string(enum2.first));
       } else if (index1 && index2) {
         // in both
         const auto& enum1 = enums1[*index1];
         const auto& enum2 = enums2[*index2];
-        result.MaybeAddNodeDiff(
-            [&](std::ostream& os) {
-              os << "enumerator '" << enum1.first << "' value";
-            },
-            enum1.second, enum2.second);
+        if (enum1.second != enum2.second) {
+          result.AddNodeDiff(DiffDetail::Kind::ENUMERATOR_CHANGED, enum1.second,
+                             enum2.second, std::string(enum1.first));
+        }
       } else {
         Die() << "Compare(Enumeration): impossible pair";
       }
@@ -552,9 +1438,12 @@ Result Compare::operator()(const Enumeration& x1, const Enumeration& x2) {
   return result;
 }
 
-Result Compare::operator()(const Function& x1, const Function& x2) {
+template <typename IgnorePolicy>
+Result Compare<IgnorePolicy>::operator()(const Function& x1,
+                                         const Function& x2) {
   Result result;
-  const auto type_diff = (*this)(x1.return_type_id, x2.return_type_id);
+  const auto type_diff =
+      Follow(result, x1.return_type_id, x2.return_type_id);
   result.MaybeAddEdgeDiff("return", type_diff);
 
   const auto& parameters1 = x1.parameters;
@@ -563,11 +1452,9 @@ Result Compare::operator()(const Function& x1, const Function& x2) {
   for (size_t i = 0; i < min; ++i) {
     const Id p1 = parameters1.at(i);
     const Id p2 = parameters2.at(i);
-    result.MaybeAddEdgeDiff(
-        [&](std::ostream& os) {
-          os << "parameter " << i + 1;
-        },
-        (*this)(p1, p2));
+    result.MaybeAddEdgeDiff(DiffDetail::Kind::PARAMETER,
+                            DiffDetail::MakeValue(i + 1),
+                            Follow(result, p1, p2));
   }
 
   bool added = parameters1.size() < parameters2.size();
@@ -575,16 +1462,17 @@ Result Compare::operator()(const Function& x1, const Function& x2) {
   const auto& parameters = which.parameters;
   for (size_t i = min; i < parameters.size(); ++i) {
     const Id parameter = parameters.at(i);
-    std::ostringstream os;
-    os << "parameter " << i + 1 << " of";
     auto diff = added ? Added(parameter) : Removed(parameter);
-    result.AddEdgeDiff(os.str(), diff);
+    result.AddEdgeDiff(DiffDetail::Kind::PARAMETER_OF,
+                       DiffDetail::MakeValue(i + 1), diff);
   }
 
   return result;
 }
 
-Result Compare::operator()(const ElfSymbol& x1, const ElfSymbol& x2) {
+template <typename IgnorePolicy>
+Result Compare<IgnorePolicy>::operator()(const ElfSymbol& x1,
+                                         const ElfSymbol& x2) {
   // ELF symbols have a lot of different attributes that can impact ABI
   // compatibility and others that either cannot or are subsumed by information
   // elsewhere.
@@ -655,8 +1543,14 @@ Result Compare::operator()(const ElfSymbol& x1, const ElfSymbol& x2) {
   }
   result.MaybeAddNodeDiff("namespace", x1.ns, x2.ns);
 
+  // A CRC is a hash of the symbol's type, so matching ones vouch for it.
+  if (ignore.Test(Ignore::SYMBOL_TYPE_SAME_CRC) && x1.crc && x2.crc
+      && *x1.crc == *x2.crc) {
+    return result;
+  }
+
   if (x1.type_id && x2.type_id) {
-    result.MaybeAddEdgeDiff("", (*this)(*x1.type_id, *x2.type_id));
+    result.MaybeAddEdgeDiff("", Follow(result, *x1.type_id, *x2.type_id));
   } else if (x1.type_id) {
     if (!ignore.Test(Ignore::SYMBOL_TYPE_PRESENCE)) {
       result.AddEdgeDiff("", Removed(*x1.type_id));
@@ -672,15 +1566,57 @@ Result Compare::operator()(const ElfSymbol& x1, const ElfSymbol& x2) {
   return result;
 }
 
-Result Compare::operator()(const Interface& x1, const Interface& x2) {
+namespace {
+
+FlatMap<std::string, Id> FilterSymbols(
+    const FlatMap<std::string, Id>& symbols, const Filter& filter) {
+  std::vector<std::pair<std::string, Id>> result;
+  for (const auto& [name, id] : symbols) {
+    if (filter(name)) {
+      result.emplace_back(name, id);
+    }
+  }
+  return FlatMap<std::string, Id>(std::move(result));
+}
+
+}  // namespace
+
+template <typename IgnorePolicy>
+Result Compare<IgnorePolicy>::operator()(const Interface& x1,
+                                         const Interface& x2) {
   Result result;
   result.diff_.holds_changes = true;
   const bool ignore_added = ignore.Test(Ignore::INTERFACE_ADDITION);
-  CompareNodes(result, *this, x1.symbols, x2.symbols, ignore_added);
-  CompareNodes(result, *this, x1.types, x2.types, ignore_added);
+  if (symbol_filter != nullptr) {
+    // Only the selected symbols, and what they reach, are compared.
+    const auto symbols1 = FilterSymbols(x1.symbols, *symbol_filter);
+    const auto symbols2 = FilterSymbols(x2.symbols, *symbol_filter);
+    if (fail_fast) {
+      CompareNodesFailFast(result, *this, symbols1, symbols2, ignore_added);
+    } else {
+      CompareNodes(result, *this, {{symbols1, symbols2}}, ignore_added);
+    }
+    return result;
+  }
+  if (fail_fast) {
+    if (!CompareNodesFailFast(result, *this, x1.symbols, x2.symbols,
+                              ignore_added)) {
+      CompareNodesFailFast(result, *this, x1.types, x2.types, ignore_added);
+    }
+    return result;
+  }
+  // Type roots, with --types, can be as many as the symbols, so the two are
+  // compared in a single concurrent batch rather than one after the other.
+  CompareNodes(result, *this, {{x1.symbols, x2.symbols}, {x1.types, x2.types}},
+               ignore_added);
   return result;
 }
 
+template struct Compare<Ignore>;
+template struct Compare<IgnoreNothing>;
+template struct Compare<IgnoreAdditions>;
+template struct Compare<IgnoreAbigailNoise>;
+
 std::pair<Id, Qualifiers> ResolveQualifiers(const Graph& graph, Id id) {
   std::pair<Id, Qualifiers> result = {id, {}};
   ResolveQualifier resolve(graph, result.first, result.second);
@@ -721,9 +1657,193 @@ std::pair<Id, std::vector<std::string>> ResolveTypedefs(
   return result;
 }
 
+namespace {
+
+// Appends the targets of a node's edges.
+struct AppendChildren {
+  void operator()(const Special&) {}
+  void operator()(const PointerReference& x) {
+    children.push_back(x.pointee_type_id);
+  }
+  void operator()(const PointerToMember& x) {
+    children.push_back(x.containing_type_id);
+    children.push_back(x.pointee_type_id);
+  }
+  void operator()(const Typedef& x) {
+    children.push_back(x.referred_type_id);
+  }
+  void operator()(const Qualified& x) {
+    children.push_back(x.qualified_type_id);
+  }
+  void operator()(const Primitive&) {}
+  void operator()(const Array& x) {
+    children.push_back(x.element_type_id);
+  }
+  void operator()(const BaseClass& x) {
+    children.push_back(x.type_id);
+  }
+  void operator()(const Method& x) {
+    children.push_back(x.type_id);
+  }
+  void operator()(const Member& x) {
+    children.push_back(x.type_id);
+  }
+  void operator()(const StructUnion& x) {
+    if (x.definition) {
+      const auto& definition = *x.definition;
+      Append(definition.base_classes);
+      Append(definition.methods);
+      Append(definition.members);
+    }
+  }
+  void operator()(const Enumeration& x) {
+    if (x.definition) {
+      children.push_back(x.definition->underlying_type_id);
+    }
+  }
+  void operator()(const Function& x) {
+    children.push_back(x.return_type_id);
+    Append(x.parameters);
+  }
+  void operator()(const ElfSymbol& x) {
+    if (x.type_id) {
+      children.push_back(*x.type_id);
+    }
+  }
+  void operator()(const Interface& x) {
+    for (const auto& [_, id] : x.symbols) {
+      children.push_back(id);
+    }
+    for (const auto& [_, id] : x.types) {
+      children.push_back(id);
+    }
+  }
+
+  void Append(const Ids& ids) {
+    children.insert(children.end(), ids.begin(), ids.end());
+  }
+
+  std::vector<Id>& children;
+};
+
+}  // namespace
+
+size_t SubgraphSizes::operator()(Id id) {
+  if (sizes_[id.ix_] != 0) {
+    return sizes_[id.ix_];
+  }
+  const auto handle = scc_.Open(id);
+  if (!handle) {
+    // already open, so counted in its SCC
+    return 0;
+  }
+  const size_t limit = sizes_.size();
+  pending_.push_back(0);
+  const size_t start = children_.size();
+  AppendChildren append{children_};
+  graph_.Apply<void>(append, id);
+  const size_t end = children_.size();
+  for (size_t ix = start; ix < end; ++ix) {
+    const size_t size = (*this)(children_[ix]);
+    pending_[*handle] = std::min(limit, pending_[*handle] + size);
+  }
+  children_.erase(children_.begin() + start, children_.end());
+  const auto nodes = scc_.Close(*handle);
+  if (nodes.empty()) {
+    return 0;
+  }
+  size_t total = nodes.size();
+  for (size_t ix = *handle; ix < pending_.size(); ++ix) {
+    total = std::min(limit, total + pending_[ix]);
+  }
+  pending_.resize(*handle);
+  for (const auto& node : nodes) {
+    sizes_[node.ix_] = total;
+  }
+  return total;
+}
+
+namespace {
+
+// A single step of qualifier resolution, as ResolveQualifier.
+struct ResolveQualifierBits {
+  bool operator()(const Qualified& x) {
+    id = x.qualified_type_id;
+    qualifiers |= 1 << static_cast<int>(x.qualifier);
+    return true;
+  }
+  bool operator()(const Array&) {
+    qualifiers = 0;
+    return false;
+  }
+  bool operator()(const Function&) {
+    qualifiers = 0;
+    return false;
+  }
+  template <typename Node>
+  bool operator()(const Node&) {
+    return false;
+  }
+
+  Id& id;
+  uint8_t& qualifiers;
+};
+
+// A single step of typedef resolution, as ResolveTypedef.
+struct ResolveTypedefStep {
+  bool operator()(const Typedef& x) {
+    id = x.referred_type_id;
+    return true;
+  }
+  template <typename Node>
+  bool operator()(const Node&) {
+    return false;
+  }
+
+  Id& id;
+};
+
+struct GetTypedefNode {
+  const Typedef& operator()(const Typedef& x) const {
+    return x;
+  }
+  template <typename Node>
+  const Typedef& operator()(const Node&) const {
+    Die() << "internal error: not a typedef";
+  }
+};
+
+}  // namespace
+
+ResolutionTable::ResolutionTable(const Graph& graph, size_t jobs)
+    : graph_(graph),
+      unqualified_(graph.Limit().ix_, Id(0)),
+      qualifiers_(graph.Limit().ix_, 0),
+      resolved_(graph.Limit().ix_, Id(0)) {
+  graph.ParallelForEach(jobs, Id(0), graph.Limit(), [&](size_t, Id id) {
+    Id unqualified = id;
+    uint8_t qualifiers = 0;
+    ResolveQualifierBits resolve_qualifier{unqualified, qualifiers};
+    while (graph.Apply<bool>(resolve_qualifier, unqualified)) {
+    }
+    unqualified_[id.ix_] = unqualified;
+    qualifiers_[id.ix_] = qualifiers;
+    Id resolved = id;
+    ResolveTypedefStep resolve_typedef{resolved};
+    while (graph.Apply<bool>(resolve_typedef, resolved)) {
+    }
+    resolved_[id.ix_] = resolved;
+  });
+}
+
+const Typedef& ResolutionTable::GetTypedef(Id id) const {
+  const GetTypedefNode get;
+  return graph_.Apply<const Typedef&>(get, id);
+}
+
 bool ResolveTypedef::operator()(const Typedef& x) {
   id = x.referred_type_id;
-  names.push_back(x.name);
+  names.emplace_back(x.name);
   return true;
 }
 
@@ -732,35 +1852,36 @@ bool ResolveTypedef::operator()(const Node&) {
   return false;
 }
 
-std::string MatchingKey::operator()(Id id) {
-  return graph.Apply<std::string>(*this, id);
+MatchingKey::Key MatchingKey::operator()(Id id) {
+  return graph.Apply<Key>(*this, id);
 }
 
-std::string MatchingKey::operator()(const BaseClass& x) {
+MatchingKey::Key MatchingKey::operator()(const BaseClass& x) {
   return (*this)(x.type_id);
 }
 
-std::string MatchingKey::operator()(const Member& x) {
+MatchingKey::Key MatchingKey::operator()(const Member& x) {
   if (!x.name.empty()) {
-    return x.name;
+    return {.name = x.name};
   }
   return (*this)(x.type_id);
 }
 
-std::string MatchingKey::operator()(const Method& x) {
-  return x.name + ',' + x.mangled_name;
+MatchingKey::Key MatchingKey::operator()(const Method& x) {
+  return {.name = x.name, .mangled_name = x.mangled_name, .method = true};
 }
 
-std::string MatchingKey::operator()(const StructUnion& x) {
+MatchingKey::Key MatchingKey::operator()(const StructUnion& x) {
   if (!x.name.empty()) {
-    return x.name;
+    return {.name = x.name};
   }
   if (x.definition) {
     const auto& members = x.definition->members;
     for (const auto& member : members) {
-      const auto recursive = (*this)(member);
-      if (!recursive.empty()) {
-        return recursive + '+';
+      auto recursive = (*this)(member);
+      if (!recursive.Empty()) {
+        ++recursive.nesting;
+        return recursive;
       }
     }
   }
@@ -768,7 +1889,7 @@ std::string MatchingKey::operator()(const StructUnion& x) {
 }
 
 template <typename Node>
-std::string MatchingKey::operator()(const Node&) {
+MatchingKey::Key MatchingKey::operator()(const Node&) {
   return {};
 }
 
@@ -22,23 +22,36 @@
 #ifndef STG_COMPARISON_H_
 #define STG_COMPARISON_H_
 
+#include <chrono>
+#include <compare>
 #include <cstddef>
+#include <cstdint>
 #include <functional>
+#include <limits>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <optional>
 #include <ostream>
 #include <set>
-#include <sstream>
+#include <span>
 #include <string>
 #include <string_view>
 #include <type_traits>
 #include <unordered_map>
 #include <utility>
+#include <variant>
 #include <vector>
 
+#include "comparison_cache.h"
+#include "equality.h"
+#include "equality_cache.h"
+#include "error.h"
+#include "filter.h"
 #include "graph.h"
+#include "hashing.h"
 #include "metrics.h"
+#include "node_hashes.h"
 #include "scc.h"
 
 namespace stg {
@@ -56,6 +69,8 @@ struct Ignore {
     // ABI compatibility testing
     INTERFACE_ADDITION = 1<<7,
     TYPE_DEFINITION_ADDITION = 1<<8,
+    // trusting Linux kernel symbol CRCs
+    SYMBOL_TYPE_SAME_CRC = 1<<9,
   };
 
   using Bitset = std::underlying_type_t<Value>;
@@ -78,6 +93,28 @@ struct Ignore {
   Bitset bitset = 0;
 };
 
+// A fixed set of ignore options, known at compile time. Compare specialised on
+// one of these has its option tests folded away, along with the code building
+// the diffs they suppress.
+template <Ignore::Bitset kBitset>
+struct StaticIgnore {
+  StaticIgnore() = default;
+  explicit StaticIgnore(const Ignore& ignore) {
+    Check(ignore.bitset == kBitset)
+        << "internal error: ignore options do not match specialisation";
+  }
+  static constexpr bool Test(Ignore::Value other) {
+    return kBitset & static_cast<Ignore::Bitset>(other);
+  }
+  operator Ignore() const {
+    Ignore ignore;
+    ignore.bitset = kBitset;
+    return ignore;
+  }
+
+  static constexpr Ignore::Bitset bitset = kBitset;
+};
+
 std::optional<Ignore::Value> ParseIgnore(std::string_view ignore);
 
 struct IgnoreUsage {};
@@ -85,10 +122,58 @@ std::ostream& operator<<(std::ostream& os, IgnoreUsage);
 
 using Comparison = std::pair<std::optional<Id>, std::optional<Id>>;
 
+// A single diff detail, either a node attribute change or an edge to another
+// comparison. Details are kept in structured form and only rendered as text
+// when reported.
 struct DiffDetail {
-  DiffDetail(const std::string& text, const std::optional<Comparison>& edge)
-      : text_(text), edge_(edge) {}
-  std::string text_;
+  enum class Kind : uint8_t {
+    TEXT,                // label
+    CHANGED,             // label changed from before to after
+    REMOVED,             // label before was removed
+    ADDED,               // label after was added
+    QUALIFIER_REMOVED,   // qualifier before removed
+    QUALIFIER_ADDED,     // qualifier after added
+    DEFINITION,          // was (not) fully defined, is now (not) fully defined
+    BIT_FIELD,           // was (not) a bit-field, is now (not) a bit-field
+    ENUMERATOR_REMOVED,  // enumerator 'name' (before) was removed
+    ENUMERATOR_ADDED,    // enumerator 'name' (after) was added
+    ENUMERATOR_CHANGED,  // enumerator 'name' value changed from before to after
+    PARAMETER,           // parameter before
+    PARAMETER_OF,        // parameter before of
+  };
+
+  using Value = std::variant<
+      std::monostate, bool, int64_t, uint64_t, std::string, Qualifier,
+      Primitive::Encoding, BaseClass::Inheritance, ElfSymbol::SymbolType,
+      ElfSymbol::Binding, ElfSymbol::Visibility, ElfSymbol::CRC>;
+
+  template <typename T>
+  static Value MakeValue(const T& value) {
+    if constexpr (std::is_same_v<T, bool>) {
+      return value;
+    } else if constexpr (std::is_integral_v<T> && std::is_signed_v<T>) {
+      return static_cast<int64_t>(value);
+    } else if constexpr (std::is_integral_v<T>) {
+      return static_cast<uint64_t>(value);
+    } else if constexpr (std::is_same_v<T, std::string_view>) {
+      return std::string(value);
+    } else {
+      return value;
+    }
+  }
+
+  DiffDetail(Kind kind, std::string_view label, Value before, Value after,
+             std::string name, const std::optional<Comparison>& edge)
+      : kind_(kind), label_(label), before_(std::move(before)),
+        after_(std::move(after)), name_(std::move(name)), edge_(edge) {}
+
+  Kind kind_;
+  // always a string literal
+  std::string_view label_;
+  Value before_;
+  Value after_;
+  // an enumerator name, otherwise empty
+  std::string name_;
   std::optional<Comparison> edge_;
 };
 
@@ -100,9 +185,11 @@ struct Diff {
   bool has_changes = false;
   std::vector<DiffDetail> details;
 
-  void Add(const std::string& text,
+  void Add(DiffDetail::Kind kind, std::string_view label,
+           DiffDetail::Value before, DiffDetail::Value after, std::string name,
            const std::optional<Comparison>& comparison) {
-    details.emplace_back(text, comparison);
+    details.emplace_back(kind, label, std::move(before), std::move(after),
+                         std::move(name), comparison);
   }
 };
 
@@ -115,77 +202,76 @@ struct Result {
   }
 
   // Used when a node attribute has changed.
-  void AddNodeDiff(const std::string& text) {
+  void AddNodeDiff(DiffDetail::Kind kind, DiffDetail::Value before,
+                   DiffDetail::Value after, std::string name = {}) {
     equals_ = false;
     diff_.has_changes = true;
-    diff_.Add(text, {});
+    diff_.Add(kind, {}, std::move(before), std::move(after), std::move(name),
+              {});
   }
 
   // Used when a node attribute may have changed.
   template <typename T>
   void MaybeAddNodeDiff(
-      const std::string& text, const T& before, const T& after) {
-    if (before != after) {
-      std::ostringstream os;
-      os << text << " changed from " << before << " to " << after;
-      AddNodeDiff(os.str());
-    }
-  }
-
-  // Used when a node attribute may have changed, lazy version.
-  template <typename T>
-  void MaybeAddNodeDiff(const std::function<void(std::ostream&)>& text,
-                        const T& before, const T& after) {
+      std::string_view text, const T& before, const T& after) {
     if (before != after) {
-      std::ostringstream os;
-      text(os);
-      os << " changed from " << before << " to " << after;
-      AddNodeDiff(os.str());
+      equals_ = false;
+      diff_.has_changes = true;
+      diff_.Add(DiffDetail::Kind::CHANGED, text, DiffDetail::MakeValue(before),
+                DiffDetail::MakeValue(after), {}, {});
     }
   }
 
   // Used when node attributes are optional values.
   template <typename T>
-  void MaybeAddNodeDiff(const std::string& text, const std::optional<T>& before,
+  void MaybeAddNodeDiff(std::string_view text, const std::optional<T>& before,
                         const std::optional<T>& after) {
     if (before && after) {
       MaybeAddNodeDiff(text, *before, *after);
     } else if (before) {
-      std::ostringstream os;
-      os << text << ' ' << *before << " was removed";
-      AddNodeDiff(os.str());
+      equals_ = false;
+      diff_.has_changes = true;
+      diff_.Add(DiffDetail::Kind::REMOVED, text, DiffDetail::MakeValue(*before),
+                {}, {}, {});
     } else if (after) {
-      std::ostringstream os;
-      os << text << ' ' << *after << " was added";
-      AddNodeDiff(os.str());
+      equals_ = false;
+      diff_.has_changes = true;
+      diff_.Add(DiffDetail::Kind::ADDED, text, {},
+                DiffDetail::MakeValue(*after), {}, {});
     }
   }
 
   // Used when an edge has been removed or added.
-  void AddEdgeDiff(const std::string& text, const Comparison& comparison) {
+  void AddEdgeDiff(std::string_view text, const Comparison& comparison) {
+    equals_ = false;
+    diff_.Add(DiffDetail::Kind::TEXT, text, {}, {}, {}, {comparison});
+  }
+
+  // Used when an edge has been removed or added, with a described label.
+  void AddEdgeDiff(DiffDetail::Kind kind, DiffDetail::Value value,
+                   const Comparison& comparison) {
     equals_ = false;
-    diff_.Add(text, {comparison});
+    diff_.Add(kind, {}, std::move(value), {}, {}, {comparison});
   }
 
   // Used when an edge to a possible comparison is present.
-  void MaybeAddEdgeDiff(const std::string& text,
+  void MaybeAddEdgeDiff(std::string_view text,
                         const std::pair<bool, std::optional<Comparison>>& p) {
     equals_ &= p.first;
     const auto& comparison = p.second;
     if (comparison) {
-      diff_.Add(text, comparison);
+      diff_.Add(DiffDetail::Kind::TEXT, text, {}, {}, {}, comparison);
     }
   }
 
-  // Used when an edge to a possible comparison is present, lazy version.
-  void MaybeAddEdgeDiff(const std::function<void(std::ostream&)>& text,
+  // Used when an edge to a possible comparison is present, with a described
+  // label.
+  void MaybeAddEdgeDiff(DiffDetail::Kind kind, DiffDetail::Value value,
                         const std::pair<bool, std::optional<Comparison>>& p) {
     equals_ &= p.first;
     const auto& comparison = p.second;
     if (comparison) {
-      std::ostringstream os;
-      text(os);
-      diff_.Add(os.str(), comparison);
+      diff_.Add(kind, {}, std::move(value), {}, {}, comparison);
     }
   }
 
@@ -206,17 +292,365 @@ struct HashComparison {
   }
 };
 
-using Outcomes = std::unordered_map<Comparison, Diff, HashComparison>;
+// An open-addressing hash table keyed on Comparison.
+//
+// Each Comparison is packed into a single 64-bit word, holding 1 + the index of
+// each present Id in 32 bits, with 0 for an absent one. The packed keys are
+// held apart from the values, so probing only touches the keys. The table uses
+// linear probing with Fibonacci hashing and backward-shift deletion and is kept
+// at most 3/4 full.
+//
+// The table keeps lookup and probe counts, to be reported as metrics by its
+// owner. Lookups through const methods are not counted, so that concurrent
+// readers are safe.
+template <typename Value>
+class ComparisonMap {
+ public:
+  ComparisonMap() = default;
+  ComparisonMap(const ComparisonMap&) = delete;
+  ComparisonMap& operator=(const ComparisonMap&) = delete;
+  ComparisonMap(ComparisonMap&& other) noexcept { Swap(other); }
+  ComparisonMap& operator=(ComparisonMap&& other) noexcept {
+    ComparisonMap empty;
+    Swap(empty);
+    Swap(other);
+    return *this;
+  }
+
+  size_t Size() const {
+    return size_;
+  }
+
+  size_t Capacity() const {
+    return keys_.size();
+  }
+
+  size_t Lookups() const {
+    return lookups_;
+  }
+
+  // Slots examined beyond the first one, over all lookups.
+  size_t Probes() const {
+    return probes_;
+  }
+
+  const Value* Find(const Comparison& comparison) const {
+    size_t probes = 0;
+    return Lookup(comparison, probes);
+  }
+
+  Value* Find(const Comparison& comparison) {
+    ++lookups_;
+    return const_cast<Value*>(Lookup(comparison, probes_));
+  }
+
+  const Value& At(const Comparison& comparison) const {
+    const Value* value = Find(comparison);
+    Check(value != nullptr) << "internal error: missing comparison";
+    return *value;
+  }
+
+  // Inserts the value unless the comparison is already present. Returns the
+  // value held and whether it was inserted.
+  std::pair<Value*, bool> Insert(const Comparison& comparison, Value value) {
+    if (4 * (size_ + 1) > 3 * keys_.size()) {
+      Grow();
+    }
+    const uint64_t key = Pack(comparison);
+    ++lookups_;
+    const size_t slot = Slot(key, probes_);
+    if (keys_[slot] != kEmpty) {
+      return {&values_[slot].value, false};
+    }
+    keys_[slot] = key;
+    values_[slot].value = std::move(value);
+    ++size_;
+    return {&values_[slot].value, true};
+  }
+
+  // Removes the comparison and returns its value, which must be present.
+  Value Extract(const Comparison& comparison) {
+    ++lookups_;
+    size_t slot = size_ ? Slot(Pack(comparison), probes_) : 0;
+    Check(size_ && keys_[slot] != kEmpty)
+        << "internal error: missing comparison";
+    Value value = std::move(values_[slot].value);
+    // shift back later entries of the probe sequence into the gap
+    const size_t mask = keys_.size() - 1;
+    size_t next = (slot + 1) & mask;
+    while (keys_[next] != kEmpty) {
+      const size_t home = Home(keys_[next]);
+      // move the entry unless its home lies cyclically in (slot, next]
+      if (((next - home) & mask) >= ((next - slot) & mask)) {
+        keys_[slot] = keys_[next];
+        values_[slot].value = std::move(values_[next].value);
+        slot = next;
+      }
+      next = (next + 1) & mask;
+    }
+    keys_[slot] = kEmpty;
+    values_[slot].value = Value();
+    --size_;
+    return value;
+  }
+
+  // Calls function(comparison, value) for each entry, in slot order.
+  template <typename Function>
+  void ForEach(Function&& function) const {
+    for (size_t slot = 0; slot < keys_.size(); ++slot) {
+      if (keys_[slot] != kEmpty) {
+        function(Unpack(keys_[slot]), values_[slot].value);
+      }
+    }
+  }
+
+  template <typename Function>
+  void ForEach(Function&& function) {
+    for (size_t slot = 0; slot < keys_.size(); ++slot) {
+      if (keys_[slot] != kEmpty) {
+        function(Unpack(keys_[slot]), values_[slot].value);
+      }
+    }
+  }
+
+  // Moves in the entries of other that are not already present.
+  void Merge(ComparisonMap&& other) {
+    for (size_t slot = 0; slot < other.keys_.size(); ++slot) {
+      if (other.keys_[slot] != kEmpty) {
+        Insert(Unpack(other.keys_[slot]), std::move(other.values_[slot].value));
+      }
+    }
+    other = ComparisonMap();
+  }
+
+ private:
+  static constexpr uint64_t kEmpty = 0;
+  static constexpr unsigned kInitialBits = 4;
+  static constexpr uint64_t kAbsent = 0;
+  static constexpr uint64_t kMaxIndex =
+      std::numeric_limits<uint32_t>::max() - 1;
+
+  static uint64_t Pack(const std::optional<Id>& id) {
+    if (!id) {
+      return kAbsent;
+    }
+    Check(id->ix_ <= kMaxIndex) << "ComparisonMap: node index too big: "
+                                << *id;
+    return id->ix_ + 1;
+  }
+
+  static uint64_t Pack(const Comparison& comparison) {
+    const uint64_t key = Pack(comparison.first) << 32 | Pack(comparison.second);
+    Check(key != kEmpty) << "internal error: empty comparison";
+    return key;
+  }
+
+  static std::optional<Id> UnpackId(uint64_t half) {
+    return half == kAbsent ? std::nullopt : std::make_optional(Id(half - 1));
+  }
+
+  static Comparison Unpack(uint64_t key) {
+    return {UnpackId(key >> 32), UnpackId(key & 0xffffffff)};
+  }
+
+  size_t Home(uint64_t key) const {
+    // Fibonacci hashing, as packed keys of nearby nodes are close
+    return (key * uint64_t{0x9e3779b97f4a7c15}) >> shift_;
+  }
+
+  const Value* Lookup(const Comparison& comparison, size_t& probes) const {
+    if (size_ == 0) {
+      return nullptr;
+    }
+    const size_t slot = Slot(Pack(comparison), probes);
+    return keys_[slot] != kEmpty ? &values_[slot].value : nullptr;
+  }
+
+  // Returns the slot holding the key or the empty slot where it belongs.
+  size_t Slot(uint64_t key, size_t& probes) const {
+    const size_t mask = keys_.size() - 1;
+    size_t slot = Home(key);
+    while (keys_[slot] != kEmpty && keys_[slot] != key) {
+      ++probes;
+      slot = (slot + 1) & mask;
+    }
+    return slot;
+  }
+
+  void Grow() {
+    std::vector<uint64_t> keys;
+    std::vector<Entry> values;
+    if (keys_.empty()) {
+      keys.resize(size_t{1} << kInitialBits, kEmpty);
+      shift_ = 64 - kInitialBits;
+    } else {
+      keys.resize(2 * keys_.size(), kEmpty);
+      --shift_;
+    }
+    values.resize(keys.size());
+    std::swap(keys, keys_);
+    std::swap(values, values_);
+    // keys are distinct, so just find an empty slot (without counting probes)
+    const size_t mask = keys_.size() - 1;
+    for (size_t slot = 0; slot < keys.size(); ++slot) {
+      if (keys[slot] != kEmpty) {
+        size_t target = Home(keys[slot]);
+        while (keys_[target] != kEmpty) {
+          target = (target + 1) & mask;
+        }
+        keys_[target] = keys[slot];
+        values_[target].value = std::move(values[slot].value);
+      }
+    }
+  }
+
+  void Swap(ComparisonMap& other) {
+    std::swap(keys_, other.keys_);
+    std::swap(values_, other.values_);
+    std::swap(size_, other.size_);
+    std::swap(shift_, other.shift_);
+    std::swap(lookups_, other.lookups_);
+    std::swap(probes_, other.probes_);
+  }
+
+  // wrapped, to avoid std::vector<bool>
+  struct Entry {
+    Value value;
+  };
+
+  std::vector<uint64_t> keys_;
+  std::vector<Entry> values_;
+  size_t size_ = 0;
+  // table index from hash
+  unsigned shift_ = 0;
+  size_t lookups_ = 0;
+  size_t probes_ = 0;
+};
+
+class SpillFile;
+
+// The diffs of closed comparisons.
+//
+// Given a memory budget, the diffs held are spilled to an unlinked temporary
+// file whenever their estimated size exceeds it, keeping only their locations.
+// Spilled diffs are read back on first use, under a lock, and then held until
+// the Outcomes is destroyed, so references stay valid and concurrent readers
+// are safe. Without a budget, nothing is spilled.
+class Outcomes {
+ public:
+  Outcomes() = default;
+  Outcomes(Outcomes&&) noexcept = default;
+  Outcomes& operator=(Outcomes&&) noexcept = default;
+
+  // Sets the budget, in bytes, of the diffs held in memory. 0 means unlimited.
+  void SetBudget(size_t budget);
+  // Returns an empty Outcomes with a share of the budget that spills to the
+  // same file, so that merging it back moves spilled diffs without reading
+  // them.
+  Outcomes Fork(size_t shares) const;
+
+  size_t Size() const {
+    return diffs_.Size() + spilled_.Size();
+  }
+  size_t Capacity() const {
+    return diffs_.Capacity() + spilled_.Capacity();
+  }
+  size_t Lookups() const {
+    return lookups_ + diffs_.Lookups() + spilled_.Lookups();
+  }
+  size_t Probes() const {
+    return probes_ + diffs_.Probes() + spilled_.Probes();
+  }
+  size_t SpilledBytes() const {
+    return spilled_bytes_;
+  }
+
+  // Inserts the diff unless the comparison is already present.
+  void Insert(const Comparison& comparison, Diff diff);
+  const Diff& At(const Comparison& comparison) const;
+  // Moves in the entries of other that are not already present.
+  void Merge(Outcomes&& other);
+
+ private:
+  // Where a diff was spilled.
+  struct Location {
+    uint64_t offset;
+    uint64_t size;
+  };
+  // The spilled diffs read back.
+  struct Paged {
+    std::mutex mutex;
+    std::unordered_map<Comparison, Diff, HashComparison> diffs;
+  };
+
+  bool Contains(const Comparison& comparison);
+  void Spill();
+
+  ComparisonMap<Diff> diffs_;
+  ComparisonMap<Location> spilled_;
+  size_t budget_ = 0;
+  // the estimated size of the diffs held
+  size_t bytes_ = 0;
+  size_t spilled_bytes_ = 0;
+  // counts from maps of diffs since spilled
+  size_t lookups_ = 0;
+  size_t probes_ = 0;
+  std::shared_ptr<SpillFile> file_;
+  std::unique_ptr<Paged> paged_;
+};
+
+using Known = ComparisonMap<bool>;
+
+// Metrics describing a ComparisonMap, recorded on destruction.
+struct ComparisonMapCounters {
+  ComparisonMapCounters(Metrics& metrics, const char* size,
+                        const char* capacity, const char* lookups,
+                        const char* probes)
+      : size(metrics, size), capacity(metrics, capacity),
+        lookups(metrics, lookups), probes(metrics, probes) {}
+
+  template <typename Map>
+  void Record(const Map& map) {
+    size = map.Size();
+    capacity = map.Capacity();
+    lookups = map.Lookups();
+    probes = map.Probes();
+  }
+
+  Counter size;
+  Counter capacity;
+  Counter lookups;
+  Counter probes;
+};
 
+// Computes the keys used to pair up the children of aggregates. Keys are made
+// of views of node names, so nothing is built during comparison.
 struct MatchingKey {
+  struct Key {
+    auto operator<=>(const Key&) const = default;
+
+    bool Empty() const {
+      return !method && name.empty();
+    }
+
+    std::string_view name = {};
+    // methods are keyed by name and mangled name
+    std::string_view mangled_name = {};
+    bool method = false;
+    // the number of anonymous aggregates the name was found inside
+    size_t nesting = 0;
+    // distinguishes otherwise empty keys, by position among them
+    size_t anonymous = 0;
+  };
+
   explicit MatchingKey(const Graph& graph) : graph(graph) {}
-  std::string operator()(Id id);
-  std::string operator()(const BaseClass&);
-  std::string operator()(const Member&);
-  std::string operator()(const Method&);
-  std::string operator()(const StructUnion&);
+  Key operator()(Id id);
+  Key operator()(const BaseClass&);
+  Key operator()(const Member&);
+  Key operator()(const Method&);
+  Key operator()(const StructUnion&);
   template <typename Node>
-  std::string operator()(const Node&);
+  Key operator()(const Node&);
   const Graph& graph;
 };
 
@@ -257,20 +691,143 @@ struct ResolveQualifier {
   Qualifiers& qualifiers;
 };
 
+// Qualifier and typedef resolutions of every node of a graph, computed once and
+// held in dense arrays, so that comparison and reporting need not build
+// qualifier sets and typedef name lists for each node they visit.
+class ResolutionTable {
+ public:
+  ResolutionTable(const Graph& graph, size_t jobs = 1);
+
+  // As ResolveQualifiers, with the qualifiers as a bitmask of each
+  // 1 << Qualifier.
+  Id Unqualified(Id id) const {
+    return unqualified_[id.ix_];
+  }
+  uint8_t Qualifiers(Id id) const {
+    return qualifiers_[id.ix_];
+  }
+
+  // As ResolveTypedefs. The typedefs resolved are those of the chain from the
+  // node, which is its first typedef if it is not already resolved.
+  Id Resolved(Id id) const {
+    return resolved_[id.ix_];
+  }
+  const Typedef& GetTypedef(Id id) const;
+
+  // Calls function(typedef) for each typedef from id to Resolved(id).
+  template <typename Function>
+  void ForEachTypedef(Id id, Function&& function) const {
+    const Id resolved = Resolved(id);
+    while (id != resolved) {
+      const Typedef& x = GetTypedef(id);
+      function(x);
+      id = x.referred_type_id;
+    }
+  }
+
+ private:
+  const Graph& graph_;
+  std::vector<Id> unqualified_;
+  std::vector<uint8_t> qualifiers_;
+  std::vector<Id> resolved_;
+};
+
+// Estimates of the number of nodes reachable from each node of a graph, used to
+// hand out the largest comparisons first. The nodes of an SCC share an
+// estimate: the size of the SCC plus the estimates of the SCCs it has edges to,
+// capped by the number of nodes in the graph. Nodes reachable along several
+// paths are counted once per path, so shared types make for overestimates.
+class SubgraphSizes {
+ public:
+  explicit SubgraphSizes(const Graph& graph)
+      : graph_(graph), sizes_(graph.Limit().ix_, 0) {}
+
+  size_t operator()(Id id);
+
+ private:
+  const Graph& graph_;
+  // 0 if not yet estimated
+  std::vector<size_t> sizes_;
+  SCC<Id> scc_;
+  // per open node, the sum of the estimates of the SCCs reached from it
+  std::vector<size_t> pending_;
+  // the children of the nodes being visited
+  std::vector<Id> children_;
+};
+
+// Results of closed comparisons, shared by Compare objects running
+// concurrently.
+class SharedKnown {
+ public:
+  explicit SharedKnown(Known&& known) : known_(std::move(known)) {}
+
+  std::optional<bool> Find(const Comparison& comparison) const;
+  void Insert(std::span<const Comparison> comparisons, bool equals);
+  Known Release();
+
+ private:
+  mutable std::mutex mutex_;
+  Known known_;
+};
+
+// The comparison engine. The ignore options are held as an IgnorePolicy, either
+// Ignore, tested at run time, or a StaticIgnore, see WithIgnorePolicy.
+//
+// As with Equals, the depth-first search uses an explicit stack, so that the
+// native stack does not grow with the depth of the graph. Each node comparison
+// builds its diff with a tentative edge diff for each edge it follows, which is
+// settled once the edge's comparison is done: it is kept only if the comparison
+// found, or may yet find, a difference. Interface comparisons get their edges'
+// results straight away, by calling back into the search.
+template <typename IgnorePolicy = Ignore>
 struct Compare {
-  Compare(const Graph& graph, const Ignore& ignore, Metrics& metrics)
-      : graph(graph), ignore(ignore),
+  // If jobs is more than 1, the comparison of Interface symbols and types is
+  // spread over that many threads, each with its own Compare state.
+  Compare(const Graph& graph, const Ignore& ignore, Metrics& metrics,
+          size_t jobs = 1)
+      : graph(graph), ignore(ignore), metrics(metrics), jobs(jobs),
         queried(metrics, "compare.queried"),
+        same_node(metrics, "compare.same_node"),
         already_compared(metrics, "compare.already_compared"),
         being_compared(metrics, "compare.being_compared"),
         really_compared(metrics, "compare.really_compared"),
         equivalent(metrics, "compare.equivalent"),
         inequivalent(metrics, "compare.inequivalent"),
-        scc_size(metrics, "compare.scc_size") {}
+        hash_skipped(metrics, "compare.hash_skipped"),
+        scc_size(metrics, "compare.scc_size"),
+        known_counters(metrics, "compare.known.size",
+                       "compare.known.capacity", "compare.known.lookups",
+                       "compare.known.probes"),
+        outcomes_counters(metrics, "compare.outcomes.size",
+                          "compare.outcomes.capacity",
+                          "compare.outcomes.lookups",
+                          "compare.outcomes.probes"),
+        outcomes_spilled(metrics, "compare.outcomes.spilled_bytes"),
+        provisional_capacity(metrics, "compare.provisional.capacity"),
+        slowest_pairs(metrics, "compare.slowest_pairs") {}
+  ~Compare();
   std::pair<bool, std::optional<Comparison>>  operator()(Id id1, Id id2);
 
+  // Compares the pairs, spreading them over the jobs, largest (estimated)
+  // first, and returns the results in order. With a deadline, pairs of symbols
+  // with changed CRCs go first and the pairs not started by the deadline are
+  // skipped, with no result. If the names of the pairs are given, the slowest
+  // pairs are recorded in slowest_pairs.
+  std::vector<std::optional<std::pair<bool, std::optional<Comparison>>>>
+  CompareAll(const std::vector<std::pair<Id, Id>>& pairs,
+             std::span<const std::string_view> names = {});
+  bool Expired() const;
+  size_t EstimateSize(Id id1, Id id2);
+
+  bool Identical(Id id1, Id id2);
+  const ResolutionTable& Resolutions();
+  std::optional<ComparisonCache::Key> CacheKey(const Comparison& comparison);
   Comparison Removed(Id id);
   Comparison Added(Id id);
+  // Queues the comparison of an edge of a node comparison, returning a
+  // tentative outcome to add to its result as an edge diff, see Settle.
+  std::pair<bool, std::optional<Comparison>> Follow(Result& result, Id id1,
+                                                    Id id2);
   void CompareDefined(bool defined1, bool defined2, Result& result);
 
   Result Mismatch();
@@ -291,20 +848,121 @@ struct Compare {
   Result operator()(const Interface&, const Interface&);
 
   const Graph& graph;
-  const Ignore ignore;
-  std::unordered_map<Comparison, bool, HashComparison> known;
+  const IgnorePolicy ignore;
+  Metrics& metrics;
+  const size_t jobs;
+  // if set, closed comparison results are also looked up and recorded here
+  SharedKnown* shared_known = nullptr;
+  // if set, node pairs with equal hashes that are confirmed equal by Equals are
+  // recorded as equal without further comparison
+  const NodeHashes* hashes = nullptr;
+  // if set, only matching Interface symbols are compared and Interface types
+  // are skipped
+  const Filter* symbol_filter = nullptr;
+  // if set, the Interface comparison stops at the first difference found,
+  // serially and in symbol (then type) order, so at most one is reported
+  bool fail_fast = false;
+  // if set, Interface symbols and types not started by then are skipped, see
+  // CompareAll, and listed by name in skipped, with the number compared in
+  // completed; the Interface comparison covers only those compared
+  std::optional<std::chrono::steady_clock::time_point> deadline;
+  std::vector<std::string> skipped;
+  size_t completed = 0;
+  // if set, the diffs of closed comparisons are dropped rather than recorded
+  // in outcomes, except for that of the Interface, so that only equality and
+  // the Interface's removed, added and changed members are kept, see
+  // reporting::ChangeCounts
+  bool count_only = false;
+  // if both set, pairs of nodes found equivalent in earlier runs are recorded
+  // as equal without further comparison and new equivalences are recorded in
+  // the cache, keyed on node digests
+  ComparisonCache* cache = nullptr;
+  const std::unordered_map<Id, HashValue64>* digests = nullptr;
+  std::optional<EqualityCache> equality_cache;
+  std::optional<Equals<EqualityCache>> equals;
+  // if set, used to resolve qualifiers and typedefs, otherwise set on first use
+  // to a table computed over the graph
+  const ResolutionTable* resolutions = nullptr;
+  std::optional<ResolutionTable> resolution_table;
+  std::optional<SubgraphSizes> subgraph_sizes;
+  Known known;
   Outcomes outcomes;
-  Outcomes provisional;
+  // the diffs of open comparisons, indexed by SCC handle
+  std::vector<Diff> provisional;
   SCC<Comparison, HashComparison> scc;
-  Counter queried;
-  Counter already_compared;
-  Counter being_compared;
-  Counter really_compared;
-  Counter equivalent;
-  Counter inequivalent;
-  Histogram scc_size;
+  OperationCounter queried;
+  OperationCounter same_node;
+  OperationCounter already_compared;
+  OperationCounter being_compared;
+  OperationCounter really_compared;
+  OperationCounter equivalent;
+  OperationCounter inequivalent;
+  OperationCounter hash_skipped;
+  OperationHistogram scc_size;
+  ComparisonMapCounters known_counters;
+  ComparisonMapCounters outcomes_counters;
+  Counter outcomes_spilled;
+  Counter provisional_capacity;
+  Slowest slowest_pairs;
+
+ private:
+  using Outcome = std::pair<bool, std::optional<Comparison>>;
+
+  // An edge queued by Follow, with the index of its edge diff in the result of
+  // the node comparison and whether that is to be kept.
+  struct Edge {
+    Comparison comparison;
+    size_t detail;
+    bool keep;
+  };
+
+  // A node comparison in progress. Its queued edges are edges[next, end).
+  struct Frame {
+    Comparison comparison;
+    size_t handle;
+    Result result;
+    size_t begin;
+    size_t next;
+    size_t end;
+  };
+
+  bool Visit(const Comparison& comparison, Outcome& outcome);
+  void Settle(Frame& frame, size_t edge, const Outcome& outcome);
+  Outcome Leave();
+
+  std::vector<Frame> stack;
+  std::vector<Edge> edges;
 };
 
+// The common combinations of ignore options, for which Compare is specialised:
+// none, those for ABI compatibility testing and those for libabigail XML noise.
+using IgnoreNothing = StaticIgnore<0>;
+using IgnoreAdditions = StaticIgnore<Ignore::INTERFACE_ADDITION
+                                     | Ignore::TYPE_DEFINITION_ADDITION>;
+using IgnoreAbigailNoise = StaticIgnore<Ignore::SYMBOL_TYPE_PRESENCE
+                                        | Ignore::TYPE_DECLARATION_STATUS>;
+
+extern template struct Compare<Ignore>;
+extern template struct Compare<IgnoreNothing>;
+extern template struct Compare<IgnoreAdditions>;
+extern template struct Compare<IgnoreAbigailNoise>;
+
+// Calls function with the IgnorePolicy for the ignore options: a StaticIgnore
+// if Compare is specialised on them, otherwise the options themselves.
+template <typename Function>
+decltype(auto) WithIgnorePolicy(const Ignore& ignore, Function&& function) {
+  switch (ignore.bitset) {
+    case IgnoreNothing::bitset:
+      return function(IgnoreNothing());
+    case IgnoreAdditions::bitset:
+      return function(IgnoreAdditions());
+    case IgnoreAbigailNoise::bitset:
+      return function(IgnoreAbigailNoise());
+    default:
+      return function(ignore);
+  }
+}
+
 }  // namespace stg
 
 #endif  // STG_COMPARISON_H_
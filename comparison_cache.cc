@@ -0,0 +1,155 @@
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+// -*- mode: C++ -*-
+//
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License v2.0 with LLVM Exceptions (the
+// "License"); you may not use this file except in compliance with the
+// License.  You may obtain a copy of the License at
+//
+//     https://llvm.org/LICENSE.txt
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "comparison_cache.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <ios>
+#include <mutex>
+#include <sstream>
+#include <string>
+
+#include "error.h"
+#include "hashing.h"
+#include "metrics.h"
+
+namespace stg {
+
+namespace {
+
+// File format: the magic string followed by pairs of little-endian 64-bit
+// digests.
+constexpr std::array<char, 8> kMagic = {'S', 'T', 'G', 'C', 'M', 'P', '0', '1'};
+constexpr size_t kKeySize = 16;
+
+std::string Filename(const std::string& directory, uint32_t ignore) {
+  std::ostringstream os;
+  os << "comparisons-" << std::hex << ignore;
+  return std::filesystem::path(directory) / os.str();
+}
+
+uint64_t Load(const char* data) {
+  uint64_t value = 0;
+  for (size_t ix = 0; ix < 8; ++ix) {
+    value |= static_cast<uint64_t>(static_cast<unsigned char>(data[ix]))
+             << (8 * ix);
+  }
+  return value;
+}
+
+void Store(uint64_t value, char* data) {
+  for (size_t ix = 0; ix < 8; ++ix) {
+    data[ix] = static_cast<char>(value >> (8 * ix));
+  }
+}
+
+}  // namespace
+
+ComparisonCache::ComparisonCache(const std::string& directory, uint32_t ignore,
+                                 Metrics& metrics)
+    : filename_(Filename(directory, ignore)),
+      loaded_(metrics, "comparison_cache.loaded"),
+      hits_(metrics, "comparison_cache.hits"),
+      misses_(metrics, "comparison_cache.misses"),
+      added_count_(metrics, "comparison_cache.added") {
+  std::ifstream input(filename_, std::ios::binary);
+  if (!input) {
+    // no record yet
+    return;
+  }
+  std::array<char, kMagic.size()> magic;
+  if (!input.read(magic.data(), magic.size()) || magic != kMagic) {
+    Warn() << "ignoring comparison cache with bad header: '" << filename_
+           << "'";
+    return;
+  }
+  std::array<char, kKeySize> buffer;
+  while (input.read(buffer.data(), buffer.size())) {
+    known_.insert({HashValue64(Load(buffer.data())),
+                   HashValue64(Load(buffer.data() + 8))});
+  }
+  if (input.gcount() != 0) {
+    Warn() << "ignoring truncated entry in comparison cache: '" << filename_
+           << "'";
+  }
+  loaded_ = known_.size();
+}
+
+ComparisonCache::~ComparisonCache() {
+  hits_ = hit_count_.load();
+  misses_ = miss_count_.load();
+  added_count_ += added_.size();
+}
+
+bool ComparisonCache::Find(const Key& key) const {
+  const bool found = known_.count(key) != 0;
+  (found ? hit_count_ : miss_count_).fetch_add(1, std::memory_order_relaxed);
+  return found;
+}
+
+void ComparisonCache::Insert(const Key& key) {
+  if (known_.count(key)) {
+    return;
+  }
+  const std::lock_guard<std::mutex> lock(mutex_);
+  added_.insert(key);
+}
+
+void ComparisonCache::Write() {
+  const std::lock_guard<std::mutex> lock(mutex_);
+  if (added_.empty()) {
+    return;
+  }
+  // write a new file and move it into place, so that readers never see a
+  // partial record
+  const std::string temporary = filename_ + ".tmp";
+  {
+    std::ofstream output(temporary, std::ios::binary | std::ios::trunc);
+    output.write(kMagic.data(), kMagic.size());
+    std::array<char, kKeySize> buffer;
+    const auto write = [&](const Key& key) {
+      Store(key.first.value, buffer.data());
+      Store(key.second.value, buffer.data() + 8);
+      output.write(buffer.data(), buffer.size());
+    };
+    for (const auto& key : known_) {
+      write(key);
+    }
+    for (const auto& key : added_) {
+      write(key);
+    }
+    output.flush();
+    if (!output) {
+      Die() << "error writing comparison cache: '" << temporary << "'";
+    }
+  }
+  std::error_code error;
+  std::filesystem::rename(temporary, filename_, error);
+  if (error) {
+    Die() << "error renaming comparison cache: '" << temporary << "': "
+          << error.message();
+  }
+  // what has been written is now known, to later comparisons as well
+  added_count_ += added_.size();
+  known_.merge(added_);
+}
+
+}  // namespace stg
@@ -0,0 +1,83 @@
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+// -*- mode: C++ -*-
+//
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License v2.0 with LLVM Exceptions (the
+// "License"); you may not use this file except in compliance with the
+// License.  You may obtain a copy of the License at
+//
+//     https://llvm.org/LICENSE.txt
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef STG_COMPARISON_CACHE_H_
+#define STG_COMPARISON_CACHE_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_set>
+#include <utility>
+
+#include "hashing.h"
+#include "metrics.h"
+
+namespace stg {
+
+// A persistent record of the node pairs that Compare has found equivalent,
+// keyed on pairs of node digests (see digest.h). Compare results depend on the
+// ignore options, so each set of options has its own record, stored in a file
+// in the given directory.
+//
+// Find and Insert may be called concurrently. Entries inserted are only found
+// once the record has been written and read back. Counter values are recorded
+// in the Metrics on destruction.
+class ComparisonCache {
+ public:
+  using Key = std::pair<HashValue64, HashValue64>;
+
+  // Reads the record for the given ignore options, if there is one.
+  ComparisonCache(const std::string& directory, uint32_t ignore,
+                  Metrics& metrics);
+  ComparisonCache(const ComparisonCache&) = delete;
+  ComparisonCache& operator=(const ComparisonCache&) = delete;
+  ~ComparisonCache();
+
+  // Returns whether the pair was found to be equivalent in an earlier run.
+  bool Find(const Key& key) const;
+  // Records the pair as equivalent.
+  void Insert(const Key& key);
+  // Writes back the record, if anything new has been inserted since it was last
+  // written.
+  void Write();
+
+ private:
+  struct HashKey {
+    size_t operator()(const Key& key) const {
+      // the digests are already good hashes
+      return key.first.value ^ (key.second.value * 0x9e3779b97f4a7c15);
+    }
+  };
+
+  const std::string filename_;
+  std::unordered_set<Key, HashKey> known_;
+  std::mutex mutex_;
+  std::unordered_set<Key, HashKey> added_;
+  mutable std::atomic<size_t> hit_count_ = 0;
+  mutable std::atomic<size_t> miss_count_ = 0;
+  Counter loaded_;
+  Counter hits_;
+  Counter misses_;
+  Counter added_count_;
+};
+
+}  // namespace stg
+
+#endif  // STG_COMPARISON_CACHE_H_
@@ -0,0 +1,200 @@
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+// -*- mode: C++ -*-
+//
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License v2.0 with LLVM Exceptions (the
+// "License"); you may not use this file except in compliance with the
+// License.  You may obtain a copy of the License at
+//
+//     https://llvm.org/LICENSE.txt
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "comparison_cache.h"
+
+#include <cstddef>
+#include <filesystem>
+#include <string>
+#include <unistd.h>
+#include <variant>
+
+#include <catch2/catch.hpp>
+#include "comparison.h"
+#include "digest.h"
+#include "fingerprint.h"
+#include "graph.h"
+#include "hashing.h"
+#include "input.h"
+#include "metrics.h"
+#include "reader_options.h"
+
+namespace Test {
+
+size_t Count(const stg::Metrics& metrics, const std::string& name) {
+  size_t count = 0;
+  for (const auto& metric : metrics) {
+    if (metric.name == name) {
+      count += std::get<size_t>(metric.value);
+    }
+  }
+  return count;
+}
+
+// A named struct with a single member of the given type, reached via a typedef.
+stg::Id NamedStruct(stg::Graph& graph, stg::Id type) {
+  const auto member = graph.Add<stg::Member>("x", type, 0, 0);
+  const auto s = graph.Add<stg::StructUnion>(
+      stg::StructUnion::Kind::STRUCT, "s", 4, std::vector<stg::Id>{},
+      std::vector<stg::Id>{}, std::vector<stg::Id>{member});
+  return graph.Add<stg::Typedef>("t", s);
+}
+
+// A named linked list node, with a member of the given type.
+stg::Id List(stg::Graph& graph, stg::Id type) {
+  const auto s = graph.Allocate();
+  const auto pointer = graph.Add<stg::PointerReference>(
+      stg::PointerReference::Kind::POINTER, s);
+  const auto next = graph.Add<stg::Member>("next", pointer, 0, 0);
+  const auto value = graph.Add<stg::Member>("value", type, 64, 0);
+  graph.Set<stg::StructUnion>(
+      s, stg::StructUnion::Kind::STRUCT, "list", 16, std::vector<stg::Id>{},
+      std::vector<stg::Id>{}, std::vector<stg::Id>{next, value});
+  return pointer;
+}
+
+TEST_CASE("digest covers named types") {
+  stg::Graph graph;
+  stg::Metrics metrics;
+  const auto int_type = graph.Add<stg::Primitive>(
+      "int", stg::Primitive::Encoding::SIGNED_INTEGER, 4);
+  const auto long_type = graph.Add<stg::Primitive>(
+      "long", stg::Primitive::Encoding::SIGNED_INTEGER, 8);
+  const auto s1 = NamedStruct(graph, int_type);
+  const auto s2 = NamedStruct(graph, int_type);
+  const auto s3 = NamedStruct(graph, long_type);
+
+  // fingerprints do not look inside named types
+  const auto f1 = stg::Fingerprint(graph, s1, metrics);
+  const auto f3 = stg::Fingerprint(graph, s3, metrics);
+  CHECK(f1.At(s1) == f3.At(s3));
+
+  const auto d1 = stg::Digest(graph, s1, metrics);
+  const auto d2 = stg::Digest(graph, s2, metrics);
+  const auto d3 = stg::Digest(graph, s3, metrics);
+  CHECK(d1.at(s1) == d2.at(s2));
+  CHECK(d1.at(s1) != d3.at(s3));
+}
+
+TEST_CASE("digest covers cycles") {
+  stg::Graph graph;
+  stg::Metrics metrics;
+  const auto int_type = graph.Add<stg::Primitive>(
+      "int", stg::Primitive::Encoding::SIGNED_INTEGER, 4);
+  const auto long_type = graph.Add<stg::Primitive>(
+      "long", stg::Primitive::Encoding::SIGNED_INTEGER, 8);
+  const auto l1 = List(graph, int_type);
+  const auto l2 = List(graph, int_type);
+  const auto l3 = List(graph, long_type);
+
+  const auto d1 = stg::Digest(graph, l1, metrics);
+  const auto d2 = stg::Digest(graph, l2, metrics);
+  const auto d3 = stg::Digest(graph, l3, metrics);
+  CHECK(d1.at(l1) == d2.at(l2));
+  CHECK(d1.at(l1) != d3.at(l3));
+}
+
+struct TemporaryDirectory {
+  TemporaryDirectory() {
+    std::string name = std::filesystem::temp_directory_path() / "stg-XXXXXX";
+    REQUIRE(mkdtemp(name.data()) != nullptr);
+    path = name;
+  }
+  ~TemporaryDirectory() {
+    std::filesystem::remove_all(path);
+  }
+  std::filesystem::path path;
+};
+
+TEST_CASE("cache round trip") {
+  const TemporaryDirectory directory;
+  const stg::ComparisonCache::Key key1 = {stg::HashValue64(1),
+                                          stg::HashValue64(2)};
+  const stg::ComparisonCache::Key key2 = {stg::HashValue64(2),
+                                          stg::HashValue64(1)};
+  const stg::ComparisonCache::Key key3 = {stg::HashValue64(3),
+                                          stg::HashValue64(4)};
+  stg::Metrics metrics;
+  {
+    stg::ComparisonCache cache(directory.path, 0, metrics);
+    CHECK(!cache.Find(key1));
+    cache.Insert(key1);
+    cache.Insert(key3);
+    // not found until written and read back
+    CHECK(!cache.Find(key1));
+    cache.Write();
+    // found once written, with nothing new to write again
+    CHECK(cache.Find(key1));
+    cache.Write();
+  }
+  {
+    stg::ComparisonCache cache(directory.path, 0, metrics);
+    CHECK(cache.Find(key1));
+    CHECK(!cache.Find(key2));
+    CHECK(cache.Find(key3));
+  }
+  {
+    // different ignore options have separate records
+    stg::ComparisonCache cache(directory.path, 1, metrics);
+    CHECK(!cache.Find(key1));
+  }
+  CHECK(Count(metrics, "comparison_cache.loaded") == 2);
+  CHECK(Count(metrics, "comparison_cache.added") == 2);
+  CHECK(Count(metrics, "comparison_cache.hits") == 3);
+  CHECK(Count(metrics, "comparison_cache.misses") == 4);
+}
+
+TEST_CASE("cached comparisons") {
+  const size_t jobs = GENERATE(1, 4);
+  const TemporaryDirectory directory;
+  const stg::Ignore ignore(stg::Ignore::SYMBOL_CRC);
+  stg::Graph graph;
+  stg::Metrics metrics;
+  const auto read = [&](const char* file) {
+    const auto path = std::filesystem::path("testdata") / file;
+    return stg::Read(graph, stg::InputFormat::ABI, path.c_str(),
+                     stg::ReadOptions(), nullptr, metrics);
+  };
+  const auto id0 = read("crc_only_0.xml");
+  const auto id1 = read("crc_only_1.xml");
+  auto digests = stg::Digest(graph, id0, metrics);
+  digests.merge(stg::Digest(graph, id1, metrics));
+
+  const auto run = [&](stg::Metrics& run_metrics) {
+    stg::ComparisonCache cache(directory.path, ignore.bitset, run_metrics);
+    stg::Compare compare{graph, ignore, run_metrics, jobs};
+    compare.cache = &cache;
+    compare.digests = &digests;
+    const auto [equals, comparison] = compare(id0, id1);
+    CHECK(equals);
+    CHECK(!comparison);
+    cache.Write();
+  };
+
+  stg::Metrics first;
+  run(first);
+  CHECK(Count(first, "comparison_cache.hits") == 0);
+  CHECK(Count(first, "comparison_cache.added") > 0);
+
+  stg::Metrics second;
+  run(second);
+  CHECK(Count(second, "comparison_cache.hits") == 1);
+  CHECK(Count(second, "comparison_cache.added") == 0);
+  CHECK(Count(second, "compare.really_compared") == 0);
+}
+
+}  // namespace Test
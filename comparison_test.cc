@@ -0,0 +1,377 @@
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+// -*- mode: C++ -*-
+//
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License v2.0 with LLVM Exceptions (the
+// "License"); you may not use this file except in compliance with the
+// License.  You may obtain a copy of the License at
+//
+//     https://llvm.org/LICENSE.txt
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "comparison.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <optional>
+#include <random>
+#include <string>
+#include <tuple>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <catch2/catch.hpp>
+#include "error.h"
+#include "graph.h"
+#include "metrics.h"
+
+namespace Test {
+
+using Map = stg::ComparisonMap<size_t>;
+using Reference = std::unordered_map<stg::Comparison, size_t,
+                                     stg::HashComparison>;
+
+template <typename Gen>
+stg::Comparison RandomComparison(Gen& gen) {
+  // a small range of ids makes for plenty of repeats and collisions
+  std::uniform_int_distribution<size_t> pick(0, 99);
+  const auto id = [&]() -> std::optional<stg::Id> {
+    const size_t ix = pick(gen);
+    return ix < 10 ? std::nullopt : std::make_optional(stg::Id(ix));
+  };
+  while (true) {
+    stg::Comparison comparison{id(), id()};
+    if (comparison.first || comparison.second) {
+      return comparison;
+    }
+  }
+}
+
+void CheckSame(const Map& map, const Reference& reference) {
+  CHECK(map.Size() == reference.size());
+  for (const auto& [comparison, value] : reference) {
+    const size_t* found = map.Find(comparison);
+    REQUIRE(found != nullptr);
+    CHECK(*found == value);
+  }
+}
+
+TEST_CASE("comparison map matches unordered_map") {
+  const uint32_t seed = GENERATE(1, 2, 3, 4, 5, 6, 7, 8);
+  std::mt19937 gen(seed);
+  std::uniform_int_distribution<int> operation(0, 2);
+  Map map;
+  Reference reference;
+  for (size_t i = 0; i < 5000; ++i) {
+    const auto comparison = RandomComparison(gen);
+    switch (operation(gen)) {
+      case 0: {
+        const auto [value, inserted] = map.Insert(comparison, i);
+        const auto [it, expected] = reference.insert({comparison, i});
+        CHECK(inserted == expected);
+        CHECK(*value == it->second);
+        break;
+      }
+      case 1: {
+        const auto it = reference.find(comparison);
+        if (it == reference.end()) {
+          CHECK(map.Find(comparison) == nullptr);
+        } else {
+          CHECK(map.Extract(comparison) == it->second);
+          reference.erase(it);
+          CHECK(map.Find(comparison) == nullptr);
+        }
+        break;
+      }
+      case 2: {
+        const auto it = reference.find(comparison);
+        const size_t* found = map.Find(comparison);
+        CHECK((found == nullptr) == (it == reference.end()));
+        if (found != nullptr && it != reference.end()) {
+          CHECK(*found == it->second);
+        }
+        break;
+      }
+    }
+  }
+  CheckSame(map, reference);
+  CHECK(4 * map.Size() <= 3 * map.Capacity());
+  CHECK(map.Lookups() > 0);
+}
+
+TEST_CASE("comparison map merge keeps existing entries") {
+  Map map1;
+  Map map2;
+  const stg::Comparison c1{{stg::Id(1)}, {stg::Id(2)}};
+  const stg::Comparison c2{{stg::Id(1)}, {}};
+  const stg::Comparison c3{{}, {stg::Id(1)}};
+  map1.Insert(c1, 1);
+  map1.Insert(c2, 2);
+  map2.Insert(c2, 20);
+  map2.Insert(c3, 30);
+  map1.Merge(std::move(map2));
+  CHECK(map1.Size() == 3);
+  CHECK(map1.At(c1) == 1);
+  CHECK(map1.At(c2) == 2);
+  CHECK(map1.At(c3) == 30);
+  CHECK(map2.Size() == 0);
+  CHECK(map2.Find(c1) == nullptr);
+}
+
+TEST_CASE("comparison map errors") {
+  Map map;
+  const stg::Comparison c1{{stg::Id(1)}, {stg::Id(2)}};
+  CHECK_THROWS_AS(map.At(c1), stg::Exception);
+  CHECK_THROWS_AS(map.Extract(c1), stg::Exception);
+  CHECK_THROWS_AS(map.Insert({{}, {}}, 0), stg::Exception);
+  CHECK_THROWS_AS(map.Insert({{stg::Id(0xffffffff)}, {}}, 0), stg::Exception);
+  map.Insert(c1, 1);
+  CHECK_THROWS_AS(map.Extract({{stg::Id(2)}, {stg::Id(1)}}), stg::Exception);
+}
+
+TEST_CASE("resolution table matches resolvers") {
+  using stg::Qualifier;
+  stg::Graph graph;
+  const auto primitive = graph.Add<stg::Primitive>(
+      "int", stg::Primitive::Encoding::SIGNED_INTEGER, 4);
+  const auto c = graph.Add<stg::Qualified>(Qualifier::CONST, primitive);
+  const auto vc = graph.Add<stg::Qualified>(Qualifier::VOLATILE, c);
+  const auto cvc = graph.Add<stg::Qualified>(Qualifier::CONST, vc);
+  const auto t = graph.Add<stg::Typedef>("T", vc);
+  const auto u = graph.Add<stg::Typedef>("U", t);
+  const auto ru = graph.Add<stg::Qualified>(Qualifier::RESTRICT, u);
+  const auto array = graph.Add<stg::Array>(3, c);
+  const auto ca = graph.Add<stg::Qualified>(Qualifier::CONST, array);
+  const auto function = graph.Add<stg::Function>(primitive,
+                                                 std::vector<stg::Id>{});
+  const auto af = graph.Add<stg::Qualified>(Qualifier::ATOMIC, function);
+  const auto v = graph.Add<stg::Typedef>("V", ca);
+  // leave a hole
+  graph.Allocate();
+
+  for (const size_t jobs : {1, 3}) {
+    const stg::ResolutionTable table(graph, jobs);
+    for (const auto id : {primitive, c, vc, cvc, t, u, ru, array, ca, function,
+                          af, v}) {
+      GIVEN("node: " + std::to_string(id.ix_)) {
+        const auto [unqualified, qualifiers] =
+            stg::ResolveQualifiers(graph, id);
+        CHECK(table.Unqualified(id) == unqualified);
+        uint8_t bits = 0;
+        for (const auto qualifier : qualifiers) {
+          bits |= 1 << static_cast<int>(qualifier);
+        }
+        CHECK(table.Qualifiers(id) == bits);
+
+        const auto [resolved, typedefs] = stg::ResolveTypedefs(graph, id);
+        CHECK(table.Resolved(id) == resolved);
+        std::vector<std::string> names;
+        table.ForEachTypedef(id, [&](const stg::Typedef& x) {
+          names.emplace_back(x.name);
+        });
+        CHECK(names == typedefs);
+      }
+    }
+  }
+}
+
+TEST_CASE("subgraph size estimates") {
+  using Kind = stg::PointerReference::Kind;
+  stg::Graph graph;
+  const auto primitive = graph.Add<stg::Primitive>(
+      "int", stg::Primitive::Encoding::SIGNED_INTEGER, 4);
+  const auto p1 = graph.Add<stg::PointerReference>(Kind::POINTER, primitive);
+  const auto p2 = graph.Add<stg::PointerReference>(Kind::POINTER, p1);
+  // struct S { struct S* m; int** m2; }
+  const auto s = graph.Allocate();
+  const auto ps = graph.Add<stg::PointerReference>(Kind::POINTER, s);
+  const auto m = graph.Add<stg::Member>("m", ps, 0, 0);
+  const auto m2 = graph.Add<stg::Member>("m2", p2, 64, 0);
+  graph.Set<stg::StructUnion>(s, stg::StructUnion::Kind::STRUCT, "S", 16,
+                              std::vector<stg::Id>{}, std::vector<stg::Id>{},
+                              std::vector<stg::Id>{m, m2});
+  // int f(int*, int*), where the shared int* is counted twice
+  const auto f = graph.Add<stg::Function>(primitive,
+                                          std::vector<stg::Id>{p1, p1});
+
+  stg::SubgraphSizes sizes(graph);
+  CHECK(sizes(p2) == 3);
+  CHECK(sizes(ps) == 7);
+  CHECK(sizes(s) == 7);
+  CHECK(sizes(m) == 7);
+  CHECK(sizes(m2) == 4);
+  CHECK(sizes(f) == 6);
+  CHECK(sizes(primitive) == 1);
+}
+
+TEST_CASE("enumerators pair up by name") {
+  using Kind = stg::DiffDetail::Kind;
+  stg::Graph graph;
+  const auto u = graph.Add<stg::Primitive>(
+      "int", stg::Primitive::Encoding::SIGNED_INTEGER, 4);
+  const auto a = graph.Intern("A");
+  const auto b = graph.Intern("B");
+  const auto c = graph.Intern("C");
+  // repeated names pair up in order of occurrence
+  const auto x1 = graph.Add<stg::Enumeration>(
+      "e", u, stg::Enumeration::Enumerators{{a, 0}, {b, 1}, {a, 2}});
+  const auto x2 = graph.Add<stg::Enumeration>(
+      "e", u, stg::Enumeration::Enumerators{{b, 1}, {a, 0}, {c, 3}, {a, 5}});
+  const auto x3 = graph.Add<stg::Enumeration>(
+      "e", u, stg::Enumeration::Enumerators{{a, 0}, {b, 1}, {a, 2}});
+  stg::Metrics metrics;
+  stg::Compare compare{graph, {}, metrics};
+  const auto [equals, comparison] = compare(x1, x2);
+  CHECK(!equals);
+  REQUIRE(comparison);
+  std::vector<std::tuple<Kind, std::string>> details;
+  for (const auto& detail : compare.outcomes.At(*comparison).details) {
+    details.emplace_back(detail.kind_, detail.name_);
+  }
+  std::sort(details.begin(), details.end());
+  CHECK(details == std::vector<std::tuple<Kind, std::string>>{
+      {Kind::ENUMERATOR_ADDED, "C"}, {Kind::ENUMERATOR_CHANGED, "A"}});
+  // identical sequences need no index
+  CHECK(compare(x1, x3).first);
+}
+
+TEST_CASE("interface symbols and types compared together") {
+  stg::Graph graph;
+  const auto int_type = graph.Add<stg::Primitive>(
+      "int", stg::Primitive::Encoding::SIGNED_INTEGER, 4);
+  const auto long_type = graph.Add<stg::Primitive>(
+      "long", stg::Primitive::Encoding::SIGNED_INTEGER, 8);
+  const auto symbol = [&](stg::Id type) {
+    return graph.Add<stg::ElfSymbol>(
+        "x", std::nullopt, true, stg::ElfSymbol::SymbolType::OBJECT,
+        stg::ElfSymbol::Binding::GLOBAL, stg::ElfSymbol::Visibility::DEFAULT,
+        std::nullopt, std::nullopt, type, std::nullopt);
+  };
+  const auto structure = [&](const char* name, stg::Id type) {
+    const auto member = graph.Add<stg::Member>("m", type, 0, 0);
+    return graph.Add<stg::StructUnion>(
+        stg::StructUnion::Kind::STRUCT, name, 8, std::vector<stg::Id>{},
+        std::vector<stg::Id>{}, std::vector<stg::Id>{member});
+  };
+  const auto typedef_type = graph.Add<stg::Typedef>("T", int_type);
+  const auto removed = structure("R", int_type);
+  const auto added = structure("A", int_type);
+  const auto root1 = graph.Add<stg::Interface>(
+      std::map<std::string, stg::Id>{{"x", symbol(int_type)}},
+      std::map<std::string, stg::Id>{{"struct R", removed},
+                                     {"struct S", structure("S", int_type)},
+                                     {"typedef T", typedef_type}});
+  const auto root2 = graph.Add<stg::Interface>(
+      std::map<std::string, stg::Id>{{"x", symbol(long_type)}},
+      std::map<std::string, stg::Id>{{"struct A", added},
+                                     {"struct S", structure("S", long_type)},
+                                     {"typedef T", typedef_type}});
+
+  // Diffs are grouped by symbols then types, each as removed, added, changed,
+  // whatever the number of jobs.
+  for (const size_t jobs : {1, 4}) {
+    stg::Metrics metrics;
+    stg::Compare compare{graph, {}, metrics, jobs};
+    const auto [equals, comparison] = compare(root1, root2);
+    CHECK(!equals);
+    REQUIRE(comparison);
+    std::vector<std::pair<bool, bool>> edges;
+    for (const auto& detail : compare.outcomes.At(*comparison).details) {
+      REQUIRE(detail.edge_);
+      edges.emplace_back(detail.edge_->first.has_value(),
+                         detail.edge_->second.has_value());
+    }
+    CHECK(edges == std::vector<std::pair<bool, bool>>{
+        {true, true}, {true, false}, {false, true}, {true, true}});
+  }
+}
+
+// Builds a linked list of named structs of the given length, each with a
+// member pointing to the next. The last one has a member of the given type.
+// Returns the first struct.
+stg::Id BuildChain(stg::Graph& graph, size_t length, stg::Id last) {
+  stg::Id next = last;
+  for (size_t i = length; i > 0; --i) {
+    const auto pointer = graph.Add<stg::PointerReference>(
+        stg::PointerReference::Kind::POINTER, next);
+    const auto member = graph.Add<stg::Member>("next", pointer, 0, 0);
+    next = graph.Add<stg::StructUnion>(
+        stg::StructUnion::Kind::STRUCT, "node_" + std::to_string(i), 8,
+        std::vector<stg::Id>{}, std::vector<stg::Id>{},
+        std::vector<stg::Id>{member});
+  }
+  return next;
+}
+
+TEST_CASE("deep chains compared") {
+  // far deeper than a recursive search could manage on a normal stack
+  const size_t length = 200000;
+  stg::Graph graph;
+  const auto int_type = graph.Add<stg::Primitive>(
+      "int", stg::Primitive::Encoding::SIGNED_INTEGER, 4);
+  const auto char_type = graph.Add<stg::Primitive>(
+      "char", stg::Primitive::Encoding::SIGNED_CHARACTER, 1);
+  const auto chain1 = BuildChain(graph, length, int_type);
+  const auto chain2 = BuildChain(graph, length, int_type);
+  const auto chain3 = BuildChain(graph, length, char_type);
+
+  stg::Metrics metrics;
+  stg::Compare compare{graph, {}, metrics};
+  const auto same = compare(chain1, chain2);
+  CHECK(same.first);
+  CHECK(!same.second);
+  const auto [equals, comparison] = compare(chain1, chain3);
+  CHECK(!equals);
+  REQUIRE(comparison);
+  CHECK(compare.scc.Empty());
+  // the difference is reached through every link
+  auto at = *comparison;
+  for (size_t i = 0; i < 3 * length; ++i) {
+    const auto& details = compare.outcomes.At(at).details;
+    REQUIRE(details.size() == 1);
+    REQUIRE(details[0].edge_);
+    at = *details[0].edge_;
+  }
+  CHECK(compare.outcomes.At(at).details.empty());
+}
+
+TEST_CASE("only edges with differences kept") {
+  stg::Graph graph;
+  const auto int_type = graph.Add<stg::Primitive>(
+      "int", stg::Primitive::Encoding::SIGNED_INTEGER, 4);
+  const auto long_type = graph.Add<stg::Primitive>(
+      "long", stg::Primitive::Encoding::SIGNED_INTEGER, 8);
+  const auto function = [&](stg::Id parameter) {
+    const auto pointer = graph.Add<stg::PointerReference>(
+        stg::PointerReference::Kind::POINTER, int_type);
+    return graph.Add<stg::Function>(
+        pointer, std::vector<stg::Id>{int_type, parameter, int_type});
+  };
+  const auto function1 = function(int_type);
+  const auto function2 = function(long_type);
+
+  stg::Metrics metrics;
+  stg::Compare compare{graph, {}, metrics};
+  const auto [equals, comparison] = compare(function1, function2);
+  CHECK(!equals);
+  REQUIRE(comparison);
+  // the return types and the other parameters are equal
+  const auto& details = compare.outcomes.At(*comparison).details;
+  REQUIRE(details.size() == 1);
+  CHECK(details[0].kind_ == stg::DiffDetail::Kind::PARAMETER);
+  CHECK(details[0].before_ == stg::DiffDetail::MakeValue(size_t{2}));
+  CHECK(details[0].edge_
+        == stg::Comparison{std::make_optional(int_type),
+                           std::make_optional(long_type)});
+}
+
+}  // namespace Test
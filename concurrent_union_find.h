@@ -0,0 +1,251 @@
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+// -*- mode: C++ -*-
+//
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License v2.0 with LLVM Exceptions (the
+// "License"); you may not use this file except in compliance with the
+// License.  You may obtain a copy of the License at
+//
+//     https://llvm.org/LICENSE.txt
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef STG_CONCURRENT_UNION_FIND_H_
+#define STG_CONCURRENT_UNION_FIND_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <utility>
+#include <vector>
+
+#include "error.h"
+#include "metrics.h"
+
+namespace stg {
+
+// Metric names used by ConcurrentUnionFind. Rank counters may be null if only
+// Link is used.
+struct UnionFindCounterNames {
+  const char* find_halved;
+  const char* union_known;
+  const char* union_unknown;
+  const char* union_rank_swap = nullptr;
+  const char* union_rank_increase = nullptr;
+  const char* union_rank_zero = nullptr;
+};
+
+// Lock-free union-find over a fixed, dense range of ids [start, limit).
+//
+// Each element is a single atomic word holding the parent index in the low
+// bits and the rank in the high bits, so that roots can be linked with a single
+// compare-and-swap. Find uses path halving; a failed halving step is harmless
+// and is not retried.
+//
+// Find, Link and Union may be called concurrently from any number of threads.
+// Counter values are accumulated with relaxed atomics and are recorded in the
+// Metrics on destruction. Construction and destruction must not race with
+// other uses of the Metrics.
+template <typename Key>
+class ConcurrentUnionFind {
+ public:
+  ConcurrentUnionFind(Key start, Key limit, Metrics& metrics,
+                      const UnionFindCounterNames& names)
+      : offset_(start.ix_),
+        data_(Size(start, limit)),
+        find_halved_(metrics, names.find_halved),
+        union_known_(metrics, names.union_known),
+        union_unknown_(metrics, names.union_unknown) {
+    for (size_t ix = 0; ix < data_.size(); ++ix) {
+      data_[ix].store(ix, std::memory_order_relaxed);
+    }
+    if (names.union_rank_swap != nullptr) {
+      union_rank_swap_.emplace(metrics, names.union_rank_swap);
+    }
+    if (names.union_rank_increase != nullptr) {
+      union_rank_increase_.emplace(metrics, names.union_rank_increase);
+    }
+    if (names.union_rank_zero != nullptr) {
+      union_rank_zero_.emplace(metrics, names.union_rank_zero);
+    }
+  }
+
+  ConcurrentUnionFind(const ConcurrentUnionFind&) = delete;
+  ConcurrentUnionFind& operator=(const ConcurrentUnionFind&) = delete;
+
+  ~ConcurrentUnionFind() {
+    find_halved_ = counts_[kFindHalved].load();
+    union_known_ = counts_[kUnionKnown].load();
+    union_unknown_ = counts_[kUnionUnknown].load();
+    if (union_rank_swap_) {
+      *union_rank_swap_ = counts_[kUnionRankSwap].load();
+    }
+    if (union_rank_increase_) {
+      *union_rank_increase_ = counts_[kUnionRankIncrease].load();
+    }
+    if (union_rank_zero_) {
+      *union_rank_zero_ = counts_[kUnionRankZero].load();
+    }
+  }
+
+  Key Find(Key id) {
+    return Key(offset_ + FindIndex(Index(id)));
+  }
+
+  // Makes the representative of id2 the representative of id1's class as well,
+  // regardless of rank. Returns false if they were already in the same class.
+  bool Link(Key id1, Key id2) {
+    const size_t ix1 = Index(id1);
+    const size_t ix2 = Index(id2);
+    while (true) {
+      const size_t root1 = FindIndex(ix1);
+      const size_t root2 = FindIndex(ix2);
+      if (root1 == root2) {
+        Count(kUnionKnown);
+        return false;
+      }
+      uint64_t expected = data_[root1].load();
+      if (Parent(expected) != root1) {
+        // lost a race, root1 is no longer a root
+        continue;
+      }
+      if (data_[root1].compare_exchange_weak(
+              expected, (expected & ~kParentMask) | root2)) {
+        Count(kUnionUnknown);
+        return true;
+      }
+    }
+  }
+
+  // Merges the classes of id1 and id2 by rank. With equal ranks, the
+  // representative of id2 is preferred. Returns false if they were already in
+  // the same class.
+  bool Union(Key id1, Key id2) {
+    const size_t ix1 = Index(id1);
+    const size_t ix2 = Index(id2);
+    while (true) {
+      size_t root1 = FindIndex(ix1);
+      size_t root2 = FindIndex(ix2);
+      if (root1 == root2) {
+        Count(kUnionKnown);
+        return false;
+      }
+      uint64_t value1 = data_[root1].load();
+      uint64_t value2 = data_[root2].load();
+      if (Parent(value1) != root1 || Parent(value2) != root2) {
+        // lost a race, try again
+        continue;
+      }
+      size_t rank1 = Rank(value1);
+      size_t rank2 = Rank(value2);
+      const bool swap = rank1 > rank2;
+      if (swap) {
+        std::swap(root1, root2);
+        std::swap(value1, value2);
+        std::swap(rank1, rank2);
+      }
+      // rank1 <= rank2
+      if (!data_[root1].compare_exchange_weak(
+              value1, (value1 & ~kParentMask) | root2)) {
+        continue;
+      }
+      if (swap) {
+        Count(kUnionRankSwap);
+      }
+      if (rank1 == rank2) {
+        // if this fails, root2 has since gained a parent or a higher rank and
+        // the rank is only a heuristic
+        if (data_[root2].compare_exchange_strong(value2, value2 + kRankUnit)) {
+          Count(kUnionRankIncrease);
+        }
+      }
+      if (rank1) {
+        Count(kUnionRankZero);
+      }
+      Count(kUnionUnknown);
+      return true;
+    }
+  }
+
+ private:
+  enum CountIndex {
+    kFindHalved,
+    kUnionKnown,
+    kUnionUnknown,
+    kUnionRankSwap,
+    kUnionRankIncrease,
+    kUnionRankZero,
+    kCounts,
+  };
+
+  static constexpr unsigned kRankShift = 56;
+  static constexpr uint64_t kParentMask = (uint64_t{1} << kRankShift) - 1;
+  static constexpr uint64_t kRankUnit = uint64_t{1} << kRankShift;
+
+  static size_t Parent(uint64_t value) {
+    return value & kParentMask;
+  }
+
+  static size_t Rank(uint64_t value) {
+    return value >> kRankShift;
+  }
+
+  static size_t Size(Key start, Key limit) {
+    Check(start.ix_ <= limit.ix_) << "ConcurrentUnionFind: bad range";
+    const size_t size = limit.ix_ - start.ix_;
+    Check(size <= kParentMask) << "ConcurrentUnionFind: range too big";
+    return size;
+  }
+
+  size_t Index(Key id) const {
+    const size_t ix = id.ix_ - offset_;
+    if (id.ix_ < offset_ || ix >= data_.size()) {
+      Die() << "ConcurrentUnionFind: out of range access to " << id;
+    }
+    return ix;
+  }
+
+  size_t FindIndex(size_t ix) {
+    // path halving
+    while (true) {
+      uint64_t value = data_[ix].load();
+      const size_t parent = Parent(value);
+      if (parent == ix) {
+        return ix;
+      }
+      const size_t parent_parent = Parent(data_[parent].load());
+      if (parent_parent == parent) {
+        return parent;
+      }
+      // a failure means another thread has already moved ix closer to the root
+      data_[ix].compare_exchange_weak(
+          value, (value & ~kParentMask) | parent_parent);
+      Count(kFindHalved);
+      ix = parent_parent;
+    }
+  }
+
+  void Count(CountIndex index) {
+    counts_[index].fetch_add(1, std::memory_order_relaxed);
+  }
+
+  const size_t offset_;
+  std::vector<std::atomic<uint64_t>> data_;
+  std::atomic<size_t> counts_[kCounts] = {};
+  Counter find_halved_;
+  Counter union_known_;
+  Counter union_unknown_;
+  std::optional<Counter> union_rank_swap_;
+  std::optional<Counter> union_rank_increase_;
+  std::optional<Counter> union_rank_zero_;
+};
+
+}  // namespace stg
+
+#endif  // STG_CONCURRENT_UNION_FIND_H_
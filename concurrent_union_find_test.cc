@@ -0,0 +1,136 @@
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+// -*- mode: C++ -*-
+//
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License v2.0 with LLVM Exceptions (the
+// "License"); you may not use this file except in compliance with the
+// License.  You may obtain a copy of the License at
+//
+//     https://llvm.org/LICENSE.txt
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "concurrent_union_find.h"
+
+#include <cstddef>
+#include <map>
+#include <string>
+#include <thread>
+#include <variant>
+#include <vector>
+
+#include <catch2/catch.hpp>
+#include "error.h"
+#include "graph.h"
+#include "metrics.h"
+
+namespace Test {
+
+using UnionFind = stg::ConcurrentUnionFind<stg::Id>;
+
+const stg::UnionFindCounterNames kNames = {
+    "find_halved", "union_known", "union_unknown",
+    "union_rank_swap", "union_rank_increase", "union_rank_zero"};
+
+std::map<std::string, size_t> Counts(const stg::Metrics& metrics) {
+  std::map<std::string, size_t> result;
+  for (const auto& metric : metrics) {
+    result[metric.name] = std::get<size_t>(metric.value);
+  }
+  return result;
+}
+
+TEST_CASE("link prefers second") {
+  stg::Metrics metrics;
+  {
+    UnionFind uf(stg::Id(10), stg::Id(20), metrics, kNames);
+    CHECK(uf.Find(stg::Id(12)) == stg::Id(12));
+    CHECK(uf.Link(stg::Id(12), stg::Id(13)));
+    CHECK(uf.Find(stg::Id(12)) == stg::Id(13));
+    CHECK(uf.Link(stg::Id(13), stg::Id(11)));
+    CHECK(uf.Find(stg::Id(12)) == stg::Id(11));
+    CHECK(!uf.Link(stg::Id(11), stg::Id(12)));
+    CHECK(uf.Find(stg::Id(13)) == stg::Id(11));
+  }
+  const auto counts = Counts(metrics);
+  CHECK(counts.at("union_unknown") == 2);
+  CHECK(counts.at("union_known") == 1);
+}
+
+TEST_CASE("union by rank") {
+  stg::Metrics metrics;
+  {
+    UnionFind uf(stg::Id(0), stg::Id(4), metrics, kNames);
+    // equal ranks, second wins
+    CHECK(uf.Union(stg::Id(0), stg::Id(1)));
+    CHECK(uf.Find(stg::Id(0)) == stg::Id(1));
+    // higher rank wins
+    CHECK(uf.Union(stg::Id(1), stg::Id(2)));
+    CHECK(uf.Find(stg::Id(2)) == stg::Id(1));
+    CHECK(uf.Union(stg::Id(3), stg::Id(0)));
+    CHECK(uf.Find(stg::Id(3)) == stg::Id(1));
+    CHECK(!uf.Union(stg::Id(2), stg::Id(3)));
+  }
+  const auto counts = Counts(metrics);
+  CHECK(counts.at("union_unknown") == 3);
+  CHECK(counts.at("union_known") == 1);
+  CHECK(counts.at("union_rank_swap") == 1);
+  CHECK(counts.at("union_rank_increase") == 1);
+  CHECK(counts.at("union_rank_zero") == 0);
+}
+
+TEST_CASE("out of range") {
+  stg::Metrics metrics;
+  UnionFind uf(stg::Id(5), stg::Id(10), metrics, kNames);
+  CHECK_THROWS_AS(uf.Find(stg::Id(4)), stg::Exception);
+  CHECK_THROWS_AS(uf.Find(stg::Id(10)), stg::Exception);
+  CHECK_THROWS_AS(uf.Union(stg::Id(5), stg::Id(10)), stg::Exception);
+}
+
+TEST_CASE("concurrent unions") {
+  const bool ranked = GENERATE(false, true);
+  const size_t threads = GENERATE(2, 4, 8);
+  // every thread joins the ids with the same residue modulo classes, starting
+  // at a different place, so there is plenty of contention
+  const size_t size = 1 << 14;
+  const size_t classes = 7;
+  stg::Metrics metrics;
+  {
+    UnionFind uf(stg::Id(0), stg::Id(size), metrics, kNames);
+    std::vector<std::thread> workers;
+    for (size_t t = 0; t < threads; ++t) {
+      workers.emplace_back([&, t]() {
+        for (size_t i = 0; i + classes < size; ++i) {
+          const size_t ix = (i + t * size / threads) % (size - classes);
+          const stg::Id id1(ix);
+          const stg::Id id2(ix + classes);
+          if (ranked) {
+            uf.Union(id1, id2);
+          } else {
+            uf.Link(id1, id2);
+          }
+        }
+      });
+    }
+    for (auto& worker : workers) {
+      worker.join();
+    }
+    for (size_t ix = 0; ix < size; ++ix) {
+      CHECK(uf.Find(stg::Id(ix)) == uf.Find(stg::Id(ix % classes)));
+    }
+    for (size_t ix = 1; ix < classes; ++ix) {
+      CHECK(uf.Find(stg::Id(ix)) != uf.Find(stg::Id(ix - 1)));
+    }
+  }
+  const auto counts = Counts(metrics);
+  CHECK(counts.at("union_unknown") == size - classes);
+  CHECK(counts.at("union_unknown") + counts.at("union_known")
+        == threads * (size - classes));
+}
+
+}  // namespace Test
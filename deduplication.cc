@@ -19,28 +19,379 @@
 
 #include "deduplication.h"
 
+#include <algorithm>
 #include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
 #include <unordered_map>
+#include <unordered_set>
+#include <utility>
 #include <vector>
 
+#include "arena.h"
 #include "equality.h"
 #include "equality_cache.h"
+#include "error.h"
+#include "flat_map.h"
 #include "graph.h"
+#include "hashing.h"
 #include "metrics.h"
+#include "parallel.h"
 #include "substitution.h"
 
 namespace stg {
 
+namespace {
+
+// Ids are rewritten concurrently in chunks of this size.
+constexpr size_t kRewriteChunk = 4096;
+
+// Partitions of nodes by hash, allocated from an arena.
+using Partitions =
+    std::pmr::unordered_map<HashValue64, std::pmr::vector<Id>>;
+
+// Splits a partition of nodes with the same fingerprint into sets of equal
+// nodes, recording the results in the equality cache. The partition is
+// consumed in place, without allocation, so that concurrent workers can refine
+// partitions allocated from an arena.
+template <typename EqualityCache>
+void Refine(Equals<EqualityCache>& equals, std::pmr::vector<Id>& ids,
+            size_t& equalities, size_t& inequalities) {
+  while (ids.size() > 1) {
+    const Id candidate = ids[0];
+    size_t todo = 0;
+    for (size_t i = 1; i < ids.size(); ++i) {
+      if (equals(ids[i], candidate)) {
+        ++equalities;
+      } else {
+        ids[todo++] = ids[i];
+        ++inequalities;
+      }
+    }
+    ids.erase(ids.begin() + todo, ids.end());
+  }
+}
+
+// Removes a node if it has a representative, otherwise updates its edges to
+// refer to representatives. Returns whether the node was removed.
+template <typename EqualityCache, typename Substitute>
+bool Rewrite(Graph& graph, EqualityCache& cache, Substitute& substitute,
+             Id id) {
+  const Id fid = cache.Find(id);
+  if (fid != id) {
+    graph.Remove(id);
+    return true;
+  }
+  substitute(id);
+  return false;
+}
+
+// Partition refinement
+//
+// This collects the attributes of a node that Equals compares into a label and
+// its outgoing edges, in the order Equals follows them. Two nodes are equal if
+// and only if they have equal labels and their edges lead to equal nodes.
+struct Local {
+  explicit Local(const Graph& graph) : graph(graph) {}
+
+  void operator()(Id id) {
+    label.clear();
+    edges.clear();
+    graph.Apply<void>(*this, id);
+  }
+
+  void Add(uint64_t x) {
+    label.append(reinterpret_cast<const char*>(&x), sizeof(x));
+  }
+
+  void Add(std::string_view x) {
+    Add(x.size());
+    label.append(x);
+  }
+
+  template <typename Enum>
+  void AddEnum(Enum x) {
+    Add(static_cast<uint64_t>(x));
+  }
+
+  template <typename Value>
+  void Add(const std::optional<Value>& x) {
+    Add(x.has_value());
+    if (x) {
+      Add(*x);
+    }
+  }
+
+  void Add(const ElfSymbol::VersionInfo& x) {
+    Add(x.is_default);
+    Add(x.name);
+  }
+
+  void Add(ElfSymbol::CRC x) {
+    Add(x.number);
+  }
+
+  void Edge(Id id) {
+    edges.push_back(id);
+  }
+
+  void Edges(const Ids& ids) {
+    Add(ids.size());
+    for (const auto id : ids) {
+      Edge(id);
+    }
+  }
+
+  template <typename Key>
+  void Edges(const FlatMap<Key, Id>& ids) {
+    Add(ids.size());
+    for (const auto& [key, id] : ids) {
+      Add(key);
+      Edge(id);
+    }
+  }
+
+  void Start(char tag) {
+    label.push_back(tag);
+  }
+
+  void operator()(const Special& x) {
+    Start('s');
+    AddEnum(x.kind);
+  }
+
+  void operator()(const PointerReference& x) {
+    Start('p');
+    AddEnum(x.kind);
+    Edge(x.pointee_type_id);
+  }
+
+  void operator()(const PointerToMember& x) {
+    Start('m');
+    Edge(x.containing_type_id);
+    Edge(x.pointee_type_id);
+  }
+
+  void operator()(const Typedef& x) {
+    Start('t');
+    Add(x.name);
+    Edge(x.referred_type_id);
+  }
+
+  void operator()(const Qualified& x) {
+    Start('q');
+    AddEnum(x.qualifier);
+    Edge(x.qualified_type_id);
+  }
+
+  void operator()(const Primitive& x) {
+    Start('P');
+    Add(x.name);
+    Add(x.encoding.has_value());
+    if (x.encoding) {
+      AddEnum(*x.encoding);
+    }
+    Add(x.bytesize);
+  }
+
+  void operator()(const Array& x) {
+    Start('a');
+    Add(x.number_of_elements);
+    Edge(x.element_type_id);
+  }
+
+  void operator()(const BaseClass& x) {
+    Start('b');
+    Add(x.offset);
+    AddEnum(x.inheritance);
+    Edge(x.type_id);
+  }
+
+  void operator()(const Method& x) {
+    Start('M');
+    Add(x.mangled_name);
+    Add(x.name);
+    Add(x.vtable_offset);
+    Edge(x.type_id);
+  }
+
+  void operator()(const Member& x) {
+    Start('e');
+    Add(x.name);
+    Add(x.offset);
+    Add(x.bitsize);
+    Edge(x.type_id);
+  }
+
+  void operator()(const StructUnion& x) {
+    Start('S');
+    AddEnum(x.kind);
+    Add(x.name);
+    Add(x.definition.has_value());
+    if (x.definition) {
+      Add(x.definition->bytesize);
+      Edges(x.definition->base_classes);
+      Edges(x.definition->methods);
+      Edges(x.definition->members);
+    }
+  }
+
+  void operator()(const Enumeration& x) {
+    Start('E');
+    Add(x.name);
+    Add(x.definition.has_value());
+    if (x.definition) {
+      Add(x.definition->enumerators.size());
+      for (const auto& [name, value] : x.definition->enumerators) {
+        Add(name);
+        Add(static_cast<uint64_t>(value));
+      }
+      Edge(x.definition->underlying_type_id);
+    }
+  }
+
+  void operator()(const Function& x) {
+    Start('f');
+    Edges(x.parameters);
+    Edge(x.return_type_id);
+  }
+
+  void operator()(const ElfSymbol& x) {
+    Start('y');
+    Add(x.symbol_name);
+    Add(x.version_info);
+    Add(x.is_defined);
+    AddEnum(x.symbol_type);
+    AddEnum(x.binding);
+    AddEnum(x.visibility);
+    Add(x.crc);
+    Add(x.ns);
+    Add(x.full_name);
+    Add(x.type_id.has_value());
+    if (x.type_id) {
+      Edge(*x.type_id);
+    }
+  }
+
+  void operator()(const Interface& x) {
+    Start('i');
+    Edges(x.symbols);
+    Edges(x.types);
+  }
+
+  const Graph& graph;
+  std::string label;
+  std::vector<Id> edges;
+};
+
+struct HashSignature {
+  size_t operator()(const std::vector<uint32_t>& signature) const {
+    uint32_t hash = signature.size();
+    for (const auto x : signature) {
+      hash = Hash()(x, hash).value;
+    }
+    return hash;
+  }
+};
+
+// Finds the duplicates among the new nodes with hashes, and between them and
+// the old nodes with hashes, which must already be free of duplicates. Returns
+// the representative of each duplicate new node: the equal old node, if there
+// is one, otherwise the lowest id of its set.
+template <typename IsNew>
+std::unordered_map<Id, Id> FindDuplicates(const Graph& graph,
+                                          const Hashes& hashes,
+                                          const IsNew& is_new,
+                                          Metrics& metrics) {
+  // Partition the nodes by hash, keeping only partitions with new nodes.
+  Arena arena(metrics, "deduplicate.arena_bytes");
+  Partitions partitions(arena.Resource());
+  {
+    Time x(metrics, "partition nodes");
+    for (const auto& [id, fp] : hashes) {
+      if (is_new(id)) {
+        partitions[fp];
+      }
+    }
+    for (const auto& [id, fp] : hashes) {
+      const auto it = partitions.find(fp);
+      if (it != partitions.end()) {
+        it->second.push_back(id);
+      }
+    }
+  }
+  Counter(metrics, "deduplicate.nodes") = hashes.Size();
+  Counter(metrics, "deduplicate.hashes") = partitions.size();
+
+  DenseEqualityCache cache(hashes, Id(0), graph.Limit(), metrics);
+  Equals<DenseEqualityCache> equals(graph, cache);
+  {
+    Memory memory(metrics, "find duplicates memory");
+    Time x(metrics, "find duplicates");
+    size_t equal = 0;
+    size_t unequal = 0;
+    for (auto& [fp, ids] : partitions) {
+      Refine(equals, ids, equal, unequal);
+    }
+    Counter(metrics, "deduplicate.equalities") = equal;
+    Counter(metrics, "deduplicate.inequalities") = unequal;
+  }
+
+  // Equality checks may have found duplicates in other partitions, so the
+  // best representative of every set is needed.
+  const auto better = [&](Id id, Id other) {
+    const bool old = !is_new(id);
+    const bool other_old = !is_new(other);
+    return old != other_old ? old : id.ix_ < other.ix_;
+  };
+  std::unordered_map<Id, Id> best;
+  for (const auto& [id, fp] : hashes) {
+    const Id fid = cache.Find(id);
+    if (fid != id) {
+      const auto [it, inserted] = best.emplace(fid, id);
+      if (!inserted && better(id, it->second)) {
+        it->second = id;
+      }
+    }
+  }
+  std::unordered_map<Id, Id> duplicates;
+  for (const auto& [id, fp] : hashes) {
+    if (!is_new(id)) {
+      continue;
+    }
+    const Id fid = cache.Find(id);
+    const auto it = best.find(fid);
+    const Id rid = it == best.end() || better(fid, it->second) ? fid
+                                                              : it->second;
+    if (rid != id) {
+      duplicates.emplace(id, rid);
+    }
+  }
+  return duplicates;
+}
+
+}  // namespace
+
 Id Deduplicate(Graph& graph, Id root, const Hashes& hashes, Metrics& metrics) {
+  return Deduplicate(graph, root, hashes, metrics, 1);
+}
+
+Id Deduplicate(Graph& graph, Id root, const Hashes& hashes, Metrics& metrics,
+               size_t jobs) {
   // Partition the nodes by hash.
-  std::unordered_map<HashValue, std::vector<Id>> partitions;
+  Arena arena(metrics, "deduplicate.arena_bytes");
+  Partitions partitions(arena.Resource());
   {
     Time x(metrics, "partition nodes");
     for (const auto& [id, fp] : hashes) {
       partitions[fp].push_back(id);
     }
   }
-  Counter(metrics, "deduplicate.nodes") = hashes.size();
+  Counter(metrics, "deduplicate.nodes") = hashes.Size();
   Counter(metrics, "deduplicate.hashes") = partitions.size();
 
   Histogram hash_partition_size(metrics, "deduplicate.hash_partition_size");
@@ -53,34 +404,300 @@ Id Deduplicate(Graph& graph, Id root, const Hashes& hashes, Metrics& metrics) {
     max_comparisons += n * (n - 1) / 2;
   }
 
-  // Refine partitions of nodes with the same fingerprints.
-  EqualityCache cache(hashes, metrics);
-  Equals<EqualityCache> equals(graph, cache);
   Counter equalities(metrics, "deduplicate.equalities");
   Counter inequalities(metrics, "deduplicate.inequalities");
+  Counter unique(metrics, "deduplicate.unique");
+  Counter duplicate(metrics, "deduplicate.duplicate");
+  auto update = [](auto& cache, Id& id) {
+    // update id to representative id, avoiding silent stores
+    const Id fid = cache.Find(id);
+    if (fid != id) {
+      id = fid;
+    }
+  };
+
+  if (jobs <= 1) {
+    // Refine partitions of nodes with the same fingerprints.
+    DenseEqualityCache cache(hashes, Id(0), graph.Limit(), metrics);
+    Equals<DenseEqualityCache> equals(graph, cache);
+    {
+      Memory memory(metrics, "find duplicates memory");
+      Time x(metrics, "find duplicates");
+      size_t equal = 0;
+      size_t unequal = 0;
+      for (auto& [fp, ids] : partitions) {
+        Refine(equals, ids, equal, unequal);
+      }
+      equalities = equal;
+      inequalities = unequal;
+    }
+
+    // Keep one representative of each set of duplicates.
+    auto remap = [&](Id& id) {
+      update(cache, id);
+    };
+    Substitute substitute(graph, remap);
+    {
+      Time x(metrics, "rewrite");
+      for (const auto& [id, fp] : hashes) {
+        if (Rewrite(graph, cache, substitute, id)) {
+          ++duplicate;
+        } else {
+          ++unique;
+        }
+      }
+    }
+
+    // In case the root node was remapped.
+    substitute.Update(root);
+    return root;
+  }
+
+  // Refine partitions concurrently, largest first, with a shared cache. Each
+  // worker has its own comparison state and metrics.
+  SharedEqualityCache shared(hashes, Id(0), graph.Limit(), metrics);
+  // worker metrics must outlive the workers
+  std::vector<Metrics> worker_metrics(jobs);
+  struct Worker {
+    std::optional<ConcurrentEqualityCache> cache;
+    std::optional<Equals<ConcurrentEqualityCache>> equals;
+    size_t equalities = 0;
+    size_t inequalities = 0;
+    size_t unique = 0;
+    size_t duplicate = 0;
+  };
+  std::vector<Worker> workers(jobs);
+  for (size_t w = 0; w < jobs; ++w) {
+    auto& worker = workers[w];
+    worker.cache.emplace(shared, worker_metrics[w]);
+    worker.equals.emplace(graph, *worker.cache);
+  }
   {
+    Memory memory(metrics, "find duplicates memory");
     Time x(metrics, "find duplicates");
+    std::vector<std::pmr::vector<Id>*> work;
+    work.reserve(partitions.size());
     for (auto& [fp, ids] : partitions) {
-      while (ids.size() > 1) {
-        std::vector<Id> todo;
-        Id candidate = ids[0];
-        for (size_t i = 1; i < ids.size(); ++i) {
-          if (equals(ids[i], candidate)) {
-            ++equalities;
-          } else {
-            todo.push_back(ids[i]);
-            ++inequalities;
-          }
-        }
-        std::swap(todo, ids);
+      if (ids.size() > 1) {
+        work.push_back(&ids);
       }
     }
+    std::stable_sort(work.begin(), work.end(), [](auto* ids1, auto* ids2) {
+      return ids1->size() > ids2->size();
+    });
+    Workers utilisation(metrics, "find duplicates workers");
+    ForEachIndex(jobs, work.size(), [&](size_t w, size_t index) {
+      auto& worker = workers[w];
+      Refine(*worker.equals, *work[index], worker.equalities,
+             worker.inequalities);
+    }, &utilisation);
   }
 
+  // Keep one representative of each set of duplicates, rewriting disjoint
+  // chunks of nodes concurrently.
+  auto remap = [&](Id& id) {
+    update(shared, id);
+  };
+  {
+    Time x(metrics, "rewrite");
+    std::vector<Id> ids;
+    ids.reserve(hashes.Size());
+    for (const auto& [id, fp] : hashes) {
+      ids.push_back(id);
+    }
+    const size_t chunks = (ids.size() + kRewriteChunk - 1) / kRewriteChunk;
+    Workers utilisation(metrics, "rewrite workers");
+    ForEachIndex(jobs, chunks, [&](size_t w, size_t chunk) {
+      auto& worker = workers[w];
+      Substitute substitute(graph, remap);
+      const size_t begin = chunk * kRewriteChunk;
+      const size_t end = std::min(begin + kRewriteChunk, ids.size());
+      for (size_t ix = begin; ix < end; ++ix) {
+        if (Rewrite(graph, shared, substitute, ids[ix])) {
+          ++worker.duplicate;
+        } else {
+          ++worker.unique;
+        }
+      }
+    }, &utilisation);
+  }
+
+  size_t equal = 0;
+  size_t unequal = 0;
+  size_t kept = 0;
+  size_t removed = 0;
+  for (auto& worker : workers) {
+    equal += worker.equalities;
+    unequal += worker.inequalities;
+    kept += worker.unique;
+    removed += worker.duplicate;
+    Check(worker.equals->scc.Empty()) << "internal error: SCC state broken";
+    worker.equals.reset();
+    worker.cache.reset();
+  }
+  MergeShards(worker_metrics, metrics);
+  equalities = equal;
+  inequalities = unequal;
+  unique = kept;
+  duplicate = removed;
+
+  // In case the root node was remapped.
+  update(shared, root);
+  return root;
+}
+
+Id DeduplicateAfter(Graph& graph, Id start, Id root, const Hashes& hashes,
+                    Metrics& metrics) {
+  const auto duplicates = FindDuplicates(
+      graph, hashes, [&](Id id) { return id.ix_ >= start.ix_; }, metrics);
+
   // Keep one representative of each set of duplicates.
-  Counter unique(metrics, "deduplicate.unique");
-  Counter duplicate(metrics, "deduplicate.duplicate");
-  auto remap = [&cache](Id& id) {
+  auto remap = [&](Id& id) {
+    const auto it = duplicates.find(id);
+    if (it != duplicates.end()) {
+      id = it->second;
+    }
+  };
+  Substitute substitute(graph, remap);
+  {
+    Counter unique(metrics, "deduplicate.unique");
+    Counter duplicate(metrics, "deduplicate.duplicate");
+    Time x(metrics, "rewrite");
+    graph.ForEach(start, graph.Limit(), [&](Id id) {
+      if (duplicates.contains(id)) {
+        graph.Remove(id);
+        ++duplicate;
+      } else {
+        substitute(id);
+        ++unique;
+      }
+    });
+  }
+
+  // In case the root node was remapped.
+  substitute.Update(root);
+  return root;
+}
+
+std::unordered_map<Id, Id> DeduplicateNodes(Graph& graph,
+                                            std::span<const Id> nodes,
+                                            const Hashes& hashes,
+                                            Metrics& metrics) {
+  const std::unordered_set<Id> is_new(nodes.begin(), nodes.end());
+  const auto duplicates = FindDuplicates(
+      graph, hashes, [&](Id id) { return is_new.contains(id); }, metrics);
+
+  auto remap = [&](Id& id) {
+    const auto it = duplicates.find(id);
+    if (it != duplicates.end()) {
+      id = it->second;
+    }
+  };
+  Substitute substitute(graph, remap);
+  {
+    Counter unique(metrics, "deduplicate.unique");
+    Counter duplicate(metrics, "deduplicate.duplicate");
+    Time x(metrics, "rewrite");
+    for (const Id id : nodes) {
+      if (duplicates.contains(id)) {
+        graph.Remove(id);
+        ++duplicate;
+      } else {
+        substitute(id);
+        ++unique;
+      }
+    }
+  }
+  return duplicates;
+}
+
+Id DeduplicateByRefinement(Graph& graph, Id root, Metrics& metrics) {
+  // Find the reachable nodes, label them and record their edges as indexes.
+  Local local(graph);
+  std::vector<Id> nodes;
+  std::vector<uint32_t> classes;
+  std::vector<size_t> edge_starts;
+  std::vector<uint32_t> edges;
+  {
+    Time x(metrics, "refine.label");
+    std::unordered_map<Id, uint32_t> index;
+    std::unordered_map<std::string, uint32_t> labels;
+    auto visit = [&](Id id) {
+      const auto [it, inserted] = index.emplace(id, nodes.size());
+      if (inserted) {
+        Check(nodes.size() < UINT32_MAX) << "refine: too many nodes";
+        nodes.push_back(id);
+      }
+      return it->second;
+    };
+    visit(root);
+    for (size_t ix = 0; ix < nodes.size(); ++ix) {
+      local(nodes[ix]);
+      classes.push_back(labels.emplace(local.label, labels.size())
+                            .first->second);
+      edge_starts.push_back(edges.size());
+      for (const auto id : local.edges) {
+        edges.push_back(visit(id));
+      }
+    }
+    edge_starts.push_back(edges.size());
+    Counter(metrics, "refine.initial_classes") = labels.size();
+  }
+  Counter(metrics, "refine.nodes") = nodes.size();
+
+  // Refine the partition by the classes of the edge targets until it is
+  // stable. Each round assigns a class to each node from its class and the
+  // classes of its edge targets, so the partition can only get finer.
+  Counter rounds(metrics, "refine.rounds");
+  Counter signatures(metrics, "refine.signatures");
+  {
+    Time x(metrics, "refine.partition");
+    size_t count = 0;
+    std::vector<uint32_t> next(nodes.size());
+    std::vector<uint32_t> signature;
+    while (true) {
+      ++rounds;
+      std::unordered_map<std::vector<uint32_t>, uint32_t, HashSignature>
+          refined;
+      for (size_t ix = 0; ix < nodes.size(); ++ix) {
+        signature.clear();
+        signature.push_back(classes[ix]);
+        for (size_t e = edge_starts[ix]; e < edge_starts[ix + 1]; ++e) {
+          signature.push_back(classes[edges[e]]);
+        }
+        next[ix] = refined.emplace(signature, refined.size()).first->second;
+        ++signatures;
+      }
+      std::swap(classes, next);
+      if (refined.size() == count) {
+        break;
+      }
+      count = refined.size();
+    }
+    Counter(metrics, "refine.classes") = count;
+  }
+
+  // Keep the first node of each class as its representative.
+  std::vector<Id> representatives(nodes.size(), Id::kInvalid);
+  std::unordered_map<Id, Id> mapping;
+  for (size_t ix = 0; ix < nodes.size(); ++ix) {
+    auto& representative = representatives[classes[ix]];
+    if (representative == Id::kInvalid) {
+      representative = nodes[ix];
+    } else {
+      mapping.emplace(nodes[ix], representative);
+    }
+  }
+
+  struct Mapping {
+    Id Find(Id id) const {
+      const auto it = map.find(id);
+      return it == map.end() ? id : it->second;
+    }
+    const std::unordered_map<Id, Id>& map;
+  };
+  Mapping cache{mapping};
+  auto remap = [&](Id& id) {
     // update id to representative id, avoiding silent stores
     const Id fid = cache.Find(id);
     if (fid != id) {
@@ -88,15 +705,14 @@ Id Deduplicate(Graph& graph, Id root, const Hashes& hashes, Metrics& metrics) {
     }
   };
   Substitute substitute(graph, remap);
+  Counter unique(metrics, "refine.unique");
+  Counter duplicate(metrics, "refine.duplicate");
   {
     Time x(metrics, "rewrite");
-    for (const auto& [id, fp] : hashes) {
-      Id fid = cache.Find(id);
-      if (fid != id) {
-        graph.Remove(id);
+    for (const auto id : nodes) {
+      if (Rewrite(graph, cache, substitute, id)) {
         ++duplicate;
       } else {
-        substitute(id);
         ++unique;
       }
     }
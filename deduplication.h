@@ -20,19 +20,58 @@
 #ifndef STG_DEDUPLICATION_H_
 #define STG_DEDUPLICATION_H_
 
+#include <cstddef>
 #include <cstdint>
+#include <span>
 #include <unordered_map>
 
 #include "graph.h"
-#include "hashing.h"
 #include "metrics.h"
+#include "node_hashes.h"
 
 namespace stg {
 
-using Hashes = std::unordered_map<Id, HashValue>;
+using Hashes = NodeHashes;
 
 Id Deduplicate(Graph& graph, Id root, const Hashes& hashes, Metrics& metrics);
 
+// As above, but compare nodes and rewrite the graph using up to the given
+// number of threads. The result is equivalent, though the representative chosen
+// for each set of duplicates may differ.
+Id Deduplicate(Graph& graph, Id root, const Hashes& hashes, Metrics& metrics,
+               size_t jobs);
+
+// Deduplicate the nodes from start onwards, among themselves and against the
+// earlier nodes, which must already be free of duplicates and are left
+// untouched. Each set of duplicates is represented by its lowest id, so earlier
+// nodes never refer to later ones and the graph can still be truncated at
+// start. The hashes must cover all the nodes reachable from the root and the
+// earlier nodes they may be equal to.
+Id DeduplicateAfter(Graph& graph, Id start, Id root, const Hashes& hashes,
+                    Metrics& metrics);
+
+// Deduplicate the given nodes, among themselves and against the other nodes
+// with hashes, which must already be free of duplicates and are left
+// untouched. Each set of duplicates is represented by such a node, if it has
+// one, otherwise by its lowest id. The hashes must cover the given nodes and
+// all the nodes reachable from them. Returns the representative of each
+// removed node. Only the given nodes are rewritten; any other references to
+// removed nodes must be updated by the caller.
+std::unordered_map<Id, Id> DeduplicateNodes(Graph& graph,
+                                            std::span<const Id> nodes,
+                                            const Hashes& hashes,
+                                            Metrics& metrics);
+
+// Deduplicate without fingerprints, by partition refinement. Nodes reachable
+// from the root are first partitioned by their own attributes, then the
+// partition is repeatedly refined by the classes of each node's edge targets
+// until it is the coarsest one consistent with node equality. This does no
+// pairwise comparisons, so it is insensitive to hash collisions. Each round is
+// linear in the number of edges. Every round but the last splits a class, so
+// there are at most as many rounds as nodes. Cycles mean this, rather than the
+// depth of the graph, is the bound.
+Id DeduplicateByRefinement(Graph& graph, Id root, Metrics& metrics);
+
 }  // namespace stg
 
 #endif  // STG_DEDUPLICATION_H_
@@ -0,0 +1,181 @@
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+// -*- mode: C++ -*-
+//
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License v2.0 with LLVM Exceptions (the
+// "License"); you may not use this file except in compliance with the
+// License.  You may obtain a copy of the License at
+//
+//     https://llvm.org/LICENSE.txt
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "deduplication.h"
+
+#include <cstddef>
+#include <filesystem>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <catch2/catch.hpp>
+#include "fingerprint.h"
+#include "graph.h"
+#include "hashing.h"
+#include "input.h"
+#include "metrics.h"
+#include "proto_writer.h"
+#include "reader_options.h"
+
+namespace Test {
+
+struct DeduplicationTestCase {
+  const char* name;
+  stg::InputFormat format;
+  const char* file;
+};
+
+// Deduplicates using fingerprints and the given number of jobs or, if jobs is
+// 0, by partition refinement.
+std::string Deduplicate(const DeduplicationTestCase& test, size_t jobs) {
+  stg::Graph graph;
+  stg::Metrics metrics;
+  const auto path = std::filesystem::path("testdata") / test.file;
+  auto root = stg::Read(graph, test.format, path.c_str(), stg::ReadOptions(),
+                        nullptr, metrics);
+  if (jobs == 0) {
+    root = stg::DeduplicateByRefinement(graph, root, metrics);
+  } else {
+    const auto hashes = stg::Fingerprint(graph, root, metrics);
+    root = stg::Deduplicate(graph, root, hashes, metrics, jobs);
+  }
+  std::ostringstream os;
+  stg::proto::Writer writer(graph);
+  writer.Write(root, os);
+  return os.str();
+}
+
+const std::vector<DeduplicationTestCase> kTestCases = {
+    {"duplicate types", stg::InputFormat::ABI, "abigail_duplicate_types_0.xml"},
+    {"anonymous types", stg::InputFormat::ABI, "abigail_anonymous_types_0.xml"},
+    {"symbols", stg::InputFormat::ABI, "added_removed_symbols_0.xml"},
+    {"type roots", stg::InputFormat::STG, "type_addition_2.stg"},
+    {"qualifiers", stg::InputFormat::STG, "qualifier_1.stg"},
+};
+
+TEST_CASE("parallel deduplication") {
+  const auto test = GENERATE(from_range(kTestCases));
+  const size_t jobs = GENERATE(2, 3, 8);
+
+  SECTION(test.name) {
+    const auto serial = Deduplicate(test, 1);
+    const auto parallel = Deduplicate(test, jobs);
+    CHECK(!serial.empty());
+    CHECK(parallel == serial);
+  }
+}
+
+TEST_CASE("deduplication by refinement") {
+  const auto test = GENERATE(from_range(kTestCases));
+
+  SECTION(test.name) {
+    const auto fingerprint = Deduplicate(test, 1);
+    const auto refine = Deduplicate(test, 0);
+    CHECK(!refine.empty());
+    CHECK(refine == fingerprint);
+  }
+}
+
+TEST_CASE("deduplication after a deduplicated input") {
+  const auto test = GENERATE(from_range(kTestCases));
+
+  SECTION(test.name) {
+    stg::Graph graph;
+    stg::Metrics metrics;
+    const auto path = std::filesystem::path("testdata") / test.file;
+    const auto read = [&]() {
+      return stg::Read(graph, test.format, path.c_str(), stg::ReadOptions(),
+                       nullptr, metrics);
+    };
+    const auto write = [&](stg::Id root) {
+      std::ostringstream os;
+      stg::proto::Writer(graph).Write(root, os);
+      return os.str();
+    };
+    auto root1 = read();
+    auto hashes = stg::Fingerprint(graph, root1, metrics);
+    root1 = stg::Deduplicate(graph, root1, hashes, metrics);
+    hashes.EraseIf([&](stg::Id id, stg::HashValue64) {
+      return !graph.Is(id);
+    });
+    const auto expected = write(root1);
+
+    const auto start = graph.Limit();
+    const auto root2 = read();
+    hashes.Merge(stg::Fingerprint(graph, root2, metrics));
+    // the second copy collapses entirely onto the first
+    CHECK(stg::DeduplicateAfter(graph, start, root2, hashes, metrics) == root1);
+    // only unreachable nodes of the second copy are left
+    size_t reachable = 0;
+    graph.ForEach(start, graph.Limit(), [&](stg::Id id) {
+      reachable += hashes.Contains(id);
+    });
+    CHECK(reachable == 0);
+    graph.Truncate(start);
+    CHECK(write(root1) == expected);
+  }
+}
+
+TEST_CASE("deduplication of given nodes") {
+  stg::Graph graph;
+  stg::Metrics metrics;
+  // a struct that points to itself
+  const auto add_list = [&]() {
+    const auto list = graph.Allocate();
+    const auto pointer = graph.Add<stg::PointerReference>(
+        stg::PointerReference::Kind::POINTER, list);
+    const auto next = graph.Add<stg::Member>("next", pointer, 0, 0);
+    graph.Set<stg::StructUnion>(list, stg::StructUnion::Kind::STRUCT, "list",
+                                8, stg::Ids(), stg::Ids(), stg::Ids{next});
+    return list;
+  };
+  const auto list = add_list();
+  const auto old_limit = graph.Limit();
+  stg::FingerprintCache hashes;
+  stg::Fingerprint(graph, list, metrics, 1, hashes);
+
+  // new nodes, with duplicates among themselves and of the existing ones
+  const auto low = graph.Allocate();
+  const auto list2 = add_list();
+  const auto list3 = add_list();
+  const auto other = graph.Add<stg::StructUnion>(
+      stg::StructUnion::Kind::UNION, "list");
+  graph.Set<stg::PointerReference>(
+      low, stg::PointerReference::Kind::POINTER, other);
+  const auto other2 = graph.Add<stg::StructUnion>(
+      stg::StructUnion::Kind::UNION, "list");
+  std::vector<stg::Id> nodes;
+  graph.ForEach(old_limit, graph.Limit(), [&](stg::Id id) {
+    nodes.push_back(id);
+  });
+  stg::Fingerprint(graph, nodes, metrics, 1, hashes);
+
+  const auto duplicates = stg::DeduplicateNodes(graph, nodes, hashes, metrics);
+  // both copies of the list collapse onto the existing one
+  CHECK(duplicates.size() == 7);
+  CHECK(duplicates.at(list2) == list);
+  CHECK(duplicates.at(list3) == list);
+  CHECK(duplicates.at(other2) == other);
+  CHECK(!duplicates.contains(other));
+  CHECK(!duplicates.contains(low));
+  size_t remaining = 0;
+  graph.ForEach(old_limit, graph.Limit(), [&](stg::Id) { ++remaining; });
+  CHECK(remaining == 2);
+}
+
+}  // namespace Test
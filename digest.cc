@@ -0,0 +1,328 @@
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+// -*- mode: C++ -*-
+//
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License v2.0 with LLVM Exceptions (the
+// "License"); you may not use this file except in compliance with the
+// License.  You may obtain a copy of the License at
+//
+//     https://llvm.org/LICENSE.txt
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "digest.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "error.h"
+#include "flat_map.h"
+#include "graph.h"
+#include "hashing.h"
+#include "metrics.h"
+#include "scc.h"
+
+namespace stg {
+namespace {
+
+// The node function objects hash node attributes, including the numbers of
+// edges of each kind, and queue the edges, in order.
+struct Digester {
+  Digester(const Graph& graph, Metrics& metrics)
+      : graph(graph),
+        non_trivial_scc_size(metrics, "digest.non_trivial_scc_size") {}
+
+  HashValue64 operator()(const Special& x) {
+    return hash('O', static_cast<uint32_t>(x.kind));
+  }
+
+  HashValue64 operator()(const PointerReference& x) {
+    edges.push_back(x.pointee_type_id);
+    return hash('P', static_cast<uint32_t>(x.kind));
+  }
+
+  HashValue64 operator()(const PointerToMember& x) {
+    edges.push_back(x.containing_type_id);
+    edges.push_back(x.pointee_type_id);
+    return hash('N');
+  }
+
+  HashValue64 operator()(const Typedef& x) {
+    edges.push_back(x.referred_type_id);
+    return hash('T', x.name);
+  }
+
+  HashValue64 operator()(const Qualified& x) {
+    edges.push_back(x.qualified_type_id);
+    return hash('Q', static_cast<uint32_t>(x.qualifier));
+  }
+
+  HashValue64 operator()(const Primitive& x) {
+    const auto encoding =
+        x.encoding ? static_cast<uint32_t>(*x.encoding) + 1 : uint32_t{0};
+    return hash('i', x.name, encoding, x.bytesize);
+  }
+
+  HashValue64 operator()(const Array& x) {
+    edges.push_back(x.element_type_id);
+    return hash('A', x.number_of_elements);
+  }
+
+  HashValue64 operator()(const BaseClass& x) {
+    edges.push_back(x.type_id);
+    return hash('B', x.offset, static_cast<uint32_t>(x.inheritance));
+  }
+
+  HashValue64 operator()(const Method& x) {
+    edges.push_back(x.type_id);
+    return hash('M', x.mangled_name, x.name, x.vtable_offset);
+  }
+
+  HashValue64 operator()(const Member& x) {
+    edges.push_back(x.type_id);
+    return hash('D', x.name, x.offset, x.bitsize);
+  }
+
+  HashValue64 operator()(const StructUnion& x) {
+    auto h = hash('U', static_cast<uint32_t>(x.kind), x.name);
+    if (!x.definition.has_value()) {
+      return hash(h, '0');
+    }
+    const auto& definition = *x.definition;
+    Queue(definition.base_classes);
+    Queue(definition.methods);
+    Queue(definition.members);
+    return hash(h, '1', definition.bytesize, definition.base_classes.size(),
+                definition.methods.size(), definition.members.size());
+  }
+
+  HashValue64 operator()(const Enumeration& x) {
+    auto h = hash('E', x.name);
+    if (!x.definition.has_value()) {
+      return hash(h, '0');
+    }
+    const auto& definition = *x.definition;
+    edges.push_back(definition.underlying_type_id);
+    h = hash(h, '1', definition.enumerators.size());
+    for (const auto& [name, value] : definition.enumerators) {
+      h = hash(h, name, value);
+    }
+    return h;
+  }
+
+  HashValue64 operator()(const Function& x) {
+    edges.push_back(x.return_type_id);
+    Queue(x.parameters);
+    return hash('F', x.parameters.size());
+  }
+
+  HashValue64 operator()(const ElfSymbol& x) {
+    auto h = hash('S', x.symbol_name, x.is_defined,
+                  static_cast<uint32_t>(x.symbol_type),
+                  static_cast<uint32_t>(x.binding),
+                  static_cast<uint32_t>(x.visibility));
+    h = x.version_info
+        ? hash(h, '1', x.version_info->is_default, x.version_info->name)
+        : hash(h, '0');
+    h = x.crc ? hash(h, '1', x.crc->number) : hash(h, '0');
+    h = x.ns ? hash(h, '1', *x.ns) : hash(h, '0');
+    h = x.full_name ? hash(h, '1', *x.full_name) : hash(h, '0');
+    if (x.type_id) {
+      edges.push_back(*x.type_id);
+      return hash(h, '1');
+    }
+    return hash(h, '0');
+  }
+
+  HashValue64 operator()(const Interface& x) {
+    auto h = hash('Z', x.symbols.size(), x.types.size());
+    h = Queue(h, x.symbols);
+    return Queue(h, x.types);
+  }
+
+  void Queue(const Ids& ids) {
+    edges.insert(edges.end(), ids.begin(), ids.end());
+  }
+
+  HashValue64 Queue(HashValue64 h, const FlatMap<std::string, Id>& ids) {
+    for (const auto& [name, id] : ids) {
+      h = hash(h, name);
+      edges.push_back(id);
+    }
+    return h;
+  }
+
+  // The depth-first search uses an explicit stack. The attribute hash and the
+  // edges of each node are kept until the node's SCC is closed. The references
+  // of queued edges and the node of the next edge are prefetched.
+  void operator()(Id root) {
+    if (!Visit(root)) {
+      return;
+    }
+    while (!stack.empty()) {
+      Frame& frame = stack.back();
+      if (frame.next < frame.end) {
+        const Id edge = edges[frame.next++];
+        if (frame.next < frame.end) {
+          graph.PrefetchNode(edges[frame.next]);
+        }
+        // this may push a frame, invalidating the reference
+        Visit(edge);
+        continue;
+      }
+      Leave();
+    }
+  }
+
+  // Starts visiting a node, returning false if there is nothing to do.
+  bool Visit(Id id) {
+    if (digests.count(id)) {
+      return false;
+    }
+    auto handle = scc.Open(id);
+    if (!handle) {
+      // Already open.
+      return false;
+    }
+    const size_t begin = edges.size();
+    const auto local = graph.Apply<HashValue64>(*this, id);
+    for (size_t ix = begin; ix < edges.size(); ++ix) {
+      graph.PrefetchReference(edges[ix]);
+    }
+    stack.push_back({id, *handle, begin, begin, edges.size()});
+    pending.insert({id, {local, begin, edges.size()}});
+    return true;
+  }
+
+  // Finishes visiting the node at the top of the stack.
+  void Leave() {
+    const Frame frame = stack.back();
+    stack.pop_back();
+    const auto ids = scc.Close(frame.handle);
+    if (ids.empty()) {
+      // The SCC is still open, so the node's edges must be kept.
+      return;
+    }
+    const std::vector<Id> members(ids.begin(), ids.end());
+    if (members.size() == 1 && !HasSelfEdge(frame.id)) {
+      // The common case of a trivial SCC.
+      const auto& node = pending.at(frame.id);
+      auto h = node.local;
+      for (size_t ix = node.begin; ix < node.end; ++ix) {
+        h = hash(h, digests.at(edges[ix]));
+      }
+      digests.insert({frame.id, h});
+    } else {
+      DigestSCC(frame.id, members);
+    }
+    for (const auto id : members) {
+      pending.erase(id);
+    }
+    // Everything queued since the SCC was entered is now finished with.
+    edges.erase(edges.begin() + frame.begin, edges.end());
+  }
+
+  bool HasSelfEdge(Id id) const {
+    const auto& node = pending.at(id);
+    for (size_t ix = node.begin; ix < node.end; ++ix) {
+      if (edges[ix] == id) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // Numbers the SCC members in depth-first order from the entry node, hashes
+  // the whole SCC and gives each member the SCC hash combined with its number.
+  void DigestSCC(Id entry, const std::vector<Id>& members) {
+    non_trivial_scc_size.Add(members.size());
+    std::unordered_map<Id, uint64_t> numbers;
+    for (const auto id : members) {
+      numbers.insert({id, 0});
+    }
+    std::vector<Id> order;
+    std::vector<Id> todo = {entry};
+    while (!todo.empty()) {
+      const Id id = todo.back();
+      todo.pop_back();
+      auto& number = numbers.at(id);
+      if (number != 0) {
+        continue;
+      }
+      order.push_back(id);
+      number = order.size();
+      // push in reverse, so that edges are followed in order
+      const auto& node = pending.at(id);
+      for (size_t ix = node.end; ix > node.begin; --ix) {
+        const Id target = edges[ix - 1];
+        const auto it = numbers.find(target);
+        if (it != numbers.end() && it->second == 0) {
+          todo.push_back(target);
+        }
+      }
+    }
+    Check(order.size() == members.size())
+        << "internal error: SCC not strongly connected";
+    auto h = hash('C', order.size());
+    for (const auto id : order) {
+      const auto& node = pending.at(id);
+      h = hash(h, node.local);
+      for (size_t ix = node.begin; ix < node.end; ++ix) {
+        const Id target = edges[ix];
+        const auto it = numbers.find(target);
+        h = it != numbers.end() ? hash(h, 'c', it->second)
+                                : hash(h, 'x', digests.at(target));
+      }
+    }
+    for (const auto id : order) {
+      digests.insert({id, hash(h, numbers.at(id))});
+    }
+  }
+
+  struct Frame {
+    Id id;
+    size_t handle;
+    size_t begin;
+    size_t next;
+    size_t end;
+  };
+
+  struct Pending {
+    HashValue64 local;
+    size_t begin;
+    size_t end;
+  };
+
+  const Graph& graph;
+  OperationHistogram non_trivial_scc_size;
+  std::unordered_map<Id, HashValue64> digests;
+  SCC<Id> scc;
+  std::vector<Frame> stack;
+  std::vector<Id> edges;
+  std::unordered_map<Id, Pending> pending;
+  Hash64 hash;
+};
+
+}  // namespace
+
+std::unordered_map<Id, HashValue64> Digest(
+    const Graph& graph, Id root, Metrics& metrics) {
+  Time x(metrics, "digest nodes");
+  Digester digester(graph, metrics);
+  digester(root);
+  Check(digester.scc.Empty()) << "internal error: SCC state broken";
+  return std::move(digester.digests);
+}
+
+}  // namespace stg
@@ -0,0 +1,45 @@
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+// -*- mode: C++ -*-
+//
+// Copyright 2022-2026 Google LLC
+//
+// Licensed under the Apache License v2.0 with LLVM Exceptions (the
+// "License"); you may not use this file except in compliance with the
+// License.  You may obtain a copy of the License at
+//
+//     https://llvm.org/LICENSE.txt
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Author: Giuliano Procida
+
+#ifndef STG_DIGEST_H_
+#define STG_DIGEST_H_
+
+#include <unordered_map>
+
+#include "graph.h"
+#include "hashing.h"
+#include "metrics.h"
+
+namespace stg {
+
+// Digest hashes all nodes reachable from a given root node. Unlike Fingerprint,
+// a node's digest covers all of its attributes and everything it refers to, so
+// that nodes with equal digests are equal, barring hash collisions.
+//
+// Nodes in the same Strongly-Connected Component are numbered in depth-first
+// order from the node by which the SCC was entered and the SCC is hashed as a
+// whole, with edges within it represented by those numbers. The result is
+// deterministic for a given graph and root, but equal nodes reached in
+// different ways may be given different digests.
+std::unordered_map<Id, HashValue64> Digest(
+    const Graph& graph, Id root, Metrics& metrics);
+
+}  // namespace stg
+
+#endif  // STG_DIGEST_H_
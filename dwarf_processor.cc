@@ -23,10 +23,17 @@
 #include <elfutils/libdw.h>
 
 #include <algorithm>
+#include <array>
+#include <chrono>
 #include <cstddef>
 #include <cstdint>
+#include <functional>
+#include <iterator>
+#include <limits>
 #include <memory>
+#include <mutex>
 #include <optional>
+#include <queue>
 #include <sstream>
 #include <string>
 #include <string_view>
@@ -37,45 +44,66 @@
 #include "dwarf_wrappers.h"
 #include "error.h"
 #include "filter.h"
+#include "deduplication.h"
+#include "fingerprint.h"
 #include "graph.h"
+#include "hash_consing.h"
+#include "hashing.h"
+#include "metrics.h"
+#include "parallel.h"
+#include "predecessors.h"
+#include "reader_options.h"
 #include "scope.h"
+#include "substitution.h"
+#include "trace.h"
 
 namespace stg {
 namespace dwarf {
 
 namespace {
 
-std::string EntryToString(Entry& entry) {
+template <typename Source>
+std::string EntryToString(Source& entry) {
   std::ostringstream os;
   os << "DWARF entry <" << Hex(entry.GetOffset()) << ">";
   return os.str();
 }
 
-std::optional<std::string> MaybeGetName(Entry& entry) {
+// Names are views of DWARF strings, valid for the lifetime of the Handler. They
+// should only be copied when they become part of a node or symbol.
+template <typename Source>
+std::optional<std::string_view> MaybeGetName(Source& entry) {
   return entry.MaybeGetString(DW_AT_name);
 }
 
-std::string GetName(Entry& entry) {
+template <typename Source>
+std::string_view GetName(Source& entry) {
   auto result = MaybeGetName(entry);
   if (!result.has_value()) {
     Die() << "Name was not found for " << EntryToString(entry);
   }
-  return std::move(*result);
+  return *result;
 }
 
-std::string GetNameOrEmpty(Entry& entry) {
-  auto result = MaybeGetName(entry);
-  if (!result.has_value()) {
-    return std::string();
-  }
-  return std::move(*result);
+template <typename Source>
+std::string_view GetNameOrEmpty(Source& entry) {
+  return MaybeGetName(entry).value_or(std::string_view());
 }
 
-std::optional<std::string> MaybeGetLinkageName(int version, Entry& entry) {
+template <typename Source>
+std::optional<std::string_view> MaybeGetLinkageName(int version,
+                                                    Source& entry) {
   return entry.MaybeGetString(
       version < 4 ? DW_AT_MIPS_linkage_name : DW_AT_linkage_name);
 }
 
+std::optional<std::string> MaybeCopy(std::optional<std::string_view> view) {
+  if (!view) {
+    return {};
+  }
+  return {std::string(*view)};
+}
+
 size_t GetBitSize(Entry& entry) {
   if (auto byte_size = entry.MaybeGetUnsignedConstant(DW_AT_byte_size)) {
     return *byte_size * 8;
@@ -85,7 +113,8 @@ size_t GetBitSize(Entry& entry) {
   Die() << "Bit size was not found for " << EntryToString(entry);
 }
 
-size_t GetByteSize(Entry& entry) {
+template <typename Source>
+size_t GetByteSize(Source& entry) {
   if (auto byte_size = entry.MaybeGetUnsignedConstant(DW_AT_byte_size)) {
     return *byte_size;
   } else if (auto bit_size = entry.MaybeGetUnsignedConstant(DW_AT_bit_size)) {
@@ -123,11 +152,13 @@ Primitive::Encoding GetEncoding(Entry& entry) {
   }
 }
 
-std::optional<Entry> MaybeGetReferredType(Entry& entry) {
+template <typename Source>
+std::optional<Entry> MaybeGetReferredType(Source& entry) {
   return entry.MaybeGetReference(DW_AT_type);
 }
 
-Entry GetReferredType(Entry& entry) {
+template <typename Source>
+Entry GetReferredType(Source& entry) {
   auto result = MaybeGetReferredType(entry);
   if (!result.has_value()) {
     Die() << "Type reference was not found in " << EntryToString(entry);
@@ -160,8 +191,9 @@ size_t GetNumberOfElements(Entry& entry) {
 
 // So this function converts DW_AT_bit_offset to the "number of bits from the
 // beginning".
-size_t CalculateBitfieldAdjustment(Entry& entry, size_t bit_size,
-                             bool is_little_endian_binary) {
+template <typename Source>
+size_t CalculateBitfieldAdjustment(Source& entry, size_t bit_size,
+                                   bool is_little_endian_binary) {
   if (bit_size == 0) {
     // bit_size == 0 marks that it is not a bit field. No adjustment needed.
     return 0;
@@ -222,7 +254,8 @@ size_t CalculateBitfieldAdjustment(Entry& entry, size_t bit_size,
 
 // Calculate the number of bits from the beginning of the structure to the
 // beginning of the data member.
-size_t GetDataBitOffset(Entry& entry, size_t bit_size,
+template <typename Source>
+size_t GetDataBitOffset(Source& entry, size_t bit_size,
                         bool is_little_endian_binary) {
   // Offset may be represented either by DW_AT_data_bit_offset (in bits) or by
   // DW_AT_data_member_location (in bytes).
@@ -248,160 +281,655 @@ size_t GetDataBitOffset(Entry& entry, size_t bit_size,
   }
 }
 
+// Collect the addresses of the functions and external variables defined
+// within an entry, looking inside namespaces, without processing anything.
+void CollectAddresses(Entry& entry, std::vector<Address>& addresses) {
+  for (auto& child : entry.GetChildren()) {
+    switch (child.GetTag()) {
+      case DW_TAG_subprogram:
+        if (auto address = child.MaybeGetAddress(DW_AT_low_pc)) {
+          addresses.push_back(*address);
+        }
+        break;
+      case DW_TAG_variable:
+        if (child.GetFlag(DW_AT_external)) {
+          if (auto address = child.MaybeGetAddress(DW_AT_location)) {
+            addresses.push_back(*address);
+          }
+        }
+        break;
+      case DW_TAG_namespace:
+        CollectAddresses(child, addresses);
+        break;
+      default:
+        break;
+    }
+  }
+}
+
+// Collect the scoped names of the struct, class, union and enum types defined
+// within an entry, looking inside namespaces and types, without processing
+// anything.
+void CollectDefinedTypes(Entry& entry, Scope& scope,
+                         std::vector<std::string>& names) {
+  for (auto& child : entry.GetChildren()) {
+    const int tag = child.GetTag();
+    switch (tag) {
+      case DW_TAG_namespace: {
+        const PushScopeName push_scope_name(scope, "namespace",
+                                            GetNameOrEmpty(child));
+        CollectDefinedTypes(child, scope, names);
+        break;
+      }
+      case DW_TAG_structure_type:
+      case DW_TAG_class_type:
+      case DW_TAG_union_type:
+      case DW_TAG_enumeration_type: {
+        const auto name = GetNameOrEmpty(child);
+        if (name.empty() || child.GetFlag(DW_AT_declaration)) {
+          break;
+        }
+        names.push_back(ScopedName(scope, name));
+        if (tag != DW_TAG_enumeration_type) {
+          const PushScopeName push_scope_name(scope, "type", name);
+          CollectDefinedTypes(child, scope, names);
+        }
+        break;
+      }
+      default:
+        break;
+    }
+  }
+}
+
+// Returns the name of a struct, union or enum declaration, or nothing.
+struct DeclarationName {
+  std::string_view operator()(const StructUnion& x) const {
+    return x.definition ? std::string_view() : std::string_view(x.name);
+  }
+
+  std::string_view operator()(const Enumeration& x) const {
+    return x.definition ? std::string_view() : std::string_view(x.name);
+  }
+
+  template <typename Node>
+  std::string_view operator()(const Node&) const {
+    return {};
+  }
+};
+
+// An open-addressing hash table from DWARF offsets to node ids.
+//
+// Entries are only ever added. The table uses linear probing with Fibonacci
+// hashing, as the offsets of nearby entries are close, and is kept at most 3/4
+// full. Iteration is in slot order.
+class OffsetIdMap {
+ public:
+  // Returns the id of the offset, first calling make() to get one if the
+  // offset is not yet present.
+  template <typename Make>
+  Id FindOrInsert(Dwarf_Off offset, Make&& make) {
+    Check(offset != kEmpty) << "OffsetIdMap: bad offset " << Hex(offset);
+    if (4 * (size_ + 1) > 3 * keys_.size()) {
+      Grow();
+    }
+    const size_t slot = Slot(offset);
+    if (keys_[slot] == kEmpty) {
+      keys_[slot] = offset;
+      values_[slot] = make();
+      ++size_;
+    }
+    return values_[slot];
+  }
+
+  // Calls function(offset, id) for each entry.
+  template <typename Function>
+  void ForEach(Function&& function) const {
+    for (size_t slot = 0; slot < keys_.size(); ++slot) {
+      if (keys_[slot] != kEmpty) {
+        function(keys_[slot], values_[slot]);
+      }
+    }
+  }
+
+  // Calls function(id) for each entry, with the id by reference.
+  template <typename Function>
+  void Update(Function&& function) {
+    for (size_t slot = 0; slot < keys_.size(); ++slot) {
+      if (keys_[slot] != kEmpty) {
+        function(values_[slot]);
+      }
+    }
+  }
+
+ private:
+  static constexpr Dwarf_Off kEmpty = ~Dwarf_Off{0};
+  static constexpr unsigned kInitialBits = 4;
+
+  size_t Slot(Dwarf_Off offset) const {
+    const size_t mask = keys_.size() - 1;
+    size_t slot = (offset * uint64_t{0x9e3779b97f4a7c15}) >> shift_;
+    while (keys_[slot] != kEmpty && keys_[slot] != offset) {
+      slot = (slot + 1) & mask;
+    }
+    return slot;
+  }
+
+  void Grow() {
+    const unsigned bits = keys_.empty() ? kInitialBits : 65 - shift_;
+    std::vector<Dwarf_Off> keys(size_t{1} << bits, kEmpty);
+    std::vector<Id> values(keys.size(), Id::kInvalid);
+    std::swap(keys_, keys);
+    std::swap(values_, values);
+    shift_ = 64 - bits;
+    for (size_t slot = 0; slot < keys.size(); ++slot) {
+      if (keys[slot] != kEmpty) {
+        const size_t new_slot = Slot(keys[slot]);
+        keys_[new_slot] = keys[slot];
+        values_[new_slot] = values[slot];
+      }
+    }
+  }
+
+  std::vector<Dwarf_Off> keys_;
+  std::vector<Id> values_;
+  size_t size_ = 0;
+  unsigned shift_ = 64;
+};
+
+// Checks for cancellation before, and reports progress after, each compilation
+// unit. Units may be finished concurrently, but progress calls are serialised.
+class Tracker {
+ public:
+  Tracker(const std::vector<CompilationUnit>& units,
+          const ReadMonitor& monitor)
+      : monitor_(monitor) {
+    progress_.total_units = units.size();
+    for (const auto& unit : units) {
+      progress_.total_bytes += unit.size;
+    }
+  }
+
+  void Start() const {
+    if (monitor_.cancel != nullptr
+        && monitor_.cancel->load(std::memory_order_relaxed)) {
+      Die() << "DWARF processing cancelled";
+    }
+  }
+
+  void Finish(const CompilationUnit& unit) {
+    if (!monitor_.progress) {
+      return;
+    }
+    const std::lock_guard<std::mutex> lock(mutex_);
+    ++progress_.units;
+    progress_.bytes += unit.size;
+    monitor_.progress(progress_);
+  }
+
+ private:
+  const ReadMonitor& monitor_;
+  std::mutex mutex_;
+  ReadProgress progress_;
+};
+
 }  // namespace
 
+struct TagTable;
+
 // Transforms DWARF entries to STG.
 class Processor {
  public:
   Processor(Graph& graph, Id void_id, Id variadic_id,
             bool is_little_endian_binary,
-            const std::unique_ptr<Filter>& file_filter, Types& result)
+            const std::unique_ptr<Filter>& file_filter, Types& result,
+            bool hash_cons = false)
       : graph_(graph),
         void_id_(void_id),
         variadic_id_(variadic_id),
         is_little_endian_binary_(is_little_endian_binary),
         file_filter_(file_filter),
-        result_(result) {}
+        result_(result) {
+    if (hash_cons) {
+      consing_.emplace(graph_);
+    }
+    InitialiseTagMetrics();
+  }
 
   void ProcessCompilationUnit(CompilationUnit& compilation_unit) {
+    const trace::Span span("dwarf.unit");
+    const auto start = std::chrono::steady_clock::now();
+    ++result_.processed_units;
     version_ = compilation_unit.version;
+    unit_ = compilation_unit.entry.die.cu;
+    offset_base_ = compilation_unit.offset_base;
     if (file_filter_ != nullptr) {
       files_ = dwarf::Files(compilation_unit.entry);
+      keep_files_.assign(files_.Size(), std::nullopt);
     }
     Process(compilation_unit.entry);
+    scoped_name_runs_.push_back(scoped_names_.size());
+    const uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - start).count();
+    if (result_.slowest_units.Wants(ns)) {
+      auto& entry = compilation_unit.entry;
+      std::ostringstream os;
+      os << "unit <" << Hex(compilation_unit.offset_base + entry.GetOffset())
+         << "> " << MaybeGetName(entry).value_or("<unnamed>");
+      result_.slowest_units.Add(ns, os.str());
+    }
+  }
+
+  // Finds the units with the same entries as earlier ones, see GetUnitTokens,
+  // and arranges for references to entries of such a unit, from other units,
+  // to resolve to the corresponding entries of the earlier one. Returns
+  // whether each unit is to be skipped.
+  std::vector<bool> FindDuplicateUnits(std::vector<CompilationUnit>& units) {
+    const trace::Span span("dwarf.find_duplicate_units");
+    std::vector<bool> skip(units.size());
+    // Units kept, by the hash of their tokens. The tokens of one are only kept
+    // once another unit has the same hash.
+    struct Original {
+      size_t index;
+      std::optional<std::string> tokens;
+    };
+    std::unordered_map<HashValue64, std::vector<Original>> originals;
+    std::string tokens;
+    unit_starts_.clear();
+    for (size_t index = 0; index < units.size(); ++index) {
+      auto& unit = units[index];
+      const Dwarf_Off start = unit.offset_base + unit.entry.GetOffset();
+      unit_starts_.emplace_back(start, start);
+      const int tag = unit.entry.GetTag();
+      tokens.clear();
+      if ((tag != DW_TAG_compile_unit && tag != DW_TAG_partial_unit)
+          || !GetUnitTokens(unit, tokens)) {
+        continue;
+      }
+      auto& candidates = originals[Hash64()(tokens)];
+      for (auto& candidate : candidates) {
+        if (!candidate.tokens) {
+          GetUnitTokens(units[candidate.index], candidate.tokens.emplace());
+        }
+        // the hash only narrows the search, the tokens are compared in full
+        if (*candidate.tokens == tokens) {
+          auto& original = units[candidate.index];
+          unit_starts_.back().second =
+              original.offset_base + original.entry.GetOffset();
+          skip[index] = true;
+          ++result_.skipped_units;
+          break;
+        }
+      }
+      if (!skip[index]) {
+        candidates.push_back({index, std::nullopt});
+      }
+    }
+    std::sort(unit_starts_.begin(), unit_starts_.end());
+    return skip;
   }
 
   void CheckUnresolvedIds() const {
-    for (const auto& [offset, id] : id_map_) {
+    id_map_.ForEach([&](Dwarf_Off offset, Id id) {
       if (!graph_.Is(id)) {
         Die() << "unresolved id " << id << ", DWARF offset " << Hex(offset);
       }
+    });
+  }
+
+  // Offsets of the entries referred to, as types or symbol specifications,
+  // but not yet processed.
+  std::vector<Dwarf_Off> GetUnresolvedOffsets() const {
+    std::vector<Dwarf_Off> result;
+    id_map_.ForEach([&](Dwarf_Off offset, Id id) {
+      if (!graph_.Is(id)) {
+        result.push_back(offset);
+      }
+    });
+    for (const auto& [offset, symbol_idx] :
+             unresolved_symbol_specifications_) {
+      result.push_back(offset);
+    }
+    return result;
+  }
+
+  // Moves the nodes and results of another Processor, which processed
+  // different compilation units into its own graph, into this one.
+  //
+  // Node references are resolved by DWARF offset, so the other Processor may
+  // refer to entries it did not process itself. Nodes are allocated in the
+  // order they appear in the other graph. All fragments must be allocated
+  // (with AllocateFragment) before any are moved (with MoveFragment).
+  std::vector<Id> AllocateFragment(const Processor& other) {
+    const Graph& other_graph = other.graph_;
+    std::vector<std::optional<Dwarf_Off>> offsets(other_graph.Limit().ix_);
+    other.id_map_.ForEach([&](Dwarf_Off offset, Id id) {
+      offsets[id.ix_] = offset;
+    });
+    std::vector<Id> mapping(offsets.size(), Id::kInvalid);
+    mapping[other.void_id_.ix_] = void_id_;
+    mapping[other.variadic_id_.ix_] = variadic_id_;
+    other_graph.ForEach(Id(0), other_graph.Limit(), [&](Id id) {
+      if (id == other.void_id_ || id == other.variadic_id_) {
+        return;
+      }
+      const auto& offset = offsets[id.ix_];
+      mapping[id.ix_] = offset ? GetIdForOffset(*offset) : graph_.Allocate();
+    });
+    return mapping;
+  }
+
+  void MoveFragment(Processor& other, std::vector<Id>& mapping) {
+    Graph& other_graph = other.graph_;
+    // references to entries from other compilation units
+    other.id_map_.ForEach([&](Dwarf_Off offset, Id id) {
+      if (!other_graph.Is(id)) {
+        mapping[id.ix_] = GetIdForOffset(offset);
+      }
+    });
+    const auto remap = [&](Id& id) {
+      id = mapping[id.ix_];
+    };
+    Substitute substitute(other_graph, remap);
+    other_graph.ForEach(Id(0), other_graph.Limit(), [&](Id id) {
+      if (id == other.void_id_ || id == other.variadic_id_) {
+        return;
+      }
+      substitute(id);
+      MoveNode move{graph_, mapping[id.ix_]};
+      other_graph.Apply<void>(move, id);
+    });
+
+    const auto& other_result = other.result_;
+    const size_t symbol_offset = result_.symbols.size();
+    result_.processed_entries += other_result.processed_entries;
+    result_.skipped_entries += other_result.skipped_entries;
+    result_.processed_units += other_result.processed_units;
+    result_.skipped_units += other_result.skipped_units;
+    result_.child_ranges += other_result.child_ranges;
+    result_.file_filter_evaluations += other_result.file_filter_evaluations;
+    result_.file_filter_hits += other_result.file_filter_hits;
+    for (size_t index = 0; index < other_result.tag_entries.size(); ++index) {
+      result_.tag_entries[index] += other_result.tag_entries[index];
+      result_.tag_timed_entries[index] +=
+          other_result.tag_timed_entries[index];
+      result_.tag_nanoseconds[index] += other_result.tag_nanoseconds[index];
+    }
+    result_.slowest_units.Merge(other_result.slowest_units);
+    for (const auto id : other_result.named_type_ids) {
+      result_.named_type_ids.push_back(mapping[id.ix_]);
+    }
+    for (const auto& symbol : other_result.symbols) {
+      result_.symbols.push_back(symbol);
+      result_.symbols.back().id = mapping[symbol.id.ix_];
+    }
+    const size_t names_base = scoped_names_.size();
+    const size_t text_base = scoped_name_text_.size();
+    scoped_name_text_ += other.scoped_name_text_;
+    for (const auto& named : other.scoped_names_) {
+      scoped_names_.push_back(
+          {named.offset, text_base + named.start, named.size});
+    }
+    for (const auto end : other.scoped_name_runs_) {
+      scoped_name_runs_.push_back(names_base + end);
+    }
+    for (const auto& [offset, symbol_idx] :
+             other.unresolved_symbol_specifications_) {
+      unresolved_symbol_specifications_.emplace_back(
+          offset, symbol_offset + symbol_idx);
     }
   }
 
   void ResolveSymbolSpecifications() {
     std::sort(unresolved_symbol_specifications_.begin(),
               unresolved_symbol_specifications_.end());
-    std::sort(scoped_names_.begin(), scoped_names_.end());
+    const auto names = MergeScopedNames();
     auto symbols_it = unresolved_symbol_specifications_.begin();
-    auto names_it = scoped_names_.begin();
+    auto names_it = names.begin();
     while (symbols_it != unresolved_symbol_specifications_.end()) {
-      while (names_it != scoped_names_.end() &&
-             names_it->first < symbols_it->first) {
+      while (names_it != names.end() && names_it->offset < symbols_it->first) {
         ++names_it;
       }
-      if (names_it == scoped_names_.end() ||
-          names_it->first != symbols_it->first) {
+      if (names_it == names.end() || names_it->offset != symbols_it->first) {
         Die() << "Scoped name not found for entry " << Hex(symbols_it->first);
       }
-      result_.symbols[symbols_it->second].name = names_it->second;
+      result_.symbols[symbols_it->second].name =
+          scoped_name_text_.substr(names_it->start, names_it->size);
       ++symbols_it;
     }
   }
 
+  // Deduplicates the nodes not yet deduplicated, against each other and those
+  // that are, and releases the duplicates by compacting the graph, which must
+  // belong to this Processor. Nodes that can reach entries referred to but not
+  // yet processed cannot be compared and are left for a later call.
+  void Deduplicate(size_t jobs) {
+    const trace::Span span("dwarf.deduplicate");
+    ++result_.deduplication_passes;
+    Metrics metrics;
+    std::vector<Id> unset;
+    id_map_.ForEach([&](Dwarf_Off, Id id) {
+      if (!graph_.Is(id)) {
+        unset.push_back(id);
+      }
+    });
+    std::vector<bool> incomplete(graph_.Limit().ix_);
+    {
+      Predecessors predecessors(graph_, jobs);
+      std::vector<Id> todo = unset;
+      for (const Id id : unset) {
+        incomplete[id.ix_] = true;
+      }
+      while (!todo.empty()) {
+        const Id id = todo.back();
+        todo.pop_back();
+        for (const Id source : predecessors(id)) {
+          if (!incomplete[source.ix_]) {
+            incomplete[source.ix_] = true;
+            todo.push_back(source);
+          }
+        }
+      }
+    }
+    std::vector<Id> nodes;
+    graph_.ForEach(Id(0), graph_.Limit(), [&](Id id) {
+      if (!incomplete[id.ix_] && !fingerprints_.Contains(id)) {
+        nodes.push_back(id);
+      }
+    });
+    Fingerprint(graph_, nodes, metrics, jobs, fingerprints_);
+    const auto duplicates =
+        DeduplicateNodes(graph_, nodes, fingerprints_, metrics);
+    result_.duplicate_nodes += duplicates.size();
+
+    // The incomplete nodes and the results may refer to the duplicates.
+    const auto forward = [&](Id& id) {
+      const auto it = duplicates.find(id);
+      if (it != duplicates.end()) {
+        id = it->second;
+      }
+    };
+    Substitute substitute(graph_, forward);
+    graph_.ForEach(Id(0), graph_.Limit(), [&](Id id) {
+      if (incomplete[id.ix_]) {
+        substitute(id);
+      }
+    });
+    const auto mapping = graph_.Compact(unset);
+    RemapIds([&](Id& id) {
+      forward(id);
+      id = mapping[id.ix_];
+    });
+    FingerprintCache fingerprints;
+    for (const auto& [id, hash] : fingerprints_) {
+      if (!duplicates.contains(id)) {
+        fingerprints.Insert(mapping[id.ix_], hash);
+      }
+    }
+    fingerprints_ = std::move(fingerprints);
+    // The index refers to the old ids.
+    if (consing_) {
+      consing_.emplace(graph_);
+    }
+  }
+
+  // Moves all the nodes into another graph, after a final Deduplicate, and
+  // updates the results to match.
+  void MoveTo(Graph& graph) {
+    const size_t count = graph_.Limit().ix_;
+    const Id base = graph.Allocate(count);
+    const auto remap = [&](Id& id) {
+      id = Id(base.ix_ + id.ix_);
+    };
+    Substitute substitute(graph_, remap);
+    graph_.ForEach(Id(0), graph_.Limit(), [&](Id id) {
+      substitute(id);
+      MoveNode move{graph, Id(base.ix_ + id.ix_)};
+      graph_.Apply<void>(move, id);
+    });
+    RemapIds(remap);
+    graph_ = Graph();
+  }
+
  private:
-  void Process(Entry& entry) {
-    ++result_.processed_entries;
-    auto tag = entry.GetTag();
-    switch (tag) {
-      case DW_TAG_array_type:
-        ProcessArray(entry);
-        break;
-      case DW_TAG_enumeration_type:
-        ProcessEnum(entry);
-        break;
-      case DW_TAG_class_type:
-        ProcessStructUnion(entry, StructUnion::Kind::STRUCT);
-        break;
-      case DW_TAG_structure_type:
-        ProcessStructUnion(entry, StructUnion::Kind::STRUCT);
-        break;
-      case DW_TAG_union_type:
-        ProcessStructUnion(entry, StructUnion::Kind::UNION);
-        break;
-      case DW_TAG_member:
-        Die() << "DW_TAG_member outside of struct/class/union";
-        break;
-      case DW_TAG_pointer_type:
-        ProcessReference<PointerReference>(
-            entry, PointerReference::Kind::POINTER);
-        break;
-      case DW_TAG_reference_type:
-        ProcessReference<PointerReference>(
-            entry, PointerReference::Kind::LVALUE_REFERENCE);
-        break;
-      case DW_TAG_rvalue_reference_type:
-        ProcessReference<PointerReference>(
-            entry, PointerReference::Kind::RVALUE_REFERENCE);
-        break;
-      case DW_TAG_ptr_to_member_type:
-        ProcessPointerToMember(entry);
-        break;
-      case DW_TAG_unspecified_type:
-        ProcessUnspecifiedType(entry);
-        break;
-      case DW_TAG_compile_unit:
-        ProcessAllChildren(entry);
-        break;
-      case DW_TAG_typedef:
-        ProcessTypedef(entry);
-        break;
-      case DW_TAG_base_type:
-        ProcessBaseType(entry);
-        break;
-      case DW_TAG_const_type:
-        ProcessReference<Qualified>(entry, Qualifier::CONST);
-        break;
-      case DW_TAG_volatile_type:
-        ProcessReference<Qualified>(entry, Qualifier::VOLATILE);
-        break;
-      case DW_TAG_restrict_type:
-        ProcessReference<Qualified>(entry, Qualifier::RESTRICT);
-        break;
-      case DW_TAG_atomic_type:
-        // TODO: test pending BTF / test suite support
-        ProcessReference<Qualified>(entry, Qualifier::ATOMIC);
-        break;
-      case DW_TAG_variable:
-        // Process only variables visible externally
-        if (entry.GetFlag(DW_AT_external)) {
-          ProcessVariable(entry);
+  friend struct TagTable;
+
+  // The scoped name of an entry, held in scoped_name_text_.
+  struct NamedEntry {
+    Dwarf_Off offset;
+    size_t start;
+    size_t size;
+  };
+
+  // Returns the scoped names in offset order. The names from each compilation
+  // unit form a run, normally already in offset order, and the runs are
+  // merged.
+  std::vector<NamedEntry> MergeScopedNames() {
+    const auto by_offset = [](const NamedEntry& a, const NamedEntry& b) {
+      return a.offset < b.offset;
+    };
+    Check(scoped_name_runs_.empty()
+          || scoped_name_runs_.back() == scoped_names_.size())
+        << "internal error: scoped name outside compilation unit";
+    // heap of (next offset, run index), least first
+    using Head = std::pair<Dwarf_Off, size_t>;
+    std::priority_queue<Head, std::vector<Head>, std::greater<>> heads;
+    std::vector<std::pair<size_t, size_t>> runs;
+    size_t begin = 0;
+    for (const auto end : scoped_name_runs_) {
+      if (begin < end) {
+        const auto first = scoped_names_.begin() + begin;
+        const auto last = scoped_names_.begin() + end;
+        if (!std::is_sorted(first, last, by_offset)) {
+          std::sort(first, last, by_offset);
         }
-        break;
-      case DW_TAG_subroutine_type:
-        // Standalone function type, for example, used in function pointers.
-        ProcessFunction(entry);
-        break;
-      case DW_TAG_subprogram:
-        // DWARF equivalent of ELF function symbol.
-        ProcessFunction(entry);
-        break;
-      case DW_TAG_namespace:
-        ProcessNamespace(entry);
-        break;
-      case DW_TAG_lexical_block:
-        ProcessAllChildren(entry);
-        break;
+        heads.emplace(first->offset, runs.size());
+        runs.emplace_back(begin, end);
+      }
+      begin = end;
+    }
+    std::vector<NamedEntry> result;
+    result.reserve(scoped_names_.size());
+    while (!heads.empty()) {
+      const size_t run = heads.top().second;
+      heads.pop();
+      auto& [next, end] = runs[run];
+      result.push_back(scoped_names_[next++]);
+      if (next < end) {
+        heads.emplace(scoped_names_[next].offset, run);
+      }
+    }
+    return result;
+  }
 
-      default:
-        // TODO: die on unexpected tag, when this switch contains
-        // all expected tags
-        break;
+  Children GetChildren(Entry& entry) {
+    ++result_.child_ranges;
+    return entry.GetChildren();
+  }
+
+  // Dispatches on the entry's tag, see TagTable.
+  void Process(Entry& entry);
+  void InitialiseTagMetrics();
+
+  void ProcessStrayMember(Entry&) {
+    Die() << "DW_TAG_member outside of struct/class/union";
+  }
+
+  void ProcessExternalVariable(Entry& entry) {
+    // Process only variables visible externally
+    if (entry.GetFlag(DW_AT_external)) {
+      ProcessVariable(entry);
     }
   }
 
+
   void ProcessAllChildren(Entry& entry) {
-    for (auto& child : entry.GetChildren()) {
+    for (auto& child : GetChildren(entry)) {
       Process(child);
     }
   }
 
+  // Function bodies contribute nothing to the ABI beyond the types defined in
+  // them, which must still be processed as they may be referred to from
+  // outside (a Clang bug). Other local entries are stepped over, along with
+  // their subtrees, without being dispatched or examined; libdw follows
+  // DW_AT_sibling, when present, to skip a subtree.
+  void ProcessLocalScope(Entry& entry) {
+    for (auto& child : GetChildren(entry)) {
+      if (IsLocalEntry(child.GetTag())) {
+        ++result_.skipped_entries;
+      } else {
+        Process(child);
+      }
+    }
+  }
+
+  static bool IsLocalEntry(int tag) {
+    switch (tag) {
+      // Local variable declarations never have a location of their own.
+      case DW_TAG_variable:
+      case DW_TAG_formal_parameter:
+      case DW_TAG_label:
+      case DW_TAG_inlined_subroutine:
+      case DW_TAG_call_site:
+      case DW_TAG_GNU_call_site:
+      case DW_TAG_imported_declaration:
+      case DW_TAG_imported_module:
+        return true;
+      default:
+        return false;
+    }
+  }
+
   void CheckNoChildren(Entry& entry) {
-    if (!entry.GetChildren().empty()) {
+    if (!GetChildren(entry).empty()) {
       Die() << "Entry expected to have no children";
     }
   }
 
+  std::string ScopedName(std::string_view name) const {
+    return stg::ScopedName(scope_, name);
+  }
+
+  // A type declared in one scope may be defined out of line in another, with
+  // DW_AT_specification referring to the declaration. GCC does this for all
+  // types in type units. The definition belongs in the declaration's scope,
+  // which is recorded for each type declaration.
+  template <typename Source>
+  void EnterDeclarationScope(Source& entry,
+                             std::optional<ReplaceScope>& replace_scope) {
+    if (entry.GetFlag(DW_AT_declaration)) {
+      declaration_scopes_.emplace(GetOffset(entry), scope_);
+      return;
+    }
+    if (auto specification = entry.MaybeGetReference(DW_AT_specification)) {
+      const auto it = declaration_scopes_.find(GetOffset(*specification));
+      if (it != declaration_scopes_.end()) {
+        replace_scope.emplace(scope_, it->second);
+      }
+    }
+  }
+
   void ProcessNamespace(Entry& entry) {
     auto name = GetNameOrEmpty(entry);
     const PushScopeName push_scope_name(scope_, "namespace", name);
@@ -416,21 +944,21 @@ class Processor {
       Die() << "type '" << type_name << "' size is not a multiple of 8";
     }
     const size_t byte_size = bit_size / 8;
-    AddProcessedNode<Primitive>(entry, type_name, GetEncoding(entry),
-                                byte_size);
+    AddSimpleNode<Primitive>(entry, std::string(type_name),
+                             GetEncoding(entry), byte_size);
   }
 
   void ProcessTypedef(Entry& entry) {
-    const std::string type_name = scope_ + GetName(entry);
+    const std::string type_name = ScopedName(GetName(entry));
     auto referred_type_id = GetIdForReferredType(MaybeGetReferredType(entry));
     const Id id = AddProcessedNode<Typedef>(entry, type_name, referred_type_id);
     AddNamedTypeNode(id);
   }
 
-  template<typename Node, typename KindType>
-  void ProcessReference(Entry& entry, KindType kind) {
+  template <typename Node, auto kind>
+  void ProcessReference(Entry& entry) {
     auto referred_type_id = GetIdForReferredType(MaybeGetReferredType(entry));
-    AddProcessedNode<Node>(entry, kind, referred_type_id);
+    AddSimpleNode<Node>(entry, kind, referred_type_id);
   }
 
   void ProcessPointerToMember(Entry& entry) {
@@ -443,40 +971,51 @@ class Processor {
   }
 
   void ProcessUnspecifiedType(Entry& entry) {
-    const std::string type_name =  GetName(entry);
+    const std::string_view type_name = GetName(entry);
     Check(type_name == "decltype(nullptr)")
         << "Unsupported DW_TAG_unspecified_type: " << type_name;
-    AddProcessedNode<Special>(entry, Special::Kind::NULLPTR);
+    AddSimpleNode<Special>(entry, Special::Kind::NULLPTR);
   }
 
-  bool ShouldKeepDefinition(Entry& entry, const std::string& name) const {
+  bool ShouldKeepDefinition(Entry& entry, std::string_view name) {
     if (file_filter_ == nullptr) {
       return true;
     }
-    const auto file = files_.MaybeGetFile(entry, DW_AT_decl_file);
-    if (!file) {
+    const auto file_index = files_.MaybeGetFileIndex(entry, DW_AT_decl_file);
+    if (!file_index) {
       // Built in types that do not have DW_AT_decl_file should be preserved.
-      static constexpr std::string_view kBuiltinPrefix = "__";
-      // TODO: use std::string_view::starts_with
-      if (name.substr(0, kBuiltinPrefix.size()) == kBuiltinPrefix) {
+      if (name.starts_with("__")) {
         return true;
       }
       Die() << "File filter is provided, but DWARF entry << "
             << EntryToString(entry) << " << doesn't have DW_AT_decl_file";
     }
-    return (*file_filter_)(*file);
+    // Many definitions share a file, so evaluate the filter once per file.
+    auto& keep = keep_files_[*file_index];
+    if (keep) {
+      ++result_.file_filter_hits;
+    } else {
+      ++result_.file_filter_evaluations;
+      keep = (*file_filter_)(files_.GetFile(*file_index));
+    }
+    return *keep;
   }
 
-  void ProcessStructUnion(Entry& entry, StructUnion::Kind kind) {
-    std::string name = GetNameOrEmpty(entry);
-    const std::string full_name = name.empty() ? std::string() : scope_ + name;
+  template <StructUnion::Kind kind>
+  void ProcessStructUnion(Entry& entry) {
+    Attributes attributes(entry);
+    std::optional<ReplaceScope> replace_scope;
+    EnterDeclarationScope(attributes, replace_scope);
+    const std::string_view name = GetNameOrEmpty(attributes);
+    const std::string full_name =
+        name.empty() ? std::string() : ScopedName(name);
     const PushScopeName push_scope_name(scope_, kind, name);
 
-    std::vector<Id> base_classes;
-    std::vector<Id> members;
-    std::vector<Id> methods;
+    Ids base_classes;
+    Ids members;
+    Ids methods;
 
-    for (auto& child : entry.GetChildren()) {
+    for (auto& child : GetChildren(entry)) {
       auto child_tag = child.GetTag();
       // All possible children of struct/class/union
       switch (child_tag) {
@@ -534,7 +1073,7 @@ class Processor {
       }
     }
 
-    if (entry.GetFlag(DW_AT_declaration) ||
+    if (attributes.GetFlag(DW_AT_declaration) ||
         !ShouldKeepDefinition(entry, name)) {
       // Declaration may have partial information about members or method.
       // We only need to parse children for information that will be needed in
@@ -543,7 +1082,7 @@ class Processor {
       return;
     }
 
-    const auto byte_size = GetByteSize(entry);
+    const auto byte_size = GetByteSize(attributes);
 
     const Id id = AddProcessedNode<StructUnion>(
         entry, kind, full_name, byte_size, std::move(base_classes),
@@ -554,10 +1093,12 @@ class Processor {
   }
 
   void ProcessMember(Entry& entry) {
-    std::string name = GetNameOrEmpty(entry);
-    auto referred_type = GetReferredType(entry);
+    Attributes attributes(entry);
+    std::string name(GetNameOrEmpty(attributes));
+    auto referred_type = GetReferredType(attributes);
     auto referred_type_id = GetIdForEntry(referred_type);
-    auto optional_bit_size = entry.MaybeGetUnsignedConstant(DW_AT_bit_size);
+    auto optional_bit_size =
+        attributes.MaybeGetUnsignedConstant(DW_AT_bit_size);
     // Member has DW_AT_bit_size if and only if it is bit field.
     // STG uses bit_size == 0 to mark that the member is not a bit field.
     Check(!optional_bit_size || *optional_bit_size > 0)
@@ -565,12 +1106,14 @@ class Processor {
     auto bit_size = optional_bit_size ? *optional_bit_size : 0;
     AddProcessedNode<Member>(
         entry, std::move(name), referred_type_id,
-        GetDataBitOffset(entry, bit_size, is_little_endian_binary_), bit_size);
+        GetDataBitOffset(attributes, bit_size, is_little_endian_binary_),
+        bit_size);
   }
 
-  void ProcessMethod(std::vector<Id>& methods, Entry& entry) {
+  void ProcessMethod(Ids& methods, Entry& entry) {
     Subprogram subprogram = GetSubprogram(entry);
-    auto id = graph_.Add<Function>(std::move(subprogram.node));
+    auto id = consing_ ? consing_->Add<Function>(std::move(subprogram.node))
+                       : graph_.Add<Function>(std::move(subprogram.node));
     if (subprogram.external && subprogram.address) {
       // Only external functions with address are useful for ABI monitoring
       // TODO: cover virtual methods
@@ -578,7 +1121,7 @@ class Processor {
       result_.symbols.push_back(Types::Symbol{
           .name = GetScopedNameForSymbol(
               new_symbol_idx, subprogram.name_with_context),
-          .linkage_name = subprogram.linkage_name,
+          .linkage_name = MaybeCopy(subprogram.linkage_name),
           .address = *subprogram.address,
           .id = id});
     }
@@ -596,8 +1139,9 @@ class Processor {
       const auto vtable_offset = entry.MaybeGetVtableOffset().value_or(0);
       // TODO: proper handling of missing linkage name
       methods.push_back(AddProcessedNode<Method>(
-          entry, subprogram.linkage_name.value_or("{missing}"),
-          *subprogram.name_with_context.unscoped_name, vtable_offset, id));
+          entry, std::string(subprogram.linkage_name.value_or("{missing}")),
+          std::string(*subprogram.name_with_context.unscoped_name),
+          vtable_offset, id));
     }
   }
 
@@ -624,7 +1168,11 @@ class Processor {
   void ProcessArray(Entry& entry) {
     auto referred_type = GetReferredType(entry);
     auto referred_type_id = GetIdForEntry(referred_type);
-    auto children = entry.GetChildren();
+    // This needs the children in reverse order, so collect them.
+    std::vector<Entry> children;
+    for (auto& child : GetChildren(entry)) {
+      children.push_back(child);
+    }
     // Multiple children in array describe multiple dimensions of this array.
     // For example, int[M][N] contains two children, M located in the first
     // child, N located in the second child. But in STG multidimensional arrays
@@ -641,15 +1189,17 @@ class Processor {
       // reversed order) is attached to the original entry itself.
       auto& entry_to_attach = (it + 1 == children.rend()) ? entry : child;
       // Update referred_type_id so next array in chain points there.
-      referred_type_id = AddProcessedNode<Array>(
+      referred_type_id = AddSimpleNode<Array>(
           entry_to_attach, GetNumberOfElements(child), referred_type_id);
     }
   }
 
   void ProcessEnum(Entry& entry) {
-    const std::optional<std::string> name_optional = MaybeGetName(entry);
+    std::optional<ReplaceScope> replace_scope;
+    EnterDeclarationScope(entry, replace_scope);
+    const std::optional<std::string_view> name_optional = MaybeGetName(entry);
     const std::string name =
-        name_optional.has_value() ? scope_ + *name_optional : "";
+        name_optional.has_value() ? ScopedName(*name_optional) : "";
 
     if (entry.GetFlag(DW_AT_declaration)) {
       // It is expected to have only name and no children in declaration.
@@ -660,13 +1210,11 @@ class Processor {
       return;
     }
     auto underlying_type_id = GetIdForReferredType(MaybeGetReferredType(entry));
-    auto children = entry.GetChildren();
     Enumeration::Enumerators enumerators;
-    enumerators.reserve(children.size());
-    for (auto& child : children) {
+    for (auto& child : GetChildren(entry)) {
       Check(child.GetTag() == DW_TAG_enumerator)
           << "Enum expects child of DW_TAG_enumerator";
-      std::string enumerator_name = GetName(child);
+      const std::string_view enumerator_name = GetName(child);
       // TODO: detect signedness of underlying type and call
       // an appropriate method.
       std::optional<size_t> value_optional =
@@ -690,11 +1238,12 @@ class Processor {
 
   struct NameWithContext {
     std::optional<Dwarf_Off> specification;
-    std::optional<std::string> unscoped_name;
+    std::optional<std::string_view> unscoped_name;
     std::optional<std::string> scoped_name;
   };
 
-  NameWithContext GetNameWithContext(Entry& entry) {
+  template <typename Source>
+  NameWithContext GetNameWithContext(Source& entry) {
     NameWithContext result;
     // Leaf of specification tree is usually a declaration (of a function or a
     // method). Then goes definition, which references declaration by
@@ -720,10 +1269,10 @@ class Processor {
     // whole chain, or use DW_AT_abstract_origin if there is no
     // DW_AT_specification.
     if (auto specification = entry.MaybeGetReference(DW_AT_specification)) {
-      result.specification = specification->GetOffset();
+      result.specification = GetOffset(*specification);
     } else if (auto abstract_origin =
                    entry.MaybeGetReference(DW_AT_abstract_origin)) {
-      result.specification = abstract_origin->GetOffset();
+      result.specification = GetOffset(*abstract_origin);
     }
     result.unscoped_name = entry.MaybeGetDirectString(DW_AT_name);
     if (!result.unscoped_name && !result.specification) {
@@ -731,12 +1280,13 @@ class Processor {
       // Anonymous entries are modelled as the empty string and not nullopt.
       // This allows us to fill and register scoped_name (also empty string) to
       // be used in references.
-      result.unscoped_name = std::string();
+      result.unscoped_name = std::string_view();
     }
     if (result.unscoped_name) {
-      result.scoped_name = scope_ + *result.unscoped_name;
-      scoped_names_.emplace_back(
-          entry.GetOffset(), *result.scoped_name);
+      result.scoped_name = ScopedName(*result.unscoped_name);
+      scoped_names_.push_back({GetOffset(entry), scoped_name_text_.size(),
+                               result.scoped_name->size()});
+      scoped_name_text_ += *result.scoped_name;
     }
     return result;
   }
@@ -778,7 +1328,7 @@ class Processor {
       const auto new_symbol_idx = result_.symbols.size();
       result_.symbols.push_back(Types::Symbol{
           .name = GetScopedNameForSymbol(new_symbol_idx, name_with_context),
-          .linkage_name = MaybeGetLinkageName(version_, entry),
+          .linkage_name = MaybeCopy(MaybeGetLinkageName(version_, entry)),
           .address = *address,
           .id = referred_type_id});
     }
@@ -786,14 +1336,14 @@ class Processor {
 
   void ProcessFunction(Entry& entry) {
     Subprogram subprogram = GetSubprogram(entry);
-    const Id id = AddProcessedNode<Function>(entry, std::move(subprogram.node));
+    const Id id = AddSimpleNode<Function>(entry, std::move(subprogram.node));
     if (subprogram.external && subprogram.address) {
       // Only external functions with address are useful for ABI monitoring
       const auto new_symbol_idx = result_.symbols.size();
       result_.symbols.push_back(Types::Symbol{
           .name = GetScopedNameForSymbol(
               new_symbol_idx, subprogram.name_with_context),
-          .linkage_name = std::move(subprogram.linkage_name),
+          .linkage_name = MaybeCopy(subprogram.linkage_name),
           .address = *subprogram.address,
           .id = id});
     }
@@ -802,16 +1352,18 @@ class Processor {
   struct Subprogram {
     Function node;
     NameWithContext name_with_context;
-    std::optional<std::string> linkage_name;
+    std::optional<std::string_view> linkage_name;
     std::optional<Address> address;
     bool external;
   };
 
   Subprogram GetSubprogram(Entry& entry) {
-    auto return_type_id = GetIdForReferredType(MaybeGetReferredType(entry));
+    Attributes attributes(entry);
+    auto return_type_id =
+        GetIdForReferredType(MaybeGetReferredType(attributes));
 
-    std::vector<Id> parameters;
-    for (auto& child : entry.GetChildren()) {
+    Ids parameters;
+    for (auto& child : GetChildren(entry)) {
       auto child_tag = child.GetTag();
       switch (child_tag) {
         case DW_TAG_formal_parameter:
@@ -825,8 +1377,15 @@ class Processor {
           CheckNoChildren(child);
           parameters.push_back(variadic_id_);
           break;
-        case DW_TAG_enumeration_type:
         case DW_TAG_label:
+        case DW_TAG_inlined_subroutine:
+        case DW_TAG_variable:
+        case DW_TAG_call_site:
+        case DW_TAG_GNU_call_site:
+          // Function body entries, see ProcessLocalScope.
+          ++result_.skipped_entries;
+          break;
+        case DW_TAG_enumeration_type:
         case DW_TAG_lexical_block:
         case DW_TAG_structure_type:
         case DW_TAG_class_type:
@@ -842,11 +1401,7 @@ class Processor {
         case DW_TAG_rvalue_reference_type:
         case DW_TAG_ptr_to_member_type:
         case DW_TAG_unspecified_type:
-        case DW_TAG_inlined_subroutine:
         case DW_TAG_subprogram:
-        case DW_TAG_variable:
-        case DW_TAG_call_site:
-        case DW_TAG_GNU_call_site:
           // TODO: Do not leak local types outside this scope.
           // TODO: It would be better to not process any
           // information that is function local but there is a dangling
@@ -873,21 +1428,50 @@ class Processor {
       }
     }
 
-    return Subprogram{.node = Function(return_type_id, parameters),
-                      .name_with_context = GetNameWithContext(entry),
-                      .linkage_name = MaybeGetLinkageName(version_, entry),
-                      .address = entry.MaybeGetAddress(DW_AT_low_pc),
-                      .external = entry.GetFlag(DW_AT_external)};
+    return Subprogram{.node = Function(return_type_id, std::move(parameters)),
+                      .name_with_context = GetNameWithContext(attributes),
+                      .linkage_name = MaybeGetLinkageName(version_, attributes),
+                      .address = attributes.MaybeGetAddress(DW_AT_low_pc),
+                      .external = attributes.GetFlag(DW_AT_external)};
+  }
+
+  // The offset of an entry, unique across all compilation and type units.
+  template <typename Source>
+  Dwarf_Off GetOffset(Source& entry) const {
+    return offset_base_ + entry.GetOffset();
+  }
+
+  // As above, for an entry that may have been reached by reference from
+  // another unit.
+  Dwarf_Off GetOffset(Entry& entry) const {
+    if (entry.die.cu == unit_) {
+      return offset_base_ + entry.GetOffset();
+    }
+    return GetOriginalOffset(GetOffsetBase(entry) + entry.GetOffset());
+  }
+
+  // The offset of the entry an entry of a skipped unit stands for, that is the
+  // corresponding one in the identical unit processed in its place.
+  Dwarf_Off GetOriginalOffset(Dwarf_Off offset) const {
+    const auto it = std::upper_bound(
+        unit_starts_.begin(), unit_starts_.end(), offset,
+        [](Dwarf_Off offset, const std::pair<Dwarf_Off, Dwarf_Off>& unit) {
+          return offset < unit.first;
+        });
+    if (it == unit_starts_.begin()) {
+      return offset;
+    }
+    const auto& [start, original_start] = *std::prev(it);
+    return offset - start + original_start;
   }
 
   // Allocate or get already allocated STG Id for Entry.
   Id GetIdForEntry(Entry& entry) {
-    const auto offset = entry.GetOffset();
-    const auto [it, emplaced] = id_map_.emplace(offset, Id(-1));
-    if (emplaced) {
-      it->second = graph_.Allocate();
-    }
-    return it->second;
+    return GetIdForOffset(GetOffset(entry));
+  }
+
+  Id GetIdForOffset(Dwarf_Off offset) {
+    return id_map_.FindOrInsert(offset, [&]() { return graph_.Allocate(); });
   }
 
   // Same as GetIdForEntry, but returns "void_id_" for "unspecified" references,
@@ -909,43 +1493,481 @@ class Processor {
     return id;
   }
 
+  // As above, but with hash-consing, if enabled. An entry not referred to yet
+  // gets the node of an identical earlier one, if there is one.
+  template <typename Node, typename... Args>
+  Id AddSimpleNode(Entry& entry, Args&&... args) {
+    if (!consing_) {
+      return AddProcessedNode<Node>(entry, std::forward<Args>(args)...);
+    }
+    bool added = false;
+    const Id id = id_map_.FindOrInsert(GetOffset(entry), [&]() {
+      added = true;
+      return consing_->Add<Node>(std::forward<Args>(args)...);
+    });
+    if (!added) {
+      consing_->Set<Node>(id, std::forward<Args>(args)...);
+    }
+    return id;
+  }
+
   void AddNamedTypeNode(Id id) {
     result_.named_type_ids.push_back(id);
   }
 
+  // Updates every id held outside the graph.
+  template <typename Remap>
+  void RemapIds(const Remap& remap) {
+    remap(void_id_);
+    remap(variadic_id_);
+    id_map_.Update(remap);
+    for (auto& symbol : result_.symbols) {
+      remap(symbol.id);
+    }
+    for (auto& id : result_.named_type_ids) {
+      remap(id);
+    }
+  }
+
+  struct MoveNode {
+    template <typename Node>
+    void operator()(Node& node) {
+      graph.Set<Node>(id, std::move(node));
+    }
+
+    Graph& graph;
+    Id id;
+  };
+
   Graph& graph_;
   Id void_id_;
   Id variadic_id_;
   bool is_little_endian_binary_;
   const std::unique_ptr<Filter>& file_filter_;
   Types& result_;
-  std::unordered_map<Dwarf_Off, Id> id_map_;
-  std::vector<std::pair<Dwarf_Off, std::string>> scoped_names_;
+  std::optional<HashConsing> consing_;
+  // fingerprints of the nodes already deduplicated, see Deduplicate
+  FingerprintCache fingerprints_;
+  OffsetIdMap id_map_;
+  // names of entries which may be symbol specifications, with the ends of the
+  // runs of them from each compilation unit
+  std::string scoped_name_text_;
+  std::vector<NamedEntry> scoped_names_;
+  std::vector<size_t> scoped_name_runs_;
+  std::unordered_map<Dwarf_Off, Scope> declaration_scopes_;
   std::vector<std::pair<Dwarf_Off, size_t>> unresolved_symbol_specifications_;
+  // with skipping of duplicate units, the start of each unit and that of the
+  // unit processed in its place, if skipped, or else its own, sorted
+  std::vector<std::pair<Dwarf_Off, Dwarf_Off>> unit_starts_;
 
   // Current scope.
   Scope scope_;
   int version_;
+  Dwarf_CU* unit_ = nullptr;
+  Dwarf_Off offset_base_ = 0;
   dwarf::Files files_;
+  std::vector<std::optional<bool>> keep_files_;
+};
+
+// How the entries of a DWARF tag are processed, with the names of their
+// metrics.
+struct TagHandler {
+  int tag;
+  void (Processor::*process)(Entry&);
+  const char* entries;
+  const char* time;
+};
+
+// All handled tags are standard DWARF 5 ones, which are small. Vendor tags are
+// not handled.
+constexpr int kTagLimit = DW_TAG_skeleton_unit + 1;
+constexpr uint8_t kNoTagHandler = std::numeric_limits<uint8_t>::max();
+
+// The handled tags. Entries of other tags are ignored.
+struct TagTable {
+  static constexpr std::array kHandlers = {
+    TagHandler{DW_TAG_array_type, &Processor::ProcessArray,
+               "dwarf.tag.array_type", "dwarf.tag.array_type.time"},
+    TagHandler{DW_TAG_enumeration_type, &Processor::ProcessEnum,
+               "dwarf.tag.enumeration_type", "dwarf.tag.enumeration_type.time"},
+    TagHandler{DW_TAG_class_type,
+               &Processor::ProcessStructUnion<StructUnion::Kind::STRUCT>,
+               "dwarf.tag.class_type", "dwarf.tag.class_type.time"},
+    TagHandler{DW_TAG_structure_type,
+               &Processor::ProcessStructUnion<StructUnion::Kind::STRUCT>,
+               "dwarf.tag.structure_type", "dwarf.tag.structure_type.time"},
+    TagHandler{DW_TAG_union_type,
+               &Processor::ProcessStructUnion<StructUnion::Kind::UNION>,
+               "dwarf.tag.union_type", "dwarf.tag.union_type.time"},
+    TagHandler{DW_TAG_member, &Processor::ProcessStrayMember,
+               "dwarf.tag.member", "dwarf.tag.member.time"},
+    TagHandler{DW_TAG_pointer_type,
+               &Processor::ProcessReference<PointerReference,
+                                            PointerReference::Kind::POINTER>,
+               "dwarf.tag.pointer_type", "dwarf.tag.pointer_type.time"},
+    TagHandler{DW_TAG_reference_type,
+               &Processor::ProcessReference<
+                   PointerReference, PointerReference::Kind::LVALUE_REFERENCE>,
+               "dwarf.tag.reference_type", "dwarf.tag.reference_type.time"},
+    TagHandler{DW_TAG_rvalue_reference_type,
+               &Processor::ProcessReference<
+                   PointerReference, PointerReference::Kind::RVALUE_REFERENCE>,
+               "dwarf.tag.rvalue_reference_type",
+               "dwarf.tag.rvalue_reference_type.time"},
+    TagHandler{DW_TAG_ptr_to_member_type, &Processor::ProcessPointerToMember,
+               "dwarf.tag.ptr_to_member_type",
+               "dwarf.tag.ptr_to_member_type.time"},
+    TagHandler{DW_TAG_unspecified_type, &Processor::ProcessUnspecifiedType,
+               "dwarf.tag.unspecified_type", "dwarf.tag.unspecified_type.time"},
+    TagHandler{DW_TAG_compile_unit, &Processor::ProcessAllChildren,
+               "dwarf.tag.compile_unit", "dwarf.tag.compile_unit.time"},
+    TagHandler{DW_TAG_type_unit, &Processor::ProcessAllChildren,
+               "dwarf.tag.type_unit", "dwarf.tag.type_unit.time"},
+    TagHandler{DW_TAG_typedef, &Processor::ProcessTypedef,
+               "dwarf.tag.typedef", "dwarf.tag.typedef.time"},
+    TagHandler{DW_TAG_base_type, &Processor::ProcessBaseType,
+               "dwarf.tag.base_type", "dwarf.tag.base_type.time"},
+    TagHandler{DW_TAG_const_type,
+               &Processor::ProcessReference<Qualified, Qualifier::CONST>,
+               "dwarf.tag.const_type", "dwarf.tag.const_type.time"},
+    TagHandler{DW_TAG_volatile_type,
+               &Processor::ProcessReference<Qualified, Qualifier::VOLATILE>,
+               "dwarf.tag.volatile_type", "dwarf.tag.volatile_type.time"},
+    TagHandler{DW_TAG_restrict_type,
+               &Processor::ProcessReference<Qualified, Qualifier::RESTRICT>,
+               "dwarf.tag.restrict_type", "dwarf.tag.restrict_type.time"},
+    // TODO: test pending BTF / test suite support
+    TagHandler{DW_TAG_atomic_type,
+               &Processor::ProcessReference<Qualified, Qualifier::ATOMIC>,
+               "dwarf.tag.atomic_type", "dwarf.tag.atomic_type.time"},
+    TagHandler{DW_TAG_variable, &Processor::ProcessExternalVariable,
+               "dwarf.tag.variable", "dwarf.tag.variable.time"},
+    // Standalone function type, for example, used in function pointers.
+    TagHandler{DW_TAG_subroutine_type, &Processor::ProcessFunction,
+               "dwarf.tag.subroutine_type", "dwarf.tag.subroutine_type.time"},
+    // DWARF equivalent of ELF function symbol.
+    TagHandler{DW_TAG_subprogram, &Processor::ProcessFunction,
+               "dwarf.tag.subprogram", "dwarf.tag.subprogram.time"},
+    TagHandler{DW_TAG_namespace, &Processor::ProcessNamespace,
+               "dwarf.tag.namespace", "dwarf.tag.namespace.time"},
+    TagHandler{DW_TAG_lexical_block, &Processor::ProcessLocalScope,
+               "dwarf.tag.lexical_block", "dwarf.tag.lexical_block.time"},
+  };
+
+  // Map from tag to index in kHandlers.
+  static constexpr auto kIndex = [] {
+    static_assert(kHandlers.size() < kNoTagHandler);
+    std::array<uint8_t, kTagLimit> result{};
+    result.fill(kNoTagHandler);
+    for (size_t index = 0; index < kHandlers.size(); ++index) {
+      result[kHandlers[index].tag] = index;
+    }
+    return result;
+  }();
 };
 
+// Reading the clock can cost as much as processing a small entry, so entry
+// times are sampled, whatever the metrics granularity: the first entry of each
+// tag and every kTagSampleRate-th one after are timed.
+constexpr size_t kTagSampleRate = 16;
+
+// With deduplication as types are read, passes are made once the graph has
+// grown by at least this many nodes, as well as doubled, since the last.
+constexpr size_t kDeduplicationBatch = size_t{1} << 16;
+
+void Processor::InitialiseTagMetrics() {
+  if constexpr (kOperationGranularity != Granularity::OFF) {
+    result_.tag_entries.resize(TagTable::kHandlers.size());
+    result_.tag_timed_entries.resize(TagTable::kHandlers.size());
+    result_.tag_nanoseconds.resize(TagTable::kHandlers.size());
+  }
+}
+
+void Processor::Process(Entry& entry) {
+  ++result_.processed_entries;
+  const int tag = entry.GetTag();
+  const size_t index = tag >= 0 && tag < kTagLimit ? TagTable::kIndex[tag]
+                                                   : kNoTagHandler;
+  if (index == kNoTagHandler) {
+    // TODO: die on unexpected tag, when the table contains all expected tags
+    return;
+  }
+  const auto process = TagTable::kHandlers[index].process;
+  if constexpr (kOperationGranularity != Granularity::OFF) {
+    if (result_.tag_entries[index]++ % kTagSampleRate == 0) {
+      // Times include those of nested entries.
+      const auto start = std::chrono::steady_clock::now();
+      (this->*process)(entry);
+      const auto finish = std::chrono::steady_clock::now();
+      ++result_.tag_timed_entries[index];
+      result_.tag_nanoseconds[index] +=
+          std::chrono::duration_cast<std::chrono::nanoseconds>(finish - start)
+              .count();
+      return;
+    }
+  }
+  (this->*process)(entry);
+}
+
 Types Process(Handler& dwarf, bool is_little_endian_binary,
-              const std::unique_ptr<Filter>& file_filter, Graph& graph) {
+              const std::unique_ptr<Filter>& file_filter, Graph& graph,
+              const ReadMonitor& monitor, bool hash_cons,
+              bool skip_duplicate_units) {
   Types result;
   const Id void_id = graph.Add<Special>(Special::Kind::VOID);
   const Id variadic_id = graph.Add<Special>(Special::Kind::VARIADIC);
   // TODO: Scope Processor to compilation units?
   Processor processor(graph, void_id, variadic_id, is_little_endian_binary,
-                      file_filter, result);
-  for (auto& compilation_unit : dwarf.GetCompilationUnits()) {
+                      file_filter, result, hash_cons);
+  auto compilation_units = dwarf.GetCompilationUnits();
+  const auto skip = skip_duplicate_units
+                    ? processor.FindDuplicateUnits(compilation_units)
+                    : std::vector<bool>(compilation_units.size());
+  Tracker tracker(compilation_units, monitor);
+  for (size_t index = 0; index < compilation_units.size(); ++index) {
+    auto& compilation_unit = compilation_units[index];
+    tracker.Start();
     // Could fetch top-level attributes like compiler here.
-    processor.ProcessCompilationUnit(compilation_unit);
+    if (!skip[index]) {
+      processor.ProcessCompilationUnit(compilation_unit);
+    }
+    tracker.Finish(compilation_unit);
+  }
+  processor.CheckUnresolvedIds();
+  processor.ResolveSymbolSpecifications();
+
+  return result;
+}
+
+Types ProcessDeduplicated(Handler& dwarf, size_t jobs,
+                          bool is_little_endian_binary,
+                          const std::unique_ptr<Filter>& file_filter,
+                          Graph& graph, const ReadMonitor& monitor,
+                          bool hash_cons, bool skip_duplicate_units) {
+  Types result;
+  // The nodes are built in a graph of their own, which can be compacted.
+  Graph local;
+  const Id void_id = local.Add<Special>(Special::Kind::VOID);
+  const Id variadic_id = local.Add<Special>(Special::Kind::VARIADIC);
+  Processor processor(local, void_id, variadic_id, is_little_endian_binary,
+                      file_filter, result, hash_cons);
+  auto compilation_units = dwarf.GetCompilationUnits();
+  const auto skip = skip_duplicate_units
+                    ? processor.FindDuplicateUnits(compilation_units)
+                    : std::vector<bool>(compilation_units.size());
+  Tracker tracker(compilation_units, monitor);
+  size_t next = kDeduplicationBatch;
+  for (size_t index = 0; index < compilation_units.size(); ++index) {
+    auto& compilation_unit = compilation_units[index];
+    tracker.Start();
+    if (!skip[index]) {
+      processor.ProcessCompilationUnit(compilation_unit);
+    }
+    tracker.Finish(compilation_unit);
+    if (local.Limit().ix_ >= next) {
+      processor.Deduplicate(jobs);
+      const size_t live = local.Limit().ix_;
+      next = live + std::max(live, kDeduplicationBatch);
+    }
   }
   processor.CheckUnresolvedIds();
   processor.ResolveSymbolSpecifications();
+  processor.Deduplicate(jobs);
+  processor.MoveTo(graph);
 
   return result;
 }
 
+Types Process(Handler& dwarf, const std::vector<Address>& addresses,
+              bool is_little_endian_binary,
+              const std::unique_ptr<Filter>& file_filter, Graph& graph,
+              const ReadMonitor& monitor, bool hash_cons) {
+  Types result;
+  const Id void_id = graph.Add<Special>(Special::Kind::VOID);
+  const Id variadic_id = graph.Add<Special>(Special::Kind::VARIADIC);
+  Processor processor(graph, void_id, variadic_id, is_little_endian_binary,
+                      file_filter, result, hash_cons);
+  auto compilation_units = dwarf.GetCompilationUnits();
+  const size_t count = compilation_units.size();
+  Tracker tracker(compilation_units, monitor);
+
+  std::vector<Address> wanted = addresses;
+  std::sort(wanted.begin(), wanted.end());
+  const auto is_wanted = [&](const Address& address) {
+    return std::binary_search(wanted.begin(), wanted.end(), address);
+  };
+
+  // Select the compilation units that define any wanted address, with a light
+  // pass over their top-level entries, which also finds the types each unit
+  // defines.
+  // Unit offsets, sorted, as split and type units are not in offset order.
+  std::vector<std::pair<Dwarf_Off, size_t>> offsets;
+  offsets.reserve(count);
+  std::vector<bool> selected(count);
+  std::vector<size_t> todo;
+  std::vector<Address> defined;
+  std::vector<std::string> defined_types;
+  // the units defining each named type, in unit order
+  std::unordered_map<std::string, std::vector<size_t>> definers;
+  for (size_t index = 0; index < count; ++index) {
+    auto& unit = compilation_units[index];
+    auto& entry = unit.entry;
+    offsets.emplace_back(unit.offset_base + entry.GetOffset(), index);
+    defined.clear();
+    CollectAddresses(entry, defined);
+    if (std::any_of(defined.begin(), defined.end(), is_wanted)) {
+      selected[index] = true;
+      todo.push_back(index);
+    }
+    Scope scope;
+    defined_types.clear();
+    CollectDefinedTypes(entry, scope, defined_types);
+    for (auto& name : defined_types) {
+      auto& units = definers[std::move(name)];
+      if (units.empty() || units.back() != index) {
+        units.push_back(index);
+      }
+    }
+  }
+  std::sort(offsets.begin(), offsets.end());
+
+  // Process them, then any others they refer to, until nothing is missing.
+  // Type resolution later gives each declaration the definition of the same
+  // name, so a unit defining a type that is only declared in the units
+  // processed is processed too, unless another such unit already was.
+  // Nodes of unprocessed units referred to are allocated early and only set
+  // when their unit is processed, so each node is examined once set.
+  const Id start = graph.Limit();
+  std::vector<bool> examined;
+  DeclarationName declaration_name;
+  while (!todo.empty()) {
+    for (const auto index : todo) {
+      tracker.Start();
+      processor.ProcessCompilationUnit(compilation_units[index]);
+      tracker.Finish(compilation_units[index]);
+    }
+    todo.clear();
+    examined.resize(graph.Limit().ix_ - start.ix_);
+    graph.ForEach(start, graph.Limit(), [&](Id id) {
+      const size_t ix = id.ix_ - start.ix_;
+      if (examined[ix]) {
+        return;
+      }
+      examined[ix] = true;
+      const auto name = graph.Apply<std::string_view>(declaration_name, id);
+      if (name.empty()) {
+        return;
+      }
+      const auto it = definers.find(std::string(name));
+      if (it == definers.end()) {
+        return;
+      }
+      const auto& units = it->second;
+      if (std::none_of(units.begin(), units.end(),
+                       [&](size_t index) { return selected[index]; })) {
+        selected[units.front()] = true;
+        todo.push_back(units.front());
+      }
+    });
+    for (const auto offset : processor.GetUnresolvedOffsets()) {
+      const auto it = std::upper_bound(
+          offsets.begin(), offsets.end(), offset,
+          [](Dwarf_Off offset, const std::pair<Dwarf_Off, size_t>& unit) {
+            return offset < unit.first;
+          });
+      if (it == offsets.begin()) {
+        continue;
+      }
+      const size_t index = std::prev(it)->second;
+      if (!selected[index]) {
+        selected[index] = true;
+        todo.push_back(index);
+      }
+    }
+    std::sort(todo.begin(), todo.end());
+  }
+  processor.CheckUnresolvedIds();
+  processor.ResolveSymbolSpecifications();
+
+  return result;
+}
+
+Types Process(Handler& dwarf, const HandlerFactory& make_handler, size_t jobs,
+              bool is_little_endian_binary,
+              const std::unique_ptr<Filter>& file_filter, Graph& graph,
+              const ReadMonitor& monitor) {
+  // Each additional worker needs its own Handler as libdw is not thread-safe.
+  std::vector<std::unique_ptr<Handler>> handlers(jobs);
+  std::vector<std::vector<CompilationUnit>> compilation_units(jobs);
+  compilation_units[0] = dwarf.GetCompilationUnits();
+  const size_t count = compilation_units[0].size();
+  Tracker tracker(compilation_units[0], monitor);
+
+  // Process each compilation unit into its own graph fragment.
+  struct Fragment {
+    Graph graph;
+    Types types;
+    std::optional<Processor> processor;
+  };
+  std::vector<Fragment> fragments(count);
+  ForEachIndex(jobs, count, [&](size_t worker, size_t index) {
+    tracker.Start();
+    if (worker > 0 && !handlers[worker]) {
+      handlers[worker] = make_handler();
+      compilation_units[worker] = handlers[worker]->GetCompilationUnits();
+      Check(compilation_units[worker].size() == count)
+          << "inconsistent number of compilation units";
+    }
+    auto& fragment = fragments[index];
+    const Id void_id = fragment.graph.Add<Special>(Special::Kind::VOID);
+    const Id variadic_id = fragment.graph.Add<Special>(Special::Kind::VARIADIC);
+    auto& processor = fragment.processor.emplace(
+        fragment.graph, void_id, variadic_id, is_little_endian_binary,
+        file_filter, fragment.types);
+    processor.ProcessCompilationUnit(compilation_units[worker][index]);
+    tracker.Finish(compilation_units[worker][index]);
+  });
+
+  // Stitch the fragments together, in compilation unit order.
+  Types result;
+  const Id void_id = graph.Add<Special>(Special::Kind::VOID);
+  const Id variadic_id = graph.Add<Special>(Special::Kind::VARIADIC);
+  Processor processor(graph, void_id, variadic_id, is_little_endian_binary,
+                      file_filter, result);
+  std::vector<std::vector<Id>> mappings;
+  mappings.reserve(count);
+  for (const auto& fragment : fragments) {
+    mappings.push_back(processor.AllocateFragment(*fragment.processor));
+  }
+  for (size_t index = 0; index < count; ++index) {
+    processor.MoveFragment(*fragments[index].processor, mappings[index]);
+    // release memory early
+    fragments[index].processor.reset();
+    fragments[index].graph = Graph();
+  }
+  processor.CheckUnresolvedIds();
+  processor.ResolveSymbolSpecifications();
+
+  return result;
+}
+
+void RecordTagMetrics(const Types& types, Metrics& metrics) {
+  for (size_t index = 0; index < types.tag_entries.size(); ++index) {
+    const auto entries = types.tag_entries[index];
+    if (entries == 0) {
+      continue;
+    }
+    const auto& handler = TagTable::kHandlers[index];
+    Counter(metrics, handler.entries) = entries;
+    // scale up the sampled time, the first entry is always timed
+    const double scale =
+        static_cast<double>(entries) / types.tag_timed_entries[index];
+    metrics.push_back(Metric{
+        handler.time, Nanoseconds(static_cast<uint64_t>(
+                          scale * types.tag_nanoseconds[index]))});
+  }
+  metrics.push_back(Metric{"dwarf.slowest_units", types.slowest_units});
+}
+
 }  // namespace dwarf
 }  // namespace stg
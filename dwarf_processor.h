@@ -21,6 +21,9 @@
 #define STG_DWARF_PROCESSOR_H_
 
 #include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
 #include <optional>
 #include <string>
 #include <vector>
@@ -28,6 +31,8 @@
 #include "dwarf_wrappers.h"
 #include "filter.h"
 #include "graph.h"
+#include "metrics.h"
+#include "reader_options.h"
 
 namespace stg {
 namespace dwarf {
@@ -41,15 +46,84 @@ struct Types {
   };
 
   size_t processed_entries = 0;
+  // Entries in function bodies stepped over without being processed.
+  size_t skipped_entries = 0;
+  // Number of compilation units processed.
+  size_t processed_units = 0;
+  // Number of compilation units skipped as identical to earlier ones.
+  size_t skipped_units = 0;
+  // Number of child lists iterated in place, rather than copied.
+  size_t child_ranges = 0;
+  // File filter verdicts computed and reused, at most one computation per file
+  // per compilation unit.
+  size_t file_filter_evaluations = 0;
+  size_t file_filter_hits = 0;
+  // Deduplication passes made while processing, and the nodes they removed.
+  size_t deduplication_passes = 0;
+  size_t duplicate_nodes = 0;
+  // For each handled tag: entries processed, entries timed and their total
+  // time, including nested entries. Empty if operation metrics are disabled.
+  std::vector<size_t> tag_entries;
+  std::vector<size_t> tag_timed_entries;
+  std::vector<uint64_t> tag_nanoseconds;
+  // The compilation units that took longest to process.
+  SlowItems slowest_units;
   // Container for all named type IDs allocated during DWARF processing.
   std::vector<Id> named_type_ids;
   std::vector<Symbol> symbols;
 };
 
 // Process every compilation unit from DWARF and returns processed STG along
-// with information needed for matching to ELF symbols.
+// with information needed for matching to ELF symbols. The monitor is told of
+// progress, and consulted for cancellation, between compilation units. With
+// hash-consing, entries describing identical simple types share a node. With
+// skipping of duplicate units, a compilation unit holding only types, whose
+// entries are the same as those of an earlier one, is not processed. The
+// entries of the earlier one stand in for its entries.
 Types Process(Handler& dwarf, bool is_little_endian_binary,
-              const std::unique_ptr<Filter>& file_filter, Graph& graph);
+              const std::unique_ptr<Filter>& file_filter, Graph& graph,
+              const ReadMonitor& monitor = {}, bool hash_cons = false,
+              bool skip_duplicate_units = false);
+
+// As above, but lazily, only processing the compilation units that define
+// functions or variables at the given addresses, as found by a light pass over
+// their top-level entries, and those they refer to, transitively. Types only
+// found in other compilation units are not seen. Progress may end short of the
+// totals, which count every compilation unit.
+Types Process(Handler& dwarf, const std::vector<Address>& addresses,
+              bool is_little_endian_binary,
+              const std::unique_ptr<Filter>& file_filter, Graph& graph,
+              const ReadMonitor& monitor = {}, bool hash_cons = false);
+
+// As the first, but the types are deduplicated as they are read. Whenever the
+// graph has doubled in size, after a compilation unit, the nodes that do not
+// depend on entries yet to be processed are fingerprinted and deduplicated,
+// using up to the given number of jobs, against each other and those of
+// earlier passes, and the duplicates are released. Peak memory then follows
+// the size of the deduplicated types rather than that of the DWARF.
+Types ProcessDeduplicated(Handler& dwarf, size_t jobs,
+                          bool is_little_endian_binary,
+                          const std::unique_ptr<Filter>& file_filter,
+                          Graph& graph, const ReadMonitor& monitor = {},
+                          bool hash_cons = false,
+                          bool skip_duplicate_units = false);
+
+using HandlerFactory = std::function<std::unique_ptr<Handler>()>;
+
+// As above, but process compilation units concurrently, using up to the given
+// number of jobs. The first job uses the given Handler, each other job uses its
+// own, obtained from the factory. A graph fragment is built per compilation
+// unit and the fragments are merged into the result graph, in compilation unit
+// order, once all have been processed. There is no hash-consing, as fragments
+// are merged by DWARF offset.
+Types Process(Handler& dwarf, const HandlerFactory& make_handler, size_t jobs,
+              bool is_little_endian_binary,
+              const std::unique_ptr<Filter>& file_filter, Graph& graph,
+              const ReadMonitor& monitor = {});
+
+// Records the per-tag entry counts and times of processed Types, and the
+// slowest compilation units.
+void RecordTagMetrics(const Types& types, Metrics& metrics);
 
 }  // namespace dwarf
 }  // namespace stg
@@ -24,7 +24,10 @@
 #include <elfutils/libdw.h>
 #include <elfutils/libdwfl.h>
 #include <fcntl.h>
+#include <unistd.h>
 
+#include <array>
+#include <cerrno>
 #include <cstddef>
 #include <cstdint>
 #include <ios>
@@ -32,6 +35,8 @@
 #include <optional>
 #include <ostream>
 #include <string>
+#include <string_view>
+#include <unordered_set>
 #include <utility>
 #include <vector>
 
@@ -139,6 +144,37 @@ Expression GetExpression(Dwarf_Attribute& attribute) {
   return result;
 }
 
+// The file holding the split unit of a skeleton unit, if it is named.
+std::optional<std::string> MaybeGetSplitFile(Entry& skeleton) {
+  auto name = skeleton.MaybeGetDirectString(DW_AT_dwo_name);
+  if (!name) {
+    name = skeleton.MaybeGetDirectString(DW_AT_GNU_dwo_name);
+  }
+  if (!name) {
+    return {};
+  }
+  std::string path;
+  if (!name->starts_with('/')) {
+    if (const auto directory = skeleton.MaybeGetDirectString(DW_AT_comp_dir)) {
+      path = *directory;
+      path += '/';
+    }
+  }
+  path += *name;
+  return {path};
+}
+
+// Asks the kernel to start reading a file that will be needed soon. This is
+// only a hint and failures are ignored.
+void Prefetch(const std::string& path) {
+  const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return;
+  }
+  posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+  close(fd);
+}
+
 }  // namespace
 
 Handler::Handler(const std::string& path) : dwfl_(dwfl_begin(&kDwflCallbacks)) {
@@ -165,6 +201,18 @@ Handler::Handler(char* data, size_t size) : dwfl_(dwfl_begin(&kDwflCallbacks)) {
   InitialiseDwarf();
 }
 
+Handler::Handler(int fd) : dwfl_(dwfl_begin(&kDwflCallbacks)) {
+  CheckOrDwflError(dwfl_.get(), "dwfl_begin");
+  // dwfl takes ownership of the descriptor it is given and maps it privately,
+  // so the caller's stays open and the contents are never written.
+  const int owned = dup(fd);
+  Check(owned >= 0) << "dup failed: " << Error(errno);
+  // Add data to process to dwfl
+  dwfl_module_ = dwfl_report_offline(dwfl_.get(), "<descriptor>",
+                                     "<descriptor>", owned);
+  InitialiseDwarf();
+}
+
 void Handler::InitialiseDwarf() {
   CheckOrDwflError(dwfl_.get(), "dwfl_report_offline");
   // Finish adding files to dwfl and process them
@@ -184,41 +232,109 @@ Elf* Handler::GetElf() {
 
 std::vector<CompilationUnit> Handler::GetCompilationUnits() {
   std::vector<CompilationUnit> result;
-  Dwarf_Off offset = 0;
-  while (true) {
-    Dwarf_Off next_offset;
-    size_t header_size = 0;
-    Dwarf_Half version = 0;
-    int return_code =
-        dwarf_next_unit(dwarf_, offset, &next_offset, &header_size, &version,
-                        nullptr, nullptr, nullptr, nullptr, nullptr);
-    Check(return_code == kReturnOk || return_code == kReturnNoEntry)
-        << "dwarf_next_unit returned error";
-    if (return_code == kReturnNoEntry) {
-      break;
+  std::vector<size_t> skeletons;
+  // The same type unit may be present more than once, but libdw resolves each
+  // signature to the first one, so only that one is needed.
+  std::unordered_set<uint64_t> signatures;
+  // DWARF 4 type units live in .debug_types, other units in .debug_info.
+  const auto add_units = [&](bool debug_types) {
+    Dwarf_Off offset = 0;
+    while (true) {
+      Dwarf_Off next_offset;
+      size_t header_size = 0;
+      Dwarf_Half version = 0;
+      uint64_t signature = 0;
+      const int return_code = dwarf_next_unit(
+          dwarf_, offset, &next_offset, &header_size, &version, nullptr,
+          nullptr, nullptr, debug_types ? &signature : nullptr, nullptr);
+      Check(return_code == kReturnOk || return_code == kReturnNoEntry)
+          << "dwarf_next_unit returned error";
+      if (return_code == kReturnNoEntry) {
+        break;
+      }
+      Entry entry;
+      const Dwarf_Off die_offset = offset + header_size;
+      const Dwarf_Off size = next_offset - offset;
+      Check((debug_types ? dwarf_offdie_types(dwarf_, die_offset, &entry.die)
+                         : dwarf_offdie(dwarf_, die_offset, &entry.die))
+            != nullptr)
+          << "dwarf_offdie returned error";
+      offset = next_offset;
+      uint8_t unit_type = 0;
+      uint64_t unit_id = 0;
+      Check(dwarf_cu_info(entry.die.cu, nullptr, &unit_type, nullptr, nullptr,
+                          &unit_id, nullptr, nullptr) == kReturnOk)
+          << "dwarf_cu_info returned error";
+      if (unit_type == DW_UT_type && !signatures.insert(unit_id).second) {
+        continue;
+      }
+      if (unit_type == DW_UT_skeleton) {
+        skeletons.push_back(result.size());
+      }
+      result.push_back(
+          {version, entry, debug_types ? kDebugTypesOffsetBase : 0, size});
+    }
+  };
+  add_units(false);
+  add_units(true);
+
+  // Replace each skeleton unit with the split unit it refers to. libdw finds
+  // and opens the .dwo (or .dwp) files one at a time, so first ask the kernel
+  // to start reading all the ones that can be found directly.
+  for (const auto index : skeletons) {
+    if (auto path = MaybeGetSplitFile(result[index].entry)) {
+      Prefetch(*path);
     }
-    result.push_back({version, {}});
-    Check(dwarf_offdie(dwarf_, offset + header_size, &result.back().entry.die))
-        << "dwarf_offdie returned error";
-
-    offset = next_offset;
+  }
+  for (const auto index : skeletons) {
+    auto& unit = result[index];
+    Dwarf_Die split;
+    Check(dwarf_cu_info(unit.entry.die.cu, nullptr, nullptr, nullptr, &split,
+                        nullptr, nullptr, nullptr) == kReturnOk)
+        << "dwarf_cu_info returned error";
+    if (split.addr == nullptr) {
+      // Without its split unit, the skeleton unit describes no types, but the
+      // rest of the DWARF is still usable.
+      Warn() << "split DWARF unit not found, using skeleton unit: "
+             << MaybeGetSplitFile(unit.entry).value_or("{missing}");
+      continue;
+    }
+    unit.entry.die = split;
+    // Split units use 32-bit DWARF, which leaves room for the unit index.
+    unit.offset_base = (Dwarf_Off{1} << 63) | (Dwarf_Off{index} << 32);
   }
   return result;
 }
 
-std::vector<Entry> Entry::GetChildren() {
-  Entry child;
-  int return_code = dwarf_child(&die, &child.die);
+Dwarf_Off GetOffsetBase(Entry& entry) {
+  Dwarf_Half version = 0;
+  uint8_t unit_type = 0;
+  Check(dwarf_cu_info(entry.die.cu, &version, &unit_type, nullptr, nullptr,
+                      nullptr, nullptr, nullptr) == kReturnOk)
+      << "dwarf_cu_info returned error";
+  if (unit_type == DW_UT_split_compile || unit_type == DW_UT_split_type) {
+    Die() << "unsupported reference to another split DWARF unit";
+  }
+  return unit_type == DW_UT_type && version < 5 ? kDebugTypesOffsetBase : 0;
+}
+
+Children Entry::GetChildren() {
+  return Children(*this);
+}
+
+Children::Iterator::Iterator(Entry& parent) {
+  const int return_code = dwarf_child(&parent.die, &child_.die);
   Check(return_code == kReturnOk || return_code == kReturnNoEntry)
       << "dwarf_child returned error";
-  std::vector<Entry> result;
-  while (return_code == kReturnOk) {
-    result.push_back(child);
-    return_code = dwarf_siblingof(&child.die, &child.die);
-    Check(return_code == kReturnOk || return_code == kReturnNoEntry)
-        << "dwarf_siblingof returned error";
-  }
-  return result;
+  done_ = return_code != kReturnOk;
+}
+
+Children::Iterator& Children::Iterator::operator++() {
+  const int return_code = dwarf_siblingof(&child_.die, &child_.die);
+  Check(return_code == kReturnOk || return_code == kReturnNoEntry)
+      << "dwarf_siblingof returned error";
+  done_ = return_code != kReturnOk;
+  return *this;
 }
 
 int Entry::GetTag() {
@@ -229,74 +345,38 @@ Dwarf_Off Entry::GetOffset() {
   return dwarf_dieoffset(&die);
 }
 
-std::optional<std::string> Entry::MaybeGetString(uint32_t attribute) {
-  std::optional<std::string> result;
-  auto dwarf_attribute = GetAttribute(&die, attribute);
-  if (!dwarf_attribute) {
-    return result;
-  }
-
-  const char* value = dwarf_formstring(&dwarf_attribute.value());
-  Check(value != nullptr) << "dwarf_formstring returned error";
-  result.emplace(value);
-  return result;
-}
-
-std::optional<std::string> Entry::MaybeGetDirectString(uint32_t attribute) {
-  std::optional<std::string> result;
-  auto dwarf_attribute = GetDirectAttribute(&die, attribute);
-  if (!dwarf_attribute) {
-    return result;
-  }
+namespace {
 
-  const char* value = dwarf_formstring(&dwarf_attribute.value());
+std::string_view GetString(Dwarf_Attribute& attribute) {
+  // This handles DW_FORM_strx* (via .debug_str_offsets) as well as the direct
+  // string forms and returns a pointer into libdw-owned memory.
+  const char* value = dwarf_formstring(&attribute);
   Check(value != nullptr) << "dwarf_formstring returned error";
-  result.emplace(value);
-  return result;
+  return value;
 }
 
-std::optional<uint64_t> Entry::MaybeGetUnsignedConstant(uint32_t attribute) {
-  auto dwarf_attribute = GetAttribute(&die, attribute);
-  if (!dwarf_attribute) {
-    return {};
-  }
-
+uint64_t GetUnsignedConstant(Dwarf_Attribute& attribute) {
   uint64_t value;
-  if (dwarf_formudata(&dwarf_attribute.value(), &value) != kReturnOk) {
+  if (dwarf_formudata(&attribute, &value) != kReturnOk) {
     Die() << "dwarf_formudata returned error";
   }
   return value;
 }
 
-bool Entry::GetFlag(uint32_t attribute) {
+bool GetBoolean(Dwarf_Attribute& attribute) {
   bool result = false;
-  auto dwarf_attribute = (attribute == DW_AT_declaration)
-                             ? GetDirectAttribute(&die, attribute)
-                             : GetAttribute(&die, attribute);
-  if (!dwarf_attribute) {
-    return result;
-  }
-
-  Check(dwarf_formflag(&dwarf_attribute.value(), &result) == kReturnOk)
+  Check(dwarf_formflag(&attribute, &result) == kReturnOk)
       << "dwarf_formflag returned error";
   return result;
 }
 
-std::optional<Entry> Entry::MaybeGetReference(uint32_t attribute) {
-  std::optional<Entry> result;
-  auto dwarf_attribute = GetAttribute(&die, attribute);
-  if (!dwarf_attribute) {
-    return result;
-  }
-
-  result.emplace();
-  Check(dwarf_formref_die(&dwarf_attribute.value(), &result->die))
+Entry GetReference(Dwarf_Attribute& attribute) {
+  Entry result;
+  Check(dwarf_formref_die(&attribute, &result.die))
       << "dwarf_formref_die returned error";
   return result;
 }
 
-namespace {
-
 std::optional<Address> GetAddressFromLocation(Dwarf_Attribute& attribute) {
   const auto expression = GetExpression(attribute);
 
@@ -329,38 +409,28 @@ std::optional<Address> GetAddressFromLocation(Dwarf_Attribute& attribute) {
   Die() << "Unsupported data location expression";
 }
 
-}  // namespace
-
-std::optional<Address> Entry::MaybeGetAddress(uint32_t attribute) {
-  auto dwarf_attribute = GetAttribute(&die, attribute);
-  if (!dwarf_attribute) {
-    return {};
-  }
-  if (attribute == DW_AT_location) {
-    return GetAddressFromLocation(*dwarf_attribute);
+std::optional<Address> GetAddress(Dwarf_Attribute& attribute,
+                                  uint32_t code) {
+  if (code == DW_AT_location) {
+    return GetAddressFromLocation(attribute);
   }
 
   Address address;
-  Check(dwarf_formaddr(&dwarf_attribute.value(), &address.value) == kReturnOk)
+  Check(dwarf_formaddr(&attribute, &address.value) == kReturnOk)
       << "dwarf_formaddr returned error";
   address.is_tls = false;
   return address;
 }
 
-std::optional<uint64_t> Entry::MaybeGetMemberByteOffset() {
-  auto attribute = GetAttribute(&die, DW_AT_data_member_location);
-  if (!attribute) {
-    return {};
-  }
-
+uint64_t GetMemberByteOffset(Dwarf_Attribute& attribute, Entry& entry) {
   uint64_t offset;
   // Try to interpret attribute as an unsigned integer constant
-  if (dwarf_formudata(&attribute.value(), &offset) == kReturnOk) {
+  if (dwarf_formudata(&attribute, &offset) == kReturnOk) {
     return offset;
   }
 
   // Parse location expression
-  const auto expression = GetExpression(attribute.value());
+  const auto expression = GetExpression(attribute);
 
   // Parse virtual base classes offset, which looks like this:
   //   [0] = DW_OP_dup
@@ -380,11 +450,177 @@ std::optional<uint64_t> Entry::MaybeGetMemberByteOffset() {
       expression[5].atom == DW_OP_plus) {
     const auto byte_offset = MaybeGetUnsignedOperand(expression[2]);
     if (byte_offset) {
-      return byte_offset;
+      return *byte_offset;
     }
   }
 
-  Die() << "Unsupported member offset expression, " << Hex(GetOffset());
+  Die() << "Unsupported member offset expression, " << Hex(entry.GetOffset());
+}
+
+}  // namespace
+
+std::optional<std::string_view> Entry::MaybeGetString(uint32_t attribute) {
+  auto dwarf_attribute = GetAttribute(&die, attribute);
+  if (!dwarf_attribute) {
+    return {};
+  }
+  return GetString(*dwarf_attribute);
+}
+
+std::optional<std::string_view> Entry::MaybeGetDirectString(
+    uint32_t attribute) {
+  auto dwarf_attribute = GetDirectAttribute(&die, attribute);
+  if (!dwarf_attribute) {
+    return {};
+  }
+  return GetString(*dwarf_attribute);
+}
+
+std::optional<uint64_t> Entry::MaybeGetUnsignedConstant(uint32_t attribute) {
+  auto dwarf_attribute = GetAttribute(&die, attribute);
+  if (!dwarf_attribute) {
+    return {};
+  }
+  return GetUnsignedConstant(*dwarf_attribute);
+}
+
+bool Entry::GetFlag(uint32_t attribute) {
+  auto dwarf_attribute = (attribute == DW_AT_declaration)
+                             ? GetDirectAttribute(&die, attribute)
+                             : GetAttribute(&die, attribute);
+  if (!dwarf_attribute) {
+    return false;
+  }
+  return GetBoolean(*dwarf_attribute);
+}
+
+std::optional<Entry> Entry::MaybeGetReference(uint32_t attribute) {
+  auto dwarf_attribute = GetAttribute(&die, attribute);
+  if (!dwarf_attribute) {
+    return {};
+  }
+  return {GetReference(*dwarf_attribute)};
+}
+
+std::optional<Address> Entry::MaybeGetAddress(uint32_t attribute) {
+  auto dwarf_attribute = GetAttribute(&die, attribute);
+  if (!dwarf_attribute) {
+    return {};
+  }
+  return GetAddress(*dwarf_attribute, attribute);
+}
+
+std::optional<uint64_t> Entry::MaybeGetMemberByteOffset() {
+  auto attribute = GetAttribute(&die, DW_AT_data_member_location);
+  if (!attribute) {
+    return {};
+  }
+  return GetMemberByteOffset(*attribute, *this);
+}
+
+Attributes::Attributes(Entry& entry) : entry_(entry) {
+  auto collect = [](Dwarf_Attribute* attribute, void* arg) {
+    auto& self = *static_cast<Attributes*>(arg);
+    // the indirection is noted even for attributes that are not kept, so that
+    // lookups of those still fall back to the entry referred to
+    const auto code = dwarf_whatattr(attribute);
+    if (code == DW_AT_abstract_origin || code == DW_AT_specification) {
+      self.indirect_ = true;
+    }
+    if (self.count_ == kCapacity) {
+      self.complete_ = false;
+      return static_cast<int>(DWARF_CB_OK);
+    }
+    self.attributes_[self.count_++] = *attribute;
+    return static_cast<int>(DWARF_CB_OK);
+  };
+  Check(dwarf_getattrs(&entry_.die, collect, this, 0) >= 0)
+      << "dwarf_getattrs returned error";
+}
+
+Dwarf_Off Attributes::GetOffset() {
+  return entry_.GetOffset();
+}
+
+std::optional<Dwarf_Attribute> Attributes::FindDirect(uint32_t attribute) {
+  for (size_t index = 0; index < count_; ++index) {
+    if (dwarf_whatattr(&attributes_[index]) == attribute) {
+      return {attributes_[index]};
+    }
+  }
+  if (!complete_) {
+    return GetDirectAttribute(&entry_.die, attribute);
+  }
+  return {};
+}
+
+std::optional<Dwarf_Attribute> Attributes::Find(uint32_t attribute) {
+  auto result = FindDirect(attribute);
+  if (!result && indirect_) {
+    // fall back to following DW_AT_abstract_origin and DW_AT_specification
+    result = GetAttribute(&entry_.die, attribute);
+  }
+  return result;
+}
+
+std::optional<std::string_view> Attributes::MaybeGetString(uint32_t attribute) {
+  auto dwarf_attribute = Find(attribute);
+  if (!dwarf_attribute) {
+    return {};
+  }
+  return GetString(*dwarf_attribute);
+}
+
+std::optional<std::string_view> Attributes::MaybeGetDirectString(
+    uint32_t attribute) {
+  auto dwarf_attribute = FindDirect(attribute);
+  if (!dwarf_attribute) {
+    return {};
+  }
+  return GetString(*dwarf_attribute);
+}
+
+std::optional<uint64_t> Attributes::MaybeGetUnsignedConstant(
+    uint32_t attribute) {
+  auto dwarf_attribute = Find(attribute);
+  if (!dwarf_attribute) {
+    return {};
+  }
+  return GetUnsignedConstant(*dwarf_attribute);
+}
+
+bool Attributes::GetFlag(uint32_t attribute) {
+  auto dwarf_attribute = (attribute == DW_AT_declaration)
+                             ? FindDirect(attribute)
+                             : Find(attribute);
+  if (!dwarf_attribute) {
+    return false;
+  }
+  return GetBoolean(*dwarf_attribute);
+}
+
+std::optional<Entry> Attributes::MaybeGetReference(uint32_t attribute) {
+  auto dwarf_attribute = Find(attribute);
+  if (!dwarf_attribute) {
+    return {};
+  }
+  return {GetReference(*dwarf_attribute)};
+}
+
+std::optional<Address> Attributes::MaybeGetAddress(uint32_t attribute) {
+  auto dwarf_attribute = Find(attribute);
+  if (!dwarf_attribute) {
+    return {};
+  }
+  return GetAddress(*dwarf_attribute, attribute);
+}
+
+std::optional<uint64_t> Attributes::MaybeGetMemberByteOffset() {
+  auto attribute = Find(DW_AT_data_member_location);
+  if (!attribute) {
+    return {};
+  }
+  return GetMemberByteOffset(*attribute, entry_);
 }
 
 std::optional<uint64_t> Entry::MaybeGetVtableOffset() {
@@ -442,6 +678,156 @@ std::optional<uint64_t> Entry::MaybeGetCount() {
   return {};
 }
 
+namespace {
+
+constexpr uint64_t kEndOfChildren = ~uint64_t{0};
+
+struct UnitTokeniser {
+  bool Add(Dwarf_Die& die) {
+    Push(dwarf_cuoffset(&die));
+    Push(dwarf_tag(&die));
+    if (dwarf_getattrs(&die, &UnitTokeniser::AddAttribute, this, 0) != 1
+        || !ok) {
+      return false;
+    }
+    Dwarf_Die child;
+    int return_code = dwarf_child(&die, &child);
+    while (return_code == kReturnOk) {
+      if (!Add(child)) {
+        return false;
+      }
+      return_code = dwarf_siblingof(&child, &child);
+    }
+    Check(return_code == kReturnNoEntry) << "error walking DWARF entries";
+    Push(kEndOfChildren);
+    return true;
+  }
+
+  static int AddAttribute(Dwarf_Attribute* attribute, void* tokeniser) {
+    auto& self = *static_cast<UnitTokeniser*>(tokeniser);
+    self.ok = self.Add(*attribute);
+    return self.ok ? DWARF_CB_OK : DWARF_CB_ABORT;
+  }
+
+  bool Add(Dwarf_Attribute& attribute) {
+    const unsigned int code = dwarf_whatattr(&attribute);
+    const unsigned int form = dwarf_whatform(&attribute);
+    if (code == DW_AT_location) {
+      // this may hold the address of a variable
+      return false;
+    }
+    Push(code);
+    Push(form);
+    switch (form) {
+      case DW_FORM_ref1:
+      case DW_FORM_ref2:
+      case DW_FORM_ref4:
+      case DW_FORM_ref8:
+      case DW_FORM_ref_udata:
+      case DW_FORM_ref_addr:
+      case DW_FORM_ref_sig8: {
+        Entry target;
+        Check(dwarf_formref_die(&attribute, &target.die) != nullptr)
+            << "dwarf_formref_die returned error";
+        if (target.die.cu == unit) {
+          Push(0);
+          Push(dwarf_cuoffset(&target.die));
+        } else {
+          Push(1);
+          Push(GetOffsetBase(target) + target.GetOffset());
+        }
+        return true;
+      }
+      case DW_FORM_string:
+      case DW_FORM_strp:
+      case DW_FORM_line_strp:
+      case DW_FORM_strx:
+      case DW_FORM_strx1:
+      case DW_FORM_strx2:
+      case DW_FORM_strx3:
+      case DW_FORM_strx4:
+      case DW_FORM_GNU_str_index:
+      case DW_FORM_GNU_strp_alt:
+      case DW_FORM_strp_sup:
+        PushString(GetString(attribute));
+        return true;
+      case DW_FORM_sec_offset:
+      case DW_FORM_loclistx:
+      case DW_FORM_rnglistx:
+        return true;
+      case DW_FORM_flag:
+      case DW_FORM_flag_present: {
+        bool value;
+        Check(dwarf_formflag(&attribute, &value) == kReturnOk)
+            << "dwarf_formflag returned error";
+        Push(value);
+        return true;
+      }
+      case DW_FORM_data1:
+      case DW_FORM_data2:
+      case DW_FORM_data4:
+      case DW_FORM_data8:
+      case DW_FORM_sdata:
+      case DW_FORM_udata:
+      case DW_FORM_implicit_const: {
+        Dwarf_Word value;
+        Check(dwarf_formudata(&attribute, &value) == kReturnOk)
+            << "dwarf_formudata returned error";
+        Push(value);
+        return true;
+      }
+      case DW_FORM_block:
+      case DW_FORM_block1:
+      case DW_FORM_block2:
+      case DW_FORM_block4:
+      case DW_FORM_exprloc:
+      case DW_FORM_data16: {
+        Dwarf_Block block;
+        Check(dwarf_formblock(&attribute, &block) == kReturnOk)
+            << "dwarf_formblock returned error";
+        PushString(std::string_view(reinterpret_cast<const char*>(block.data),
+                                    block.length));
+        return true;
+      }
+      default:
+        // addresses, references to supplementary files and anything unknown
+        return false;
+    }
+  }
+
+  void Push(uint64_t value) {
+    tokens.append(reinterpret_cast<const char*>(&value), sizeof(value));
+  }
+
+  // strings and blocks are held in full, after their lengths
+  void PushString(std::string_view value) {
+    Push(value.size());
+    tokens.append(value);
+  }
+
+  Dwarf_CU* unit;
+  std::string& tokens;
+  bool ok = true;
+};
+
+}  // namespace
+
+bool GetUnitTokens(CompilationUnit& unit, std::string& tokens) {
+  UnitTokeniser tokeniser{unit.entry.die.cu, tokens};
+  Dwarf_Files* files = nullptr;
+  size_t count = 0;
+  if (dwarf_getsrcfiles(&unit.entry.die, &files, &count) != kReturnOk) {
+    count = 0;
+  }
+  tokeniser.Push(count);
+  for (size_t index = 0; index < count; ++index) {
+    const char* file = dwarf_filesrc(files, index, nullptr, nullptr);
+    Check(file != nullptr) << "dwarf_filesrc returned error";
+    tokeniser.PushString(file);
+  }
+  return tokeniser.Add(unit.entry.die);
+}
+
 Files::Files(Entry& compilation_unit) {
   if (dwarf_getsrcfiles(&compilation_unit.die, &files_, &files_count_) !=
       kReturnOk) {
@@ -449,7 +835,7 @@ Files::Files(Entry& compilation_unit) {
   }
 }
 
-std::optional<std::string> Files::MaybeGetFile(Entry& entry,
+std::optional<size_t> Files::MaybeGetFileIndex(Entry& entry,
                                                uint32_t attribute) const {
   auto file_index = entry.MaybeGetUnsignedConstant(attribute);
   if (!file_index) {
@@ -460,7 +846,11 @@ std::optional<std::string> Files::MaybeGetFile(Entry& entry,
     Die() << "File index is greater than or equal files count (" << *file_index
           << " >= " << files_count_ << ")";
   }
-  const char* result = dwarf_filesrc(files_, *file_index, nullptr, nullptr);
+  return *file_index;
+}
+
+std::string Files::GetFile(size_t file_index) const {
+  const char* result = dwarf_filesrc(files_, file_index, nullptr, nullptr);
   Check(result != nullptr) << "dwarf_filesrc returned error";
   return result;
 }
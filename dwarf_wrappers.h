@@ -24,12 +24,15 @@
 #include <elfutils/libdw.h>
 #include <elfutils/libdwfl.h>
 
+#include <array>
 #include <cstddef>
 #include <cstdint>
+#include <iterator>
 #include <memory>
 #include <optional>
 #include <ostream>
 #include <string>
+#include <string_view>
 #include <tuple>
 #include <vector>
 
@@ -52,6 +55,8 @@ struct Address {
 
 std::ostream& operator<<(std::ostream& os, const Address& address);
 
+class Children;
+
 // C++ wrapper over Dwarf_Die, providing interface for its various properties.
 struct Entry {
   // All methods in libdw take Dwarf_Die by non-const pointer as libdw caches
@@ -68,14 +73,16 @@ struct Entry {
   // within one thread it is preferable to pass it by reference.
   Dwarf_Die die{};
 
-  // Get list of direct descendants of an entry in the DWARF tree.
-  std::vector<Entry> GetChildren();
+  // Get range of direct descendants of an entry in the DWARF tree.
+  Children GetChildren();
 
   // All getters are non-const as libdw may need to modify Dwarf_Die.
   int GetTag();
   Dwarf_Off GetOffset();
-  std::optional<std::string> MaybeGetString(uint32_t attribute);
-  std::optional<std::string> MaybeGetDirectString(uint32_t attribute);
+  // Strings are views of libdw-owned memory and remain valid for the lifetime
+  // of the Handler.
+  std::optional<std::string_view> MaybeGetString(uint32_t attribute);
+  std::optional<std::string_view> MaybeGetDirectString(uint32_t attribute);
   std::optional<uint64_t> MaybeGetUnsignedConstant(uint32_t attribute);
   bool GetFlag(uint32_t attribute);
   std::optional<Entry> MaybeGetReference(uint32_t attribute);
@@ -87,20 +94,147 @@ struct Entry {
   std::optional<uint64_t> MaybeGetCount();
 };
 
+// Range over the direct descendants of an entry in the DWARF tree.
+//
+// Children are visited in place, one at a time, using dwarf_child and
+// dwarf_siblingof, so no container is allocated. An iterator refers to a single
+// Entry that is updated on increment; copy it if it needs to outlive that.
+class Children {
+ public:
+  class Iterator {
+   public:
+    using iterator_category = std::input_iterator_tag;
+    using value_type = Entry;
+    using difference_type = std::ptrdiff_t;
+    using pointer = Entry*;
+    using reference = Entry&;
+
+    Iterator() = default;
+    explicit Iterator(Entry& parent);
+
+    Entry& operator*() {
+      return child_;
+    }
+    Entry* operator->() {
+      return &child_;
+    }
+    Iterator& operator++();
+    // only past-the-end iterators compare equal
+    bool operator==(const Iterator& other) const {
+      return done_ && other.done_;
+    }
+    bool operator!=(const Iterator& other) const {
+      return !(*this == other);
+    }
+
+   private:
+    Entry child_;
+    bool done_ = true;
+  };
+
+  explicit Children(Entry& parent) : parent_(parent) {}
+
+  Iterator begin() {
+    return Iterator(parent_);
+  }
+  Iterator end() {
+    return Iterator();
+  }
+  bool empty() {
+    return begin() == end();
+  }
+
+ private:
+  Entry& parent_;
+};
+
+// The attributes of an entry, decoded together.
+//
+// Each Entry getter looks up its attribute separately, walking the entry's
+// abbreviation every time. Attributes walks it once, with dwarf_getattrs, and
+// keeps what it finds. The getters have the same semantics as the Entry ones:
+// if the entry refers to another by DW_AT_abstract_origin or
+// DW_AT_specification, attributes missing from the entry itself are looked up
+// there.
+class Attributes {
+ public:
+  explicit Attributes(Entry& entry);
+
+  Dwarf_Off GetOffset();
+  std::optional<std::string_view> MaybeGetString(uint32_t attribute);
+  std::optional<std::string_view> MaybeGetDirectString(uint32_t attribute);
+  std::optional<uint64_t> MaybeGetUnsignedConstant(uint32_t attribute);
+  bool GetFlag(uint32_t attribute);
+  std::optional<Entry> MaybeGetReference(uint32_t attribute);
+  std::optional<Address> MaybeGetAddress(uint32_t attribute);
+  std::optional<uint64_t> MaybeGetMemberByteOffset();
+
+ private:
+  // enough for almost all entries; any others are looked up individually
+  static constexpr size_t kCapacity = 16;
+
+  std::optional<Dwarf_Attribute> FindDirect(uint32_t attribute);
+  std::optional<Dwarf_Attribute> Find(uint32_t attribute);
+
+  Entry& entry_;
+  std::array<Dwarf_Attribute, kCapacity> attributes_;
+  size_t count_ = 0;
+  // whether all of the entry's own attributes are in attributes_
+  bool complete_ = true;
+  // whether the entry has DW_AT_abstract_origin or DW_AT_specification
+  bool indirect_ = false;
+};
+
 // Metadata and top-level entry of a compilation unit.
+// A compilation unit or type unit.
 struct CompilationUnit {
   int version;
   Entry entry;
+  // Entry offsets are relative to the section holding them: .debug_info,
+  // .debug_types or the .debug_info of a split unit's .dwo file. Adding this
+  // base, which is zero for .debug_info, makes them unique.
+  Dwarf_Off offset_base;
+  // The number of section bytes holding the unit, including its header.
+  Dwarf_Off size;
 };
 
+// The offset base for DWARF 4 type units in .debug_types.
+inline constexpr Dwarf_Off kDebugTypesOffsetBase = Dwarf_Off{1} << 62;
+
+// The offset base of the unit holding an entry, for entries outside the unit
+// being processed. This would be an entry in a type unit, referred to by
+// signature, or one in another compilation unit.
+Dwarf_Off GetOffsetBase(Entry& entry);
+
+// Appends a canonical serialisation of the unit's entries to tokens, so that
+// units holding the same types can be recognised wherever they are.
+//
+// Each entry contributes its unit-relative offset, tag and attributes, with
+// their forms and values, followed by its children and an end marker.
+// References within the unit are unit-relative, strings and blocks are held in
+// full and the file table is included by name. Other section offsets, such as
+// those of line tables and location and range lists, are left out. Units are
+// the same exactly when their serialisations are.
+//
+// Returns false, with tokens in an unspecified state, if the unit holds
+// addresses, which could give rise to symbols, or anything else that cannot
+// be made independent of where the unit is.
+bool GetUnitTokens(CompilationUnit& unit, std::string& tokens);
+
 // C++ wrapper over libdw (DWARF library).
 //
 // Creates a "Dwarf" object from an ELF file or a memory and controls the life
 // cycle of the created objects.
+//
+// Memory must be writable, as libdwfl may modify it, for example to apply
+// relocations. A file descriptor is instead mapped copy-on-write, so it may
+// refer to read-only or shared memory, such as a memfd, without the contents
+// being copied. The descriptor is not closed.
 class Handler {
  public:
   explicit Handler(const std::string& path);
   Handler(char* data, size_t size);
+  explicit Handler(int fd);
 
   Elf* GetElf();
   std::vector<CompilationUnit> GetCompilationUnits();
@@ -124,8 +258,10 @@ class Files {
  public:
   Files() = default;
   explicit Files(Entry& compilation_unit);
-  std::optional<std::string> MaybeGetFile(Entry& entry,
+  std::optional<size_t> MaybeGetFileIndex(Entry& entry,
                                           uint32_t attribute) const;
+  std::string GetFile(size_t file_index) const;
+  size_t Size() const { return files_count_; }
 
  private:
   Dwarf_Files* files_ = nullptr;
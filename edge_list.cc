@@ -0,0 +1,260 @@
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+// -*- mode: C++ -*-
+//
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License v2.0 with LLVM Exceptions (the
+// "License"); you may not use this file except in compliance with the
+// License.  You may obtain a copy of the License at
+//
+//     https://llvm.org/LICENSE.txt
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "edge_list.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <ios>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "error.h"
+#include "flat_map.h"
+#include "graph.h"
+
+namespace stg {
+namespace edges {
+
+namespace {
+
+// The columns of the edge list, built in node order.
+struct Columns {
+  explicit Columns(const Graph& graph) : graph(graph) {}
+
+  void operator()(Id id) {
+    graph.Apply<void>(*this, id);
+    offsets.push_back(targets.size());
+  }
+
+  void Node(Kind kind, std::string_view name) {
+    kinds.push_back(kind);
+    if (name.empty()) {
+      names.push_back(kNoName);
+      return;
+    }
+    const auto [it, inserted] =
+        numbers.emplace(std::string(name), strings.size());
+    if (inserted) {
+      strings.push_back(&it->first);
+    }
+    names.push_back(it->second);
+  }
+
+  void Edge(Id id) {
+    const uint32_t target = nodes[id.ix_];
+    Check(target != kNoNode) << "edge list node refers to missing node " << id;
+    targets.push_back(target);
+  }
+
+  void Edges(const Ids& ids) {
+    for (const Id id : ids) {
+      Edge(id);
+    }
+  }
+
+  void Edges(const FlatMap<std::string, Id>& ids) {
+    for (const auto& [_, id] : ids) {
+      Edge(id);
+    }
+  }
+
+  void operator()(const Special&) {
+    Node(Kind::SPECIAL, {});
+  }
+
+  void operator()(const PointerReference& x) {
+    Node(Kind::POINTER_REFERENCE, {});
+    Edge(x.pointee_type_id);
+  }
+
+  void operator()(const PointerToMember& x) {
+    Node(Kind::POINTER_TO_MEMBER, {});
+    Edge(x.containing_type_id);
+    Edge(x.pointee_type_id);
+  }
+
+  void operator()(const Typedef& x) {
+    Node(Kind::TYPEDEF, x.name);
+    Edge(x.referred_type_id);
+  }
+
+  void operator()(const Qualified& x) {
+    Node(Kind::QUALIFIED, {});
+    Edge(x.qualified_type_id);
+  }
+
+  void operator()(const Primitive& x) {
+    Node(Kind::PRIMITIVE, x.name);
+  }
+
+  void operator()(const Array& x) {
+    Node(Kind::ARRAY, {});
+    Edge(x.element_type_id);
+  }
+
+  void operator()(const BaseClass& x) {
+    Node(Kind::BASE_CLASS, {});
+    Edge(x.type_id);
+  }
+
+  void operator()(const Method& x) {
+    Node(Kind::METHOD, x.name);
+    Edge(x.type_id);
+  }
+
+  void operator()(const Member& x) {
+    Node(Kind::MEMBER, x.name);
+    Edge(x.type_id);
+  }
+
+  void operator()(const StructUnion& x) {
+    Node(Kind::STRUCT_UNION, x.name);
+    if (x.definition) {
+      Edges(x.definition->base_classes);
+      Edges(x.definition->methods);
+      Edges(x.definition->members);
+    }
+  }
+
+  void operator()(const Enumeration& x) {
+    Node(Kind::ENUMERATION, x.name);
+    if (x.definition) {
+      Edge(x.definition->underlying_type_id);
+    }
+  }
+
+  void operator()(const Function& x) {
+    Node(Kind::FUNCTION, {});
+    Edge(x.return_type_id);
+    Edges(x.parameters);
+  }
+
+  void operator()(const ElfSymbol& x) {
+    Node(Kind::ELF_SYMBOL, VersionedSymbolName(x));
+    if (x.type_id) {
+      Edge(*x.type_id);
+    }
+  }
+
+  void operator()(const Interface& x) {
+    Node(Kind::INTERFACE, {});
+    Edges(x.symbols);
+    Edges(x.types);
+  }
+
+  static constexpr uint32_t kNoNode = UINT32_MAX;
+
+  const Graph& graph;
+  // node numbers, by graph id
+  std::vector<uint32_t> nodes;
+  std::vector<Kind> kinds;
+  std::vector<uint32_t> names;
+  std::vector<uint64_t> offsets = {0};
+  std::vector<uint32_t> targets;
+  std::unordered_map<std::string, uint32_t> numbers;
+  // in number order
+  std::vector<const std::string*> strings;
+};
+
+// Gathers little-endian fields.
+class Output {
+ public:
+  void Put(uint64_t value, size_t bytes) {
+    for (size_t ix = 0; ix < bytes; ++ix) {
+      data_.push_back(static_cast<char>(value >> (8 * ix)));
+    }
+  }
+
+  void Put(std::string_view bytes) {
+    data_.append(bytes);
+  }
+
+  void Align() {
+    data_.resize((data_.size() + 7) / 8 * 8);
+  }
+
+  void Write(std::ostream& os) const {
+    os.write(data_.data(), static_cast<std::streamsize>(data_.size()));
+  }
+
+ private:
+  std::string data_;
+};
+
+}  // namespace
+
+void Write(const Graph& graph, Id root, std::ostream& os) {
+  Columns columns(graph);
+  columns.nodes.resize(graph.Limit().ix_, Columns::kNoNode);
+  size_t count = 0;
+  graph.ForEach(Id(0), graph.Limit(), [&](Id id) {
+    columns.nodes[id.ix_] = count++;
+  });
+  Check(count < Columns::kNoNode) << "too many nodes for an edge list";
+  Check(graph.Is(root)) << "edge list root is missing";
+  columns.kinds.reserve(count);
+  columns.names.reserve(count);
+  columns.offsets.reserve(count + 1);
+  graph.ForEach(Id(0), graph.Limit(), [&](Id id) {
+    columns(id);
+  });
+
+  uint64_t string_bytes = 0;
+  for (const auto* string : columns.strings) {
+    string_bytes += string->size();
+  }
+  Output output;
+  output.Put(kMagic);
+  for (const uint64_t value :
+       {kVersion, uint64_t{count}, uint64_t{columns.targets.size()},
+        uint64_t{columns.strings.size()}, string_bytes,
+        uint64_t{columns.nodes[root.ix_]}}) {
+    output.Put(value, 8);
+  }
+  for (const auto kind : columns.kinds) {
+    output.Put(static_cast<uint64_t>(kind), 1);
+  }
+  output.Align();
+  for (const auto name : columns.names) {
+    output.Put(name, 4);
+  }
+  output.Align();
+  for (const auto offset : columns.offsets) {
+    output.Put(offset, 8);
+  }
+  for (const auto target : columns.targets) {
+    output.Put(target, 4);
+  }
+  output.Align();
+  uint64_t offset = 0;
+  output.Put(offset, 8);
+  for (const auto* string : columns.strings) {
+    offset += string->size();
+    output.Put(offset, 8);
+  }
+  for (const auto* string : columns.strings) {
+    output.Put(*string);
+  }
+  output.Write(os);
+}
+
+}  // namespace edges
+}  // namespace stg
@@ -0,0 +1,87 @@
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+// -*- mode: C++ -*-
+//
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License v2.0 with LLVM Exceptions (the
+// "License"); you may not use this file except in compliance with the
+// License.  You may obtain a copy of the License at
+//
+//     https://llvm.org/LICENSE.txt
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef STG_EDGE_LIST_H_
+#define STG_EDGE_LIST_H_
+
+#include <cstdint>
+#include <ostream>
+#include <string_view>
+
+#include "graph.h"
+
+namespace stg {
+namespace edges {
+
+// A graph exported as an edge list, for analysis by other tools, which can map
+// it and use it in place. Only the structure is kept: the kind, name and
+// children of each node.
+//
+// All fields are little-endian and each section starts at a multiple of 8
+// bytes, padded with zeros:
+//
+//   magic, format version, node count N, edge count E, string count S,
+//   string bytes B, root node - 7 x u64
+//   node kinds - N x u8, see Kind
+//   node names - N x u32, string numbers, or kNoName
+//   edge offsets - (N + 1) x u64, node n has children targets[offsets[n]] to
+//   targets[offsets[n + 1]], in compressed sparse row form
+//   edge targets - E x u32, node numbers
+//   string offsets - (S + 1) x u64, string s is bytes[offsets[s]] to
+//   bytes[offsets[s + 1]]
+//   string bytes - B x u8
+//
+// Nodes are numbered densely in graph id order and strings are numbered in
+// order of first use and stored once.
+//
+// Node names are those of typedefs, primitives, members, methods, structs,
+// unions and enums and, for ELF symbols, the versioned symbol name. The
+// children of a node are those it refers to, in order: the symbols and then
+// the types of an interface; the base classes, methods and members of a
+// struct or union; the underlying type of an enum; the return type and then
+// the parameters of a function; the containing type and then the pointee
+// type of a pointer to member; and otherwise the single type referred to.
+inline constexpr std::string_view kMagic = "STGEDGES";
+inline constexpr uint64_t kVersion = 1;
+inline constexpr uint32_t kNoName = UINT32_MAX;
+
+enum class Kind : uint8_t {
+  SPECIAL = 0,
+  POINTER_REFERENCE = 1,
+  POINTER_TO_MEMBER = 2,
+  TYPEDEF = 3,
+  QUALIFIED = 4,
+  PRIMITIVE = 5,
+  ARRAY = 6,
+  BASE_CLASS = 7,
+  METHOD = 8,
+  MEMBER = 9,
+  STRUCT_UNION = 10,
+  ENUMERATION = 11,
+  FUNCTION = 12,
+  ELF_SYMBOL = 13,
+  INTERFACE = 14,
+};
+
+// Writes every node of the graph, which should hold just the nodes reachable
+// from the root, as after deduplication.
+void Write(const Graph& graph, Id root, std::ostream& os);
+
+}  // namespace edges
+}  // namespace stg
+
+#endif  // STG_EDGE_LIST_H_
@@ -0,0 +1,130 @@
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+// -*- mode: C++ -*-
+//
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License v2.0 with LLVM Exceptions (the
+// "License"); you may not use this file except in compliance with the
+// License.  You may obtain a copy of the License at
+//
+//     https://llvm.org/LICENSE.txt
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "edge_list.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <catch2/catch.hpp>
+#include "graph.h"
+
+namespace Test {
+
+using stg::edges::Kind;
+using stg::edges::kNoName;
+
+// Reads the sections of an edge list, in order.
+struct EdgeListReader {
+  explicit EdgeListReader(const std::string& data) : data(data) {}
+
+  uint64_t Get(size_t bytes) {
+    uint64_t value = 0;
+    for (size_t ix = 0; ix < bytes; ++ix) {
+      value |= uint64_t{static_cast<unsigned char>(data.at(position++))}
+               << (8 * ix);
+    }
+    return value;
+  }
+
+  std::vector<uint64_t> Get(size_t count, size_t bytes) {
+    std::vector<uint64_t> values;
+    for (size_t ix = 0; ix < count; ++ix) {
+      values.push_back(Get(bytes));
+    }
+    return values;
+  }
+
+  void Align() {
+    while (position % 8 != 0) {
+      CHECK(data.at(position++) == 0);
+    }
+  }
+
+  const std::string& data;
+  size_t position = 0;
+};
+
+TEST_CASE("edge list") {
+  stg::Graph graph;
+  const auto int_type = graph.Add<stg::Primitive>(
+      "int", stg::Primitive::Encoding::SIGNED_INTEGER, 4);
+  const auto self = graph.Allocate();
+  const auto self_pointer = graph.Add<stg::PointerReference>(
+      stg::PointerReference::Kind::POINTER, self);
+  const auto value = graph.Add<stg::Member>("value", int_type, 0, 0);
+  const auto next = graph.Add<stg::Member>("next", self_pointer, 64, 0);
+  graph.Set<stg::StructUnion>(self, stg::StructUnion::Kind::STRUCT, "S", 16,
+                              stg::Ids{}, stg::Ids{}, stg::Ids{value, next});
+  graph.Add<stg::Typedef>("S", self);
+  const auto function = graph.Add<stg::Function>(int_type,
+                                                 stg::Ids{self_pointer});
+  const auto symbol = graph.Add<stg::ElfSymbol>(
+      "f", std::nullopt, true, stg::ElfSymbol::SymbolType::FUNCTION,
+      stg::ElfSymbol::Binding::GLOBAL, stg::ElfSymbol::Visibility::DEFAULT,
+      std::nullopt, std::nullopt, function, std::nullopt);
+  const auto root = graph.Add<stg::Interface>(
+      std::map<std::string, stg::Id>{{"f", symbol}},
+      std::map<std::string, stg::Id>{{"struct S", self}});
+
+  std::ostringstream os;
+  stg::edges::Write(graph, root, os);
+  const std::string data = os.str();
+  EdgeListReader reader(data);
+
+  CHECK(data.substr(0, 8) == stg::edges::kMagic);
+  reader.position = 8;
+  CHECK(reader.Get(8) == stg::edges::kVersion);
+  const auto nodes = reader.Get(8);
+  const auto edges = reader.Get(8);
+  const auto strings = reader.Get(8);
+  const auto string_bytes = reader.Get(8);
+  CHECK(nodes == 9);
+  CHECK(edges == 11);
+  CHECK(strings == 5);
+  CHECK(string_bytes == 14);
+  CHECK(reader.Get(8) == 8);
+
+  std::vector<uint64_t> kinds;
+  for (const auto kind : {Kind::PRIMITIVE, Kind::STRUCT_UNION,
+                          Kind::POINTER_REFERENCE, Kind::MEMBER, Kind::MEMBER,
+                          Kind::TYPEDEF, Kind::FUNCTION, Kind::ELF_SYMBOL,
+                          Kind::INTERFACE}) {
+    kinds.push_back(static_cast<uint64_t>(kind));
+  }
+  CHECK(reader.Get(nodes, 1) == kinds);
+  reader.Align();
+  // strings are shared and numbered by first use
+  CHECK(reader.Get(nodes, 4) == std::vector<uint64_t>{
+      0, 1, kNoName, 2, 3, 1, kNoName, 4, kNoName});
+  reader.Align();
+  CHECK(reader.Get(nodes + 1, 8) == std::vector<uint64_t>{
+      0, 0, 2, 3, 4, 5, 6, 8, 9, 11});
+  CHECK(reader.Get(edges, 4) == std::vector<uint64_t>{
+      3, 4, 1, 0, 2, 1, 0, 2, 6, 7, 1});
+  reader.Align();
+  CHECK(reader.Get(strings + 1, 8) == std::vector<uint64_t>{
+      0, 3, 4, 9, 13, 14});
+  CHECK(data.substr(reader.position) == "intSvaluenextf");
+}
+
+}  // namespace Test
@@ -25,11 +25,15 @@
 #include <gelf.h>
 #include <libelf.h>
 
+#include <algorithm>
+#include <bit>
 #include <cstddef>
+#include <cstdint>
 #include <cstring>
-#include <functional>
 #include <iostream>
 #include <limits>
+#include <memory>
+#include <optional>
 #include <ostream>
 #include <string>
 #include <string_view>
@@ -38,6 +42,7 @@
 
 #include "error.h"
 #include "graph.h"
+#include "parallel.h"
 
 namespace stg {
 namespace elf {
@@ -166,58 +171,6 @@ void AdjustAddress(GElf_Half machine, SymbolTableEntry& entry) {
   }
 }
 
-std::vector<Elf_Scn*> GetSectionsIf(
-    Elf* elf, const std::function<bool(const GElf_Shdr&)>& predicate) {
-  std::vector<Elf_Scn*> result;
-  Elf_Scn* section = nullptr;
-  GElf_Shdr header;
-  while ((section = elf_nextscn(elf, section)) != nullptr) {
-    Check(gelf_getshdr(section, &header) != nullptr)
-        << "could not get ELF section header";
-    if (predicate(header)) {
-      result.push_back(section);
-    }
-  }
-  return result;
-}
-
-std::vector<Elf_Scn*> GetSectionsByName(Elf* elf, const std::string& name) {
-  size_t shdr_strtab_index;
-  Check(elf_getshdrstrndx(elf, &shdr_strtab_index) == 0)
-      << "could not get ELF section header string table index";
-  return GetSectionsIf(elf, [&](const GElf_Shdr& header) {
-    const auto* section_name =
-        elf_strptr(elf, shdr_strtab_index, header.sh_name);
-    return section_name != nullptr && section_name == name;
-  });
-}
-
-Elf_Scn* MaybeGetSectionByName(Elf* elf, const std::string& name) {
-  const auto sections = GetSectionsByName(elf, name);
-  if (sections.empty()) {
-    return nullptr;
-  }
-  Check(sections.size() == 1)
-      << "multiple sections found with name '" << name << "'";
-  return sections[0];
-}
-
-Elf_Scn* GetSectionByName(Elf* elf, const std::string& name) {
-  Elf_Scn* section = MaybeGetSectionByName(elf, name);
-  Check(section != nullptr) << "no section found with name '" << name << "'";
-  return section;
-}
-
-Elf_Scn* MaybeGetSectionByType(Elf* elf, Elf64_Word type) {
-  auto sections = GetSectionsIf(
-      elf, [&](const GElf_Shdr& header) { return header.sh_type == type; });
-  if (sections.empty()) {
-    return nullptr;
-  }
-  Check(sections.size() == 1) << "multiple sections found with type " << type;
-  return sections[0];
-}
-
 Elf_Scn* GetSectionByIndex(Elf* elf, size_t index) {
   Elf_Scn* section = elf_getscn(elf, index);
   Check(section != nullptr) << "no section found with index " << index;
@@ -246,47 +199,49 @@ size_t GetNumberOfEntries(const GElf_Shdr& section_header) {
   return section_header.sh_size / section_header.sh_entsize;
 }
 
-std::string_view GetString(Elf* elf, uint32_t section, size_t offset) {
-  const auto name = elf_strptr(elf, section, offset);
-
-  Check(name != nullptr) << "string was not found (section: " << section
-                         << ", offset: " << offset << ")";
-  return name;
-}
-
-Elf_Scn* GetSymbolTableSection(Elf* elf, bool is_linux_kernel_binary,
-                               bool verbose) {
-  GElf_Ehdr elf_header;
-  Check(gelf_getehdr(elf, &elf_header) != nullptr)
-      << "could not get ELF header";
-
-  if (verbose) {
-    std::cout << "ELF type: " << ElfHeaderTypeToString(elf_header.e_type)
-              << '\n';
+// Looks up strings in a string table section. If the table is a single,
+// NUL-terminated block of data, strings are found directly in it with just a
+// bounds check, otherwise through elf_strptr.
+class StringTable {
+ public:
+  StringTable(Elf* elf, size_t section) : elf_(elf), section_(section) {
+    Elf_Scn* scn = elf_getscn(elf, section);
+    GElf_Shdr header;
+    if (scn == nullptr || gelf_getshdr(scn, &header) == nullptr) {
+      return;
+    }
+    Elf_Data* data = elf_getdata(scn, nullptr);
+    if (header.sh_type == SHT_STRTAB && data != nullptr &&
+        data->d_buf != nullptr && data->d_size > 0 &&
+        data->d_size == header.sh_size && elf_getdata(scn, data) == nullptr) {
+      const auto* begin = static_cast<const char*>(data->d_buf);
+      if (begin[data->d_size - 1] == '\0') {
+        begin_ = begin;
+        size_ = data->d_size;
+      }
+    }
   }
 
-  Elf_Scn* symtab = MaybeGetSectionByType(elf, SHT_SYMTAB);
-  Elf_Scn* dynsym = MaybeGetSectionByType(elf, SHT_DYNSYM);
-  if (symtab != nullptr && dynsym != nullptr) {
-    // Relocatable ELF binaries, Linux kernel and modules have their
-    // exported symbols in .symtab, all other ELF types have their
-    // exported symbols in .dynsym.
-    if (elf_header.e_type == ET_REL || is_linux_kernel_binary) {
-      return symtab;
+  std::string_view operator[](size_t offset) const {
+    const char* name = nullptr;
+    if (begin_ != nullptr) {
+      if (offset < size_) {
+        name = begin_ + offset;
+      }
+    } else {
+      name = elf_strptr(elf_, section_, offset);
     }
-    if (elf_header.e_type == ET_DYN || elf_header.e_type == ET_EXEC) {
-      return dynsym;
-    }
-    Die() << "unsupported ELF type: '"
-          << ElfHeaderTypeToString(elf_header.e_type) << "'";
-  } else if (symtab != nullptr) {
-    return symtab;
-  } else if (dynsym != nullptr) {
-    return dynsym;
-  } else {
-    Die() << "no ELF symbol table found";
+    Check(name != nullptr) << "string was not found (section: " << section_
+                           << ", offset: " << offset << ")";
+    return name;
   }
-}
+
+ private:
+  Elf* elf_;
+  size_t section_;
+  const char* begin_ = nullptr;
+  size_t size_ = 0;
+};
 
 
 constexpr std::string_view kCFISuffix = ".cfi";
@@ -308,6 +263,20 @@ std::string_view UnwrapCFISymbolName(std::string_view cfi_name) {
 
 namespace {
 
+// Returns the symbol table as an array, if libelf holds it in memory as
+// ELF64 symbols. libelf has already converted the data to the native byte
+// order, and will not have copied it at all for a native mapped file.
+const Elf64_Sym* GetNativeSymbols(Elf* elf, const GElf_Shdr& header,
+                                  const Elf_Data* data, size_t count) {
+  if (gelf_getclass(elf) != ELFCLASS64 || data->d_type != ELF_T_SYM ||
+      header.sh_entsize != sizeof(Elf64_Sym) || data->d_buf == nullptr ||
+      data->d_size < count * sizeof(Elf64_Sym) ||
+      reinterpret_cast<uintptr_t>(data->d_buf) % alignof(Elf64_Sym) != 0) {
+    return nullptr;
+  }
+  return static_cast<const Elf64_Sym*>(data->d_buf);
+}
+
 std::vector<SymbolTableEntry> GetSymbols(
     Elf* elf, Elf_Scn* symbol_table_section, bool cfi) {
   const auto machine = GetMachine(elf);
@@ -315,6 +284,10 @@ std::vector<SymbolTableEntry> GetSymbols(
       GetSectionInfo(symbol_table_section);
   const size_t number_of_symbols = GetNumberOfEntries(symbol_table_header);
 
+  const StringTable strings(elf, symbol_table_header.sh_link);
+  const Elf64_Sym* native_symbols = GetNativeSymbols(
+      elf, symbol_table_header, symbol_table_data, number_of_symbols);
+
   std::vector<SymbolTableEntry> result;
   result.reserve(number_of_symbols);
 
@@ -322,26 +295,29 @@ std::vector<SymbolTableEntry> GetSymbols(
   Check(number_of_symbols <= std::numeric_limits<int>::max())
       << "number of symbols exceeds INT_MAX";
   for (size_t i = 0; i < number_of_symbols; ++i) {
-    GElf_Sym symbol;
-    Check(gelf_getsym(symbol_table_data, static_cast<int>(i), &symbol) !=
-          nullptr)
-        << "symbol (i = " << i << ") was not found";
+    GElf_Sym copy;
+    const GElf_Sym* symbol;
+    if (native_symbols != nullptr) {
+      symbol = &native_symbols[i];
+    } else {
+      symbol = gelf_getsym(symbol_table_data, static_cast<int>(i), &copy);
+      Check(symbol != nullptr) << "symbol (i = " << i << ") was not found";
+    }
 
-    const auto name =
-        GetString(elf, symbol_table_header.sh_link, symbol.st_name);
+    const auto name = strings[symbol->st_name];
     if (cfi != IsCFISymbolName(name)) {
       continue;
     }
     SymbolTableEntry entry{
         .name = name,
-        .value = symbol.st_value,
-        .size = symbol.st_size,
-        .symbol_type = ParseSymbolType(GELF_ST_TYPE(symbol.st_info)),
-        .binding = ParseSymbolBinding(GELF_ST_BIND(symbol.st_info)),
+        .value = symbol->st_value,
+        .size = symbol->st_size,
+        .symbol_type = ParseSymbolType(GELF_ST_TYPE(symbol->st_info)),
+        .binding = ParseSymbolBinding(GELF_ST_BIND(symbol->st_info)),
         .visibility =
-            ParseSymbolVisibility(GELF_ST_VISIBILITY(symbol.st_other)),
-        .section_index = symbol.st_shndx,
-        .value_type = ParseSymbolValueType(symbol.st_shndx),
+            ParseSymbolVisibility(GELF_ST_VISIBILITY(symbol->st_other)),
+        .section_index = symbol->st_shndx,
+        .value_type = ParseSymbolValueType(symbol->st_shndx),
     };
     AdjustAddress(machine, entry);
     result.push_back(entry);
@@ -350,23 +326,6 @@ std::vector<SymbolTableEntry> GetSymbols(
   return result;
 }
 
-bool IsLinuxKernelBinary(Elf* elf) {
-  // The Linux kernel itself has many specific sections that are sufficient to
-  // classify a binary as kernel binary if present, `__ksymtab_strings` is one
-  // of them. It is present if a kernel binary (vmlinux or a module) exports
-  // symbols via the EXPORT_SYMBOL_* macros and it contains symbol names and
-  // namespaces which form part of the ABI.
-  //
-  // Kernel modules might not present a `__ksymtab_strings` section if they do
-  // not export symbols themselves via the ksymtab. Yet they can be identified
-  // by the presence of the `.modinfo` section. Since that is somewhat a generic
-  // name, also check for the presence of `.gnu.linkonce.this_module` to get
-  // solid signal as both of those sections are present in kernel modules.
-  return MaybeGetSectionByName(elf, "__ksymtab_strings") != nullptr ||
-         (MaybeGetSectionByName(elf, ".modinfo") != nullptr &&
-          MaybeGetSectionByName(elf, ".gnu.linkonce.this_module") != nullptr);
-}
-
 bool IsRelocatable(Elf* elf) {
   GElf_Ehdr elf_header;
   Check(gelf_getehdr(elf, &elf_header) != nullptr)
@@ -436,13 +395,108 @@ ElfLoader::ElfLoader(Elf* elf, bool verbose)
 }
 
 void ElfLoader::InitializeElfInformation() {
-  is_linux_kernel_binary_ = elf::IsLinuxKernelBinary(elf_);
+  IndexSections();
+  // The Linux kernel itself has many specific sections that are sufficient to
+  // classify a binary as kernel binary if present, `__ksymtab_strings` is one
+  // of them. It is present if a kernel binary (vmlinux or a module) exports
+  // symbols via the EXPORT_SYMBOL_* macros and it contains symbol names and
+  // namespaces which form part of the ABI.
+  //
+  // Kernel modules might not present a `__ksymtab_strings` section if they do
+  // not export symbols themselves via the ksymtab. Yet they can be identified
+  // by the presence of the `.modinfo` section. Since that is somewhat a generic
+  // name, also check for the presence of `.gnu.linkonce.this_module` to get
+  // solid signal as both of those sections are present in kernel modules.
+  is_linux_kernel_binary_ =
+      MaybeGetSectionByName("__ksymtab_strings") != nullptr ||
+      (MaybeGetSectionByName(".modinfo") != nullptr &&
+       MaybeGetSectionByName(".gnu.linkonce.this_module") != nullptr);
   is_relocatable_ = elf::IsRelocatable(elf_);
   is_little_endian_binary_ = elf::IsLittleEndianBinary(elf_);
 }
 
+void ElfLoader::IndexSections() {
+  size_t shdr_strtab_index;
+  Check(elf_getshdrstrndx(elf_, &shdr_strtab_index) == 0)
+      << "could not get ELF section header string table index";
+  const auto add = [](Sections& sections, Elf_Scn* section) {
+    if (sections.count++ == 0) {
+      sections.first = section;
+    }
+  };
+  Elf_Scn* section = nullptr;
+  GElf_Shdr header;
+  while ((section = elf_nextscn(elf_, section)) != nullptr) {
+    Check(gelf_getshdr(section, &header) != nullptr)
+        << "could not get ELF section header";
+    const auto* name = elf_strptr(elf_, shdr_strtab_index, header.sh_name);
+    if (name != nullptr) {
+      add(sections_by_name_[name], section);
+    }
+    add(sections_by_type_[header.sh_type], section);
+  }
+}
+
+Elf_Scn* ElfLoader::MaybeGetSectionByName(std::string_view name) const {
+  const auto it = sections_by_name_.find(name);
+  if (it == sections_by_name_.end()) {
+    return nullptr;
+  }
+  Check(it->second.count == 1)
+      << "multiple sections found with name '" << name << "'";
+  return it->second.first;
+}
+
+Elf_Scn* ElfLoader::GetSectionByName(std::string_view name) const {
+  Elf_Scn* section = MaybeGetSectionByName(name);
+  Check(section != nullptr) << "no section found with name '" << name << "'";
+  return section;
+}
+
+Elf_Scn* ElfLoader::MaybeGetSectionByType(Elf64_Word type) const {
+  const auto it = sections_by_type_.find(type);
+  if (it == sections_by_type_.end()) {
+    return nullptr;
+  }
+  Check(it->second.count == 1) << "multiple sections found with type " << type;
+  return it->second.first;
+}
+
+Elf_Scn* ElfLoader::GetSymbolTableSection() const {
+  GElf_Ehdr elf_header;
+  Check(gelf_getehdr(elf_, &elf_header) != nullptr)
+      << "could not get ELF header";
+
+  if (verbose_) {
+    std::cout << "ELF type: " << ElfHeaderTypeToString(elf_header.e_type)
+              << '\n';
+  }
+
+  Elf_Scn* symtab = MaybeGetSectionByType(SHT_SYMTAB);
+  Elf_Scn* dynsym = MaybeGetSectionByType(SHT_DYNSYM);
+  if (symtab != nullptr && dynsym != nullptr) {
+    // Relocatable ELF binaries, Linux kernel and modules have their
+    // exported symbols in .symtab, all other ELF types have their
+    // exported symbols in .dynsym.
+    if (elf_header.e_type == ET_REL || is_linux_kernel_binary_) {
+      return symtab;
+    }
+    if (elf_header.e_type == ET_DYN || elf_header.e_type == ET_EXEC) {
+      return dynsym;
+    }
+    Die() << "unsupported ELF type: '"
+          << ElfHeaderTypeToString(elf_header.e_type) << "'";
+  } else if (symtab != nullptr) {
+    return symtab;
+  } else if (dynsym != nullptr) {
+    return dynsym;
+  } else {
+    Die() << "no ELF symbol table found";
+  }
+}
+
 std::string_view ElfLoader::GetBtfRawData() const {
-  Elf_Scn* btf_section = GetSectionByName(elf_, ".BTF");
+  Elf_Scn* btf_section = GetSectionByName(".BTF");
   Check(btf_section != nullptr) << ".BTF section is invalid";
   Elf_Data* elf_data = elf_rawdata(btf_section, nullptr);
   Check(elf_data != nullptr) << ".BTF section data is invalid";
@@ -452,8 +506,7 @@ std::string_view ElfLoader::GetBtfRawData() const {
 }
 
 std::vector<SymbolTableEntry> ElfLoader::GetElfSymbols() const {
-  Elf_Scn* symbol_table_section =
-      GetSymbolTableSection(elf_, is_linux_kernel_binary_, verbose_);
+  Elf_Scn* symbol_table_section = GetSymbolTableSection();
   Check(symbol_table_section != nullptr)
       << "failed to find symbol table section";
 
@@ -462,7 +515,7 @@ std::vector<SymbolTableEntry> ElfLoader::GetElfSymbols() const {
 
 std::vector<SymbolTableEntry> ElfLoader::GetCFISymbols() const {
   // CFI symbols may be only in .symtab
-  Elf_Scn* symbol_table_section = MaybeGetSectionByType(elf_, SHT_SYMTAB);
+  Elf_Scn* symbol_table_section = MaybeGetSectionByType(SHT_SYMTAB);
   if (symbol_table_section == nullptr) {
     // It is possible for ET_DYN and ET_EXEC ELF binaries to not have .symtab,
     // because it was trimmed away. We can't determine whether there were CFI
@@ -553,5 +606,187 @@ bool ElfLoader::IsLittleEndianBinary() const {
   return is_little_endian_binary_;
 }
 
+namespace {
+
+struct ElfDeleter {
+  void operator()(Elf* elf) {
+    elf_end(elf);
+  }
+};
+
+// libelf only reads the image, but wants a mutable pointer to it.
+std::unique_ptr<Elf, ElfDeleter> OpenImage(std::string_view image) {
+  Check(elf_version(EV_CURRENT) != EV_NONE) << "ELF version mismatch";
+  std::unique_ptr<Elf, ElfDeleter> elf(
+      elf_memory(const_cast<char*>(image.data()), image.size()));
+  Check(elf != nullptr) << "elf_memory returned error: " << elf_errmsg(-1);
+  return elf;
+}
+
+template <typename Shdr>
+void UpdateSectionHeader(char* header, uint64_t offset, uint64_t size,
+                         uint64_t alignment) {
+  Shdr shdr;
+  std::memcpy(&shdr, header, sizeof(shdr));
+  shdr.sh_offset = offset;
+  shdr.sh_size = size;
+  shdr.sh_flags &= ~static_cast<decltype(shdr.sh_flags)>(SHF_COMPRESSED);
+  shdr.sh_addralign = alignment;
+  std::memcpy(header, &shdr, sizeof(shdr));
+}
+
+template <typename Ehdr>
+void UpdateSectionHeaderOffset(char* header, uint64_t offset) {
+  Ehdr ehdr;
+  std::memcpy(&ehdr, header, sizeof(ehdr));
+  ehdr.e_shoff = offset;
+  std::memcpy(header, &ehdr, sizeof(ehdr));
+}
+
+uint64_t AlignUp(uint64_t value, uint64_t alignment) {
+  return alignment > 1 ? (value + alignment - 1) / alignment * alignment
+                       : value;
+}
+
+}  // namespace
+
+std::vector<char> DecompressDebugSections(std::string_view image,
+                                          size_t jobs) {
+  const auto elf = OpenImage(image);
+  GElf_Ehdr ehdr;
+  Check(gelf_getehdr(elf.get(), &ehdr) != nullptr)
+      << "gelf_getehdr returned error: " << elf_errmsg(-1);
+  const bool is_little_endian = ehdr.e_ident[EI_DATA] == ELFDATA2LSB;
+  if (is_little_endian != (std::endian::native == std::endian::little)
+      || ehdr.e_type == ET_REL) {
+    return {};
+  }
+  size_t shstrndx;
+  Check(elf_getshdrstrndx(elf.get(), &shstrndx) == 0)
+      << "elf_getshdrstrndx returned error: " << elf_errmsg(-1);
+  size_t shnum;
+  Check(elf_getshdrnum(elf.get(), &shnum) == 0)
+      << "elf_getshdrnum returned error: " << elf_errmsg(-1);
+
+  struct Section {
+    size_t index;
+    uint64_t compressed_size;
+    std::vector<char> contents;
+    uint64_t alignment = 0;
+    uint64_t offset = 0;
+    uint64_t size = 0;
+  };
+  std::vector<Section> sections;
+  for (Elf_Scn* scn = elf_nextscn(elf.get(), nullptr); scn != nullptr;
+       scn = elf_nextscn(elf.get(), scn)) {
+    GElf_Shdr shdr;
+    Check(gelf_getshdr(scn, &shdr) != nullptr)
+        << "gelf_getshdr returned error: " << elf_errmsg(-1);
+    if ((shdr.sh_flags & SHF_COMPRESSED) == 0 || shdr.sh_type == SHT_NOBITS) {
+      continue;
+    }
+    const char* name = elf_strptr(elf.get(), shstrndx, shdr.sh_name);
+    if (name != nullptr && std::string_view(name).starts_with(".debug_")) {
+      sections.push_back({elf_ndxscn(scn), shdr.sh_size, {}});
+    }
+  }
+  if (sections.empty()) {
+    return {};
+  }
+  std::sort(sections.begin(), sections.end(),
+            [](const Section& a, const Section& b) {
+              return a.compressed_size > b.compressed_size;
+            });
+
+  // libelf may update the headers of the sections it decompresses in place,
+  // so the workers share a private copy of the image, each with its own handle.
+  std::vector<char> result(image.begin(), image.end());
+  const std::string_view copy(result.data(), result.size());
+  std::vector<std::unique_ptr<Elf, ElfDeleter>> handles(jobs);
+  ForEachIndex(jobs, sections.size(), [&](size_t worker, size_t index) {
+    auto& handle = handles[worker];
+    if (!handle) {
+      handle = OpenImage(copy);
+    }
+    auto& section = sections[index];
+    Elf_Scn* scn = elf_getscn(handle.get(), section.index);
+    Check(scn != nullptr) << "elf_getscn returned error: " << elf_errmsg(-1);
+    Check(elf_compress(scn, 0, 0) == 1)
+        << "elf_compress returned error: " << elf_errmsg(-1);
+    GElf_Shdr shdr;
+    Check(gelf_getshdr(scn, &shdr) != nullptr)
+        << "gelf_getshdr returned error: " << elf_errmsg(-1);
+    const Elf_Data* data = elf_getdata(scn, nullptr);
+    Check(data != nullptr) << "elf_getdata returned error: " << elf_errmsg(-1);
+    const char* bytes = static_cast<const char*>(data->d_buf);
+    section.contents.assign(bytes, bytes + data->d_size);
+    section.alignment = shdr.sh_addralign;
+  });
+  handles.clear();
+
+  // Append the contents, then the section header table, and refer to them.
+  for (auto& section : sections) {
+    result.resize(AlignUp(result.size(), section.alignment));
+    section.offset = result.size();
+    section.size = section.contents.size();
+    result.insert(result.end(), section.contents.begin(),
+                  section.contents.end());
+    section.contents = {};
+  }
+  const bool is_64 = gelf_getclass(elf.get()) == ELFCLASS64;
+  const size_t shentsize = is_64 ? sizeof(Elf64_Shdr) : sizeof(Elf32_Shdr);
+  result.resize(AlignUp(result.size(), 8));
+  const uint64_t shoff = result.size();
+  const auto table = image.substr(ehdr.e_shoff, shnum * shentsize);
+  Check(table.size() == shnum * shentsize) << "truncated section headers";
+  result.insert(result.end(), table.begin(), table.end());
+  for (const auto& section : sections) {
+    char* header = result.data() + shoff + section.index * shentsize;
+    if (is_64) {
+      UpdateSectionHeader<Elf64_Shdr>(header, section.offset, section.size,
+                                      section.alignment);
+    } else {
+      UpdateSectionHeader<Elf32_Shdr>(header, section.offset, section.size,
+                                      section.alignment);
+    }
+  }
+  if (is_64) {
+    UpdateSectionHeaderOffset<Elf64_Ehdr>(result.data(), shoff);
+  } else {
+    UpdateSectionHeaderOffset<Elf32_Ehdr>(result.data(), shoff);
+  }
+  return result;
+}
+
+std::optional<std::vector<ArchiveMember>> GetArchiveMembers(
+    std::string_view image) {
+  const auto archive = OpenImage(image);
+  if (elf_kind(archive.get()) != ELF_K_AR) {
+    return {};
+  }
+  std::vector<ArchiveMember> members;
+  Elf_Cmd command = ELF_C_READ_MMAP;
+  while (command != ELF_C_NULL) {
+    const std::unique_ptr<Elf, ElfDeleter> member(
+        elf_begin(-1, command, archive.get()));
+    if (!member) {
+      break;
+    }
+    if (elf_kind(member.get()) == ELF_K_ELF) {
+      const Elf_Arhdr* header = elf_getarhdr(member.get());
+      Check(header != nullptr)
+          << "elf_getarhdr returned error: " << elf_errmsg(-1);
+      size_t size;
+      const char* contents = elf_rawfile(member.get(), &size);
+      Check(contents != nullptr)
+          << "elf_rawfile returned error: " << elf_errmsg(-1);
+      members.emplace_back(header->ar_name, std::string_view(contents, size));
+    }
+    // this moves on the archive, and its current header, to the next member
+    command = elf_next(member.get());
+  }
+  return {std::move(members)};
+}
+
 }  // namespace elf
 }  // namespace stg
@@ -25,9 +25,11 @@
 #include <cstddef>
 #include <cstdint>
 #include <memory>
+#include <optional>
 #include <ostream>
 #include <string>
 #include <string_view>
+#include <unordered_map>
 #include <vector>
 
 #include "graph.h"
@@ -87,15 +89,52 @@ class ElfLoader final {
   bool IsLittleEndianBinary() const;
 
  private:
+  // The first section with a given name or type and how many there are.
+  struct Sections {
+    Elf_Scn* first = nullptr;
+    size_t count = 0;
+  };
+
   void InitializeElfInformation();
+  void IndexSections();
+  Elf_Scn* MaybeGetSectionByName(std::string_view name) const;
+  Elf_Scn* GetSectionByName(std::string_view name) const;
+  Elf_Scn* MaybeGetSectionByType(Elf64_Word type) const;
+  Elf_Scn* GetSymbolTableSection() const;
 
   const bool verbose_;
   Elf* elf_;
+  // libelf can only find sections by name or type with a linear search, so
+  // these are indexed once. Names point into the section header string table.
+  std::unordered_map<std::string_view, Sections> sections_by_name_;
+  std::unordered_map<Elf64_Word, Sections> sections_by_type_;
   bool is_linux_kernel_binary_;
   bool is_relocatable_;
   bool is_little_endian_binary_;
 };
 
+// Returns a copy of an ELF image with its compressed debug sections
+// decompressed, using up to the given number of threads, each decompressing
+// whole sections, largest first. The decompressed contents follow the original
+// ones and are followed by a new section header table that refers to them.
+// Returns an empty vector if there is nothing to decompress, if the image is
+// not in the native byte order or if it is relocatable, as libdwfl applies
+// relocations to the image in place.
+std::vector<char> DecompressDebugSections(std::string_view image,
+                                          size_t jobs);
+
+// A member of an ar archive: its name and its contents within the archive.
+struct ArchiveMember {
+  std::string name;
+  std::string_view image;
+};
+
+// Returns the ELF members of an ar archive image, in archive order, or nothing
+// if the image is not an ar archive. Other members, such as symbol indexes, are
+// skipped. The member contents point into the image.
+std::optional<std::vector<ArchiveMember>> GetArchiveMembers(
+    std::string_view image);
+
 }  // namespace elf
 }  // namespace stg
 
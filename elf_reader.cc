@@ -19,6 +19,11 @@
 
 #include "elf_reader.h"
 
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
 #include <cstddef>
 #include <functional>
 #include <iomanip>
@@ -27,8 +32,10 @@
 #include <map>
 #include <memory>
 #include <optional>
+#include <span>
 #include <string>
 #include <string_view>
+#include <tuple>
 #include <utility>
 #include <vector>
 
@@ -36,9 +43,12 @@
 #include "dwarf_wrappers.h"
 #include "elf_loader.h"
 #include "error.h"
+#include "file_descriptor.h"
 #include "filter.h"
+#include "flat_map.h"
 #include "graph.h"
 #include "metrics.h"
+#include "parallel.h"
 #include "reader_options.h"
 #include "type_normalisation.h"
 #include "type_resolution.h"
@@ -48,19 +58,6 @@ namespace stg {
 namespace elf {
 namespace internal {
 
-namespace {
-
-template <typename M, typename K>
-std::optional<typename M::mapped_type> MaybeGet(const M& map, const K& key) {
-  const auto it = map.find(key);
-  if (it == map.end()) {
-    return {};
-  }
-  return {it->second};
-}
-
-}  // namespace
-
 ElfSymbol::SymbolType ConvertSymbolType(
     SymbolTableEntry::SymbolType symbol_type) {
   switch (symbol_type) {
@@ -79,76 +76,116 @@ ElfSymbol::SymbolType ConvertSymbolType(
   }
 }
 
-SymbolNameList GetKsymtabSymbols(const SymbolTable& symbols) {
-  constexpr std::string_view kKsymtabPrefix = "__ksymtab_";
-  SymbolNameList result;
-  result.reserve(symbols.size() / 2);
-  for (const auto& symbol : symbols) {
-    if (symbol.name.substr(0, kKsymtabPrefix.size()) == kKsymtabPrefix) {
-      result.emplace(symbol.name.substr(kKsymtabPrefix.size()));
-    }
-  }
-  return result;
-}
-
-CRCValuesMap GetCRCValuesMap(const SymbolTable& symbols, const ElfLoader& elf) {
-  constexpr std::string_view kCRCPrefix = "__crc_";
-
-  CRCValuesMap crc_values;
-
+ExportSymbols GetExportSymbols(const SymbolTable& symbols) {
+  constexpr std::pair<std::string_view, ExportSymbol::Kind> kPrefixes[] = {
+      {"__ksymtab_", ExportSymbol::Kind::KSYMTAB},
+      {"__crc_", ExportSymbol::Kind::CRC},
+      {"__kstrtabns_", ExportSymbol::Kind::NAMESPACE},
+  };
+  ExportSymbols result;
   for (const auto& symbol : symbols) {
     const std::string_view name = symbol.name;
-    if (name.substr(0, kCRCPrefix.size()) == kCRCPrefix) {
-      std::string_view name_suffix = name.substr(kCRCPrefix.size());
-      if (!crc_values.emplace(name_suffix, elf.GetElfSymbolCRC(symbol))
-               .second) {
-        Die() << "Multiple CRC values for symbol '" << name_suffix << '\'';
+    if (!name.starts_with("__")) {
+      continue;
+    }
+    for (const auto& [prefix, kind] : kPrefixes) {
+      if (name.starts_with(prefix)) {
+        result.push_back({name.substr(prefix.size()), kind, &symbol});
+        break;
       }
     }
   }
-
-  return crc_values;
+  std::stable_sort(result.begin(), result.end(),
+                   [](const ExportSymbol& lhs, const ExportSymbol& rhs) {
+                     return std::make_pair(lhs.name, lhs.kind)
+                         < std::make_pair(rhs.name, rhs.kind);
+                   });
+  return result;
 }
 
-NamespacesMap GetNamespacesMap(const SymbolTable& symbols,
-                               const ElfLoader& elf) {
-  constexpr std::string_view kNSPrefix = "__kstrtabns_";
-
-  NamespacesMap namespaces;
-
-  for (const auto& symbol : symbols) {
-    const std::string_view name = symbol.name;
-    if (name.substr(0, kNSPrefix.size()) == kNSPrefix) {
-      const std::string_view name_suffix = name.substr(kNSPrefix.size());
-      const std::string_view ns = elf.GetElfSymbolNamespace(symbol);
-      if (ns.empty()) {
-        // The global namespace is explicitly represented as the empty string,
-        // but the common interpretation is that such symbols lack an export
-        // namespace.
-        continue;
+Exports GetExports(const ExportSymbols& export_symbols, const ElfLoader& elf) {
+  Exports result;
+  for (const auto& [name, kind, symbol] : export_symbols) {
+    if (result.empty() || result.back().name != name) {
+      result.push_back({name, false, {}, {}});
+    }
+    auto& entry = result.back();
+    switch (kind) {
+      case ExportSymbol::Kind::KSYMTAB: {
+        entry.ksymtab = true;
+        break;
+      }
+      case ExportSymbol::Kind::CRC: {
+        const auto crc = elf.GetElfSymbolCRC(*symbol);
+        if (entry.crc) {
+          Die() << "Multiple CRC values for symbol '" << name << '\'';
+        }
+        entry.crc = crc;
+        break;
       }
-      if (!namespaces.emplace(name_suffix, ns).second) {
-        Die() << "Multiple namespaces for symbol '" << name_suffix << '\'';
+      case ExportSymbol::Kind::NAMESPACE: {
+        const std::string_view ns = elf.GetElfSymbolNamespace(*symbol);
+        if (ns.empty()) {
+          // The global namespace is explicitly represented as the empty
+          // string, but the common interpretation is that such symbols lack an
+          // export namespace.
+          break;
+        }
+        if (entry.ns) {
+          Die() << "Multiple namespaces for symbol '" << name << '\'';
+        }
+        entry.ns = ns;
+        break;
       }
     }
   }
+  return result;
+}
 
-  return namespaces;
+const Export* FindExport(const Exports& exports, std::string_view name) {
+  const auto it = std::lower_bound(
+      exports.begin(), exports.end(), name,
+      [](const Export& entry, std::string_view key) {
+        return entry.name < key;
+      });
+  return it != exports.end() && it->name == name ? &*it : nullptr;
 }
 
 AddressMap GetCFIAddressMap(const SymbolTable& symbols, const ElfLoader& elf) {
   AddressMap name_to_address;
+  name_to_address.reserve(symbols.size());
   for (const auto& symbol : symbols) {
-    const std::string_view name_prefix = UnwrapCFISymbolName(symbol.name);
-    const size_t address = elf.GetAbsoluteAddress(symbol);
-    if (!name_to_address.emplace(name_prefix, address).second) {
-      Die() << "Multiple CFI symbols referring to symbol '" << name_prefix
-            << '\'';
-    }
+    name_to_address.emplace_back(UnwrapCFISymbolName(symbol.name),
+                                 elf.GetAbsoluteAddress(symbol));
+  }
+  std::stable_sort(name_to_address.begin(), name_to_address.end(),
+                   [](const auto& lhs, const auto& rhs) {
+                     return lhs.first < rhs.first;
+                   });
+  const auto it = std::adjacent_find(
+      name_to_address.begin(), name_to_address.end(),
+      [](const auto& lhs, const auto& rhs) {
+        return lhs.first == rhs.first;
+      });
+  if (it != name_to_address.end()) {
+    Die() << "Multiple CFI symbols referring to symbol '" << it->first << '\'';
   }
   return name_to_address;
 }
 
+std::optional<size_t> FindAddress(const AddressMap& addresses,
+                                  std::string_view name) {
+  const auto it = std::lower_bound(
+      addresses.begin(), addresses.end(), name,
+      [](const auto& entry, std::string_view key) {
+        return entry.first < key;
+      });
+  if (it == addresses.end() || it->first != name) {
+    return {};
+  }
+  return {it->second};
+}
+
 bool IsPublicFunctionOrVariable(const SymbolTableEntry& symbol) {
   const auto symbol_type = symbol.symbol_type;
   // Reject symbols that are not functions or variables.
@@ -197,7 +234,13 @@ class Reader {
   Reader(Graph& graph, const std::string& path, ReadOptions options,
          const std::unique_ptr<Filter>& file_filter, Metrics& metrics)
       : graph_(graph),
-        dwarf_(path),
+        image_(Decompress(path, options, metrics)),
+        make_dwarf_(image_.empty()
+                    ? dwarf::HandlerFactory([path]() {
+                        return std::make_unique<dwarf::Handler>(path);
+                      })
+                    : MakeImageHandler()),
+        dwarf_(std::move(*make_dwarf_())),
         elf_(dwarf_.GetElf(), options.Test(ReadOptions::INFO)),
         options_(options),
         file_filter_(file_filter),
@@ -206,7 +249,28 @@ class Reader {
   Reader(Graph& graph, char* data, size_t size, ReadOptions options,
          const std::unique_ptr<Filter>& file_filter, Metrics& metrics)
       : graph_(graph),
-        dwarf_(data, size),
+        image_(Decompress(std::string_view(data, size), options, metrics)),
+        make_dwarf_(image_.empty()
+                    ? dwarf::HandlerFactory([data, size]() {
+                        return std::make_unique<dwarf::Handler>(data, size);
+                      })
+                    : MakeImageHandler()),
+        dwarf_(std::move(*make_dwarf_())),
+        elf_(dwarf_.GetElf(), options.Test(ReadOptions::INFO)),
+        options_(options),
+        file_filter_(file_filter),
+        metrics_(metrics) {}
+
+  Reader(Graph& graph, int fd, ReadOptions options,
+         const std::unique_ptr<Filter>& file_filter, Metrics& metrics)
+      : graph_(graph),
+        image_(Decompress(fd, options, metrics)),
+        make_dwarf_(image_.empty()
+                    ? dwarf::HandlerFactory([fd]() {
+                        return std::make_unique<dwarf::Handler>(fd);
+                      })
+                    : MakeImageHandler()),
+        dwarf_(std::move(*make_dwarf_())),
         elf_(dwarf_.GetElf(), options.Test(ReadOptions::INFO)),
         options_(options),
         file_filter_(file_filter),
@@ -215,24 +279,63 @@ class Reader {
   Id Read();
 
  private:
-  using SymbolIndex =
-      std::map<std::pair<dwarf::Address, std::string>, std::vector<size_t>>;
+  // A DWARF symbol's address and linkage name (or name), with its index.
+  struct SymbolKey {
+    auto Tie() const {
+      return std::tie(address, name, index);
+    }
+    bool operator<(const SymbolKey& other) const {
+      return Tie() < other.Tie();
+    }
 
-  Id BuildRoot(const std::vector<std::pair<ElfSymbol, size_t>>& symbols) {
+    dwarf::Address address;
+    std::string_view name;
+    size_t index;
+  };
+
+  using Symbols = std::vector<std::pair<ElfSymbol, size_t>>;
+
+  Symbols GetSymbols();
+
+  dwarf::Types ProcessDwarf(dwarf::Handler& dwarf, const Symbols& symbols) {
+    const bool is_little_endian_binary = elf_.IsLittleEndianBinary();
+    const bool hash_cons = options_.Test(ReadOptions::HASH_CONS);
+    const bool skip_duplicate_units =
+        options_.Test(ReadOptions::SKIP_DUPLICATE_UNITS);
+    if (options_.Test(ReadOptions::LAZY_DWARF)) {
+      // Only look for the DWARF of the symbols there are.
+      std::vector<dwarf::Address> addresses;
+      addresses.reserve(symbols.size());
+      for (const auto& [symbol, address] : symbols) {
+        addresses.push_back(GetDwarfAddress(symbol, address));
+      }
+      return dwarf::Process(dwarf, addresses, is_little_endian_binary,
+                            file_filter_, graph_, options_.monitor, hash_cons);
+    }
+    if (options_.Test(ReadOptions::DEDUPLICATE_DWARF)) {
+      return dwarf::ProcessDeduplicated(dwarf, options_.jobs,
+                                        is_little_endian_binary, file_filter_,
+                                        graph_, options_.monitor, hash_cons,
+                                        skip_duplicate_units);
+    }
+    if (options_.jobs > 1) {
+      return dwarf::Process(dwarf, make_dwarf_, options_.jobs,
+                            is_little_endian_binary, file_filter_, graph_,
+                            options_.monitor);
+    }
+    return dwarf::Process(dwarf, is_little_endian_binary, file_filter_, graph_,
+                          options_.monitor, hash_cons, skip_duplicate_units);
+  }
+
+  Id BuildRoot(Id start, const Symbols& symbols, const dwarf::Types& types) {
     // On destruction, the unification object will remove or rewrite each graph
     // node for which it has a mapping.
     //
     // Graph rewriting is expensive so an important optimisation is to restrict
     // the nodes in consideration to the ones allocated by the DWARF processor
-    // here and any symbol or type roots that follow. This is done by setting
-    // the starting node ID to be the current graph limit.
-    Unification unification(graph_, graph_.Limit(), metrics_);
-
-    dwarf::Types types;
-    if (!options_.Test(ReadOptions::SKIP_DWARF)) {
-      types = dwarf::Process(dwarf_, elf_.IsLittleEndianBinary(), file_filter_,
-                             graph_);
-    }
+    // and any symbol or type roots that follow. This is done by setting the
+    // starting node ID to be the graph limit before DWARF processing.
+    Unification unification(graph_, start, metrics_, options_.jobs);
 
     // A less important optimisation is avoiding copying the mapping array as it
     // is populated. This is done by reserving space to the new graph limit.
@@ -250,24 +353,49 @@ class Reader {
     //   address
     // * assembly symbols - multiple declarations but no definition and no
     //   address in DWARF.
-    SymbolIndex address_name_to_index;
+    //
+    // ELF symbols are matched to DWARF symbols by a merge join, both sides
+    // sorted by address. DWARF symbols with the same address and name are
+    // adjacent, in their original order.
+    std::vector<SymbolKey> dwarf_keys;
+    dwarf_keys.reserve(types.symbols.size());
     for (size_t i = 0; i < types.symbols.size(); ++i) {
       const auto& symbol = types.symbols[i];
-
-      const auto& name =
+      const std::string_view name =
           symbol.linkage_name.has_value() ? *symbol.linkage_name : symbol.name;
-      address_name_to_index[std::make_pair(symbol.address, name)].push_back(i);
+      dwarf_keys.push_back({symbol.address, name, i});
+    }
+    std::sort(dwarf_keys.begin(), dwarf_keys.end());
+
+    std::vector<ElfSymbol> nodes;
+    nodes.reserve(symbols.size());
+    std::vector<std::pair<dwarf::Address, size_t>> elf_keys;
+    elf_keys.reserve(symbols.size());
+    for (const auto& [symbol, address] : symbols) {
+      elf_keys.emplace_back(GetDwarfAddress(symbol, address), nodes.size());
+      nodes.push_back(symbol);
     }
+    std::sort(elf_keys.begin(), elf_keys.end());
 
-    std::map<std::string, Id> symbols_map;
-    for (auto [symbol, address] : symbols) {
+    const std::span<const SymbolKey> all_keys(dwarf_keys);
+    size_t next = 0;
+    for (const auto& [address, ix] : elf_keys) {
+      while (next < all_keys.size() && all_keys[next].address < address) {
+        ++next;
+      }
+      MaybeAddTypeInfo(all_keys.subspan(next), types.symbols, address,
+                       nodes[ix], unification);
+    }
+
+    std::vector<std::pair<std::string, Id>> symbols_map;
+    symbols_map.reserve(nodes.size());
+    for (auto& node : nodes) {
       // TODO: add VersionInfoToString to SymbolKey name
       // TODO: check for uniqueness of SymbolKey in map after
       // support for version info
-      MaybeAddTypeInfo(address_name_to_index, types.symbols, address, symbol,
-                       unification);
-      symbols_map.emplace(VersionedSymbolName(symbol),
-                          graph_.Add<ElfSymbol>(symbol));
+      auto name = VersionedSymbolName(node);
+      symbols_map.emplace_back(std::move(name),
+                               graph_.Add<ElfSymbol>(std::move(node)));
     }
 
     std::map<std::string, Id> types_map;
@@ -282,7 +410,8 @@ class Reader {
     }
 
     Id root = graph_.Add<Interface>(
-        std::move(symbols_map), std::move(types_map));
+        FlatMap<std::string, Id>(std::move(symbols_map)),
+        std::move(types_map));
 
     // Use all named types and DWARF declarations as roots for type resolution.
     std::vector<Id> roots;
@@ -295,7 +424,8 @@ class Reader {
     }
     roots.push_back(root);
 
-    stg::ResolveTypes(graph_, unification, {roots}, metrics_);
+    stg::ResolveTypes(graph_, unification, {roots}, metrics_,
+                      options_.jobs);
 
     unification.Update(root);
     return root;
@@ -309,26 +439,32 @@ class Reader {
   }
 
   static ElfSymbol SymbolTableEntryToElfSymbol(
-      const CRCValuesMap& crc_values, const NamespacesMap& namespaces,
-      const SymbolTableEntry& symbol) {
+      const Export* export_info, const SymbolTableEntry& symbol) {
+    std::optional<ElfSymbol::CRC> crc;
+    std::optional<std::string> ns;
+    if (export_info != nullptr) {
+      crc = export_info->crc;
+      if (export_info->ns) {
+        ns.emplace(*export_info->ns);
+      }
+    }
     return ElfSymbol(
-        /* symbol_name = */ std::string(symbol.name),
+        /* symbol_name = */ symbol.name,
         /* version_info = */ std::nullopt,
         /* is_defined = */
         symbol.value_type != SymbolTableEntry::ValueType::UNDEFINED,
         /* symbol_type = */ ConvertSymbolType(symbol.symbol_type),
         /* binding = */ symbol.binding,
         /* visibility = */ symbol.visibility,
-        /* crc = */ MaybeGet(crc_values, std::string(symbol.name)),
-        /* ns = */ MaybeGet(namespaces, std::string(symbol.name)),
+        /* crc = */ crc,
+        /* ns = */ ns,
         /* type_id = */ std::nullopt,
         /* full_name = */ std::nullopt);
   }
 
-  static void MaybeAddTypeInfo(
-      const SymbolIndex& address_name_to_index,
-      const std::vector<dwarf::Types::Symbol>& dwarf_symbols,
-      size_t address_value, ElfSymbol& node, Unification& unification) {
+  // The DWARF address to match an ELF symbol with.
+  static dwarf::Address GetDwarfAddress(const ElfSymbol& node,
+                                        size_t address_value) {
     const bool is_tls = node.symbol_type == ElfSymbol::SymbolType::TLS;
     if (is_tls) {
       // TLS symbols address may be incorrect because of unsupported
@@ -337,35 +473,45 @@ class Reader {
       // TODO: match TLS variables by address
       address_value = 0;
     }
-    const dwarf::Address address{.value = address_value, .is_tls = is_tls};
-    // try to find the first symbol with given address
-    const auto start_it = address_name_to_index.lower_bound(
-        std::make_pair(address, std::string()));
-    auto best_symbols_it = address_name_to_index.end();
+    return {.value = address_value, .is_tls = is_tls};
+  }
+
+  // The keys start with the first DWARF symbol at or after the address.
+  static void MaybeAddTypeInfo(
+      std::span<const SymbolKey> keys,
+      const std::vector<dwarf::Types::Symbol>& dwarf_symbols,
+      const dwarf::Address& address, ElfSymbol& node,
+      Unification& unification) {
+    std::span<const SymbolKey> best_symbols;
     bool matched_by_name = false;
     size_t candidates = 0;
-    for (auto it = start_it;
-         it != address_name_to_index.end() && it->first.first == address;
-         ++it) {
-      ++candidates;
+    size_t start = 0;
+    while (start < keys.size() && keys[start].address == address) {
       // We have at least matching addresses.
-      if (it->first.second == node.symbol_name) {
+      const auto name = keys[start].name;
+      size_t end = start + 1;
+      while (end < keys.size() && keys[end].address == address
+             && keys[end].name == name) {
+        ++end;
+      }
+      ++candidates;
+      const auto symbols = keys.subspan(start, end - start);
+      if (name == node.symbol_name) {
         // If we have also matching names we can stop looking further.
         matched_by_name = true;
-        best_symbols_it = it;
+        best_symbols = symbols;
         break;
       }
-      if (best_symbols_it == address_name_to_index.end()) {
+      if (best_symbols.empty()) {
         // Otherwise keep the first match.
-        best_symbols_it = it;
+        best_symbols = symbols;
       }
+      start = end;
     }
-    if (best_symbols_it != address_name_to_index.end()) {
-      const auto& best_symbols = best_symbols_it->second;
-      Check(!best_symbols.empty()) << "best_symbols.empty()";
-      const auto& best_symbol = dwarf_symbols[best_symbols[0]];
+    if (!best_symbols.empty()) {
+      const auto& best_symbol = dwarf_symbols[best_symbols[0].index];
       for (size_t i = 1; i < best_symbols.size(); ++i) {
-        const auto& other = dwarf_symbols[best_symbols[i]];
+        const auto& other = dwarf_symbols[best_symbols[i].index];
         // TODO: allow "compatible" duplicates, for example
         // "void foo(int bar)" vs "void foo(const int bar)"
         if (!IsEqual(unification, best_symbol, other)) {
@@ -391,7 +537,63 @@ class Reader {
     }
   }
 
+  // With more than one job, the compressed debug sections are decompressed up
+  // front, concurrently, into a private image shared by all the DWARF
+  // handlers. Otherwise, libdw decompresses them, one at a time, for each
+  // handler. Returns an empty image if there is nothing to decompress.
+  static std::vector<char> Decompress(std::string_view image,
+                                      const ReadOptions& options,
+                                      Metrics& metrics) {
+    if (!ShouldDecompress(options)) {
+      return {};
+    }
+    const Time time(metrics, "decompress debug sections");
+    return elf::DecompressDebugSections(image, options.jobs);
+  }
+
+  static std::vector<char> Decompress(const FileDescriptor& fd,
+                                      const ReadOptions& options,
+                                      Metrics& metrics) {
+    const auto map = MemoryMap::TryMap(fd);
+    return map ? Decompress(map->Contents(), options, metrics)
+               : std::vector<char>();
+  }
+
+  static std::vector<char> Decompress(const std::string& path,
+                                      const ReadOptions& options,
+                                      Metrics& metrics) {
+    if (!ShouldDecompress(options)) {
+      return {};
+    }
+    return Decompress(FileDescriptor(path.c_str(), O_RDONLY), options,
+                      metrics);
+  }
+
+  static std::vector<char> Decompress(int fd, const ReadOptions& options,
+                                      Metrics& metrics) {
+    if (!ShouldDecompress(options)) {
+      return {};
+    }
+    const int owned = dup(fd);
+    Check(owned >= 0) << "dup failed: " << Error(errno);
+    return Decompress(FileDescriptor(owned), options, metrics);
+  }
+
+  static bool ShouldDecompress(const ReadOptions& options) {
+    return options.jobs > 1 && !options.Test(ReadOptions::SKIP_DWARF);
+  }
+
+  dwarf::HandlerFactory MakeImageHandler() {
+    return [this]() {
+      return std::make_unique<dwarf::Handler>(image_.data(), image_.size());
+    };
+  }
+
   Graph& graph_;
+  // The image with decompressed debug sections, if any, see Decompress.
+  std::vector<char> image_;
+  // Creates additional DWARF handlers for concurrent processing.
+  dwarf::HandlerFactory make_dwarf_;
   // The order of the following two fields is important because ElfLoader uses
   // an Elf* from dwarf::Handler without owning it.
   dwarf::Handler dwarf_;
@@ -399,24 +601,20 @@ class Reader {
   ReadOptions options_;
   const std::unique_ptr<Filter>& file_filter_;
   Metrics& metrics_;
+  // public symbols dropped by the symbol filter
+  size_t filtered_symbols_ = 0;
 };
 
-Id Reader::Read() {
+Reader::Symbols Reader::GetSymbols() {
   const auto all_symbols = elf_.GetElfSymbols();
   if (options_.Test(ReadOptions::INFO)) {
     std::cout << "Parsed " << all_symbols.size() << " symbols\n";
   }
 
   const bool is_linux_kernel = elf_.IsLinuxKernelBinary();
-  const SymbolNameList ksymtab_symbols =
-      is_linux_kernel ? GetKsymtabSymbols(all_symbols) : SymbolNameList();
-
-  CRCValuesMap crc_values;
-  NamespacesMap namespaces;
-  if (is_linux_kernel) {
-    crc_values = GetCRCValuesMap(all_symbols, elf_);
-    namespaces = GetNamespacesMap(all_symbols, elf_);
-  }
+  const Exports exports = is_linux_kernel
+                          ? GetExports(GetExportSymbols(all_symbols), elf_)
+                          : Exports();
 
   const auto cfi_address_map = GetCFIAddressMap(elf_.GetCFISymbols(), elf_);
   if (options_.Test(ReadOptions::INFO) && !cfi_address_map.empty()) {
@@ -429,33 +627,94 @@ Id Reader::Read() {
   if (options_.Test(ReadOptions::INFO)) {
     std::cout << "Public functions and variables:\n";
   }
-  std::vector<std::pair<ElfSymbol, size_t>> symbols;
+  // Symbols not selected are dropped before any DWARF is matched with them.
+  const Filter* symbol_filter = options_.symbol_filter;
+  Symbols symbols;
   symbols.reserve(all_symbols.size());
   for (const auto& symbol : all_symbols) {
-    if (IsPublicFunctionOrVariable(symbol) &&
-        (!is_linux_kernel || ksymtab_symbols.count(symbol.name))) {
-      const auto cfi_it = cfi_address_map.find(std::string(symbol.name));
-      const size_t address = cfi_it != cfi_address_map.end()
-                                 ? cfi_it->second
-                                 : elf_.GetAbsoluteAddress(symbol);
-      symbols.emplace_back(
-          SymbolTableEntryToElfSymbol(crc_values, namespaces, symbol), address);
-
-      if (options_.Test(ReadOptions::INFO)) {
-        std::cout << "  " << symbol.binding << ' ' << symbol.symbol_type << " '"
-                  << symbol.name << "'\n    visibility=" << symbol.visibility
-                  << " size=" << symbol.size << " value=" << symbol.value << "["
-                  << symbol.value_type << "]\n";
+    if (!IsPublicFunctionOrVariable(symbol)) {
+      continue;
+    }
+    const Export* export_info = nullptr;
+    if (is_linux_kernel) {
+      export_info = FindExport(exports, symbol.name);
+      if (export_info == nullptr || !export_info->ksymtab) {
+        continue;
       }
     }
+    auto node = SymbolTableEntryToElfSymbol(export_info, symbol);
+    if (symbol_filter != nullptr
+        && !(*symbol_filter)(VersionedSymbolName(node))) {
+      ++filtered_symbols_;
+      continue;
+    }
+    const size_t address = FindAddress(cfi_address_map, symbol.name)
+                               .value_or(elf_.GetAbsoluteAddress(symbol));
+    symbols.emplace_back(std::move(node), address);
+
+    if (options_.Test(ReadOptions::INFO)) {
+      std::cout << "  " << symbol.binding << ' ' << symbol.symbol_type << " '"
+                << symbol.name << "'\n    visibility=" << symbol.visibility
+                << " size=" << symbol.size << " value=" << symbol.value << "["
+                << symbol.value_type << "]\n";
+    }
   }
   symbols.shrink_to_fit();
+  return symbols;
+}
 
-  Id root = BuildRoot(symbols);
+Id Reader::Read() {
+  const Id start = graph_.Limit();
+  Symbols symbols;
+  dwarf::Types types;
+  if (options_.Test(ReadOptions::SKIP_DWARF)) {
+    symbols = GetSymbols();
+  } else if (options_.jobs > 1 && !options_.Test(ReadOptions::LAZY_DWARF)) {
+    // Unless it is lazy, DWARF processing does not depend on the ELF symbols,
+    // so do both at the same time. As libdw is not thread-safe, the DWARF gets
+    // its own handler. Only DWARF processing adds nodes to the graph.
+    ForEachIndex(2, 2, [&](size_t, size_t index) {
+      if (index == 0) {
+        symbols = GetSymbols();
+      } else {
+        const auto dwarf = make_dwarf_();
+        types = ProcessDwarf(*dwarf, {});
+      }
+    });
+  } else {
+    symbols = GetSymbols();
+    types = ProcessDwarf(dwarf_, symbols);
+  }
+  if (options_.symbol_filter != nullptr) {
+    Counter(metrics_, "elf.filtered_symbols") = filtered_symbols_;
+  }
+  if (!options_.Test(ReadOptions::SKIP_DWARF)) {
+    Counter(metrics_, "dwarf.units") = types.processed_units;
+    if (options_.Test(ReadOptions::SKIP_DUPLICATE_UNITS)) {
+      Counter(metrics_, "dwarf.cu_skipped") = types.skipped_units;
+    }
+    Counter(metrics_, "dwarf.entries") = types.processed_entries;
+    Counter(metrics_, "dwarf.skipped_entries") = types.skipped_entries;
+    Counter(metrics_, "dwarf.child_ranges") = types.child_ranges;
+    dwarf::RecordTagMetrics(types, metrics_);
+    if (file_filter_) {
+      Counter(metrics_, "dwarf.file_filter.evaluations") =
+          types.file_filter_evaluations;
+      Counter(metrics_, "dwarf.file_filter.hits") = types.file_filter_hits;
+    }
+    if (options_.Test(ReadOptions::DEDUPLICATE_DWARF)) {
+      Counter(metrics_, "dwarf.deduplication.passes") =
+          types.deduplication_passes;
+      Counter(metrics_, "dwarf.deduplication.duplicates") =
+          types.duplicate_nodes;
+    }
+  }
+
+  Id root = BuildRoot(start, symbols, types);
 
   // Types produced by ELF/DWARF readers may require removing useless
   // qualifiers.
-  RemoveUselessQualifiers(graph_, root);
+  RemoveUselessQualifiers(graph_, root, metrics_, options_.jobs);
 
   return root;
 }
@@ -474,5 +733,10 @@ Id Read(Graph& graph, char* data, size_t size, ReadOptions options,
       .Read();
 }
 
+Id Read(Graph& graph, int fd, ReadOptions options,
+        const std::unique_ptr<Filter>& file_filter, Metrics& metrics) {
+  return internal::Reader(graph, fd, options, file_filter, metrics).Read();
+}
+
 }  // namespace elf
 }  // namespace stg
@@ -22,10 +22,10 @@
 
 #include <cstddef>
 #include <memory>
+#include <optional>
 #include <string>
 #include <string_view>
-#include <unordered_map>
-#include <unordered_set>
+#include <utility>
 #include <vector>
 
 #include "elf_loader.h"
@@ -39,25 +39,50 @@ namespace elf {
 
 Id Read(Graph& graph, const std::string& path, ReadOptions options,
         const std::unique_ptr<Filter>& file_filter, Metrics& metrics);
+// The data must be writable. Read-only and shared memory can be read without
+// a copy via a file descriptor, see dwarf::Handler.
 Id Read(Graph& graph, char* data, size_t size, ReadOptions options,
         const std::unique_ptr<Filter>& file_filter, Metrics& metrics);
+Id Read(Graph& graph, int fd, ReadOptions options,
+        const std::unique_ptr<Filter>& file_filter, Metrics& metrics);
 
 // For unit tests only
 namespace internal {
 
 using SymbolTable = std::vector<SymbolTableEntry>;
-using SymbolNameList = std::unordered_set<std::string_view>;
-using CRCValuesMap = std::unordered_map<std::string, ElfSymbol::CRC>;
-using NamespacesMap = std::unordered_map<std::string, std::string>;
-using AddressMap = std::unordered_map<std::string, size_t>;
+
+// A kernel symbol that carries export information about another symbol.
+struct ExportSymbol {
+  enum class Kind { KSYMTAB, CRC, NAMESPACE };
+  // the name of the exported symbol
+  std::string_view name;
+  Kind kind;
+  const SymbolTableEntry* symbol;
+};
+
+// The export information of a kernel symbol.
+struct Export {
+  std::string_view name;
+  bool ksymtab = false;
+  std::optional<ElfSymbol::CRC> crc;
+  std::optional<std::string_view> ns;
+};
+
+// Export symbols, sorted by name and kind.
+using ExportSymbols = std::vector<ExportSymbol>;
+// Exports, sorted by name with at most one entry per name.
+using Exports = std::vector<Export>;
+// CFI symbol addresses, sorted by name with at most one entry per name.
+using AddressMap = std::vector<std::pair<std::string_view, size_t>>;
 
 ElfSymbol::SymbolType ConvertSymbolType(
     SymbolTableEntry::SymbolType symbol_type);
-SymbolNameList GetKsymtabSymbols(const SymbolTable& symbols);
-CRCValuesMap GetCRCValuesMap(const SymbolTable& symbols, const ElfLoader& elf);
-NamespacesMap GetNamespacesMap(const SymbolTable& symbols,
-                               const ElfLoader& elf);
+ExportSymbols GetExportSymbols(const SymbolTable& symbols);
+Exports GetExports(const ExportSymbols& export_symbols, const ElfLoader& elf);
+const Export* FindExport(const Exports& exports, std::string_view name);
 AddressMap GetCFIAddressMap(const SymbolTable& symbols, const ElfLoader& elf);
+std::optional<size_t> FindAddress(const AddressMap& addresses,
+                                  std::string_view name);
 bool IsPublicFunctionOrVariable(const SymbolTableEntry& symbol);
 
 }  // namespace internal
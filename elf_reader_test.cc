@@ -17,12 +17,33 @@
 //
 // Author: Aleksei Vetrov
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <sstream>
+#include <string>
 #include <string_view>
+#include <variant>
+#include <vector>
 
 #include <catch2/catch.hpp>
 #include "elf_loader.h"
 #include "elf_reader.h"
+#include "error.h"
+#include "file_descriptor.h"
+#include "filter.h"
 #include "graph.h"
+#include "metrics.h"
+#include "pipeline.h"
+#include "proto_writer.h"
+#include "reader_options.h"
+#include "stable_hash.h"
 
 namespace Test {
 
@@ -43,15 +64,196 @@ SymbolTableEntry MakeSymbol(std::string_view name) {
 }
 
 
-TEST_CASE("GetKsymtabSymbols") {
+TEST_CASE("GetExportSymbols") {
   const SymbolTable all_symbols = {
     MakeSymbol("foo"),
     MakeSymbol("__ksymtab_foo"),
     MakeSymbol("bar"),
+    MakeSymbol("__kstrtabns_foo"),
+    MakeSymbol("__crc_bar"),
+  };
+  using Kind = stg::elf::internal::ExportSymbol::Kind;
+  const auto exports = stg::elf::internal::GetExportSymbols(all_symbols);
+  REQUIRE(exports.size() == 3);
+  CHECK(exports[0].name == "bar");
+  CHECK(exports[0].kind == Kind::CRC);
+  CHECK(exports[0].symbol == &all_symbols[4]);
+  CHECK(exports[1].name == "foo");
+  CHECK(exports[1].kind == Kind::KSYMTAB);
+  CHECK(exports[1].symbol == &all_symbols[1]);
+  CHECK(exports[2].name == "foo");
+  CHECK(exports[2].kind == Kind::NAMESPACE);
+  CHECK(exports[2].symbol == &all_symbols[3]);
+}
+
+TEST_CASE("FindExport") {
+  const stg::elf::internal::Exports exports = {
+    {"bar", true, {}, {}},
+    {"foo", true, {}, "NS"},
+  };
+  CHECK(stg::elf::internal::FindExport(exports, "baz") == nullptr);
+  CHECK(stg::elf::internal::FindExport(exports, "zzz") == nullptr);
+  const auto* foo = stg::elf::internal::FindExport(exports, "foo");
+  REQUIRE(foo != nullptr);
+  CHECK(foo->ns == "NS");
+}
+
+// Returns the STG output or, as binaries may lack DWARF, the error message.
+std::string ReadAndWrite(
+    const std::function<stg::Id(stg::Graph&, stg::ReadOptions,
+                                const std::unique_ptr<stg::Filter>&,
+                                stg::Metrics&)>& read) {
+  try {
+    stg::Graph graph;
+    stg::Metrics metrics;
+    const stg::Id root =
+        read(graph, stg::ReadOptions(stg::ReadOptions::SKIP_DWARF), nullptr,
+             metrics);
+    std::ostringstream os;
+    stg::proto::Writer(graph).Write(root, os);
+    return os.str();
+  } catch (const stg::Exception& e) {
+    return e.what();
+  }
+}
+
+TEST_CASE("read from sealed memory") {
+  // this test binary is a convenient ELF file
+  const std::string path = "/proc/self/exe";
+  std::ifstream is(path);
+  std::vector<char> contents((std::istreambuf_iterator<char>(is)),
+                             std::istreambuf_iterator<char>());
+  REQUIRE(!contents.empty());
+
+  // a memfd which can no longer be written to in any way
+  stg::FileDescriptor memory(
+      memfd_create("elf_reader_test", MFD_CLOEXEC | MFD_ALLOW_SEALING));
+  REQUIRE(write(memory.Value(), contents.data(), contents.size())
+          == static_cast<ssize_t>(contents.size()));
+  REQUIRE(fcntl(memory.Value(), F_ADD_SEALS,
+                F_SEAL_SEAL | F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE) == 0);
+
+  using Filter = std::unique_ptr<stg::Filter>;
+  const auto from_path = ReadAndWrite(
+      [&](stg::Graph& graph, stg::ReadOptions options, const Filter& filter,
+          stg::Metrics& metrics) {
+        return stg::elf::Read(graph, path, options, filter, metrics);
+      });
+  const auto from_memory = ReadAndWrite(
+      [&](stg::Graph& graph, stg::ReadOptions options, const Filter& filter,
+          stg::Metrics& metrics) {
+        return stg::elf::Read(graph, contents.data(), contents.size(), options,
+                              filter, metrics);
+      });
+  const auto from_descriptor = ReadAndWrite(
+      [&](stg::Graph& graph, stg::ReadOptions options, const Filter& filter,
+          stg::Metrics& metrics) {
+        return stg::elf::Read(graph, memory.Value(), options, filter, metrics);
+      });
+  CHECK(from_memory == from_path);
+  CHECK(from_descriptor == from_path);
+  // the descriptor is left open
+  CHECK(fcntl(memory.Value(), F_GETFD) != -1);
+}
+
+TEST_CASE("cancellation") {
+  // this test binary is a convenient ELF file
+  const std::string path = "/proc/self/exe";
+  using Filter = std::unique_ptr<stg::Filter>;
+  const std::atomic<bool> cancel = true;
+  for (const size_t jobs : {1, 3}) {
+    GIVEN("jobs: " + std::to_string(jobs)) {
+      size_t reports = 0;
+      stg::ReadOptions options;
+      options.jobs = jobs;
+      options.monitor.progress = [&](const stg::ReadProgress&) { ++reports; };
+      options.monitor.cancel = &cancel;
+      // cancellation is checked before the first compilation unit, but the
+      // test binary may lack debug information
+      const std::string what = ReadAndWrite(
+          [&](stg::Graph& graph, stg::ReadOptions, const Filter& filter,
+              stg::Metrics& metrics) {
+            return stg::elf::Read(graph, path, options, filter, metrics);
+          });
+      CHECK((what.find("DWARF processing cancelled") != std::string::npos
+             || what.find("No DWARF information found")
+                    != std::string::npos));
+      CHECK(reports == 0);
+    }
+  }
+}
+
+TEST_CASE("lazy DWARF") {
+  // Built with
+  //
+  //   gcc -g -O0 -shared -fPIC -fno-asynchronous-unwind-tables \
+  //     -fdebug-prefix-map=$PWD=. \
+  //     lazy_dwarf_declaration.c lazy_dwarf_definition.c -o lazy_dwarf.elf
+  //
+  // The unit holding the only symbol, get, declares struct S and the other
+  // unit, which has no symbols, defines it.
+  const std::string path = "testdata/lazy_dwarf.elf";
+  using Filter = std::unique_ptr<stg::Filter>;
+  const auto read = [&](bool lazy) {
+    return ReadAndWrite(
+        [&](stg::Graph& graph, stg::ReadOptions, const Filter& filter,
+            stg::Metrics& metrics) {
+          stg::ReadOptions options;
+          if (lazy) {
+            options.Set(stg::ReadOptions::LAZY_DWARF);
+          }
+          const stg::Id root =
+              stg::elf::Read(graph, path, options, filter, metrics);
+          stg::StableHashCache stable_hashes;
+          return stg::ResolveAndDeduplicate(graph, root, false, stable_hashes,
+                                            metrics, 1);
+        });
+  };
+  const auto lazy = read(true);
+  // the definition is read, though its unit holds no symbols
+  CHECK(lazy.find("name: \"x\"") != std::string::npos);
+  CHECK(lazy == read(false));
+}
+
+TEST_CASE("skip duplicate units") {
+  // Built with
+  //
+  //   F="-g -O0 -fPIC -fno-asynchronous-unwind-tables \
+  //     -fno-eliminate-unused-debug-types -fdebug-prefix-map=$PWD=."
+  //   gcc $F -c duplicate_units_get.c -o get.o
+  //   gcc $F -c duplicate_units_type.c -o type_0.o
+  //   gcc $F -c duplicate_units_type.c -o type_1.o
+  //   gcc -shared get.o type_0.o type_1.o -o duplicate_units.elf
+  //
+  // The last two units are the same and define struct T, which the first
+  // declares.
+  const std::string path = "testdata/duplicate_units.elf";
+  using Filter = std::unique_ptr<stg::Filter>;
+  size_t skipped_units = 0;
+  const auto read = [&](bool skip) {
+    return ReadAndWrite(
+        [&](stg::Graph& graph, stg::ReadOptions, const Filter& filter,
+            stg::Metrics& metrics) {
+          stg::ReadOptions options;
+          if (skip) {
+            options.Set(stg::ReadOptions::SKIP_DUPLICATE_UNITS);
+          }
+          const stg::Id root =
+              stg::elf::Read(graph, path, options, filter, metrics);
+          for (const auto& metric : metrics) {
+            if (std::string_view(metric.name) == "dwarf.cu_skipped") {
+              skipped_units = std::get<size_t>(metric.value);
+            }
+          }
+          stg::StableHashCache stable_hashes;
+          return stg::ResolveAndDeduplicate(graph, root, false, stable_hashes,
+                                            metrics, 1);
+        });
   };
-  const auto ksymtab = stg::elf::internal::GetKsymtabSymbols(all_symbols);
-  REQUIRE(ksymtab.size() == 1);
-  CHECK(*ksymtab.begin() == "foo");
+  const auto skipped = read(true);
+  CHECK(skipped_units == 1);
+  CHECK(skipped.find("name: \"y\"") != std::string::npos);
+  CHECK(skipped == read(false));
 }
 
 }  // namespace Test
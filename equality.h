@@ -21,9 +21,9 @@
 #define STG_EQUALITY_H_
 
 #include <cstddef>
-#include <map>
 #include <vector>
 
+#include "flat_map.h"
 #include "graph.h"
 #include "scc.h"
 
@@ -34,74 +34,74 @@ namespace stg {
 // information about equality results and queried for the same. Different
 // implementations are possible depending on the needs of the caller and the
 // guaranteed invariants.
+//
+// The depth-first search uses an explicit stack, so that the native stack does
+// not grow with the depth of the graph. Each node comparison checks the node
+// attributes and queues the edges to follow, which are then compared in order,
+// stopping at the first difference.
 template <typename EqualityCache>
 struct Equals {
   Equals(const Graph& graph, EqualityCache& equality_cache)
       : graph(graph), equality_cache(equality_cache) {}
 
   bool operator()(Id id1, Id id2) {
-    const Pair comparison = {id1, id2};
-
-    // Check if the comparison has an already known result.
-    const auto check = equality_cache.Query(comparison);
-    if (check.has_value()) {
-      return check.value();
-    }
-
-    // Record the comparison with Strongly-Connected Component finder.
-    auto handle = scc.Open(comparison);
-    if (!handle) {
-      // Already open.
-      //
-      // Return a dummy true outcome.
-      return true;
-    }
-    // Comparison opened, need to close it before returning.
-
-    bool result = graph.Apply2<bool>(*this, id1, id2);
-
-    // Check for a complete Strongly-Connected Component.
-    auto comparisons = scc.Close(*handle);
-    if (comparisons.empty()) {
-      // Note that result is tentative as the SCC is still open.
+    const size_t base = stack.size();
+    bool result;
+    if (!Visit({id1, id2}, result)) {
       return result;
     }
-
-    // Closed SCC.
-    //
-    // Note that result is the conjunction of every equality in the SCC via the
-    // DFS spanning tree.
-    if (result) {
-      equality_cache.AllSame(comparisons);
-    } else {
-      equality_cache.AllDifferent(comparisons);
+    while (true) {
+      Frame& frame = stack.back();
+      if (frame.result && frame.next < frame.end) {
+        const Pair edge = edges[frame.next++];
+        // this may push a frame, invalidating the reference
+        const size_t ix = stack.size() - 1;
+        if (!Visit(edge, result)) {
+          stack[ix].result = result;
+        }
+        continue;
+      }
+      result = Leave();
+      if (stack.size() == base) {
+        return result;
+      }
+      // the parent only follows edges while its result is true
+      stack.back().result = result;
     }
-    return result;
   }
 
-  bool operator()(const std::vector<Id>& ids1, const std::vector<Id>& ids2) {
-    bool result = ids1.size() == ids2.size();
-    for (size_t ix = 0; result && ix < ids1.size(); ++ix) {
-      result = (*this)(ids1[ix], ids2[ix]);
+  // Queues an edge to follow.
+  bool Follow(Id id1, Id id2) {
+    edges.push_back({id1, id2});
+    return true;
+  }
+
+  bool operator()(const Ids& ids1, const Ids& ids2) {
+    if (ids1.size() != ids2.size()) {
+      return false;
     }
-    return result;
+    for (size_t ix = 0; ix < ids1.size(); ++ix) {
+      Follow(ids1[ix], ids2[ix]);
+    }
+    return true;
   }
 
   template <typename Key>
-  bool operator()(const std::map<Key, Id>& ids1,
-                  const std::map<Key, Id>& ids2) {
-    bool result = ids1.size() == ids2.size();
+  bool operator()(const FlatMap<Key, Id>& ids1,
+                  const FlatMap<Key, Id>& ids2) {
+    if (ids1.size() != ids2.size()) {
+      return false;
+    }
     auto it1 = ids1.begin();
     auto it2 = ids2.begin();
     const auto end1 = ids1.end();
-    const auto end2 = ids2.end();
-    while (result && it1 != end1 && it2 != end2) {
-      result = it1->first == it2->first
-               && (*this)(it1->second, it2->second);
-      ++it1;
-      ++it2;
+    for (; it1 != end1; ++it1, ++it2) {
+      if (it1->first != it2->first) {
+        return false;
+      }
+      Follow(it1->second, it2->second);
     }
-    return result && it1 == end1 && it2 == end2;
+    return true;
   }
 
   bool operator()(const Special& x1, const Special& x2) {
@@ -111,22 +111,22 @@ struct Equals {
   bool operator()(const PointerReference& x1,
                   const PointerReference& x2) {
     return x1.kind == x2.kind
-        && (*this)(x1.pointee_type_id, x2.pointee_type_id);
+        && Follow(x1.pointee_type_id, x2.pointee_type_id);
   }
 
   bool operator()(const PointerToMember& x1, const PointerToMember& x2) {
-    return (*this)(x1.containing_type_id, x2.containing_type_id)
-        && (*this)(x1.pointee_type_id, x2.pointee_type_id);
+    return Follow(x1.containing_type_id, x2.containing_type_id)
+        && Follow(x1.pointee_type_id, x2.pointee_type_id);
   }
 
   bool operator()(const Typedef& x1, const Typedef& x2) {
     return x1.name == x2.name
-        && (*this)(x1.referred_type_id, x2.referred_type_id);
+        && Follow(x1.referred_type_id, x2.referred_type_id);
   }
 
   bool operator()(const Qualified& x1, const Qualified& x2) {
     return x1.qualifier == x2.qualifier
-        && (*this)(x1.qualified_type_id, x2.qualified_type_id);
+        && Follow(x1.qualified_type_id, x2.qualified_type_id);
   }
 
   bool operator()(const Primitive& x1, const Primitive& x2) {
@@ -137,27 +137,27 @@ struct Equals {
 
   bool operator()(const Array& x1, const Array& x2) {
     return x1.number_of_elements == x2.number_of_elements
-        && (*this)(x1.element_type_id, x2.element_type_id);
+        && Follow(x1.element_type_id, x2.element_type_id);
   }
 
   bool operator()(const BaseClass& x1, const BaseClass& x2) {
     return x1.offset == x2.offset
         && x1.inheritance == x2.inheritance
-        && (*this)(x1.type_id, x2.type_id);
+        && Follow(x1.type_id, x2.type_id);
   }
 
   bool operator()(const Method& x1, const Method& x2) {
     return x1.mangled_name == x2.mangled_name
         && x1.name == x2.name
         && x1.vtable_offset == x2.vtable_offset
-        && (*this)(x1.type_id, x2.type_id);
+        && Follow(x1.type_id, x2.type_id);
   }
 
   bool operator()(const Member& x1, const Member& x2) {
     return x1.name == x2.name
         && x1.offset == x2.offset
         && x1.bitsize == x2.bitsize
-        && (*this)(x1.type_id, x2.type_id);
+        && Follow(x1.type_id, x2.type_id);
   }
 
   bool operator()(const StructUnion& x1, const StructUnion& x2) {
@@ -181,8 +181,8 @@ struct Equals {
     bool result = x1.name == x2.name
                   && definition1.has_value() == definition2.has_value();
     if (result && definition1.has_value()) {
-      result = (*this)(definition1->underlying_type_id,
-                       definition2->underlying_type_id)
+      result = Follow(definition1->underlying_type_id,
+                      definition2->underlying_type_id)
                && definition1->enumerators == definition2->enumerators;
     }
     return result;
@@ -190,7 +190,7 @@ struct Equals {
 
   bool operator()(const Function& x1, const Function& x2) {
     return (*this)(x1.parameters, x2.parameters)
-        && (*this)(x1.return_type_id, x2.return_type_id);
+        && Follow(x1.return_type_id, x2.return_type_id);
   }
 
   bool operator()(const ElfSymbol& x1, const ElfSymbol& x2) {
@@ -205,7 +205,7 @@ struct Equals {
                   && x1.full_name == x2.full_name
                   && x1.type_id.has_value() == x2.type_id.has_value();
     if (result && x1.type_id.has_value()) {
-      result = (*this)(x1.type_id.value(), x2.type_id.value());
+      result = Follow(x1.type_id.value(), x2.type_id.value());
     }
     return result;
   }
@@ -222,6 +222,76 @@ struct Equals {
   const Graph& graph;
   EqualityCache& equality_cache;
   SCC<Pair> scc;
+
+ private:
+  // A node comparison in progress. Its queued edges are edges[next, end).
+  struct Frame {
+    Pair comparison;
+    size_t handle;
+    size_t begin;
+    size_t next;
+    size_t end;
+    bool result;
+  };
+
+  // Starts a comparison, returning false if the result is already known.
+  bool Visit(const Pair& comparison, bool& result) {
+    // Check if the comparison has an already known result.
+    const auto check = equality_cache.Query(comparison);
+    if (check.has_value()) {
+      result = check.value();
+      return false;
+    }
+
+    // Record the comparison with Strongly-Connected Component finder.
+    auto handle = scc.Open(comparison);
+    if (!handle) {
+      // Already open.
+      //
+      // Return a dummy true outcome.
+      result = true;
+      return false;
+    }
+    // Comparison opened, need to close it in Leave.
+
+    const size_t begin = edges.size();
+    const bool local = graph.Apply2<bool>(
+        *this, comparison.first, comparison.second);
+    if (!local) {
+      edges.erase(edges.begin() + begin, edges.end());
+    }
+    stack.push_back({comparison, *handle, begin, begin, edges.size(), local});
+    return true;
+  }
+
+  // Finishes the comparison at the top of the stack, returning its result.
+  bool Leave() {
+    const Frame frame = stack.back();
+    stack.pop_back();
+    edges.erase(edges.begin() + frame.begin, edges.end());
+    const bool result = frame.result;
+
+    // Check for a complete Strongly-Connected Component.
+    auto comparisons = scc.Close(frame.handle);
+    if (comparisons.empty()) {
+      // Note that result is tentative as the SCC is still open.
+      return result;
+    }
+
+    // Closed SCC.
+    //
+    // Note that result is the conjunction of every equality in the SCC via the
+    // DFS spanning tree.
+    if (result) {
+      equality_cache.AllSame(comparisons);
+    } else {
+      equality_cache.AllDifferent(comparisons);
+    }
+    return result;
+  }
+
+  std::vector<Frame> stack;
+  std::vector<Pair> edges;
 };
 
 }  // namespace stg
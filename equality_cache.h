@@ -20,16 +20,24 @@
 #ifndef STG_EQUALITY_CACHE_H_
 #define STG_EQUALITY_CACHE_H_
 
+#include <algorithm>
 #include <cstddef>
 #include <cstdint>
+#include <iterator>
+#include <mutex>
 #include <optional>
+#include <span>
 #include <unordered_map>
 #include <unordered_set>
+#include <utility>
 #include <vector>
 
+#include "concurrent_union_find.h"
+#include "error.h"
 #include "graph.h"
 #include "hashing.h"
 #include "metrics.h"
+#include "node_hashes.h"
 
 namespace stg {
 
@@ -46,8 +54,7 @@ namespace stg {
 // Node hashes such as those generated by the Fingerprint function object may be
 // supplied to avoid equality testing when hashes differ.
 struct EqualityCache {
-  EqualityCache(const std::unordered_map<Id, HashValue>& hashes,
-                Metrics& metrics)
+  EqualityCache(const NodeHashes& hashes, Metrics& metrics)
       : hashes(hashes),
         query_count(metrics, "cache.query_count"),
         query_equal_ids(metrics, "cache.query_equal_ids"),
@@ -95,23 +102,22 @@ struct EqualityCache {
     return std::nullopt;
   }
 
-  void AllSame(const std::vector<Pair>& comparisons) {
+  void AllSame(std::span<const Pair> comparisons) {
     for (const auto& [id1, id2] : comparisons) {
       Union(id1, id2);
     }
   }
 
-  void AllDifferent(const std::vector<Pair>& comparisons) {
+  void AllDifferent(std::span<const Pair> comparisons) {
     for (const auto& [id1, id2] : comparisons) {
       Disunion(id1, id2);
     }
   }
 
   bool DistinctHashes(Id id1, Id id2) {
-    const auto it1 = hashes.find(id1);
-    const auto it2 = hashes.find(id2);
-    return it1 != hashes.end() && it2 != hashes.end()
-        && it1->second != it2->second;
+    const auto* hash1 = hashes.Find(id1);
+    const auto* hash2 = hashes.Find(id2);
+    return hash1 != nullptr && hash2 != nullptr && *hash1 != *hash2;
   }
 
   Id Find(Id id) {
@@ -203,26 +209,406 @@ struct EqualityCache {
     }
   }
 
-  const std::unordered_map<Id, HashValue>& hashes;
+  const NodeHashes& hashes;
   std::unordered_map<Id, Id> mapping;
   std::unordered_map<Id, size_t> rank;
   std::unordered_map<Id, std::unordered_set<Id>> inequalities;
 
-  Counter query_count;
-  Counter query_equal_ids;
-  Counter query_unequal_hashes;
-  Counter query_equal_representatives;
-  Counter query_inequality_found;
-  Counter query_not_found;
-  Counter find_halved;
-  Counter union_known;
-  Counter union_rank_swap;
-  Counter union_rank_increase;
-  Counter union_rank_zero;
-  Counter union_unknown;
-  Counter disunion_known_hash;
-  Counter disunion_known_inequality;
-  Counter disunion_unknown;
+  OperationCounter query_count;
+  OperationCounter query_equal_ids;
+  OperationCounter query_unequal_hashes;
+  OperationCounter query_equal_representatives;
+  OperationCounter query_inequality_found;
+  OperationCounter query_not_found;
+  OperationCounter find_halved;
+  OperationCounter union_known;
+  OperationCounter union_rank_swap;
+  OperationCounter union_rank_increase;
+  OperationCounter union_rank_zero;
+  OperationCounter union_unknown;
+  OperationCounter disunion_known_hash;
+  OperationCounter disunion_known_inequality;
+  OperationCounter disunion_unknown;
+};
+
+// Equality cache - as above, but for nodes in a dense range of ids
+//
+// The union-find parents and ranks and the node hashes are held in flat vectors
+// indexed by id. Inequalities are held per representative as sorted vectors,
+// which are almost always short.
+struct DenseEqualityCache {
+  DenseEqualityCache(const NodeHashes& hashes, Id start, Id limit,
+                     Metrics& metrics)
+      : offset(start.ix_),
+        query_count(metrics, "cache.query_count"),
+        query_equal_ids(metrics, "cache.query_equal_ids"),
+        query_unequal_hashes(metrics, "cache.query_unequal_hashes"),
+        query_equal_representatives(metrics,
+                                    "cache.query_equal_representatives"),
+        query_inequality_found(metrics, "cache.query_inequality_found"),
+        query_not_found(metrics, "cache.query_not_found"),
+        find_halved(metrics, "cache.find_halved"),
+        union_known(metrics, "cache.union_known"),
+        union_rank_swap(metrics, "cache.union_rank_swap"),
+        union_rank_increase(metrics, "cache.union_rank_increase"),
+        union_rank_zero(metrics, "cache.union_rank_zero"),
+        union_unknown(metrics, "cache.union_unknown"),
+        disunion_known_hash(metrics, "cache.disunion_known_hash"),
+        disunion_known_inequality(metrics, "cache.disunion_known_inequality"),
+        disunion_unknown(metrics, "cache.disunion_unknown") {
+    Check(start.ix_ <= limit.ix_) << "DenseEqualityCache: bad range";
+    const size_t size = limit.ix_ - start.ix_;
+    mapping.reserve(size);
+    for (size_t ix = 0; ix < size; ++ix) {
+      mapping.emplace_back(offset + ix);
+    }
+    rank.resize(size);
+    node_hashes.resize(size);
+    inequalities.resize(size);
+    for (const auto& [id, hash] : hashes) {
+      node_hashes[Index(id)] = hash;
+    }
+  }
+
+  std::optional<bool> Query(const Pair& comparison) {
+    ++query_count;
+    const auto& [id1, id2] = comparison;
+    if (id1 == id2) {
+      ++query_equal_ids;
+      return std::make_optional(true);
+    }
+    if (DistinctHashes(id1, id2)) {
+      ++query_unequal_hashes;
+      return std::make_optional(false);
+    }
+    const Id fid1 = Find(id1);
+    const Id fid2 = Find(id2);
+    if (fid1 == fid2) {
+      ++query_equal_representatives;
+      return std::make_optional(true);
+    }
+    if (Contains(inequalities[Index(fid1)], fid2)) {
+      ++query_inequality_found;
+      return std::make_optional(false);
+    }
+    ++query_not_found;
+    return std::nullopt;
+  }
+
+  void AllSame(std::span<const Pair> comparisons) {
+    for (const auto& [id1, id2] : comparisons) {
+      Union(id1, id2);
+    }
+  }
+
+  void AllDifferent(std::span<const Pair> comparisons) {
+    for (const auto& [id1, id2] : comparisons) {
+      Disunion(id1, id2);
+    }
+  }
+
+  size_t Index(Id id) const {
+    const size_t ix = id.ix_ - offset;
+    if (id.ix_ < offset || ix >= mapping.size()) {
+      Die() << "DenseEqualityCache: out of range access to " << id;
+    }
+    return ix;
+  }
+
+  bool DistinctHashes(Id id1, Id id2) const {
+    const auto& hash1 = node_hashes[Index(id1)];
+    const auto& hash2 = node_hashes[Index(id2)];
+    return hash1 && hash2 && *hash1 != *hash2;
+  }
+
+  Id Find(Id id) {
+    // path halving
+    size_t ix = Index(id);
+    while (true) {
+      auto& parent = mapping[ix];
+      if (parent == id) {
+        return id;
+      }
+      const size_t parent_ix = parent.ix_ - offset;
+      const Id parent_parent = mapping[parent_ix];
+      if (parent_parent == parent) {
+        return parent;
+      }
+      id = parent = parent_parent;
+      ix = id.ix_ - offset;
+      ++find_halved;
+    }
+  }
+
+  void Union(Id id1, Id id2) {
+    Check(!DistinctHashes(id1, id2)) << "union with distinct hashes";
+    Id fid1 = Find(id1);
+    Id fid2 = Find(id2);
+    if (fid1 == fid2) {
+      ++union_known;
+      return;
+    }
+    size_t ix1 = Index(fid1);
+    size_t ix2 = Index(fid2);
+    if (rank[ix1] > rank[ix2]) {
+      std::swap(fid1, fid2);
+      std::swap(ix1, ix2);
+      ++union_rank_swap;
+    }
+    // rank1 <= rank2
+    if (rank[ix1] == rank[ix2]) {
+      ++rank[ix2];
+      ++union_rank_increase;
+    }
+    if (rank[ix1]) {
+      rank[ix1] = 0;
+      ++union_rank_zero;
+    }
+    mapping[ix1] = fid2;
+    ++union_unknown;
+
+    // move inequalities from fid1 to fid2
+    auto& source = inequalities[ix1];
+    if (!source.empty()) {
+      auto& target = inequalities[ix2];
+      for (const auto fid : source) {
+        Check(fid != fid2) << "union of unequal";
+        auto& target2 = inequalities[Index(fid)];
+        Erase(target2, fid1);
+        Insert(target2, fid2);
+      }
+      std::vector<Id> merged;
+      merged.reserve(source.size() + target.size());
+      std::set_union(source.begin(), source.end(), target.begin(),
+                     target.end(), std::back_inserter(merged), Less);
+      target = std::move(merged);
+      source = std::vector<Id>();
+    }
+  }
+
+  void Disunion(Id id1, Id id2) {
+    if (DistinctHashes(id1, id2)) {
+      ++disunion_known_hash;
+      return;
+    }
+    const Id fid1 = Find(id1);
+    const Id fid2 = Find(id2);
+    Check(fid1 != fid2) << "disunion of equal";
+    if (Insert(inequalities[Index(fid1)], fid2)) {
+      Insert(inequalities[Index(fid2)], fid1);
+      ++disunion_unknown;
+    } else {
+      ++disunion_known_inequality;
+    }
+  }
+
+  static bool Less(Id id1, Id id2) {
+    return id1.ix_ < id2.ix_;
+  }
+
+  static bool Contains(const std::vector<Id>& ids, Id id) {
+    return std::binary_search(ids.begin(), ids.end(), id, Less);
+  }
+
+  static bool Insert(std::vector<Id>& ids, Id id) {
+    const auto it = std::lower_bound(ids.begin(), ids.end(), id, Less);
+    if (it != ids.end() && *it == id) {
+      return false;
+    }
+    ids.insert(it, id);
+    return true;
+  }
+
+  static void Erase(std::vector<Id>& ids, Id id) {
+    const auto it = std::lower_bound(ids.begin(), ids.end(), id, Less);
+    if (it != ids.end() && *it == id) {
+      ids.erase(it);
+    }
+  }
+
+  const size_t offset;
+  std::vector<Id> mapping;
+  std::vector<uint8_t> rank;
+  std::vector<std::optional<HashValue64>> node_hashes;
+  std::vector<std::vector<Id>> inequalities;
+
+  OperationCounter query_count;
+  OperationCounter query_equal_ids;
+  OperationCounter query_unequal_hashes;
+  OperationCounter query_equal_representatives;
+  OperationCounter query_inequality_found;
+  OperationCounter query_not_found;
+  OperationCounter find_halved;
+  OperationCounter union_known;
+  OperationCounter union_rank_swap;
+  OperationCounter union_rank_increase;
+  OperationCounter union_rank_zero;
+  OperationCounter union_unknown;
+  OperationCounter disunion_known_hash;
+  OperationCounter disunion_known_inequality;
+  OperationCounter disunion_unknown;
+};
+
+// Equality cache state shared by concurrent workers
+//
+// This holds the same information as DenseEqualityCache, but all operations are
+// thread-safe. Equalities are held in a lock-free union-find. Inequalities are
+// held between the representatives current at the time of recording, in
+// sharded sets. An inequality may be missed after a later union, which only
+// costs a repeated comparison; it is never wrongly reported.
+class SharedEqualityCache {
+ public:
+  SharedEqualityCache(const NodeHashes& hashes, Id start, Id limit,
+                      Metrics& metrics)
+      : offset_(start.ix_),
+        union_find_(start, limit, metrics,
+                    {"cache.find_halved", "cache.union_known",
+                     "cache.union_unknown", "cache.union_rank_swap",
+                     "cache.union_rank_increase", "cache.union_rank_zero"}),
+        node_hashes_(limit.ix_ - start.ix_),
+        shards_(kShards) {
+    for (const auto& [id, hash] : hashes) {
+      node_hashes_[Index(id)] = hash;
+    }
+  }
+
+  bool DistinctHashes(Id id1, Id id2) const {
+    const auto& hash1 = node_hashes_[Index(id1)];
+    const auto& hash2 = node_hashes_[Index(id2)];
+    return hash1 && hash2 && *hash1 != *hash2;
+  }
+
+  Id Find(Id id) {
+    return union_find_.Find(id);
+  }
+
+  void Union(Id id1, Id id2) {
+    union_find_.Union(id1, id2);
+  }
+
+  // Returns true if the inequality was not already known.
+  bool AddInequality(Id fid1, Id fid2) {
+    const auto key = Key(fid1, fid2);
+    auto& shard = GetShard(key);
+    const std::lock_guard<std::mutex> lock(shard.mutex);
+    return shard.pairs.insert(key).second;
+  }
+
+  bool HasInequality(Id fid1, Id fid2) {
+    const auto key = Key(fid1, fid2);
+    auto& shard = GetShard(key);
+    const std::lock_guard<std::mutex> lock(shard.mutex);
+    return shard.pairs.count(key) != 0;
+  }
+
+ private:
+  static constexpr size_t kShards = 64;
+
+  struct Shard {
+    std::mutex mutex;
+    std::unordered_set<Pair> pairs;
+  };
+
+  static Pair Key(Id id1, Id id2) {
+    return id1.ix_ < id2.ix_ ? Pair{id1, id2} : Pair{id2, id1};
+  }
+
+  Shard& GetShard(const Pair& key) {
+    return shards_[std::hash<Pair>()(key) % kShards];
+  }
+
+  size_t Index(Id id) const {
+    const size_t ix = id.ix_ - offset_;
+    if (id.ix_ < offset_ || ix >= node_hashes_.size()) {
+      Die() << "SharedEqualityCache: out of range access to " << id;
+    }
+    return ix;
+  }
+
+  const size_t offset_;
+  ConcurrentUnionFind<Id> union_find_;
+  std::vector<std::optional<HashValue64>> node_hashes_;
+  std::vector<Shard> shards_;
+};
+
+// Equality cache - a per-worker view of a SharedEqualityCache
+//
+// The counters are not thread-safe, so each worker should use its own Metrics.
+// Union-find counters are recorded by the shared cache.
+struct ConcurrentEqualityCache {
+  ConcurrentEqualityCache(SharedEqualityCache& shared, Metrics& metrics)
+      : shared(shared),
+        query_count(metrics, "cache.query_count"),
+        query_equal_ids(metrics, "cache.query_equal_ids"),
+        query_unequal_hashes(metrics, "cache.query_unequal_hashes"),
+        query_equal_representatives(metrics,
+                                    "cache.query_equal_representatives"),
+        query_inequality_found(metrics, "cache.query_inequality_found"),
+        query_not_found(metrics, "cache.query_not_found"),
+        disunion_known_hash(metrics, "cache.disunion_known_hash"),
+        disunion_known_inequality(metrics, "cache.disunion_known_inequality"),
+        disunion_unknown(metrics, "cache.disunion_unknown") {}
+
+  std::optional<bool> Query(const Pair& comparison) {
+    ++query_count;
+    const auto& [id1, id2] = comparison;
+    if (id1 == id2) {
+      ++query_equal_ids;
+      return std::make_optional(true);
+    }
+    if (shared.DistinctHashes(id1, id2)) {
+      ++query_unequal_hashes;
+      return std::make_optional(false);
+    }
+    const Id fid1 = shared.Find(id1);
+    const Id fid2 = shared.Find(id2);
+    if (fid1 == fid2) {
+      ++query_equal_representatives;
+      return std::make_optional(true);
+    }
+    if (shared.HasInequality(fid1, fid2)) {
+      ++query_inequality_found;
+      return std::make_optional(false);
+    }
+    ++query_not_found;
+    return std::nullopt;
+  }
+
+  void AllSame(std::span<const Pair> comparisons) {
+    for (const auto& [id1, id2] : comparisons) {
+      Check(!shared.DistinctHashes(id1, id2)) << "union with distinct hashes";
+      shared.Union(id1, id2);
+    }
+  }
+
+  void AllDifferent(std::span<const Pair> comparisons) {
+    for (const auto& [id1, id2] : comparisons) {
+      if (shared.DistinctHashes(id1, id2)) {
+        ++disunion_known_hash;
+        continue;
+      }
+      const Id fid1 = shared.Find(id1);
+      const Id fid2 = shared.Find(id2);
+      Check(fid1 != fid2) << "disunion of equal";
+      if (shared.AddInequality(fid1, fid2)) {
+        ++disunion_unknown;
+      } else {
+        ++disunion_known_inequality;
+      }
+    }
+  }
+
+  SharedEqualityCache& shared;
+
+  OperationCounter query_count;
+  OperationCounter query_equal_ids;
+  OperationCounter query_unequal_hashes;
+  OperationCounter query_equal_representatives;
+  OperationCounter query_inequality_found;
+  OperationCounter query_not_found;
+  OperationCounter disunion_known_hash;
+  OperationCounter disunion_known_inequality;
+  OperationCounter disunion_unknown;
 };
 
 struct SimpleEqualityCache {
@@ -247,21 +633,21 @@ struct SimpleEqualityCache {
     return std::nullopt;
   }
 
-  void AllSame(const std::vector<Pair>& comparisons) {
+  void AllSame(std::span<const Pair> comparisons) {
     for (const auto& comparison : comparisons) {
       ++known_equality_inserts;
       known_equalities.insert(comparison);
     }
   }
 
-  void AllDifferent(const std::vector<Pair>&) {}
+  void AllDifferent(std::span<const Pair>) {}
 
   std::unordered_set<Pair> known_equalities;
 
-  Counter query_count;
-  Counter query_equal_ids;
-  Counter query_known_equality;
-  Counter known_equality_inserts;
+  OperationCounter query_count;
+  OperationCounter query_equal_ids;
+  OperationCounter query_known_equality;
+  OperationCounter known_equality_inserts;
 };
 
 }  // namespace stg
@@ -0,0 +1,79 @@
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+// -*- mode: C++ -*-
+//
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License v2.0 with LLVM Exceptions (the
+// "License"); you may not use this file except in compliance with the
+// License.  You may obtain a copy of the License at
+//
+//     https://llvm.org/LICENSE.txt
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "equality_cache.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include <catch2/catch.hpp>
+#include "error.h"
+#include "graph.h"
+#include "hashing.h"
+#include "metrics.h"
+#include "node_hashes.h"
+
+namespace Test {
+
+TEST_CASE("dense equality cache matches sparse") {
+  const uint32_t seed = GENERATE(1, 2, 3, 4, 5, 6, 7, 8);
+  std::mt19937 gen(seed);
+  const size_t start = 10;
+  const size_t size = 200;
+  // nodes with the same residue are equal, a few nodes have hashes
+  const size_t classes = 9;
+  std::uniform_int_distribution<size_t> pick(start, start + size - 1);
+  stg::NodeHashes hashes;
+  for (size_t ix = start; ix < start + size; ix += 5) {
+    hashes.Insert(stg::Id(ix), stg::HashValue64(ix % classes));
+  }
+
+  stg::Metrics metrics;
+  stg::EqualityCache sparse(hashes, metrics);
+  stg::DenseEqualityCache dense(hashes, stg::Id(start),
+                                stg::Id(start + size), metrics);
+  for (size_t i = 0; i < 2000; ++i) {
+    const stg::Id id1(pick(gen));
+    const stg::Id id2(pick(gen));
+    const std::vector<stg::Pair> pairs = {{id1, id2}};
+    const auto expected = sparse.Query(pairs[0]);
+    CHECK(dense.Query(pairs[0]) == expected);
+    if (!expected) {
+      if (id1.ix_ % classes == id2.ix_ % classes) {
+        sparse.AllSame(pairs);
+        dense.AllSame(pairs);
+      } else {
+        sparse.AllDifferent(pairs);
+        dense.AllDifferent(pairs);
+      }
+    }
+    CHECK((dense.Find(id1) == dense.Find(id2))
+          == (sparse.Find(id1) == sparse.Find(id2)));
+  }
+}
+
+TEST_CASE("dense equality cache range") {
+  stg::Metrics metrics;
+  stg::DenseEqualityCache cache({}, stg::Id(3), stg::Id(6), metrics);
+  CHECK(cache.Find(stg::Id(3)) == stg::Id(3));
+  CHECK_THROWS_AS(cache.Find(stg::Id(2)), stg::Exception);
+  CHECK_THROWS_AS(cache.Query({stg::Id(5), stg::Id(6)}), stg::Exception);
+}
+
+}  // namespace Test
@@ -0,0 +1,101 @@
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+// -*- mode: C++ -*-
+//
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License v2.0 with LLVM Exceptions (the
+// "License"); you may not use this file except in compliance with the
+// License.  You may obtain a copy of the License at
+//
+//     https://llvm.org/LICENSE.txt
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "equality.h"
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include <catch2/catch.hpp>
+#include "equality_cache.h"
+#include "graph.h"
+#include "metrics.h"
+#include "node_hashes.h"
+
+namespace Test {
+
+// Builds a linked list of named structs of the given length, each with a
+// pointer to the next. The last one has a member of the given type. Returns
+// the first struct.
+stg::Id BuildChain(stg::Graph& graph, size_t length, stg::Id last) {
+  stg::Id next = last;
+  for (size_t i = length; i > 0; --i) {
+    const auto pointer = graph.Add<stg::PointerReference>(
+        stg::PointerReference::Kind::POINTER, next);
+    const auto member = graph.Add<stg::Member>("next", pointer, 0, 0);
+    next = graph.Add<stg::StructUnion>(
+        stg::StructUnion::Kind::STRUCT, "node_" + std::to_string(i), 8,
+        std::vector<stg::Id>{}, std::vector<stg::Id>{},
+        std::vector<stg::Id>{member});
+  }
+  return next;
+}
+
+TEST_CASE("deep chains") {
+  // far deeper than a recursive search could manage on a normal stack
+  const size_t length = 200000;
+  stg::Graph graph;
+  const auto int_type = graph.Add<stg::Primitive>(
+      "int", stg::Primitive::Encoding::SIGNED_INTEGER, 4);
+  const auto char_type = graph.Add<stg::Primitive>(
+      "char", stg::Primitive::Encoding::SIGNED_CHARACTER, 1);
+  const auto chain1 = BuildChain(graph, length, int_type);
+  const auto chain2 = BuildChain(graph, length, int_type);
+  const auto chain3 = BuildChain(graph, length, char_type);
+
+  const stg::NodeHashes hashes;
+  stg::Metrics metrics;
+  stg::EqualityCache cache(hashes, metrics);
+  stg::Equals<stg::EqualityCache> equals(graph, cache);
+  CHECK(equals(chain1, chain2));
+  CHECK(!equals(chain1, chain3));
+  CHECK(!equals(chain3, chain2));
+  CHECK(equals.scc.Empty());
+}
+
+TEST_CASE("cycles") {
+  // struct a { struct a* next; } in two copies, and a variant with an extra
+  // level of indirection
+  stg::Graph graph;
+  auto cycle = [&](size_t pointers) {
+    const auto id = graph.Allocate();
+    stg::Id type = id;
+    for (size_t i = 0; i < pointers; ++i) {
+      type = graph.Add<stg::PointerReference>(
+          stg::PointerReference::Kind::POINTER, type);
+    }
+    const auto member = graph.Add<stg::Member>("next", type, 0, 0);
+    graph.Set<stg::StructUnion>(
+        id, stg::StructUnion::Kind::STRUCT, "a", 8, std::vector<stg::Id>{},
+        std::vector<stg::Id>{}, std::vector<stg::Id>{member});
+    return id;
+  };
+  const auto a1 = cycle(1);
+  const auto a2 = cycle(1);
+  const auto b = cycle(2);
+
+  const stg::NodeHashes hashes;
+  stg::Metrics metrics;
+  stg::EqualityCache cache(hashes, metrics);
+  stg::Equals<stg::EqualityCache> equals(graph, cache);
+  CHECK(equals(a1, a2));
+  CHECK(!equals(a1, b));
+  CHECK(equals.scc.Empty());
+}
+
+}  // namespace Test
@@ -19,30 +19,33 @@
 
 #include "fidelity.h"
 
-#include <map>
+#include <algorithm>
+#include <cstddef>
 #include <ostream>
-#include <set>
 #include <string>
-#include <unordered_map>
 #include <utility>
 #include <vector>
 
+#include "flat_map.h"
 #include "graph.h"
 #include "naming.h"
+#include "parallel.h"
 
 namespace stg {
 
 namespace {
 
+// Finds the fidelity of the symbols and named types reachable from a root. The
+// nodes seen are tracked densely by id and types are recorded by id, to be
+// named afterwards, so that roots can be traversed concurrently.
 struct Fidelity {
-  Fidelity(const Graph& graph, NameCache& name_cache)
-      : graph(graph), describe(graph, name_cache), seen(Id(0)) {
+  explicit Fidelity(const Graph& graph) : graph(graph), seen(Id(0)) {
     seen.Reserve(graph.Limit());
   }
 
   void operator()(Id);
-  void operator()(const std::vector<Id>&);
-  void operator()(const std::map<std::string, Id>&);
+  void operator()(const Ids&);
+  void operator()(const FlatMap<std::string, Id>&);
   void operator()(const Special&, Id);
   void operator()(const PointerReference&, Id);
   void operator()(const PointerToMember&, Id);
@@ -60,10 +63,9 @@ struct Fidelity {
   void operator()(const Interface&, Id);
 
   const Graph& graph;
-  Describe describe;
   DenseIdSet seen;
-  std::unordered_map<std::string, SymbolFidelity> symbols;
-  std::unordered_map<std::string, TypeFidelity> types;
+  std::vector<std::pair<std::string, SymbolFidelity>> symbols;
+  std::vector<std::pair<Id, TypeFidelity>> types;
 };
 
 void Fidelity::operator()(Id id) {
@@ -72,13 +74,13 @@ void Fidelity::operator()(Id id) {
   }
 }
 
-void Fidelity::operator()(const std::vector<Id>& x) {
+void Fidelity::operator()(const Ids& x) {
   for (auto id : x) {
     (*this)(id);
   }
 }
 
-void Fidelity::operator()(const std::map<std::string, Id>& x) {
+void Fidelity::operator()(const FlatMap<std::string, Id>& x) {
   for (const auto& [_, id] : x) {
     (*this)(id);
   }
@@ -123,11 +125,8 @@ void Fidelity::operator()(const Member& x, Id) {
 
 void Fidelity::operator()(const StructUnion& x, Id id) {
   if (!x.name.empty()) {
-    auto [it, _] =
-        types.emplace(describe(id).ToString(), TypeFidelity::DECLARATION_ONLY);
-    if (x.definition) {
-      it->second = TypeFidelity::FULLY_DEFINED;
-    }
+    types.emplace_back(id, x.definition ? TypeFidelity::FULLY_DEFINED
+                                        : TypeFidelity::DECLARATION_ONLY);
   }
   if (x.definition) {
     (*this)(x.definition->base_classes);
@@ -138,11 +137,8 @@ void Fidelity::operator()(const StructUnion& x, Id id) {
 
 void Fidelity::operator()(const Enumeration& x, Id id) {
   if (!x.name.empty()) {
-    auto [it, _] =
-        types.emplace(describe(id).ToString(), TypeFidelity::DECLARATION_ONLY);
-    if (x.definition) {
-      it->second = TypeFidelity::FULLY_DEFINED;
-    }
+    types.emplace_back(id, x.definition ? TypeFidelity::FULLY_DEFINED
+                                        : TypeFidelity::DECLARATION_ONLY);
   }
 }
 
@@ -152,10 +148,10 @@ void Fidelity::operator()(const Function& x, Id) {
 }
 
 void Fidelity::operator()(const ElfSymbol& x, Id) {
-  auto symbol = VersionedSymbolName(x);
-  auto [it, _] = symbols.emplace(symbol, SymbolFidelity::UNTYPED);
+  symbols.emplace_back(VersionedSymbolName(x), x.type_id
+                                                   ? SymbolFidelity::TYPED
+                                                   : SymbolFidelity::UNTYPED);
   if (x.type_id) {
-    it->second = SymbolFidelity::TYPED;
     (*this)(*x.type_id);
   }
 }
@@ -165,18 +161,31 @@ void Fidelity::operator()(const Interface& x, Id) {
   (*this)(x.types);
 }
 
+// Sorts by name, keeping only the highest fidelity of each.
 template <typename T>
-std::set<std::string> GetKeys(
-    const std::unordered_map<std::string, T>& x1,
-    const std::unordered_map<std::string, T>& x2) {
-  std::set<std::string> keys;
-  for (const auto& [key, _] : x1) {
-    keys.insert(key);
-  }
-  for (const auto& [key, _] : x2) {
-    keys.insert(key);
+void SortByName(std::vector<std::pair<std::string, T>>& x) {
+  std::sort(x.begin(), x.end(), [](const auto& a, const auto& b) {
+    return a.first != b.first ? a.first < b.first : a.second > b.second;
+  });
+  x.erase(std::unique(x.begin(), x.end(),
+                      [](const auto& a, const auto& b) {
+                        return a.first == b.first;
+                      }),
+          x.end());
+}
+
+// Names the types found, using the cache.
+Fidelities Finish(const Graph& graph, Fidelity& fidelity, NameCache& names) {
+  Fidelities result;
+  result.symbols = std::move(fidelity.symbols);
+  SortByName(result.symbols);
+  Describe describe(graph, names);
+  result.types.reserve(fidelity.types.size());
+  for (const auto& [id, type_fidelity] : fidelity.types) {
+    result.types.emplace_back(describe(id).ToString(), type_fidelity);
   }
-  return keys;
+  SortByName(result.types);
+  return result;
 }
 
 void InsertTransition(FidelityDiff& diff, SymbolFidelityTransition transition,
@@ -189,16 +198,30 @@ void InsertTransition(FidelityDiff& diff, TypeFidelityTransition transition,
   diff.type_transitions[transition].push_back(type);
 }
 
+// Merges the sorted names, a missing one being ABSENT.
 template <typename T>
 void InsertTransitions(FidelityDiff& diff,
-                       const std::unordered_map<std::string, T>& x1,
-                       const std::unordered_map<std::string, T>& x2) {
-  for (const auto& key : GetKeys(x1, x2)) {
-    auto it1 = x1.find(key);
-    auto it2 = x2.find(key);
-    auto transition = std::make_pair(it1 == x1.end() ? T() : it1->second,
-                                     it2 == x2.end() ? T() : it2->second);
-    InsertTransition(diff, transition, key);
+                       const std::vector<std::pair<std::string, T>>& x1,
+                       const std::vector<std::pair<std::string, T>>& x2) {
+  auto it1 = x1.begin();
+  auto it2 = x2.begin();
+  const auto insert = [&](const std::string& key, T from, T to) {
+    if (from != to) {
+      InsertTransition(diff, std::make_pair(from, to), key);
+    }
+  };
+  while (it1 != x1.end() || it2 != x2.end()) {
+    if (it2 == x2.end() || (it1 != x1.end() && it1->first < it2->first)) {
+      insert(it1->first, it1->second, T());
+      ++it1;
+    } else if (it1 == x1.end() || it2->first < it1->first) {
+      insert(it2->first, T(), it2->second);
+      ++it2;
+    } else {
+      insert(it1->first, it1->second, it2->second);
+      ++it1;
+      ++it2;
+    }
   }
 }
 
@@ -234,17 +257,38 @@ std::ostream& operator<<(std::ostream& os, TypeFidelityTransition x) {
   return os << "type(s) changed from " << x.first << " to " << x.second;
 }
 
-FidelityDiff GetFidelityTransitions(const Graph& graph, Id root1, Id root2) {
-  NameCache name_cache;
-  Fidelity fidelity1(graph, name_cache);
-  Fidelity fidelity2(graph, name_cache);
-  fidelity1(root1);
-  fidelity2(root2);
+Fidelities GetFidelities(const Graph& graph, Id root, NameCache& names) {
+  Fidelity fidelity(graph);
+  fidelity(root);
+  return Finish(graph, fidelity, names);
+}
+
+std::pair<Fidelities, Fidelities> GetFidelities(const Graph& graph, Id root1,
+                                                Id root2, NameCache& names,
+                                                size_t jobs) {
+  Fidelity fidelity1(graph);
+  Fidelity fidelity2(graph);
+  ForEachIndex(jobs, 2, [&](size_t, size_t ix) {
+    ix == 0 ? fidelity1(root1) : fidelity2(root2);
+  });
+  auto result1 = Finish(graph, fidelity1, names);
+  return {std::move(result1), Finish(graph, fidelity2, names)};
+}
 
+FidelityDiff GetFidelityTransitions(const Fidelities& fidelities1,
+                                    const Fidelities& fidelities2) {
   FidelityDiff diff;
-  InsertTransitions(diff, fidelity1.symbols, fidelity2.symbols);
-  InsertTransitions(diff, fidelity1.types, fidelity2.types);
+  InsertTransitions(diff, fidelities1.symbols, fidelities2.symbols);
+  InsertTransitions(diff, fidelities1.types, fidelities2.types);
   return diff;
 }
 
+FidelityDiff GetFidelityTransitions(const Graph& graph, Id root1, Id root2,
+                                    size_t jobs) {
+  NameCache names;
+  const auto [fidelities1, fidelities2] =
+      GetFidelities(graph, root1, root2, names, jobs);
+  return GetFidelityTransitions(fidelities1, fidelities2);
+}
+
 }  // namespace stg
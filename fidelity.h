@@ -29,6 +29,7 @@
 #include <vector>
 
 #include "graph.h"
+#include "naming.h"
 
 namespace stg {
 
@@ -74,6 +75,7 @@ struct hash<stg::TypeFidelityTransition> {
 
 namespace stg {
 
+// Only the names whose fidelity changed are recorded, in order.
 struct FidelityDiff {
   std::unordered_map<SymbolFidelityTransition, std::vector<std::string>>
       symbol_transitions;
@@ -81,7 +83,28 @@ struct FidelityDiff {
       type_transitions;
 };
 
-FidelityDiff GetFidelityTransitions(const Graph& graph, Id root1, Id root2);
+// The fidelity of every symbol and named type reachable from a root, sorted by
+// name. Where several nodes have the same name, the highest fidelity is kept.
+struct Fidelities {
+  std::vector<std::pair<std::string, SymbolFidelity>> symbols;
+  std::vector<std::pair<std::string, TypeFidelity>> types;
+};
+
+// Type names are taken from (and added to) the given cache, which may be shared
+// with reporting. The result for one root can be reused across several diffs.
+Fidelities GetFidelities(const Graph& graph, Id root, NameCache& names);
+
+// As above, for two roots, which are traversed concurrently if jobs allow. The
+// types are named afterwards, as the cache is not shared between threads.
+std::pair<Fidelities, Fidelities> GetFidelities(const Graph& graph, Id root1,
+                                                Id root2, NameCache& names,
+                                                size_t jobs);
+
+FidelityDiff GetFidelityTransitions(const Fidelities& fidelities1,
+                                    const Fidelities& fidelities2);
+
+FidelityDiff GetFidelityTransitions(const Graph& graph, Id root1, Id root2,
+                                    size_t jobs = 1);
 
 }  // namespace stg
 
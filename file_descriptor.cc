@@ -21,10 +21,18 @@
 #include "file_descriptor.h"
 
 #include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
 #include <cerrno>
+#include <cstddef>
+#include <cstdint>
 #include <exception>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
 
 #include "error.h"
 
@@ -37,6 +45,12 @@ FileDescriptor::FileDescriptor(const char* filename, int flags, mode_t mode)
   }
 }
 
+FileDescriptor::FileDescriptor(int fd) : fd_(fd) {
+  if (fd_ < 0) {
+    Die() << "invalid file descriptor: " << fd_;
+  }
+}
+
 FileDescriptor::~FileDescriptor() noexcept(false) {
   // If we're unwinding, ignore any close failure.
   if (fd_ >= 0 && close(fd_) != 0 && std::uncaught_exceptions() == 0) {
@@ -51,4 +65,96 @@ int FileDescriptor::Value() const {
   return fd_;
 }
 
+MemoryMap::MemoryMap(const FileDescriptor& fd) {
+  struct stat st;
+  if (fstat(fd.Value(), &st) != 0) {
+    Die() << "fstat failed: " << Error(errno);
+  }
+  // zero-length mappings are not allowed
+  if (st.st_size > 0) {
+    void* data = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd.Value(),
+                      0);
+    if (data == MAP_FAILED) {
+      Die() << "mmap failed: " << Error(errno);
+    }
+    data_ = data;
+    size_ = st.st_size;
+  }
+}
+
+std::optional<MemoryMap> MemoryMap::TryMap(const FileDescriptor& fd) {
+  struct stat st;
+  if (fstat(fd.Value(), &st) != 0 || !S_ISREG(st.st_mode)) {
+    return {};
+  }
+  MemoryMap map;
+  // zero-length mappings are not allowed
+  if (st.st_size > 0) {
+    void* data = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd.Value(),
+                      0);
+    if (data == MAP_FAILED) {
+      return {};
+    }
+    map.data_ = data;
+    map.size_ = st.st_size;
+  }
+  return {std::move(map)};
+}
+
+MemoryMap::~MemoryMap() noexcept(false) {
+  // If we're unwinding, ignore any munmap failure.
+  if (data_ != nullptr && munmap(data_, size_) != 0
+      && std::uncaught_exceptions() == 0) {
+    Die() << "munmap failed: " << Error(errno);
+  }
+  data_ = nullptr;
+}
+
+std::string_view MemoryMap::Contents() const {
+  return {static_cast<const char*>(data_), size_};
+}
+
+std::string ReadContents(const FileDescriptor& fd) {
+  std::string contents;
+  char buffer[1 << 16];
+  while (true) {
+    const ssize_t count = read(fd.Value(), buffer, sizeof(buffer));
+    if (count < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      Die() << "read failed: " << Error(errno);
+    }
+    if (count == 0) {
+      break;
+    }
+    contents.append(buffer, count);
+  }
+  return contents;
+}
+
+void PrefetchFile(const char* filename) {
+  const int fd = open(filename, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return;
+  }
+  struct stat st;
+  if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+    posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+  }
+  close(fd);
+}
+
+void PrefetchMemory(std::string_view contents) {
+  if (contents.empty()) {
+    return;
+  }
+  // the range must start on a page boundary
+  const auto page = static_cast<uintptr_t>(sysconf(_SC_PAGESIZE));
+  const auto begin = reinterpret_cast<uintptr_t>(contents.data());
+  const auto start = begin & ~(page - 1);
+  madvise(reinterpret_cast<void*>(start), begin + contents.size() - start,
+          MADV_WILLNEED);
+}
+
 }  // namespace stg
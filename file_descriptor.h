@@ -23,6 +23,10 @@
 
 #include <sys/stat.h>  // for mode_t
 
+#include <cstddef>
+#include <optional>
+#include <string>
+#include <string_view>
 #include <utility>
 
 namespace stg {
@@ -32,6 +36,8 @@ class FileDescriptor {
  public:
   FileDescriptor() = default;
   FileDescriptor(const char* filename, int flags, mode_t mode = 0);
+  // Takes ownership of an already open file descriptor, such as a socket.
+  explicit FileDescriptor(int fd);
   FileDescriptor(const FileDescriptor&) = delete;
   FileDescriptor& operator=(const FileDescriptor&) = delete;
   FileDescriptor(FileDescriptor&& other) noexcept {
@@ -46,6 +52,40 @@ class FileDescriptor {
   int fd_ = -1;
 };
 
+// RAII wrapper over a read-only, shared memory mapping of an entire file
+class MemoryMap {
+ public:
+  explicit MemoryMap(const FileDescriptor& fd);
+  // Returns nothing if the file is not a regular file or cannot be mapped.
+  static std::optional<MemoryMap> TryMap(const FileDescriptor& fd);
+  MemoryMap(const MemoryMap&) = delete;
+  MemoryMap& operator=(const MemoryMap&) = delete;
+  MemoryMap(MemoryMap&& other) noexcept {
+    std::swap(data_, other.data_);
+    std::swap(size_, other.size_);
+  }
+  MemoryMap& operator=(MemoryMap&& other) = delete;
+  ~MemoryMap() noexcept(false);
+
+  std::string_view Contents() const;
+
+ private:
+  MemoryMap() = default;
+
+  void* data_ = nullptr;
+  size_t size_ = 0;
+};
+
+// Reads the entire contents of a file, from its current position, for files
+// that cannot be mapped.
+std::string ReadContents(const FileDescriptor& fd);
+
+// Asks the kernel to start reading a whole file, or some mapped memory, into
+// the page cache, so that later reads overlap with other work rather than
+// stall. These are only hints: they do not wait and failures are ignored.
+void PrefetchFile(const char* filename);
+void PrefetchMemory(std::string_view contents);
+
 }  // namespace stg
 
 #endif  // STG_FILE_DESCRIPTOR_H_
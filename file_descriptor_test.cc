@@ -22,6 +22,7 @@
 #include <fcntl.h>
 #include <unistd.h>
 
+#include <string>
 #include <utility>
 
 #include <catch2/catch.hpp>
@@ -65,4 +66,53 @@ TEST_CASE("ownership transfer on move") {
   CHECK(fd_val == fd3.Value());
 }
 
+TEST_CASE("empty memory map") {
+  const stg::FileDescriptor fd("/dev/null", O_RDONLY);
+  const stg::MemoryMap map(fd);
+  CHECK(map.Contents().empty());
+}
+
+TEST_CASE("memory map contents") {
+  const stg::FileDescriptor fd("testdata/qualifier_0.stg", O_RDONLY);
+  const stg::MemoryMap map(fd);
+  std::string contents;
+  char buffer[256];
+  ssize_t count;
+  while ((count = read(fd.Value(), buffer, sizeof(buffer))) > 0) {
+    contents.append(buffer, count);
+  }
+  CHECK(!contents.empty());
+  CHECK(map.Contents() == contents);
+}
+
+TEST_CASE("try memory map") {
+  const stg::FileDescriptor fd("testdata/qualifier_0.stg", O_RDONLY);
+  const auto map = stg::MemoryMap::TryMap(fd);
+  REQUIRE(map);
+  CHECK(map->Contents() == stg::MemoryMap(fd).Contents());
+
+  const stg::FileDescriptor null("/dev/null", O_RDONLY);
+  CHECK(!stg::MemoryMap::TryMap(null));
+}
+
+TEST_CASE("read contents") {
+  const stg::FileDescriptor fd("testdata/qualifier_0.stg", O_RDONLY);
+  const stg::MemoryMap map(fd);
+  CHECK(stg::ReadContents(fd) == map.Contents());
+
+  const stg::FileDescriptor null("/dev/null", O_RDONLY);
+  CHECK(stg::ReadContents(null).empty());
+}
+
+TEST_CASE("memory map ownership transfer on move") {
+  const stg::FileDescriptor fd("testdata/qualifier_0.stg", O_RDONLY);
+  stg::MemoryMap map(fd);
+  const auto contents = map.Contents();
+  CHECK(!contents.empty());
+
+  auto map2(std::move(map));
+  CHECK(map.Contents().empty());
+  CHECK(map2.Contents().data() == contents.data());
+}
+
 }  // namespace Test
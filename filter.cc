@@ -26,7 +26,9 @@
 #include <cstddef>
 #include <cstring>
 #include <fstream>
+#include <functional>
 #include <memory>
+#include <optional>
 #include <ostream>
 #include <queue>
 #include <sstream>
@@ -34,13 +36,23 @@
 #include <string_view>
 #include <unordered_set>
 #include <utility>
+#include <variant>
+#include <vector>
 
 #include "error.h"
 
 namespace stg {
 namespace {
 
-using Items = std::unordered_set<std::string>;
+// Transparent hashing so that items can be looked up by std::string_view.
+struct ItemHash {
+  using is_transparent = void;
+  size_t operator()(std::string_view item) const {
+    return std::hash<std::string_view>{}(item);
+  }
+};
+
+using Items = std::unordered_set<std::string, ItemHash, std::equal_to<>>;
 
 Items ReadAbigail(const std::string& filename) {
   static constexpr std::string_view kSectionSuffix = "list";
@@ -94,7 +106,7 @@ class NotFilter : public Filter {
  public:
   explicit NotFilter(std::unique_ptr<Filter> filter)
       : filter_(std::move(filter)) {}
-  bool operator()(const std::string& item) const final {
+  bool operator()(std::string_view item) const final {
     return !(*filter_)(item);
   };
 
@@ -108,7 +120,7 @@ class AndFilter : public Filter {
   AndFilter(std::unique_ptr<Filter> filter1,
             std::unique_ptr<Filter> filter2)
       : filter1_(std::move(filter1)), filter2_(std::move(filter2)) {}
-  bool operator()(const std::string& item) const final {
+  bool operator()(std::string_view item) const final {
     return (*filter1_)(item) && (*filter2_)(item);
   };
 
@@ -123,7 +135,7 @@ class OrFilter : public Filter {
   OrFilter(std::unique_ptr<Filter> filter1,
            std::unique_ptr<Filter> filter2)
       : filter1_(std::move(filter1)), filter2_(std::move(filter2)) {}
-  bool operator()(const std::string& item) const final {
+  bool operator()(std::string_view item) const final {
     return (*filter1_)(item) || (*filter2_)(item);
   };
 
@@ -133,15 +145,69 @@ class OrFilter : public Filter {
 };
 
 // Glob filter.
+//
+// Patterns whose only metacharacter is '*' are precompiled into their literal
+// pieces and matched directly. Anything else is left to fnmatch.
 class GlobFilter : public Filter {
  public:
-  explicit GlobFilter(const std::string& pattern) : pattern_(pattern) {}
-  bool operator()(const std::string& item) const final {
-    return fnmatch(pattern_.c_str(), item.c_str(), 0) == 0;
+  explicit GlobFilter(const std::string& pattern)
+      : pattern_(pattern), pieces_(Split(pattern)) {}
+  bool operator()(std::string_view item) const final {
+    if (!pieces_) {
+      const std::string copy(item);
+      return fnmatch(pattern_.c_str(), copy.c_str(), 0) == 0;
+    }
+    return Match(*pieces_, item);
   }
 
  private:
+  using Pieces = std::vector<std::string>;
+
+  static std::optional<Pieces> Split(const std::string& pattern) {
+    if (pattern.find_first_of("?[\\") != std::string::npos) {
+      return {};
+    }
+    Pieces pieces;
+    size_t start = 0;
+    while (true) {
+      const size_t star = pattern.find('*', start);
+      if (star == std::string::npos) {
+        pieces.push_back(pattern.substr(start));
+        return {std::move(pieces)};
+      }
+      pieces.push_back(pattern.substr(start, star - start));
+      start = star + 1;
+    }
+  }
+
+  // There is one more piece than there are stars. The first and last pieces
+  // are anchored and the middle ones are matched leftmost, which is sufficient
+  // as the stars in between can absorb anything.
+  static bool Match(const Pieces& pieces, std::string_view item) {
+    const std::string& first = pieces.front();
+    if (pieces.size() == 1) {
+      return item == first;
+    }
+    const std::string& last = pieces.back();
+    if (item.size() < first.size() + last.size()
+        || !item.starts_with(first) || !item.ends_with(last)) {
+      return false;
+    }
+    item.remove_prefix(first.size());
+    item.remove_suffix(last.size());
+    for (size_t ix = 1; ix + 1 < pieces.size(); ++ix) {
+      const std::string& piece = pieces[ix];
+      const size_t found = item.find(piece);
+      if (found == std::string_view::npos) {
+        return false;
+      }
+      item.remove_prefix(found + piece.size());
+    }
+    return true;
+  }
+
   const std::string pattern_;
+  const std::optional<Pieces> pieces_;
 };
 
 // Literal list filter.
@@ -149,8 +215,8 @@ class SetFilter : public Filter {
  public:
   explicit SetFilter(Items&& items)
       : items_(std::move(items)) {}
-  bool operator()(const std::string& item) const final {
-    return items_.count(item) > 0;
+  bool operator()(std::string_view item) const final {
+    return items_.find(item) != items_.end();
   };
 
  private:
@@ -207,10 +273,21 @@ std::unique_ptr<Filter> Fail(
   Die() << os.str();
 }
 
-std::unique_ptr<Filter> Expression(std::queue<std::string>& tokens);
+// The result of parsing. Literal items are kept unwrapped until needed, so that
+// alternatives can be merged into a single set lookup.
+using Parsed = std::variant<Items, std::unique_ptr<Filter>>;
+
+std::unique_ptr<Filter> Build(Parsed&& parsed) {
+  if (auto* items = std::get_if<Items>(&parsed)) {
+    return std::make_unique<SetFilter>(std::move(*items));
+  }
+  return std::move(std::get<std::unique_ptr<Filter>>(parsed));
+}
+
+Parsed Expression(std::queue<std::string>& tokens);
 
 // Parse a filter atom.
-std::unique_ptr<Filter> Atom(std::queue<std::string>& tokens) {
+Parsed Atom(std::queue<std::string>& tokens) {
   if (tokens.empty()) {
     return Fail("expected a filter expression", tokens);
   }
@@ -229,17 +306,20 @@ std::unique_ptr<Filter> Atom(std::queue<std::string>& tokens) {
     }
     token = tokens.front();
     tokens.pop();
-    return std::make_unique<SetFilter>(ReadAbigail(token));
+    return ReadAbigail(token);
   } else {
     if (std::strchr(kTokenCharacters, token[0])) {
       return Fail("expected a glob token", tokens);
     }
+    if (token.find_first_of("*?[\\") == std::string::npos) {
+      return Items{token};
+    }
     return std::make_unique<GlobFilter>(token);
   }
 }
 
 // Parse a filter factor.
-std::unique_ptr<Filter> Factor(std::queue<std::string>& tokens) {
+Parsed Factor(std::queue<std::string>& tokens) {
   bool invert = false;
   while (!tokens.empty() && tokens.front() == "!") {
     tokens.pop();
@@ -247,29 +327,60 @@ std::unique_ptr<Filter> Factor(std::queue<std::string>& tokens) {
   }
   auto atom = Atom(tokens);
   if (invert) {
-    atom = std::make_unique<NotFilter>(std::move(atom));
+    return std::make_unique<NotFilter>(Build(std::move(atom)));
   }
   return atom;
 }
 
 // Parse a filter term.
-std::unique_ptr<Filter> Term(std::queue<std::string>& tokens) {
+Parsed Term(std::queue<std::string>& tokens) {
   auto factor = Factor(tokens);
+  if (tokens.empty() || tokens.front() != "&") {
+    return factor;
+  }
+  auto term = Build(std::move(factor));
   while (!tokens.empty() && tokens.front() == "&") {
     tokens.pop();
-    factor = std::make_unique<AndFilter>(std::move(factor), Factor(tokens));
+    term = std::make_unique<AndFilter>(std::move(term),
+                                       Build(Factor(tokens)));
   }
-  return factor;
+  return term;
 }
 
 // Parse a filter expression.
-std::unique_ptr<Filter> Expression(std::queue<std::string>& tokens) {
-  auto term = Term(tokens);
-  while (!tokens.empty() && tokens.front() == "|") {
+//
+// Disjunction is commutative and evaluation has no side effects, so all the
+// literal alternatives are gathered into one set, which is tested first.
+Parsed Expression(std::queue<std::string>& tokens) {
+  std::optional<Items> literals;
+  std::unique_ptr<Filter> others;
+  while (true) {
+    auto term = Term(tokens);
+    if (auto* items = std::get_if<Items>(&term)) {
+      if (literals) {
+        literals->merge(*items);
+      } else {
+        literals = std::move(*items);
+      }
+    } else {
+      auto filter = std::move(std::get<std::unique_ptr<Filter>>(term));
+      others = others ? std::make_unique<OrFilter>(std::move(others),
+                                                   std::move(filter))
+                      : std::move(filter);
+    }
+    if (tokens.empty() || tokens.front() != "|") {
+      break;
+    }
     tokens.pop();
-    term = std::make_unique<OrFilter>(std::move(term), Term(tokens));
   }
-  return term;
+  if (!others) {
+    return std::move(*literals);
+  }
+  if (!literals) {
+    return others;
+  }
+  return std::make_unique<OrFilter>(
+      std::make_unique<SetFilter>(std::move(*literals)), std::move(others));
 }
 
 }  // namespace
@@ -278,7 +389,7 @@ std::unique_ptr<Filter> Expression(std::queue<std::string>& tokens) {
 std::unique_ptr<Filter> MakeFilter(const std::string& filter)
 {
   auto tokens = Tokenise(filter);
-  auto result = Expression(tokens);
+  auto result = Build(Expression(tokens));
   if (!tokens.empty()) {
     return Fail("unexpected junk at end of filter", tokens);
   }
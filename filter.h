@@ -23,6 +23,7 @@
 #include <memory>
 #include <ostream>
 #include <string>
+#include <string_view>
 
 namespace stg {
 
@@ -31,7 +32,7 @@ class Filter {
  public:
   virtual ~Filter() = default;
   // Filter predicate evaluation.
-  virtual bool operator()(const std::string& item) const = 0;
+  virtual bool operator()(std::string_view item) const = 0;
 };
 
 // Tokenise and parse a filter expression.
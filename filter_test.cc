@@ -19,6 +19,8 @@
 
 #include "filter.h"
 
+#include <fnmatch.h>
+
 #include <sstream>
 #include <string>
 #include <tuple>
@@ -101,6 +103,13 @@ TEST_CASE("hand-curated cases") {
     {"!:/dev/null", {"", "a"}, {}},
     {":" + testdata + "/symbol_list", {"one"}, {"#", "bad"}},
     {"!:" + testdata + "/symbol_list", {"", " "}, {"two"}},
+    {"a | b* | c",  {"a", "b", "bc", "c"}, {"", "ab", "d"}},
+    {"a | (b | c)", {"a", "b", "c"}, {"", "d"}},
+    {"a | b & c | d", {"a", "d"}, {"b", "c"}},
+    {"*a*b*",       {"ab", "xaxbx", "aab", "bab"}, {"", "ba", "b", "a"}},
+    {"a*a",         {"aa", "aba", "aaa"}, {"a", "ab", "ba"}},
+    {"a\\*",        {"a*"}, {"a", "ab"}},
+    {"[ab]c",       {"ac", "bc"}, {"c", "cc", "abc"}},
   };
 
   for (const auto& [expression, ins, outs] : cases) {
@@ -121,4 +130,25 @@ TEST_CASE("hand-curated cases") {
   }
 }
 
+TEST_CASE("globs match fnmatch") {
+  const std::vector<std::string> patterns = {
+    "*", "**", "a*", "*a", "*a*", "a*b", "a*b*c", "*ab*ab", "ab*ba", "a**a",
+  };
+  const std::vector<std::string> items = {
+    "", "a", "b", "aa", "ab", "ba", "aba", "abab", "abba", "abcab", "aabb",
+    "bab", "abc", "acbc", "aXbYc",
+  };
+  for (const auto& pattern : patterns) {
+    GIVEN("glob: " + pattern) {
+      auto filter = stg::MakeFilter(pattern);
+      for (const auto& item : items) {
+        GIVEN("item: " + item) {
+          CHECK((*filter)(item)
+                == (fnmatch(pattern.c_str(), item.c_str(), 0) == 0));
+        }
+      }
+    }
+  }
+}
+
 }  // namespace Test
@@ -19,29 +19,63 @@
 
 #include "fingerprint.h"
 
-#include <map>
+#include <algorithm>
+#include <cstddef>
+#include <numeric>
+#include <optional>
+#include <span>
 #include <string>
 #include <unordered_map>
 #include <unordered_set>
 #include <utility>
 #include <vector>
 
+#include "flat_map.h"
 #include "graph.h"
 #include "hashing.h"
 #include "metrics.h"
+#include "node_hashes.h"
+#include "parallel.h"
+#include "predecessors.h"
 #include "scc.h"
 
 namespace stg {
 namespace {
 
+// Hashers record fingerprints either directly in the result or, when working
+// concurrently, in sparse per-worker maps that are merged into it.
+const HashValue64* Find(const NodeHashes& hashes, Id id) {
+  return hashes.Find(id);
+}
+
+const HashValue64* Find(const std::unordered_map<Id, HashValue64>& hashes,
+                        Id id) {
+  const auto it = hashes.find(id);
+  return it != hashes.end() ? &it->second : nullptr;
+}
+
+void Insert(NodeHashes& hashes, Id id, HashValue64 hash) {
+  hashes.Insert(id, hash);
+}
+
+void Insert(std::unordered_map<Id, HashValue64>& hashes, Id id,
+            HashValue64 hash) {
+  hashes.insert({id, hash});
+}
+
+template <typename Hashes>
 struct Hasher {
-  Hasher(const Graph& graph, std::unordered_map<Id, HashValue>& hashes,
-         std::unordered_set<Id>& todo, Metrics& metrics)
-      : graph(graph), hashes(hashes), todo(todo),
-        non_trivial_scc_size(metrics, "fingerprint.non_trivial_scc_size") {}
+  Hasher(const Graph& graph, Hashes& hashes,
+         std::unordered_set<Id>& todo, Metrics& metrics,
+         const Refinement& refinement, size_t jobs,
+         const NodeHashes* known = nullptr)
+      : graph(graph), hashes(hashes), todo(todo), refinement(refinement),
+        jobs(jobs), known(known),
+        non_trivial_scc_size(metrics, "fingerprint.non_trivial_scc_size"),
+        refined_scc_size(metrics, "fingerprint.refined_scc_size") {}
 
   // Graph function implementation
-  HashValue operator()(const Special& x) {
+  HashValue64 operator()(const Special& x) {
     switch (x.kind) {
       case Special::Kind::VOID:
         return hash('O');
@@ -52,45 +86,45 @@ struct Hasher {
     }
   }
 
-  HashValue operator()(const PointerReference& x) {
+  HashValue64 operator()(const PointerReference& x) {
     return hash('P', static_cast<uint32_t>(x.kind), (*this)(x.pointee_type_id));
   }
 
-  HashValue operator()(const PointerToMember& x) {
+  HashValue64 operator()(const PointerToMember& x) {
     return hash('N', (*this)(x.containing_type_id), (*this)(x.pointee_type_id));
   }
 
-  HashValue operator()(const Typedef& x) {
+  HashValue64 operator()(const Typedef& x) {
     todo.insert(x.referred_type_id);
     return hash('T', x.name);
   }
 
-  HashValue operator()(const Qualified& x) {
+  HashValue64 operator()(const Qualified& x) {
     return hash('Q', static_cast<uint32_t>(x.qualifier),
                 (*this)(x.qualified_type_id));
   }
 
-  HashValue operator()(const Primitive& x) {
+  HashValue64 operator()(const Primitive& x) {
     return hash('i', x.name);
   }
 
-  HashValue operator()(const Array& x) {
+  HashValue64 operator()(const Array& x) {
     return hash('A', x.number_of_elements, (*this)(x.element_type_id));
   }
 
-  HashValue operator()(const BaseClass& x) {
+  HashValue64 operator()(const BaseClass& x) {
     return hash('B', (*this)(x.type_id));
   }
 
-  HashValue operator()(const Method& x) {
+  HashValue64 operator()(const Method& x) {
     return hash('M', x.mangled_name, x.name, (*this)(x.type_id));
   }
 
-  HashValue operator()(const Member& x) {
+  HashValue64 operator()(const Member& x) {
     return hash('D', x.name, x.offset, (*this)(x.type_id));
   }
 
-  HashValue operator()(const StructUnion& x) {
+  HashValue64 operator()(const StructUnion& x) {
     auto h = hash('U', static_cast<uint32_t>(x.kind), x.name);
     if (x.definition.has_value()) {
       h = hash(h, '1');
@@ -110,7 +144,7 @@ struct Hasher {
     return h;
   }
 
-  HashValue operator()(const Enumeration& x) {
+  HashValue64 operator()(const Enumeration& x) {
     auto h = hash('E', x.name);
     if (x.definition.has_value()) {
       h = hash(h, '1');
@@ -127,7 +161,7 @@ struct Hasher {
     return h;
   }
 
-  HashValue operator()(const Function& x) {
+  HashValue64 operator()(const Function& x) {
     auto h = hash('F', (*this)(x.return_type_id));
     for (const auto& parameter : x.parameters) {
       h = hash(h, (*this)(parameter));
@@ -135,25 +169,36 @@ struct Hasher {
     return h;
   }
 
-  HashValue operator()(const ElfSymbol& x) {
+  HashValue64 operator()(const ElfSymbol& x) {
     if (x.type_id.has_value()) {
       todo.insert(x.type_id.value());
     }
     return hash('S', x.symbol_name);
   }
 
-  HashValue operator()(const Interface& x) {
+  HashValue64 operator()(const Interface& x) {
     ToDo(x.symbols);
     ToDo(x.types);
     return hash('Z');
   }
 
   // main entry point
-  HashValue operator()(Id id) {
+  HashValue64 operator()(Id id) {
+    // Check if the id is being refined.
+    if (labels != nullptr) {
+      const auto it = labels->find(id);
+      if (it != labels->end()) {
+        return it->second;
+      }
+    }
     // Check if the id already has a fingerprint.
-    const auto it = hashes.find(id);
-    if (it != hashes.end()) {
-      return it->second;
+    if (const auto* fingerprint = Find(hashes, id)) {
+      return *fingerprint;
+    }
+    if (known != nullptr) {
+      if (const auto* fingerprint = known->Find(id)) {
+        return *fingerprint;
+      }
     }
 
     // Record the id with Strongly-Connected Component finder.
@@ -162,11 +207,11 @@ struct Hasher {
       // Already open.
       //
       // Return a dummy fingerprint.
-      return HashValue(0);
+      return HashValue64(0);
     }
     // Comparison opened, need to close it before returning.
 
-    HashValue result = graph.Apply<HashValue>(*this, id);
+    HashValue64 result = graph.Apply<HashValue64>(*this, id);
 
     // Check for a complete Strongly-Connected Component.
     auto ids = scc.Close(*handle);
@@ -181,55 +226,424 @@ struct Hasher {
     // the DFS spanning tree.
     //
     // All nodes in a non-trivial SCCs are given the same fingerprint, but
-    // non-trivial SCCs should be extremely rare.
+    // non-trivial SCCs should be extremely rare. Large ones are refined.
     const auto size = ids.size();
     if (size > 1) {
-      result = HashValue(size);
       non_trivial_scc_size.Add(size);
+      if (refinement.rounds > 0 && size >= refinement.min_size) {
+        refined_scc_size.Add(size);
+        Refine(ids);
+        return *Find(hashes, id);
+      }
+      result = HashValue64(size);
     }
     for (auto id : ids) {
-      hashes.insert({id, result});
+      Insert(hashes, id, result);
     }
     return result;
   }
 
-  void ToDo(const std::vector<Id>& ids) {
+  // Hashes the nodes of a closed SCC by rounds of local refinement. Each node
+  // is rehashed using the previous round's labels for the nodes of the SCC
+  // and the fingerprints already known for everything else, which is all the
+  // node hashing functions need, so workers never open another SCC.
+  void Refine(std::span<const Id> ids) {
+    const size_t workers = std::max<size_t>(1, std::min(jobs, ids.size()));
+    // worker metrics and work lists are discarded, the latter as the nodes
+    // have already been visited
+    std::vector<Metrics> worker_metrics(workers);
+    std::vector<std::unordered_set<Id>> worker_todo(workers);
+    std::unordered_map<Id, HashValue64> current;
+    for (auto id : ids) {
+      current.insert({id, hash('R')});
+    }
+    std::vector<std::optional<Hasher>> hashers(workers);
+    for (size_t worker = 0; worker < workers; ++worker) {
+      auto& hasher = hashers[worker];
+      hasher.emplace(graph, hashes, worker_todo[worker],
+                     worker_metrics[worker], Refinement(), 1, known);
+      hasher->labels = &current;
+    }
+    std::vector<HashValue64> next(ids.size(), HashValue64(0));
+    for (size_t round = 0; round < refinement.rounds; ++round) {
+      ForEachIndex(workers, ids.size(), [&](size_t worker, size_t index) {
+        next[index] = graph.Apply<HashValue64>(*hashers[worker], ids[index]);
+      });
+      for (size_t index = 0; index < ids.size(); ++index) {
+        current.at(ids[index]) = next[index];
+      }
+    }
+    for (const auto& [id, label] : current) {
+      Insert(hashes, id, label);
+    }
+  }
+
+  void ToDo(const Ids& ids) {
     for (auto id : ids) {
       todo.insert(id);
     }
   }
 
-  void ToDo(const std::map<std::string, Id>& ids) {
+  void ToDo(const FlatMap<std::string, Id>& ids) {
     for (const auto& [_, id] : ids) {
       todo.insert(id);
     }
   }
 
   const Graph& graph;
-  std::unordered_map<Id, HashValue>& hashes;
+  Hashes& hashes;
   std::unordered_set<Id> &todo;
-  Histogram non_trivial_scc_size;
+  const Refinement refinement;
+  const size_t jobs;
+  // if set, fingerprints already computed elsewhere
+  const NodeHashes* known;
+  // if set, labels of the SCC being refined
+  const std::unordered_map<Id, HashValue64>* labels = nullptr;
+  OperationHistogram non_trivial_scc_size;
+  OperationHistogram refined_scc_size;
   SCC<Id> scc;
 
-  // Function object: (Args...) -> HashValue
-  Hash hash;
+  // Function object: (Args...) -> HashValue64
+  Hash64 hash;
 };
 
-}  // namespace
+// The nodes whose fingerprints the fingerprint of a node is computed from, and
+// the other nodes that the Hasher goes on to fingerprint from it. This must
+// follow the edges exactly as the Hasher does.
+struct Dependencies {
+  void operator()(const Special&) {}
 
-std::unordered_map<Id, HashValue> Fingerprint(
-    const Graph& graph, Id root, Metrics& metrics) {
+  void operator()(const PointerReference& x) {
+    hashed.push_back(x.pointee_type_id);
+  }
+
+  void operator()(const PointerToMember& x) {
+    hashed.push_back(x.containing_type_id);
+    hashed.push_back(x.pointee_type_id);
+  }
+
+  void operator()(const Typedef& x) {
+    reached.push_back(x.referred_type_id);
+  }
+
+  void operator()(const Qualified& x) {
+    hashed.push_back(x.qualified_type_id);
+  }
+
+  void operator()(const Primitive&) {}
+
+  void operator()(const Array& x) {
+    hashed.push_back(x.element_type_id);
+  }
+
+  void operator()(const BaseClass& x) {
+    hashed.push_back(x.type_id);
+  }
+
+  void operator()(const Method& x) {
+    hashed.push_back(x.type_id);
+  }
+
+  void operator()(const Member& x) {
+    hashed.push_back(x.type_id);
+  }
+
+  void operator()(const StructUnion& x) {
+    if (x.definition.has_value()) {
+      const auto& definition = *x.definition;
+      reached.insert(reached.end(), definition.base_classes.begin(),
+                     definition.base_classes.end());
+      reached.insert(reached.end(), definition.methods.begin(),
+                     definition.methods.end());
+      auto& members = x.name.empty() ? hashed : reached;
+      members.insert(members.end(), definition.members.begin(),
+                     definition.members.end());
+    }
+  }
+
+  void operator()(const Enumeration& x) {
+    if (x.definition.has_value()) {
+      reached.push_back(x.definition->underlying_type_id);
+    }
+  }
+
+  void operator()(const Function& x) {
+    hashed.push_back(x.return_type_id);
+    hashed.insert(hashed.end(), x.parameters.begin(), x.parameters.end());
+  }
+
+  void operator()(const ElfSymbol& x) {
+    if (x.type_id.has_value()) {
+      reached.push_back(*x.type_id);
+    }
+  }
+
+  void operator()(const Interface& x) {
+    for (const auto& [_, id] : x.symbols) {
+      reached.push_back(id);
+    }
+    for (const auto& [_, id] : x.types) {
+      reached.push_back(id);
+    }
+  }
+
+  std::vector<Id> hashed;
+  std::vector<Id> reached;
+};
+
+// Fingerprints the nodes reachable from the roots that are not already hashed.
+void Extend(const Graph& graph, std::span<const Id> roots, Metrics& metrics,
+            const Refinement& refinement, NodeHashes& hashes) {
   Time x(metrics, "hash nodes");
-  std::unordered_map<Id, HashValue> hashes;
   std::unordered_set<Id> todo;
-  Hasher hasher(graph, hashes, todo, metrics);
-  todo.insert(root);
+  Hasher<NodeHashes> hasher(graph, hashes, todo, metrics, refinement, 1);
+  todo.insert(roots.begin(), roots.end());
   while (!todo.empty()) {
     for (auto id : std::exchange(todo, {})) {
       hasher(id);
     }
   }
+}
+
+// Fingerprints the nodes whose fingerprints do not depend on any cycle, as
+// described below, using hash(worker, id) to compute the fingerprint of a node
+// whose dependencies are all hashed. Returns the other unhashed nodes reachable
+// from the roots.
+template <typename Hash>
+std::vector<Id> HashAcyclic(const Graph& graph, std::span<const Id> roots,
+                            Metrics& metrics, size_t jobs, NodeHashes& hashes,
+                            const Hash& hash, Workers& utilisation) {
+  // Find the nodes and the dependencies between them.
+  std::unordered_map<Id, size_t> index;
+  std::vector<Id> nodes;
+  std::vector<std::pair<size_t, size_t>> edges;
+  std::vector<std::pair<Id, size_t>> stack;
+  const auto number = [&](Id id) {
+    const auto [it, inserted] = index.try_emplace(id, nodes.size());
+    if (inserted) {
+      nodes.push_back(id);
+      stack.emplace_back(id, it->second);
+      graph.PrefetchReference(id);
+    }
+    return it->second;
+  };
+  for (const auto id : roots) {
+    if (!hashes.Contains(id)) {
+      number(id);
+    }
+  }
+  Dependencies dependencies;
+  while (!stack.empty()) {
+    const auto [id, from] = stack.back();
+    stack.pop_back();
+    if (!stack.empty()) {
+      graph.PrefetchNode(stack.back().first);
+    }
+    dependencies.hashed.clear();
+    dependencies.reached.clear();
+    graph.Apply<void>(dependencies, id);
+    for (const auto to : dependencies.hashed) {
+      if (!hashes.Contains(to)) {
+        edges.emplace_back(from, number(to));
+      }
+    }
+    for (const auto to : dependencies.reached) {
+      if (!hashes.Contains(to)) {
+        number(to);
+      }
+    }
+  }
+  index.clear();
+
+  // Index the dependents of each node and count the dependencies.
+  const size_t size = nodes.size();
+  std::vector<size_t> pending(size, 0);
+  std::vector<size_t> start(size + 1, 0);
+  for (const auto& [from, to] : edges) {
+    ++pending[from];
+    ++start[to + 1];
+  }
+  std::partial_sum(start.begin(), start.end(), start.begin());
+  std::vector<size_t> dependents(edges.size());
+  {
+    auto next = start;
+    for (const auto& [from, to] : edges) {
+      dependents[next[to]++] = from;
+    }
+  }
+  edges = {};
+
+  // Hash level by level.
+  std::vector<size_t> level;
+  for (size_t ix = 0; ix < size; ++ix) {
+    if (pending[ix] == 0) {
+      level.push_back(ix);
+    }
+  }
+  std::vector<HashValue64> results;
+  size_t levels = 0;
+  size_t levelled = 0;
+  while (!level.empty()) {
+    results.assign(level.size(), HashValue64(0));
+    ForEachIndex(jobs, level.size(), [&](size_t worker, size_t index) {
+      results[index] = hash(worker, nodes[level[index]]);
+    }, &utilisation);
+    std::vector<size_t> next;
+    for (size_t index = 0; index < level.size(); ++index) {
+      const size_t ix = level[index];
+      hashes.Insert(nodes[ix], results[index]);
+      for (size_t dependent = start[ix]; dependent < start[ix + 1];
+           ++dependent) {
+        if (--pending[dependents[dependent]] == 0) {
+          next.push_back(dependents[dependent]);
+        }
+      }
+    }
+    ++levels;
+    levelled += level.size();
+    level = std::move(next);
+  }
+  Counter(metrics, "fingerprint.acyclic_levels") = levels;
+  Counter(metrics, "fingerprint.acyclic_nodes") = levelled;
+
+  std::vector<Id> remaining;
+  for (size_t ix = 0; ix < size; ++ix) {
+    if (pending[ix] != 0) {
+      remaining.push_back(nodes[ix]);
+    }
+  }
+  return remaining;
+}
+
+/*
+ * Fingerprinting concurrently.
+ *
+ * Most nodes do not depend on any cycle, and their fingerprints are computed
+ * first, level by level. The unhashed nodes reachable from the roots are found
+ * along with the edges along which their fingerprints depend on each other.
+ * Peeling off the nodes with no unhashed dependencies, repeatedly, gives the
+ * levels. The nodes of each level are hashed concurrently, with every
+ * dependency already hashed, so no SCC is ever opened. The nodes left over are
+ * in cycles or depend on them and are fingerprinted as below, with all the
+ * others already known.
+ *
+ * The work list is processed in rounds. In each round, the ids to do are
+ * shared out between workers, each with its own Hasher, fingerprints and work
+ * list, and read-only access to the fingerprints from earlier rounds. At the
+ * end of each round, the workers' fingerprints and work lists are merged.
+ *
+ * The fingerprint of a node depends only on the graph, not on the order nodes
+ * are visited, so the result is identical to that of the serial version.
+ * Within an SCC, the tentative fingerprints computed along the DFS spanning
+ * tree do depend on where the SCC was entered, but none of them is kept: they
+ * are only seen by other nodes of the same SCC, whose nodes all get its size or
+ * their labels after refinement, which starts from the same label everywhere.
+ * Workers may occasionally fingerprint the same node in the same round, each
+ * entering an SCC wherever it first reaches it.
+ *
+ * A worker refining a large SCC shares the refinement rounds with any threads
+ * that are free.
+ */
+void Extend(const Graph& graph, std::span<const Id> roots, Metrics& metrics,
+            size_t jobs, const Refinement& refinement, NodeHashes& hashes) {
+  if (jobs <= 1) {
+    Extend(graph, roots, metrics, refinement, hashes);
+    return;
+  }
+  Time x(metrics, "hash nodes");
+  // worker metrics must outlive the workers
+  std::vector<Metrics> worker_metrics(jobs);
+  struct Worker {
+    std::unordered_map<Id, HashValue64> hashes;
+    std::unordered_set<Id> todo;
+    std::optional<Hasher<std::unordered_map<Id, HashValue64>>> hasher;
+  };
+  std::vector<Worker> workers(jobs);
+  for (size_t w = 0; w < jobs; ++w) {
+    auto& worker = workers[w];
+    worker.hasher.emplace(graph, worker.hashes, worker.todo,
+                          worker_metrics[w], refinement, jobs, &hashes);
+  }
+  Workers utilisation(metrics, "hash nodes workers");
+  const auto hash = [&](size_t worker, Id id) {
+    return graph.Apply<HashValue64>(*workers[worker].hasher, id);
+  };
+  std::vector<Id> todo =
+      HashAcyclic(graph, roots, metrics, jobs, hashes, hash, utilisation);
+  // the acyclic nodes' work lists are covered by the nodes found
+  for (auto& worker : workers) {
+    worker.hashes.clear();
+    worker.todo.clear();
+  }
+  while (!todo.empty()) {
+    ForEachIndex(jobs, todo.size(), [&](size_t worker, size_t index) {
+      (*workers[worker].hasher)(todo[index]);
+    }, &utilisation);
+    std::unordered_set<Id> next;
+    for (auto& worker : workers) {
+      for (const auto& [id, hash] : worker.hashes) {
+        hashes.Insert(id, hash);
+      }
+      worker.hashes.clear();
+      next.merge(worker.todo);
+      worker.todo.clear();
+    }
+    todo.clear();
+    for (const auto id : next) {
+      if (!hashes.Contains(id)) {
+        todo.push_back(id);
+      }
+    }
+  }
+  workers.clear();
+  MergeShards(worker_metrics, metrics);
+}
+
+}  // namespace
+
+NodeHashes Fingerprint(const Graph& graph, Id root, Metrics& metrics,
+                       const Refinement& refinement) {
+  NodeHashes hashes;
+  Extend(graph, {&root, 1}, metrics, refinement, hashes);
+  return hashes;
+}
+
+NodeHashes Fingerprint(const Graph& graph, Id root, Metrics& metrics,
+                       size_t jobs, const Refinement& refinement) {
+  NodeHashes hashes;
+  Extend(graph, {&root, 1}, metrics, jobs, refinement, hashes);
   return hashes;
 }
 
+void Fingerprint(const Graph& graph, Id root, Metrics& metrics, size_t jobs,
+                 FingerprintCache& cache, const Refinement& refinement) {
+  Fingerprint(graph, {&root, 1}, metrics, jobs, cache, refinement);
+}
+
+void Fingerprint(const Graph& graph, std::span<const Id> roots,
+                 Metrics& metrics, size_t jobs, FingerprintCache& cache,
+                 const Refinement& refinement) {
+  const size_t cached = cache.Size();
+  Extend(graph, roots, metrics, jobs, refinement, cache);
+  Counter(metrics, "fingerprint.cached") = cached;
+  Counter(metrics, "fingerprint.hashed") = cache.Size() - cached;
+}
+
+void InvalidateFingerprints(FingerprintCache& cache,
+                            Predecessors& predecessors,
+                            std::span<const Id> changed) {
+  std::unordered_set<Id> seen(changed.begin(), changed.end());
+  std::vector<Id> todo(seen.begin(), seen.end());
+  while (!todo.empty()) {
+    const Id id = todo.back();
+    todo.pop_back();
+    cache.Erase(id);
+    for (const Id source : predecessors(id)) {
+      if (seen.insert(source).second) {
+        todo.push_back(source);
+      }
+    }
+  }
+}
+
 }  // namespace stg
@@ -20,12 +20,15 @@
 #ifndef STG_FINGERPRINT_H_
 #define STG_FINGERPRINT_H_
 
+#include <cstddef>
 #include <cstdint>
-#include <unordered_map>
+#include <span>
 
 #include "graph.h"
 #include "hashing.h"
 #include "metrics.h"
+#include "node_hashes.h"
+#include "predecessors.h"
 
 namespace stg {
 
@@ -34,8 +37,52 @@ namespace stg {
 //
 // Given any mutual dependencies between hashes, it falls back to a very poor
 // but safe hash for the affected nodes: the size of the SCC.
-std::unordered_map<Id, HashValue> Fingerprint(
-    const Graph& graph, Id root, Metrics& metrics);
+//
+// SCCs of at least min_size nodes are instead hashed by refinement. Every node
+// starts with the same label and, in each of the given number of rounds, is
+// relabelled with its own hash, taking the labels of the previous round for
+// the nodes in the SCC it refers to. Each round is spread over the available
+// threads. Equal nodes still get equal hashes and more rounds distinguish more
+// distant differences. Zero rounds disables refinement.
+struct Refinement {
+  size_t min_size = 256;
+  size_t rounds = 8;
+};
+
+NodeHashes Fingerprint(const Graph& graph, Id root, Metrics& metrics,
+                       const Refinement& refinement = {});
+
+// As above, but spread the work over up to the given number of threads. The
+// result is identical.
+NodeHashes Fingerprint(const Graph& graph, Id root, Metrics& metrics,
+                       size_t jobs, const Refinement& refinement = {});
+
+// Fingerprints kept with a graph across changes to it, keyed by node id.
+using FingerprintCache = NodeHashes;
+
+// As above, but fingerprints in the cache are reused rather than computed
+// again, and new ones are added to it. Afterwards, the cache covers all the
+// nodes reachable from the root.
+//
+// The cached fingerprints must be those of the nodes as they are now. After
+// changing the graph, use InvalidateFingerprints to drop the stale ones, so
+// that only they are computed again.
+void Fingerprint(const Graph& graph, Id root, Metrics& metrics, size_t jobs,
+                 FingerprintCache& cache, const Refinement& refinement = {});
+
+// As above, covering all the nodes reachable from any of the roots.
+void Fingerprint(const Graph& graph, std::span<const Id> roots,
+                 Metrics& metrics, size_t jobs, FingerprintCache& cache,
+                 const Refinement& refinement = {});
+
+// Drops the cached fingerprints of the changed nodes and of all the nodes that
+// can reach them, as found in the predecessors index, which must reflect the
+// graph after the change. Changed nodes are those that were added, removed or
+// modified, or whose edges were redirected. This is conservative: all edges
+// are followed, including those that do not contribute to fingerprints.
+void InvalidateFingerprints(FingerprintCache& cache,
+                            Predecessors& predecessors,
+                            std::span<const Id> changed);
 
 }  // namespace stg
 
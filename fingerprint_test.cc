@@ -0,0 +1,211 @@
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+// -*- mode: C++ -*-
+//
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License v2.0 with LLVM Exceptions (the
+// "License"); you may not use this file except in compliance with the
+// License.  You may obtain a copy of the License at
+//
+//     https://llvm.org/LICENSE.txt
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "fingerprint.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <filesystem>
+#include <map>
+#include <string>
+#include <string_view>
+#include <variant>
+#include <vector>
+
+#include <catch2/catch.hpp>
+#include "graph.h"
+#include "input.h"
+#include "metrics.h"
+#include "predecessors.h"
+#include "reader_options.h"
+
+namespace Test {
+
+struct FingerprintTestCase {
+  const char* name;
+  stg::InputFormat format;
+  const char* file;
+};
+
+TEST_CASE("parallel fingerprint") {
+  const auto test = GENERATE(
+      FingerprintTestCase({"offsets", stg::InputFormat::ABI,
+                           "offset_0.xml"}),
+      FingerprintTestCase({"anonymous types", stg::InputFormat::ABI,
+                           "abigail_anonymous_types_0.xml"}),
+      FingerprintTestCase({"symbols", stg::InputFormat::ABI,
+                           "added_removed_symbols_0.xml"}),
+      FingerprintTestCase({"type roots", stg::InputFormat::STG,
+                           "type_addition_2.stg"}),
+      FingerprintTestCase({"qualifiers", stg::InputFormat::STG,
+                           "qualifier_1.stg"}));
+  const size_t jobs = GENERATE(2, 3, 8);
+
+  SECTION(test.name) {
+    stg::Graph graph;
+    stg::Metrics metrics;
+    const auto path = std::filesystem::path("testdata") / test.file;
+    const auto root = stg::Read(graph, test.format, path.c_str(),
+                                stg::ReadOptions(), nullptr, metrics);
+    const auto serial = stg::Fingerprint(graph, root, metrics);
+    const auto parallel = stg::Fingerprint(graph, root, metrics, jobs);
+    CHECK(!serial.Empty());
+    CHECK(parallel == serial);
+  }
+}
+
+// Builds a ring of anonymous structs, each with a member pointing to the next,
+// which is a single SCC. The member of the first struct has the given name.
+std::vector<stg::Id> Ring(stg::Graph& graph, size_t size,
+                          const std::string& first) {
+  std::vector<stg::Id> ids;
+  for (size_t ix = 0; ix < size; ++ix) {
+    ids.push_back(graph.Allocate());
+  }
+  for (size_t ix = 0; ix < size; ++ix) {
+    const auto pointer = graph.Add<stg::PointerReference>(
+        stg::PointerReference::Kind::POINTER, ids[(ix + 1) % size]);
+    const auto member =
+        graph.Add<stg::Member>(ix == 0 ? first : "next", pointer, 0, 0);
+    graph.Set<stg::StructUnion>(ids[ix], stg::StructUnion::Kind::STRUCT, "", 8,
+                                stg::Ids(), stg::Ids(), stg::Ids{member});
+  }
+  return ids;
+}
+
+TEST_CASE("refined SCC") {
+  stg::Graph graph;
+  stg::Metrics metrics;
+  const size_t size = 100;
+  const auto same = Ring(graph, size, "next");
+  const auto other = Ring(graph, size, "first");
+  const auto root = graph.Add<stg::Interface>(
+      std::map<std::string, stg::Id>(),
+      std::map<std::string, stg::Id>{{"same", same[0]}, {"other", other[0]}});
+  const stg::Refinement refinement{.min_size = 2, .rounds = 8};
+
+  const auto hashes = stg::Fingerprint(graph, root, metrics, refinement);
+  // equal nodes are not distinguished
+  CHECK(hashes.At(same[0]) == hashes.At(same[size / 2]));
+  // differences within reach of the rounds are
+  CHECK(hashes.At(same[0]) != hashes.At(other[0]));
+  CHECK(hashes.At(same[size - 1]) != hashes.At(other[size - 1]));
+  // but distant ones are not
+  CHECK(hashes.At(same[size / 2]) == hashes.At(other[size / 2]));
+
+  const size_t jobs = GENERATE(2, 3, 8);
+  CHECK(stg::Fingerprint(graph, root, metrics, jobs, refinement) == hashes);
+
+  const auto unrefined = stg::Fingerprint(graph, root, metrics,
+                                          stg::Refinement{.rounds = 0});
+  CHECK(unrefined.At(same[0]) == unrefined.At(other[0]));
+}
+
+TEST_CASE("SCC entry point") {
+  stg::Graph graph;
+  const size_t size = 5;
+  const auto ring = Ring(graph, size, "next");
+  const auto pointer = graph.Add<stg::PointerReference>(
+      stg::PointerReference::Kind::POINTER, ring[size / 2]);
+  const auto function =
+      graph.Add<stg::Function>(pointer, stg::Ids{ring[size - 1]});
+  const auto root = graph.Add<stg::Interface>(
+      std::map<std::string, stg::Id>(),
+      std::map<std::string, stg::Id>{{"f", function}, {"r", ring[0]}});
+
+  stg::Metrics metrics;
+  const auto serial = stg::Fingerprint(graph, root, metrics);
+  const size_t jobs = GENERATE(1, 2, 8);
+  CHECK(stg::Fingerprint(graph, root, metrics, jobs) == serial);
+  // the ring is too small to be refined, so its nodes share a fingerprint
+  // whichever of them it is entered by
+  for (const auto entry : ring) {
+    stg::FingerprintCache cache;
+    stg::Fingerprint(graph, entry, metrics, jobs, cache);
+    CHECK(cache.At(entry) == serial.At(ring[0]));
+    stg::Fingerprint(graph, root, metrics, jobs, cache);
+    CHECK(cache == serial);
+  }
+}
+
+TEST_CASE("acyclic nodes hashed by level") {
+  stg::Graph graph;
+  const auto int_type = graph.Add<stg::Primitive>(
+      "int", stg::Primitive::Encoding::SIGNED_INTEGER, 4);
+  const auto int_pointer = graph.Add<stg::PointerReference>(
+      stg::PointerReference::Kind::POINTER, int_type);
+  const auto ring = Ring(graph, 2, "next");
+  const auto ring_pointer = graph.Add<stg::PointerReference>(
+      stg::PointerReference::Kind::POINTER, ring[0]);
+  const auto root = graph.Add<stg::Interface>(
+      std::map<std::string, stg::Id>(),
+      std::map<std::string, stg::Id>{{"p", int_pointer},
+                                     {"r", ring_pointer}});
+
+  stg::Metrics metrics;
+  const auto serial = stg::Fingerprint(graph, root, metrics);
+  const size_t jobs = GENERATE(2, 3, 8);
+  stg::Metrics parallel_metrics;
+  CHECK(stg::Fingerprint(graph, root, parallel_metrics, jobs) == serial);
+  // the root, int and int*, but not the ring or the pointer to it
+  const auto acyclic = std::find_if(
+      parallel_metrics.begin(), parallel_metrics.end(), [](const auto& m) {
+        return std::string_view(m.name) == "fingerprint.acyclic_nodes";
+      });
+  REQUIRE(acyclic != parallel_metrics.end());
+  CHECK(std::get<size_t>(acyclic->value) == 3);
+}
+
+TEST_CASE("incremental fingerprints") {
+  const size_t jobs = GENERATE(1, 4);
+  stg::Graph graph;
+  stg::Metrics metrics;
+  const auto int_type = graph.Add<stg::Primitive>(
+      "int", stg::Primitive::Encoding::SIGNED_INTEGER, 4);
+  const auto char_type = graph.Add<stg::Primitive>(
+      "char", stg::Primitive::Encoding::SIGNED_CHARACTER, 1);
+  const auto int_pointer = graph.Add<stg::PointerReference>(
+      stg::PointerReference::Kind::POINTER, int_type);
+  const auto char_pointer = graph.Add<stg::PointerReference>(
+      stg::PointerReference::Kind::POINTER, char_type);
+  const auto function =
+      graph.Add<stg::Function>(int_pointer, stg::Ids{char_pointer});
+  const auto root = graph.Add<stg::Interface>(
+      std::map<std::string, stg::Id>(),
+      std::map<std::string, stg::Id>{{"f", function}, {"p", char_pointer}});
+
+  stg::FingerprintCache cache;
+  stg::Fingerprint(graph, root, metrics, jobs, cache);
+  CHECK(cache == stg::Fingerprint(graph, root, metrics));
+  const auto before = cache.At(function);
+
+  graph.Unset(int_type);
+  graph.Set<stg::Primitive>(int_type, "long",
+                            stg::Primitive::Encoding::SIGNED_INTEGER, 8);
+  stg::Predecessors predecessors(graph);
+  stg::InvalidateFingerprints(cache, predecessors, std::vector{int_type});
+  // only the changed node and those that reach it are dropped
+  CHECK(cache.Size() == 2);
+  CHECK(cache.Contains(char_type));
+  CHECK(cache.Contains(char_pointer));
+
+  stg::Fingerprint(graph, root, metrics, jobs, cache);
+  CHECK(cache == stg::Fingerprint(graph, root, metrics));
+  CHECK(cache.At(function) != before);
+}
+
+}  // namespace Test
@@ -0,0 +1,106 @@
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+// -*- mode: C++ -*-
+//
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License v2.0 with LLVM Exceptions (the
+// "License"); you may not use this file except in compliance with the
+// License.  You may obtain a copy of the License at
+//
+//     https://llvm.org/LICENSE.txt
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef STG_FLAT_MAP_H_
+#define STG_FLAT_MAP_H_
+
+#include <algorithm>
+#include <cstddef>
+#include <map>
+#include <utility>
+#include <vector>
+
+namespace stg {
+
+// An ordered map held as a vector of pairs sorted by key.
+//
+// This is for maps which are built in bulk and then only iterated and searched,
+// such as Interface symbols and types. Compared with std::map, there is one
+// allocation rather than one per item, and iteration is sequential in memory.
+// Iteration order is key order.
+template <typename Key, typename Value>
+class FlatMap {
+ public:
+  using value_type = std::pair<Key, Value>;
+  using iterator = typename std::vector<value_type>::iterator;
+  using const_iterator = typename std::vector<value_type>::const_iterator;
+
+  FlatMap() = default;
+
+  // Items may be given in any order. They are stably sorted by key and, where a
+  // key is repeated, only its first item is kept, as with repeated
+  // std::map::emplace.
+  explicit FlatMap(std::vector<value_type> items) : items_(std::move(items)) {
+    const auto by_key = [](const value_type& a, const value_type& b) {
+      return a.first < b.first;
+    };
+    if (!std::is_sorted(items_.begin(), items_.end(), by_key)) {
+      std::stable_sort(items_.begin(), items_.end(), by_key);
+    }
+    const auto same_key = [](const value_type& a, const value_type& b) {
+      return a.first == b.first;
+    };
+    items_.erase(std::unique(items_.begin(), items_.end(), same_key),
+                 items_.end());
+  }
+
+  // These are implicit so that a std::map can be built and then handed over.
+  FlatMap(const std::map<Key, Value>& map) : items_(map.begin(), map.end()) {}
+  FlatMap(std::map<Key, Value>&& map) {
+    items_.reserve(map.size());
+    while (!map.empty()) {
+      auto node = map.extract(map.begin());
+      items_.emplace_back(std::move(node.key()), std::move(node.mapped()));
+    }
+  }
+
+  iterator begin() {
+    return items_.begin();
+  }
+  iterator end() {
+    return items_.end();
+  }
+  const_iterator begin() const {
+    return items_.begin();
+  }
+  const_iterator end() const {
+    return items_.end();
+  }
+  size_t size() const {
+    return items_.size();
+  }
+  bool empty() const {
+    return items_.empty();
+  }
+
+  template <typename K>
+  const_iterator find(const K& key) const {
+    const auto it = std::lower_bound(
+        items_.begin(), items_.end(), key,
+        [](const value_type& item, const K& k) { return item.first < k; });
+    return it != items_.end() && it->first == key ? it : items_.end();
+  }
+
+  bool operator==(const FlatMap& other) const = default;
+
+ private:
+  std::vector<value_type> items_;
+};
+
+}  // namespace stg
+
+#endif  // STG_FLAT_MAP_H_
@@ -0,0 +1,60 @@
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+// -*- mode: C++ -*-
+//
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License v2.0 with LLVM Exceptions (the
+// "License"); you may not use this file except in compliance with the
+// License.  You may obtain a copy of the License at
+//
+//     https://llvm.org/LICENSE.txt
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "flat_map.h"
+
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <catch2/catch.hpp>
+
+namespace Test {
+
+using Map = stg::FlatMap<std::string, int>;
+using Items = std::vector<std::pair<std::string, int>>;
+
+Items Contents(const Map& map) {
+  return {map.begin(), map.end()};
+}
+
+TEST_CASE("bulk build sorts and keeps first") {
+  const Map map(Items{{"c", 1}, {"a", 2}, {"b", 3}, {"a", 4}, {"c", 5}});
+  CHECK(Contents(map) == Items{{"a", 2}, {"b", 3}, {"c", 1}});
+  CHECK(map.size() == 3);
+}
+
+TEST_CASE("matches std::map") {
+  std::map<std::string, int> source = {{"x", 1}, {"y", 2}, {"w", 3}};
+  const Map copied(source);
+  const Map moved(std::move(source));
+  CHECK(copied == moved);
+  CHECK(Contents(moved) == Items{{"w", 3}, {"x", 1}, {"y", 2}});
+}
+
+TEST_CASE("find") {
+  const Map map(Items{{"b", 1}, {"d", 2}});
+  CHECK(map.find(std::string("b"))->second == 1);
+  CHECK(map.find(std::string("d"))->second == 2);
+  CHECK(map.find(std::string("a")) == map.end());
+  CHECK(map.find(std::string("c")) == map.end());
+  CHECK(map.find(std::string("e")) == map.end());
+  CHECK(Map().empty());
+}
+
+}  // namespace Test
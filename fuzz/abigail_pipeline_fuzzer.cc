@@ -0,0 +1,58 @@
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+// -*- mode: C++ -*-
+//
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License v2.0 with LLVM Exceptions (the
+// "License"); you may not use this file except in compliance with the
+// License.  You may obtain a copy of the License at
+//
+//     https://llvm.org/LICENSE.txt
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <cstddef>
+
+#include <libxml/parser.h>
+#include <libxml/tree.h>
+#include "abigail_reader.h"
+#include "error.h"
+#include "graph.h"
+#include "metrics.h"
+#include "pipeline_fuzzer.h"
+
+static void DoNothing(void*, const char*, ...) {}
+
+extern "C" int LLVMFuzzerTestOneInput(char* data, size_t size) {
+  // The document is parsed afresh for each read, as processing modifies it.
+  auto read = [&](stg::Graph& graph, stg::Metrics& metrics) {
+    xmlParserCtxtPtr ctxt = xmlNewParserCtxt();
+    // Suppress libxml error messages.
+    xmlSetGenericErrorFunc(ctxt, (xmlGenericErrorFunc) DoNothing);
+    xmlDocPtr doc = xmlCtxtReadMemory(
+        ctxt, data, size, nullptr, nullptr,
+        XML_PARSE_NOERROR | XML_PARSE_NONET | XML_PARSE_NOWARNING);
+    xmlFreeParserCtxt(ctxt);
+    stg::Check(doc != nullptr) << "invalid XML";
+    xmlNodePtr root = xmlDocGetRootElement(doc);
+    try {
+      stg::Check(root != nullptr) << "empty XML";
+      const stg::Id id = stg::abixml::Abigail(graph).ProcessRoot(root, metrics);
+      xmlFreeDoc(doc);
+      return id;
+    } catch (...) {
+      xmlFreeDoc(doc);
+      throw;
+    }
+  };
+  try {
+    stg::fuzz::RunPipeline(read);
+  } catch (const stg::Exception&) {
+    // Pass as this is us catching invalid XML properly.
+  }
+  return 0;
+}
@@ -24,6 +24,7 @@
 #include "abigail_reader.h"
 #include "error.h"
 #include "graph.h"
+#include "metrics.h"
 
 static void DoNothing(void*, const char*, ...) {}
 
@@ -45,7 +46,8 @@ extern "C" int LLVMFuzzerTestOneInput(char* data, size_t size) {
   if (root) {
     try {
       stg::Graph graph;
-      stg::abixml::Abigail(graph).ProcessRoot(root);
+      stg::Metrics metrics;
+      stg::abixml::Abigail(graph).ProcessRoot(root, metrics);
     } catch (const stg::Exception&) {
       // Pass as this is us catching invalid XML properly.
     }
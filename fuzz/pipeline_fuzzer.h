@@ -0,0 +1,112 @@
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+// -*- mode: C++ -*-
+//
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License v2.0 with LLVM Exceptions (the
+// "License"); you may not use this file except in compliance with the
+// License.  You may obtain a copy of the License at
+//
+//     https://llvm.org/LICENSE.txt
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef STG_FUZZ_PIPELINE_FUZZER_H_
+#define STG_FUZZ_PIPELINE_FUZZER_H_
+
+#include <sys/resource.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <variant>
+
+#include "comparison.h"
+#include "deduplication.h"
+#include "fingerprint.h"
+#include "graph.h"
+#include "metrics.h"
+#include "type_resolution.h"
+#include "unification.h"
+
+namespace stg {
+namespace fuzz {
+
+// The full stg and stgdiff pipeline, run on each fuzzer input with time and
+// memory budgets, so that inputs which are merely pathologically slow, such as
+// those with huge hash buckets or enormous SCCs, are reported as well as
+// crashes. An input over budget prints its metrics and aborts, which makes the
+// fuzzer save it. Once fixed, such an input can be pinned by adding it to
+// testdata, where stgperf and stg_benchmarks will pick it up.
+//
+// The budgets are CPU milliseconds, for the whole pipeline, and megabytes of
+// peak resident set size, for the process. They can be set with the
+// environment variables STG_FUZZ_TIME_BUDGET_MS and STG_FUZZ_RSS_BUDGET_MB.
+// Deep recursion is caught by the sanitizers as stack overflow.
+
+inline uint64_t Budget(const char* variable, uint64_t fallback) {
+  const char* value = std::getenv(variable);
+  return value == nullptr ? fallback : std::strtoull(value, nullptr, 10);
+}
+
+inline uint64_t PeakRssMegabytes() {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return static_cast<uint64_t>(usage.ru_maxrss) / 1024;
+}
+
+// Reads the input twice, via the given reader, resolves, fingerprints and
+// deduplicates the first copy, resolves the second and compares the two.
+// Readers should throw Exception for invalid input.
+inline void RunPipeline(const std::function<Id(Graph&, Metrics&)>& read) {
+  static const uint64_t time_budget =
+      Budget("STG_FUZZ_TIME_BUDGET_MS", 1000) * 1'000'000;
+  static const uint64_t rss_budget = Budget("STG_FUZZ_RSS_BUDGET_MB", 1024);
+
+  Metrics metrics;
+  {
+    const Time total(metrics, "fuzz.pipeline");
+    Graph graph;
+    const auto resolve = [&](Id root) {
+      Unification unification(graph, Id(0), metrics);
+      unification.Reserve(graph.Limit());
+      ResolveTypes(graph, unification, {root}, metrics);
+      unification.Update(root);
+      return root;
+    };
+    const Id root1 = resolve(read(graph, metrics));
+    const Id deduplicated = [&]() {
+      const Time time(metrics, "fuzz.deduplicate");
+      const auto hashes = Fingerprint(graph, root1, metrics);
+      return Deduplicate(graph, root1, hashes, metrics);
+    }();
+    const Id root2 = resolve(read(graph, metrics));
+    {
+      const Time time(metrics, "fuzz.compare");
+      Compare compare{graph, Ignore(), metrics};
+      (void)compare(deduplicated, root2);
+    }
+  }
+
+  const auto& total = std::get<Nanoseconds>(metrics.front().value);
+  const uint64_t rss = PeakRssMegabytes();
+  if (total.ns > time_budget || rss > rss_budget) {
+    std::cerr << "input over budget: " << total.ns / 1'000'000 << " ms (budget "
+              << time_budget / 1'000'000 << " ms), peak RSS " << rss
+              << " MB (budget " << rss_budget << " MB)\n";
+    Report(metrics, std::cerr);
+    std::abort();
+  }
+}
+
+}  // namespace fuzz
+}  // namespace stg
+
+#endif  // STG_FUZZ_PIPELINE_FUZZER_H_
@@ -21,11 +21,20 @@
 
 #include "graph.h"
 
+#include <algorithm>
+#include <cstddef>
 #include <ios>
 #include <limits>
 #include <ostream>
+#include <span>
 #include <string>
 #include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "error.h"
+#include "substitution.h"
 
 namespace stg {
 
@@ -35,6 +44,239 @@ std::ostream& operator<<(std::ostream& os, Id id) {
   return os << '<' << id.ix_ << '>';
 }
 
+namespace {
+
+struct AddNode {
+  template <typename Node>
+  void operator()(Node& node) {
+    graph.Add<Node>(std::move(node));
+  }
+
+  Graph& graph;
+};
+
+}  // namespace
+
+std::vector<Id> Graph::Compact() {
+  return Compact({});
+}
+
+std::vector<Id> Graph::Compact(std::span<const Id> reserved) {
+  Check(!layer_) << "graph compacted during checkpoint";
+  std::vector<bool> keep(indirection_.size());
+  for (const Id id : reserved) {
+    Check(!Is(id)) << "reserved node is set during compaction: " << id;
+    keep[id.ix_] = true;
+  }
+  std::vector<Id> sequence;
+  for (size_t ix = 0; ix < indirection_.size(); ++ix) {
+    if (indirection_[ix].which != Which::ABSENT || keep[ix]) {
+      sequence.emplace_back(ix);
+    }
+  }
+  return Rebuild(sequence);
+}
+
+std::vector<Id> Graph::Renumber(std::span<const Id> order) {
+  Check(!layer_) << "graph renumbered during checkpoint";
+  std::vector<bool> placed(indirection_.size());
+  std::vector<Id> sequence;
+  sequence.reserve(indirection_.size());
+  for (const Id id : order) {
+    Check(Is(id) && !placed[id.ix_])
+        << "node renumbered twice or not set: " << id;
+    placed[id.ix_] = true;
+    sequence.push_back(id);
+  }
+  for (size_t ix = 0; ix < indirection_.size(); ++ix) {
+    if (indirection_[ix].which != Which::ABSENT && !placed[ix]) {
+      sequence.emplace_back(ix);
+    }
+  }
+  return Rebuild(sequence);
+}
+
+std::vector<Id> Graph::Rebuild(const std::vector<Id>& sequence) {
+  std::vector<Id> mapping(indirection_.size(), Id::kInvalid);
+  std::vector<size_t> counts(static_cast<size_t>(Which::INTERFACE) + 1);
+  for (size_t ix = 0; ix < sequence.size(); ++ix) {
+    const Id id = sequence[ix];
+    mapping[id.ix_] = Id(ix);
+    ++counts[static_cast<size_t>(indirection_[id.ix_].which)];
+  }
+
+  // reserve exactly, to avoid leaving the slack of vector growth behind
+  Graph rebuilt(Resource());
+  // node names are views of the interned strings, which survive the move, and
+  // names interned again as nodes are added must be kept too
+  rebuilt.strings_ = std::move(strings_);
+  const auto count = [&](Which which) {
+    return counts[static_cast<size_t>(which)];
+  };
+  rebuilt.indirection_.reserve(sequence.size());
+  rebuilt.special_.reserve(count(Which::SPECIAL));
+  rebuilt.pointer_reference_.reserve(count(Which::POINTER_REFERENCE));
+  rebuilt.pointer_to_member_.reserve(count(Which::POINTER_TO_MEMBER));
+  rebuilt.typedef_.reserve(count(Which::TYPEDEF));
+  rebuilt.qualified_.reserve(count(Which::QUALIFIED));
+  rebuilt.primitive_.reserve(count(Which::PRIMITIVE));
+  rebuilt.array_.reserve(count(Which::ARRAY));
+  rebuilt.base_class_.reserve(count(Which::BASE_CLASS));
+  rebuilt.method_.reserve(count(Which::METHOD));
+  rebuilt.member_.reserve(count(Which::MEMBER));
+  rebuilt.struct_union_.reserve(count(Which::STRUCT_UNION));
+  rebuilt.enumeration_.reserve(count(Which::ENUMERATION));
+  rebuilt.function_.reserve(count(Which::FUNCTION));
+  rebuilt.elf_symbol_.reserve(count(Which::ELF_SYMBOL));
+  rebuilt.interface_.reserve(count(Which::INTERFACE));
+
+  const auto remap = [&](Id& id) {
+    const Id replacement = mapping[id.ix_];
+    Check(replacement != Id::kInvalid)
+        << "reference to removed node during compaction: " << id;
+    id = replacement;
+  };
+  Substitute substitute(*this, remap);
+  AddNode add{rebuilt};
+  for (const Id id : sequence) {
+    if (Is(id)) {
+      substitute(id);
+      Apply<void>(add, id);
+    } else {
+      rebuilt.Allocate();
+    }
+  }
+
+  *this = std::move(rebuilt);
+  return mapping;
+}
+
+void Graph::Truncate(Id limit) {
+  Check(!layer_) << "graph truncated during checkpoint";
+  // the storage of nodes before limit precedes that of the others
+  std::vector<size_t> sizes(static_cast<size_t>(Which::INTERFACE) + 1);
+  for (size_t ix = 0; ix < limit.ix_; ++ix) {
+    const auto [which, index] = indirection_[ix];
+    if (which != Which::ABSENT) {
+      auto& size = sizes[static_cast<size_t>(which)];
+      size = std::max(size, static_cast<size_t>(index) + 1);
+    }
+  }
+  for (size_t ix = limit.ix_; ix < indirection_.size(); ++ix) {
+    const auto [which, index] = indirection_[ix];
+    Check(which == Which::ABSENT || index >= sizes[static_cast<size_t>(which)])
+        << "internal error: truncated node set out of order: " << Id(ix);
+  }
+  Shrink(limit, sizes);
+}
+
+void Graph::Checkpoint() {
+  Check(!layer_) << "graph checkpoints do not nest";
+  layer_.emplace(Layer{Limit(), Sizes(), {}});
+}
+
+void Graph::Rollback() {
+  Check(layer_.has_value()) << "graph rollback without checkpoint";
+  auto& saved = layer_->saved;
+  // restore in reverse, so each id ends with its reference at the checkpoint
+  for (auto it = saved.rbegin(); it != saved.rend(); ++it) {
+    indirection_[it->first.ix_] = it->second;
+  }
+  const Layer layer = std::move(*layer_);
+  layer_.reset();
+  Shrink(layer.base, layer.sizes);
+}
+
+void Graph::Commit() {
+  Check(layer_.has_value()) << "graph commit without checkpoint";
+  layer_.reset();
+}
+
+void Graph::CopyOnWrite(Id id) {
+  const auto reference = indirection_[id.ix_];
+  // absent nodes cannot be changed and copies are changed in place
+  if (reference.which == Which::ABSENT
+      || reference.ix >= layer_->sizes[static_cast<size_t>(reference.which)]) {
+    return;
+  }
+  layer_->saved.emplace_back(id, reference);
+  const auto copy = [&](const auto& node) {
+    using Node = std::decay_t<decltype(node)>;
+    Node value(node);
+    Emplace<Node>(indirection_[id.ix_], std::move(value));
+  };
+  static_cast<const Graph&>(*this).Apply<void>(copy, id);
+}
+
+std::vector<size_t> Graph::Sizes() const {
+  return {
+      0,
+      special_.size(),
+      pointer_reference_.size(),
+      pointer_to_member_.size(),
+      typedef_.size(),
+      qualified_.size(),
+      primitive_.size(),
+      array_.size(),
+      base_class_.size(),
+      method_.size(),
+      member_.size(),
+      struct_union_.size(),
+      enumeration_.size(),
+      function_.size(),
+      elf_symbol_.size(),
+      interface_.size(),
+  };
+}
+
+void Graph::Shrink(Id limit, const std::vector<size_t>& sizes) {
+  // node types are not default constructible, so cannot be resized
+  const auto truncate = [&](auto& nodes, Which which) {
+    nodes.erase(nodes.begin() + sizes[static_cast<size_t>(which)], nodes.end());
+  };
+  indirection_.resize(limit.ix_);
+  truncate(special_, Which::SPECIAL);
+  truncate(pointer_reference_, Which::POINTER_REFERENCE);
+  truncate(pointer_to_member_, Which::POINTER_TO_MEMBER);
+  truncate(typedef_, Which::TYPEDEF);
+  truncate(qualified_, Which::QUALIFIED);
+  truncate(primitive_, Which::PRIMITIVE);
+  truncate(array_, Which::ARRAY);
+  truncate(base_class_, Which::BASE_CLASS);
+  truncate(method_, Which::METHOD);
+  truncate(member_, Which::MEMBER);
+  truncate(struct_union_, Which::STRUCT_UNION);
+  truncate(enumeration_, Which::ENUMERATION);
+  truncate(function_, Which::FUNCTION);
+  truncate(elf_symbol_, Which::ELF_SYMBOL);
+  truncate(interface_, Which::INTERFACE);
+}
+
+std::vector<Graph::Storage> Graph::Usage() const {
+  std::vector<Storage> result;
+  const auto add = [&](std::string_view kind, const auto& nodes) {
+    using Node = typename std::decay_t<decltype(nodes)>::value_type;
+    result.push_back({kind, nodes.size(), nodes.capacity() * sizeof(Node)});
+  };
+  add("ids", indirection_);
+  add("special", special_);
+  add("pointer_reference", pointer_reference_);
+  add("pointer_to_member", pointer_to_member_);
+  add("typedef", typedef_);
+  add("qualified", qualified_);
+  add("primitive", primitive_);
+  add("array", array_);
+  add("base_class", base_class_);
+  add("method", method_);
+  add("member", member_);
+  add("struct_union", struct_union_);
+  add("enumeration", enumeration_);
+  add("function", function_);
+  add("elf_symbol", elf_symbol_);
+  add("interface", interface_);
+  return result;
+}
+
 std::ostream& operator<<(std::ostream& os, BaseClass::Inheritance inheritance) {
   switch (inheritance) {
     case BaseClass::Inheritance::NON_VIRTUAL:
@@ -125,9 +367,11 @@ std::string VersionInfoToString(const ElfSymbol::VersionInfo& version_info) {
 }
 
 std::string VersionedSymbolName(const ElfSymbol& symbol) {
-  return symbol.symbol_name + (symbol.version_info
-                                   ? VersionInfoToString(*symbol.version_info)
-                                   : std::string());
+  std::string result(symbol.symbol_name);
+  if (symbol.version_info) {
+    result += VersionInfoToString(*symbol.version_info);
+  }
+  return result;
 }
 
 std::ostream& operator<<(std::ostream& os, ElfSymbol::CRC crc) {
@@ -22,27 +22,37 @@
 #ifndef STG_GRAPH_H_
 #define STG_GRAPH_H_
 
+#include <algorithm>
 #include <cstddef>
 #include <cstdint>
 #include <functional>
-#include <map>
+#include <limits>
+#include <memory_resource>
 #include <optional>
 #include <ostream>
+#include <span>
 #include <sstream>
 #include <string>
+#include <string_view>
 #include <type_traits>
 #include <utility>
 #include <vector>
 
 #include "error.h"
+#include "flat_map.h"
+#include "interner.h"
+#include "parallel.h"
+#include "small_vector.h"
 
 namespace stg {
 
 // A wrapped (for type safety) array index.
+// Node ids are 32 bits, which is ample for any ABI and halves the size of every
+// edge. Graph::Allocate checks that they do not run out.
 struct Id {
   // defined in graph.cc as maximum value for index type
   static const Id kInvalid;
-  explicit Id(size_t ix) : ix_(ix) {}
+  explicit Id(size_t ix) : ix_(static_cast<uint32_t>(ix)) {}
   // TODO: auto operator<=>(const Id&) const = default;
   bool operator==(const Id& other) const {
     return ix_ == other.ix_;
@@ -50,7 +60,7 @@ struct Id {
   bool operator!=(const Id& other) const {
     return ix_ != other.ix_;
   }
-  size_t ix_;
+  uint32_t ix_;
 };
 
 std::ostream& operator<<(std::ostream& os, Id id);
@@ -83,6 +93,16 @@ struct hash<stg::Pair> {
 
 namespace stg {
 
+// Child lists of nodes. Most are short enough to be held inline.
+using Ids = SmallVector<Id, 4>;
+
+// Node names, and enumerator names, are interned by the graph holding the node,
+// so equal names within a graph have the same data pointer. Names given to a
+// node before it is set in a graph need only live until then; anything keeping
+// nodes for longer, such as GraphBuilder, must intern their names itself. A
+// node set in another graph, as Move does, has its names interned again by that
+// graph, so a copy kept outside any graph is only valid while its graph lives.
+
 struct Special {
   enum class Kind {
     VOID,
@@ -120,10 +140,10 @@ struct PointerToMember {
 };
 
 struct Typedef {
-  Typedef(const std::string& name, Id referred_type_id)
+  Typedef(std::string_view name, Id referred_type_id)
       : name(name), referred_type_id(referred_type_id) {}
 
-  std::string name;
+  std::string_view name;
   Id referred_type_id;
 };
 
@@ -150,11 +170,11 @@ struct Primitive {
     COMPLEX_NUMBER,
     UTF,
   };
-  Primitive(const std::string& name, std::optional<Encoding> encoding,
+  Primitive(std::string_view name, std::optional<Encoding> encoding,
             uint32_t bytesize)
       : name(name), encoding(encoding), bytesize(bytesize) {}
 
-  std::string name;
+  std::string_view name;
   std::optional<Encoding> encoding;
   uint32_t bytesize;
 };
@@ -181,22 +201,22 @@ struct BaseClass {
 std::ostream& operator<<(std::ostream& os, BaseClass::Inheritance inheritance);
 
 struct Method {
-  Method(const std::string& mangled_name, const std::string& name,
+  Method(std::string_view mangled_name, std::string_view name,
          uint64_t vtable_offset, Id type_id)
-      : mangled_name(mangled_name), name(name),
-        vtable_offset(vtable_offset), type_id(type_id) {}
+      : mangled_name(mangled_name), name(name), vtable_offset(vtable_offset),
+        type_id(type_id) {}
 
-  std::string mangled_name;
-  std::string name;
+  std::string_view mangled_name;
+  std::string_view name;
   uint64_t vtable_offset;
   Id type_id;
 };
 
 struct Member {
-  Member(const std::string& name, Id type_id, uint64_t offset, uint64_t bitsize)
+  Member(std::string_view name, Id type_id, uint64_t offset, uint64_t bitsize)
       : name(name), type_id(type_id), offset(offset), bitsize(bitsize) {}
 
-  std::string name;
+  std::string_view name;
   Id type_id;
   uint64_t offset;
   uint64_t bitsize;
@@ -206,19 +226,20 @@ struct StructUnion {
   enum class Kind { STRUCT, UNION };
   struct Definition {
     uint64_t bytesize;
-    std::vector<Id> base_classes;
-    std::vector<Id> methods;
-    std::vector<Id> members;
+    Ids base_classes;
+    Ids methods;
+    Ids members;
   };
-  StructUnion(Kind kind, const std::string& name) : kind(kind), name(name) {}
-  StructUnion(Kind kind, const std::string& name, uint64_t bytesize,
-              const std::vector<Id>& base_classes,
-              const std::vector<Id>& methods, const std::vector<Id>& members)
+  StructUnion(Kind kind, std::string_view name)
+      : kind(kind), name(name) {}
+  StructUnion(Kind kind, std::string_view name, uint64_t bytesize,
+              Ids base_classes, Ids methods, Ids members)
       : kind(kind), name(name),
-        definition({bytesize, base_classes, methods, members}) {}
+        definition({bytesize, std::move(base_classes), std::move(methods),
+                    std::move(members)}) {}
 
   Kind kind;
-  std::string name;
+  std::string_view name;
   std::optional<Definition> definition;
 };
 
@@ -226,26 +247,27 @@ std::ostream& operator<<(std::ostream& os, StructUnion::Kind kind);
 std::string& operator+=(std::string& os, StructUnion::Kind kind);
 
 struct Enumeration {
-  using Enumerators = std::vector<std::pair<std::string, int64_t>>;
+  // interned, as node names are
+  using Enumerators = SmallVector<std::pair<std::string_view, int64_t>, 2>;
   struct Definition {
     Id underlying_type_id;
     Enumerators enumerators;
   };
-  explicit Enumeration(const std::string& name) : name(name) {}
-  Enumeration(const std::string& name, Id underlying_type_id,
-              const Enumerators& enumerators)
-      : name(name), definition({underlying_type_id, enumerators}) {}
+  explicit Enumeration(std::string_view name) : name(name) {}
+  Enumeration(std::string_view name, Id underlying_type_id,
+              Enumerators enumerators)
+      : name(name), definition({underlying_type_id, std::move(enumerators)}) {}
 
-  std::string name;
+  std::string_view name;
   std::optional<Definition> definition;
 };
 
 struct Function {
-  Function(Id return_type_id, const std::vector<Id>& parameters)
-      : return_type_id(return_type_id), parameters(parameters) {}
+  Function(Id return_type_id, Ids parameters)
+      : return_type_id(return_type_id), parameters(std::move(parameters)) {}
 
   Id return_type_id;
-  std::vector<Id> parameters;
+  Ids parameters;
 };
 
 struct ElfSymbol {
@@ -271,7 +293,7 @@ struct ElfSymbol {
     }
     uint32_t number;
   };
-  ElfSymbol(const std::string& symbol_name,
+  ElfSymbol(std::string_view symbol_name,
             std::optional<VersionInfo> version_info,
             bool is_defined,
             SymbolType symbol_type,
@@ -288,11 +310,11 @@ struct ElfSymbol {
         binding(binding),
         visibility(visibility),
         crc(crc),
-        ns(ns),
+        ns(std::move(ns)),
         type_id(type_id),
         full_name(full_name) {}
 
-  std::string symbol_name;
+  std::string_view symbol_name;
   std::optional<VersionInfo> version_info;
   bool is_defined;
   SymbolType symbol_type;
@@ -314,90 +336,114 @@ std::string VersionedSymbolName(const ElfSymbol&);
 std::ostream& operator<<(std::ostream& os, ElfSymbol::CRC crc);
 
 struct Interface {
-  explicit Interface(const std::map<std::string, Id>& symbols)
-      : symbols(symbols) {}
-  Interface(const std::map<std::string, Id>& symbols,
-            const std::map<std::string, Id>& types)
-      : symbols(symbols), types(types) {}
-
-  std::map<std::string, Id> symbols;
-  std::map<std::string, Id> types;
+  explicit Interface(FlatMap<std::string, Id> symbols)
+      : symbols(std::move(symbols)) {}
+  Interface(FlatMap<std::string, Id> symbols, FlatMap<std::string, Id> types)
+      : symbols(std::move(symbols)), types(std::move(types)) {}
+
+  FlatMap<std::string, Id> symbols;
+  FlatMap<std::string, Id> types;
 };
 
 std::ostream& operator<<(std::ostream& os, Primitive::Encoding encoding);
 
+// Points the names of a node at interned copies. Nodes without names are left
+// alone.
+template <typename Node>
+void InternNames(Interner&, Node&) {}
+inline void InternNames(Interner& strings, Typedef& x) {
+  x.name = strings.Intern(x.name);
+}
+inline void InternNames(Interner& strings, Primitive& x) {
+  x.name = strings.Intern(x.name);
+}
+inline void InternNames(Interner& strings, Method& x) {
+  x.mangled_name = strings.Intern(x.mangled_name);
+  x.name = strings.Intern(x.name);
+}
+inline void InternNames(Interner& strings, Member& x) {
+  x.name = strings.Intern(x.name);
+}
+inline void InternNames(Interner& strings, StructUnion& x) {
+  x.name = strings.Intern(x.name);
+}
+inline void InternNames(Interner& strings, Enumeration& x) {
+  x.name = strings.Intern(x.name);
+  if (x.definition) {
+    for (auto& [name, _] : x.definition->enumerators) {
+      name = strings.Intern(name);
+    }
+  }
+}
+inline void InternNames(Interner& strings, ElfSymbol& x) {
+  x.symbol_name = strings.Intern(x.symbol_name);
+}
+
 // Concrete graph type.
+//
+// The id table and the node vectors are obtained from a memory resource, by
+// default the general-purpose allocator. This allows the bulk of a graph to be
+// placed in dedicated memory, such as huge pages, and released with it. Any
+// storage owned by the nodes themselves, such as child lists, is not affected.
 class Graph {
  public:
+  Graph() : Graph(std::pmr::get_default_resource()) {}
+  // The resource must outlive the graph.
+  explicit Graph(std::pmr::memory_resource* resource)
+      : indirection_(resource),
+        special_(resource),
+        pointer_reference_(resource),
+        pointer_to_member_(resource),
+        typedef_(resource),
+        qualified_(resource),
+        primitive_(resource),
+        array_(resource),
+        base_class_(resource),
+        method_(resource),
+        member_(resource),
+        struct_union_(resource),
+        enumeration_(resource),
+        function_(resource),
+        elf_symbol_(resource),
+        interface_(resource) {}
+
+  std::pmr::memory_resource* Resource() const {
+    return indirection_.get_allocator().resource();
+  }
+
   Id Limit() const {
     return Id(indirection_.size());
   }
 
   bool Is(Id id) const {
-    return indirection_[id.ix_].first != Which::ABSENT;
+    return indirection_[id.ix_].which != Which::ABSENT;
   }
 
   Id Allocate() {
+    CheckCapacity(1);
+    const auto id = Limit();
+    indirection_.emplace_back();
+    return id;
+  }
+
+  // Allocates count contiguous ids, returning the first.
+  Id Allocate(size_t count) {
+    CheckCapacity(count);
     const auto id = Limit();
-    indirection_.emplace_back(Which::ABSENT, 0);
+    indirection_.resize(indirection_.size() + count);
     return id;
   }
 
   template <typename Node, typename... Args>
   void Set(Id id, Args&&... args) {
     auto& reference = indirection_[id.ix_];
-    if (reference.first != Which::ABSENT) {
+    if (reference.which != Which::ABSENT) {
       Die() << "node value already set: " << id;
     }
-    if constexpr (std::is_same_v<Node, Special>) {
-      reference = {Which::SPECIAL, special_.size()};
-      special_.emplace_back(std::forward<Args>(args)...);
-    } else if constexpr (std::is_same_v<Node, PointerReference>) {
-      reference = {Which::POINTER_REFERENCE, pointer_reference_.size()};
-      pointer_reference_.emplace_back(std::forward<Args>(args)...);
-    } else if constexpr (std::is_same_v<Node, PointerToMember>) {
-      reference = {Which::POINTER_TO_MEMBER, pointer_to_member_.size()};
-      pointer_to_member_.emplace_back(std::forward<Args>(args)...);
-    } else if constexpr (std::is_same_v<Node, Typedef>) {
-      reference = {Which::TYPEDEF, typedef_.size()};
-      typedef_.emplace_back(std::forward<Args>(args)...);
-    } else if constexpr (std::is_same_v<Node, Qualified>) {
-      reference = {Which::QUALIFIED, qualified_.size()};
-      qualified_.emplace_back(std::forward<Args>(args)...);
-    } else if constexpr (std::is_same_v<Node, Primitive>) {
-      reference = {Which::PRIMITIVE, primitive_.size()};
-      primitive_.emplace_back(std::forward<Args>(args)...);
-    } else if constexpr (std::is_same_v<Node, Array>) {
-      reference = {Which::ARRAY, array_.size()};
-      array_.emplace_back(std::forward<Args>(args)...);
-    } else if constexpr (std::is_same_v<Node, BaseClass>) {
-      reference = {Which::BASE_CLASS, base_class_.size()};
-      base_class_.emplace_back(std::forward<Args>(args)...);
-    } else if constexpr (std::is_same_v<Node, Method>) {
-      reference = {Which::METHOD, method_.size()};
-      method_.emplace_back(std::forward<Args>(args)...);
-    } else if constexpr (std::is_same_v<Node, Member>) {
-      reference = {Which::MEMBER, member_.size()};
-      member_.emplace_back(std::forward<Args>(args)...);
-    } else if constexpr (std::is_same_v<Node, StructUnion>) {
-      reference = {Which::STRUCT_UNION, struct_union_.size()};
-      struct_union_.emplace_back(std::forward<Args>(args)...);
-    } else if constexpr (std::is_same_v<Node, Enumeration>) {
-      reference = {Which::ENUMERATION, enumeration_.size()};
-      enumeration_.emplace_back(std::forward<Args>(args)...);
-    } else if constexpr (std::is_same_v<Node, Function>) {
-      reference = {Which::FUNCTION, function_.size()};
-      function_.emplace_back(std::forward<Args>(args)...);
-    } else if constexpr (std::is_same_v<Node, ElfSymbol>) {
-      reference = {Which::ELF_SYMBOL, elf_symbol_.size()};
-      elf_symbol_.emplace_back(std::forward<Args>(args)...);
-    } else if constexpr (std::is_same_v<Node, Interface>) {
-      reference = {Which::INTERFACE, interface_.size()};
-      interface_.emplace_back(std::forward<Args>(args)...);
-    } else {
-      // unfortunately we cannot static_assert(false, "missing case")
-      static_assert(std::is_same<Node, Node*>::value, "missing case");
+    if (layer_ && id.ix_ < layer_->base.ix_) {
+      layer_->saved.emplace_back(id, reference);
     }
+    Emplace<Node>(reference, std::forward<Args>(args)...);
   }
 
   template <typename Node, typename... Args>
@@ -408,15 +454,18 @@ class Graph {
   }
 
   void Deallocate(Id) {
-    // don't actually do anything, not supported
+    // don't actually do anything, ids are only released by Compact
   }
 
   void Unset(Id id) {
     auto& reference = indirection_[id.ix_];
-    if (reference.first == Which::ABSENT) {
+    if (reference.which == Which::ABSENT) {
       Die() << "node value already unset: " << id;
     }
-    reference = {Which::ABSENT, 0};
+    if (layer_ && id.ix_ < layer_->base.ix_) {
+      layer_->saved.emplace_back(id, reference);
+    }
+    reference = Reference();
   }
 
   void Remove(Id id) {
@@ -424,6 +473,43 @@ class Graph {
     Deallocate(id);
   }
 
+  // Renumbers the remaining nodes densely, preserving their order, and releases
+  // the storage of removed nodes. Returns the mapping from old to new ids, in
+  // which removed nodes map to Id::kInvalid. Nodes must not refer to removed
+  // nodes.
+  std::vector<Id> Compact();
+
+  // As above, but the given unset ids stay allocated, and are renumbered with
+  // the nodes, so that nodes may refer to them and they can be set later.
+  std::vector<Id> Compact(std::span<const Id> reserved);
+
+  // As Compact, but the nodes are renumbered in the given order, which lists
+  // each node at most once, followed by any others in their existing order.
+  // Visitors then find nodes close to those that refer to them if the order is
+  // that of a traversal.
+  std::vector<Id> Renumber(std::span<const Id> order);
+
+  // Removes all nodes from limit onwards and releases their storage, so that
+  // the ids can be allocated again. Nodes before limit must not refer to them
+  // and must all have been set before any of them.
+  void Truncate(Id limit);
+
+  // Makes the current nodes an immutable base for the changes that follow,
+  // until Rollback or Commit. A base node that is changed, by Set, Unset or a
+  // mutable Apply (as used by Substitute), is first copied and the copy is
+  // changed instead. Rollback restores the base nodes and removes the nodes
+  // added since, at a cost proportional to the changes rather than to the
+  // base. This lets a baseline graph serve many candidates without being
+  // copied or read again.
+  //
+  // Checkpoints do not nest, Compact and Truncate cannot be used until the
+  // checkpoint is released and base nodes must not be changed concurrently.
+  void Checkpoint();
+  void Rollback();
+  // Keeps the changes made since the checkpoint. The storage of replaced base
+  // nodes is only released by Compact.
+  void Commit();
+
   template <typename Result, typename FunctionObject, typename... Args>
   Result Apply(FunctionObject& function, Id id, Args&&... args) const;
 
@@ -433,6 +519,15 @@ class Graph {
   template <typename Result, typename FunctionObject, typename... Args>
   Result Apply(FunctionObject& function, Id id, Args&&... args);
 
+  // Hints that a node is about to be visited, so that depth-first visitors can
+  // overlap the cache misses of the nodes they have queued. PrefetchReference
+  // fetches the indirection entry of a node and PrefetchNode, best issued once
+  // that has arrived, the node itself. Neither has any other effect.
+  void PrefetchReference(Id id) const {
+    __builtin_prefetch(&indirection_[id.ix_]);
+  }
+  void PrefetchNode(Id id) const;
+
   template <typename Function>
   void ForEach(Id start, Id limit, Function&& function) const {
     for (size_t ix = start.ix_; ix < limit.ix_; ++ix) {
@@ -443,8 +538,63 @@ class Graph {
     }
   }
 
+  // Calls function(worker, id) for each node in [start, limit), handing out
+  // chunks of consecutive ids to at most jobs workers, as with ForEachIndex.
+  // The function must be safe to call concurrently for distinct nodes.
+  template <typename Function>
+  void ParallelForEach(size_t jobs, Id start, Id limit,
+                       Function&& function) const {
+    constexpr size_t kChunk = 4096;
+    const size_t begin = start.ix_;
+    const size_t end = std::max<size_t>(begin, limit.ix_);
+    const size_t chunks = (end - begin + kChunk - 1) / kChunk;
+    ForEachIndex(jobs, chunks, [&](size_t worker, size_t chunk) {
+      const size_t chunk_begin = begin + chunk * kChunk;
+      const size_t chunk_end = std::min(chunk_begin + kChunk, end);
+      ForEach(Id(chunk_begin), Id(chunk_end), [&](Id id) {
+        function(worker, id);
+      });
+    });
+  }
+
+  // Returns a view of a copy of the string owned by the graph. Equal strings
+  // share storage. Node and enumerator names are interned as nodes are added,
+  // so readers need only keep the names they pass in alive until then.
+  std::string_view Intern(std::string_view string) {
+    return strings_.Intern(string);
+  }
+
+  // Points the names of a node kept outside the graph at the graph's copies.
+  template <typename Node>
+  void InternNames(Node& node) {
+    stg::InternNames(strings_, node);
+  }
+
+  const Interner& Strings() const {
+    return strings_;
+  }
+
+  // The number of entries of a node kind vector, including those of unset
+  // nodes not yet released by Compact, and the bytes reserved for them. Any
+  // storage owned by the nodes themselves is not included.
+  struct Storage {
+    std::string_view kind;
+    size_t count;
+    size_t bytes;
+  };
+
+  // Returns the storage of the id indirection table, then of each node kind.
+  std::vector<Storage> Usage() const;
+
  private:
-  enum class Which {
+  // The largest id value is reserved for Id::kInvalid.
+  void CheckCapacity(size_t count) const {
+    constexpr size_t kMaxIds = std::numeric_limits<decltype(Id::ix_)>::max();
+    Check(count <= kMaxIds - indirection_.size())
+        << "too many graph nodes: " << indirection_.size() << " + " << count;
+  }
+
+  enum class Which : uint8_t {
     ABSENT,
     SPECIAL,
     POINTER_REFERENCE,
@@ -463,30 +613,128 @@ class Graph {
     INTERFACE,
   };
 
-  std::vector<std::pair<Which, size_t>> indirection_;
-
-  std::vector<Special> special_;
-  std::vector<PointerReference> pointer_reference_;
-  std::vector<PointerToMember> pointer_to_member_;
-  std::vector<Typedef> typedef_;
-  std::vector<Qualified> qualified_;
-  std::vector<Primitive> primitive_;
-  std::vector<Array> array_;
-  std::vector<BaseClass> base_class_;
-  std::vector<Method> method_;
-  std::vector<Member> member_;
-  std::vector<StructUnion> struct_union_;
-  std::vector<Enumeration> enumeration_;
-  std::vector<Function> function_;
-  std::vector<ElfSymbol> elf_symbol_;
-  std::vector<Interface> interface_;
+  // A node kind and index into the corresponding node vector, packed into 8
+  // bytes as there is one of these per node id.
+  struct Reference {
+    Reference() : which(Which::ABSENT), ix(0) {}
+    Reference(Which which, size_t ix) : which(which), ix(ix) {
+      Check(ix == this->ix) << "graph node index overflow";
+    }
+
+    Which which;
+    uint32_t ix;
+  };
+
+  // Stores a node and points the reference at it.
+  template <typename Node, typename... Args>
+  void Emplace(Reference& reference, Args&&... args) {
+    if constexpr (std::is_same_v<Node, Special>) {
+      reference = Reference(Which::SPECIAL, special_.size());
+      special_.emplace_back(std::forward<Args>(args)...);
+    } else if constexpr (std::is_same_v<Node, PointerReference>) {
+      reference =
+          Reference(Which::POINTER_REFERENCE, pointer_reference_.size());
+      pointer_reference_.emplace_back(std::forward<Args>(args)...);
+    } else if constexpr (std::is_same_v<Node, PointerToMember>) {
+      reference =
+          Reference(Which::POINTER_TO_MEMBER, pointer_to_member_.size());
+      pointer_to_member_.emplace_back(std::forward<Args>(args)...);
+    } else if constexpr (std::is_same_v<Node, Typedef>) {
+      reference = Reference(Which::TYPEDEF, typedef_.size());
+      stg::InternNames(strings_,
+                       typedef_.emplace_back(std::forward<Args>(args)...));
+    } else if constexpr (std::is_same_v<Node, Qualified>) {
+      reference = Reference(Which::QUALIFIED, qualified_.size());
+      qualified_.emplace_back(std::forward<Args>(args)...);
+    } else if constexpr (std::is_same_v<Node, Primitive>) {
+      reference = Reference(Which::PRIMITIVE, primitive_.size());
+      stg::InternNames(strings_,
+                       primitive_.emplace_back(std::forward<Args>(args)...));
+    } else if constexpr (std::is_same_v<Node, Array>) {
+      reference = Reference(Which::ARRAY, array_.size());
+      array_.emplace_back(std::forward<Args>(args)...);
+    } else if constexpr (std::is_same_v<Node, BaseClass>) {
+      reference = Reference(Which::BASE_CLASS, base_class_.size());
+      base_class_.emplace_back(std::forward<Args>(args)...);
+    } else if constexpr (std::is_same_v<Node, Method>) {
+      reference = Reference(Which::METHOD, method_.size());
+      stg::InternNames(strings_,
+                       method_.emplace_back(std::forward<Args>(args)...));
+    } else if constexpr (std::is_same_v<Node, Member>) {
+      reference = Reference(Which::MEMBER, member_.size());
+      stg::InternNames(strings_,
+                       member_.emplace_back(std::forward<Args>(args)...));
+    } else if constexpr (std::is_same_v<Node, StructUnion>) {
+      reference = Reference(Which::STRUCT_UNION, struct_union_.size());
+      stg::InternNames(strings_,
+                       struct_union_.emplace_back(std::forward<Args>(args)...));
+    } else if constexpr (std::is_same_v<Node, Enumeration>) {
+      reference = Reference(Which::ENUMERATION, enumeration_.size());
+      stg::InternNames(strings_,
+                       enumeration_.emplace_back(std::forward<Args>(args)...));
+    } else if constexpr (std::is_same_v<Node, Function>) {
+      reference = Reference(Which::FUNCTION, function_.size());
+      function_.emplace_back(std::forward<Args>(args)...);
+    } else if constexpr (std::is_same_v<Node, ElfSymbol>) {
+      reference = Reference(Which::ELF_SYMBOL, elf_symbol_.size());
+      stg::InternNames(strings_,
+                       elf_symbol_.emplace_back(std::forward<Args>(args)...));
+    } else if constexpr (std::is_same_v<Node, Interface>) {
+      reference = Reference(Which::INTERFACE, interface_.size());
+      interface_.emplace_back(std::forward<Args>(args)...);
+    } else {
+      // unfortunately we cannot static_assert(false, "missing case")
+      static_assert(std::is_same<Node, Node*>::value, "missing case");
+    }
+  }
+
+  // Rebuilds the graph with the given ids, set or not, in order and returns
+  // the mapping from old to new ids, as used by Compact and Renumber.
+  std::vector<Id> Rebuild(const std::vector<Id>& sequence);
+  // Copies a base node, if not already copied, so that it can be changed.
+  void CopyOnWrite(Id id);
+  // The number of entries of each node kind vector, indexed by Which.
+  std::vector<size_t> Sizes() const;
+  // Drops the ids from limit onwards and the node storage beyond the sizes.
+  void Shrink(Id limit, const std::vector<size_t>& sizes);
+
+  struct Layer {
+    Id base;
+    std::vector<size_t> sizes;
+    // the previous references of changed base ids, in order of change
+    std::vector<std::pair<Id, Reference>> saved;
+  };
+
+  std::pmr::vector<Reference> indirection_;
+
+  std::pmr::vector<Special> special_;
+  std::pmr::vector<PointerReference> pointer_reference_;
+  std::pmr::vector<PointerToMember> pointer_to_member_;
+  std::pmr::vector<Typedef> typedef_;
+  std::pmr::vector<Qualified> qualified_;
+  std::pmr::vector<Primitive> primitive_;
+  std::pmr::vector<Array> array_;
+  std::pmr::vector<BaseClass> base_class_;
+  std::pmr::vector<Method> method_;
+  std::pmr::vector<Member> member_;
+  std::pmr::vector<StructUnion> struct_union_;
+  std::pmr::vector<Enumeration> enumeration_;
+  std::pmr::vector<Function> function_;
+  std::pmr::vector<ElfSymbol> elf_symbol_;
+  std::pmr::vector<Interface> interface_;
+
+  Interner strings_;
+  // set between Checkpoint and Rollback or Commit
+  std::optional<Layer> layer_;
 };
 
 template <typename Result, typename FunctionObject, typename... Args>
 Result Graph::Apply(FunctionObject& function, Id id, Args&&... args) const {
-  const auto& [which, ix] = indirection_[id.ix_];
+  const auto [which, ix] = indirection_[id.ix_];
+  // A switch over the dense node kinds compiles to a jump table and, unlike a
+  // table of function pointers, lets the visitor be inlined into each case.
   switch (which) {
-    case Which::ABSENT:
+    case Which::ABSENT: [[unlikely]]
       Die() << "undefined node: " << id;
     case Which::SPECIAL:
       return function(special_[ix], std::forward<Args>(args)...);
@@ -521,16 +769,54 @@ Result Graph::Apply(FunctionObject& function, Id id, Args&&... args) const {
   }
 }
 
+inline void Graph::PrefetchNode(Id id) const {
+  const auto [which, ix] = indirection_[id.ix_];
+  switch (which) {
+    case Which::ABSENT:
+      return;
+    case Which::SPECIAL:
+      return __builtin_prefetch(&special_[ix]);
+    case Which::POINTER_REFERENCE:
+      return __builtin_prefetch(&pointer_reference_[ix]);
+    case Which::POINTER_TO_MEMBER:
+      return __builtin_prefetch(&pointer_to_member_[ix]);
+    case Which::TYPEDEF:
+      return __builtin_prefetch(&typedef_[ix]);
+    case Which::QUALIFIED:
+      return __builtin_prefetch(&qualified_[ix]);
+    case Which::PRIMITIVE:
+      return __builtin_prefetch(&primitive_[ix]);
+    case Which::ARRAY:
+      return __builtin_prefetch(&array_[ix]);
+    case Which::BASE_CLASS:
+      return __builtin_prefetch(&base_class_[ix]);
+    case Which::METHOD:
+      return __builtin_prefetch(&method_[ix]);
+    case Which::MEMBER:
+      return __builtin_prefetch(&member_[ix]);
+    case Which::STRUCT_UNION:
+      return __builtin_prefetch(&struct_union_[ix]);
+    case Which::ENUMERATION:
+      return __builtin_prefetch(&enumeration_[ix]);
+    case Which::FUNCTION:
+      return __builtin_prefetch(&function_[ix]);
+    case Which::ELF_SYMBOL:
+      return __builtin_prefetch(&elf_symbol_[ix]);
+    case Which::INTERFACE:
+      return __builtin_prefetch(&interface_[ix]);
+  }
+}
+
 template <typename Result, typename FunctionObject, typename... Args>
 Result Graph::Apply2(
     FunctionObject& function, Id id1, Id id2, Args&&... args) const {
-  const auto& [which1, ix1] = indirection_[id1.ix_];
-  const auto& [which2, ix2] = indirection_[id2.ix_];
+  const auto [which1, ix1] = indirection_[id1.ix_];
+  const auto [which2, ix2] = indirection_[id2.ix_];
   if (which1 != which2) {
     return function.Mismatch(std::forward<Args>(args)...);
   }
   switch (which1) {
-    case Which::ABSENT:
+    case Which::ABSENT: [[unlikely]]
       Die() << "undefined nodes: " << id1 << ", " << id2;
     case Which::SPECIAL:
       return function(special_[ix1], special_[ix2],
@@ -592,6 +878,9 @@ struct ConstAdapter {
 
 template <typename Result, typename FunctionObject, typename... Args>
 Result Graph::Apply(FunctionObject& function, Id id, Args&&... args) {
+  if (layer_ && id.ix_ < layer_->base.ix_) [[unlikely]] {
+    CopyOnWrite(id);
+  }
   ConstAdapter<Result, FunctionObject, Args&&...> adapter(function);
   return static_cast<const Graph&>(*this).Apply<Result>(
       adapter, id, std::forward<Args>(args)...);
@@ -605,7 +894,7 @@ struct InterfaceKey {
   }
 
   std::string operator()(const stg::Typedef& x) const {
-    return x.name;
+    return std::string(x.name);
   }
 
   std::string operator()(const stg::StructUnion& x) const {
@@ -621,7 +910,7 @@ struct InterfaceKey {
     if (x.name.empty()) {
       Die() << "anonymous enum interface type";
     }
-    return "enum " + x.name;
+    return "enum " + std::string(x.name);
   }
 
   std::string operator()(const stg::ElfSymbol& x) const {
@@ -637,60 +926,103 @@ struct InterfaceKey {
 };
 
 // Roughly equivalent to std::set<Id> but with constant time operations and
-// key set limited to allocated Ids.
+// key set limited to allocated Ids. Membership is packed 64 Ids to a word.
 class DenseIdSet {
  public:
   explicit DenseIdSet(Id start) : offset_(start.ix_) {}
   void Reserve(Id limit) {
-    ids_.reserve(limit.ix_ - offset_);
+    words_.reserve(Words(limit.ix_ - offset_));
   }
+  // Returns whether the Id was newly inserted.
   bool Insert(Id id) {
+    const auto offset_ix = Offset(id);
+    const auto word_ix = offset_ix / kBits;
+    if (word_ix >= words_.size()) {
+      words_.resize(word_ix + 1, 0);
+    }
+    auto& word = words_[word_ix];
+    const uint64_t bit = uint64_t{1} << (offset_ix % kBits);
+    const bool present = (word & bit) != 0;
+    word |= bit;
+    return !present;
+  }
+  bool Contains(Id id) const {
+    const auto offset_ix = Offset(id);
+    const auto word_ix = offset_ix / kBits;
+    return word_ix < words_.size()
+        && (words_[word_ix] & (uint64_t{1} << (offset_ix % kBits))) != 0;
+  }
+
+ private:
+  static constexpr size_t kBits = 64;
+
+  static size_t Words(size_t size) {
+    return (size + kBits - 1) / kBits;
+  }
+  size_t Offset(Id id) const {
     const auto ix = id.ix_;
     if (ix < offset_) {
       Die() << "DenseIdSet: out of range access to " << id;
     }
-    const auto offset_ix = ix - offset_;
-    if (offset_ix >= ids_.size()) {
-      ids_.resize(offset_ix + 1, false);
-    }
-    if (ids_[offset_ix]) {
-      return false;
-    }
-    ids_[offset_ix] = true;
-    return true;
+    return ix - offset_;
   }
 
- private:
   size_t offset_;
-  std::vector<bool> ids_;
+  std::vector<uint64_t> words_;
 };
 
 // Roughly equivalent to std::map<Id, Id>, defaulted to the identity mapping,
 // but with constant time operations and key set limited to allocated Ids.
+//
+// Storage is allocated in fixed-size pages which are never moved or resized,
+// so growth copies no entries and references returned by operator[] remain
+// valid. Get never allocates and may be called concurrently, as long as no
+// thread is populating the mapping at the same time.
 class DenseIdMapping {
  public:
   explicit DenseIdMapping(Id start) : offset_(start.ix_) {}
   void Reserve(Id limit) {
-    ids_.reserve(limit.ix_ - offset_);
+    pages_.reserve((limit.ix_ - offset_ + kPageSize - 1) / kPageSize);
   }
   Id& operator[](Id id) {
+    const auto offset_ix = Offset(id);
+    const auto page_ix = offset_ix / kPageSize;
+    while (page_ix >= pages_.size()) {
+      AddPage();
+    }
+    return pages_[page_ix][offset_ix % kPageSize];
+  }
+  // As above, but without populating, so it may be called concurrently.
+  Id Get(Id id) const {
+    const auto offset_ix = Offset(id);
+    const auto page_ix = offset_ix / kPageSize;
+    return page_ix < pages_.size() ? pages_[page_ix][offset_ix % kPageSize]
+                                   : id;
+  }
+
+ private:
+  static constexpr size_t kPageSize = 4096;
+
+  size_t Offset(Id id) const {
     const auto ix = id.ix_;
     if (ix < offset_) {
       Die() << "DenseIdMapping: out of range access to " << id;
     }
-    Populate(ix + 1);
-    return ids_[ix - offset_];
+    return ix - offset_;
   }
-
- private:
-  void Populate(size_t size) {
-    for (size_t ix = offset_ + ids_.size(); ix < size; ++ix) {
-      ids_.emplace_back(ix);
+  // The page's buffer is allocated once and moves with it, so the entries
+  // themselves stay put even when the page list is reallocated.
+  void AddPage() {
+    const size_t base = offset_ + pages_.size() * kPageSize;
+    auto& page = pages_.emplace_back();
+    page.reserve(kPageSize);
+    for (size_t ix = base; ix < base + kPageSize; ++ix) {
+      page.emplace_back(ix);
     }
   }
 
   size_t offset_;
-  std::vector<Id> ids_;
+  std::vector<std::vector<Id>> pages_;
 };
 
 }  // namespace stg
@@ -0,0 +1,164 @@
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+// -*- mode: C++ -*-
+//
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License v2.0 with LLVM Exceptions (the
+// "License"); you may not use this file except in compliance with the
+// License.  You may obtain a copy of the License at
+//
+//     https://llvm.org/LICENSE.txt
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef STG_GRAPH_BUILDER_H_
+#define STG_GRAPH_BUILDER_H_
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include "error.h"
+#include "graph.h"
+
+namespace stg {
+
+// Populates a graph from several threads at once. Graph itself is not
+// thread-safe, so each worker allocates ids from blocks handed out atomically
+// and keeps the nodes it sets in its own per-kind lists. Seal then moves all
+// the nodes into the graph, in a single pass.
+//
+// Workers may refer to ids allocated by other workers, as all ids are global.
+// The ids each worker gets depend on scheduling, so any order that must not
+// depend on the number of threads should not be taken from them. Ids that were
+// allocated but not set are left as holes in the graph.
+//
+// The graph must not be changed between creating the builder and sealing it.
+class GraphBuilder {
+ public:
+  class Worker {
+   public:
+    Id Allocate() {
+      if (next_ == end_) {
+        next_ = builder_.next_.fetch_add(kBlock);
+        end_ = next_ + kBlock;
+      }
+      const Id id(next_++);
+      limit_ = std::max(limit_, next_);
+      return id;
+    }
+
+    template <typename Node, typename... Args>
+    void Set(Id id, Args&&... args) {
+      // names are kept here until the graph interns its own copies
+      InternNames(strings_, std::get<Nodes<Node>>(nodes_).emplace_back(
+          std::piecewise_construct, std::forward_as_tuple(id),
+          std::forward_as_tuple(std::forward<Args>(args)...)).second);
+    }
+
+    template <typename Node, typename... Args>
+    Id Add(Args&&... args) {
+      const Id id = Allocate();
+      Set<Node>(id, std::forward<Args>(args)...);
+      return id;
+    }
+
+   private:
+    friend class GraphBuilder;
+
+    template <typename Node>
+    using Nodes = std::vector<std::pair<Id, Node>>;
+
+    explicit Worker(GraphBuilder& builder) : builder_(builder) {}
+
+    template <typename Node>
+    void MoveTo(Graph& graph, size_t limit) {
+      auto& nodes = std::get<Nodes<Node>>(nodes_);
+      for (auto& [id, node] : nodes) {
+        Check(id.ix_ < limit) << "node id was not allocated: " << id;
+        graph.Set<Node>(id, std::move(node));
+      }
+      nodes = Nodes<Node>();
+    }
+
+    GraphBuilder& builder_;
+    // the rest of the current block of ids
+    size_t next_ = 0;
+    size_t end_ = 0;
+    // one past the last id allocated
+    size_t limit_ = 0;
+    std::tuple<Nodes<Special>, Nodes<PointerReference>, Nodes<PointerToMember>,
+               Nodes<Typedef>, Nodes<Qualified>, Nodes<Primitive>,
+               Nodes<Array>, Nodes<BaseClass>, Nodes<Method>, Nodes<Member>,
+               Nodes<StructUnion>, Nodes<Enumeration>, Nodes<Function>,
+               Nodes<ElfSymbol>, Nodes<Interface>> nodes_;
+    Interner strings_;
+  };
+
+  GraphBuilder(Graph& graph, size_t workers)
+      : graph_(graph), start_(graph.Limit()), next_(start_.ix_) {
+    workers_.reserve(workers);
+    for (size_t ix = 0; ix < workers; ++ix) {
+      workers_.emplace_back(new Worker(*this));
+    }
+  }
+
+  GraphBuilder(const GraphBuilder&) = delete;
+  GraphBuilder& operator=(const GraphBuilder&) = delete;
+
+  // Each worker must only be used by one thread at a time.
+  Worker& operator[](size_t worker) {
+    return *workers_[worker];
+  }
+
+  // Moves the nodes of all the workers into the graph. The ids allocated (up to
+  // the last used by any worker) are added to the graph.
+  void Seal() {
+    Check(graph_.Limit() == start_)
+        << "graph changed while being built concurrently";
+    size_t limit = start_.ix_;
+    for (const auto& worker : workers_) {
+      limit = std::max(limit, worker->limit_);
+    }
+    graph_.Allocate(limit - start_.ix_);
+    for (auto& worker : workers_) {
+      worker->MoveTo<Special>(graph_, limit);
+      worker->MoveTo<PointerReference>(graph_, limit);
+      worker->MoveTo<PointerToMember>(graph_, limit);
+      worker->MoveTo<Typedef>(graph_, limit);
+      worker->MoveTo<Qualified>(graph_, limit);
+      worker->MoveTo<Primitive>(graph_, limit);
+      worker->MoveTo<Array>(graph_, limit);
+      worker->MoveTo<BaseClass>(graph_, limit);
+      worker->MoveTo<Method>(graph_, limit);
+      worker->MoveTo<Member>(graph_, limit);
+      worker->MoveTo<StructUnion>(graph_, limit);
+      worker->MoveTo<Enumeration>(graph_, limit);
+      worker->MoveTo<Function>(graph_, limit);
+      worker->MoveTo<ElfSymbol>(graph_, limit);
+      worker->MoveTo<Interface>(graph_, limit);
+    }
+    workers_.clear();
+  }
+
+ private:
+  // ids handed out to a worker at a time
+  static constexpr size_t kBlock = 256;
+
+  Graph& graph_;
+  const Id start_;
+  std::atomic<size_t> next_;
+  std::vector<std::unique_ptr<Worker>> workers_;
+};
+
+}  // namespace stg
+
+#endif  // STG_GRAPH_BUILDER_H_
@@ -0,0 +1,100 @@
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+// -*- mode: C++ -*-
+//
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License v2.0 with LLVM Exceptions (the
+// "License"); you may not use this file except in compliance with the
+// License.  You may obtain a copy of the License at
+//
+//     https://llvm.org/LICENSE.txt
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "graph_builder.h"
+
+#include <cstddef>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <catch2/catch.hpp>
+#include "error.h"
+#include "graph.h"
+#include "parallel.h"
+
+namespace Test {
+
+struct GetTypedef {
+  std::optional<std::pair<std::string, stg::Id>> operator()(
+      const stg::Typedef& x) {
+    return {{std::string(x.name), x.referred_type_id}};
+  }
+  template <typename Node>
+  std::optional<std::pair<std::string, stg::Id>> operator()(const Node&) {
+    return {};
+  }
+};
+
+TEST_CASE("concurrent build") {
+  const size_t jobs = GENERATE(1, 4);
+  const size_t count = 2000;
+  stg::Graph graph;
+  const stg::Id start = graph.Add<stg::Special>(stg::Special::Kind::VOID);
+  // every worker refers to a node that existed before building
+  std::vector<std::optional<stg::Id>> ids(count);
+  stg::GraphBuilder builder(graph, jobs);
+  stg::ForEachIndex(jobs, count, [&](size_t worker, size_t index) {
+    auto& build = builder[worker];
+    ids[index] = build.Add<stg::Typedef>("t" + std::to_string(index), start);
+  });
+  builder.Seal();
+
+  GetTypedef get;
+  for (size_t index = 0; index < count; ++index) {
+    REQUIRE(ids[index]);
+    const auto node =
+        graph.Apply<std::optional<std::pair<std::string, stg::Id>>>(
+            get, *ids[index]);
+    REQUIRE(node);
+    CHECK(node->first == "t" + std::to_string(index));
+    CHECK(node->second == start);
+  }
+}
+
+TEST_CASE("cross references and holes") {
+  stg::Graph graph;
+  stg::GraphBuilder builder(graph, 2);
+  auto& worker0 = builder[0];
+  auto& worker1 = builder[1];
+  const stg::Id a = worker0.Allocate();
+  const stg::Id b = worker1.Allocate();
+  const stg::Id unused = worker1.Allocate();
+  worker0.Set<stg::Typedef>(a, "a", b);
+  worker1.Set<stg::Special>(b, stg::Special::Kind::VOID);
+  builder.Seal();
+
+  CHECK(graph.Is(a));
+  CHECK(graph.Is(b));
+  CHECK(!graph.Is(unused));
+  GetTypedef get;
+  const auto node =
+      graph.Apply<std::optional<std::pair<std::string, stg::Id>>>(get, a);
+  REQUIRE(node);
+  CHECK(node->second == b);
+}
+
+TEST_CASE("graph changed before sealing") {
+  stg::Graph graph;
+  stg::GraphBuilder builder(graph, 1);
+  builder[0].Add<stg::Special>(stg::Special::Kind::VOID);
+  graph.Add<stg::Special>(stg::Special::Kind::VOID);
+  CHECK_THROWS_AS(builder.Seal(), stg::Exception);
+}
+
+}  // namespace Test
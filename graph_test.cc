@@ -0,0 +1,289 @@
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+// -*- mode: C++ -*-
+//
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License v2.0 with LLVM Exceptions (the
+// "License"); you may not use this file except in compliance with the
+// License.  You may obtain a copy of the License at
+//
+//     https://llvm.org/LICENSE.txt
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "graph.h"
+
+#include <cstddef>
+#include <set>
+#include <string>
+#include <string_view>
+#include <variant>
+#include <vector>
+
+#include <catch2/catch.hpp>
+#include "arena.h"
+#include "metrics.h"
+#include "substitution.h"
+
+namespace Test {
+
+size_t Count(const stg::Graph& graph, std::string_view kind) {
+  for (const auto& storage : graph.Usage()) {
+    if (storage.kind == kind) {
+      return storage.count;
+    }
+  }
+  return 0;
+}
+
+TEST_CASE("truncation") {
+  stg::Graph graph;
+  const auto int_type = graph.Add<stg::Primitive>(
+      "int", stg::Primitive::Encoding::SIGNED_INTEGER, 4);
+  const auto unset = graph.Add<stg::Typedef>("unset", int_type);
+  const auto kept = graph.Add<stg::Typedef>("kept", int_type);
+  graph.Unset(unset);
+  const auto limit = graph.Limit();
+
+  const auto pointer = graph.Add<stg::PointerReference>(
+      stg::PointerReference::Kind::POINTER, kept);
+  const auto removed = graph.Add<stg::Typedef>("removed", pointer);
+  graph.Add<stg::Typedef>("also removed", int_type);
+  graph.Unset(removed);
+  CHECK(Count(graph, "typedef") == 4);
+
+  graph.Truncate(limit);
+  CHECK(graph.Limit() == limit);
+  CHECK(graph.Is(int_type));
+  CHECK(!graph.Is(unset));
+  CHECK(graph.Is(kept));
+  CHECK(Count(graph, "ids") == 3);
+  CHECK(Count(graph, "typedef") == 2);
+  CHECK(Count(graph, "pointer_reference") == 0);
+
+  // ids are allocated again
+  CHECK(graph.Add<stg::Typedef>("again", kept) == pointer);
+  CHECK(Count(graph, "typedef") == 3);
+}
+
+struct GetTypedef {
+  stg::Typedef operator()(const stg::Typedef& x) {
+    return x;
+  }
+  template <typename Node>
+  stg::Typedef operator()(const Node&) {
+    return {{}, stg::Id::kInvalid};
+  }
+};
+
+TEST_CASE("checkpoint and rollback") {
+  stg::Graph graph;
+  const auto int_type = graph.Add<stg::Primitive>(
+      "int", stg::Primitive::Encoding::SIGNED_INTEGER, 4);
+  const auto long_type = graph.Add<stg::Primitive>(
+      "long", stg::Primitive::Encoding::SIGNED_INTEGER, 8);
+  const auto changed = graph.Add<stg::Typedef>("changed", int_type);
+  const auto removed = graph.Add<stg::Typedef>("removed", int_type);
+  const auto later = graph.Allocate();
+  const auto limit = graph.Limit();
+  graph.Checkpoint();
+
+  // base nodes are copied before they are changed, and only once
+  auto remap = [&](stg::Id& id) {
+    if (id == int_type) {
+      id = long_type;
+    }
+  };
+  stg::Substitute substitute(graph, remap);
+  substitute(changed);
+  substitute(changed);
+  CHECK(Count(graph, "typedef") == 3);
+  graph.Remove(removed);
+  graph.Set<stg::Typedef>(later, "later", changed);
+  const auto added = graph.Add<stg::Typedef>("added", later);
+  CHECK(!graph.Is(removed));
+  CHECK(graph.Is(added));
+
+  graph.Rollback();
+  CHECK(graph.Limit() == limit);
+  CHECK(graph.Is(removed));
+  CHECK(!graph.Is(later));
+  GetTypedef get;
+  const auto restored = graph.Apply<stg::Typedef>(get, changed);
+  CHECK(restored.name == "changed");
+  CHECK(restored.referred_type_id == int_type);
+  CHECK(Count(graph, "typedef") == 2);
+
+  // changes can also be kept
+  graph.Checkpoint();
+  graph.Remove(removed);
+  CHECK_THROWS(graph.Compact());
+  graph.Commit();
+  CHECK(!graph.Is(removed));
+  CHECK_THROWS(graph.Rollback());
+}
+
+TEST_CASE("compaction with reserved ids") {
+  stg::Graph graph;
+  const auto removed = graph.Add<stg::Primitive>(
+      "char", stg::Primitive::Encoding::SIGNED_CHARACTER, 1);
+  const auto later = graph.Allocate();
+  const auto pointer = graph.Add<stg::PointerReference>(
+      stg::PointerReference::Kind::POINTER, later);
+  const auto dropped = graph.Allocate();
+  graph.Remove(removed);
+
+  const auto mapping = graph.Compact({&later, 1});
+  CHECK(mapping[removed.ix_] == stg::Id::kInvalid);
+  CHECK(mapping[later.ix_] == stg::Id(0));
+  CHECK(mapping[pointer.ix_] == stg::Id(1));
+  CHECK(mapping[dropped.ix_] == stg::Id::kInvalid);
+  CHECK(graph.Limit() == stg::Id(2));
+  CHECK(!graph.Is(stg::Id(0)));
+  CHECK(graph.Is(stg::Id(1)));
+  // the reserved id can still be set
+  graph.Set<stg::Typedef>(stg::Id(0), "t", stg::Id(1));
+  CHECK(graph.Is(stg::Id(0)));
+  // but set ids cannot be reserved
+  const stg::Id set(1);
+  CHECK_THROWS(graph.Compact({&set, 1}));
+}
+
+struct GetEnumeratorName {
+  std::string operator()(const stg::Enumeration& x) {
+    return std::string(x.definition->enumerators.front().first);
+  }
+  template <typename Node>
+  std::string operator()(const Node&) {
+    return {};
+  }
+};
+
+TEST_CASE("renumbering") {
+  stg::Graph graph;
+  const auto int_type = graph.Add<stg::Primitive>(
+      "int", stg::Primitive::Encoding::SIGNED_INTEGER, 4);
+  const auto removed = graph.Add<stg::Typedef>("removed", int_type);
+  const auto other = graph.Add<stg::Typedef>("other", int_type);
+  const auto pointer = graph.Add<stg::PointerReference>(
+      stg::PointerReference::Kind::POINTER, int_type);
+  const auto enumeration = graph.Add<stg::Enumeration>(
+      "e", int_type, stg::Enumeration::Enumerators{{"a", 1}});
+  graph.Remove(removed);
+
+  const std::vector<stg::Id> order = {pointer, int_type};
+  const auto mapping = graph.Renumber(order);
+  CHECK(mapping[pointer.ix_] == stg::Id(0));
+  CHECK(mapping[int_type.ix_] == stg::Id(1));
+  CHECK(mapping[removed.ix_] == stg::Id::kInvalid);
+  // nodes not listed follow
+  CHECK(mapping[other.ix_] == stg::Id(2));
+  CHECK(mapping[enumeration.ix_] == stg::Id(3));
+  CHECK(graph.Limit() == stg::Id(4));
+  GetTypedef get;
+  CHECK(graph.Apply<stg::Typedef>(get, stg::Id(2)).referred_type_id
+        == stg::Id(1));
+  // interned enumerator names survive
+  GetEnumeratorName get_name;
+  CHECK(graph.Apply<std::string>(get_name, stg::Id(3)) == "a");
+  // nodes must be set and listed once
+  const std::vector<stg::Id> repeated = {stg::Id(0), stg::Id(0)};
+  CHECK_THROWS(graph.Renumber(repeated));
+}
+
+TEST_CASE("block allocation") {
+  stg::Graph graph;
+  graph.Allocate();
+  const auto first = graph.Allocate(3);
+  CHECK(first == stg::Id(1));
+  CHECK(graph.Limit() == stg::Id(4));
+  for (size_t ix = 0; ix < 4; ++ix) {
+    CHECK(!graph.Is(stg::Id(ix)));
+  }
+  CHECK(graph.Allocate(0) == graph.Limit());
+  // ids are 32 bits and Id::kInvalid is never allocated
+  CHECK_THROWS(graph.Allocate(stg::Id::kInvalid.ix_ - 3));
+  CHECK(graph.Limit() == stg::Id(4));
+}
+
+TEST_CASE("memory resource") {
+  stg::Metrics metrics;
+  {
+    // the arena counts the bytes it passes through
+    stg::Arena arena(metrics, "graph", 0);
+    stg::Graph graph(arena.Resource());
+    const auto int_type = graph.Add<stg::Primitive>(
+        "int", stg::Primitive::Encoding::SIGNED_INTEGER, 4);
+    const auto removed = graph.Add<stg::Typedef>("removed", int_type);
+    graph.Add<stg::Typedef>("kept", int_type);
+    graph.Remove(removed);
+    graph.Compact();
+    CHECK(graph.Resource() == arena.Resource());
+    CHECK(graph.Limit() == stg::Id(2));
+  }
+  REQUIRE(metrics.size() == 1);
+  CHECK(std::get<size_t>(metrics[0].value) > 0);
+}
+
+TEST_CASE("dense id set") {
+  stg::DenseIdSet set(stg::Id(10));
+  std::set<size_t> expected;
+  for (const size_t ix : {10, 11, 73, 74, 137, 10, 5000, 73, 4999}) {
+    const stg::Id id(ix);
+    CHECK(set.Insert(id) == expected.insert(ix).second);
+  }
+  for (size_t ix = 10; ix < 6000; ++ix) {
+    CHECK(set.Contains(stg::Id(ix)) == (expected.count(ix) > 0));
+  }
+  CHECK_THROWS(set.Insert(stg::Id(9)));
+}
+
+TEST_CASE("dense id mapping") {
+  stg::DenseIdMapping mapping(stg::Id(3));
+  CHECK(mapping.Get(stg::Id(100000)) == stg::Id(100000));
+  auto& first = mapping[stg::Id(3)];
+  first = stg::Id(7);
+  // populating later pages leaves existing entries in place
+  mapping[stg::Id(20000)] = stg::Id(4);
+  CHECK(&first == &mapping[stg::Id(3)]);
+  CHECK(mapping.Get(stg::Id(3)) == stg::Id(7));
+  CHECK(mapping.Get(stg::Id(20000)) == stg::Id(4));
+  CHECK(mapping.Get(stg::Id(19999)) == stg::Id(19999));
+  CHECK(mapping.Get(stg::Id(4100)) == stg::Id(4100));
+  CHECK(mapping.Get(stg::Id(100000)) == stg::Id(100000));
+  CHECK_THROWS(mapping.Get(stg::Id(2)));
+}
+
+struct GetEnumerators {
+  stg::Enumeration::Enumerators operator()(const stg::Enumeration& x) {
+    return x.definition->enumerators;
+  }
+  template <typename Node>
+  stg::Enumeration::Enumerators operator()(const Node&) {
+    return {};
+  }
+};
+
+TEST_CASE("enumerator names are interned") {
+  stg::Graph graph;
+  const auto v = graph.Add<stg::Special>(stg::Special::Kind::VOID);
+  std::string name = "RED";
+  const auto e1 = graph.Add<stg::Enumeration>(
+      "e1", v, stg::Enumeration::Enumerators{{name, 0}});
+  name = "RED";
+  const auto e2 = graph.Add<stg::Enumeration>(
+      "e2", v, stg::Enumeration::Enumerators{{name, 1}});
+  name.clear();
+  GetEnumerators get;
+  const auto enums1 = graph.Apply<stg::Enumeration::Enumerators>(get, e1);
+  const auto enums2 = graph.Apply<stg::Enumeration::Enumerators>(get, e2);
+  CHECK(enums1[0].first == "RED");
+  CHECK(enums1[0].first.data() == enums2[0].first.data());
+  CHECK(enums2[0].second == 1);
+}
+
+}  // namespace Test
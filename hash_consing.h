@@ -0,0 +1,153 @@
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+// -*- mode: C++ -*-
+//
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License v2.0 with LLVM Exceptions (the
+// "License"); you may not use this file except in compliance with the
+// License.  You may obtain a copy of the License at
+//
+//     https://llvm.org/LICENSE.txt
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef STG_HASH_CONSING_H_
+#define STG_HASH_CONSING_H_
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <tuple>
+#include <unordered_map>
+#include <utility>
+
+#include "graph.h"
+#include "hashing.h"
+
+namespace stg {
+
+// Hash-consing of the nodes that are entirely described by their own
+// attributes and edges: Special, Primitive, PointerReference, Qualified, Array
+// and Function. Readers can use this in front of the graph to avoid creating
+// nodes that deduplication would later remove.
+//
+// Add returns the id of an identical node added or set earlier, if there is
+// one, instead of adding another. Set puts a node under an id allocated in
+// advance, as readers do for nodes referred to before they are read, so that
+// later identical nodes share it.
+//
+// Nodes are only identical if their edges are, so nodes referring to distinct
+// but equal nodes are not caught. That is left to deduplication.
+class HashConsing {
+ public:
+  explicit HashConsing(Graph& graph) : graph_(graph) {}
+
+  template <typename Node, typename... Args>
+  Id Add(Args&&... args) {
+    auto& index = std::get<Index<Node>>(indexes_);
+    const auto [it, inserted] =
+        index.try_emplace(Key<Node>(std::forward<Args>(args)...), Id::kInvalid);
+    if (inserted) {
+      it->second = graph_.Add<Node>(it->first);
+    } else {
+      ++hits_;
+    }
+    return it->second;
+  }
+
+  template <typename Node, typename... Args>
+  void Set(Id id, Args&&... args) {
+    auto& index = std::get<Index<Node>>(indexes_);
+    const auto it =
+        index.try_emplace(Key<Node>(std::forward<Args>(args)...), id).first;
+    graph_.Set<Node>(id, it->first);
+  }
+
+  // The number of nodes Add did not have to add.
+  size_t Hits() const {
+    return hits_;
+  }
+
+ private:
+  // The index outlives the names passed in, so keys use the graph's copies.
+  template <typename Node, typename... Args>
+  Node Key(Args&&... args) {
+    Node node(std::forward<Args>(args)...);
+    graph_.InternNames(node);
+    return node;
+  }
+
+  struct HashNode {
+    size_t operator()(const Special& x) const {
+      return hash(static_cast<uint32_t>(x.kind)).value;
+    }
+    size_t operator()(const Primitive& x) const {
+      const uint32_t encoding =
+          x.encoding ? static_cast<uint32_t>(*x.encoding) + 1 : 0;
+      return hash(std::string_view(x.name), encoding, x.bytesize).value;
+    }
+    size_t operator()(const PointerReference& x) const {
+      return hash(static_cast<uint32_t>(x.kind), x.pointee_type_id.ix_).value;
+    }
+    size_t operator()(const Qualified& x) const {
+      return hash(static_cast<uint32_t>(x.qualifier), x.qualified_type_id.ix_)
+          .value;
+    }
+    size_t operator()(const Array& x) const {
+      return hash(x.number_of_elements, x.element_type_id.ix_).value;
+    }
+    size_t operator()(const Function& x) const {
+      auto h = hash(x.return_type_id.ix_);
+      for (const auto& parameter : x.parameters) {
+        h = hash(h, parameter.ix_);
+      }
+      return h.value;
+    }
+
+    Hash hash;
+  };
+
+  struct EqualNode {
+    bool operator()(const Special& x, const Special& y) const {
+      return x.kind == y.kind;
+    }
+    bool operator()(const Primitive& x, const Primitive& y) const {
+      return x.name == y.name && x.encoding == y.encoding
+          && x.bytesize == y.bytesize;
+    }
+    bool operator()(const PointerReference& x,
+                    const PointerReference& y) const {
+      return x.kind == y.kind && x.pointee_type_id == y.pointee_type_id;
+    }
+    bool operator()(const Qualified& x, const Qualified& y) const {
+      return x.qualifier == y.qualifier
+          && x.qualified_type_id == y.qualified_type_id;
+    }
+    bool operator()(const Array& x, const Array& y) const {
+      return x.number_of_elements == y.number_of_elements
+          && x.element_type_id == y.element_type_id;
+    }
+    bool operator()(const Function& x, const Function& y) const {
+      return x.return_type_id == y.return_type_id
+          && std::equal(x.parameters.begin(), x.parameters.end(),
+                        y.parameters.begin(), y.parameters.end());
+    }
+  };
+
+  template <typename Node>
+  using Index = std::unordered_map<Node, Id, HashNode, EqualNode>;
+
+  Graph& graph_;
+  std::tuple<Index<Special>, Index<Primitive>, Index<PointerReference>,
+             Index<Qualified>, Index<Array>, Index<Function>> indexes_;
+  size_t hits_ = 0;
+};
+
+}  // namespace stg
+
+#endif  // STG_HASH_CONSING_H_
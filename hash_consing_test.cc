@@ -0,0 +1,77 @@
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+// -*- mode: C++ -*-
+//
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License v2.0 with LLVM Exceptions (the
+// "License"); you may not use this file except in compliance with the
+// License.  You may obtain a copy of the License at
+//
+//     https://llvm.org/LICENSE.txt
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "hash_consing.h"
+
+#include <optional>
+
+#include <catch2/catch.hpp>
+#include "graph.h"
+
+namespace Test {
+
+TEST_CASE("hash consing") {
+  using stg::Primitive;
+  stg::Graph graph;
+  stg::HashConsing consing(graph);
+
+  const auto int_type = consing.Add<Primitive>(
+      "int", Primitive::Encoding::SIGNED_INTEGER, 4);
+  const auto unsigned_type = consing.Add<Primitive>(
+      "unsigned int", Primitive::Encoding::UNSIGNED_INTEGER, 4);
+  const auto untyped = consing.Add<Primitive>("int", std::nullopt, 4);
+  CHECK(unsigned_type != int_type);
+  CHECK(untyped != int_type);
+  CHECK(consing.Add<Primitive>(
+            "int", Primitive::Encoding::SIGNED_INTEGER, 4) == int_type);
+  CHECK(consing.Hits() == 1);
+
+  const auto pointer = consing.Add<stg::PointerReference>(
+      stg::PointerReference::Kind::POINTER, int_type);
+  CHECK(consing.Add<stg::PointerReference>(
+            stg::PointerReference::Kind::LVALUE_REFERENCE, int_type)
+        != pointer);
+  CHECK(consing.Add<stg::PointerReference>(
+            stg::PointerReference::Kind::POINTER, int_type) == pointer);
+  CHECK(consing.Add<stg::Qualified>(stg::Qualifier::CONST, pointer)
+        == consing.Add<stg::Qualified>(stg::Qualifier::CONST, pointer));
+  CHECK(consing.Add<stg::Array>(4, int_type)
+        != consing.Add<stg::Array>(8, int_type));
+
+  const auto function = consing.Add<stg::Function>(
+      int_type, stg::Ids{int_type, pointer});
+  CHECK(consing.Add<stg::Function>(int_type, stg::Ids{int_type, pointer})
+        == function);
+  CHECK(consing.Add<stg::Function>(int_type, stg::Ids{pointer, int_type})
+        != function);
+  CHECK(consing.Add<stg::Function>(int_type, stg::Ids{int_type}) != function);
+  CHECK(consing.Hits() == 4);
+
+  // nodes set under ids allocated in advance are shared by later additions
+  const auto set = graph.Allocate();
+  consing.Set<stg::Special>(set, stg::Special::Kind::VOID);
+  CHECK(graph.Is(set));
+  CHECK(consing.Add<stg::Special>(stg::Special::Kind::VOID) == set);
+  // but identical nodes set later keep their own ids
+  const auto other = graph.Allocate();
+  consing.Set<stg::Special>(other, stg::Special::Kind::VOID);
+  CHECK(graph.Is(other));
+  CHECK(consing.Add<stg::Special>(stg::Special::Kind::VOID) == set);
+  CHECK(consing.Hits() == 6);
+}
+
+}  // namespace Test
@@ -21,11 +21,14 @@
 #ifndef STG_HASHING_H_
 #define STG_HASHING_H_
 
+#include <bit>
 #include <cstddef>
 #include <cstdint>
+#include <cstring>
 #include <functional>
 #include <string>
 #include <string_view>
+#include <type_traits>
 
 namespace stg {
 
@@ -129,6 +132,169 @@ struct Hash {
   }
 };
 
+// A 64-bit hash value. Fingerprints of large graphs use this as 32-bit hashes
+// would have many collisions.
+struct HashValue64 {
+  constexpr explicit HashValue64(uint64_t value) : value(value) {}
+  bool operator==(const HashValue64&) const = default;
+
+  uint64_t value;
+};
+
+}  // namespace stg
+
+namespace std {
+
+template <>
+struct hash<stg::HashValue64> {
+  size_t operator()(const stg::HashValue64& hv) const {
+    // do not overhash
+    return hv.value;
+  }
+};
+
+}  // namespace std
+
+namespace stg {
+
+// As Hash, but producing 64-bit values. Strings are hashed a word at a time.
+struct Hash64 {
+  constexpr HashValue64 operator()(HashValue64 hash_value) const {
+    return hash_value;
+  }
+
+  // Hash boolean by converting to int.
+  constexpr HashValue64 operator()(bool x) const {
+    return x ? (*this)(uint64_t{1}) : (*this)(uint64_t{0});
+  }
+
+  // See https://mostlymangling.blogspot.com (moremur).
+  constexpr HashValue64 operator()(uint64_t x) const {
+    x ^= x >> 27;
+    x *= 0x3c79ac492ba7b653;
+    x ^= x >> 33;
+    x *= 0x1c69b3f74ac4ae35;
+    x ^= x >> 27;
+    return HashValue64(x);
+  }
+
+  // Hash signed 64 bits by casting to unsigned 64 bits.
+  constexpr HashValue64 operator()(int64_t x) const {
+    return (*this)(static_cast<uint64_t>(x));
+  }
+
+  // Hash unsigned 32 bits by zero extending to 64 bits.
+  constexpr HashValue64 operator()(uint32_t x) const {
+    return (*this)(static_cast<uint64_t>(x));
+  }
+
+  // Hash signed 32 bits by casting to unsigned 32 bits.
+  constexpr HashValue64 operator()(int32_t x) const {
+    return (*this)(static_cast<uint32_t>(x));
+  }
+
+  // Hash 8 bits by zero extending to 32 bits.
+  constexpr HashValue64 operator()(char x) const {
+    return (*this)(static_cast<uint32_t>(static_cast<unsigned char>(x)));
+  }
+
+  // Multiply-fold over little-endian words, in the style of wyhash. Strings of
+  // up to 16 bytes, which covers most identifiers, are read with two
+  // overlapping loads and a single fold. Longer strings are consumed 16 bytes
+  // per round, with a final overlapping load of the last 16 bytes. The length
+  // is mixed in so that trailing zero bytes are significant.
+  constexpr HashValue64 operator()(const std::string_view x) const {
+    constexpr uint64_t kSeed = 0xa0761d6478bd642f;
+    constexpr uint64_t kPrime1 = 0xe7037ed1a0b428db;
+    constexpr uint64_t kPrime2 = 0x8ebc6af09c88c6e3;
+    const size_t size = x.size();
+    uint64_t h = kSeed ^ size;
+    uint64_t a = 0;
+    uint64_t b = 0;
+    if (size <= 16) {
+      if (size >= 8) {
+        a = Load8(x, 0);
+        b = Load8(x, size - 8);
+      } else if (size >= 4) {
+        a = Load4(x, 0);
+        b = Load4(x, size - 4);
+      } else if (size > 0) {
+        a = (static_cast<uint64_t>(Byte(x, 0)) << 16)
+            | (static_cast<uint64_t>(Byte(x, size / 2)) << 8)
+            | Byte(x, size - 1);
+      }
+    } else {
+      size_t ix = 0;
+      for (; ix + 16 < size; ix += 16) {
+        h = Fold(Load8(x, ix) ^ kPrime1, Load8(x, ix + 8) ^ h);
+      }
+      a = Load8(x, size - 16);
+      b = Load8(x, size - 8);
+    }
+    h = Fold(a ^ kPrime1, b ^ h);
+    return HashValue64(Fold(h ^ kPrime2, kPrime1 ^ size));
+  }
+
+  // Hash std::string by constructing a std::string_view.
+  HashValue64 operator()(const std::string& x) const {
+    return (*this)(std::string_view(x));
+  }
+
+  // Hash C string by constructing a std::string_view.
+  constexpr HashValue64 operator()(const char* x) const {
+    return (*this)(std::string_view(x));
+  }
+
+  // Reverse order Boost hash_combine, 64-bit variant (must be used with good
+  // hashes).
+  template <typename Arg, typename... Args>
+  constexpr HashValue64 operator()(Arg arg, Args... args) const {
+    const uint64_t seed = (*this)(args...).value;
+    const uint64_t hash = (*this)(arg).value;
+    return HashValue64(
+        seed ^ (hash + 0x9e3779b97f4a7c15 + (seed << 12) + (seed >> 4)));
+  }
+
+ private:
+  static constexpr uint8_t Byte(std::string_view x, size_t ix) {
+    return static_cast<unsigned char>(x[ix]);
+  }
+
+  // Little-endian load of size bytes. Outside constant evaluation this is a
+  // single unaligned load.
+  template <size_t size>
+  static constexpr uint64_t Load(std::string_view x, size_t ix) {
+    if (!std::is_constant_evaluated()) {
+      std::conditional_t<size == 8, uint64_t, uint32_t> word;
+      std::memcpy(&word, x.data() + ix, size);
+      if constexpr (std::endian::native == std::endian::big) {
+        word = size == 8 ? __builtin_bswap64(word) : __builtin_bswap32(word);
+      }
+      return word;
+    }
+    uint64_t word = 0;
+    for (size_t i = 0; i < size; ++i) {
+      word |= static_cast<uint64_t>(Byte(x, ix + i)) << (8 * i);
+    }
+    return word;
+  }
+
+  static constexpr uint64_t Load8(std::string_view x, size_t ix) {
+    return Load<8>(x, ix);
+  }
+
+  static constexpr uint64_t Load4(std::string_view x, size_t ix) {
+    return Load<4>(x, ix);
+  }
+
+  // Full 128-bit product, high and low halves combined.
+  static constexpr uint64_t Fold(uint64_t a, uint64_t b) {
+    const unsigned __int128 product = static_cast<unsigned __int128>(a) * b;
+    return static_cast<uint64_t>(product) ^
+           static_cast<uint64_t>(product >> 64);
+  }
+};
+
 }  // namespace stg
 
 #endif  // STG_HASHING_H_
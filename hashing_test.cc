@@ -0,0 +1,63 @@
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+// -*- mode: C++ -*-
+//
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License v2.0 with LLVM Exceptions (the
+// "License"); you may not use this file except in compliance with the
+// License.  You may obtain a copy of the License at
+//
+//     https://llvm.org/LICENSE.txt
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "hashing.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+
+#include <catch2/catch.hpp>
+
+namespace Test {
+
+TEST_CASE("string hash64 is a compile-time constant") {
+  constexpr auto hash = stg::Hash64()("struct foo");
+  STATIC_REQUIRE(hash.value != 0);
+  CHECK(stg::Hash64()(std::string("struct foo")) == hash);
+}
+
+TEST_CASE("string hash64 distinguishes lengths and trailing zeros") {
+  using namespace std::literals;
+  std::unordered_set<uint64_t> seen;
+  std::string text;
+  for (size_t size = 0; size <= 40; ++size) {
+    CHECK(seen.insert(stg::Hash64()(text).value).second);
+    text.push_back('\0');
+  }
+  CHECK(stg::Hash64()("a"sv) != stg::Hash64()("a\0"sv));
+  CHECK(stg::Hash64()("abcdefgh"sv) != stg::Hash64()("abcdefgh\0"sv));
+}
+
+TEST_CASE("string hash64 has no collisions on similar names") {
+  std::unordered_set<uint64_t> seen;
+  for (size_t i = 0; i < 100000; ++i) {
+    const auto name = "symbol_" + std::to_string(i);
+    CHECK(seen.insert(stg::Hash64()(name).value).second);
+  }
+}
+
+TEST_CASE("hash64 combination is order sensitive") {
+  const stg::Hash64 hash;
+  CHECK(hash('a', 'b') != hash('b', 'a'));
+  CHECK(hash(uint64_t{1}, uint64_t{2}) != hash(uint64_t{2}, uint64_t{1}));
+  CHECK(hash(hash('a'), 'b') == hash(stg::HashValue64(hash('a')), 'b'));
+}
+
+}  // namespace Test
@@ -19,40 +19,307 @@
 
 #include "input.h"
 
+#include <ar.h>
+#include <fcntl.h>
+#include <sys/resource.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <filesystem>
+#include <iterator>
 #include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <utility>
+#include <vector>
 
 #include "abigail_reader.h"
 #include "btf_reader.h"
+#include "elf_loader.h"
 #include "elf_reader.h"
+#include "error.h"
+#include "file_descriptor.h"
 #include "filter.h"
 #include "graph.h"
 #include "metrics.h"
+#include "parallel.h"
 #include "proto_reader.h"
 #include "reader_options.h"
+#include "stable_hash.h"
+#include "substitution.h"
+#include "type_store.h"
 
 namespace stg {
 
+namespace {
+
+struct MoveNode {
+  template <typename Node>
+  void operator()(Node& node) {
+    graph.Set<Node>(id, std::move(node));
+  }
+
+  Graph& graph;
+  Id id;
+};
+
+bool IsDirectory(const char* path) {
+  std::error_code error;
+  return std::filesystem::is_directory(path, error);
+}
+
+// Maps the file if it is an ar archive.
+std::optional<MemoryMap> MapArchive(const char* path) {
+  const FileDescriptor fd(path, O_RDONLY);
+  auto map = MemoryMap::TryMap(fd);
+  if (!map || !map->Contents().starts_with(std::string_view(ARMAG, SARMAG))) {
+    return {};
+  }
+  return map;
+}
+
+// Returns the kernel modules below a directory, in path order.
+std::vector<std::string> FindModules(const char* directory) {
+  std::vector<std::string> modules;
+  std::error_code error;
+  for (std::filesystem::recursive_directory_iterator it(directory, error), end;
+       !error && it != end; it.increment(error)) {
+    if (it->is_regular_file() && it->path().extension() == ".ko") {
+      modules.push_back(it->path().string());
+    }
+  }
+  Check(!error) << "failed to search directory " << directory << ": "
+                << error.message();
+  std::sort(modules.begin(), modules.end());
+  return modules;
+}
+
+// An object to read: a whole input or an ELF member of an ar archive.
+struct Object {
+  InputFormat format;
+  std::string path;
+  std::optional<std::string_view> member;
+};
+
+// The objects that several inputs stand for, see IsMultiObject.
+class Objects {
+ public:
+  explicit Objects(
+      const std::vector<std::pair<InputFormat, const char*>>& inputs) {
+    for (const auto& [format, input] : inputs) {
+      if (format != InputFormat::ELF) {
+        objects_.push_back({format, input, {}});
+      } else if (IsDirectory(input)) {
+        for (auto& module : FindModules(input)) {
+          objects_.push_back({format, std::move(module), {}});
+        }
+      } else if (auto map = MapArchive(input)) {
+        const auto members = elf::GetArchiveMembers(map->Contents());
+        Check(members.has_value()) << "failed to read ar archive " << input;
+        for (const auto& [name, image] : *members) {
+          objects_.push_back({format, std::string(input) + '(' + name + ')',
+                              {image}});
+        }
+        // the member contents point into the mapping
+        archives_.push_back(std::move(*map));
+      } else {
+        objects_.push_back({format, input, {}});
+      }
+    }
+  }
+
+  size_t Size() const {
+    return objects_.size();
+  }
+  // Starts reading an upcoming object, if there is one, in the background.
+  void Prefetch(size_t index) const {
+    if (index >= objects_.size()) {
+      return;
+    }
+    const auto& object = objects_[index];
+    if (object.member) {
+      PrefetchMemory(*object.member);
+    } else if (object.format != InputFormat::STORED) {
+      PrefetchFile(object.path.c_str());
+    }
+  }
+  const Object& operator[](size_t index) const {
+    return objects_[index];
+  }
+
+ private:
+  std::vector<MemoryMap> archives_;
+  std::vector<Object> objects_;
+};
+
+// Counts the major page faults of the current thread within a scope, that is
+// the times it stalled waiting for mapped input to be read from storage.
+class MajorFaults {
+ public:
+  explicit MajorFaults(Metrics& metrics)
+      : counter_(metrics, "read major faults"), start_(Get()) {}
+  ~MajorFaults() {
+    counter_ = Get() - start_;
+  }
+
+ private:
+  static size_t Get() {
+    struct rusage usage;
+    return getrusage(RUSAGE_THREAD, &usage) == 0 ? usage.ru_majflt : 0;
+  }
+
+  Counter counter_;
+  size_t start_;
+};
+
+Id Read(Graph& graph, const Object& object, ReadOptions options,
+        const std::unique_ptr<Filter>& file_filter, Metrics& metrics) {
+  if (!object.member) {
+    return Read(graph, object.format, object.path.c_str(), options,
+                file_filter, metrics);
+  }
+  Memory memory(metrics, "read ELF memory");
+  Time read(metrics, "read ELF");
+  const MajorFaults faults(metrics);
+  // the reader needs writable contents
+  std::vector<char> contents(object.member->begin(), object.member->end());
+  return elf::Read(graph, contents.data(), contents.size(), options,
+                   file_filter, metrics);
+}
+
+std::vector<SeparateInput> ReadObjects(
+    const Objects& objects, ReadOptions options,
+    const std::unique_ptr<Filter>& file_filter) {
+  const size_t count = objects.Size();
+  // Verbose output is not interleaved.
+  const size_t workers = options.Test(ReadOptions::INFO)
+                         ? 1
+                         : std::max<size_t>(1, std::min(options.jobs, count));
+  ReadOptions input_options = options;
+  input_options.jobs = std::max<size_t>(1, options.jobs / workers);
+  std::vector<SeparateInput> parts(count);
+  ForEachIndex(workers, count, [&](size_t, size_t index) {
+    // indexes are handed out in order, so this is likely the next one taken
+    objects.Prefetch(index + workers);
+    auto& part = parts[index];
+    part.root = Read(part.graph, objects[index], input_options, file_filter,
+                     part.metrics);
+  });
+  return parts;
+}
+
+}  // namespace
+
 Id Read(Graph& graph, InputFormat format, const char* input,
         ReadOptions options, const std::unique_ptr<Filter>& file_filter,
-        Metrics& metrics) {
+        Metrics& metrics, StableHashCache* stable_hashes, bool* canonical) {
+  // The whole input is wanted, including the DWARF sections of ELF, which are
+  // otherwise read piecemeal as they are reached.
+  if (format != InputFormat::STORED) {
+    PrefetchFile(input);
+  }
   switch (format) {
     case InputFormat::ABI: {
+      Memory memory(metrics, "read ABI memory");
       Time read(metrics, "read ABI");
-      return abixml::Read(graph, input, metrics);
+      const MajorFaults faults(metrics);
+      return abixml::Read(graph, input, metrics, options.jobs,
+                          options.Test(ReadOptions::HASH_CONS),
+                          options.symbol_filter);
     }
     case InputFormat::BTF: {
+      Memory memory(metrics, "read BTF memory");
       Time read(metrics, "read BTF");
-      return btf::ReadFile(graph, input, options);
+      const MajorFaults faults(metrics);
+      return btf::ReadFile(graph, input, options, &metrics);
     }
     case InputFormat::ELF: {
+      Memory memory(metrics, "read ELF memory");
       Time read(metrics, "read ELF");
+      const MajorFaults faults(metrics);
       return elf::Read(graph, input, options, file_filter, metrics);
     }
     case InputFormat::STG: {
+      Memory memory(metrics, "read STG memory");
       Time read(metrics, "read STG");
-      return proto::Read(graph, input);
+      const MajorFaults faults(metrics);
+      return proto::Read(graph, input, stable_hashes, proto::IdMapping::SORTED,
+                         options.jobs, canonical, options.symbol_filter,
+                         &metrics);
+    }
+    case InputFormat::STORED: {
+      Memory memory(metrics, "read stored memory");
+      Time read(metrics, "read stored");
+      const MajorFaults faults(metrics);
+      if (canonical != nullptr) {
+        *canonical = true;
+      }
+      return ReadStored(graph, input, metrics);
     }
   }
 }
 
+bool IsMultiObject(InputFormat format, const char* input) {
+  return format == InputFormat::ELF
+      && (IsDirectory(input) || MapArchive(input));
+}
+
+std::vector<Id> Read(
+    Graph& graph,
+    const std::vector<std::pair<InputFormat, const char*>>& inputs,
+    ReadOptions options, const std::unique_ptr<Filter>& file_filter,
+    Metrics& metrics) {
+  const Objects objects(inputs);
+  const size_t count = objects.Size();
+  std::vector<Id> roots;
+  roots.reserve(count);
+  // Verbose output is not interleaved.
+  if (options.jobs == 1 || count < 2 || options.Test(ReadOptions::INFO)) {
+    for (size_t index = 0; index < count; ++index) {
+      objects.Prefetch(index + 1);
+      roots.push_back(
+          Read(graph, objects[index], options, file_filter, metrics));
+    }
+    return roots;
+  }
+
+  auto parts = ReadObjects(objects, options, file_filter);
+  for (auto& part : parts) {
+    std::move(part.metrics.begin(), part.metrics.end(),
+              std::back_inserter(metrics));
+  }
+  Time move(metrics, "move inputs");
+  for (auto& part : parts) {
+    roots.push_back(Move(part.graph, *part.root, graph));
+    // release memory early
+    part.graph = Graph();
+  }
+  return roots;
+}
+
+std::vector<SeparateInput> ReadSeparately(
+    const std::vector<std::pair<InputFormat, const char*>>& inputs,
+    ReadOptions options, const std::unique_ptr<Filter>& file_filter) {
+  return ReadObjects(Objects(inputs), options, file_filter);
+}
+
+Id Move(Graph& from, Id root, Graph& to) {
+  std::vector<Id> mapping(from.Limit().ix_, Id::kInvalid);
+  from.ForEach(Id(0), from.Limit(), [&](Id id) {
+    mapping[id.ix_] = to.Allocate();
+  });
+  const auto remap = [&](Id& id) {
+    id = mapping[id.ix_];
+  };
+  Substitute substitute(from, remap);
+  from.ForEach(Id(0), from.Limit(), [&](Id id) {
+    substitute(id);
+    MoveNode move{to, mapping[id.ix_]};
+    from.Apply<void>(move, id);
+  });
+  return mapping[root.ix_];
+}
+
 }  // namespace stg
@@ -21,19 +21,61 @@
 #define STG_INPUT_H_
 
 #include <memory>
+#include <optional>
+#include <utility>
+#include <vector>
 
 #include "filter.h"
 #include "graph.h"
 #include "metrics.h"
 #include "reader_options.h"
+#include "stable_hash.h"
 
 namespace stg {
 
-enum class InputFormat { ABI, BTF, ELF, STG };
+// STORED input is a snapshot in a type store, given by the path of its
+// manifest, see TypeStore.
+enum class InputFormat { ABI, BTF, ELF, STG, STORED };
 
+// Only STG input can supply stable hashes or claim to be canonical, see
+// proto::Read.
 Id Read(Graph& graph, InputFormat format, const char* input,
         ReadOptions options, const std::unique_ptr<Filter>& file_filter,
-        Metrics& metrics);
+        Metrics& metrics, StableHashCache* stable_hashes = nullptr,
+        bool* canonical = nullptr);
+
+// Returns whether an input stands for several objects. These are ELF inputs
+// that are ar archives, standing for their ELF members, or directories,
+// standing for the kernel modules (.ko files) below them. When reading several
+// inputs, each such object is read as an input of its own, in archive or path
+// order.
+bool IsMultiObject(InputFormat format, const char* input);
+
+// Reads several inputs, returning their roots in input order. With more than
+// one job, inputs are read concurrently, each into its own graph, with the jobs
+// shared between them. The graphs are then moved into the given one.
+std::vector<Id> Read(
+    Graph& graph,
+    const std::vector<std::pair<InputFormat, const char*>>& inputs,
+    ReadOptions options, const std::unique_ptr<Filter>& file_filter,
+    Metrics& metrics);
+
+// An input read into a graph of its own, with the metrics recorded meanwhile.
+struct SeparateInput {
+  Graph graph;
+  Metrics metrics;
+  std::optional<Id> root;
+};
+
+// Reads several inputs, each into its own graph, returning them in input
+// order. With more than one job, inputs are read concurrently, with the jobs
+// shared between them.
+std::vector<SeparateInput> ReadSeparately(
+    const std::vector<std::pair<InputFormat, const char*>>& inputs,
+    ReadOptions options, const std::unique_ptr<Filter>& file_filter);
+
+// Moves all the nodes of one graph into another, returning the new root.
+Id Move(Graph& from, Id root, Graph& to);
 
 }  // namespace stg
 
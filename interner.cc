@@ -0,0 +1,55 @@
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+// -*- mode: C++ -*-
+//
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License v2.0 with LLVM Exceptions (the
+// "License"); you may not use this file except in compliance with the
+// License.  You may obtain a copy of the License at
+//
+//     https://llvm.org/LICENSE.txt
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "interner.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <string_view>
+
+namespace stg {
+
+std::string_view Interner::Intern(std::string_view string) {
+  const auto it = index_.find(string);
+  if (it != index_.end()) {
+    return *it;
+  }
+  char* data = Store(string.size());
+  std::copy(string.begin(), string.end(), data);
+  const std::string_view result(data, string.size());
+  index_.insert(result);
+  bytes_ += string.size();
+  return result;
+}
+
+char* Interner::Store(size_t size) {
+  if (size > available_) {
+    // large strings get a block of their own, keeping the current block
+    if (size > kBlockSize / 4) {
+      return blocks_.emplace_back(new char[size]).get();
+    }
+    next_ = blocks_.emplace_back(new char[kBlockSize]).get();
+    available_ = kBlockSize;
+  }
+  char* result = next_;
+  next_ += size;
+  available_ -= size;
+  return result;
+}
+
+}  // namespace stg
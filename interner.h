@@ -0,0 +1,69 @@
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+// -*- mode: C++ -*-
+//
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License v2.0 with LLVM Exceptions (the
+// "License"); you may not use this file except in compliance with the
+// License.  You may obtain a copy of the License at
+//
+//     https://llvm.org/LICENSE.txt
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef STG_INTERNER_H_
+#define STG_INTERNER_H_
+
+#include <cstddef>
+#include <memory>
+#include <string_view>
+#include <unordered_set>
+#include <vector>
+
+namespace stg {
+
+// Arena-backed string interner.
+//
+// Intern returns a view of a stored copy of its argument. Equal strings yield
+// views with the same data pointer, so interned strings can be compared by
+// pointer. Views remain valid for the lifetime of the Interner, including
+// across moves.
+class Interner {
+ public:
+  Interner() = default;
+  Interner(const Interner&) = delete;
+  Interner& operator=(const Interner&) = delete;
+  Interner(Interner&&) = default;
+  Interner& operator=(Interner&&) = default;
+
+  std::string_view Intern(std::string_view string);
+
+  // number of distinct strings
+  size_t Size() const {
+    return index_.size();
+  }
+
+  // number of bytes of string data stored
+  size_t Bytes() const {
+    return bytes_;
+  }
+
+ private:
+  static constexpr size_t kBlockSize = 64 * 1024;
+
+  char* Store(size_t size);
+
+  std::vector<std::unique_ptr<char[]>> blocks_;
+  char* next_ = nullptr;
+  size_t available_ = 0;
+  size_t bytes_ = 0;
+  std::unordered_set<std::string_view> index_;
+};
+
+}  // namespace stg
+
+#endif  // STG_INTERNER_H_
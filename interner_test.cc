@@ -0,0 +1,76 @@
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+// -*- mode: C++ -*-
+//
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License v2.0 with LLVM Exceptions (the
+// "License"); you may not use this file except in compliance with the
+// License.  You may obtain a copy of the License at
+//
+//     https://llvm.org/LICENSE.txt
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "interner.h"
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include <catch2/catch.hpp>
+
+namespace Test {
+
+TEST_CASE("intern returns equal views") {
+  stg::Interner interner;
+  const std::string a = "unsigned int";
+  const std::string b = "unsigned int";
+  const auto x = interner.Intern(a);
+  const auto y = interner.Intern(b);
+  CHECK(x == a);
+  CHECK(x.data() == y.data());
+  CHECK(x.data() != a.data());
+  CHECK(interner.Size() == 1);
+  CHECK(interner.Bytes() == a.size());
+}
+
+TEST_CASE("intern distinguishes strings") {
+  stg::Interner interner;
+  const auto empty = interner.Intern("");
+  const auto flags = interner.Intern("flags");
+  const auto flag = interner.Intern("flag");
+  CHECK(empty.empty());
+  CHECK(flags == "flags");
+  CHECK(flag == "flag");
+  CHECK(flags.data() != flag.data());
+  CHECK(interner.Size() == 3);
+  CHECK(interner.Bytes() == 9);
+}
+
+TEST_CASE("interned views are stable") {
+  stg::Interner interner;
+  std::vector<std::pair<std::string, std::string_view>> interned;
+  // enough data to span several blocks, including some large strings
+  for (size_t i = 0; i < 10000; ++i) {
+    std::string string = "name" + std::to_string(i);
+    if (i % 1000 == 0) {
+      string.append(100000, 'x');
+    }
+    const auto view = interner.Intern(string);
+    interned.emplace_back(std::move(string), view);
+  }
+  stg::Interner moved = std::move(interner);
+  for (const auto& [string, view] : interned) {
+    CHECK(view == string);
+    CHECK(moved.Intern(string).data() == view.data());
+  }
+  CHECK(moved.Size() == interned.size());
+}
+
+}  // namespace Test
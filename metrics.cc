@@ -19,17 +19,117 @@
 
 #include "metrics.h"
 
+#include <linux/perf_event.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
 #include <cstddef>
+#include <cstdint>
 #include <iomanip>
+#include <ios>
+#include <iterator>
 #include <map>
+#include <optional>
 #include <ostream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
 #include <utility>
 #include <variant>
+#include <vector>
+
+#include "error.h"
+
+// Provided by jemalloc, if it is linked in.
+extern "C" int mallctl(const char* name, void* oldp, size_t* oldlenp,
+                       void* newp, size_t newlen) __attribute__((weak));
 
 namespace stg {
 
 namespace {
 
+std::optional<size_t> AllocatorStatistic(const char* name) {
+  size_t value;
+  size_t length = sizeof(value);
+  if (mallctl(name, &value, &length, nullptr, 0) != 0) {
+    return {};
+  }
+  return {value};
+}
+
+std::optional<ptrdiff_t> Difference(std::optional<size_t> start,
+                                    std::optional<size_t> finish) {
+  if (!start || !finish) {
+    return {};
+  }
+  return {static_cast<ptrdiff_t>(*finish - *start)};
+}
+
+struct HardwareEvent {
+  uint32_t type;
+  uint64_t config;
+};
+
+// In the order of HardwareCounts::kNames.
+constexpr std::array<HardwareEvent, HardwareCounts::kNames.size()>
+    kHardwareEvents = {{
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+        {PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_LL
+                                 | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+                                 | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)},
+        {PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_DTLB
+                                 | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+                                 | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)},
+    }};
+
+std::atomic<bool> hardware_counters_enabled = false;
+// events that could not be opened, which are not tried again
+std::array<std::atomic<bool>, kHardwareEvents.size()> hardware_unavailable;
+
+// Adds the counts of other to those of total, keeping counts absent from
+// either.
+void Add(std::optional<HardwareCounts>& total,
+         const std::optional<HardwareCounts>& other) {
+  if (!other) {
+    return;
+  }
+  if (!total) {
+    total = other;
+    return;
+  }
+  for (size_t ix = 0; ix < kHardwareEvents.size(); ++ix) {
+    auto& count = total->counts[ix];
+    const auto& more = other->counts[ix];
+    if (count && more) {
+      *count += *more;
+    } else if (more) {
+      count = more;
+    }
+  }
+}
+
+std::ostream& operator<<(std::ostream& os, const HardwareCounts& value) {
+  bool separate = false;
+  for (size_t ix = 0; ix < kHardwareEvents.size(); ++ix) {
+    if (const auto& count = value.counts[ix]) {
+      os << (separate ? ", " : " (") << HardwareCounts::kNames[ix] << ' '
+         << *count;
+      separate = true;
+    }
+  }
+  if (separate) {
+    os << ')';
+  }
+  return os;
+}
+
 std::ostream& operator<<(std::ostream& os, std::monostate) {
   return os << "<incomplete>";
 }
@@ -56,28 +156,433 @@ std::ostream& operator<<(std::ostream& os, const Nanoseconds& value) {
             << std::setfill(' ') << " ms";
 }
 
+std::ostream& operator<<(std::ostream& os, const Durations& value) {
+  return os << value.total << " total, " << value.max << " max, "
+            << value.count << " times";
+}
+
+std::ostream& operator<<(std::ostream& os, const WorkerUsage& value) {
+  os << value.busy << " busy over " << value.elapsed << " with "
+     << value.workers << " workers";
+  const uint64_t capacity = value.elapsed.ns * value.workers;
+  if (capacity != 0) {
+    os << " (" << value.busy.ns * 100 / capacity << "%)";
+  }
+  return os;
+}
+
+std::ostream& operator<<(std::ostream& os, const SlowItems& value) {
+  const auto items = value.Sorted();
+  if (items.empty()) {
+    return os << "none";
+  }
+  bool separate = false;
+  for (const auto& [time, description] : items) {
+    if (separate) {
+      os << "; ";
+    } else {
+      separate = true;
+    }
+    os << time << ' ' << description;
+  }
+  return os;
+}
+
+std::ostream& operator<<(std::ostream& os, const MemoryUsage& value) {
+  os << "peak RSS +" << value.peak_rss_increase << " B";
+  if (value.allocated) {
+    os << ", allocated " << std::showpos << *value.allocated << std::noshowpos
+       << " B";
+  }
+  if (value.active) {
+    os << ", active " << std::showpos << *value.active << std::noshowpos
+       << " B";
+  }
+  return os;
+}
+
+struct JsonString {
+  std::string_view string;
+};
+
+std::ostream& operator<<(std::ostream& os, JsonString value) {
+  os << '"';
+  for (const char c : value.string) {
+    if (c == '"' || c == '\\') {
+      os << '\\' << c;
+    } else if (static_cast<unsigned char>(c) < 0x20) {
+      os << "\\u" << std::hex << std::setfill('0') << std::setw(4)
+         << static_cast<int>(c) << std::setfill(' ') << std::dec;
+    } else {
+      os << c;
+    }
+  }
+  return os << '"';
+}
+
+struct JsonValue {
+  void operator()(std::monostate) const {
+    os << R"("type":"incomplete")";
+  }
+
+  void operator()(const Nanoseconds& value) const {
+    os << R"("type":"time","ns":)" << value.ns;
+  }
+
+  void operator()(size_t value) const {
+    os << R"("type":"counter","value":)" << value;
+  }
+
+  void operator()(const std::map<size_t, size_t>& frequencies) const {
+    os << R"("type":"histogram","frequencies":[)";
+    bool separate = false;
+    for (const auto& [item, frequency] : frequencies) {
+      if (separate) {
+        os << ',';
+      } else {
+        separate = true;
+      }
+      os << '[' << item << ',' << frequency << ']';
+    }
+    os << ']';
+  }
+
+  void operator()(const Durations& value) const {
+    os << R"("type":"durations","total_ns":)" << value.total.ns
+       << R"(,"max_ns":)" << value.max.ns << R"(,"count":)" << value.count;
+  }
+
+  void operator()(const WorkerUsage& value) const {
+    os << R"("type":"workers","elapsed_ns":)" << value.elapsed.ns
+       << R"(,"busy_ns":)" << value.busy.ns << R"(,"workers":)"
+       << value.workers;
+  }
+
+  void operator()(const SlowItems& value) const {
+    os << R"("type":"slowest","items":[)";
+    bool separate = false;
+    for (const auto& [time, description] : value.Sorted()) {
+      if (separate) {
+        os << ',';
+      } else {
+        separate = true;
+      }
+      os << R"({"ns":)" << time.ns << R"(,"name":)" << JsonString{description}
+         << '}';
+    }
+    os << ']';
+  }
+
+  void operator()(const MemoryUsage& value) const {
+    os << R"("type":"memory","peak_rss_increase":)"
+       << value.peak_rss_increase;
+    if (value.allocated) {
+      os << R"(,"allocated":)" << *value.allocated;
+    }
+    if (value.active) {
+      os << R"(,"active":)" << *value.active;
+    }
+  }
+
+  std::ostream& os;
+};
+
+// Writes the metrics in [begin, end) as a JSON array, with the metrics recorded
+// within a scope nested inside it.
+void ReportJson(const Metrics& metrics, size_t begin, size_t end,
+                std::ostream& os) {
+  os << '[';
+  for (size_t ix = begin; ix < end;) {
+    if (ix != begin) {
+      os << ',';
+    }
+    const auto& metric = metrics[ix];
+    const size_t nested_end = std::min(end, ix + 1 + metric.nested);
+    os << R"({"name":)" << JsonString{metric.name} << ',';
+    std::visit(JsonValue{os}, metric.value);
+    if (metric.hardware) {
+      os << R"(,"hardware":{)";
+      bool separate = false;
+      for (size_t ix = 0; ix < kHardwareEvents.size(); ++ix) {
+        if (const auto& count = metric.hardware->counts[ix]) {
+          if (separate) {
+            os << ',';
+          } else {
+            separate = true;
+          }
+          os << JsonString{HardwareCounts::kNames[ix]} << ':' << *count;
+        }
+      }
+      os << '}';
+    }
+    if (nested_end > ix + 1) {
+      os << R"(,"nested":)";
+      ReportJson(metrics, ix + 1, nested_end, os);
+    }
+    os << '}';
+    ix = nested_end;
+  }
+  os << ']';
+}
+
+uint64_t Nanos(const struct timeval& time) {
+  return time.tv_sec * 1'000'000'000ULL + time.tv_usec * 1'000ULL;
+}
+
+void ReportJson(const Metrics& metrics, std::ostream& os) {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  os << R"({"metrics":)";
+  ReportJson(metrics, 0, metrics.size(), os);
+  os << R"(,"process":{)"
+     << R"("user_cpu_ns":)" << Nanos(usage.ru_utime)
+     << R"(,"system_cpu_ns":)" << Nanos(usage.ru_stime)
+     << R"(,"peak_rss":)" << static_cast<size_t>(usage.ru_maxrss) * 1024
+     << R"(,"minor_faults":)" << usage.ru_minflt
+     << R"(,"major_faults":)" << usage.ru_majflt
+     << R"(,"voluntary_context_switches":)" << usage.ru_nvcsw
+     << R"(,"involuntary_context_switches":)" << usage.ru_nivcsw
+     << "}}\n";
+}
+
+std::optional<ptrdiff_t> Max(std::optional<ptrdiff_t> value1,
+                             std::optional<ptrdiff_t> value2) {
+  if (!value1) {
+    return value2;
+  }
+  if (!value2) {
+    return value1;
+  }
+  return {std::max(*value1, *value2)};
+}
+
+// Combines the value of a metric with that of a later one of the same name.
+struct Combine {
+  void operator()(std::monostate&, std::monostate) const {}
+
+  void operator()(Nanoseconds& value1, Nanoseconds value2) const {
+    Durations durations{value1, value1, 1};
+    (*this)(durations, value2);
+    metric.value = durations;
+  }
+
+  void operator()(Durations& value1, Nanoseconds value2) const {
+    (*this)(value1, Durations{value2, value2, 1});
+  }
+
+  void operator()(Durations& value1, const Durations& value2) const {
+    value1.total.ns += value2.total.ns;
+    value1.max.ns = std::max(value1.max.ns, value2.max.ns);
+    value1.count += value2.count;
+  }
+
+  void operator()(size_t& value1, size_t value2) const {
+    value1 += value2;
+  }
+
+  void operator()(WorkerUsage& value1, const WorkerUsage& value2) const {
+    value1.elapsed.ns += value2.elapsed.ns;
+    value1.busy.ns += value2.busy.ns;
+    value1.workers = std::max(value1.workers, value2.workers);
+  }
+
+  void operator()(std::map<size_t, size_t>& value1,
+                  const std::map<size_t, size_t>& value2) const {
+    for (const auto& [item, frequency] : value2) {
+      value1[item] += frequency;
+    }
+  }
+
+  void operator()(SlowItems& value1, const SlowItems& value2) const {
+    value1.Merge(value2);
+  }
+
+  void operator()(MemoryUsage& value1, const MemoryUsage& value2) const {
+    value1.peak_rss_increase =
+        std::max(value1.peak_rss_increase, value2.peak_rss_increase);
+    value1.allocated = Max(value1.allocated, value2.allocated);
+    value1.active = Max(value1.active, value2.active);
+  }
+
+  template <typename Value1, typename Value2>
+  void operator()(Value1&, const Value2&) const {
+    Die() << "inconsistent kinds of metric: " << metric.name;
+  }
+
+  Metric& metric;
+};
+
 }  // namespace
 
-void Report(const Metrics& metrics, std::ostream& os) {
-  for (const auto& metric : metrics) {
-    std::visit([&](auto&& value) {
-      os << metric.name << ": " << value << '\n';
-    }, metric.value);
+void SlowItems::Add(uint64_t ns, std::string description) {
+  if (!Wants(ns)) {
+    return;
+  }
+  const auto faster = [](const auto& item1, const auto& item2) {
+    return item1.first > item2.first;
+  };
+  items_.emplace_back(ns, std::move(description));
+  std::push_heap(items_.begin(), items_.end(), faster);
+  if (items_.size() > limit_) {
+    std::pop_heap(items_.begin(), items_.end(), faster);
+    items_.pop_back();
+  }
+}
+
+void SlowItems::Merge(const SlowItems& other) {
+  limit_ = std::max(limit_, other.limit_);
+  for (const auto& [ns, description] : other.items_) {
+    Add(ns, description);
+  }
+}
+
+std::vector<std::pair<Nanoseconds, std::string>> SlowItems::Sorted() const {
+  auto items = items_;
+  std::stable_sort(items.begin(), items.end(),
+                   [](const auto& item1, const auto& item2) {
+                     return item1.first > item2.first;
+                   });
+  std::vector<std::pair<Nanoseconds, std::string>> result;
+  result.reserve(items.size());
+  for (auto& [ns, description] : items) {
+    result.emplace_back(Nanoseconds(ns), std::move(description));
   }
+  return result;
 }
 
+void MergeShards(std::vector<Metrics>& shards, Metrics& metrics) {
+  Metrics merged;
+  std::unordered_map<std::string_view, size_t> index;
+  for (auto& shard : shards) {
+    for (auto& metric : shard) {
+      const auto [it, inserted] = index.emplace(metric.name, merged.size());
+      if (inserted) {
+        merged.push_back(
+            Metric{metric.name, std::move(metric.value), 0, metric.hardware});
+      } else {
+        auto& existing = merged[it->second];
+        std::visit(Combine{existing}, existing.value, metric.value);
+        Add(existing.hardware, metric.hardware);
+      }
+    }
+    shard.clear();
+  }
+  std::move(merged.begin(), merged.end(), std::back_inserter(metrics));
+}
+
+std::optional<MetricsFormat> ParseMetricsFormat(std::string_view format) {
+  if (format == "text") {
+    return {MetricsFormat::TEXT};
+  }
+  if (format == "json") {
+    return {MetricsFormat::JSON};
+  }
+  return {};
+}
+
+void Report(const Metrics& metrics, std::ostream& os, MetricsFormat format) {
+  switch (format) {
+    case MetricsFormat::TEXT:
+      for (const auto& metric : metrics) {
+        std::visit([&](auto&& value) {
+          os << metric.name << ": " << value;
+        }, metric.value);
+        if (metric.hardware) {
+          os << *metric.hardware;
+        }
+        os << '\n';
+      }
+      break;
+    case MetricsFormat::JSON:
+      ReportJson(metrics, os);
+      break;
+  }
+}
+
+void EnableHardwareCounters() {
+  hardware_counters_enabled = true;
+}
+
+// The hardware events of the calling thread, counted from construction.
+class HardwareCounters {
+ public:
+  HardwareCounters() {
+    for (size_t ix = 0; ix < kHardwareEvents.size(); ++ix) {
+      if (hardware_unavailable[ix]) {
+        continue;
+      }
+      struct perf_event_attr attr = {};
+      attr.size = sizeof(attr);
+      attr.type = kHardwareEvents[ix].type;
+      attr.config = kHardwareEvents[ix].config;
+      attr.exclude_kernel = 1;
+      attr.exclude_hv = 1;
+      attr.read_format =
+          PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+      fds_[ix] = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1,
+                                          -1, PERF_FLAG_FD_CLOEXEC));
+      if (fds_[ix] < 0) {
+        hardware_unavailable[ix] = true;
+      }
+    }
+  }
+  HardwareCounters(const HardwareCounters&) = delete;
+  HardwareCounters& operator=(const HardwareCounters&) = delete;
+  ~HardwareCounters() {
+    for (const int fd : fds_) {
+      if (fd >= 0) {
+        close(fd);
+      }
+    }
+  }
+
+  // Returns nothing if no event could be counted.
+  std::optional<HardwareCounts> Read() const {
+    HardwareCounts result;
+    bool any = false;
+    for (size_t ix = 0; ix < kHardwareEvents.size(); ++ix) {
+      // value, time enabled, time running
+      std::array<uint64_t, 3> values;
+      if (fds_[ix] < 0
+          || read(fds_[ix], values.data(), sizeof(values))
+              != static_cast<ssize_t>(sizeof(values))
+          || values[2] == 0) {
+        continue;
+      }
+      // scale up counts of events multiplexed with others
+      result.counts[ix] = static_cast<uint64_t>(
+          static_cast<double>(values[0]) * values[1] / values[2]);
+      any = true;
+    }
+    if (!any) {
+      return {};
+    }
+    return {result};
+  }
+
+ private:
+  std::array<int, kHardwareEvents.size()> fds_ = {-1, -1, -1, -1};
+};
+
 Time::Time(Metrics& metrics, const char* name)
-    : metrics_(metrics), index_(metrics.size()) {
+    : metrics_(metrics), index_(metrics.size()), span_(name) {
   clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &start_);
   metrics_.push_back(Metric{name, std::monostate()});
+  if (hardware_counters_enabled) {
+    hardware_ = std::make_shared<const HardwareCounters>();
+  }
 }
 
 Time::~Time() {
+  if (hardware_) {
+    metrics_[index_].hardware = hardware_->Read();
+  }
   struct timespec finish;
   clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &finish);
   const auto seconds = finish.tv_sec - start_.tv_sec;
   const auto nanos = finish.tv_nsec - start_.tv_nsec;
   metrics_[index_].value.emplace<1>(seconds * 1'000'000'000 + nanos);
+  metrics_[index_].nested = metrics_.size() - index_ - 1;
 }
 
 Counter::Counter(Metrics& metrics, const char* name)
@@ -89,13 +594,78 @@ Counter::~Counter() {
   metrics_[index_].value = value_;
 }
 
+Memory::Memory(Metrics& metrics, const char* name)
+    : metrics_(metrics), index_(metrics.size()), start_(Measure()) {
+  metrics_.push_back(Metric{name, std::monostate()});
+}
+
+Memory::~Memory() {
+  const auto finish = Measure();
+  metrics_[index_].value.emplace<4>(MemoryUsage{
+      finish.peak_rss - start_.peak_rss,
+      Difference(start_.allocated, finish.allocated),
+      Difference(start_.active, finish.active)});
+  metrics_[index_].nested = metrics_.size() - index_ - 1;
+}
+
+Memory::Sample Memory::Measure() {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  // the peak resident set size is reported in KiB
+  Sample sample{static_cast<size_t>(usage.ru_maxrss) * 1024, {}, {}};
+  if (mallctl != nullptr) {
+    // refresh the statistics, which jemalloc otherwise caches
+    uint64_t epoch = 1;
+    size_t length = sizeof(epoch);
+    mallctl("epoch", &epoch, &length, &epoch, length);
+    sample.allocated = AllocatorStatistic("stats.allocated");
+    sample.active = AllocatorStatistic("stats.active");
+  }
+  return sample;
+}
+
+Workers::Workers(Metrics& metrics, const char* name)
+    : metrics_(metrics), index_(metrics.size()) {
+  clock_gettime(CLOCK_MONOTONIC, &start_);
+  metrics_.push_back(Metric{name, std::monostate()});
+}
+
+Workers::~Workers() {
+  struct timespec finish;
+  clock_gettime(CLOCK_MONOTONIC, &finish);
+  const auto seconds = finish.tv_sec - start_.tv_sec;
+  const auto nanos = finish.tv_nsec - start_.tv_nsec;
+  metrics_[index_].value.emplace<6>(WorkerUsage{
+      Nanoseconds(seconds * 1'000'000'000 + nanos), Nanoseconds(busy_),
+      workers_});
+}
+
+Slowest::Slowest(Metrics& metrics, const char* name)
+    : metrics_(metrics), index_(metrics.size()) {
+  metrics_.push_back(Metric{name, std::monostate()});
+}
+
+Slowest::~Slowest() {
+  metrics_[index_].value = std::move(items_);
+}
+
 Histogram::Histogram(Metrics& metrics, const char* name)
     : metrics_(metrics), index_(metrics.size()) {
   metrics_.push_back(Metric{name, std::monostate()});
 }
 
 Histogram::~Histogram() {
-  metrics_[index_].value.emplace<3>(std::move(frequencies_));
+  std::map<size_t, size_t> frequencies;
+  for (size_t ix = 0; ix < kBuckets; ++ix) {
+    const auto frequency = frequencies_[ix];
+    if (frequency != 0) {
+      const size_t item = ix < kExact
+          ? ix
+          : size_t{1} << (ix - kExact + std::bit_width(kExact) - 1);
+      frequencies.emplace(item, frequency);
+    }
+  }
+  metrics_[index_].value.emplace<3>(std::move(frequencies));
 }
 
 }  // namespace stg
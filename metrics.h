@@ -20,14 +20,25 @@
 #ifndef STG_METRICS_H_
 #define STG_METRICS_H_
 
+#include <array>
+#include <atomic>
+#include <bit>
 #include <cstddef>
 #include <cstdint>
 #include <ctime>
+#include <limits>
 #include <map>
+#include <memory>
+#include <optional>
 #include <ostream>
+#include <string>
+#include <string_view>
+#include <utility>
 #include <variant>
 #include <vector>
 
+#include "trace.h"
+
 namespace stg {
 
 struct Nanoseconds {
@@ -35,21 +46,118 @@ struct Nanoseconds {
   uint64_t ns;
 };
 
+// Changes in memory use, in bytes. The allocator statistics are only available
+// when running with jemalloc.
+struct MemoryUsage {
+  size_t peak_rss_increase;
+  std::optional<ptrdiff_t> allocated;
+  std::optional<ptrdiff_t> active;
+};
+
+// The combined times of a scope that ran in several workers.
+struct Durations {
+  Nanoseconds total;
+  Nanoseconds max;
+  size_t count;
+};
+
+// How busy the workers of a parallel stage were: the elapsed (wall-clock) time
+// of the stage, the total time the workers spent working and the most workers
+// that took part.
+struct WorkerUsage {
+  Nanoseconds elapsed;
+  Nanoseconds busy;
+  size_t workers;
+};
+
+// The slowest items of some kind, up to a limit, with their descriptions. Wants
+// says whether an item taking so long would be kept, so that only those need be
+// described.
+class SlowItems {
+ public:
+  static constexpr size_t kLimit = 10;
+
+  explicit SlowItems(size_t limit = kLimit) : limit_(limit) {}
+
+  bool Wants(uint64_t ns) const {
+    return items_.size() < limit_
+        || (!items_.empty() && ns > items_.front().first);
+  }
+  void Add(uint64_t ns, std::string description);
+  // Keeps the slowest items of both, up to the larger limit.
+  void Merge(const SlowItems& other);
+  // Slowest first.
+  std::vector<std::pair<Nanoseconds, std::string>> Sorted() const;
+
+ private:
+  size_t limit_;
+  // a heap with the fastest item kept at the front
+  std::vector<std::pair<uint64_t, std::string>> items_;
+};
+
+// Counts of hardware events, see EnableHardwareCounters. A count is absent if
+// its event could not be counted.
+struct HardwareCounts {
+  static constexpr std::array<const char*, 4> kNames = {
+      "cycles", "instructions", "llc_misses", "dtlb_misses"};
+  std::array<std::optional<uint64_t>, kNames.size()> counts;
+};
+
 struct Metric {
   const char* name;
   std::variant<
       std::monostate,
       Nanoseconds,
       size_t,
-      std::map<size_t, size_t>
+      std::map<size_t, size_t>,
+      MemoryUsage,
+      Durations,
+      WorkerUsage,
+      SlowItems
       > value;
+  // the number of immediately following metrics that were recorded within
+  // this one's scope, for Time and Memory
+  size_t nested = 0;
+  // for Time, if hardware counters are enabled and available
+  std::optional<HardwareCounts> hardware = {};
 };
 
 using Metrics = std::vector<Metric>;
 
-void Report(const Metrics& metrics, std::ostream& os);
+// Metrics cannot be shared between threads, so concurrent work should record
+// into one shard per worker and merge them once the workers have finished.
+//
+// This appends one metric per distinct name, in order of first appearance
+// across the shards, taken in order. Counters are summed, histograms are
+// merged, times are combined into Durations and memory usage takes the maximum
+// of each value, as memory is measured process-wide. Worker usage times are
+// summed, keeping the most workers, slowest items are merged and hardware
+// counts are summed. Nesting is not preserved. The shards are left empty.
+void MergeShards(std::vector<Metrics>& shards, Metrics& metrics);
+
+enum class MetricsFormat { TEXT, JSON };
+
+std::optional<MetricsFormat> ParseMetricsFormat(std::string_view format);
+
+// The text format is one line per metric. The JSON format is a document
+// with scoped metrics nested within their enclosing scopes, followed by
+// process-wide resource usage.
+void Report(const Metrics& metrics, std::ostream& os,
+            MetricsFormat format = MetricsFormat::TEXT);
+
+// Makes each later Time scope also count hardware events with perf_event_open:
+// cycles, instructions, last-level cache misses and data TLB misses. The
+// counts are of the thread that created the scope, so exclude the work of
+// any pool threads it waits for. Events that cannot be counted, for example
+// because of perf_event_paranoid or in a virtual machine without a PMU, are
+// omitted and are not tried again.
+void EnableHardwareCounters();
 
 // These objects only record values on destruction, so scope them!
+//
+// Time scopes are also recorded as trace spans, when tracing.
+
+class HardwareCounters;
 
 class Time {
  public:
@@ -60,6 +168,8 @@ class Time {
   Metrics& metrics_;
   size_t index_;
   struct timespec start_;
+  trace::Span span_;
+  std::shared_ptr<const HardwareCounters> hardware_;
 };
 
 class Counter {
@@ -88,21 +198,193 @@ class Counter {
   size_t value_;
 };
 
+// Records the increase in the process's peak resident set size and, with
+// jemalloc, the changes in allocated and active bytes. These are process-wide,
+// so include the effects of anything else running concurrently.
+class Memory {
+ public:
+  Memory(Metrics& metrics, const char* name);
+  ~Memory();
+
+ private:
+  struct Sample {
+    size_t peak_rss;
+    std::optional<size_t> allocated;
+    std::optional<size_t> active;
+  };
+
+  static Sample Measure();
+
+  Metrics& metrics_;
+  size_t index_;
+  Sample start_;
+};
+
+// Records the utilisation of the workers of parallel work within its scope, see
+// ForEachIndex. Workers may report their busy time concurrently.
+class Workers {
+ public:
+  Workers(Metrics& metrics, const char* name);
+  ~Workers();
+
+  void Busy(size_t worker, uint64_t ns) {
+    busy_ += ns;
+    size_t workers = workers_.load(std::memory_order_relaxed);
+    while (worker + 1 > workers
+           && !workers_.compare_exchange_weak(workers, worker + 1)) {
+    }
+  }
+
+ private:
+  Metrics& metrics_;
+  size_t index_;
+  struct timespec start_;
+  std::atomic<uint64_t> busy_ = 0;
+  std::atomic<size_t> workers_ = 0;
+};
+
+// Frequencies are accumulated in a flat array. Small items are counted exactly
+// and larger ones in power-of-two buckets, reported by their lower bounds.
 class Histogram {
  public:
   Histogram(Metrics& metrics, const char* name);
   ~Histogram();
 
-  void Add(size_t item) {
-    ++frequencies_[item];
+  void Add(size_t item, size_t count = 1) {
+    frequencies_[Bucket(item)] += count;
+  }
+
+ private:
+  static constexpr size_t kExact = 32;
+  static constexpr size_t kBuckets =
+      kExact + std::numeric_limits<size_t>::digits + 1 - std::bit_width(kExact);
+
+  static size_t Bucket(size_t item) {
+    return item < kExact
+        ? item
+        : kExact + std::bit_width(item) - std::bit_width(kExact);
+  }
+
+  Metrics& metrics_;
+  size_t index_;
+  std::array<size_t, kBuckets> frequencies_ = {};
+};
+
+// Records the slowest of the items timed within its scope, see SlowItems.
+// Different instances recording the same name, for example in the shards of
+// concurrent work, are merged by MergeShards.
+class Slowest {
+ public:
+  Slowest(Metrics& metrics, const char* name);
+  ~Slowest();
+
+  bool Wants(uint64_t ns) const {
+    return items_.Wants(ns);
+  }
+  void Add(uint64_t ns, std::string description) {
+    items_.Add(ns, std::move(description));
   }
 
  private:
   Metrics& metrics_;
   size_t index_;
-  std::map<size_t, size_t> frequencies_;
+  SlowItems items_;
+};
+
+// The granularity of per-operation metrics, those updated in hot loops.
+//
+// FULL records every operation. SAMPLED counts every operation, which costs no
+// more than checking whether to sample, but only adds every kSampleRate-th item
+// to histograms, with a correspondingly scaled frequency. OFF records nothing,
+// not even the metric names.
+//
+// Phase metrics (Time, Memory and Counters of totals) are always recorded.
+enum class Granularity { OFF, SAMPLED, FULL };
+
+#ifndef STG_OPERATION_METRICS
+#define STG_OPERATION_METRICS FULL
+#endif
+
+inline constexpr Granularity kOperationGranularity =
+    Granularity::STG_OPERATION_METRICS;
+
+template <Granularity granularity>
+class BasicOperationCounter {
+ public:
+  BasicOperationCounter(Metrics& metrics, const char* name)
+      : counter_(metrics, name) {}
+
+  BasicOperationCounter& operator=(size_t x) {
+    counter_ = x;
+    return *this;
+  }
+
+  BasicOperationCounter& operator+=(size_t x) {
+    counter_ += x;
+    return *this;
+  }
+
+  BasicOperationCounter& operator++() {
+    ++counter_;
+    return *this;
+  }
+
+ private:
+  Counter counter_;
 };
 
+template <>
+class BasicOperationCounter<Granularity::OFF> {
+ public:
+  BasicOperationCounter(Metrics&, const char*) {}
+
+  BasicOperationCounter& operator=(size_t) {
+    return *this;
+  }
+
+  BasicOperationCounter& operator+=(size_t) {
+    return *this;
+  }
+
+  BasicOperationCounter& operator++() {
+    return *this;
+  }
+};
+
+template <Granularity granularity>
+class BasicOperationHistogram {
+ public:
+  BasicOperationHistogram(Metrics& metrics, const char* name)
+      : histogram_(metrics, name) {}
+
+  void Add(size_t item) {
+    if constexpr (granularity == Granularity::SAMPLED) {
+      if (++ticks_ % kSampleRate == 0) {
+        histogram_.Add(item, kSampleRate);
+      }
+    } else {
+      histogram_.Add(item);
+    }
+  }
+
+ private:
+  static constexpr size_t kSampleRate = 16;
+
+  Histogram histogram_;
+  size_t ticks_ = 0;
+};
+
+template <>
+class BasicOperationHistogram<Granularity::OFF> {
+ public:
+  BasicOperationHistogram(Metrics&, const char*) {}
+
+  void Add(size_t) {}
+};
+
+using OperationCounter = BasicOperationCounter<kOperationGranularity>;
+using OperationHistogram = BasicOperationHistogram<kOperationGranularity>;
+
 }  // namespace stg
 
 #endif  // STG_METRICS_H_
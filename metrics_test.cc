@@ -21,11 +21,15 @@
 
 #include <cstddef>
 #include <cstdint>
+#include <map>
+#include <limits>
 #include <sstream>
 #include <string>
+#include <variant>
 #include <vector>
 
 #include <catch2/catch.hpp>
+#include "error.h"
 
 namespace Test {
 
@@ -121,4 +125,224 @@ TEST_CASE("histogram") {
   CHECK(os.str() == expected);
 }
 
+TEST_CASE("histogram buckets") {
+  stg::Metrics metrics;
+  {
+    stg::Histogram h(metrics, "h");
+    h.Add(31);
+    h.Add(32);
+    h.Add(63);
+    h.Add(64, 2);
+    h.Add(std::numeric_limits<size_t>::max());
+  }
+  std::ostringstream os;
+  Report(metrics, os);
+  const std::string expected =
+      "h: [31]=1 [32]=2 [64]=2 [9223372036854775808]=1\n";
+  CHECK(os.str() == expected);
+}
+
+TEST_CASE("operation granularity") {
+  using Sampled = stg::BasicOperationHistogram<stg::Granularity::SAMPLED>;
+  using OffCounter = stg::BasicOperationCounter<stg::Granularity::OFF>;
+  using OffHistogram = stg::BasicOperationHistogram<stg::Granularity::OFF>;
+  stg::Metrics metrics;
+  {
+    stg::BasicOperationCounter<stg::Granularity::SAMPLED> c(metrics, "c");
+    Sampled s(metrics, "s");
+    OffCounter oc(metrics, "oc");
+    OffHistogram oh(metrics, "oh");
+    for (size_t i = 0; i < 40; ++i) {
+      ++c;
+      ++oc;
+      s.Add(1);
+      oh.Add(1);
+    }
+  }
+  std::ostringstream os;
+  Report(metrics, os);
+  const std::string expected = "c: 40\ns: [1]=32\n";
+  CHECK(os.str() == expected);
+}
+
+TEST_CASE("memory") {
+  stg::Metrics metrics;
+  const size_t size = 64 << 20;
+  {
+    stg::Memory m(metrics, "m");
+    // touch every page, so that they become resident
+    std::vector<char> buffer(size, 1);
+    CHECK(buffer.back() == 1);
+  }
+  REQUIRE(metrics.size() == 1);
+  const auto& usage = std::get<stg::MemoryUsage>(metrics[0].value);
+  CHECK(usage.peak_rss_increase >= size / 2);
+  std::ostringstream os;
+  Report(metrics, os);
+  CHECK(os.str().rfind("m: peak RSS +", 0) == 0);
+}
+
+TEST_CASE("nesting") {
+  stg::Metrics metrics;
+  {
+    stg::Time a(metrics, "a");
+    {
+      stg::Counter b(metrics, "b");
+      stg::Time c(metrics, "c");
+      stg::Counter d(metrics, "d");
+    }
+    stg::Counter e(metrics, "e");
+  }
+  stg::Counter f(metrics, "f");
+  REQUIRE(metrics.size() == 6);
+  CHECK(metrics[0].nested == 4);
+  CHECK(metrics[1].nested == 0);
+  CHECK(metrics[2].nested == 1);
+  CHECK(metrics[5].nested == 0);
+}
+
+TEST_CASE("json") {
+  const stg::Metrics metrics = {
+      {"a", stg::Nanoseconds(5), 2},
+      {"b\"", size_t{3}},
+      {"c", std::map<size_t, size_t>{{1, 2}, {3, 4}}},
+      {"d", stg::MemoryUsage{7, {-8}, {}}},
+      {"e", std::monostate()},
+  };
+  std::ostringstream os;
+  stg::Report(metrics, os, stg::MetricsFormat::JSON);
+  const std::string expected =
+      R"({"metrics":[)"
+      R"({"name":"a","type":"time","ns":5,"nested":[)"
+      R"({"name":"b\"","type":"counter","value":3},)"
+      R"({"name":"c","type":"histogram","frequencies":[[1,2],[3,4]]}]},)"
+      R"({"name":"d","type":"memory","peak_rss_increase":7,"allocated":-8},)"
+      R"({"name":"e","type":"incomplete"}],"process":{)";
+  CHECK(os.str().rfind(expected, 0) == 0);
+  CHECK(os.str().back() == '\n');
+}
+
+TEST_CASE("metrics format") {
+  CHECK(stg::ParseMetricsFormat("text") == stg::MetricsFormat::TEXT);
+  CHECK(stg::ParseMetricsFormat("json") == stg::MetricsFormat::JSON);
+  CHECK(!stg::ParseMetricsFormat("xml"));
+}
+
+TEST_CASE("merge") {
+  std::vector<stg::Metrics> shards = {
+      {
+          {"t", stg::Nanoseconds(5)},
+          {"c", size_t{1}},
+          {"h", std::map<size_t, size_t>{{1, 2}}},
+      },
+      {
+          {"m", stg::MemoryUsage{3, {-2}, {}}},
+          {"c", size_t{2}},
+          {"t", stg::Nanoseconds(7)},
+      },
+      {},
+      {
+          {"h", std::map<size_t, size_t>{{1, 1}, {4, 1}}},
+          {"t", stg::Nanoseconds(1)},
+          {"m", stg::MemoryUsage{1, {5}, {6}}},
+      },
+  };
+  stg::Metrics metrics = {{"first", size_t{0}}};
+  stg::MergeShards(shards, metrics);
+  for (const auto& shard : shards) {
+    CHECK(shard.empty());
+  }
+  std::ostringstream os;
+  Report(metrics, os);
+  const std::string expected =
+      "first: 0\n"
+      "t: 0.000013 ms total, 0.000007 ms max, 3 times\n"
+      "c: 3\n"
+      "h: [1]=3 [4]=1\n"
+      "m: peak RSS +3 B, allocated +5 B, active +6 B\n";
+  CHECK(os.str() == expected);
+
+  std::vector<stg::Metrics> inconsistent = {
+      {{"x", size_t{1}}},
+      {{"x", stg::Nanoseconds(1)}},
+  };
+  CHECK_THROWS_AS(stg::MergeShards(inconsistent, metrics), stg::Exception);
+}
+
+TEST_CASE("slowest") {
+  std::vector<stg::Metrics> shards(2);
+  {
+    stg::Slowest slowest(shards[0], "s");
+    for (const uint64_t ns : {5, 1, 9, 3, 7}) {
+      if (slowest.Wants(ns)) {
+        slowest.Add(ns, "item" + std::to_string(ns));
+      }
+    }
+  }
+  {
+    stg::Slowest slowest(shards[1], "s");
+    CHECK(slowest.Wants(0));
+    slowest.Add(8, "item8");
+  }
+  stg::SlowItems items(3);
+  for (const uint64_t ns : {4, 2, 6, 1}) {
+    items.Add(ns, "x");
+  }
+  CHECK(!items.Wants(1));
+  CHECK(items.Wants(3));
+  stg::Metrics metrics = {{"t", items}};
+  stg::MergeShards(shards, metrics);
+
+  std::ostringstream text;
+  Report(metrics, text);
+  const std::string expected_text =
+      "t: 0.000006 ms x; 0.000004 ms x; 0.000002 ms x\n"
+      "s: 0.000009 ms item9; 0.000008 ms item8; 0.000007 ms item7;"
+      " 0.000005 ms item5; 0.000003 ms item3; 0.000001 ms item1\n";
+  CHECK(text.str() == expected_text);
+
+  const stg::Metrics empty = {{"e", stg::SlowItems()}};
+  Report(empty, text);
+  CHECK(text.str() == expected_text + "e: none\n");
+
+  std::ostringstream json;
+  Report(metrics, json, stg::MetricsFormat::JSON);
+  const std::string expected_json =
+      R"({"metrics":[)"
+      R"({"name":"t","type":"slowest","items":[)"
+      R"({"ns":6,"name":"x"},{"ns":4,"name":"x"},{"ns":2,"name":"x"}]},)";
+  CHECK(json.str().rfind(expected_json, 0) == 0);
+}
+
+TEST_CASE("hardware counts") {
+  const stg::HardwareCounts counts1{{100, 50, {}, 2}};
+  const stg::HardwareCounts counts2{{10, 5, 1, {}}};
+  std::vector<stg::Metrics> shards = {
+      {{"t", stg::Nanoseconds(5), 0, counts1}},
+      {{"t", stg::Nanoseconds(7), 0, counts2}},
+      {{"t", stg::Nanoseconds(1)}},
+  };
+  stg::Metrics metrics = {{"a", stg::Nanoseconds(3), 0, counts2}};
+  stg::MergeShards(shards, metrics);
+
+  std::ostringstream text;
+  Report(metrics, text);
+  const std::string expected_text =
+      "a: 0.000003 ms (cycles 10, instructions 5, llc_misses 1)\n"
+      "t: 0.000013 ms total, 0.000007 ms max, 3 times"
+      " (cycles 110, instructions 55, llc_misses 1, dtlb_misses 2)\n";
+  CHECK(text.str() == expected_text);
+
+  std::ostringstream json;
+  Report(metrics, json, stg::MetricsFormat::JSON);
+  const std::string expected_json =
+      R"({"metrics":[)"
+      R"({"name":"a","type":"time","ns":3,)"
+      R"("hardware":{"cycles":10,"instructions":5,"llc_misses":1}},)"
+      R"({"name":"t","type":"durations","total_ns":13,"max_ns":7,"count":3,)"
+      R"("hardware":{"cycles":110,"instructions":55,"llc_misses":1,)"
+      R"("dtlb_misses":2}}],"process":{)";
+  CHECK(json.str().rfind(expected_json, 0) == 0);
+}
+
 }  // namespace Test
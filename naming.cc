@@ -20,19 +20,76 @@
 
 #include "naming.h"
 
+#include <cstddef>
+#include <memory>
 #include <ostream>
 #include <sstream>
 #include <string>
+#include <string_view>
+#include <utility>
 
 #include "graph.h"
 
 namespace stg {
 
+// A leaf holds text, otherwise the node is the concatenation of its children.
+struct Name::Rope {
+  Rope(std::string_view leaf, Text first, Text second, size_t size)
+      : leaf(leaf), first(std::move(first)), second(std::move(second)),
+        size(size) {}
+  std::string leaf;
+  Text first;
+  Text second;
+  size_t size;
+};
+
+Name::Text Name::Leaf(std::string_view text) {
+  if (text.empty()) {
+    return {};
+  }
+  return std::make_shared<const Rope>(text, Text(), Text(), text.size());
+}
+
+Name::Text Name::Concat(Text first, Text second) {
+  if (!first) {
+    return second;
+  }
+  if (!second) {
+    return first;
+  }
+  const size_t size = first->size + second->size;
+  return std::make_shared<const Rope>(
+      std::string(), std::move(first), std::move(second), size);
+}
+
+size_t Name::Size(const Text& text) {
+  return text ? text->size : 0;
+}
+
+void Name::Print(std::ostream& os, const Text& text) {
+  if (text) {
+    os << text->leaf;
+    Print(os, text->first);
+    Print(os, text->second);
+  }
+}
+
+void Name::Append(std::string& result, const Text& text) {
+  if (text) {
+    result += text->leaf;
+    Append(result, text->first);
+    Append(result, text->second);
+  }
+}
+
 Name Name::Add(Side side, Precedence precedence,
-               const std::string& text) const {
+               std::string_view text) const {
+  static const Text open = Leaf("(");
+  static const Text close = Leaf(")");
+  static const Text space = Leaf(" ");
   bool bracket = precedence < precedence_;
-  std::ostringstream left;
-  std::ostringstream right;
+  Text left = left_;
+  Text right;
 
   // Bits on the left require whitespace separation when an identifier is being
   // added. While it would be simpler to unconditionally add a space, we choose
@@ -40,23 +97,26 @@ Name Name::Add(Side side, Precedence precedence,
   // except for the longer pointer-to-member syntax.
   //
   // For illegal types containing && & or & && this could result in &&&.
-  left << left_;
   if (bracket) {
-    left << '(';
+    left = Concat(left, open);
   } else if (side == Side::LEFT
              && (precedence == Precedence::ATOMIC || text.size() > 2)) {
-    left << ' ';
+    left = Concat(left, space);
   }
 
-  (side == Side::LEFT ? left : right) << text;
+  if (side == Side::LEFT) {
+    left = Concat(left, Leaf(text));
+  } else {
+    right = Leaf(text);
+  }
 
   // Bits on the right are arrays [] and functions () and need no whitespace.
   if (bracket) {
-    right << ')';
+    right = Concat(right, close);
   }
-  right << right_;
+  right = Concat(right, right_);
 
-  return Name{left.str(), precedence, right.str()};
+  return Name{left, precedence, right};
 }
 
 Name Name::Qualify(Qualifier qualifier) const {
@@ -69,35 +129,41 @@ Name Name::Qualify(Qualifier qualifier) const {
       //
       // This gives the more popular format (const int rather than int const)
       // and is safe because NIL precedence types are always leaf syntax.
-      os << qualifier << ' ' << left_;
-      return Name{os.str(), precedence_, right_};
+      os << qualifier << ' ';
+      return Name{Concat(Leaf(os.str()), left_), precedence_, right_};
     }
     case Precedence::POINTER: {
       // Add qualifier to the right of the sigil.
       //
       // TODO: consider dropping ' ' here.
-      os << left_ << ' ' << qualifier;
-      return Name{os.str(), precedence_, right_};
+      os << ' ' << qualifier;
+      return Name{Concat(left_, Leaf(os.str())), precedence_, right_};
     }
     case Precedence::ARRAY_FUNCTION: {
       // Qualifiers should not normally apply to arrays or functions.
-      os << '{' << qualifier << ">}" << right_;
-      return Name{left_, precedence_, os.str()};
+      os << '{' << qualifier << ">}";
+      return Name{left_, precedence_, Concat(Leaf(os.str()), right_)};
     }
     case Precedence::ATOMIC: {
       // Qualifiers should not normally apply to names.
-      os << left_ << "{<" << qualifier << '}';
-      return Name{os.str(), precedence_, right_};
+      os << "{<" << qualifier << '}';
+      return Name{Concat(left_, Leaf(os.str())), precedence_, right_};
     }
   }
 }
 
 std::ostream& Name::Print(std::ostream& os) const {
-  return os << left_ << right_;
+  Print(os, left_);
+  Print(os, right_);
+  return os;
 }
 
 std::string Name::ToString() const {
-  return left_ + right_;
+  std::string result;
+  result.reserve(Size(left_) + Size(right_));
+  Append(result, left_);
+  Append(result, right_);
+  return result;
 }
 
 std::ostream& operator<<(std::ostream& os, const Name& name) {
@@ -189,7 +255,11 @@ Name Describe::operator()(const Method& x) {
   if (x.mangled_name == x.name) {
     return Name{x.name};
   }
-  return Name{x.name + " {" + x.mangled_name + "}"};
+  std::string name(x.name);
+  name += " {";
+  name += x.mangled_name;
+  name += '}';
+  return Name{name};
 }
 
 Name Describe::operator()(const StructUnion& x) {
@@ -240,7 +310,7 @@ Name Describe::operator()(const Function& x) {
 }
 
 Name Describe::operator()(const ElfSymbol& x) {
-  const auto& name = x.full_name ? *x.full_name : x.symbol_name;
+  const std::string_view name = x.full_name ? *x.full_name : x.symbol_name;
   return x.type_id
       ? (*this)(*x.type_id).Add(Side::LEFT, Precedence::ATOMIC, name)
       : Name{name};
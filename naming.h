@@ -21,9 +21,13 @@
 #ifndef STG_NAMING_H_
 #define STG_NAMING_H_
 
+#include <cstddef>
+#include <memory>
 #include <ostream>
 #include <string>
+#include <string_view>
 #include <unordered_map>
+#include <utility>
 
 #include "graph.h"
 
@@ -34,21 +38,38 @@ namespace stg {
 enum class Precedence { NIL, POINTER, ARRAY_FUNCTION, ATOMIC };
 enum class Side { LEFT, RIGHT };
 
+// Names are immutable ropes. Adding to a Name shares the text of the original,
+// so building up a deeply nested declarator is linear rather than quadratic in
+// its length. The text is only flattened when printed.
 class Name {
  public:
-  explicit Name(const std::string& name)
-      : left_(name), precedence_(Precedence::NIL), right_() {}
-  Name(const std::string& left, Precedence precedence, const std::string& right)
-      : left_(left), precedence_(precedence), right_(right) {}
-  Name Add(Side side, Precedence precedence, const std::string& text) const;
+  explicit Name(std::string_view name)
+      : left_(Leaf(name)), precedence_(Precedence::NIL) {}
+  Name(std::string_view left, Precedence precedence, std::string_view right)
+      : left_(Leaf(left)), precedence_(precedence), right_(Leaf(right)) {}
+  Name Add(Side side, Precedence precedence, std::string_view text) const;
   Name Qualify(Qualifier qualifier) const;
   std::ostream& Print(std::ostream& os) const;
   std::string ToString() const;
 
  private:
-  std::string left_;
+  struct Rope;
+  // null represents the empty string
+  using Text = std::shared_ptr<const Rope>;
+
+  static Text Leaf(std::string_view text);
+  static Text Concat(Text first, Text second);
+  static size_t Size(const Text& text);
+  static void Print(std::ostream& os, const Text& text);
+  static void Append(std::string& result, const Text& text);
+
+  Name(Text left, Precedence precedence, Text right)
+      : left_(std::move(left)), precedence_(precedence),
+        right_(std::move(right)) {}
+
+  Text left_;
   Precedence precedence_;
-  std::string right_;
+  Text right_;
 };
 
 std::ostream& operator<<(std::ostream& os, const Name& name);
@@ -0,0 +1,204 @@
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+// -*- mode: C++ -*-
+//
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License v2.0 with LLVM Exceptions (the
+// "License"); you may not use this file except in compliance with the
+// License.  You may obtain a copy of the License at
+//
+//     https://llvm.org/LICENSE.txt
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef STG_NODE_HASHES_H_
+#define STG_NODE_HASHES_H_
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <utility>
+#include <vector>
+
+#include "error.h"
+#include "graph.h"
+#include "hashing.h"
+
+namespace stg {
+
+// Roughly equivalent to std::unordered_map<Id, HashValue64>, but held densely
+// as a vector of hashes indexed by id and a bitset of the ids present.
+//
+// Lookups are a single indexed load and iteration is in id order, so anything
+// derived from it is deterministic. Storage grows to cover the largest id
+// inserted, which suits node hashes as they cover most of a graph's ids.
+class NodeHashes {
+ public:
+  class Iterator {
+   public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = std::pair<Id, HashValue64>;
+    using difference_type = std::ptrdiff_t;
+    using pointer = void;
+    using reference = value_type;
+
+    Iterator() = default;
+    Iterator(const NodeHashes* hashes, size_t ix) : hashes_(hashes), ix_(ix) {
+      Skip();
+    }
+    value_type operator*() const {
+      return {Id(ix_), hashes_->values_[ix_]};
+    }
+    Iterator& operator++() {
+      ++ix_;
+      Skip();
+      return *this;
+    }
+    Iterator operator++(int) {
+      auto result = *this;
+      ++*this;
+      return result;
+    }
+    bool operator==(const Iterator& other) const {
+      return ix_ == other.ix_;
+    }
+    bool operator!=(const Iterator& other) const {
+      return ix_ != other.ix_;
+    }
+
+   private:
+    // Advances to the next id present, or to the end.
+    void Skip() {
+      const auto& words = hashes_->present_;
+      const size_t end = hashes_->values_.size();
+      while (ix_ < end) {
+        const uint64_t word = words[ix_ / kBits] >> (ix_ % kBits);
+        if (word != 0) {
+          ix_ += std::countr_zero(word);
+          return;
+        }
+        ix_ = (ix_ / kBits + 1) * kBits;
+      }
+      ix_ = end;
+    }
+
+    const NodeHashes* hashes_ = nullptr;
+    size_t ix_ = 0;
+  };
+
+  void Reserve(Id limit) {
+    values_.reserve(limit.ix_);
+    present_.reserve(Words(limit.ix_));
+  }
+  size_t Size() const {
+    return size_;
+  }
+  bool Empty() const {
+    return size_ == 0;
+  }
+  bool Contains(Id id) const {
+    const auto ix = id.ix_;
+    return ix < values_.size()
+        && (present_[ix / kBits] & (uint64_t{1} << (ix % kBits))) != 0;
+  }
+  // Returns the hash of the id, or nullptr if there is none.
+  const HashValue64* Find(Id id) const {
+    return Contains(id) ? &values_[id.ix_] : nullptr;
+  }
+  // Returns the hash of the id, which must be present.
+  HashValue64 At(Id id) const {
+    if (!Contains(id)) {
+      Die() << "NodeHashes: no hash for " << id;
+    }
+    return values_[id.ix_];
+  }
+  // Returns whether the id was newly inserted. An existing hash is kept.
+  bool Insert(Id id, HashValue64 hash) {
+    const auto ix = id.ix_;
+    if (ix >= values_.size()) {
+      values_.resize(ix + 1, HashValue64(0));
+      present_.resize(Words(ix + 1), 0);
+    }
+    auto& word = present_[ix / kBits];
+    const uint64_t bit = uint64_t{1} << (ix % kBits);
+    if ((word & bit) != 0) {
+      return false;
+    }
+    word |= bit;
+    values_[ix] = hash;
+    ++size_;
+    return true;
+  }
+  // Returns whether the id was present.
+  bool Erase(Id id) {
+    if (!Contains(id)) {
+      return false;
+    }
+    present_[id.ix_ / kBits] &= ~(uint64_t{1} << (id.ix_ % kBits));
+    --size_;
+    return true;
+  }
+  // Erases the entries for which the predicate, given id and hash, holds.
+  // Returns the number erased.
+  template <typename Predicate>
+  size_t EraseIf(Predicate predicate) {
+    size_t erased = 0;
+    for (const auto& [id, hash] : *this) {
+      if (predicate(id, hash)) {
+        Erase(id);
+        ++erased;
+      }
+    }
+    return erased;
+  }
+  void Clear() {
+    values_.clear();
+    present_.clear();
+    size_ = 0;
+  }
+  // Inserts the entries of other whose ids are not already present.
+  void Merge(const NodeHashes& other) {
+    for (const auto& [id, hash] : other) {
+      Insert(id, hash);
+    }
+  }
+
+  bool operator==(const NodeHashes& other) const {
+    return size_ == other.size_
+        && std::all_of(begin(), end(), [&](const auto& item) {
+             const auto* hash = other.Find(item.first);
+             return hash != nullptr && *hash == item.second;
+           });
+  }
+  bool operator!=(const NodeHashes& other) const {
+    return !(*this == other);
+  }
+
+  Iterator begin() const {
+    return {this, 0};
+  }
+  Iterator end() const {
+    return {this, values_.size()};
+  }
+
+ private:
+  static constexpr size_t kBits = 64;
+
+  static size_t Words(size_t size) {
+    return (size + kBits - 1) / kBits;
+  }
+
+  std::vector<HashValue64> values_;
+  std::vector<uint64_t> present_;
+  size_t size_ = 0;
+};
+
+}  // namespace stg
+
+#endif  // STG_NODE_HASHES_H_
@@ -0,0 +1,79 @@
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+// -*- mode: C++ -*-
+//
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License v2.0 with LLVM Exceptions (the
+// "License"); you may not use this file except in compliance with the
+// License.  You may obtain a copy of the License at
+//
+//     https://llvm.org/LICENSE.txt
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "node_hashes.h"
+
+#include <cstddef>
+#include <vector>
+
+#include <catch2/catch.hpp>
+#include "error.h"
+#include "graph.h"
+#include "hashing.h"
+
+namespace Test {
+
+TEST_CASE("node hashes") {
+  using stg::HashValue64;
+  using stg::Id;
+  stg::NodeHashes hashes;
+  CHECK(hashes.Empty());
+  CHECK(hashes.Find(Id(0)) == nullptr);
+  CHECK_THROWS_AS(hashes.At(Id(0)), stg::Exception);
+
+  for (size_t ix : {130, 3, 64, 0, 63}) {
+    CHECK(hashes.Insert(Id(ix), HashValue64(ix + 1)));
+  }
+  // existing hashes are kept
+  CHECK(!hashes.Insert(Id(64), HashValue64(0)));
+  CHECK(hashes.Size() == 5);
+  CHECK(hashes.At(Id(64)) == HashValue64(65));
+  CHECK(!hashes.Contains(Id(1)));
+  CHECK(!hashes.Contains(Id(1000)));
+
+  // iteration is in id order
+  std::vector<size_t> ids;
+  for (const auto& [id, hash] : hashes) {
+    CHECK(hash == HashValue64(id.ix_ + 1));
+    ids.push_back(id.ix_);
+  }
+  CHECK(ids == std::vector<size_t>{0, 3, 63, 64, 130});
+
+  CHECK(hashes.Erase(Id(3)));
+  CHECK(!hashes.Erase(Id(3)));
+  CHECK(hashes.EraseIf([](Id id, HashValue64) { return id.ix_ >= 64; }) == 2);
+  CHECK(hashes.Size() == 2);
+
+  stg::NodeHashes other;
+  other.Insert(Id(63), HashValue64(0));
+  other.Insert(Id(200), HashValue64(201));
+  CHECK(other != hashes);
+  other.Merge(hashes);
+  CHECK(other.Size() == 3);
+  CHECK(other.At(Id(63)) == HashValue64(0));
+  CHECK(other.At(Id(0)) == HashValue64(1));
+
+  other.Erase(Id(200));
+  other.Erase(Id(63));
+  other.Insert(Id(63), HashValue64(64));
+  CHECK(other == hashes);
+  other.Clear();
+  CHECK(other.Empty());
+  CHECK(other.begin() == other.end());
+}
+
+}  // namespace Test
@@ -23,6 +23,7 @@
 #include <algorithm>
 #include <cstddef>
 #include <optional>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
@@ -42,22 +43,50 @@ namespace stg {
 // indexes2: george, ted, emily
 //
 // indexes1: rose, george, ted, emily
+//
+// This takes expected linear time. Rather than inserting new items one by one,
+// it records, for each new item, the number of items of the left ordering it
+// should follow (which never decreases) and merges them in at the end.
 template <typename T>
 void ExtendOrder(std::vector<T>& indexes1, const std::vector<T>& indexes2) {
+  const size_t size1 = indexes1.size();
+  // the position of each item in indexes1 (the first, if repeated), with new
+  // items at position size1
+  std::unordered_map<T, size_t> positions;
+  positions.reserve(size1 + indexes2.size());
+  for (size_t position = 0; position < size1; ++position) {
+    positions.emplace(indexes1[position], position);
+  }
+  // new items, each with the number of items of indexes1 that precede it
+  std::vector<std::pair<size_t, T>> insertions;
   // keep track of where we can insert in indexes1
-  size_t pos = 0;
+  size_t gap = 0;
   for (const auto& value : indexes2) {
-    auto found = std::find(indexes1.begin(), indexes1.end(), value);
-    if (found == indexes1.end()) {
+    const auto [found, inserted] = positions.emplace(value, size1);
+    if (inserted) {
       // new node, insert at first possible place
-      indexes1.insert(indexes1.begin() + pos, value);
-      // now pointing at inserted item, point after it
-      ++pos;
-    } else if (indexes1.begin() + pos <= found) {
+      insertions.emplace_back(gap, value);
+    } else if (found->second < size1 && gap <= found->second) {
       // safe to use the constraint, point after found item
-      pos = found - indexes1.begin() + 1;
+      gap = found->second + 1;
+    }
+  }
+  if (insertions.empty()) {
+    return;
+  }
+  std::vector<T> result;
+  result.reserve(size1 + insertions.size());
+  auto insertion = insertions.begin();
+  for (size_t position = 0; position <= size1; ++position) {
+    for (; insertion != insertions.end() && insertion->first == position;
+         ++insertion) {
+      result.push_back(std::move(insertion->second));
+    }
+    if (position < size1) {
+      result.push_back(std::move(indexes1[position]));
     }
   }
+  indexes1 = std::move(result);
 }
 
 // Permutes the data array according to the permutation.
@@ -19,6 +19,7 @@
 
 #include "order.h"
 
+#include <algorithm>
 #include <cstddef>
 #include <optional>
 #include <random>
@@ -210,6 +211,46 @@ TEST_CASE("randomly-generating ordering sequences, single overlap") {
   }
 }
 
+// The original quadratic algorithm, inserting new items one by one.
+template <typename T>
+void SimpleExtendOrder(std::vector<T>& indexes1,
+                       const std::vector<T>& indexes2) {
+  size_t pos = 0;
+  for (const auto& value : indexes2) {
+    auto found = std::find(indexes1.begin(), indexes1.end(), value);
+    if (found == indexes1.end()) {
+      indexes1.insert(indexes1.begin() + pos, value);
+      ++pos;
+    } else if (indexes1.begin() + pos <= found) {
+      pos = found - indexes1.begin() + 1;
+    }
+  }
+}
+
+TEST_CASE("randomly-generated ordering sequences match simple algorithm") {
+  std::ranlux48 gen;
+  auto seed = gen();
+  // NOTES:
+  //   Items are drawn from a range small enough to give overlaps and repeats.
+  for (size_t k = 0; k < 40; ++k) {
+    for (size_t n = 0; n < 100; ++n, ++seed) {
+      gen.seed(seed);
+      std::uniform_int_distribution<size_t> pick(0, k + k / 2);
+      std::vector<size_t> order1(k);
+      std::vector<size_t> order2(k);
+      for (size_t i = 0; i < k; ++i) {
+        order1[i] = pick(gen);
+        order2[i] = pick(gen);
+      }
+      INFO("orderings of " << k << " numbers generated using seed " << seed);
+      auto expected = order1;
+      SimpleExtendOrder(expected, order2);
+      stg::ExtendOrder(order1, order2);
+      CHECK(order1 == expected);
+    }
+  }
+}
+
 TEST_CASE("hand-curated ordering sequences") {
   using Sequence = std::vector<std::string>;
   // NOTES:
@@ -0,0 +1,192 @@
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+// -*- mode: C++ -*-
+//
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License v2.0 with LLVM Exceptions (the
+// "License"); you may not use this file except in compliance with the
+// License.  You may obtain a copy of the License at
+//
+//     https://llvm.org/LICENSE.txt
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "parallel.h"
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace stg {
+
+namespace {
+
+// A process-wide pool of threads, shared by all parallel work and grown on
+// demand to the largest number of helpers wanted so far.
+//
+// Each pool thread has its own deque of tasks. Tasks submitted by a pool thread
+// (for nested parallel work) go on its own deque, which it takes from newest
+// first, while tasks submitted by other threads go on a shared queue. An idle
+// thread takes from its own deque, then the shared queue and then steals the
+// oldest task from another thread's deque. Tasks are coarse (a whole worker of
+// a ForEachIndex), so a single lock is held while queueing.
+class Executor {
+ public:
+  using Task = std::function<void()>;
+
+  static Executor& Instance() {
+    static Executor executor;
+    return executor;
+  }
+
+  ~Executor() {
+    {
+      const std::lock_guard<std::mutex> lock(mutex_);
+      stopping_ = true;
+    }
+    wake_.notify_all();
+    for (auto& thread : threads_) {
+      thread.join();
+    }
+  }
+
+  void Submit(size_t threads, std::vector<Task>&& tasks) {
+    {
+      const std::lock_guard<std::mutex> lock(mutex_);
+      while (threads_.size() < threads) {
+        const size_t index = threads_.size();
+        deques_.push_back(std::make_unique<std::deque<Task>>());
+        threads_.emplace_back([this, index] { Run(index); });
+      }
+      auto& queue = current_ != nullptr && current_->executor == this
+                    ? *deques_[current_->index]
+                    : shared_;
+      for (auto& task : tasks) {
+        queue.push_back(std::move(task));
+      }
+    }
+    wake_.notify_all();
+  }
+
+ private:
+  struct Current {
+    Executor* executor;
+    size_t index;
+  };
+
+  Executor() = default;
+
+  std::optional<Task> Take(size_t index) {
+    auto& own = *deques_[index];
+    if (!own.empty()) {
+      Task task = std::move(own.back());
+      own.pop_back();
+      return task;
+    }
+    if (!shared_.empty()) {
+      Task task = std::move(shared_.front());
+      shared_.pop_front();
+      return task;
+    }
+    for (size_t offset = 1; offset < deques_.size(); ++offset) {
+      auto& other = *deques_[(index + offset) % deques_.size()];
+      if (!other.empty()) {
+        Task task = std::move(other.front());
+        other.pop_front();
+        return task;
+      }
+    }
+    return {};
+  }
+
+  void Run(size_t index) {
+    Current current{this, index};
+    current_ = &current;
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+      if (auto task = Take(index)) {
+        lock.unlock();
+        (*task)();
+        lock.lock();
+      } else if (stopping_) {
+        break;
+      } else {
+        wake_.wait(lock);
+      }
+    }
+    current_ = nullptr;
+  }
+
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  bool stopping_ = false;
+  std::deque<Task> shared_;
+  // one per thread, stable while the thread runs
+  std::vector<std::unique_ptr<std::deque<Task>>> deques_;
+  std::vector<std::thread> threads_;
+  static thread_local Current* current_;
+};
+
+thread_local Executor::Current* Executor::current_ = nullptr;
+
+// The pool threads helping with some parallel work. A helper that only starts
+// once the work is finished does nothing.
+struct Helpers {
+  std::mutex mutex;
+  std::condition_variable done;
+  bool closed = false;
+  size_t running = 0;
+  size_t started = 0;
+  const std::function<void(size_t)>* run = nullptr;
+};
+
+}  // namespace
+
+namespace internal {
+
+void RunWorkers(size_t workers, const std::function<void(size_t)>& run) {
+  auto helpers = std::make_shared<Helpers>();
+  helpers->run = &run;
+  std::vector<Executor::Task> tasks;
+  tasks.reserve(workers - 1);
+  for (size_t ix = 1; ix < workers; ++ix) {
+    tasks.emplace_back([helpers] {
+      size_t worker;
+      {
+        const std::lock_guard<std::mutex> lock(helpers->mutex);
+        if (helpers->closed) {
+          return;
+        }
+        ++helpers->running;
+        worker = ++helpers->started;
+      }
+      (*helpers->run)(worker);
+      {
+        const std::lock_guard<std::mutex> lock(helpers->mutex);
+        --helpers->running;
+      }
+      helpers->done.notify_all();
+    });
+  }
+  Executor::Instance().Submit(workers - 1, std::move(tasks));
+  run(0);
+  // Helpers not yet started are no longer needed. Wait for the others.
+  std::unique_lock<std::mutex> lock(helpers->mutex);
+  helpers->closed = true;
+  helpers->done.wait(lock, [&] { return helpers->running == 0; });
+}
+
+}  // namespace internal
+
+}  // namespace stg
@@ -0,0 +1,135 @@
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+// -*- mode: C++ -*-
+//
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License v2.0 with LLVM Exceptions (the
+// "License"); you may not use this file except in compliance with the
+// License.  You may obtain a copy of the License at
+//
+//     https://llvm.org/LICENSE.txt
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef STG_PARALLEL_H_
+#define STG_PARALLEL_H_
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <ctime>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include "metrics.h"
+
+namespace stg {
+
+namespace internal {
+
+// Calls run(worker) for each worker in [0, workers): worker 0 on the calling
+// thread and the others on threads of a process-wide work-stealing pool, as and
+// when they become free. Returns once run(0) and any other calls that started
+// have returned; calls that have not started by then are skipped. Nested calls
+// are safe: the caller never waits for a helper that has not started.
+void RunWorkers(size_t workers, const std::function<void(size_t)>& run);
+
+inline uint64_t MonotonicNanos() {
+  struct timespec time;
+  clock_gettime(CLOCK_MONOTONIC, &time);
+  return time.tv_sec * 1'000'000'000ULL + time.tv_nsec;
+}
+
+}  // namespace internal
+
+// Calls work(worker, index) for every index in [0, count), spreading the calls
+// over at most jobs workers. Worker 0 is the calling thread and the others are
+// borrowed from a pool of threads shared by all parallel work. Each worker
+// number is used by only one thread, so it can be used to index per-worker
+// state.
+//
+// Indexes are handed out in increasing order, but may complete in any order.
+// If any call throws, no further indexes are handed out and the first
+// exception is rethrown once all workers have finished.
+//
+// If utilisation is given, the time each worker spends working is recorded.
+template <typename Work>
+void ForEachIndex(size_t jobs, size_t count, Work&& work,
+                  Workers* utilisation = nullptr) {
+  const size_t workers = std::max<size_t>(1, std::min(jobs, count));
+  if (workers == 1) {
+    const uint64_t start = utilisation ? internal::MonotonicNanos() : 0;
+    for (size_t index = 0; index < count; ++index) {
+      work(size_t{0}, index);
+    }
+    if (utilisation) {
+      utilisation->Busy(0, internal::MonotonicNanos() - start);
+    }
+    return;
+  }
+
+  std::atomic<size_t> next = 0;
+  std::mutex mutex;
+  std::exception_ptr exception;
+  const std::function<void(size_t)> run = [&](size_t worker) {
+    const uint64_t start = utilisation ? internal::MonotonicNanos() : 0;
+    try {
+      while (true) {
+        const size_t index = next++;
+        if (index >= count) {
+          break;
+        }
+        work(worker, index);
+      }
+    } catch (...) {
+      // stop handing out work
+      next = count;
+      const std::lock_guard<std::mutex> lock(mutex);
+      if (!exception) {
+        exception = std::current_exception();
+      }
+    }
+    if (utilisation) {
+      utilisation->Busy(worker, internal::MonotonicNanos() - start);
+    }
+  };
+
+  internal::RunWorkers(workers, run);
+  if (exception) {
+    std::rethrow_exception(exception);
+  }
+}
+
+// Calls produce(index) for every index in [0, count), spread over at most jobs
+// workers as with ForEachIndex, and passes the results to consume in index
+// order, so that what is consumed does not depend on the number of jobs.
+// Results are produced in batches of batch_per_job per job, so only a bounded
+// number are held at once.
+template <typename Result, typename Produce, typename Consume>
+void ForEachIndexInOrder(size_t jobs, size_t count, size_t batch_per_job,
+                         Produce&& produce, Consume&& consume,
+                         Workers* utilisation = nullptr) {
+  const size_t batch = std::max<size_t>(1, jobs * batch_per_job);
+  std::vector<Result> results;
+  for (size_t start = 0; start < count; start += batch) {
+    results.clear();
+    results.resize(std::min(batch, count - start));
+    ForEachIndex(jobs, results.size(), [&](size_t, size_t index) {
+      results[index] = produce(start + index);
+    }, utilisation);
+    for (auto& result : results) {
+      consume(std::move(result));
+    }
+  }
+}
+
+}  // namespace stg
+
+#endif  // STG_PARALLEL_H_
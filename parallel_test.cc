@@ -0,0 +1,105 @@
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+// -*- mode: C++ -*-
+//
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License v2.0 with LLVM Exceptions (the
+// "License"); you may not use this file except in compliance with the
+// License.  You may obtain a copy of the License at
+//
+//     https://llvm.org/LICENSE.txt
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "parallel.h"
+
+#include <atomic>
+#include <cstddef>
+#include <stdexcept>
+#include <string>
+#include <variant>
+#include <vector>
+
+#include <catch2/catch.hpp>
+#include "metrics.h"
+
+namespace Test {
+
+TEST_CASE("every index once") {
+  const size_t jobs = GENERATE(1, 2, 8);
+  const size_t count = GENERATE(0, 1, 5, 1000);
+  std::vector<std::atomic<size_t>> seen(count);
+  std::atomic<bool> bad_worker = false;
+  stg::ForEachIndex(jobs, count, [&](size_t worker, size_t index) {
+    if (worker >= jobs) {
+      bad_worker = true;
+    }
+    ++seen[index];
+  });
+  CHECK(!bad_worker);
+  for (const auto& times : seen) {
+    CHECK(times == 1);
+  }
+}
+
+TEST_CASE("nested") {
+  const size_t outer = 8;
+  const size_t inner = 100;
+  std::vector<std::atomic<size_t>> seen(outer * inner);
+  stg::ForEachIndex(4, outer, [&](size_t, size_t index) {
+    stg::ForEachIndex(4, inner, [&](size_t, size_t nested) {
+      ++seen[index * inner + nested];
+    });
+  });
+  for (const auto& times : seen) {
+    CHECK(times == 1);
+  }
+}
+
+TEST_CASE("exception") {
+  const size_t jobs = GENERATE(1, 4);
+  CHECK_THROWS_AS(
+      stg::ForEachIndex(jobs, 100, [](size_t, size_t index) {
+        if (index == 42) {
+          throw std::runtime_error("42");
+        }
+      }),
+      std::runtime_error);
+  // the pool is still usable
+  std::atomic<size_t> count = 0;
+  stg::ForEachIndex(jobs, 100, [&](size_t, size_t) { ++count; });
+  CHECK(count == 100);
+}
+
+TEST_CASE("in order") {
+  const size_t jobs = GENERATE(1, 3, 8);
+  const size_t count = GENERATE(0, 7, 1000);
+  std::vector<size_t> consumed;
+  stg::ForEachIndexInOrder<std::string>(
+      jobs, count, 2, [](size_t index) { return std::to_string(index); },
+      [&](std::string result) { consumed.push_back(std::stoul(result)); });
+  REQUIRE(consumed.size() == count);
+  for (size_t index = 0; index < count; ++index) {
+    CHECK(consumed[index] == index);
+  }
+}
+
+TEST_CASE("utilisation") {
+  const size_t jobs = GENERATE(1, 4);
+  stg::Metrics metrics;
+  {
+    stg::Workers utilisation(metrics, "workers");
+    stg::ForEachIndex(jobs, 1000, [](size_t, size_t) {}, &utilisation);
+  }
+  REQUIRE(metrics.size() == 1);
+  const auto* usage = std::get_if<stg::WorkerUsage>(&metrics[0].value);
+  REQUIRE(usage != nullptr);
+  CHECK(usage->workers >= 1);
+  CHECK(usage->workers <= jobs);
+}
+
+}  // namespace Test
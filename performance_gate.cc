@@ -0,0 +1,182 @@
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+// -*- mode: C++ -*-
+//
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License v2.0 with LLVM Exceptions (the
+// "License"); you may not use this file except in compliance with the
+// License.  You may obtain a copy of the License at
+//
+//     https://llvm.org/LICENSE.txt
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "performance_gate.h"
+
+#include <algorithm>
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <map>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <variant>
+
+#include "error.h"
+#include "metrics.h"
+
+namespace stg {
+
+namespace {
+
+constexpr std::string_view kCounter = "counter";
+constexpr std::string_view kTime = "time";
+
+struct Add {
+  void operator()(size_t value) const {
+    measurements.counters[key] += value;
+  }
+
+  void operator()(const Nanoseconds& value) const {
+    measurements.times[key] += value.ns;
+  }
+
+  void operator()(const Durations& value) const {
+    measurements.times[key] += value.total.ns;
+  }
+
+  template <typename Value>
+  void operator()(const Value&) const {}
+
+  const std::string& key;
+  Measurements& measurements;
+};
+
+// Compares the values of one kind, writing a line per difference of note and
+// returning the number of regressions.
+size_t Compare(std::string_view kind,
+               const std::map<std::string, uint64_t>& baseline,
+               const std::map<std::string, uint64_t>& current, double percent,
+               uint64_t minimum, const Filter* keys, std::ostream& os) {
+  size_t regressions = 0;
+  for (const auto& [key, value] : baseline) {
+    if (!current.contains(key)) {
+      os << "missing " << kind << ": " << key << '\n';
+    }
+  }
+  for (const auto& [key, value] : current) {
+    const auto it = baseline.find(key);
+    if (it == baseline.end()) {
+      os << "new " << kind << ": " << key << '\n';
+      continue;
+    }
+    if (keys != nullptr && !(*keys)(key)) {
+      continue;
+    }
+    const auto old_value = std::max(it->second, minimum);
+    const auto new_value = std::max(value, minimum);
+    const auto limit = static_cast<double>(old_value) * (1.0 + percent / 100);
+    const auto floor = static_cast<double>(old_value) * (1.0 - percent / 100);
+    const char* verdict;
+    if (static_cast<double>(new_value) > limit) {
+      verdict = "regressed ";
+      ++regressions;
+    } else if (static_cast<double>(new_value) < floor) {
+      verdict = "improved ";
+    } else {
+      continue;
+    }
+    os << verdict << kind << ": " << key << ": " << it->second << " -> "
+       << value;
+    if (it->second != 0) {
+      const auto change = 100.0 * (static_cast<double>(value)
+                                   - static_cast<double>(it->second))
+                          / static_cast<double>(it->second);
+      os << " (" << (change > 0 ? "+" : "") << change << "%)";
+    }
+    os << '\n';
+  }
+  return regressions;
+}
+
+}  // namespace
+
+void Measure(const std::string& run, const Metrics& metrics,
+             Measurements& measurements) {
+  for (const auto& metric : metrics) {
+    const std::string key = run + '/' + metric.name;
+    std::visit(Add{key, measurements}, metric.value);
+  }
+}
+
+void WriteMeasurements(const Measurements& measurements, std::ostream& os) {
+  for (const auto& [key, value] : measurements.counters) {
+    os << kCounter << ' ' << value << ' ' << key << '\n';
+  }
+  for (const auto& [key, value] : measurements.times) {
+    os << kTime << ' ' << value << ' ' << key << '\n';
+  }
+}
+
+Measurements ReadMeasurements(std::istream& is) {
+  Measurements measurements;
+  std::string line;
+  size_t number = 0;
+  while (std::getline(is, line)) {
+    ++number;
+    const std::string_view view = line;
+    const auto kind_end = view.find(' ');
+    const auto value_end = kind_end == std::string_view::npos
+                           ? std::string_view::npos
+                           : view.find(' ', kind_end + 1);
+    if (value_end == std::string_view::npos || value_end + 1 == view.size()) {
+      Die() << "baseline line " << number << ": expected <kind> <value> <key>";
+    }
+    const auto kind = view.substr(0, kind_end);
+    const auto* value_begin = view.data() + kind_end + 1;
+    const auto* value_end_ptr = view.data() + value_end;
+    uint64_t value;
+    const auto [ptr, ec] = std::from_chars(value_begin, value_end_ptr, value);
+    if (ec != std::errc() || ptr != value_end_ptr) {
+      Die() << "baseline line " << number << ": bad value";
+    }
+    const std::string key(view.substr(value_end + 1));
+    std::map<std::string, uint64_t>* values;
+    if (kind == kCounter) {
+      values = &measurements.counters;
+    } else if (kind == kTime) {
+      values = &measurements.times;
+    } else {
+      Die() << "baseline line " << number << ": unknown kind '" << kind
+            << "'";
+    }
+    if (!values->emplace(key, value).second) {
+      Die() << "baseline line " << number << ": duplicate key '" << key
+            << "'";
+    }
+  }
+  return measurements;
+}
+
+size_t CompareMeasurements(const Measurements& baseline,
+                           const Measurements& current,
+                           const Thresholds& thresholds, std::ostream& os) {
+  size_t regressions =
+      Compare(kCounter, baseline.counters, current.counters,
+              thresholds.counter_percent, 0, thresholds.keys, os);
+  if (thresholds.time_percent) {
+    regressions += Compare(kTime, baseline.times, current.times,
+                           *thresholds.time_percent, thresholds.minimum_time,
+                           thresholds.keys, os);
+  }
+  return regressions;
+}
+
+}  // namespace stg
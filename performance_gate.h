@@ -0,0 +1,71 @@
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+// -*- mode: C++ -*-
+//
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License v2.0 with LLVM Exceptions (the
+// "License"); you may not use this file except in compliance with the
+// License.  You may obtain a copy of the License at
+//
+//     https://llvm.org/LICENSE.txt
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef STG_PERFORMANCE_GATE_H_
+#define STG_PERFORMANCE_GATE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <map>
+#include <optional>
+#include <ostream>
+#include <string>
+
+#include "filter.h"
+#include "metrics.h"
+
+namespace stg {
+
+// Counters and times recorded by a set of runs, keyed by "<run>/<metric>".
+// Repeated metrics within a run are summed. Times are in nanoseconds.
+struct Measurements {
+  std::map<std::string, uint64_t> counters;
+  std::map<std::string, uint64_t> times;
+};
+
+// Adds the counters and times of one run. Histograms and memory usage are not
+// measured, the latter being process-wide and too noisy to gate on.
+void Measure(const std::string& run, const Metrics& metrics,
+             Measurements& measurements);
+
+// The baseline format is one line per measurement: the kind ("counter" or
+// "time"), the value and the key, separated by single spaces. The key is the
+// rest of the line, as metric names may contain spaces.
+void WriteMeasurements(const Measurements& measurements, std::ostream& os);
+Measurements ReadMeasurements(std::istream& is);
+
+// Counters are deterministic and any increase beyond the threshold is a
+// regression. Times are only gated if there is a time threshold and small
+// times are first rounded up to the minimum time, to avoid gating on noise.
+// Only keys matching the filter, if any, are gated.
+struct Thresholds {
+  double counter_percent = 0.0;
+  std::optional<double> time_percent;
+  uint64_t minimum_time = 1'000'000;
+  const Filter* keys = nullptr;
+};
+
+// Writes one line per regression, improvement and key present in only one of
+// the measurements. Returns the number of regressions.
+size_t CompareMeasurements(const Measurements& baseline,
+                           const Measurements& current,
+                           const Thresholds& thresholds, std::ostream& os);
+
+}  // namespace stg
+
+#endif  // STG_PERFORMANCE_GATE_H_
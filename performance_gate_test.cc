@@ -0,0 +1,127 @@
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+// -*- mode: C++ -*-
+//
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License v2.0 with LLVM Exceptions (the
+// "License"); you may not use this file except in compliance with the
+// License.  You may obtain a copy of the License at
+//
+//     https://llvm.org/LICENSE.txt
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "performance_gate.h"
+
+#include <cstddef>
+#include <map>
+#include <sstream>
+#include <string>
+
+#include <catch2/catch.hpp>
+#include "filter.h"
+#include "metrics.h"
+
+namespace Test {
+
+TEST_CASE("measure") {
+  stg::Metrics metrics;
+  {
+    const stg::Time time(metrics, "time");
+    stg::Counter counter(metrics, "counter");
+    counter = 2;
+  }
+  {
+    stg::Counter counter(metrics, "counter");
+    counter = 3;
+    stg::Histogram histogram(metrics, "histogram");
+    histogram.Add(1);
+  }
+  stg::Measurements measurements;
+  stg::Measure("run", metrics, measurements);
+  CHECK(measurements.counters == std::map<std::string, uint64_t>{
+                                     {"run/counter", 5}});
+  CHECK(measurements.times.size() == 1);
+  CHECK(measurements.times.contains("run/time"));
+}
+
+TEST_CASE("round trip") {
+  const stg::Measurements measurements{
+      {{"run/a counter", 0}, {"run/b", 12}},
+      {{"other run/time taken", 345}}};
+  std::ostringstream os;
+  stg::WriteMeasurements(measurements, os);
+  CHECK(os.str() == "counter 0 run/a counter\n"
+                    "counter 12 run/b\n"
+                    "time 345 other run/time taken\n");
+  std::istringstream is(os.str());
+  const auto read = stg::ReadMeasurements(is);
+  CHECK(read.counters == measurements.counters);
+  CHECK(read.times == measurements.times);
+}
+
+TEST_CASE("bad baselines") {
+  for (const std::string baseline : {
+           "counter\n",
+           "counter 1\n",
+           "counter 1 \n",
+           "counter x key\n",
+           "counter -1 key\n",
+           "size 1 key\n",
+           "counter 1 key\ncounter 2 key\n",
+       }) {
+    GIVEN("baseline: " + baseline) {
+      std::istringstream is(baseline);
+      CHECK_THROWS(stg::ReadMeasurements(is));
+    }
+  }
+}
+
+TEST_CASE("compare") {
+  const stg::Measurements baseline{
+      {{"a", 100}, {"b", 100}, {"c", 100}, {"gone", 1}},
+      {{"fast", 1000}, {"slow", 1'000'000'000}}};
+  const stg::Measurements current{
+      {{"a", 100}, {"b", 105}, {"c", 90}, {"new", 1}},
+      {{"fast", 5000}, {"slow", 2'000'000'000}}};
+
+  GIVEN("exact counters") {
+    std::ostringstream os;
+    CHECK(stg::CompareMeasurements(baseline, current, {}, os) == 1);
+    CHECK(os.str() == "missing counter: gone\n"
+                      "regressed counter: b: 100 -> 105 (+5%)\n"
+                      "improved counter: c: 100 -> 90 (-10%)\n"
+                      "new counter: new\n");
+  }
+
+  GIVEN("a counter threshold") {
+    std::ostringstream os;
+    stg::Thresholds thresholds;
+    thresholds.counter_percent = 10;
+    CHECK(stg::CompareMeasurements(baseline, current, thresholds, os) == 0);
+  }
+
+  GIVEN("a time threshold") {
+    std::ostringstream os;
+    stg::Thresholds thresholds;
+    thresholds.counter_percent = 10;
+    thresholds.time_percent = 50;
+    CHECK(stg::CompareMeasurements(baseline, current, thresholds, os) == 1);
+    CHECK(os.str().find("regressed time: slow") != std::string::npos);
+    CHECK(os.str().find("fast") == std::string::npos);
+  }
+
+  GIVEN("a key filter") {
+    std::ostringstream os;
+    const auto keys = stg::MakeFilter("!b");
+    stg::Thresholds thresholds;
+    thresholds.keys = keys.get();
+    CHECK(stg::CompareMeasurements(baseline, current, thresholds, os) == 0);
+  }
+}
+
+}  // namespace Test
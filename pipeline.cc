@@ -0,0 +1,758 @@
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+// -*- mode: C++ -*-
+//
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License v2.0 with LLVM Exceptions (the
+// "License"); you may not use this file except in compliance with the
+// License.  You may obtain a copy of the License at
+//
+//     https://llvm.org/LICENSE.txt
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "pipeline.h"
+
+#include <fcntl.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <filesystem>
+#include <functional>
+#include <ios>
+#include <iterator>
+#include <memory>
+#include <optional>
+#include <ostream>
+#include <span>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#include "async_output.h"
+#include "btf_writer.h"
+#include "comparison.h"
+#include "deduplication.h"
+#include "digest.h"
+#include "edge_list.h"
+#include "error.h"
+#include "fidelity.h"
+#include "file_descriptor.h"
+#include "filter.h"
+#include "fingerprint.h"
+#include "flat_map.h"
+#include "graph.h"
+#include "hashing.h"
+#include "input.h"
+#include "metrics.h"
+#include "node_hashes.h"
+#include "parallel.h"
+#include "proto_index.h"
+#include "proto_writer.h"
+#include "reporting.h"
+#include "stable_hash.h"
+#include "substitution.h"
+#include "type_resolution.h"
+#include "unification.h"
+
+namespace stg {
+
+namespace {
+
+struct GetInterface {
+  Interface& operator()(Interface& x) const {
+    return x;
+  }
+
+  template <typename Node>
+  Interface& operator()(Node&) const {
+    Die() << "expected an Interface root node";
+  }
+};
+
+const size_t kMaxCrcOnlyChanges = 3;
+
+// Removes the nodes not reachable from the root, which may include orphans
+// still referring to removed duplicates. Returns how many were removed.
+size_t RemoveUnreachableNodes(Graph& graph, Id root) {
+  std::vector<bool> reachable(graph.Limit().ix_);
+  std::vector<Id> todo;
+  const auto visit = [&](Id& id) {
+    if (!reachable[id.ix_]) {
+      reachable[id.ix_] = true;
+      todo.push_back(id);
+    }
+  };
+  Substitute substitute(graph, visit);
+  Id start = root;
+  visit(start);
+  while (!todo.empty()) {
+    const Id id = todo.back();
+    todo.pop_back();
+    substitute(id);
+  }
+  size_t removed = 0;
+  graph.ForEach(Id(0), graph.Limit(), [&](Id id) {
+    if (!reachable[id.ix_]) {
+      graph.Remove(id);
+      ++removed;
+    }
+  });
+  return removed;
+}
+
+// Removes the nodes not reachable from the root, then compacts the graph.
+// Returns the new root.
+Id CompactReachable(Graph& graph, Id root) {
+  RemoveUnreachableNodes(graph, root);
+  return graph.Compact()[root.ix_];
+}
+
+// Lists the nodes reachable from the root in the order a depth-first traversal
+// reaches them, except that the children of each node are listed together, in
+// the order they are referred to, as soon as it is visited.
+std::vector<Id> TraversalOrder(Graph& graph, Id root) {
+  std::vector<bool> seen(graph.Limit().ix_);
+  std::vector<Id> order;
+  std::vector<Id> todo;
+  const auto visit = [&](Id& id) {
+    if (!seen[id.ix_]) {
+      seen[id.ix_] = true;
+      order.push_back(id);
+      todo.push_back(id);
+    }
+  };
+  Substitute substitute(graph, visit);
+  Id start = root;
+  visit(start);
+  while (!todo.empty()) {
+    const Id id = todo.back();
+    todo.pop_back();
+    const size_t size = todo.size();
+    substitute(id);
+    // the first child is visited next
+    std::reverse(todo.begin() + size, todo.end());
+  }
+  return order;
+}
+
+// Rekeys a cache of node hashes after compaction, dropping removed nodes.
+template <typename Cache>
+void Remap(const std::vector<Id>& mapping, Cache& cache) {
+  Cache compacted;
+  for (const auto& [id, hash] : cache) {
+    const Id replacement = mapping[id.ix_];
+    if (replacement != Id::kInvalid) {
+      compacted.emplace(replacement, hash);
+    }
+  }
+  cache = std::move(compacted);
+}
+
+void Remap(const std::vector<Id>& mapping, NodeHashes& hashes) {
+  NodeHashes compacted;
+  for (const auto& [id, hash] : hashes) {
+    const Id replacement = mapping[id.ix_];
+    if (replacement != Id::kInvalid) {
+      compacted.Insert(replacement, hash);
+    }
+  }
+  hashes = std::move(compacted);
+}
+
+SeparateInput ReadInput(InputFormat format, const char* filename,
+                        ReadOptions options, Metrics& metrics) {
+  SeparateInput input;
+  input.root = Read(input.graph, format, filename, options, nullptr, metrics);
+  return input;
+}
+
+// Merges sorted maps in a single pass, keeping the first item of each key, in
+// map order. Each later item with the same key is passed to duplicate, along
+// with the item kept. The keys are moved out of the maps.
+template <typename Duplicate>
+FlatMap<std::string, Id> MergeSorted(
+    const std::vector<FlatMap<std::string, Id>*>& maps,
+    const Duplicate& duplicate) {
+  using Iterator = FlatMap<std::string, Id>::iterator;
+  struct Cursor {
+    Iterator it;
+    Iterator end;
+    size_t index;
+  };
+  // a min-heap on key, then map index
+  const auto after = [](const Cursor& a, const Cursor& b) {
+    const int order = a.it->first.compare(b.it->first);
+    return order != 0 ? order > 0 : a.index > b.index;
+  };
+  std::vector<Cursor> heap;
+  size_t total = 0;
+  for (size_t index = 0; index < maps.size(); ++index) {
+    auto& map = *maps[index];
+    total += map.size();
+    if (!map.empty()) {
+      heap.push_back({map.begin(), map.end(), index});
+    }
+  }
+  std::make_heap(heap.begin(), heap.end(), after);
+  std::vector<std::pair<std::string, Id>> merged;
+  merged.reserve(total);
+  while (!heap.empty()) {
+    std::pop_heap(heap.begin(), heap.end(), after);
+    auto& cursor = heap.back();
+    auto& item = *cursor.it;
+    if (!merged.empty() && merged.back().first == item.first) {
+      duplicate(item, merged.back());
+    } else {
+      merged.emplace_back(std::move(item.first), item.second);
+    }
+    if (++cursor.it == cursor.end) {
+      heap.pop_back();
+    } else {
+      std::push_heap(heap.begin(), heap.end(), after);
+    }
+  }
+  // already sorted and unique
+  return FlatMap<std::string, Id>(std::move(merged));
+}
+
+}  // namespace
+
+Id Merge(Graph& graph, const std::vector<Id>& roots, Metrics& metrics,
+         size_t jobs) {
+  bool failed = false;
+  // this rewrites the graph on destruction
+  Unification unification(graph, Id(0), metrics, jobs);
+  unification.Reserve(graph.Limit());
+  std::vector<FlatMap<std::string, Id>*> symbol_maps;
+  std::vector<FlatMap<std::string, Id>*> type_maps;
+  const GetInterface get;
+  for (auto root : roots) {
+    auto& interface = graph.Apply<Interface&>(get, root);
+    symbol_maps.push_back(&interface.symbols);
+    type_maps.push_back(&interface.types);
+  }
+  auto symbols = MergeSorted(symbol_maps, [&](const auto& x, const auto&) {
+    Warn() << "duplicate symbol during merge: " << x.first;
+    failed = true;
+  });
+  // TODO: test type roots merge
+  auto types = MergeSorted(type_maps, [&](const auto& x, const auto& kept) {
+    if (!unification.Unify(x.second, kept.second)) {
+      Warn() << "type conflict during merge: " << x.first;
+      failed = true;
+    }
+  });
+  for (auto root : roots) {
+    graph.Remove(root);
+  }
+  if (failed) {
+    Die() << "merge failed";
+  }
+  return graph.Add<Interface>(std::move(symbols), std::move(types));
+}
+
+Id Merge(Graph& graph, std::vector<SeparateInput>& inputs, Metrics& metrics,
+         size_t jobs) {
+  Check(!inputs.empty()) << "nothing to merge";
+  Time merge(metrics, "merge tree");
+  while (inputs.size() > 1) {
+    const size_t pairs = inputs.size() / 2;
+    const size_t pair_jobs = std::max<size_t>(1, jobs / pairs);
+    Workers utilisation(metrics, "merge tree workers");
+    ForEachIndex(jobs, pairs, [&](size_t, size_t index) {
+      auto& left = inputs[2 * index];
+      auto& right = inputs[2 * index + 1];
+      const Id moved = Move(right.graph, *right.root, left.graph);
+      // release memory early
+      right.graph = Graph();
+      std::move(right.metrics.begin(), right.metrics.end(),
+                std::back_inserter(left.metrics));
+      auto& part = left.graph;
+      auto& part_metrics = left.metrics;
+      const Id root = Merge(part, {*left.root, moved}, part_metrics, pair_jobs);
+      const auto hashes = Fingerprint(part, root, part_metrics, pair_jobs);
+      const Id deduplicated =
+          Deduplicate(part, root, hashes, part_metrics, pair_jobs);
+      left.root = CompactReachable(part, deduplicated);
+    }, &utilisation);
+    // keep the merged inputs and any odd one out
+    for (size_t index = 1; index < inputs.size(); ++index) {
+      if (index % 2 == 0) {
+        inputs[index / 2] = std::move(inputs[index]);
+      }
+    }
+    inputs.resize((inputs.size() + 1) / 2);
+  }
+  auto& last = inputs.front();
+  std::move(last.metrics.begin(), last.metrics.end(),
+            std::back_inserter(metrics));
+  const Id root = Move(last.graph, *last.root, graph);
+  inputs.clear();
+  return root;
+}
+
+Id RemoveUnreachable(Graph& graph, Id root, StableHashCache& stable_hashes,
+                     Metrics& metrics) {
+  {
+    Time collect(metrics, "remove unreachable");
+    Counter(metrics, "unreachable.removed") =
+        RemoveUnreachableNodes(graph, root);
+  }
+  return Compact(graph, root, stable_hashes, metrics);
+}
+
+Id ResolveAndDeduplicate(Graph& graph, Id root, bool refine,
+                         StableHashCache& stable_hashes, Metrics& metrics,
+                         size_t jobs) {
+  FingerprintCache fingerprints;
+  return ResolveAndDeduplicate(graph, root, refine, stable_hashes,
+                               fingerprints, metrics, jobs);
+}
+
+Id ResolveAndDeduplicate(Graph& graph, Id root, bool refine,
+                         StableHashCache& stable_hashes,
+                         FingerprintCache& fingerprints, Metrics& metrics,
+                         size_t jobs) {
+  {
+    Unification unification(graph, Id(0), metrics, jobs);
+    unification.Reserve(graph.Limit());
+    ResolveTypes(graph, unification, {root}, metrics, jobs);
+    unification.Update(root);
+    if (unification.Unified()) {
+      stable_hashes.clear();
+      fingerprints.Clear();
+    }
+  }
+  if (refine) {
+    fingerprints.Clear();
+    root = DeduplicateByRefinement(graph, root, metrics);
+  } else {
+    Fingerprint(graph, root, metrics, jobs, fingerprints);
+    root = Deduplicate(graph, root, fingerprints, metrics, jobs);
+    // deduplication only substitutes equal nodes, so the remaining
+    // fingerprints stay valid
+    fingerprints.EraseIf([&](Id id, HashValue64) {
+      return !graph.Is(id);
+    });
+  }
+  return Renumber(graph, root, stable_hashes, fingerprints, metrics);
+}
+
+Id Compact(Graph& graph, Id root, StableHashCache& stable_hashes,
+           Metrics& metrics) {
+  FingerprintCache fingerprints;
+  return Compact(graph, root, stable_hashes, fingerprints, metrics);
+}
+
+Id Compact(Graph& graph, Id root, StableHashCache& stable_hashes,
+           FingerprintCache& fingerprints, Metrics& metrics) {
+  Counter live(metrics, "compact.live");
+  Counter removed(metrics, "compact.removed");
+  size_t count = 0;
+  graph.ForEach(Id(0), graph.Limit(), [&](Id) { ++count; });
+  const size_t limit = graph.Limit().ix_;
+  live = count;
+  removed = limit - count;
+  if (4 * (limit - count) < limit) {
+    return root;
+  }
+  Time compact(metrics, "compact");
+  const auto mapping = graph.Compact();
+  Remap(mapping, stable_hashes);
+  Remap(mapping, fingerprints);
+  return mapping[root.ix_];
+}
+
+Id Renumber(Graph& graph, Id root, StableHashCache& stable_hashes,
+            FingerprintCache& fingerprints, Metrics& metrics) {
+  Time renumber(metrics, "renumber");
+  const auto mapping = graph.Renumber(TraversalOrder(graph, root));
+  Remap(mapping, stable_hashes);
+  Remap(mapping, fingerprints);
+  return mapping[root.ix_];
+}
+
+void Write(const Graph& graph, Id root, const char* output,
+           proto::Format format, proto::Compression compression,
+           const StableHashCache& stable_hashes, bool record_stable_hashes,
+           bool canonical, Metrics& metrics, size_t jobs, bool index) {
+  Write(graph, root, {&output, 1}, format, compression, stable_hashes,
+        record_stable_hashes, canonical, metrics, jobs, index);
+}
+
+void Write(const Graph& graph, Id root, std::span<const char* const> outputs,
+           proto::Format format, proto::Compression compression,
+           const StableHashCache& stable_hashes, bool record_stable_hashes,
+           bool canonical, Metrics& metrics, size_t jobs, bool index) {
+  // output is written out by a thread per file while more is produced
+  std::vector<std::unique_ptr<AsyncOutput>> files;
+  std::vector<std::ostream*> streams;
+  for (const auto* output : outputs) {
+    streams.push_back(
+        files.emplace_back(std::make_unique<AsyncOutput>(output)).get());
+  }
+  {
+    Time x(metrics, "write");
+    proto::Writer writer(graph, stable_hashes, jobs);
+    std::ostringstream index_buffer;
+    if (index) {
+      writer.Index(index_buffer);
+    }
+    writer.Write(root, streams, format, record_stable_hashes, compression,
+                 canonical);
+    for (auto& file : files) {
+      file->Close();
+    }
+    if (index) {
+      const std::string bytes = std::move(index_buffer).str();
+      for (const auto* output : outputs) {
+        AsyncOutput os(output + std::string(proto::kIndexSuffix));
+        os.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+        os.Close();
+      }
+    }
+  }
+}
+
+void WriteBtf(const Graph& graph, Id root, const char* output,
+              Metrics& metrics) {
+  Time x(metrics, "write BTF");
+  AsyncOutput os(output);
+  btf::Write(graph, root, os);
+  os.Close();
+}
+
+void WriteEdges(const Graph& graph, Id root, const char* output,
+                Metrics& metrics) {
+  Time x(metrics, "write edges");
+  AsyncOutput os(output);
+  edges::Write(graph, root, os);
+  os.Close();
+}
+
+Checkpoints::Checkpoints(const char* directory, std::vector<Stage> stages)
+    : directory_(directory), stages_(std::move(stages)) {}
+
+void Checkpoints::Write(size_t stage, const Graph& graph, Id root,
+                        const StableHashCache& stable_hashes,
+                        bool record_stable_hashes, bool canonical,
+                        Metrics& metrics, size_t jobs) const {
+  Time x(metrics, "write checkpoint");
+  std::error_code error;
+  std::filesystem::create_directories(directory_, error);
+  if (error) {
+    Die() << "error creating checkpoint directory: '" << directory_.string()
+          << "': " << error.message();
+  }
+  // manifests go first, so that nothing is left that seems complete
+  for (size_t later = stages_.size(); later > stage; --later) {
+    Remove(Path(later - 1, ".manifest"));
+    Remove(Path(later - 1, ".stg"));
+  }
+  const std::string temporary = Path(stage, ".stg").string() + ".tmp";
+  stg::Write(graph, root, temporary.c_str(), proto::Format::BINARY,
+             proto::Compression::NONE, stable_hashes, record_stable_hashes,
+             canonical, metrics, jobs);
+  Rename(temporary, Path(stage, ".stg"));
+  const std::string manifest = Path(stage, ".manifest").string() + ".tmp";
+  AsyncOutput os(manifest);
+  os << stages_[stage].description;
+  os.Close();
+  Rename(manifest, Path(stage, ".manifest"));
+}
+
+std::optional<std::string> Checkpoints::Latest() const {
+  bool mismatch = false;
+  for (size_t stage = stages_.size(); stage > 0; --stage) {
+    const auto manifest = Path(stage - 1, ".manifest");
+    const auto path = Path(stage - 1, ".stg");
+    std::error_code error;
+    if (!std::filesystem::exists(manifest, error)
+        || !std::filesystem::exists(path, error)) {
+      continue;
+    }
+    const FileDescriptor fd(manifest.c_str(), O_RDONLY);
+    if (ReadContents(fd) == stages_[stage - 1].description) {
+      return {path.string()};
+    }
+    mismatch = true;
+  }
+  if (mismatch) {
+    Die() << "checkpoints in '" << directory_.string()
+          << "' were taken with other inputs or options";
+  }
+  return {};
+}
+
+std::filesystem::path Checkpoints::Path(size_t stage,
+                                        std::string_view suffix) const {
+  return directory_ / (stages_[stage].name + std::string(suffix));
+}
+
+void Checkpoints::Remove(const std::filesystem::path& path) const {
+  std::error_code error;
+  std::filesystem::remove(path, error);
+  if (error) {
+    Die() << "error removing checkpoint file: '" << path.string() << "': "
+          << error.message();
+  }
+}
+
+void Checkpoints::Rename(const std::string& from,
+                         const std::filesystem::path& to) const {
+  std::error_code error;
+  std::filesystem::rename(from, to, error);
+  if (error) {
+    Die() << "error renaming checkpoint file: '" << from << "': "
+          << error.message();
+  }
+}
+
+Differ::Differ(InputFormat format, const char* filename, Ignore ignore,
+               ReadOptions options, const Filter* symbol_filter,
+               bool fail_fast, std::optional<const char*> cache_directory,
+               DiffDeduplication deduplication, size_t max_viz_bytes,
+               size_t max_diff_bytes, Metrics& metrics)
+    : Differ(ReadInput(format, filename, options, metrics), ignore, options,
+             symbol_filter, fail_fast, cache_directory, deduplication,
+             max_viz_bytes, max_diff_bytes, metrics) {}
+
+Differ::Differ(SeparateInput&& baseline, Ignore ignore, ReadOptions options,
+               const Filter* symbol_filter, bool fail_fast,
+               std::optional<const char*> cache_directory,
+               DiffDeduplication deduplication, size_t max_viz_bytes,
+               size_t max_diff_bytes, Metrics& metrics)
+    : ignore_(ignore),
+      options_(options),
+      symbol_filter_(symbol_filter),
+      fail_fast_(fail_fast),
+      // Node hashes let identical parts of the graphs be skipped. They cover
+      // entire graphs and are not worth it when only comparing a few symbols.
+      use_hashes_(symbol_filter == nullptr),
+      deduplication_(deduplication),
+      max_viz_bytes_(max_viz_bytes),
+      max_diff_bytes_(max_diff_bytes),
+      graph_(std::move(baseline.graph)),
+      baseline_(*baseline.root) {
+  std::move(baseline.metrics.begin(), baseline.metrics.end(),
+            std::back_inserter(metrics));
+  baseline.metrics.clear();
+  if (deduplication_ == DiffDeduplication::NONE) {
+    AddHashes(baseline_, metrics);
+  } else {
+    baseline_ = Canonicalise(Id(0), baseline_, metrics);
+  }
+  // Every candidate is compared with the baseline, so its nodes are laid out
+  // in traversal order first.
+  {
+    Time renumber(metrics, "renumber baseline");
+    const auto mapping = graph_.Renumber(TraversalOrder(graph_, baseline_));
+    Remap(mapping, hashes_);
+    baseline_ = mapping[baseline_.ix_];
+  }
+  // Results from earlier runs are keyed on node digests.
+  if (cache_directory) {
+    cache_.emplace(*cache_directory, ignore.bitset, metrics);
+  }
+  AddDigests(baseline_, metrics);
+}
+
+bool Differ::Diff(InputFormat format, const char* filename,
+                  const Reports& outputs,
+                  std::optional<FidelityDiff>* fidelity, Metrics& metrics) {
+  return Diff([&]() {
+    return Read(graph_, format, filename, options_, nullptr, metrics);
+  }, outputs, fidelity, metrics);
+}
+
+bool Differ::Diff(SeparateInput&& candidate, const Reports& outputs,
+                  std::optional<FidelityDiff>* fidelity, Metrics& metrics) {
+  std::move(candidate.metrics.begin(), candidate.metrics.end(),
+            std::back_inserter(metrics));
+  candidate.metrics.clear();
+  return Diff([&]() {
+    Time move(metrics, "move candidate");
+    const Id root = Move(candidate.graph, *candidate.root, graph_);
+    // release memory early
+    candidate.graph = Graph();
+    return root;
+  }, outputs, fidelity, metrics);
+}
+
+bool Differ::Diff(const std::function<Id()>& read, const Reports& outputs,
+                  std::optional<FidelityDiff>* fidelity, Metrics& metrics) {
+  const auto start = graph_.Limit();
+  // the baseline is restored afterwards, even if the candidate changed it
+  graph_.Checkpoint();
+  bool status;
+  try {
+    status = DiffCandidate(start, read(), outputs, fidelity, metrics);
+  } catch (...) {
+    Forget(start);
+    throw;
+  }
+  Forget(start);
+  return status;
+}
+
+void Differ::WriteCache(Metrics& metrics) {
+  if (cache_) {
+    const Time write(metrics, "write cache");
+    cache_->Write();
+  }
+}
+
+void Differ::AddHashes(Id root, Metrics& metrics) {
+  if (use_hashes_) {
+    Time fingerprint(metrics, "fingerprint");
+    hashes_.Merge(Fingerprint(graph_, root, metrics, options_.jobs));
+  }
+}
+
+// Resolves and deduplicates an input, whose nodes are those from start onwards,
+// returning its new root. The hashes of its remaining nodes are kept, as they
+// are needed to deduplicate candidates jointly.
+Id Differ::Canonicalise(Id start, Id root, Metrics& metrics) {
+  const Time time(metrics, "deduplicate input");
+  {
+    Unification unification(graph_, start, metrics, options_.jobs);
+    unification.Reserve(graph_.Limit());
+    ResolveTypes(graph_, unification, {root}, metrics, options_.jobs);
+    unification.Update(root);
+  }
+  auto hashes = Fingerprint(graph_, root, metrics, options_.jobs);
+  if (deduplication_ == DiffDeduplication::JOINTLY && start != Id(0)) {
+    hashes_.Merge(hashes);
+    root = DeduplicateAfter(graph_, start, root, hashes_, metrics);
+  } else {
+    root = Deduplicate(graph_, root, hashes, metrics, options_.jobs);
+    hashes_.Merge(hashes);
+  }
+  hashes_.EraseIf([&](Id id, HashValue64) {
+    return id.ix_ >= start.ix_ && !graph_.Is(id);
+  });
+  return root;
+}
+
+void Differ::AddDigests(Id root, Metrics& metrics) {
+  if (cache_) {
+    Time digest(metrics, "digest");
+    digests_.merge(Digest(graph_, root, metrics));
+  }
+}
+
+bool Differ::DiffCandidate(Id start, Id root, const Reports& outputs,
+                           std::optional<FidelityDiff>* fidelity,
+                           Metrics& metrics) {
+  if (deduplication_ == DiffDeduplication::NONE) {
+    AddHashes(root, metrics);
+  } else {
+    root = Canonicalise(start, root, metrics);
+  }
+  AddDigests(root, metrics);
+  // The common ignore options have their own specialisations of Compare.
+  return WithIgnorePolicy(ignore_, [&](auto policy) {
+    return CompareCandidate<decltype(policy)>(root, outputs, fidelity, metrics);
+  });
+}
+
+template <typename IgnorePolicy>
+bool Differ::CompareCandidate(Id root, const Reports& outputs,
+                              std::optional<FidelityDiff>* fidelity,
+                              Metrics& metrics) {
+  // Compute differences.
+  Compare<IgnorePolicy> compare{graph_, ignore_, metrics, options_.jobs};
+  if (use_hashes_) {
+    compare.hashes = &hashes_;
+  }
+  compare.symbol_filter = symbol_filter_;
+  compare.fail_fast = fail_fast_;
+  compare.outcomes.SetBudget(max_diff_bytes_);
+  compare.deadline = deadline_;
+  compare.count_only = count_only_;
+  if (cache_) {
+    compare.cache = &*cache_;
+    compare.digests = &digests_;
+  }
+  std::pair<bool, std::optional<Comparison>> result;
+  {
+    Memory memory(metrics, "compute diffs memory");
+    Time compute(metrics, "compute diffs");
+    result = compare(baseline_, root);
+  }
+  Check(compare.scc.Empty()) << "internal error: SCC state broken";
+  skipped_ = std::move(compare.skipped);
+  completed_ = compare.completed;
+  const auto& [equals, comparison] = result;
+
+  // Write reports.
+  if (count_only_) {
+    for (const auto& [_, output] : outputs) {
+      const Time report(metrics, "report counts");
+      reporting::ChangeCounts(graph_, compare.outcomes, compare.known,
+                              comparison, *output);
+      *output << std::flush;
+    }
+  } else if (comparison) {
+    // the format is chosen per output
+    const reporting::Options report_options{
+        reporting::OutputFormat::PLAIN, kMaxCrcOnlyChanges, options_.jobs,
+        max_viz_bytes_};
+    const reporting::Reporting reporting{graph_, compare.outcomes,
+                                         report_options, names_,
+                                         compare.resolutions};
+    const size_t flat_writes = std::count_if(
+        outputs.begin(), outputs.end(), [](const auto& output) {
+          const auto format = output.first;
+          return format == reporting::OutputFormat::FLAT
+              || format == reporting::OutputFormat::SMALL
+              || format == reporting::OutputFormat::SHORT;
+        });
+    reporting::Reports reports(reporting, *comparison, flat_writes);
+    for (const auto& [format, output] : outputs) {
+      Time report(metrics, "report diffs");
+      reports.Write(format, *output);
+      *output << std::flush;
+    }
+  }
+
+  // Compute fidelity diff if requested.
+  if (fidelity) {
+    const Time report(metrics, "fidelity");
+    if (!baseline_fidelities_) {
+      // the first time, the baseline and candidate are traversed together
+      auto [baseline, candidate] =
+          GetFidelities(graph_, baseline_, root, names_, options_.jobs);
+      baseline_fidelities_.emplace(std::move(baseline));
+      fidelity->emplace(
+          GetFidelityTransitions(*baseline_fidelities_, candidate));
+    } else {
+      fidelity->emplace(GetFidelityTransitions(
+          *baseline_fidelities_, GetFidelities(graph_, root, names_)));
+    }
+  }
+  return !equals;
+}
+
+// Removes the candidate's nodes and everything keyed on them, so that their ids
+// can be reused, and restores any baseline nodes changed.
+void Differ::Forget(Id start) {
+  const auto candidate_node = [&](const auto& item) {
+    return item.first.ix_ >= start.ix_;
+  };
+  hashes_.EraseIf([&](Id id, HashValue64) {
+    return id.ix_ >= start.ix_;
+  });
+  std::erase_if(digests_, candidate_node);
+  std::erase_if(names_, candidate_node);
+  graph_.Rollback();
+}
+}  // namespace stg
@@ -0,0 +1,272 @@
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+// -*- mode: C++ -*-
+//
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License v2.0 with LLVM Exceptions (the
+// "License"); you may not use this file except in compliance with the
+// License.  You may obtain a copy of the License at
+//
+//     https://llvm.org/LICENSE.txt
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef STG_PIPELINE_H_
+#define STG_PIPELINE_H_
+
+#include <chrono>
+#include <cstddef>
+#include <filesystem>
+#include <functional>
+#include <optional>
+#include <ostream>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "comparison.h"
+#include "comparison_cache.h"
+#include "fidelity.h"
+#include "filter.h"
+#include "fingerprint.h"
+#include "graph.h"
+#include "hashing.h"
+#include "input.h"
+#include "metrics.h"
+#include "naming.h"
+#include "node_hashes.h"
+#include "proto_writer.h"
+#include "reader_options.h"
+#include "reporting.h"
+#include "stable_hash.h"
+
+namespace stg {
+
+// The stages of the stg and stgdiff tools, for use by other programs that keep
+// graphs in memory across several operations. Reading is provided by Read, see
+// input.h.
+
+// Merges the interfaces of the given roots into a new one, unifying types with
+// the same name. The old roots are removed.
+Id Merge(Graph& graph, const std::vector<Id>& roots, Metrics& metrics,
+         size_t jobs);
+
+// Merges inputs read into separate graphs, in a tree. Each round merges pairs
+// of inputs concurrently and deduplicates the results, so later rounds work on
+// smaller graphs. The final result is moved into the given graph and its root
+// returned. The inputs are consumed.
+Id Merge(Graph& graph, std::vector<SeparateInput>& inputs, Metrics& metrics,
+         size_t jobs);
+
+// Removes the nodes not reachable from the root, such as those reachable only
+// from symbols dropped by a symbol filter or from the interfaces replaced by
+// Merge, then compacts the graph as below. Returns the new root. The stable
+// hash cache is kept in step.
+Id RemoveUnreachable(Graph& graph, Id root, StableHashCache& stable_hashes,
+                     Metrics& metrics);
+
+// Resolves declarations to definitions, removes duplicate nodes, either by
+// fingerprint or by partition refinement, and renumbers the graph, see
+// Renumber. Returns the new root. The stable hash cache is kept in step, or
+// cleared if resolution unified anything.
+Id ResolveAndDeduplicate(Graph& graph, Id root, bool refine,
+                         StableHashCache& stable_hashes, Metrics& metrics,
+                         size_t jobs);
+
+// As above, but fingerprints are taken from and kept in the given cache, so
+// that deduplicating again after a small change to the graph, such as a merge,
+// only hashes the nodes affected by it, see InvalidateFingerprints. The cache
+// is cleared if resolution unified anything or refinement is used.
+Id ResolveAndDeduplicate(Graph& graph, Id root, bool refine,
+                         StableHashCache& stable_hashes,
+                         FingerprintCache& fingerprints, Metrics& metrics,
+                         size_t jobs);
+
+// Compacts the graph, if at least a quarter of its node ids are no longer in
+// use, returning the new root. The stable hash cache is kept in step.
+Id Compact(Graph& graph, Id root, StableHashCache& stable_hashes,
+           Metrics& metrics);
+
+// As above, also keeping the fingerprint cache in step.
+Id Compact(Graph& graph, Id root, StableHashCache& stable_hashes,
+           FingerprintCache& fingerprints, Metrics& metrics);
+
+// Renumbers and compacts the graph so that the nodes reachable from the root
+// come first, in depth-first order with the children of each node together,
+// returning the new root. Later traversals then find related nodes close by.
+// The caches are kept in step.
+Id Renumber(Graph& graph, Id root, StableHashCache& stable_hashes,
+            FingerprintCache& fingerprints, Metrics& metrics);
+
+// Writes the graph from the root to the named file, in STG format. The output
+// is marked canonical if the graph has been through ResolveAndDeduplicate. If
+// index is set, an index is also written, see proto_index.h.
+void Write(const Graph& graph, Id root, const char* output,
+           proto::Format format, proto::Compression compression,
+           const StableHashCache& stable_hashes, bool record_stable_hashes,
+           bool canonical, Metrics& metrics, size_t jobs, bool index = false);
+
+// As above, but to each of several named files. The output is produced only
+// once, so that further files cost little more than the copying.
+void Write(const Graph& graph, Id root, std::span<const char* const> outputs,
+           proto::Format format, proto::Compression compression,
+           const StableHashCache& stable_hashes, bool record_stable_hashes,
+           bool canonical, Metrics& metrics, size_t jobs, bool index = false);
+
+// Writes the interface at the root to the named file as raw BTF. This is lossy,
+// see btf::Write.
+void WriteBtf(const Graph& graph, Id root, const char* output,
+              Metrics& metrics);
+
+// Writes the graph to the named file as a binary edge list, see edge_list.h.
+void WriteEdges(const Graph& graph, Id root, const char* output,
+                Metrics& metrics);
+
+// Checkpoints save the graph after stages of processing, so that a later run
+// can resume from there rather than start over.
+//
+// The checkpoint of a stage is written in binary STG format to
+// <directory>/<stage>.stg, with a manifest, <directory>/<stage>.manifest,
+// holding the description of the inputs and options that the stage depends
+// on. A checkpoint only counts once its manifest is in place, so an
+// interrupted run leaves no partial one behind. Writing the checkpoint of a
+// stage removes those of later stages, which no longer follow from it.
+class Checkpoints {
+ public:
+  struct Stage {
+    std::string name;
+    std::string description;
+  };
+
+  // The stages are given in order.
+  Checkpoints(const char* directory, std::vector<Stage> stages);
+
+  void Write(size_t stage, const Graph& graph, Id root,
+             const StableHashCache& stable_hashes, bool record_stable_hashes,
+             bool canonical, Metrics& metrics, size_t jobs) const;
+
+  // Returns the path of the latest checkpoint whose manifest matches the
+  // description of its stage, if any. Fails if there are checkpoints, but
+  // none match, as they were taken with other inputs or options.
+  std::optional<std::string> Latest() const;
+
+ private:
+  std::filesystem::path Path(size_t stage, std::string_view suffix) const;
+  void Remove(const std::filesystem::path& path) const;
+  void Rename(const std::string& from,
+              const std::filesystem::path& to) const;
+
+  std::filesystem::path directory_;
+  std::vector<Stage> stages_;
+};
+
+// Reports to be written, each in its own format.
+using Reports =
+    std::vector<std::pair<reporting::OutputFormat, std::ostream*>>;
+
+// How the inputs are deduplicated before comparison, if at all. Each input can
+// be resolved and deduplicated on its own or, jointly, each candidate can also
+// be deduplicated against the baseline, so that the types they have in common
+// become the same nodes.
+enum class DiffDeduplication { NONE, SEPARATELY, JOINTLY };
+
+// The baseline, read, fingerprinted and named only once, together with the
+// state shared by all the candidates compared with it. Each candidate is read
+// into the same graph and removed again once compared.
+class Differ {
+ public:
+  Differ(InputFormat format, const char* filename, Ignore ignore,
+         ReadOptions options, const Filter* symbol_filter, bool fail_fast,
+         std::optional<const char*> cache_directory,
+         DiffDeduplication deduplication, size_t max_viz_bytes,
+         size_t max_diff_bytes, Metrics& metrics);
+  // Takes a baseline already read, for example concurrently with the first
+  // candidate by ReadSeparately. Its graph and metrics are consumed.
+  Differ(SeparateInput&& baseline, Ignore ignore, ReadOptions options,
+         const Filter* symbol_filter, bool fail_fast,
+         std::optional<const char*> cache_directory,
+         DiffDeduplication deduplication, size_t max_viz_bytes,
+         size_t max_diff_bytes, Metrics& metrics);
+
+  // Compares a candidate with the baseline, writing a report in each of the
+  // given formats and computing the fidelity diff, if requested. Returns
+  // whether any ABI differences were found.
+  bool Diff(InputFormat format, const char* filename, const Reports& outputs,
+            std::optional<FidelityDiff>* fidelity, Metrics& metrics);
+  // As above, for a candidate already read. Its graph and metrics are
+  // consumed.
+  bool Diff(SeparateInput&& candidate, const Reports& outputs,
+            std::optional<FidelityDiff>* fidelity, Metrics& metrics);
+
+  // Records the equivalences found so far, if there is a comparison cache.
+  void WriteCache(Metrics& metrics);
+
+  // Skips the symbols and types not started by the deadline, so that later
+  // comparisons are partial, see Compare::deadline.
+  void SetDeadline(std::chrono::steady_clock::time_point deadline) {
+    deadline_ = deadline;
+  }
+  // The names of the symbols and types skipped by the last comparison and the
+  // number compared, if there is a deadline.
+  const std::vector<std::string>& Skipped() const {
+    return skipped_;
+  }
+  size_t Completed() const {
+    return completed_;
+  }
+
+  // Records only which comparisons are equal, so that later comparisons write
+  // a JSON summary of the changes to each output, whatever its format, rather
+  // than a report, see reporting::ChangeCounts.
+  void SetCountOnly() {
+    count_only_ = true;
+  }
+
+ private:
+  void AddHashes(Id root, Metrics& metrics);
+  Id Canonicalise(Id start, Id root, Metrics& metrics);
+  void AddDigests(Id root, Metrics& metrics);
+  bool Diff(const std::function<Id()>& read, const Reports& outputs,
+            std::optional<FidelityDiff>* fidelity, Metrics& metrics);
+  bool DiffCandidate(Id start, Id root, const Reports& outputs,
+                     std::optional<FidelityDiff>* fidelity, Metrics& metrics);
+  template <typename IgnorePolicy>
+  bool CompareCandidate(Id root, const Reports& outputs,
+                        std::optional<FidelityDiff>* fidelity,
+                        Metrics& metrics);
+  void Forget(Id start);
+
+  const Ignore ignore_;
+  const ReadOptions options_;
+  const Filter* const symbol_filter_;
+  const bool fail_fast_;
+  const bool use_hashes_;
+  const DiffDeduplication deduplication_;
+  // if not 0, the size limit of VIZ reports
+  const size_t max_viz_bytes_;
+  // if not 0, the memory budget of the diffs of a comparison, see Outcomes
+  const size_t max_diff_bytes_;
+  std::optional<std::chrono::steady_clock::time_point> deadline_;
+  std::vector<std::string> skipped_;
+  size_t completed_ = 0;
+  bool count_only_ = false;
+  Graph graph_;
+  Id baseline_;
+  NodeHashes hashes_;
+  std::optional<ComparisonCache> cache_;
+  std::unordered_map<Id, HashValue64> digests_;
+  // Names and baseline fidelities are shared by all the candidates.
+  NameCache names_;
+  std::optional<Fidelities> baseline_fidelities_;
+};
+
+}  // namespace stg
+
+#endif  // STG_PIPELINE_H_
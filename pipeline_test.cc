@@ -0,0 +1,367 @@
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+// -*- mode: C++ -*-
+//
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License v2.0 with LLVM Exceptions (the
+// "License"); you may not use this file except in compliance with the
+// License.  You may obtain a copy of the License at
+//
+//     https://llvm.org/LICENSE.txt
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "pipeline.h"
+
+#include <unistd.h>
+
+#include <cstddef>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <catch2/catch.hpp>
+#include "comparison.h"
+#include "error.h"
+#include "fidelity.h"
+#include "filter.h"
+#include "graph.h"
+#include "input.h"
+#include "metrics.h"
+#include "reader_options.h"
+#include "reporting.h"
+#include "stable_hash.h"
+
+namespace Test {
+
+struct GetInterface {
+  const stg::Interface& operator()(const stg::Interface& x) const {
+    return x;
+  }
+  template <typename Node>
+  const stg::Interface& operator()(const Node&) const {
+    stg::Die() << "expected an Interface";
+  }
+};
+
+size_t CountNodes(const stg::Graph& graph) {
+  size_t count = 0;
+  graph.ForEach(stg::Id(0), graph.Limit(), [&](stg::Id) { ++count; });
+  return count;
+}
+
+TEST_CASE("merge and deduplication") {
+  stg::Graph graph;
+  const auto make_pointer = [&]() {
+    const auto int_type = graph.Add<stg::Primitive>(
+        "int", stg::Primitive::Encoding::SIGNED_INTEGER, 4);
+    return graph.Add<stg::PointerReference>(
+        stg::PointerReference::Kind::POINTER, int_type);
+  };
+  const auto make_interface = [&](const std::string& name) {
+    return graph.Add<stg::Interface>(
+        std::map<std::string, stg::Id>{},
+        std::map<std::string, stg::Id>{{name, make_pointer()}});
+  };
+  stg::Metrics metrics;
+  const auto root = stg::Merge(
+      graph, {make_interface("a"), make_interface("b")}, metrics, 1);
+  CHECK(CountNodes(graph) == 5);
+  for (const bool refine : {false, true}) {
+    GIVEN("refine: " + std::to_string(refine)) {
+      stg::StableHashCache stable_hashes;
+      const auto deduplicated = stg::ResolveAndDeduplicate(
+          graph, root, refine, stable_hashes, metrics, 1);
+      CHECK(CountNodes(graph) == 3);
+      CHECK(graph.Limit().ix_ == 3);
+      CHECK(graph.Is(deduplicated));
+    }
+  }
+}
+
+TEST_CASE("merge of several interfaces") {
+  stg::Graph graph;
+  const auto int_type = graph.Add<stg::Primitive>(
+      "int", stg::Primitive::Encoding::SIGNED_INTEGER, 4);
+  const auto make_interface = [&](const std::vector<std::string>& symbols,
+                                  const std::vector<std::string>& types) {
+    std::map<std::string, stg::Id> symbol_map;
+    for (const auto& name : symbols) {
+      symbol_map.emplace(name, int_type);
+    }
+    std::map<std::string, stg::Id> type_map;
+    for (const auto& name : types) {
+      type_map.emplace(name, int_type);
+    }
+    return graph.Add<stg::Interface>(std::move(symbol_map),
+                                     std::move(type_map));
+  };
+  stg::Metrics metrics;
+  GetInterface get;
+
+  const auto root = stg::Merge(graph,
+                               {make_interface({"c", "a"}, {"t", "u"}),
+                                make_interface({"b"}, {"u"}),
+                                make_interface({"d"}, {"s", "t"})},
+                               metrics, 1);
+  const auto& merged = graph.Apply<const stg::Interface&>(get, root);
+  std::vector<std::string> names;
+  for (const auto& [name, _] : merged.symbols) {
+    names.push_back(name);
+  }
+  CHECK(names == std::vector<std::string>{"a", "b", "c", "d"});
+  names.clear();
+  for (const auto& [name, _] : merged.types) {
+    names.push_back(name);
+  }
+  CHECK(names == std::vector<std::string>{"s", "t", "u"});
+
+  CHECK_THROWS(stg::Merge(
+      graph, {make_interface({"a"}, {}), make_interface({"a"}, {})}, metrics,
+      1));
+}
+
+TEST_CASE("unreachable node removal") {
+  stg::Graph graph;
+  const auto int_type = graph.Add<stg::Primitive>(
+      "int", stg::Primitive::Encoding::SIGNED_INTEGER, 4);
+  // as left behind by a dropped symbol
+  const auto dropped = graph.Add<stg::PointerReference>(
+      stg::PointerReference::Kind::POINTER, int_type);
+  graph.Add<stg::Typedef>("orphan", dropped);
+  const auto root = graph.Add<stg::Interface>(
+      std::map<std::string, stg::Id>{},
+      std::map<std::string, stg::Id>{{"int", int_type}});
+  stg::StableHashCache stable_hashes{{int_type, stg::HashValue(1)},
+                                     {dropped, stg::HashValue(2)}};
+  stg::Metrics metrics;
+  const auto kept = stg::RemoveUnreachable(graph, root, stable_hashes, metrics);
+  CHECK(CountNodes(graph) == 2);
+  CHECK(graph.Limit().ix_ == 2);
+  CHECK(graph.Is(kept));
+  CHECK(stable_hashes.size() == 1);
+}
+
+TEST_CASE("checkpoints") {
+  const auto directory = std::filesystem::temp_directory_path()
+                         / ("stg-checkpoints-" + std::to_string(getpid()));
+  const auto make = [&](const std::string& inputs) {
+    return stg::Checkpoints(
+        directory.c_str(),
+        {{"read", inputs}, {"deduplicated", inputs + " deduplicated"}});
+  };
+  const auto first = make("first");
+  const auto second = make("second");
+  CHECK(!first.Latest());
+
+  stg::Graph graph;
+  const auto int_type = graph.Add<stg::Primitive>(
+      "int", stg::Primitive::Encoding::SIGNED_INTEGER, 4);
+  const auto root = graph.Add<stg::Interface>(
+      std::map<std::string, stg::Id>{},
+      std::map<std::string, stg::Id>{
+          {"int_t", graph.Add<stg::Typedef>("int_t", int_type)}});
+  const stg::StableHashCache stable_hashes;
+  stg::Metrics metrics;
+  first.Write(0, graph, root, stable_hashes, false, false, metrics, 1);
+  first.Write(1, graph, root, stable_hashes, false, true, metrics, 1);
+  const auto latest = first.Latest();
+  REQUIRE(latest);
+  CHECK(*latest == (directory / "deduplicated.stg").string());
+  // other inputs do not resume from these checkpoints
+  CHECK_THROWS_AS(second.Latest(), stg::Exception);
+
+  stg::Graph resumed;
+  bool canonical = false;
+  const auto resumed_root = stg::Read(
+      resumed, stg::InputFormat::STG, latest->c_str(), stg::ReadOptions(),
+      std::unique_ptr<stg::Filter>(), metrics, nullptr, &canonical);
+  CHECK(canonical);
+  CHECK(CountNodes(resumed) == 3);
+  CHECK(resumed.Is(resumed_root));
+
+  // an earlier stage, taken with other inputs, removes the later, stale one
+  second.Write(0, graph, root, stable_hashes, false, false, metrics, 1);
+  CHECK(!std::filesystem::exists(directory / "deduplicated.stg"));
+  CHECK(second.Latest() == (directory / "read.stg").string());
+  CHECK_THROWS_AS(first.Latest(), stg::Exception);
+
+  // a stage with other options is passed over for an earlier one that matches
+  const stg::Checkpoints refined(
+      directory.c_str(),
+      {{"read", "second"}, {"deduplicated", "second refined"}});
+  second.Write(1, graph, root, stable_hashes, false, true, metrics, 1);
+  CHECK(refined.Latest() == (directory / "read.stg").string());
+  std::filesystem::remove_all(directory);
+}
+
+TEST_CASE("tree merge") {
+  const size_t count = GENERATE(1, 2, 3, 5, 8);
+  const size_t jobs = GENERATE(1, 4);
+  std::vector<stg::SeparateInput> inputs(count);
+  for (size_t ix = 0; ix < count; ++ix) {
+    auto& graph = inputs[ix].graph;
+    const auto int_type = graph.Add<stg::Primitive>(
+        "int", stg::Primitive::Encoding::SIGNED_INTEGER, 4);
+    const auto pointer = graph.Add<stg::PointerReference>(
+        stg::PointerReference::Kind::POINTER, int_type);
+    const auto symbol = graph.Add<stg::ElfSymbol>(
+        "s" + std::to_string(ix), std::nullopt, true,
+        stg::ElfSymbol::SymbolType::OBJECT, stg::ElfSymbol::Binding::GLOBAL,
+        stg::ElfSymbol::Visibility::DEFAULT, std::nullopt, std::nullopt,
+        pointer, std::nullopt);
+    inputs[ix].root = graph.Add<stg::Interface>(
+        std::map<std::string, stg::Id>{{"s" + std::to_string(ix), symbol}},
+        std::map<std::string, stg::Id>{{"int", int_type}});
+  }
+  stg::Graph graph;
+  stg::Metrics metrics;
+  const auto root = stg::Merge(graph, inputs, metrics, jobs);
+  CHECK(inputs.empty());
+  // one each of int, pointer and interface, and the symbols
+  CHECK(CountNodes(graph) == 3 + count);
+  CHECK(graph.Is(root));
+}
+
+struct GetEnumerators {
+  stg::Enumeration::Enumerators operator()(const stg::Enumeration& x) const {
+    return x.definition->enumerators;
+  }
+  template <typename Node>
+  stg::Enumeration::Enumerators operator()(const Node&) const {
+    stg::Die() << "expected an Enumeration";
+  }
+};
+
+TEST_CASE("enumerators moved between graphs") {
+  stg::Graph source;
+  const auto int_type = source.Add<stg::Primitive>(
+      "int", stg::Primitive::Encoding::SIGNED_INTEGER, 4);
+  const auto enumeration = source.Add<stg::Enumeration>(
+      "e", int_type, stg::Enumeration::Enumerators{{"RED", 0}, {"BLUE", 1}});
+  stg::Graph graph;
+  const auto moved = stg::Move(source, enumeration, graph);
+  // release the source, as Differ does, along with its interned names
+  source = stg::Graph();
+  const GetEnumerators get;
+  const auto enumerators =
+      graph.Apply<stg::Enumeration::Enumerators>(get, moved);
+  REQUIRE(enumerators.size() == 2);
+  CHECK(enumerators[0].first == "RED");
+  CHECK(enumerators[1].first == "BLUE");
+  // the names are held by the destination graph
+  CHECK(enumerators[0].first.data() == graph.Intern("RED").data());
+}
+
+TEST_CASE("differ reuse") {
+  const auto path = [](const char* file) {
+    return (std::filesystem::path("testdata") / file).string();
+  };
+  const auto baseline = path("member_size_0.stg");
+  const auto changed = path("member_size_1.stg");
+  stg::Metrics metrics;
+  stg::Differ differ(stg::InputFormat::STG, baseline.c_str(), stg::Ignore(),
+                     stg::ReadOptions(), nullptr, false, std::nullopt,
+                     stg::DiffDeduplication::NONE, 0, 0, metrics);
+  const auto diff = [&](const std::string& candidate) {
+    std::ostringstream report;
+    std::optional<stg::FidelityDiff> fidelity;
+    const bool changes = differ.Diff(
+        stg::InputFormat::STG, candidate.c_str(),
+        {{stg::reporting::OutputFormat::SMALL, &report}}, &fidelity, metrics);
+    CHECK(fidelity);
+    return std::make_pair(changes, report.str());
+  };
+
+  const auto first = diff(changed);
+  CHECK(first.first);
+  CHECK(!first.second.empty());
+  CHECK(diff(baseline) == std::make_pair(false, std::string()));
+  // a failed read leaves the baseline intact
+  CHECK_THROWS_AS(diff(path("no_such_file.stg")), stg::Exception);
+  CHECK(diff(changed) == first);
+}
+
+TEST_CASE("differ with inputs read separately") {
+  const auto baseline = std::filesystem::path("testdata") / "member_size_0.stg";
+  const auto changed = std::filesystem::path("testdata") / "member_size_1.stg";
+  const std::vector<std::pair<stg::InputFormat, const char*>> inputs = {
+      {stg::InputFormat::STG, baseline.c_str()},
+      {stg::InputFormat::STG, changed.c_str()}};
+  const auto diff = [&](size_t jobs) -> std::pair<bool, std::string> {
+    stg::ReadOptions options;
+    options.jobs = jobs;
+    auto parts = stg::ReadSeparately(inputs, options, nullptr);
+    stg::Metrics metrics;
+    stg::Differ differ(std::move(parts[0]), stg::Ignore(), options, nullptr,
+                       false, std::nullopt, stg::DiffDeduplication::NONE, 0,
+                       0, metrics);
+    std::ostringstream report;
+    const bool changes =
+        differ.Diff(std::move(parts[1]),
+                    {{stg::reporting::OutputFormat::SMALL, &report}}, nullptr,
+                    metrics);
+    // the baseline is left intact
+    std::ostringstream again;
+    CHECK(!differ.Diff(stg::InputFormat::STG, baseline.c_str(),
+                       {{stg::reporting::OutputFormat::SMALL, &again}},
+                       nullptr, metrics));
+    return {changes, report.str()};
+  };
+
+  stg::Metrics metrics;
+  stg::Differ differ(stg::InputFormat::STG, baseline.c_str(), stg::Ignore(),
+                     stg::ReadOptions(), nullptr, false, std::nullopt,
+                     stg::DiffDeduplication::NONE, 0, 0, metrics);
+  std::ostringstream report;
+  const bool changes = differ.Diff(
+      stg::InputFormat::STG, changed.c_str(),
+      {{stg::reporting::OutputFormat::SMALL, &report}}, nullptr, metrics);
+  const auto expected = std::make_pair(changes, report.str());
+  CHECK(expected.first);
+  CHECK(diff(1) == expected);
+  CHECK(diff(2) == expected);
+}
+
+TEST_CASE("differ deduplication") {
+  const auto path = [](const char* file) {
+    return (std::filesystem::path("testdata") / file).string();
+  };
+  const auto baseline = path("abigail_duplicate_types_0.xml");
+  const std::vector<std::string> candidates = {
+      path("abigail_duplicate_types_1.xml"), baseline,
+      path("abigail_duplicate_types_2.xml"),
+      path("abigail_duplicate_types_1.xml")};
+  const auto diff_all = [&](stg::DiffDeduplication deduplication) {
+    stg::Metrics metrics;
+    stg::Differ differ(stg::InputFormat::ABI, baseline.c_str(), stg::Ignore(),
+                       stg::ReadOptions(), nullptr, false, std::nullopt,
+                       deduplication, 0, 0, metrics);
+    std::vector<std::pair<bool, std::string>> results;
+    for (const auto& candidate : candidates) {
+      std::ostringstream report;
+      const bool changes = differ.Diff(
+          stg::InputFormat::ABI, candidate.c_str(),
+          {{stg::reporting::OutputFormat::SMALL, &report}}, nullptr, metrics);
+      results.emplace_back(changes, report.str());
+    }
+    return results;
+  };
+
+  const auto expected = diff_all(stg::DiffDeduplication::NONE);
+  CHECK(expected[1] == std::make_pair(false, std::string()));
+  CHECK(expected[3] == expected[0]);
+  CHECK(diff_all(stg::DiffDeduplication::SEPARATELY) == expected);
+  CHECK(diff_all(stg::DiffDeduplication::JOINTLY) == expected);
+}
+
+}  // namespace Test
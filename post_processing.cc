@@ -20,182 +20,392 @@
 #include "post_processing.h"
 
 #include <algorithm>
+#include <charconv>
 #include <cstddef>
-#include <iostream>
+#include <cstdint>
+#include <deque>
 #include <map>
+#include <memory>
+#include <optional>
 #include <ostream>
-#include <regex>
 #include <sstream>
 #include <string>
+#include <string_view>
+#include <system_error>
 #include <unordered_map>
 #include <utility>
 #include <vector>
 
 namespace stg {
 
-std::vector<std::string> SummariseCRCChanges(
-    const std::vector<std::string>& report, size_t limit) {
-  const std::regex symbol_changed_re("^.* symbol .* changed$");
-  const std::regex crc_re("^  CRC changed from [^ ]* to [^ ]*$");
-  const std::regex empty_re("^$");
-  const std::regex section_re("^[^ \\n].*$");
-  const std::regex symbol_re("^.* symbol .*$");
+namespace {
 
-  std::vector<std::string> new_report;
-  std::vector<std::pair<std::string, std::string>> pending;
-
-  auto emit_pending = [&]() {
-    const size_t crc_only_changes = pending.size();
-    for (size_t ix = 0; ix < std::min(crc_only_changes, limit); ++ix) {
-      new_report.push_back(pending[ix].first);
-      new_report.push_back(pending[ix].second);
-      new_report.emplace_back();
-    }
-    if (crc_only_changes > limit) {
-      std::ostringstream os;
-      os << "... " << crc_only_changes - limit << " omitted; "
-         << crc_only_changes << " symbols have only CRC changes";
-      new_report.push_back(os.str());
-      new_report.emplace_back();
-    }
-    pending.clear();
-  };
-
-  for (size_t ix = 0; ix < report.size(); ++ix) {
-    if (std::regex_match(report[ix], section_re) &&
-        !std::regex_match(report[ix], symbol_re)) {
-      emit_pending();
-      new_report.push_back(report[ix]);
-    } else if (ix + 2 < report.size() &&
-               std::regex_match(report[ix], symbol_changed_re) &&
-               std::regex_match(report[ix + 1], crc_re) &&
-               std::regex_match(report[ix + 2], empty_re)) {
-      pending.emplace_back(report[ix], report[ix + 1]);
-      // consumed 3 lines in total => 2 extra lines
-      ix += 2;
-    } else {
-      new_report.push_back(report[ix]);
-    }
+// Line matchers. These are hand-written, as std::regex is slow enough to
+// dominate the time taken to write a SHORT report.
+
+constexpr std::string_view kSymbol = " symbol ";
+
+// Removes prefix from the start of text, if present.
+bool Skip(std::string_view& text, std::string_view prefix) {
+  if (!text.starts_with(prefix)) {
+    return false;
   }
+  text.remove_prefix(prefix.size());
+  return true;
+}
 
-  emit_pending();
-  return new_report;
+// Removes suffix from the end of text, if present.
+bool Trim(std::string_view& text, std::string_view suffix) {
+  if (!text.ends_with(suffix)) {
+    return false;
+  }
+  text.remove_suffix(suffix.size());
+  return true;
 }
 
-std::vector<std::string> SummariseOffsetChanges(
-    const std::vector<std::string>& report) {
-  const std::regex re1("^( *)member ('.*') changed$");
-  const std::regex re2("^( *)offset changed from (\\d+) to (\\d+)$");
-  const std::regex re3("^( *).*$");
-
-  std::smatch match1;
-  std::smatch match2;
-  std::smatch match3;
-  size_t indent = 0;
-  int64_t offset = 0;
-  std::vector<std::string> vars;
-  std::vector<std::string> new_report;
+// Removes and returns leading spaces.
+size_t Indent(std::string_view& text) {
+  const size_t indent = std::min(text.find_first_not_of(' '), text.size());
+  text.remove_prefix(indent);
+  return indent;
+}
 
-  auto emit_pending = [&]() {
-    if (vars.empty()) {
-      return;
+// Matches and removes a leading unsigned decimal number.
+std::optional<int64_t> Number(std::string_view& text) {
+  int64_t value;
+  const auto [end, error] =
+      std::from_chars(text.data(), text.data() + text.size(), value);
+  if (error != std::errc() || end == text.data() || text[0] == '-') {
+    return {};
+  }
+  text.remove_prefix(end - text.data());
+  return {value};
+}
+
+// "<section>", a line not starting with a space and not about a symbol
+bool IsSection(std::string_view line) {
+  return !line.empty() && line[0] != ' ' &&
+         line.find(kSymbol) == std::string_view::npos;
+}
+
+// "<kind> symbol <name> changed"
+bool IsSymbolChanged(std::string_view line) {
+  const auto symbol = line.find(kSymbol);
+  return symbol != std::string_view::npos && Trim(line, " changed") &&
+         symbol + kSymbol.size() <= line.size();
+}
+
+// "  CRC changed from <crc> to <crc>"
+bool IsCRCChanged(std::string_view line) {
+  if (!Skip(line, "  CRC changed from ")) {
+    return false;
+  }
+  const auto space = line.find(' ');
+  if (space == std::string_view::npos) {
+    return false;
+  }
+  line.remove_prefix(space);
+  return Skip(line, " to ") && line.find(' ') == std::string_view::npos;
+}
+
+// "<indent>member '<name>' changed"
+bool MatchMemberChanged(std::string_view line, size_t& indent,
+                        std::string_view& name) {
+  indent = Indent(line);
+  if (!Skip(line, "member ") || !Trim(line, " changed") || line.size() < 2 ||
+      line.front() != '\'' || line.back() != '\'') {
+    return false;
+  }
+  name = line;
+  return true;
+}
+
+// "<indent>offset changed from <number> to <number>"
+bool MatchOffsetChanged(std::string_view line, size_t& indent,
+                        int64_t& from, int64_t& to) {
+  indent = Indent(line);
+  if (!Skip(line, "offset changed from ")) {
+    return false;
+  }
+  const auto before = Number(line);
+  if (!before || !Skip(line, " to ")) {
+    return false;
+  }
+  const auto after = Number(line);
+  if (!after || !line.empty()) {
+    return false;
+  }
+  from = *before;
+  to = *after;
+  return true;
+}
+
+// "<kind> symbol <name> was <added|removed>"
+bool MatchSymbolAddedRemoved(std::string_view line, std::string_view& kind,
+                             std::string_view& name, std::string_view& which) {
+  if (Trim(line, " was added")) {
+    which = "added";
+  } else if (Trim(line, " was removed")) {
+    which = "removed";
+  } else {
+    return false;
+  }
+  const auto symbol = line.rfind(kSymbol);
+  if (symbol == std::string_view::npos) {
+    return false;
+  }
+  kind = line.substr(0, symbol);
+  name = line.substr(symbol + kSymbol.size());
+  return true;
+}
+
+// Each stage holds a window of up to Lookahead lines, starting with the next
+// line to process. A line is processed once the window is full or, at the end
+// of input, with whatever lines remain.
+template <size_t Lookahead>
+class Stage : public LineSink {
+ public:
+  explicit Stage(LineSink& next) : next_(next) {}
+
+  void Push(std::string line) final {
+    window_.push_back(std::move(line));
+    if (window_.size() == Lookahead) {
+      Step();
     }
-    std::ostringstream line1;
-    line1 << std::string(indent, ' ');
-    if (vars.size() == 1) {
-      line1 << "member " << vars.front() << " changed";
+  }
+
+  void Finish() final {
+    while (!window_.empty()) {
+      Step();
+    }
+    EmitPending();
+    next_.Finish();
+  }
+
+ protected:
+  std::deque<std::string> window_;
+
+  // Processes the first line of the window, and possibly more, consuming at
+  // least one line.
+  virtual void Step() = 0;
+  virtual void EmitPending() = 0;
+
+  void Emit(std::string line) {
+    next_.Push(std::move(line));
+  }
+
+  // Forwards the first line of the window.
+  void Forward() {
+    Emit(std::move(window_.front()));
+    Consume(1);
+  }
+
+  void Consume(size_t count) {
+    window_.erase(window_.begin(), window_.begin() + count);
+  }
+
+ private:
+  LineSink& next_;
+};
+
+// Only the first limit CRC-only changes are kept, the rest are only counted.
+class SummariseCRCChanges : public Stage<3> {
+ public:
+  SummariseCRCChanges(size_t limit, LineSink& next)
+      : Stage(next), limit_(limit) {}
+
+ private:
+  const size_t limit_;
+  std::vector<std::pair<std::string, std::string>> pending_;
+  size_t crc_only_changes_ = 0;
+
+  void Step() final {
+    if (IsSection(window_[0])) {
+      EmitPending();
+      Forward();
+    } else if (window_.size() >= 3 && IsSymbolChanged(window_[0]) &&
+               IsCRCChanged(window_[1]) && window_[2].empty()) {
+      if (pending_.size() < limit_) {
+        pending_.emplace_back(std::move(window_[0]), std::move(window_[1]));
+      }
+      ++crc_only_changes_;
+      Consume(3);
     } else {
-      line1 << vars.size() << " members (" << vars.front() << " .. "
-            << vars.back() << ") changed";
+      Forward();
     }
-    new_report.push_back(line1.str());
-    std::ostringstream line2;
-    line2 << std::string(indent, ' ') << "  offset changed by " << offset;
-    new_report.push_back(line2.str());
-    vars.clear();
-  };
-
-  for (size_t ix = 0; ix < report.size(); ++ix) {
-    if (ix + 2 < report.size() && std::regex_match(report[ix], match1, re1) &&
-        std::regex_match(report[ix + 1], match2, re2) &&
-        std::regex_match(report[ix + 2], match3, re3)) {
-      const size_t indent1 = match1[1].length();
-      const size_t indent2 = match2[1].length();
-      const size_t indent3 = match3[1].length();
+  }
+
+  void EmitPending() final {
+    for (auto& [symbol, crc] : pending_) {
+      Emit(std::move(symbol));
+      Emit(std::move(crc));
+      Emit({});
+    }
+    if (crc_only_changes_ > limit_) {
+      std::ostringstream os;
+      os << "... " << crc_only_changes_ - limit_ << " omitted; "
+         << crc_only_changes_ << " symbols have only CRC changes";
+      Emit(os.str());
+      Emit({});
+    }
+    pending_.clear();
+    crc_only_changes_ = 0;
+  }
+};
+
+// Only the first and last members of a run are needed.
+class SummariseOffsetChanges : public Stage<3> {
+ public:
+  explicit SummariseOffsetChanges(LineSink& next) : Stage(next) {}
+
+ private:
+  size_t indent_ = 0;
+  int64_t offset_ = 0;
+  size_t vars_ = 0;
+  std::string first_;
+  std::string last_;
+
+  void Step() final {
+    size_t indent1;
+    size_t indent2;
+    std::string_view name;
+    int64_t from;
+    int64_t to;
+    if (window_.size() >= 3 &&
+        MatchMemberChanged(window_[0], indent1, name) &&
+        MatchOffsetChanged(window_[1], indent2, from, to)) {
+      std::string_view line3 = window_[2];
+      const size_t indent3 = Indent(line3);
       if (indent1 + 2 == indent2 && indent1 >= indent3) {
         const auto new_indent = indent1;
-        int64_t new_offset =
-            std::stoll(match2[3].str()) - std::stoll(match2[2].str());
-        if (new_indent != indent || new_offset != offset) {
-          emit_pending();
-          indent = new_indent;
-          offset = new_offset;
+        const int64_t new_offset = to - from;
+        if (new_indent != indent_ || new_offset != offset_) {
+          EmitPending();
+          indent_ = new_indent;
+          offset_ = new_offset;
+        }
+        last_ = name;
+        if (vars_++ == 0) {
+          first_ = last_;
         }
-        vars.push_back(match1[2]);
-        // consumed 2 lines in total => 1 extra line
-        ++ix;
-        continue;
+        // consumed 2 lines
+        Consume(2);
+        return;
       }
     }
-    emit_pending();
-    new_report.push_back(report[ix]);
+    EmitPending();
+    Forward();
   }
 
-  emit_pending();
-  return new_report;
-}
+  void EmitPending() final {
+    if (vars_ == 0) {
+      return;
+    }
+    std::ostringstream line1;
+    line1 << std::string(indent_, ' ');
+    if (vars_ == 1) {
+      line1 << "member " << first_ << " changed";
+    } else {
+      line1 << vars_ << " members (" << first_ << " .. " << last_
+            << ") changed";
+    }
+    Emit(line1.str());
+    std::ostringstream line2;
+    line2 << std::string(indent_, ' ') << "  offset changed by " << offset_;
+    Emit(line2.str());
+    vars_ = 0;
+  }
+};
 
-std::vector<std::string> GroupRemovedAddedSymbols(
-    const std::vector<std::string>& report) {
-  const std::regex symbol_re("^(.*) symbol (.*) was (added|removed)$");
-  const std::regex empty_re("^$");
+// The symbol names of a run are held until its end, to group them by kind.
+class GroupRemovedAddedSymbols : public Stage<2> {
+ public:
+  explicit GroupRemovedAddedSymbols(LineSink& next) : Stage(next) {}
 
-  std::vector<std::string> new_report;
+ private:
   std::unordered_map<std::string,
-      std::map<std::string, std::vector<std::string>>> pending;
+      std::map<std::string, std::vector<std::string>>> pending_;
+
+  void Step() final {
+    std::string_view kind;
+    std::string_view name;
+    std::string_view which;
+    if (window_.size() >= 2 &&
+        MatchSymbolAddedRemoved(window_[0], kind, name, which) &&
+        window_[1].empty()) {
+      pending_[std::string(which)][std::string(kind)].emplace_back(name);
+      // consumed 2 lines (there is always an empty line after symbol
+      // added/removed line)
+      Consume(2);
+    } else {
+      EmitPending();
+      Forward();
+    }
+  }
 
-  auto emit_pending = [&]() {
+  void EmitPending() final {
     for (const auto& which : {"removed", "added"}) {
-      auto& pending_kinds = pending[which];
+      auto& pending_kinds = pending_[which];
       for (auto& [kind, pending_symbols] : pending_kinds) {
         if (!pending_symbols.empty()) {
           std::ostringstream os;
           os << pending_symbols.size() << ' ' << kind << " symbol(s) " << which;
-          new_report.push_back(os.str());
+          Emit(os.str());
           for (const auto& symbol : std::exchange(pending_symbols, {})) {
-            new_report.push_back("  " + symbol);
+            Emit("  " + symbol);
           }
-          new_report.emplace_back();
+          Emit({});
         }
       }
     }
-  };
-
-  for (size_t ix = 0; ix < report.size(); ++ix) {
-    std::smatch match;
-    if (ix + 1 < report.size() &&
-        std::regex_match(report[ix], match, symbol_re) &&
-        std::regex_match(report[ix + 1], empty_re)) {
-      pending[match[3].str()][match[1].str()].push_back(match[2].str());
-      // consumed 2 lines in total => 1 extra line (there is always an empty
-      // line after symbol added/removed line)
-      ++ix;
-    } else {
-      emit_pending();
-      new_report.push_back(report[ix]);
-    }
   }
+};
 
-  emit_pending();
-  return new_report;
+class VectorLines : public LineSink {
+ public:
+  explicit VectorLines(std::vector<std::string>& lines) : lines_(lines) {}
+
+  void Push(std::string line) final {
+    lines_.push_back(std::move(line));
+  }
+
+  void Finish() final {}
+
+ private:
+  std::vector<std::string>& lines_;
+};
+
+}  // namespace
+
+void StreamLines::Push(std::string line) {
+  output_ << line << '\n';
+}
+
+PostProcessor::PostProcessor(size_t max_crc_only_changes, LineSink& output)
+    : offsets_(std::make_unique<SummariseOffsetChanges>(output)),
+      symbols_(std::make_unique<GroupRemovedAddedSymbols>(*offsets_)),
+      crcs_(std::make_unique<SummariseCRCChanges>(max_crc_only_changes,
+                                                  *symbols_)) {}
+
+PostProcessor::~PostProcessor() = default;
+
+void PostProcessor::Push(std::string line) {
+  crcs_->Push(std::move(line));
+}
+
+void PostProcessor::Finish() {
+  crcs_->Finish();
 }
 
 std::vector<std::string> PostProcess(const std::vector<std::string>& report,
                                      size_t max_crc_only_changes) {
   std::vector<std::string> new_report;
-  new_report = SummariseCRCChanges(report, max_crc_only_changes);
-  new_report = GroupRemovedAddedSymbols(new_report);
-  new_report = SummariseOffsetChanges(new_report);
+  VectorLines output(new_report);
+  PostProcessor post_processor(max_crc_only_changes, output);
+  for (const auto& line : report) {
+    post_processor.Push(line);
+  }
+  post_processor.Finish();
   return new_report;
 }
 
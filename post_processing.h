@@ -21,11 +21,51 @@
 #define STG_POST_PROCESSING_H_
 
 #include <cstddef>
+#include <memory>
+#include <ostream>
 #include <string>
 #include <vector>
 
 namespace stg {
 
+// A consumer of report lines, without trailing newlines. Finish is called once,
+// after the last line.
+class LineSink {
+ public:
+  virtual ~LineSink() = default;
+  virtual void Push(std::string line) = 0;
+  virtual void Finish() = 0;
+};
+
+// Writes each line, followed by a newline, as soon as it is pushed.
+class StreamLines : public LineSink {
+ public:
+  explicit StreamLines(std::ostream& output) : output_(output) {}
+  void Push(std::string line) final;
+  void Finish() final {}
+
+ private:
+  std::ostream& output_;
+};
+
+// Summarises a SMALL report as a SHORT report, line by line. Only a few lines
+// of lookahead are buffered, along with the bounded state of any summary in
+// progress. The exception is a run of added or removed symbols, whose names
+// are held until the run ends, as they are grouped by kind.
+class PostProcessor : public LineSink {
+ public:
+  PostProcessor(size_t max_crc_only_changes, LineSink& output);
+  ~PostProcessor() override;
+  void Push(std::string line) final;
+  void Finish() final;
+
+ private:
+  // stages, in reverse order of processing
+  std::unique_ptr<LineSink> offsets_;
+  std::unique_ptr<LineSink> symbols_;
+  std::unique_ptr<LineSink> crcs_;
+};
+
 std::vector<std::string> PostProcess(const std::vector<std::string>& report,
                                      size_t max_crc_only_changes);
 
@@ -0,0 +1,140 @@
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+// -*- mode: C++ -*-
+//
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License v2.0 with LLVM Exceptions (the
+// "License"); you may not use this file except in compliance with the
+// License.  You may obtain a copy of the License at
+//
+//     https://llvm.org/LICENSE.txt
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "post_processing.h"
+
+#include <cstddef>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <catch2/catch.hpp>
+
+namespace Test {
+
+TEST_CASE("CRC-only changes beyond the limit are counted") {
+  const std::vector<std::string> report = {
+      "function symbol 'void f1()' changed",
+      "  CRC changed from 0x1 to 0x2",
+      "",
+      "function symbol 'void f2()' changed",
+      "  CRC changed from 0x3 to 0x4",
+      "",
+      "function symbol 'void f3()' changed",
+      "  CRC changed from 0x5 to 0x6",
+      "",
+      "type 'struct A' changed",
+      "  byte size changed from 4 to 8",
+      "",
+  };
+  const std::vector<std::string> expected = {
+      "function symbol 'void f1()' changed",
+      "  CRC changed from 0x1 to 0x2",
+      "",
+      "... 2 omitted; 3 symbols have only CRC changes",
+      "",
+      "type 'struct A' changed",
+      "  byte size changed from 4 to 8",
+      "",
+  };
+  CHECK(stg::PostProcess(report, 1) == expected);
+}
+
+TEST_CASE("offset changes are summarised") {
+  const std::vector<std::string> report = {
+      "type 'struct A' changed",
+      "  member 'int b' changed",
+      "    offset changed from 32 to 48",
+      "  member 'int c' changed",
+      "    offset changed from 64 to 80",
+      "  member 'int d' changed",
+      "    offset changed from 96 to 112",
+      "",
+  };
+  const std::vector<std::string> expected = {
+      "type 'struct A' changed",
+      "  3 members ('int b' .. 'int d') changed",
+      "    offset changed by 16",
+      "",
+  };
+  CHECK(stg::PostProcess(report, 0) == expected);
+}
+
+TEST_CASE("added and removed symbols are grouped") {
+  const std::vector<std::string> report = {
+      "function symbol 'int g(int)' was added",
+      "",
+      "variable symbol 'int b' was removed",
+      "",
+      "function symbol 'void f()' was removed",
+      "",
+      "function symbol 'void h()' was added",
+      "",
+  };
+  const std::vector<std::string> expected = {
+      "1 function symbol(s) removed",
+      "  'void f()'",
+      "",
+      "1 variable symbol(s) removed",
+      "  'int b'",
+      "",
+      "2 function symbol(s) added",
+      "  'int g(int)'",
+      "  'void h()'",
+      "",
+  };
+  CHECK(stg::PostProcess(report, 0) == expected);
+}
+
+TEST_CASE("lines that only resemble summarised ones are kept") {
+  const std::vector<std::string> report = {
+      "function symbol 'void f1()' changed",
+      "  CRC changed from 0x1 to 0x2 and back",
+      "",
+      "type 'struct A' changed",
+      "  member 'int b' changed",
+      "    offset changed from -32 to 48",
+      "  member int c changed",
+      "    offset changed from 64 to 80",
+      "",
+      "function symbol 'void f()' was removed",
+      "extra",
+  };
+  CHECK(stg::PostProcess(report, 0) == report);
+}
+
+TEST_CASE("lines are written with bounded lookahead") {
+  std::ostringstream output;
+  stg::StreamLines lines(output);
+  stg::PostProcessor post_processor(0, lines);
+  const size_t count = 100;
+  std::ostringstream expected;
+  for (size_t ix = 0; ix < count; ++ix) {
+    const std::string line =
+        "type 'struct S" + std::to_string(ix) + "' changed";
+    post_processor.Push(line);
+    expected << line << '\n';
+  }
+  // only a few lines are held back before the end of input
+  const auto written = output.str();
+  CHECK(expected.str().starts_with(written));
+  CHECK(expected.str().size() - written.size() < expected.str().size() / 10);
+  post_processor.Finish();
+  CHECK(output.str() == expected.str());
+}
+
+}  // namespace Test
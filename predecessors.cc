@@ -0,0 +1,105 @@
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+// -*- mode: C++ -*-
+//
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License v2.0 with LLVM Exceptions (the
+// "License"); you may not use this file except in compliance with the
+// License.  You may obtain a copy of the License at
+//
+//     https://llvm.org/LICENSE.txt
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "predecessors.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <span>
+#include <utility>
+#include <vector>
+
+#include "error.h"
+#include "graph.h"
+#include "parallel.h"
+#include "substitution.h"
+
+namespace stg {
+
+namespace {
+
+// Rows are sorted concurrently in chunks of this size.
+constexpr size_t kChunk = 4096;
+
+}  // namespace
+
+std::span<const Id> Predecessors::operator()(Id id) {
+  if (!index_) {
+    Build();
+  }
+  const auto& [offsets, sources] = *index_;
+  Check(id.ix_ + 1 < offsets.size())
+      << "predecessors of node outside graph: " << id;
+  return std::span<const Id>(sources).subspan(
+      offsets[id.ix_], offsets[id.ix_ + 1] - offsets[id.ix_]);
+}
+
+void Predecessors::Build() {
+  const size_t limit = graph_.Limit().ix_;
+  // calls visit(source, target) for every edge, concurrently
+  const auto for_each_edge = [&](const auto& visit) {
+    graph_.ParallelForEach(jobs_, Id(0), Id(limit), [&](size_t, Id source) {
+      const auto update = [&](Id& target) {
+        Check(target.ix_ < limit)
+            << "edge from " << source << " to node outside graph: " << target;
+        visit(source, target);
+      };
+      Substitute substitute(graph_, update);
+      substitute(source);
+    });
+  };
+
+  // count the edges to each node
+  std::vector<std::atomic<size_t>> cursors(limit);
+  for_each_edge([&](Id, Id target) {
+    cursors[target.ix_].fetch_add(1, std::memory_order_relaxed);
+  });
+
+  // turn the counts into offsets, leaving the cursors at the start of each row
+  Index index;
+  index.offsets.reserve(limit + 1);
+  size_t total = 0;
+  index.offsets.push_back(total);
+  for (auto& cursor : cursors) {
+    const size_t count = cursor.exchange(total, std::memory_order_relaxed);
+    total += count;
+    index.offsets.push_back(total);
+  }
+
+  // fill in the rows and make their order deterministic
+  index.sources.resize(total, Id::kInvalid);
+  for_each_edge([&](Id source, Id target) {
+    const size_t position =
+        cursors[target.ix_].fetch_add(1, std::memory_order_relaxed);
+    index.sources[position] = source;
+  });
+  const size_t chunks = (limit + kChunk - 1) / kChunk;
+  ForEachIndex(jobs_, chunks, [&](size_t, size_t chunk) {
+    const size_t begin = chunk * kChunk;
+    const size_t end = std::min(begin + kChunk, limit);
+    for (size_t ix = begin; ix < end; ++ix) {
+      std::sort(index.sources.begin() + index.offsets[ix],
+                index.sources.begin() + index.offsets[ix + 1],
+                [](Id id1, Id id2) { return id1.ix_ < id2.ix_; });
+    }
+  });
+
+  index_ = std::move(index);
+}
+
+}  // namespace stg
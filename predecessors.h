@@ -0,0 +1,68 @@
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+// -*- mode: C++ -*-
+//
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License v2.0 with LLVM Exceptions (the
+// "License"); you may not use this file except in compliance with the
+// License.  You may obtain a copy of the License at
+//
+//     https://llvm.org/LICENSE.txt
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef STG_PREDECESSORS_H_
+#define STG_PREDECESSORS_H_
+
+#include <cstddef>
+#include <optional>
+#include <span>
+#include <vector>
+
+#include "graph.h"
+
+namespace stg {
+
+// An index of the predecessors of each node of a graph, held in compressed
+// sparse row form: one offset per node id and one entry per edge.
+//
+// The index is built on first use, in parallel passes over the edges of the
+// nodes in [0, Limit), and reflects the graph at that point. Invalidate must be
+// called after any change to the graph's nodes or edges. Building is not
+// thread-safe but, once built, the index may be queried concurrently.
+//
+// The graph is never modified, but is not const as edges are visited using
+// Substitute.
+class Predecessors {
+ public:
+  explicit Predecessors(Graph& graph, size_t jobs = 1)
+      : graph_(graph), jobs_(jobs) {}
+
+  // Returns the sources of the edges to the given node, in increasing order.
+  // A source appears once per edge, so may be repeated.
+  std::span<const Id> operator()(Id id);
+
+  void Invalidate() {
+    index_.reset();
+  }
+
+ private:
+  struct Index {
+    std::vector<size_t> offsets;
+    std::vector<Id> sources;
+  };
+
+  void Build();
+
+  Graph& graph_;
+  const size_t jobs_;
+  std::optional<Index> index_;
+};
+
+}  // namespace stg
+
+#endif  // STG_PREDECESSORS_H_
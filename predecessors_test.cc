@@ -0,0 +1,79 @@
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+// -*- mode: C++ -*-
+//
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License v2.0 with LLVM Exceptions (the
+// "License"); you may not use this file except in compliance with the
+// License.  You may obtain a copy of the License at
+//
+//     https://llvm.org/LICENSE.txt
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "predecessors.h"
+
+#include <cstddef>
+#include <vector>
+
+#include <catch2/catch.hpp>
+#include "error.h"
+#include "graph.h"
+
+namespace Test {
+
+std::vector<stg::Id> Get(stg::Predecessors& predecessors, stg::Id id) {
+  const auto sources = predecessors(id);
+  return {sources.begin(), sources.end()};
+}
+
+TEST_CASE("predecessors") {
+  const size_t jobs = GENERATE(1, 4);
+  stg::Graph graph;
+  const auto v = graph.Add<stg::Special>(stg::Special::Kind::VOID);
+  const auto p = graph.Add<stg::PointerReference>(
+      stg::PointerReference::Kind::POINTER, v);
+  const auto f = graph.Add<stg::Function>(v, std::vector<stg::Id>{p, p});
+  const auto q = graph.Add<stg::PointerReference>(
+      stg::PointerReference::Kind::POINTER, f);
+  const auto removed = graph.Allocate();
+
+  stg::Predecessors predecessors(graph, jobs);
+  CHECK(Get(predecessors, v) == std::vector<stg::Id>{p, f});
+  CHECK(Get(predecessors, p) == std::vector<stg::Id>{f, f});
+  CHECK(Get(predecessors, f) == std::vector<stg::Id>{q});
+  CHECK(Get(predecessors, q).empty());
+  CHECK(Get(predecessors, removed).empty());
+  CHECK_THROWS_AS(predecessors(graph.Limit()), stg::Exception);
+
+  // the index is rebuilt after invalidation
+  graph.Set<stg::PointerReference>(
+      removed, stg::PointerReference::Kind::POINTER, q);
+  CHECK(Get(predecessors, q).empty());
+  predecessors.Invalidate();
+  CHECK(Get(predecessors, q) == std::vector<stg::Id>{removed});
+}
+
+TEST_CASE("predecessors of large graph") {
+  const size_t jobs = GENERATE(1, 3);
+  // a long chain of pointers to pointers crosses many chunks
+  stg::Graph graph;
+  const size_t size = 10000;
+  auto id = graph.Add<stg::Special>(stg::Special::Kind::VOID);
+  for (size_t ix = 1; ix < size; ++ix) {
+    id = graph.Add<stg::PointerReference>(
+        stg::PointerReference::Kind::POINTER, id);
+  }
+  stg::Predecessors predecessors(graph, jobs);
+  for (size_t ix = 0; ix + 1 < size; ++ix) {
+    CHECK(Get(predecessors, stg::Id(ix))
+          == std::vector<stg::Id>{stg::Id(ix + 1)});
+  }
+  CHECK(Get(predecessors, stg::Id(size - 1)).empty());
+}
+
+}  // namespace Test
@@ -0,0 +1,295 @@
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+// -*- mode: C++ -*-
+//
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License v2.0 with LLVM Exceptions (the
+// "License"); you may not use this file except in compliance with the
+// License.  You may obtain a copy of the License at
+//
+//     https://llvm.org/LICENSE.txt
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "proto_index.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include <google/protobuf/io/coded_stream.h>
+#include <google/protobuf/wire_format_lite.h>
+#include "error.h"
+#include "proto_shards.h"
+#include "stg.pb.h"
+
+namespace stg {
+namespace proto {
+
+namespace {
+
+using google::protobuf::internal::WireFormatLite;
+
+constexpr std::string_view kIndexMagic = "STGINDEX";
+// magic, version and three counts
+constexpr size_t kHeaderSize = 40;
+// name offset, name size, id
+constexpr size_t kNameEntrySize = 24;
+// id, field, offset, size
+constexpr size_t kNodeEntrySize = 32;
+
+uint64_t Load(const char* data) {
+  uint64_t value = 0;
+  for (size_t ix = 0; ix < 8; ++ix) {
+    value |= static_cast<uint64_t>(static_cast<unsigned char>(data[ix]))
+             << (8 * ix);
+  }
+  return value;
+}
+
+void Store(uint64_t value, std::ostream& os) {
+  char data[8];
+  for (size_t ix = 0; ix < 8; ++ix) {
+    data[ix] = static_cast<char>(value >> (8 * ix));
+  }
+  os.write(data, sizeof(data));
+}
+
+struct NodeEntry {
+  uint32_t id;
+  uint32_t field;
+  uint64_t offset;
+  uint64_t size;
+};
+
+// Finds the id of a node message, which is 0 if it has none.
+uint32_t NodeId(std::string_view message) {
+  google::protobuf::io::CodedInputStream coded(
+      reinterpret_cast<const uint8_t*>(message.data()),
+      static_cast<int>(message.size()));
+  uint32_t id = 0;
+  while (const uint32_t tag = coded.ReadTag()) {
+    if (WireFormatLite::GetTagFieldNumber(tag) == 1
+        && WireFormatLite::GetTagWireType(tag)
+               == WireFormatLite::WIRETYPE_FIXED32) {
+      Check(coded.ReadLittleEndian32(&id)) << "bad STG node id";
+    } else {
+      Check(WireFormatLite::SkipField(&coded, tag)) << "bad STG node";
+    }
+  }
+  return id;
+}
+
+// Finds the node messages of an STG message starting at the given offset,
+// without parsing them.
+void Scan(std::string_view stg, size_t start, size_t size,
+          std::vector<NodeEntry>& nodes, std::optional<uint32_t>& version) {
+  google::protobuf::io::CodedInputStream coded(
+      reinterpret_cast<const uint8_t*>(stg.data() + start),
+      static_cast<int>(size));
+  while (const uint32_t tag = coded.ReadTag()) {
+    const uint32_t field = WireFormatLite::GetTagFieldNumber(tag);
+    const auto wire_type = WireFormatLite::GetTagWireType(tag);
+    if (field == STG::kVersionFieldNumber
+        && wire_type == WireFormatLite::WIRETYPE_VARINT) {
+      uint32_t value;
+      Check(coded.ReadVarint32(&value)) << "bad STG version";
+      version = value;
+    } else if (field >= STG::kVoidFieldNumber
+               && field <= STG::kInterfaceFieldNumber
+               && wire_type == WireFormatLite::WIRETYPE_LENGTH_DELIMITED) {
+      uint32_t length;
+      Check(coded.ReadVarint32(&length)
+            && length <= size - coded.CurrentPosition())
+          << "bad STG node length";
+      const size_t offset = start + coded.CurrentPosition();
+      nodes.push_back(
+          {NodeId(stg.substr(offset, length)), field, offset, length});
+      coded.Skip(static_cast<int>(length));
+    } else {
+      Check(WireFormatLite::SkipField(&coded, tag)) << "bad STG field";
+    }
+  }
+  Check(static_cast<size_t>(coded.CurrentPosition()) == size)
+      << "failed to scan STG";
+}
+
+void WriteNames(const std::vector<std::pair<std::string, uint32_t>>& names,
+                uint64_t& offset, std::ostream& os) {
+  for (const auto& [name, id] : names) {
+    Store(offset, os);
+    Store(name.size(), os);
+    Store(id, os);
+    offset += name.size();
+  }
+}
+
+std::vector<std::pair<std::string, uint32_t>> Sorted(
+    std::vector<std::pair<std::string, uint32_t>> names) {
+  std::sort(names.begin(), names.end());
+  return names;
+}
+
+}  // namespace
+
+void WriteIndex(std::string_view stg,
+                const std::vector<std::pair<std::string, uint32_t>>& symbols,
+                const std::vector<std::pair<std::string, uint32_t>>& types,
+                std::ostream& os) {
+  std::vector<NodeEntry> nodes;
+  std::optional<uint32_t> version;
+  if (stg.starts_with(kShardsMagic)) {
+    // the layout is checked as by proto::Read
+    const size_t start = kShardsMagic.size();
+    google::protobuf::io::CodedInputStream coded(
+        reinterpret_cast<const uint8_t*>(stg.data() + start),
+        static_cast<int>(stg.size() - start));
+    uint64_t count;
+    Check(coded.ReadVarint64(&count) && count > 0 && count <= stg.size())
+        << "bad STG shard count";
+    std::vector<uint64_t> sizes(count);
+    for (auto& size : sizes) {
+      Check(coded.ReadVarint64(&size)) << "bad STG shard size";
+    }
+    size_t offset = start + coded.CurrentPosition();
+    for (size_t ix = 0; ix < count; ++ix) {
+      Check(sizes[ix] <= stg.size() - offset) << "truncated STG shard";
+      // only the first shard carries the version
+      std::optional<uint32_t> shard_version;
+      Scan(stg, offset, sizes[ix], nodes, shard_version);
+      if (ix == 0) {
+        version = shard_version;
+      }
+      offset += sizes[ix];
+    }
+    Check(offset == stg.size()) << "trailing data after STG shards";
+  } else {
+    Check(!stg.empty() && stg[0] == 0x08)
+        << "only binary or sharded STG can be indexed";
+    Scan(stg, 0, stg.size(), nodes, version);
+  }
+  Check(version.has_value()) << "STG to be indexed has no version";
+  std::sort(nodes.begin(), nodes.end(), [](const auto& a, const auto& b) {
+    return a.id < b.id;
+  });
+  const auto duplicate = std::adjacent_find(
+      nodes.begin(), nodes.end(),
+      [](const auto& a, const auto& b) { return a.id == b.id; });
+  if (duplicate != nodes.end()) {
+    Die() << "duplicate STG node id " << duplicate->id;
+  }
+  const auto sorted_symbols = Sorted(symbols);
+  const auto sorted_types = Sorted(types);
+
+  os.write(kIndexMagic.data(), kIndexMagic.size());
+  Store(*version, os);
+  Store(sorted_symbols.size(), os);
+  Store(sorted_types.size(), os);
+  Store(nodes.size(), os);
+  uint64_t offset = 0;
+  WriteNames(sorted_symbols, offset, os);
+  WriteNames(sorted_types, offset, os);
+  for (const auto& node : nodes) {
+    Store(node.id, os);
+    Store(node.field, os);
+    Store(node.offset, os);
+    Store(node.size, os);
+  }
+  for (const auto* names : {&sorted_symbols, &sorted_types}) {
+    for (const auto& [name, _] : *names) {
+      os.write(name.data(), static_cast<std::streamsize>(name.size()));
+    }
+  }
+}
+
+Index::Index(std::string_view data) : data_(data) {
+  Check(data.size() >= kHeaderSize && data.starts_with(kIndexMagic))
+      << "not an STG index";
+  const auto count = [&](size_t ix) {
+    const uint64_t value = Load(data.data() + kIndexMagic.size() + 8 * ix);
+    Check(value <= data.size()) << "bad STG index";
+    return static_cast<size_t>(value);
+  };
+  symbols_ = count(1);
+  types_ = count(2);
+  nodes_ = count(3);
+  names_ = kHeaderSize + (symbols_ + types_) * kNameEntrySize
+           + nodes_ * kNodeEntrySize;
+  Check(names_ <= data.size()) << "truncated STG index";
+}
+
+uint32_t Index::Version() const {
+  return static_cast<uint32_t>(Load(data_.data() + kIndexMagic.size()));
+}
+
+std::optional<uint32_t> Index::Symbol(std::string_view name) const {
+  return Lookup(kHeaderSize, symbols_, name);
+}
+
+std::optional<uint32_t> Index::Type(std::string_view name) const {
+  return Lookup(kHeaderSize + symbols_ * kNameEntrySize, types_, name);
+}
+
+std::optional<uint32_t> Index::Lookup(size_t start, size_t count,
+                                      std::string_view name) const {
+  const std::string_view names = data_.substr(names_);
+  const auto get = [&](size_t ix) {
+    const char* entry = data_.data() + start + ix * kNameEntrySize;
+    const uint64_t offset = Load(entry);
+    const uint64_t size = Load(entry + 8);
+    Check(offset <= names.size() && size <= names.size() - offset)
+        << "bad STG index name";
+    return names.substr(offset, size);
+  };
+  size_t low = 0;
+  size_t high = count;
+  while (low < high) {
+    const size_t middle = low + (high - low) / 2;
+    if (get(middle) < name) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+  if (low == count || get(low) != name) {
+    return {};
+  }
+  return {static_cast<uint32_t>(
+      Load(data_.data() + start + low * kNameEntrySize + 16))};
+}
+
+std::optional<Index::Node> Index::Find(uint32_t id) const {
+  const size_t start = kHeaderSize + (symbols_ + types_) * kNameEntrySize;
+  const auto entry = [&](size_t ix) {
+    return data_.data() + start + ix * kNodeEntrySize;
+  };
+  size_t low = 0;
+  size_t high = nodes_;
+  while (low < high) {
+    const size_t middle = low + (high - low) / 2;
+    if (Load(entry(middle)) < id) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+  if (low == nodes_ || Load(entry(low)) != id) {
+    return {};
+  }
+  const char* found = entry(low);
+  return {Node{static_cast<uint32_t>(Load(found + 8)), Load(found + 16),
+               Load(found + 24)}};
+}
+
+}  // namespace proto
+}  // namespace stg
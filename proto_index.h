@@ -0,0 +1,91 @@
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+// -*- mode: C++ -*-
+//
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License v2.0 with LLVM Exceptions (the
+// "License"); you may not use this file except in compliance with the
+// License.  You may obtain a copy of the License at
+//
+//     https://llvm.org/LICENSE.txt
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef STG_PROTO_INDEX_H_
+#define STG_PROTO_INDEX_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace stg {
+namespace proto {
+
+// An index of binary or sharded STG lets a few symbols or types, and the nodes
+// they reach, be read without parsing the rest, see ReadIndexed. It is written
+// alongside the STG, with this suffix added to its name.
+inline constexpr std::string_view kIndexSuffix = ".idx";
+
+// The index maps the symbol and type names of the root interface to external
+// ids, and external ids to the node messages holding them. It is made of
+// little-endian fixed-width fields, so that it can be searched where it is
+// mapped:
+//
+//   magic, format version, symbol count, type count, node count
+//   symbols: name offset, name size, id - sorted by name
+//   types: name offset, name size, id - sorted by name
+//   nodes: id, STG field number, offset, size - sorted by id
+//   names
+//
+// Node offsets are from the start of the STG and name offsets are from the
+// start of the names.
+//
+// Writes the index of the given binary or sharded STG, which is scanned for the
+// node messages. The names are those of the root interface.
+void WriteIndex(std::string_view stg,
+                const std::vector<std::pair<std::string, uint32_t>>& symbols,
+                const std::vector<std::pair<std::string, uint32_t>>& types,
+                std::ostream& os);
+
+// Looks up entries in an index, without copying it.
+class Index {
+ public:
+  struct Node {
+    // the number of the STG field, which determines the message type
+    uint32_t field;
+    // the location of the message within the STG
+    uint64_t offset;
+    uint64_t size;
+  };
+
+  explicit Index(std::string_view data);
+
+  uint32_t Version() const;
+  std::optional<uint32_t> Symbol(std::string_view name) const;
+  std::optional<uint32_t> Type(std::string_view name) const;
+  std::optional<Node> Find(uint32_t id) const;
+
+ private:
+  std::optional<uint32_t> Lookup(size_t start, size_t count,
+                                 std::string_view name) const;
+
+  std::string_view data_;
+  size_t symbols_;
+  size_t types_;
+  size_t nodes_;
+  size_t names_;
+};
+
+}  // namespace proto
+}  // namespace stg
+
+#endif  // STG_PROTO_INDEX_H_
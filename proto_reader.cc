@@ -19,24 +19,42 @@
 
 #include "proto_reader.h"
 
+#include <fcntl.h>
+
 #include <algorithm>
 #include <array>
-#include <cerrno>
+#include <cctype>
+#include <cstddef>
 #include <cstdint>
-#include <fstream>
+#include <limits>
 #include <map>
 #include <optional>
 #include <string>
 #include <string_view>
 #include <unordered_map>
+#include <unordered_set>
+#include <utility>
 #include <vector>
 
-#include <google/protobuf/io/zero_copy_stream_impl.h>
+#include <google/protobuf/arena.h>
+#include <google/protobuf/io/coded_stream.h>
+#include <google/protobuf/io/gzip_stream.h>
+#include <google/protobuf/io/zero_copy_stream.h>
+#include <google/protobuf/message_lite.h>
 #include <google/protobuf/repeated_field.h>
 #include <google/protobuf/repeated_ptr_field.h>
 #include <google/protobuf/text_format.h>
 #include "error.h"
+#include "file_descriptor.h"
+#include "filter.h"
+#include "flat_map.h"
 #include "graph.h"
+#include "hashing.h"
+#include "metrics.h"
+#include "parallel.h"
+#include "proto_index.h"
+#include "proto_shards.h"
+#include "stable_hash.h"
 #include "stg.pb.h"
 
 namespace stg {
@@ -44,13 +62,174 @@ namespace proto {
 
 namespace {
 
+// A sorted set of external ids, found by looking in a bucket selected by their
+// top bits. Stable hashes are well spread, so buckets are small.
+class SortedIds {
+ public:
+  explicit SortedIds(std::vector<uint32_t> ids) : ids_(std::move(ids)) {
+    std::sort(ids_.begin(), ids_.end());
+    ids_.erase(std::unique(ids_.begin(), ids_.end()), ids_.end());
+    size_t bits = 0;
+    while (bits < 32 && (size_t{1} << bits) < ids_.size()) {
+      ++bits;
+    }
+    shift_ = 32 - bits;
+    const size_t buckets = size_t{1} << bits;
+    starts_.reserve(buckets + 1);
+    size_t ix = 0;
+    for (size_t bucket = 0; bucket < buckets; ++bucket) {
+      while (ix < ids_.size() && Bucket(ids_[ix]) < bucket) {
+        ++ix;
+      }
+      starts_.push_back(ix);
+    }
+    starts_.push_back(ids_.size());
+  }
+
+  size_t Size() const {
+    return ids_.size();
+  }
+
+  uint32_t operator[](size_t ix) const {
+    return ids_[ix];
+  }
+
+  std::optional<size_t> Find(uint32_t id) const {
+    const size_t bucket = Bucket(id);
+    const auto begin = ids_.begin() + starts_[bucket];
+    const auto end = ids_.begin() + starts_[bucket + 1];
+    const auto it = std::lower_bound(begin, end, id);
+    if (it == end || *it != id) {
+      return {};
+    }
+    return {it - ids_.begin()};
+  }
+
+ private:
+  size_t Bucket(uint32_t id) const {
+    return static_cast<uint64_t>(id) >> shift_;
+  }
+
+  std::vector<uint32_t> ids_;
+  size_t shift_;
+  // start of each bucket, followed by the end of the last
+  std::vector<size_t> starts_;
+};
+
+// The external ids each kind of node refers to, see Transformer::Select.
+// Interfaces are handled there, as their symbols may be filtered.
+using Edges = std::vector<uint32_t>;
+
+template <typename ExternalIds>
+void AppendIds(const ExternalIds& ids, Edges& edges) {
+  edges.insert(edges.end(), ids.begin(), ids.end());
+}
+
+void AddEdges(const Void&, Edges&) {}
+
+void AddEdges(const Variadic&, Edges&) {}
+
+void AddEdges(const Special&, Edges&) {}
+
+void AddEdges(const PointerReference& x, Edges& edges) {
+  edges.push_back(x.pointee_type_id());
+}
+
+void AddEdges(const PointerToMember& x, Edges& edges) {
+  edges.push_back(x.containing_type_id());
+  edges.push_back(x.pointee_type_id());
+}
+
+void AddEdges(const Typedef& x, Edges& edges) {
+  edges.push_back(x.referred_type_id());
+}
+
+void AddEdges(const Qualified& x, Edges& edges) {
+  edges.push_back(x.qualified_type_id());
+}
+
+void AddEdges(const Primitive&, Edges&) {}
+
+void AddEdges(const Array& x, Edges& edges) {
+  edges.push_back(x.element_type_id());
+}
+
+void AddEdges(const BaseClass& x, Edges& edges) {
+  edges.push_back(x.type_id());
+}
+
+void AddEdges(const Method& x, Edges& edges) {
+  edges.push_back(x.type_id());
+}
+
+void AddEdges(const Member& x, Edges& edges) {
+  edges.push_back(x.type_id());
+}
+
+void AddEdges(const StructUnion& x, Edges& edges) {
+  if (x.has_definition()) {
+    const auto& definition = x.definition();
+    AppendIds(definition.base_class_id(), edges);
+    AppendIds(definition.method_id(), edges);
+    AppendIds(definition.member_id(), edges);
+  }
+}
+
+void AddEdges(const Enumeration& x, Edges& edges) {
+  if (x.has_definition()) {
+    edges.push_back(x.definition().underlying_type_id());
+  }
+}
+
+void AddEdges(const Function& x, Edges& edges) {
+  edges.push_back(x.return_type_id());
+  AppendIds(x.parameter_id(), edges);
+}
+
+void AddEdges(const ElfSymbol& x, Edges& edges) {
+  if (x.has_type_id()) {
+    edges.push_back(x.type_id());
+  }
+}
+
+void AddEdges(const Symbols& x, Edges& edges) {
+  for (const auto& [_, id] : x.symbol()) {
+    edges.push_back(id);
+  }
+}
+
+template <typename ProtoType>
+void AddEdges(const google::protobuf::RepeatedPtrField<ProtoType>& x,
+              std::unordered_map<uint32_t, Edges>& edges) {
+  for (const ProtoType& proto : x) {
+    AddEdges(proto, edges[proto.id()]);
+  }
+}
+
 struct Transformer {
-  explicit Transformer(Graph& graph) : graph(graph) {}
+  explicit Transformer(Graph& graph, const Filter* symbol_filter = nullptr)
+      : graph(graph), symbol_filter(symbol_filter) {}
+
+  // Restricts the nodes built to those reachable from the root, following only
+  // the interface symbols the symbol filter accepts. This must come first.
+  void Select(const std::vector<proto::STG*>&);
+  // Gives the nodes of the shards a contiguous block of graph ids, in external
+  // id order, so that references to them need no hashing.
+  void Reserve(const std::vector<proto::STG*>&);
 
-  Id Transform(const proto::STG&);
+  // The shards together make up the graph, the first has the root id.
+  Id Transform(const std::vector<proto::STG*>&);
+  void Transform(const StableHashes&, StableHashCache&);
+  // external id and hash
+  void Transform(const std::vector<std::pair<uint32_t, uint32_t>>& collisions,
+                 StableHashCache&);
 
   Id GetId(uint32_t);
+  std::optional<Id> FindId(uint32_t) const;
 
+  template <typename ProtoType>
+  void AddIds(const google::protobuf::RepeatedPtrField<ProtoType>&,
+              std::vector<uint32_t>&);
   template <typename ProtoType>
   void AddNodes(const google::protobuf::RepeatedPtrField<ProtoType>&);
   void AddNode(const Void&);
@@ -74,10 +253,11 @@ struct Transformer {
   template <typename STGType, typename... Args>
   void AddNode(Args&&...);
 
-  std::vector<Id> Transform(const google::protobuf::RepeatedField<uint32_t>&);
-  template <typename GetKey>
-  std::map<std::string, Id> Transform(GetKey,
-                                      const google::protobuf::RepeatedField<uint32_t>&);
+  Ids Transform(const google::protobuf::RepeatedField<uint32_t>&);
+  // Nodes whose keys the filter, if any, rejects are left out.
+  template <typename GetKey, typename ExternalIds>
+  std::map<std::string, Id> Transform(GetKey, const ExternalIds&,
+                                      const Filter* filter = nullptr);
   stg::Special::Kind Transform(Special::Kind);
   stg::PointerReference::Kind Transform(PointerReference::Kind);
   stg::Qualifier Transform(Qualified::Qualifier);
@@ -95,42 +275,229 @@ struct Transformer {
   Type Transform(const Type&);
 
   Graph& graph;
+  // if set, the symbols of interfaces are filtered
+  const Filter* symbol_filter;
+  std::optional<SortedIds> sorted_ids;
+  Id sorted_start = Id(0);
+  // external ids not reserved
   std::unordered_map<uint32_t, Id> id_map;
+  // if set, external ids given new graph ids are recorded here
+  std::vector<uint32_t>* fresh = nullptr;
+  // if set, the external ids of the only nodes built, see Select
+  std::optional<std::unordered_set<uint32_t>> selected;
+  // nodes not built as they are not selected
+  size_t skipped = 0;
 };
 
-Id Transformer::Transform(const proto::STG& x) {
-  AddNodes(x.void_());  // deprecated
-  AddNodes(x.variadic());  // deprecated
-  AddNodes(x.special());
-  AddNodes(x.pointer_reference());
-  AddNodes(x.pointer_to_member());
-  AddNodes(x.typedef_());
-  AddNodes(x.qualified());
-  AddNodes(x.primitive());
-  AddNodes(x.array());
-  AddNodes(x.base_class());
-  AddNodes(x.method());
-  AddNodes(x.member());
-  AddNodes(x.struct_union());
-  AddNodes(x.enumeration());
-  AddNodes(x.function());
-  AddNodes(x.elf_symbol());
-  AddNodes(x.symbols());
-  AddNodes(x.interface());
-  return GetId(x.root_id());
+void Transformer::Select(const std::vector<proto::STG*>& shards) {
+  Check(!sorted_ids && id_map.empty()) << "nodes selected too late";
+  std::unordered_map<uint32_t, Edges> edges;
+  std::unordered_map<uint32_t, const ElfSymbol*> symbols;
+  for (const auto* shard : shards) {
+    const auto& x = *shard;
+    AddEdges(x.void_(), edges);
+    AddEdges(x.variadic(), edges);
+    AddEdges(x.special(), edges);
+    AddEdges(x.pointer_reference(), edges);
+    AddEdges(x.pointer_to_member(), edges);
+    AddEdges(x.typedef_(), edges);
+    AddEdges(x.qualified(), edges);
+    AddEdges(x.primitive(), edges);
+    AddEdges(x.array(), edges);
+    AddEdges(x.base_class(), edges);
+    AddEdges(x.method(), edges);
+    AddEdges(x.member(), edges);
+    AddEdges(x.struct_union(), edges);
+    AddEdges(x.enumeration(), edges);
+    AddEdges(x.function(), edges);
+    AddEdges(x.elf_symbol(), edges);
+    AddEdges(x.symbols(), edges);
+    for (const auto& symbol : x.elf_symbol()) {
+      symbols.emplace(symbol.id(), &symbol);
+    }
+  }
+  // interface symbols are followed only if their keys are accepted
+  const auto accept = [&](uint32_t id) {
+    if (symbol_filter == nullptr) {
+      return true;
+    }
+    const auto it = symbols.find(id);
+    Check(it != symbols.end()) << "interface symbol " << id << " not found";
+    const auto& symbol = *it->second;
+    const auto& version = symbol.version_info();
+    const auto key =
+        symbol.name()
+        + (symbol.has_version_info()
+               ? VersionInfoToString(stg::ElfSymbol::VersionInfo{
+                     version.is_default(), version.name()})
+               : std::string());
+    return (*symbol_filter)(key);
+  };
+  for (const auto* shard : shards) {
+    for (const auto& x : shard->interface()) {
+      auto& out = edges[x.id()];
+      for (const auto id : x.symbol_id()) {
+        if (accept(id)) {
+          out.push_back(id);
+        }
+      }
+      AppendIds(x.type_id(), out);
+    }
+  }
+  auto& reached = selected.emplace();
+  std::vector<uint32_t> pending = {shards.front()->root_id()};
+  while (!pending.empty()) {
+    const auto id = pending.back();
+    pending.pop_back();
+    if (!reached.insert(id).second) {
+      continue;
+    }
+    const auto it = edges.find(id);
+    if (it != edges.end()) {
+      pending.insert(pending.end(), it->second.begin(), it->second.end());
+    }
+  }
+}
+
+void Transformer::Reserve(const std::vector<proto::STG*>& shards) {
+  Check(!sorted_ids && id_map.empty()) << "external ids reserved too late";
+  std::vector<uint32_t> external_ids;
+  for (const auto* shard : shards) {
+    const auto& x = *shard;
+    AddIds(x.void_(), external_ids);
+    AddIds(x.variadic(), external_ids);
+    AddIds(x.special(), external_ids);
+    AddIds(x.pointer_reference(), external_ids);
+    AddIds(x.pointer_to_member(), external_ids);
+    AddIds(x.typedef_(), external_ids);
+    AddIds(x.qualified(), external_ids);
+    AddIds(x.primitive(), external_ids);
+    AddIds(x.array(), external_ids);
+    AddIds(x.base_class(), external_ids);
+    AddIds(x.method(), external_ids);
+    AddIds(x.member(), external_ids);
+    AddIds(x.struct_union(), external_ids);
+    AddIds(x.enumeration(), external_ids);
+    AddIds(x.function(), external_ids);
+    AddIds(x.elf_symbol(), external_ids);
+    AddIds(x.symbols(), external_ids);
+    AddIds(x.interface(), external_ids);
+  }
+  sorted_ids.emplace(std::move(external_ids));
+  sorted_start = graph.Limit();
+  for (size_t ix = 0; ix < sorted_ids->Size(); ++ix) {
+    graph.Allocate();
+  }
+}
+
+Id Transformer::Transform(const std::vector<proto::STG*>& shards) {
+  for (const auto* shard : shards) {
+    const auto& x = *shard;
+    AddNodes(x.void_());  // deprecated
+    AddNodes(x.variadic());  // deprecated
+    AddNodes(x.special());
+    AddNodes(x.pointer_reference());
+    AddNodes(x.pointer_to_member());
+    AddNodes(x.typedef_());
+    AddNodes(x.qualified());
+    AddNodes(x.primitive());
+    AddNodes(x.array());
+    AddNodes(x.base_class());
+    AddNodes(x.method());
+    AddNodes(x.member());
+    AddNodes(x.struct_union());
+    AddNodes(x.enumeration());
+    AddNodes(x.function());
+    AddNodes(x.elf_symbol());
+    AddNodes(x.symbols());
+  }
+  // interface keys are looked up in the nodes referred to
+  for (const auto* x : shards) {
+    AddNodes(x->interface());
+  }
+  return GetId(shards.front()->root_id());
+}
+
+void Transformer::Transform(const StableHashes& x,
+                            StableHashCache& stable_hashes) {
+  std::vector<std::pair<uint32_t, uint32_t>> collisions;
+  collisions.reserve(x.collision().size());
+  for (const auto& collision : x.collision()) {
+    collisions.emplace_back(collision.id(), collision.hash());
+  }
+  Transform(collisions, stable_hashes);
+}
+
+void Transformer::Transform(
+    const std::vector<std::pair<uint32_t, uint32_t>>& collisions,
+    StableHashCache& stable_hashes) {
+  const size_t sorted_size = sorted_ids ? sorted_ids->Size() : 0;
+  stable_hashes.reserve(sorted_size + id_map.size());
+  for (size_t ix = 0; ix < sorted_size; ++ix) {
+    stable_hashes.emplace(Id(sorted_start.ix_ + ix),
+                          HashValue((*sorted_ids)[ix]));
+  }
+  for (const auto& [external_id, id] : id_map) {
+    stable_hashes.emplace(id, HashValue(external_id));
+  }
+  for (const auto& [external_id, hash] : collisions) {
+    if (selected && !selected->contains(external_id)) {
+      continue;
+    }
+    const auto id = FindId(external_id);
+    Check(id.has_value())
+        << "stable hash collision for unknown node " << external_id;
+    stable_hashes.insert_or_assign(*id, HashValue(hash));
+  }
 }
 
 Id Transformer::GetId(uint32_t id) {
+  if (sorted_ids) {
+    if (const auto ix = sorted_ids->Find(id)) {
+      return Id(sorted_start.ix_ + *ix);
+    }
+  }
   auto [it, inserted] = id_map.emplace(id, 0);
   if (inserted) {
     it->second = graph.Allocate();
+    if (fresh != nullptr) {
+      fresh->push_back(id);
+    }
   }
   return it->second;
 }
 
+std::optional<Id> Transformer::FindId(uint32_t id) const {
+  if (sorted_ids) {
+    if (const auto ix = sorted_ids->Find(id)) {
+      return {Id(sorted_start.ix_ + *ix)};
+    }
+  }
+  const auto it = id_map.find(id);
+  if (it == id_map.end()) {
+    return {};
+  }
+  return {it->second};
+}
+
+template <typename ProtoType>
+void Transformer::AddIds(
+    const google::protobuf::RepeatedPtrField<ProtoType>& x,
+    std::vector<uint32_t>& ids) {
+  for (const ProtoType& proto : x) {
+    if (!selected || selected->contains(proto.id())) {
+      ids.push_back(proto.id());
+    }
+  }
+}
+
 template <typename ProtoType>
 void Transformer::AddNodes(const google::protobuf::RepeatedPtrField<ProtoType>& x) {
   for (const ProtoType& proto : x) {
+    if (selected && !selected->contains(proto.id())) {
+      ++skipped;
+      continue;
+    }
     AddNode(proto);
   }
 }
@@ -241,16 +608,19 @@ void Transformer::AddNode(const ElfSymbol& x) {
 }
 
 void Transformer::AddNode(const Symbols& x) {
-  std::map<std::string, Id> symbols;
+  std::vector<std::pair<std::string, Id>> symbols;
+  symbols.reserve(x.symbol().size());
   for (const auto& [symbol, id] : x.symbol()) {
-    symbols.emplace(symbol, GetId(id));
+    symbols.emplace_back(symbol, GetId(id));
   }
-  AddNode<stg::Interface>(GetId(x.id()), symbols);
+  AddNode<stg::Interface>(GetId(x.id()),
+                          FlatMap<std::string, Id>(std::move(symbols)));
 }
 
 void Transformer::AddNode(const Interface& x) {
   const InterfaceKey get_key(graph);
-  AddNode<stg::Interface>(GetId(x.id()), Transform(get_key, x.symbol_id()),
+  AddNode<stg::Interface>(GetId(x.id()),
+                          Transform(get_key, x.symbol_id(), symbol_filter),
                           Transform(get_key, x.type_id()));
 }
 
@@ -259,9 +629,9 @@ void Transformer::AddNode(Args&&... args) {
   graph.Set<STGType>(Transform(args)...);
 }
 
-std::vector<Id> Transformer::Transform(
+Ids Transformer::Transform(
     const google::protobuf::RepeatedField<uint32_t>& ids) {
-  std::vector<Id> result;
+  Ids result;
   result.reserve(ids.size());
   for (uint32_t id : ids) {
     result.push_back(GetId(id));
@@ -269,13 +639,21 @@ std::vector<Id> Transformer::Transform(
   return result;
 }
 
-template <typename GetKey>
-std::map<std::string, Id> Transformer::Transform(
-    GetKey get_key, const google::protobuf::RepeatedField<uint32_t>& ids) {
+template <typename GetKey, typename ExternalIds>
+std::map<std::string, Id> Transformer::Transform(GetKey get_key,
+                                                 const ExternalIds& ids,
+                                                 const Filter* filter) {
   std::map<std::string, Id> result;
   for (auto id : ids) {
+    if (selected && !selected->contains(id)) {
+      continue;
+    }
     const Id stg_id = GetId(id);
-    const auto [it, inserted] = result.emplace(get_key(stg_id), stg_id);
+    auto key = get_key(stg_id);
+    if (filter != nullptr && !(*filter)(key)) {
+      continue;
+    }
+    const auto [it, inserted] = result.emplace(std::move(key), stg_id);
     if (!inserted) {
       Die() << "conflicting interface nodes: " << it->first;
     }
@@ -438,6 +816,898 @@ Type Transformer::Transform(const Type& x) {
   return x;
 }
 
+// A single-pass parser for STG text format as proto::Writer produces it, which
+// adds nodes to the graph as they are read rather than building a proto::STG
+// message first. Only fields of the current schema are recognised, with
+// singular fields given at most once and values in the plainest spelling.
+// Anything else is left to TextFormat.
+class TextParser {
+ public:
+  TextParser(Transformer& transformer, std::string_view input)
+      : transformer_(transformer), input_(input) {}
+
+  // Returns the root, or nothing if the input was not understood, in which
+  // case the nodes added so far have been removed again.
+  std::optional<Id> Parse() {
+    uint32_t seen = 0;
+    std::string_view field;
+    uint32_t root_id = 0;
+    while (Field(field, true)) {
+      if (Is(field, "version", 1, false, seen)) {
+        version_ = Number<uint32_t>();
+      } else if (Is(field, "root_id", 2, false, seen)) {
+        root_id = Number<uint32_t>();
+      } else if (Is(field, "special", 5, true, seen)) {
+        ParseSpecial();
+      } else if (Is(field, "pointer_reference", 6, true, seen)) {
+        ParsePointerReference();
+      } else if (Is(field, "pointer_to_member", 7, true, seen)) {
+        ParsePointerToMember();
+      } else if (Is(field, "typedef", 8, true, seen)) {
+        ParseTypedef();
+      } else if (Is(field, "qualified", 9, true, seen)) {
+        ParseQualified();
+      } else if (Is(field, "primitive", 10, true, seen)) {
+        ParsePrimitive();
+      } else if (Is(field, "array", 11, true, seen)) {
+        ParseArray();
+      } else if (Is(field, "base_class", 12, true, seen)) {
+        ParseBaseClass();
+      } else if (Is(field, "method", 13, true, seen)) {
+        ParseMethod();
+      } else if (Is(field, "member", 14, true, seen)) {
+        ParseMember();
+      } else if (Is(field, "struct_union", 15, true, seen)) {
+        ParseStructUnion();
+      } else if (Is(field, "enumeration", 16, true, seen)) {
+        ParseEnumeration();
+      } else if (Is(field, "function", 17, true, seen)) {
+        ParseFunction();
+      } else if (Is(field, "elf_symbol", 18, true, seen)) {
+        ParseElfSymbol();
+      } else if (Is(field, "interface", 20, true, seen)) {
+        ParseInterface();
+      } else if (Is(field, "stable_hashes", 21, false, seen)) {
+        ParseStableHashes();
+      } else if (Is(field, "canonical", 22, false, seen)) {
+        canonical_ = Bool();
+      } else {
+        Fail();
+      }
+    }
+    // interface keys are looked up in the nodes referred to
+    for (const auto& [id, symbol_ids, type_ids] : interfaces_) {
+      if (failed_) {
+        break;
+      }
+      const Id node = GetId(id);
+      const InterfaceKey get_key(transformer_.graph);
+      auto symbols = transformer_.Transform(get_key, symbol_ids,
+                                            transformer_.symbol_filter);
+      Add<stg::Interface>(node, std::move(symbols),
+                          transformer_.Transform(get_key, type_ids));
+    }
+    if (failed_) {
+      for (const Id id : added_) {
+        transformer_.graph.Unset(id);
+      }
+      return {};
+    }
+    return {transformer_.GetId(root_id)};
+  }
+
+  uint32_t Version() const {
+    return version_;
+  }
+
+  bool HasStableHashes() const {
+    return has_stable_hashes_;
+  }
+
+  bool Canonical() const {
+    return canonical_;
+  }
+
+  // external id and hash
+  const std::vector<std::pair<uint32_t, uint32_t>>& Collisions() const {
+    return collisions_;
+  }
+
+ private:
+  void ParseSpecial() {
+    Open();
+    uint32_t id = 0;
+    auto kind = Special::KIND_UNSPECIFIED;
+    uint32_t seen = 0;
+    std::string_view field;
+    while (Field(field)) {
+      if (Is(field, "id", 1, false, seen)) {
+        id = Number<uint32_t>();
+      } else if (Is(field, "kind", 2, false, seen)) {
+        kind = Enum<Special::Kind>(Special::Kind_Parse);
+      } else {
+        Fail();
+      }
+    }
+    if (!failed_) {
+      Add<stg::Special>(GetId(id), kind);
+    }
+  }
+
+  void ParsePointerReference() {
+    Open();
+    uint32_t id = 0;
+    auto kind = PointerReference::KIND_UNSPECIFIED;
+    uint32_t pointee_type_id = 0;
+    uint32_t seen = 0;
+    std::string_view field;
+    while (Field(field)) {
+      if (Is(field, "id", 1, false, seen)) {
+        id = Number<uint32_t>();
+      } else if (Is(field, "kind", 2, false, seen)) {
+        kind = Enum<PointerReference::Kind>(PointerReference::Kind_Parse);
+      } else if (Is(field, "pointee_type_id", 3, false, seen)) {
+        pointee_type_id = Number<uint32_t>();
+      } else {
+        Fail();
+      }
+    }
+    if (!failed_) {
+      const Id node = GetId(id);
+      Add<stg::PointerReference>(node, kind, GetId(pointee_type_id));
+    }
+  }
+
+  void ParsePointerToMember() {
+    Open();
+    uint32_t id = 0;
+    uint32_t containing_type_id = 0;
+    uint32_t pointee_type_id = 0;
+    uint32_t seen = 0;
+    std::string_view field;
+    while (Field(field)) {
+      if (Is(field, "id", 1, false, seen)) {
+        id = Number<uint32_t>();
+      } else if (Is(field, "containing_type_id", 2, false, seen)) {
+        containing_type_id = Number<uint32_t>();
+      } else if (Is(field, "pointee_type_id", 3, false, seen)) {
+        pointee_type_id = Number<uint32_t>();
+      } else {
+        Fail();
+      }
+    }
+    if (!failed_) {
+      const Id node = GetId(id);
+      const Id containing = GetId(containing_type_id);
+      Add<stg::PointerToMember>(node, containing, GetId(pointee_type_id));
+    }
+  }
+
+  void ParseTypedef() {
+    Open();
+    uint32_t id = 0;
+    std::string name;
+    uint32_t referred_type_id = 0;
+    uint32_t seen = 0;
+    std::string_view field;
+    while (Field(field)) {
+      if (Is(field, "id", 1, false, seen)) {
+        id = Number<uint32_t>();
+      } else if (Is(field, "name", 2, false, seen)) {
+        name = String();
+      } else if (Is(field, "referred_type_id", 3, false, seen)) {
+        referred_type_id = Number<uint32_t>();
+      } else {
+        Fail();
+      }
+    }
+    if (!failed_) {
+      const Id node = GetId(id);
+      Add<stg::Typedef>(node, name, GetId(referred_type_id));
+    }
+  }
+
+  void ParseQualified() {
+    Open();
+    uint32_t id = 0;
+    auto qualifier = Qualified::QUALIFIER_UNSPECIFIED;
+    uint32_t qualified_type_id = 0;
+    uint32_t seen = 0;
+    std::string_view field;
+    while (Field(field)) {
+      if (Is(field, "id", 1, false, seen)) {
+        id = Number<uint32_t>();
+      } else if (Is(field, "qualifier", 2, false, seen)) {
+        qualifier = Enum<Qualified::Qualifier>(Qualified::Qualifier_Parse);
+      } else if (Is(field, "qualified_type_id", 3, false, seen)) {
+        qualified_type_id = Number<uint32_t>();
+      } else {
+        Fail();
+      }
+    }
+    if (!failed_) {
+      const Id node = GetId(id);
+      Add<stg::Qualified>(node, qualifier, GetId(qualified_type_id));
+    }
+  }
+
+  void ParsePrimitive() {
+    Open();
+    uint32_t id = 0;
+    std::string name;
+    std::optional<Primitive::Encoding> encoding;
+    uint32_t bytesize = 0;
+    uint32_t seen = 0;
+    std::string_view field;
+    while (Field(field)) {
+      if (Is(field, "id", 1, false, seen)) {
+        id = Number<uint32_t>();
+      } else if (Is(field, "name", 2, false, seen)) {
+        name = String();
+      } else if (Is(field, "encoding", 3, false, seen)) {
+        encoding = Enum<Primitive::Encoding>(Primitive::Encoding_Parse);
+      } else if (Is(field, "bytesize", 4, false, seen)) {
+        bytesize = Number<uint32_t>();
+      } else {
+        Fail();
+      }
+    }
+    if (!failed_) {
+      const auto& stg_encoding =
+          transformer_.Transform<stg::Primitive::Encoding>(
+              encoding.has_value(), encoding.value_or(Primitive::NONE));
+      Add<stg::Primitive>(GetId(id), name, stg_encoding, bytesize);
+    }
+  }
+
+  void ParseArray() {
+    Open();
+    uint32_t id = 0;
+    uint64_t number_of_elements = 0;
+    uint32_t element_type_id = 0;
+    uint32_t seen = 0;
+    std::string_view field;
+    while (Field(field)) {
+      if (Is(field, "id", 1, false, seen)) {
+        id = Number<uint32_t>();
+      } else if (Is(field, "number_of_elements", 2, false, seen)) {
+        number_of_elements = Number<uint64_t>();
+      } else if (Is(field, "element_type_id", 3, false, seen)) {
+        element_type_id = Number<uint32_t>();
+      } else {
+        Fail();
+      }
+    }
+    if (!failed_) {
+      const Id node = GetId(id);
+      Add<stg::Array>(node, number_of_elements, GetId(element_type_id));
+    }
+  }
+
+  void ParseBaseClass() {
+    Open();
+    uint32_t id = 0;
+    uint32_t type_id = 0;
+    uint64_t offset = 0;
+    auto inheritance = BaseClass::INHERITANCE_UNSPECIFIED;
+    uint32_t seen = 0;
+    std::string_view field;
+    while (Field(field)) {
+      if (Is(field, "id", 1, false, seen)) {
+        id = Number<uint32_t>();
+      } else if (Is(field, "type_id", 2, false, seen)) {
+        type_id = Number<uint32_t>();
+      } else if (Is(field, "offset", 3, false, seen)) {
+        offset = Number<uint64_t>();
+      } else if (Is(field, "inheritance", 4, false, seen)) {
+        inheritance =
+            Enum<BaseClass::Inheritance>(BaseClass::Inheritance_Parse);
+      } else {
+        Fail();
+      }
+    }
+    if (!failed_) {
+      const Id node = GetId(id);
+      Add<stg::BaseClass>(node, GetId(type_id), offset, inheritance);
+    }
+  }
+
+  void ParseMethod() {
+    Open();
+    uint32_t id = 0;
+    std::string mangled_name;
+    std::string name;
+    uint64_t vtable_offset = 0;
+    uint32_t type_id = 0;
+    uint32_t seen = 0;
+    std::string_view field;
+    while (Field(field)) {
+      if (Is(field, "id", 1, false, seen)) {
+        id = Number<uint32_t>();
+      } else if (Is(field, "mangled_name", 2, false, seen)) {
+        mangled_name = String();
+      } else if (Is(field, "name", 3, false, seen)) {
+        name = String();
+      } else if (Is(field, "vtable_offset", 4, false, seen)) {
+        vtable_offset = Number<uint64_t>();
+      } else if (Is(field, "type_id", 5, false, seen)) {
+        type_id = Number<uint32_t>();
+      } else {
+        Fail();
+      }
+    }
+    if (!failed_) {
+      const Id node = GetId(id);
+      Add<stg::Method>(node, mangled_name, name, vtable_offset, GetId(type_id));
+    }
+  }
+
+  void ParseMember() {
+    Open();
+    uint32_t id = 0;
+    std::string name;
+    uint32_t type_id = 0;
+    uint64_t offset = 0;
+    uint64_t bitsize = 0;
+    uint32_t seen = 0;
+    std::string_view field;
+    while (Field(field)) {
+      if (Is(field, "id", 1, false, seen)) {
+        id = Number<uint32_t>();
+      } else if (Is(field, "name", 2, false, seen)) {
+        name = String();
+      } else if (Is(field, "type_id", 3, false, seen)) {
+        type_id = Number<uint32_t>();
+      } else if (Is(field, "offset", 4, false, seen)) {
+        offset = Number<uint64_t>();
+      } else if (Is(field, "bitsize", 5, false, seen)) {
+        bitsize = Number<uint64_t>();
+      } else {
+        Fail();
+      }
+    }
+    if (!failed_) {
+      const Id node = GetId(id);
+      Add<stg::Member>(node, name, GetId(type_id), offset, bitsize);
+    }
+  }
+
+  void ParseStructUnion() {
+    Open();
+    uint32_t id = 0;
+    auto kind = StructUnion::KIND_UNSPECIFIED;
+    std::string name;
+    bool has_definition = false;
+    uint64_t bytesize = 0;
+    std::vector<uint32_t> base_class_ids;
+    std::vector<uint32_t> method_ids;
+    std::vector<uint32_t> member_ids;
+    uint32_t seen = 0;
+    std::string_view field;
+    while (Field(field)) {
+      if (Is(field, "id", 1, false, seen)) {
+        id = Number<uint32_t>();
+      } else if (Is(field, "kind", 2, false, seen)) {
+        kind = Enum<StructUnion::Kind>(StructUnion::Kind_Parse);
+      } else if (Is(field, "name", 3, false, seen)) {
+        name = String();
+      } else if (Is(field, "definition", 4, false, seen)) {
+        has_definition = true;
+        Open();
+        uint32_t definition_seen = 0;
+        while (Field(field)) {
+          if (Is(field, "bytesize", 1, false, definition_seen)) {
+            bytesize = Number<uint64_t>();
+          } else if (Is(field, "base_class_id", 2, true, definition_seen)) {
+            base_class_ids.push_back(Number<uint32_t>());
+          } else if (Is(field, "method_id", 3, true, definition_seen)) {
+            method_ids.push_back(Number<uint32_t>());
+          } else if (Is(field, "member_id", 4, true, definition_seen)) {
+            member_ids.push_back(Number<uint32_t>());
+          } else {
+            Fail();
+          }
+        }
+      } else {
+        Fail();
+      }
+    }
+    if (!failed_) {
+      const Id node = GetId(id);
+      if (has_definition) {
+        auto base_classes = GetIds(base_class_ids);
+        auto methods = GetIds(method_ids);
+        Add<stg::StructUnion>(node, kind, name, bytesize,
+                              std::move(base_classes), std::move(methods),
+                              GetIds(member_ids));
+      } else {
+        Add<stg::StructUnion>(node, kind, name);
+      }
+    }
+  }
+
+  void ParseEnumeration() {
+    Open();
+    uint32_t id = 0;
+    std::string name;
+    bool has_definition = false;
+    uint32_t underlying_type_id = 0;
+    stg::Enumeration::Enumerators enumerators;
+    uint32_t seen = 0;
+    std::string_view field;
+    while (Field(field)) {
+      if (Is(field, "id", 1, false, seen)) {
+        id = Number<uint32_t>();
+      } else if (Is(field, "name", 2, false, seen)) {
+        name = String();
+      } else if (Is(field, "definition", 3, false, seen)) {
+        has_definition = true;
+        Open();
+        uint32_t definition_seen = 0;
+        while (Field(field)) {
+          if (Is(field, "underlying_type_id", 1, false, definition_seen)) {
+            underlying_type_id = Number<uint32_t>();
+          } else if (Is(field, "enumerator", 2, true, definition_seen)) {
+            enumerators.push_back(ParseEnumerator());
+          } else {
+            Fail();
+          }
+        }
+      } else {
+        Fail();
+      }
+    }
+    if (!failed_) {
+      const Id node = GetId(id);
+      if (has_definition) {
+        Add<stg::Enumeration>(node, name, GetId(underlying_type_id),
+                              std::move(enumerators));
+      } else {
+        Add<stg::Enumeration>(node, name);
+      }
+    }
+  }
+
+  std::pair<std::string_view, int64_t> ParseEnumerator() {
+    Open();
+    std::string name;
+    int64_t value = 0;
+    uint32_t seen = 0;
+    std::string_view field;
+    while (Field(field)) {
+      if (Is(field, "name", 1, false, seen)) {
+        name = String();
+      } else if (Is(field, "value", 2, false, seen)) {
+        value = Signed();
+      } else {
+        Fail();
+      }
+    }
+    return {transformer_.graph.Intern(name), value};
+  }
+
+  void ParseFunction() {
+    Open();
+    uint32_t id = 0;
+    uint32_t return_type_id = 0;
+    std::vector<uint32_t> parameter_ids;
+    uint32_t seen = 0;
+    std::string_view field;
+    while (Field(field)) {
+      if (Is(field, "id", 1, false, seen)) {
+        id = Number<uint32_t>();
+      } else if (Is(field, "return_type_id", 2, false, seen)) {
+        return_type_id = Number<uint32_t>();
+      } else if (Is(field, "parameter_id", 3, true, seen)) {
+        parameter_ids.push_back(Number<uint32_t>());
+      } else {
+        Fail();
+      }
+    }
+    if (!failed_) {
+      const Id node = GetId(id);
+      const Id return_type = GetId(return_type_id);
+      Add<stg::Function>(node, return_type, GetIds(parameter_ids));
+    }
+  }
+
+  void ParseElfSymbol() {
+    Open();
+    uint32_t id = 0;
+    std::string name;
+    std::optional<stg::ElfSymbol::VersionInfo> version_info;
+    bool is_defined = false;
+    auto symbol_type = ElfSymbol::SYMBOL_TYPE_UNSPECIFIED;
+    auto binding = ElfSymbol::GLOBAL;
+    auto visibility = ElfSymbol::DEFAULT;
+    std::optional<stg::ElfSymbol::CRC> crc;
+    std::optional<std::string> ns;
+    std::optional<uint32_t> type_id;
+    std::optional<std::string> full_name;
+    uint32_t seen = 0;
+    std::string_view field;
+    while (Field(field)) {
+      if (Is(field, "id", 1, false, seen)) {
+        id = Number<uint32_t>();
+      } else if (Is(field, "name", 2, false, seen)) {
+        name = String();
+      } else if (Is(field, "version_info", 3, false, seen)) {
+        version_info = ParseVersionInfo();
+      } else if (Is(field, "is_defined", 4, false, seen)) {
+        is_defined = Bool();
+      } else if (Is(field, "symbol_type", 5, false, seen)) {
+        symbol_type = Enum<ElfSymbol::SymbolType>(ElfSymbol::SymbolType_Parse);
+      } else if (Is(field, "binding", 6, false, seen)) {
+        binding = Enum<ElfSymbol::Binding>(ElfSymbol::Binding_Parse);
+      } else if (Is(field, "visibility", 7, false, seen)) {
+        visibility = Enum<ElfSymbol::Visibility>(ElfSymbol::Visibility_Parse);
+      } else if (Is(field, "crc", 8, false, seen)) {
+        crc.emplace(Number<uint32_t>());
+      } else if (Is(field, "namespace", 9, false, seen)) {
+        ns = String();
+      } else if (Is(field, "type_id", 10, false, seen)) {
+        type_id = Number<uint32_t>();
+      } else if (Is(field, "full_name", 11, false, seen)) {
+        full_name = String();
+      } else {
+        Fail();
+      }
+    }
+    if (!failed_) {
+      const Id node = GetId(id);
+      const auto& type =
+          type_id ? std::make_optional(GetId(*type_id)) : std::nullopt;
+      Add<stg::ElfSymbol>(node, name, version_info, is_defined, symbol_type,
+                          binding, visibility, crc, ns, type, full_name);
+    }
+  }
+
+  stg::ElfSymbol::VersionInfo ParseVersionInfo() {
+    Open();
+    bool is_default = false;
+    std::string name;
+    uint32_t seen = 0;
+    std::string_view field;
+    while (Field(field)) {
+      if (Is(field, "is_default", 1, false, seen)) {
+        is_default = Bool();
+      } else if (Is(field, "name", 2, false, seen)) {
+        name = String();
+      } else {
+        Fail();
+      }
+    }
+    return {is_default, std::move(name)};
+  }
+
+  void ParseInterface() {
+    Open();
+    uint32_t id = 0;
+    std::vector<uint32_t> symbol_ids;
+    std::vector<uint32_t> type_ids;
+    uint32_t seen = 0;
+    std::string_view field;
+    while (Field(field)) {
+      if (Is(field, "id", 1, false, seen)) {
+        id = Number<uint32_t>();
+      } else if (Is(field, "symbol_id", 2, true, seen)) {
+        symbol_ids.push_back(Number<uint32_t>());
+      } else if (Is(field, "type_id", 3, true, seen)) {
+        type_ids.push_back(Number<uint32_t>());
+      } else {
+        Fail();
+      }
+    }
+    interfaces_.push_back({id, std::move(symbol_ids), std::move(type_ids)});
+  }
+
+  void ParseStableHashes() {
+    Open();
+    has_stable_hashes_ = true;
+    uint32_t seen = 0;
+    std::string_view field;
+    while (Field(field)) {
+      if (Is(field, "collision", 1, true, seen)) {
+        Open();
+        uint32_t id = 0;
+        uint32_t hash = 0;
+        uint32_t collision_seen = 0;
+        while (Field(field)) {
+          if (Is(field, "id", 1, false, collision_seen)) {
+            id = Number<uint32_t>();
+          } else if (Is(field, "hash", 2, false, collision_seen)) {
+            hash = Number<uint32_t>();
+          } else {
+            Fail();
+          }
+        }
+        collisions_.emplace_back(id, hash);
+      } else {
+        Fail();
+      }
+    }
+  }
+
+  Id GetId(uint32_t id) {
+    return transformer_.GetId(id);
+  }
+
+  Ids GetIds(const std::vector<uint32_t>& ids) {
+    Ids result;
+    result.reserve(ids.size());
+    for (const uint32_t id : ids) {
+      result.push_back(GetId(id));
+    }
+    return result;
+  }
+
+  template <typename Node, typename... Args>
+  void Add(Id id, Args&&... args) {
+    transformer_.AddNode<Node>(id, std::forward<Args>(args)...);
+    added_.push_back(id);
+  }
+
+  // Gives up, leaving nothing more to read.
+  void Fail() {
+    failed_ = true;
+    pos_ = input_.size();
+  }
+
+  // Matches a field name, checking that singular fields are not repeated.
+  bool Is(std::string_view field, std::string_view name, int number,
+          bool repeated, uint32_t& seen) {
+    if (field != name) {
+      return false;
+    }
+    const uint32_t bit = uint32_t{1} << number;
+    if (!repeated && (seen & bit) != 0) {
+      Fail();
+    }
+    seen |= bit;
+    return true;
+  }
+
+  void SkipSpace() {
+    while (pos_ < input_.size()) {
+      const char c = input_[pos_];
+      if (c == '#') {
+        const auto end = input_.find('\n', pos_);
+        pos_ = end == std::string_view::npos ? input_.size() : end;
+      } else if (c == ' ' || c == '\n' || c == '\t' || c == '\r' || c == '\v'
+                 || c == '\f') {
+        ++pos_;
+      } else {
+        break;
+      }
+    }
+  }
+
+  static bool IsIdentifier(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z')
+        || (c >= '0' && c <= '9') || c == '_';
+  }
+
+  // Reads the next field name of a message, returning false at its end. The
+  // top level ends at the end of input, nested messages at a closing brace.
+  bool Field(std::string_view& field, bool top = false) {
+    SkipSpace();
+    if (pos_ == input_.size()) {
+      if (!top) {
+        Fail();
+      }
+      return false;
+    }
+    if (!top && input_[pos_] == '}') {
+      ++pos_;
+      return false;
+    }
+    field = Identifier();
+    return !failed_;
+  }
+
+  std::string_view Identifier() {
+    const size_t start = pos_;
+    while (pos_ < input_.size() && IsIdentifier(input_[pos_])) {
+      ++pos_;
+    }
+    if (pos_ == start || (input_[start] >= '0' && input_[start] <= '9')) {
+      Fail();
+      return {};
+    }
+    return input_.substr(start, pos_ - start);
+  }
+
+  void Expect(char c) {
+    SkipSpace();
+    if (pos_ < input_.size() && input_[pos_] == c) {
+      ++pos_;
+    } else {
+      Fail();
+    }
+  }
+
+  void Open() {
+    Expect('{');
+  }
+
+  // Reads a value of the form that the writer uses, hexadecimal or decimal
+  // without leading zeros.
+  template <typename Int>
+  Int Number() {
+    Expect(':');
+    SkipSpace();
+    return Unsigned<Int>();
+  }
+
+  template <typename Int>
+  Int Unsigned() {
+    const size_t start = pos_;
+    const bool hex = input_.substr(pos_, 2) == "0x";
+    if (hex) {
+      pos_ += 2;
+    }
+    const unsigned base = hex ? 16 : 10;
+    const size_t digits = pos_;
+    uint64_t value = 0;
+    while (pos_ < input_.size() && IsIdentifier(input_[pos_])) {
+      const char c = input_[pos_];
+      unsigned digit;
+      if (c >= '0' && c <= '9') {
+        digit = c - '0';
+      } else if (hex && c >= 'a' && c <= 'f') {
+        digit = c - 'a' + 10;
+      } else if (hex && c >= 'A' && c <= 'F') {
+        digit = c - 'A' + 10;
+      } else {
+        Fail();
+        return 0;
+      }
+      if (value > (std::numeric_limits<Int>::max() - digit) / base) {
+        Fail();
+        return 0;
+      }
+      value = value * base + digit;
+      ++pos_;
+    }
+    // octal and floating point values are not expected
+    if (pos_ == digits || (!hex && input_[start] == '0' && pos_ - start > 1)
+        || (pos_ < input_.size() && input_[pos_] == '.')) {
+      Fail();
+      return 0;
+    }
+    return static_cast<Int>(value);
+  }
+
+  int64_t Signed() {
+    Expect(':');
+    SkipSpace();
+    const bool negative = pos_ < input_.size() && input_[pos_] == '-';
+    if (negative) {
+      ++pos_;
+    }
+    const uint64_t magnitude = Unsigned<uint64_t>();
+    const uint64_t limit =
+        static_cast<uint64_t>(std::numeric_limits<int64_t>::max()) + negative;
+    if (magnitude > limit) {
+      Fail();
+      return 0;
+    }
+    return negative ? static_cast<int64_t>(0 - magnitude)
+                    : static_cast<int64_t>(magnitude);
+  }
+
+  bool Bool() {
+    Expect(':');
+    SkipSpace();
+    const auto value = Identifier();
+    if (value != "true" && value != "false") {
+      Fail();
+    }
+    return value == "true";
+  }
+
+  template <typename Value, typename Parse>
+  Value Enum(Parse parse) {
+    Expect(':');
+    SkipSpace();
+    Value value{};
+    if (!parse(std::string(Identifier()), &value)) {
+      Fail();
+    }
+    return value;
+  }
+
+  // Reads a double-quoted string with the escapes the writer uses or TextFormat
+  // understands, apart from Unicode ones.
+  std::string String() {
+    Expect(':');
+    Expect('"');
+    std::string result;
+    while (true) {
+      const size_t end = input_.find_first_of("\"\\\n", pos_);
+      if (end == std::string_view::npos || input_[end] == '\n') {
+        Fail();
+        return {};
+      }
+      result.append(input_.substr(pos_, end - pos_));
+      pos_ = end + 1;
+      if (input_[end] == '"') {
+        break;
+      }
+      if (pos_ == input_.size()) {
+        Fail();
+        return {};
+      }
+      const char c = input_[pos_++];
+      switch (c) {
+        case 'a': result.push_back('\a'); break;
+        case 'b': result.push_back('\b'); break;
+        case 'f': result.push_back('\f'); break;
+        case 'n': result.push_back('\n'); break;
+        case 'r': result.push_back('\r'); break;
+        case 't': result.push_back('\t'); break;
+        case 'v': result.push_back('\v'); break;
+        case '\\': case '?': case '\'': case '"': result.push_back(c); break;
+        case 'x': {
+          unsigned value = 0;
+          size_t digits = 0;
+          while (digits < 2 && pos_ < input_.size()
+                 && std::isxdigit(static_cast<unsigned char>(input_[pos_]))) {
+            const char d = input_[pos_++];
+            value = value * 16 + (d <= '9' ? d - '0' : (d | 0x20) - 'a' + 10);
+            ++digits;
+          }
+          if (digits == 0) {
+            Fail();
+            return {};
+          }
+          result.push_back(static_cast<char>(value));
+          break;
+        }
+        default: {
+          if (c < '0' || c > '7') {
+            Fail();
+            return {};
+          }
+          unsigned value = c - '0';
+          for (size_t digits = 1; digits < 3 && pos_ < input_.size()
+                   && input_[pos_] >= '0' && input_[pos_] <= '7'; ++digits) {
+            value = value * 8 + (input_[pos_++] - '0');
+          }
+          if (value > 0xff) {
+            Fail();
+            return {};
+          }
+          result.push_back(static_cast<char>(value));
+          break;
+        }
+      }
+    }
+    // adjacent strings are concatenated by TextFormat
+    SkipSpace();
+    if (pos_ < input_.size() && (input_[pos_] == '"' || input_[pos_] == '\'')) {
+      Fail();
+    }
+    return result;
+  }
+
+  Transformer& transformer_;
+  const std::string_view input_;
+  size_t pos_ = 0;
+  bool failed_ = false;
+  uint32_t version_ = 0;
+  bool has_stable_hashes_ = false;
+  bool canonical_ = false;
+  std::vector<std::pair<uint32_t, uint32_t>> collisions_;
+  std::vector<Id> added_;
+  struct PendingInterface {
+    uint32_t id;
+    std::vector<uint32_t> symbol_ids;
+    std::vector<uint32_t> type_ids;
+  };
+  std::vector<PendingInterface> interfaces_;
+};
+
 const std::array<uint32_t, 3> kSupportedFormatVersions = {0, 1, 2};
 
 void CheckFormatVersion(uint32_t version, std::optional<std::string> path) {
@@ -457,24 +1727,343 @@ void CheckFormatVersion(uint32_t version, std::optional<std::string> path) {
   }
 }
 
+// STG text format starts with a comment, whitespace or a field name. STG binary
+// format starts with the tag of the version field, which is always present.
+bool IsBinary(int first) {
+  return first == 0x08;
+}
+
+// A stream over input of any size. Protobuf's own array streams take an int
+// size.
+class ViewInputStream : public google::protobuf::io::ZeroCopyInputStream {
+ public:
+  explicit ViewInputStream(std::string_view input) : input_(input) {}
+
+  bool Next(const void** data, int* size) override {
+    if (position_ == input_.size()) {
+      return false;
+    }
+    const size_t count = std::min(input_.size() - position_, kChunkSize);
+    *data = input_.data() + position_;
+    *size = static_cast<int>(count);
+    position_ += count;
+    return true;
+  }
+
+  void BackUp(int count) override {
+    position_ -= count;
+  }
+
+  bool Skip(int count) override {
+    if (static_cast<size_t>(count) > input_.size() - position_) {
+      position_ = input_.size();
+      return false;
+    }
+    position_ += count;
+    return true;
+  }
+
+  int64_t ByteCount() const override {
+    return static_cast<int64_t>(position_);
+  }
+
+ private:
+  static constexpr size_t kChunkSize = 1 << 30;
+
+  std::string_view input_;
+  size_t position_ = 0;
+};
+
+// Parses a binary message. Input too large for protobuf's array parsing is
+// streamed instead, and fails cleanly if protobuf cannot take it.
+bool ParseBinary(google::protobuf::MessageLite& message,
+                 std::string_view input) {
+  if (input.size() <= static_cast<size_t>(std::numeric_limits<int>::max())) {
+    return message.ParseFromArray(input.data(),
+                                  static_cast<int>(input.size()));
+  }
+  ViewInputStream stream(input);
+  return message.ParseFromZeroCopyStream(&stream);
+}
+
+// Parses the shards concurrently, into the arena.
+std::vector<proto::STG*> ParseShards(std::string_view input, size_t jobs,
+                                     google::protobuf::Arena& arena) {
+  input.remove_prefix(kShardsMagic.size());
+  ViewInputStream stream(input);
+  google::protobuf::io::CodedInputStream coded(&stream);
+  uint64_t count;
+  Check(coded.ReadVarint64(&count) && count > 0 && count <= input.size())
+      << "bad STG shard count";
+  std::vector<uint64_t> sizes(count);
+  for (auto& size : sizes) {
+    Check(coded.ReadVarint64(&size)) << "bad STG shard size";
+  }
+  std::vector<std::string_view> pieces;
+  pieces.reserve(count);
+  size_t offset = coded.CurrentPosition();
+  for (const auto size : sizes) {
+    Check(size <= input.size() - offset) << "truncated STG shard";
+    pieces.push_back(input.substr(offset, size));
+    offset += size;
+  }
+  Check(offset == input.size()) << "trailing data after STG shards";
+  std::vector<proto::STG*> shards(count);
+  ForEachIndex(jobs, count, [&](size_t, size_t ix) {
+    const auto& piece = pieces[ix];
+    shards[ix] = google::protobuf::Arena::Create<proto::STG>(&arena);
+    Check(ParseBinary(*shards[ix], piece))
+        << "failed to parse STG shard " << ix;
+  });
+  return shards;
+}
+
+// gzip streams start with a magic number that is not valid STG, in any format.
+constexpr std::string_view kGzipMagic = "\x1f\x8b";
+
+// Decompresses and parses the input as it goes, without holding a copy of the
+// uncompressed data. The hand-written parser needs contiguous input, so text is
+// parsed using TextFormat.
+proto::STG* ParseCompressed(std::string_view input,
+                            google::protobuf::Arena& arena) {
+  ViewInputStream stream(input);
+  google::protobuf::io::GzipInputStream gzip(
+      &stream, google::protobuf::io::GzipInputStream::GZIP);
+  const void* data;
+  int size = 0;
+  while (size == 0) {
+    Check(gzip.Next(&data, &size)) << "failed to decompress STG";
+  }
+  const std::string_view start(static_cast<const char*>(data), size);
+  gzip.BackUp(size);
+  Check(!start.starts_with(kShardsMagic))
+      << "compressed sharded STG is not supported";
+  auto* stg = google::protobuf::Arena::Create<proto::STG>(&arena);
+  if (IsBinary(start[0])) {
+    Check(stg->ParseFromZeroCopyStream(&gzip))
+        << "failed to parse compressed binary STG";
+  } else {
+    Check(google::protobuf::TextFormat::Parse(&gzip, stg))
+        << "failed to parse compressed STG";
+  }
+  return stg;
+}
+
+// If external_ids is given, the input extends the nodes they map to, see
+// ReadExtension. With a symbol filter, text is not parsed in a single pass, as
+// the nodes to build are selected before any are built.
+Id Parse(Graph& graph, std::string_view input,
+         const std::optional<std::string>& path,
+         StableHashCache* stable_hashes, IdMapping id_mapping, size_t jobs,
+         bool* canonical, const Filter* symbol_filter, Metrics* metrics,
+         ExternalIdMap* external_ids = nullptr) {
+  const bool compressed = input.starts_with(kGzipMagic);
+  const bool sharded = input.substr(0, kShardsMagic.size()) == kShardsMagic;
+  const bool binary = !input.empty() && IsBinary(input[0]);
+  if (!compressed && !sharded && !binary && external_ids == nullptr
+      && symbol_filter == nullptr) {
+    Transformer transformer(graph, symbol_filter);
+    TextParser parser(transformer, input);
+    if (const auto root = parser.Parse()) {
+      CheckFormatVersion(parser.Version(), path);
+      if (stable_hashes != nullptr && parser.HasStableHashes()) {
+        transformer.Transform(parser.Collisions(), *stable_hashes);
+      }
+      if (canonical != nullptr) {
+        *canonical = parser.Canonical();
+      }
+      return *root;
+    }
+  }
+  // The messages are allocated from an arena, so that their many sub-messages
+  // and strings are cheap to allocate and are all freed at once, as soon as
+  // they have been transformed.
+  google::protobuf::Arena arena;
+  std::vector<proto::STG*> shards;
+  if (compressed) {
+    shards.push_back(ParseCompressed(input, arena));
+  } else if (sharded) {
+    shards = ParseShards(input, jobs, arena);
+  } else if (binary) {
+    auto* stg = shards.emplace_back(
+        google::protobuf::Arena::Create<proto::STG>(&arena));
+    Check(ParseBinary(*stg, input)) << "failed to parse binary STG";
+  } else {
+    auto* stg = shards.emplace_back(
+        google::protobuf::Arena::Create<proto::STG>(&arena));
+    ViewInputStream is(input);
+    google::protobuf::TextFormat::Parse(&is, stg);
+  }
+  const auto& first = *shards.front();
+  CheckFormatVersion(first.version(), path);
+  Transformer transformer(graph, symbol_filter);
+  if (symbol_filter != nullptr) {
+    transformer.Select(shards);
+  }
+  if (external_ids != nullptr) {
+    // earlier nodes are found, and new ones added, by hashing
+    transformer.id_map = std::move(*external_ids);
+  } else if (id_mapping == IdMapping::SORTED) {
+    transformer.Reserve(shards);
+  }
+  const Id root = transformer.Transform(shards);
+  if (metrics != nullptr && symbol_filter != nullptr) {
+    Counter(*metrics, "proto.skipped_nodes") = transformer.skipped;
+  }
+  if (external_ids != nullptr) {
+    *external_ids = std::move(transformer.id_map);
+  }
+  if (stable_hashes != nullptr && first.has_stable_hashes()) {
+    transformer.Transform(first.stable_hashes(), *stable_hashes);
+  }
+  if (canonical != nullptr) {
+    *canonical = first.canonical();
+  }
+  return root;
+}
+
+template <typename ProtoType>
+void AddIndexedNode(Transformer& transformer, std::string_view message) {
+  ProtoType node;
+  Check(ParseBinary(node, message)) << "failed to parse indexed STG node";
+  transformer.AddNode(node);
+}
+
+void AddIndexedNode(Transformer& transformer, uint32_t field,
+                    std::string_view message) {
+  switch (field) {
+    case STG::kVoidFieldNumber:
+      return AddIndexedNode<Void>(transformer, message);
+    case STG::kVariadicFieldNumber:
+      return AddIndexedNode<Variadic>(transformer, message);
+    case STG::kSpecialFieldNumber:
+      return AddIndexedNode<Special>(transformer, message);
+    case STG::kPointerReferenceFieldNumber:
+      return AddIndexedNode<PointerReference>(transformer, message);
+    case STG::kPointerToMemberFieldNumber:
+      return AddIndexedNode<PointerToMember>(transformer, message);
+    case STG::kTypedefFieldNumber:
+      return AddIndexedNode<Typedef>(transformer, message);
+    case STG::kQualifiedFieldNumber:
+      return AddIndexedNode<Qualified>(transformer, message);
+    case STG::kPrimitiveFieldNumber:
+      return AddIndexedNode<Primitive>(transformer, message);
+    case STG::kArrayFieldNumber:
+      return AddIndexedNode<Array>(transformer, message);
+    case STG::kBaseClassFieldNumber:
+      return AddIndexedNode<BaseClass>(transformer, message);
+    case STG::kMethodFieldNumber:
+      return AddIndexedNode<Method>(transformer, message);
+    case STG::kMemberFieldNumber:
+      return AddIndexedNode<Member>(transformer, message);
+    case STG::kStructUnionFieldNumber:
+      return AddIndexedNode<StructUnion>(transformer, message);
+    case STG::kEnumerationFieldNumber:
+      return AddIndexedNode<Enumeration>(transformer, message);
+    case STG::kFunctionFieldNumber:
+      return AddIndexedNode<Function>(transformer, message);
+    case STG::kElfSymbolFieldNumber:
+      return AddIndexedNode<ElfSymbol>(transformer, message);
+    case STG::kSymbolsFieldNumber:
+      return AddIndexedNode<Symbols>(transformer, message);
+    default:
+      // interfaces are only reached from the root
+      Die() << "unexpected indexed STG field " << field;
+  }
+}
+
+// The contents of a file. Files are mapped rather than read, so that
+// concurrent readers of the same file share the page cache and no copy of the
+// input is made, but pipes, such as those of process substitution, are read.
+class InputFile {
+ public:
+  explicit InputFile(const std::string& path)
+      : fd_(path.c_str(), O_RDONLY), map_(MemoryMap::TryMap(fd_)) {
+    if (!map_) {
+      contents_ = ReadContents(fd_);
+    }
+  }
+
+  std::string_view Contents() const {
+    return map_ ? map_->Contents() : std::string_view(contents_);
+  }
+
+ private:
+  const FileDescriptor fd_;
+  const std::optional<MemoryMap> map_;
+  std::string contents_;
+};
+
 }  // namespace
 
-Id Read(Graph& graph, const std::string& path) {
-  std::ifstream ifs(path);
-  Check(ifs.good()) << "error opening file '" << path
-                    << "' for reading: " << Error(errno);
-  google::protobuf::io::IstreamInputStream is(&ifs);
-  proto::STG stg;
-  google::protobuf::TextFormat::Parse(&is, &stg);
-  CheckFormatVersion(stg.version(), path);
-  return Transformer(graph).Transform(stg);
-}
-
-Id ReadFromString(Graph& graph, const std::string_view input) {
-  proto::STG stg;
-  google::protobuf::TextFormat::ParseFromString(std::string(input), &stg);
-  CheckFormatVersion(stg.version(), std::nullopt);
-  return Transformer(graph).Transform(stg);
+Id Read(Graph& graph, const std::string& path,
+        StableHashCache* stable_hashes, IdMapping id_mapping, size_t jobs,
+        bool* canonical, const Filter* symbol_filter, Metrics* metrics) {
+  const InputFile file(path);
+  return Parse(graph, file.Contents(), path, stable_hashes, id_mapping, jobs,
+               canonical, symbol_filter, metrics);
+}
+
+Id ReadFromString(Graph& graph, const std::string_view input,
+                  StableHashCache* stable_hashes, IdMapping id_mapping,
+                  size_t jobs, bool* canonical,
+                  const Filter* symbol_filter, Metrics* metrics) {
+  return Parse(graph, input, std::nullopt, stable_hashes, id_mapping, jobs,
+               canonical, symbol_filter, metrics);
+}
+
+Id ReadExtension(Graph& graph, const std::string& path,
+                 ExternalIdMap& external_ids, size_t jobs) {
+  const InputFile file(path);
+  const Id start = graph.Limit();
+  const Id root = Parse(graph, file.Contents(), path, nullptr,
+                        IdMapping::HASHED, jobs, nullptr, nullptr, nullptr,
+                        &external_ids);
+  // every node referred to is either earlier or defined by the input
+  for (size_t ix = start.ix_; ix < graph.Limit().ix_; ++ix) {
+    Check(graph.Is(Id(ix)))
+        << "STG extension '" << path << "' refers to unknown nodes";
+  }
+  return root;
+}
+
+Id ReadIndexed(Graph& graph, const std::string& path,
+               const std::vector<std::string>& symbols,
+               const std::vector<std::string>& types) {
+  const InputFile file(path);
+  const InputFile index_file(path + std::string(kIndexSuffix));
+  const std::string_view input = file.Contents();
+  const Index index(index_file.Contents());
+  CheckFormatVersion(index.Version(), path);
+
+  // Each node is read when first referred to, starting from those named.
+  Transformer transformer(graph);
+  std::vector<uint32_t> fresh;
+  transformer.fresh = &fresh;
+  std::map<std::string, Id> symbol_ids;
+  for (const auto& name : symbols) {
+    const auto id = index.Symbol(name);
+    Check(id.has_value()) << "symbol not in STG index: " << name;
+    symbol_ids.emplace(name, transformer.GetId(*id));
+  }
+  std::map<std::string, Id> type_ids;
+  for (const auto& name : types) {
+    const auto id = index.Type(name);
+    Check(id.has_value()) << "type not in STG index: " << name;
+    type_ids.emplace(name, transformer.GetId(*id));
+  }
+  while (!fresh.empty()) {
+    const uint32_t id = fresh.back();
+    fresh.pop_back();
+    const auto node = index.Find(id);
+    Check(node.has_value()) << "node not in STG index: " << id;
+    Check(node->offset <= input.size()
+          && node->size <= input.size() - node->offset)
+        << "STG index does not match '" << path << "'";
+    AddIndexedNode(transformer, node->field,
+                   input.substr(node->offset, node->size));
+  }
+  return graph.Add<stg::Interface>(std::move(symbol_ids), std::move(type_ids));
 }
 
 }  // namespace proto
@@ -20,16 +20,64 @@
 #ifndef STG_PROTO_READER_H_
 #define STG_PROTO_READER_H_
 
+#include <cstddef>
+#include <cstdint>
 #include <string>
 #include <string_view>
+#include <unordered_map>
+#include <vector>
 
+#include "filter.h"
 #include "graph.h"
+#include "metrics.h"
+#include "stable_hash.h"
 
 namespace stg {
 namespace proto {
 
-Id Read(Graph&, const std::string&);
-Id ReadFromString(Graph&, std::string_view);
+// How external node ids are mapped to graph ids when reading a whole message.
+// HASHED looks up every reference in a hash table. SORTED first gives all the
+// nodes a block of graph ids in external id order and finds references in a
+// bucketed sorted table. Text that is parsed in a single pass always hashes.
+enum class IdMapping { HASHED, SORTED };
+
+// If stable_hashes is given and the input records them, it is filled with the
+// stable hashes of the nodes read. The shards of sharded input are parsed by at
+// most jobs workers. If canonical is given, it is set to whether the input
+// claims to be resolved and deduplicated. If symbol_filter is given, the
+// interface only has the symbols it accepts and only the nodes reachable from
+// these and its types are built. The count of nodes left out is then recorded
+// in metrics, if given, as proto.skipped_nodes.
+Id Read(Graph&, const std::string&, StableHashCache* stable_hashes = nullptr,
+        IdMapping id_mapping = IdMapping::SORTED, size_t jobs = 1,
+        bool* canonical = nullptr, const Filter* symbol_filter = nullptr,
+        Metrics* metrics = nullptr);
+Id ReadFromString(Graph&, std::string_view,
+                  StableHashCache* stable_hashes = nullptr,
+                  IdMapping id_mapping = IdMapping::SORTED, size_t jobs = 1,
+                  bool* canonical = nullptr,
+                  const Filter* symbol_filter = nullptr,
+                  Metrics* metrics = nullptr);
+
+// External ids and the graph ids of the nodes read with them, see
+// ReadExtension.
+using ExternalIdMap = std::unordered_map<uint32_t, Id>;
+
+// Reads input that extends nodes read earlier into the same graph, such as that
+// written by a Writer given their external ids, see Writer::Extend. References
+// to external ids in the map are to the earlier nodes and the external ids of
+// the nodes read are added to it. All other references must be to nodes in the
+// input.
+Id ReadExtension(Graph&, const std::string&, ExternalIdMap& external_ids,
+                 size_t jobs = 1);
+
+// Reads just the named symbols and types of the root interface of binary or
+// sharded STG, and the nodes they reach, using the index written alongside it,
+// see Writer::Index. Returns a new interface holding only these. Nothing else
+// is parsed, so this takes time in proportion to what is read.
+Id ReadIndexed(Graph&, const std::string&,
+               const std::vector<std::string>& symbols,
+               const std::vector<std::string>& types = {});
 
 }  // namespace proto
 }  // namespace stg
@@ -0,0 +1,41 @@
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+// -*- mode: C++ -*-
+//
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License v2.0 with LLVM Exceptions (the
+// "License"); you may not use this file except in compliance with the
+// License.  You may obtain a copy of the License at
+//
+//     https://llvm.org/LICENSE.txt
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef STG_PROTO_SHARDS_H_
+#define STG_PROTO_SHARDS_H_
+
+#include <cstddef>
+#include <string_view>
+
+namespace stg {
+namespace proto {
+
+// Sharded STG starts with this magic, which is neither protobuf wire format nor
+// text. It is followed by the number of shards and the size of each, all as
+// varints, and then the shards themselves. Each shard is an STG message in
+// wire format and the concatenation of the shards, which protobuf parses as
+// their merge, is the whole graph. The first shard carries the version, root
+// id and stable hashes, as well as the special and interface nodes.
+inline constexpr std::string_view kShardsMagic = "\x89STG\r\n\x1a\n";
+
+// The number of nodes in each shard, other than the first.
+inline constexpr size_t kNodesPerShard = size_t{1} << 16;
+
+}  // namespace proto
+}  // namespace stg
+
+#endif  // STG_PROTO_SHARDS_H_
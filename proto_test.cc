@@ -0,0 +1,550 @@
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+// -*- mode: C++ -*-
+//
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License v2.0 with LLVM Exceptions (the
+// "License"); you may not use this file except in compliance with the
+// License.  You may obtain a copy of the License at
+//
+//     https://llvm.org/LICENSE.txt
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <sys/stat.h>
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <ios>
+#include <map>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <variant>
+#include <vector>
+
+#include <catch2/catch.hpp>
+#include <google/protobuf/text_format.h>
+#include "error.h"
+#include "filter.h"
+#include "graph.h"
+#include "metrics.h"
+#include "proto_index.h"
+#include "proto_reader.h"
+#include "proto_writer.h"
+#include "stable_hash.h"
+#include "stg.pb.h"
+
+namespace Test {
+
+std::string Write(const stg::Graph& graph, stg::Id root,
+                  stg::proto::Format format,
+                  bool record_stable_hashes = false,
+                  stg::proto::Compression compression =
+                      stg::proto::Compression::NONE,
+                  bool canonical = false) {
+  std::ostringstream os;
+  stg::proto::Writer writer(graph);
+  writer.Write(root, os, format, record_stable_hashes, compression, canonical);
+  return os.str();
+}
+
+// Checks that the recorded stable hashes are those that would be computed.
+void CheckStableHashes(const stg::Graph& graph,
+                       const stg::StableHashCache& stable_hashes) {
+  stg::StableHash stable_hash(graph);
+  for (const auto& [id, hash] : stable_hashes) {
+    CHECK(stable_hash(id) == hash);
+  }
+}
+
+TEST_CASE("binary round trip") {
+  const auto input = GENERATE(
+      "crc_change_0.stg",
+      "enum_underlying_type_0.stg",
+      "fidelity_diff_0.stg",
+      "interface_addition_0.stg",
+      "member_size_0.stg",
+      "primitive_type_encoding_0.stg",
+      "qualifier_0.stg",
+      "type_addition_0.stg");
+  SECTION(input) {
+    const auto path = std::filesystem::path("testdata") / input;
+    stg::Graph graph;
+    const auto root = stg::proto::Read(graph, path);
+    const auto text = Write(graph, root, stg::proto::Format::TEXT);
+    const auto binary = Write(graph, root, stg::proto::Format::BINARY);
+    CHECK(binary.size() < text.size());
+
+    stg::Graph from_text;
+    const auto text_root = stg::proto::ReadFromString(from_text, text);
+    CHECK(Write(from_text, text_root, stg::proto::Format::TEXT) == text);
+
+    stg::Graph from_binary;
+    const auto binary_root = stg::proto::ReadFromString(from_binary, binary);
+    CHECK(Write(from_binary, binary_root, stg::proto::Format::TEXT) == text);
+    CHECK(Write(from_binary, binary_root, stg::proto::Format::BINARY)
+          == binary);
+
+    stg::Graph hashed;
+    const auto hashed_root = stg::proto::ReadFromString(
+        hashed, binary, nullptr, stg::proto::IdMapping::HASHED);
+    CHECK(Write(hashed, hashed_root, stg::proto::Format::BINARY) == binary);
+  }
+}
+
+TEST_CASE("reading from a pipe") {
+  const auto format = GENERATE(stg::proto::Format::TEXT,
+                               stg::proto::Format::BINARY,
+                               stg::proto::Format::SHARDED);
+  stg::Graph graph;
+  const auto root = stg::proto::Read(
+      graph, std::filesystem::path("testdata") / "qualifier_0.stg");
+  const auto contents = Write(graph, root, format);
+  const auto expected = Write(graph, root, stg::proto::Format::TEXT);
+
+  std::string directory = std::filesystem::temp_directory_path() / "stg-XXXXXX";
+  REQUIRE(mkdtemp(directory.data()) != nullptr);
+  const auto path = std::filesystem::path(directory) / "pipe";
+  REQUIRE(mkfifo(path.c_str(), 0600) == 0);
+  // opening either end of a FIFO waits for the other
+  std::thread writer([&] {
+    std::ofstream os(path, std::ios::binary);
+    os << contents;
+  });
+  stg::Graph other;
+  const auto other_root = stg::proto::Read(other, path);
+  writer.join();
+  CHECK(Write(other, other_root, stg::proto::Format::TEXT) == expected);
+  std::filesystem::remove_all(directory);
+}
+
+TEST_CASE("stable hashes round trip") {
+  const auto input = GENERATE(
+      "crc_change_0.stg",
+      "member_size_0.stg",
+      "type_addition_0.stg");
+  SECTION(input) {
+    const auto path = std::filesystem::path("testdata") / input;
+    stg::Graph graph;
+    stg::StableHashCache none;
+    const auto root = stg::proto::Read(graph, path, &none);
+    CHECK(none.empty());
+    const auto text = Write(graph, root, stg::proto::Format::TEXT, true);
+
+    stg::Graph from_text;
+    stg::StableHashCache stable_hashes;
+    const auto text_root =
+        stg::proto::ReadFromString(from_text, text, &stable_hashes);
+    CHECK(stable_hashes.size() == from_text.Limit().ix_);
+    CheckStableHashes(from_text, stable_hashes);
+
+    // reusing the hashes gives the same output
+    std::ostringstream os;
+    stg::proto::Writer writer(from_text, stable_hashes);
+    writer.Write(text_root, os, stg::proto::Format::TEXT, true);
+    CHECK(os.str() == text);
+  }
+}
+
+TEST_CASE("stable hash collisions") {
+  // typedefs are hashed by name only
+  stg::Graph graph;
+  const auto int_type = graph.Add<stg::Primitive>(
+      "int", stg::Primitive::Encoding::SIGNED_INTEGER, 4);
+  const auto char_type = graph.Add<stg::Primitive>(
+      "char", stg::Primitive::Encoding::SIGNED_CHARACTER, 1);
+  const auto symbol = graph.Add<stg::ElfSymbol>(
+      "s", std::nullopt, true, stg::ElfSymbol::SymbolType::OBJECT,
+      stg::ElfSymbol::Binding::GLOBAL, stg::ElfSymbol::Visibility::DEFAULT,
+      std::nullopt, std::nullopt, graph.Add<stg::Typedef>("t", char_type),
+      std::nullopt);
+  const auto root = graph.Add<stg::Interface>(
+      std::map<std::string, stg::Id>{{"s", symbol}},
+      std::map<std::string, stg::Id>{
+          {"t", graph.Add<stg::Typedef>("t", int_type)}});
+  const auto text = Write(graph, root, stg::proto::Format::TEXT, true);
+  CHECK(text.find("collision") != std::string::npos);
+  const auto binary = Write(graph, root, stg::proto::Format::BINARY, true);
+
+  stg::Graph from_binary;
+  stg::StableHashCache stable_hashes;
+  const auto binary_root =
+      stg::proto::ReadFromString(from_binary, binary, &stable_hashes);
+  CHECK(stable_hashes.size() == 6);
+  CheckStableHashes(from_binary, stable_hashes);
+  CHECK(Write(from_binary, binary_root, stg::proto::Format::BINARY, true)
+        == binary);
+}
+
+TEST_CASE("text spellings") {
+  // the first is as written, the others are left to TextFormat in whole or in
+  // part
+  const std::vector<std::string> inputs = {
+    "version: 0x00000002\n"
+    "root_id: 0x00000001\n"
+    "primitive {\n"
+    "  id: 0x00000002\n"
+    "  name: \"int\"\n"
+    "  encoding: SIGNED_INTEGER\n"
+    "  bytesize: 0x00000004\n"
+    "}\n"
+    "enumeration {\n"
+    "  id: 0x00000003\n"
+    "  name: \"e\"\n"
+    "  definition {\n"
+    "    underlying_type_id: 0x00000002\n"
+    "    enumerator {\n"
+    "      name: \"minus\"\n"
+    "      value: -1\n"
+    "    }\n"
+    "  }\n"
+    "}\n"
+    "elf_symbol {\n"
+    "  id: 0x00000004\n"
+    "  name: \"s\\t\\\"\\303\\251\"\n"
+    "  is_defined: true\n"
+    "  symbol_type: OBJECT\n"
+    "  type_id: 0x00000003\n"
+    "}\n"
+    "interface {\n"
+    "  id: 0x00000001\n"
+    "  symbol_id: 0x00000004\n"
+    "  type_id: 0x00000003\n"
+    "}\n",
+    // comments, layout and field order
+    "# comment\n"
+    "interface { id: 1 type_id: 3 symbol_id: 4 }\n"
+    "elf_symbol { type_id: 3 id: 4 name: \"s\\x09\\\"\xc3\xa9\""
+    " is_defined: true symbol_type: OBJECT }  # comment\n"
+    "primitive { encoding: SIGNED_INTEGER id: 2 name: \"int\" bytesize: 4 }\n"
+    "enumeration { id: 3 name: \"e\" definition {\n"
+    "  underlying_type_id: 2 enumerator { value: -1 name: \"minus\" } } }\n"
+    "root_id: 1 version: 2\n",
+    // spellings only TextFormat understands
+    "version: 2;\n"
+    "root_id: 0X1\n"
+    "primitive < id: 2 name: 'int' encoding: 3 bytesize: 04 >\n"
+    "enumeration: { id: 3 name: \"e\" definition {\n"
+    "  underlying_type_id: 2 enumerator { name: \"mi\" \"nus\" value: -1 }"
+    " } }\n"
+    "elf_symbol { id: 4 name: \"s\\t\\\"\\u00e9\""
+    " is_defined: t symbol_type: OBJECT type_id: 3 }\n"
+    "interface { id: 1 symbol_id: [4] type_id: 3 }\n",
+    // a field of an old schema
+    "version: 2\n"
+    "root_id: 1\n"
+    "void { id: 5 }\n"
+    "primitive { id: 2 name: \"int\" encoding: SIGNED_INTEGER bytesize: 4 }\n"
+    "enumeration { id: 3 name: \"e\" definition {\n"
+    "  underlying_type_id: 2 enumerator { name: \"minus\" value: -1 } } }\n"
+    "elf_symbol { id: 4 name: \"s\\t\\\"\\303\\251\" is_defined: true"
+    " symbol_type: OBJECT type_id: 3 }\n"
+    "interface { id: 1 symbol_id: 4 type_id: 3 }\n",
+  };
+  stg::Graph graph;
+  const auto root = stg::proto::ReadFromString(graph, inputs[0]);
+  const auto expected = Write(graph, root, stg::proto::Format::TEXT);
+  for (const auto& input : inputs) {
+    GIVEN("input: " + input) {
+      stg::Graph other;
+      const auto other_root = stg::proto::ReadFromString(other, input);
+      CHECK(Write(other, other_root, stg::proto::Format::TEXT) == expected);
+    }
+  }
+}
+
+TEST_CASE("sharded round trip") {
+  // enough nodes for several shards
+  stg::Graph graph;
+  const auto int_type = graph.Add<stg::Primitive>(
+      "int", stg::Primitive::Encoding::SIGNED_INTEGER, 4);
+  std::map<std::string, stg::Id> types;
+  for (size_t i = 0; i < 150000; ++i) {
+    const auto name = "t" + std::to_string(i);
+    types.emplace(name, graph.Add<stg::Typedef>(name, int_type));
+  }
+  const auto root = graph.Add<stg::Interface>(
+      std::map<std::string, stg::Id>{}, std::move(types));
+  for (const bool record_stable_hashes : {false, true}) {
+    const auto binary =
+        Write(graph, root, stg::proto::Format::BINARY, record_stable_hashes);
+    const auto sharded =
+        Write(graph, root, stg::proto::Format::SHARDED, record_stable_hashes);
+    for (const size_t jobs : {1, 4}) {
+      stg::Graph from_sharded;
+      stg::StableHashCache stable_hashes;
+      const auto sharded_root = stg::proto::ReadFromString(
+          from_sharded, sharded, &stable_hashes, stg::proto::IdMapping::SORTED,
+          jobs);
+      CHECK(stable_hashes.size()
+            == (record_stable_hashes ? from_sharded.Limit().ix_ : 0));
+      CHECK(Write(from_sharded, sharded_root, stg::proto::Format::BINARY,
+                  record_stable_hashes) == binary);
+    }
+  }
+}
+
+TEST_CASE("compressed round trip") {
+  const auto input = GENERATE(
+      "crc_change_0.stg",
+      "fidelity_diff_0.stg",
+      "type_addition_0.stg");
+  SECTION(input) {
+    const auto path = std::filesystem::path("testdata") / input;
+    stg::Graph graph;
+    const auto root = stg::proto::Read(graph, path);
+    for (const auto format :
+         {stg::proto::Format::TEXT, stg::proto::Format::BINARY}) {
+      for (const bool record_stable_hashes : {false, true}) {
+        const auto plain = Write(graph, root, format, record_stable_hashes);
+        const auto compressed = Write(graph, root, format, record_stable_hashes,
+                                      stg::proto::Compression::GZIP);
+        CHECK(compressed.starts_with("\x1f\x8b"));
+        stg::Graph from_compressed;
+        stg::StableHashCache stable_hashes;
+        const auto compressed_root = stg::proto::ReadFromString(
+            from_compressed, compressed, &stable_hashes);
+        CHECK(stable_hashes.size()
+              == (record_stable_hashes ? from_compressed.Limit().ix_ : 0));
+        CHECK(Write(from_compressed, compressed_root, format,
+                    record_stable_hashes) == plain);
+      }
+    }
+  }
+}
+
+TEST_CASE("canonical round trip") {
+  const auto path = std::filesystem::path("testdata") / "crc_change_0.stg";
+  stg::Graph graph;
+  const auto root = stg::proto::Read(graph, path);
+  for (const auto format :
+       {stg::proto::Format::TEXT, stg::proto::Format::BINARY,
+        stg::proto::Format::SHARDED}) {
+    for (const auto compression :
+         {stg::proto::Compression::NONE, stg::proto::Compression::GZIP}) {
+      if (format == stg::proto::Format::SHARDED
+          && compression != stg::proto::Compression::NONE) {
+        continue;
+      }
+      for (const bool canonical : {false, true}) {
+        const auto written =
+            Write(graph, root, format, false, compression, canonical);
+        stg::Graph other;
+        bool read_canonical = !canonical;
+        const auto other_root = stg::proto::ReadFromString(
+            other, written, nullptr, stg::proto::IdMapping::SORTED, 1,
+            &read_canonical);
+        CHECK(read_canonical == canonical);
+        CHECK(Write(other, other_root, stg::proto::Format::TEXT)
+              == Write(graph, root, stg::proto::Format::TEXT));
+      }
+    }
+  }
+}
+
+TEST_CASE("parallel writing matches serial") {
+  const auto input = GENERATE(
+      "crc_change_0.stg",
+      "fidelity_diff_0.stg",
+      "member_size_0.stg",
+      "type_addition_0.stg");
+  SECTION(input) {
+    const auto path = std::filesystem::path("testdata") / input;
+    stg::Graph graph;
+    const auto root = stg::proto::Read(graph, path);
+    for (const auto format :
+         {stg::proto::Format::TEXT, stg::proto::Format::BINARY}) {
+      for (const bool record_stable_hashes : {false, true}) {
+        const auto serial = Write(graph, root, format, record_stable_hashes);
+        std::ostringstream os;
+        stg::proto::Writer writer(graph, {}, 4);
+        writer.Write(root, os, format, record_stable_hashes);
+        CHECK(os.str() == serial);
+      }
+    }
+    const auto stable_hashes = stg::ComputeStableHashes(graph, {}, 4);
+    CHECK(stable_hashes.size() == graph.Limit().ix_);
+    CheckStableHashes(graph, stable_hashes);
+  }
+}
+
+// The way text used to be printed, from a complete proto::STG message.
+class HexPrinter : public google::protobuf::TextFormat::FastFieldValuePrinter {
+  void PrintUInt32(uint32_t value,
+                   google::protobuf::TextFormat::BaseTextGenerator* generator)
+      const override {
+    std::ostringstream os;
+    os << std::showbase << std::hex << std::setfill('0') << std::internal
+       << std::setw(10) << value;
+    generator->PrintString(os.str());
+  }
+};
+
+std::string PrintProto(const std::string& binary) {
+  stg::proto::STG stg;
+  REQUIRE(stg.ParseFromString(binary));
+  google::protobuf::TextFormat::Printer printer;
+  printer.SetDefaultFieldValuePrinter(new HexPrinter());
+  std::string output;
+  printer.PrintToString(stg, &output);
+  return output;
+}
+
+TEST_CASE("text matches protobuf text format") {
+  stg::Graph graph;
+  const auto int_type = graph.Add<stg::Primitive>(
+      "int", stg::Primitive::Encoding::SIGNED_INTEGER, 4);
+  const auto odd_type = graph.Add<stg::Primitive>(
+      "odd \"'\\\n\t\r\x01\x7f\xc3\xa9", std::nullopt, 0);
+  const auto member = graph.Add<stg::Member>("", int_type, 0, 0);
+  const auto method = graph.Add<stg::Method>(
+      "_ZN1s1fEv", "f", 3, graph.Add<stg::Function>(int_type,
+                                                      std::vector<stg::Id>{}));
+  const auto base = graph.Add<stg::BaseClass>(
+      graph.Add<stg::StructUnion>(stg::StructUnion::Kind::STRUCT, "b"), 0,
+      stg::BaseClass::Inheritance::VIRTUAL);
+  const auto struct_type = graph.Add<stg::StructUnion>(
+      stg::StructUnion::Kind::UNION, "s", 0, std::vector<stg::Id>{base},
+      std::vector<stg::Id>{method}, std::vector<stg::Id>{member});
+  const auto enum_type = graph.Add<stg::Enumeration>(
+      "e", int_type,
+      stg::Enumeration::Enumerators{{"minus", -1}, {"zero", 0}, {"", 1}});
+  const auto symbol = graph.Add<stg::ElfSymbol>(
+      "s", stg::ElfSymbol::VersionInfo{false, ""}, false,
+      stg::ElfSymbol::SymbolType::OBJECT, stg::ElfSymbol::Binding::WEAK,
+      stg::ElfSymbol::Visibility::HIDDEN, stg::ElfSymbol::CRC{0},
+      std::string(), struct_type, std::string());
+  const auto root = graph.Add<stg::Interface>(
+      std::map<std::string, stg::Id>{{"s", symbol}},
+      std::map<std::string, stg::Id>{
+          {"e", enum_type}, {"o", odd_type},
+          {"t", graph.Add<stg::Typedef>("t", int_type)}});
+  for (const bool record_stable_hashes : {false, true}) {
+    for (const bool canonical : {false, true}) {
+      const auto text =
+          Write(graph, root, stg::proto::Format::TEXT, record_stable_hashes,
+                stg::proto::Compression::NONE, canonical);
+      const auto binary =
+          Write(graph, root, stg::proto::Format::BINARY, record_stable_hashes,
+                stg::proto::Compression::NONE, canonical);
+      CHECK(text == PrintProto(binary));
+    }
+  }
+}
+
+// An interface with a function symbol f taking a pointer to struct s, which is
+// also a type, and, if wanted, an object symbol g of another type.
+stg::Id IndexedInterface(stg::Graph& graph, bool with_g) {
+  const auto int_type = graph.Add<stg::Primitive>(
+      "int", stg::Primitive::Encoding::SIGNED_INTEGER, 4);
+  const auto member = graph.Add<stg::Member>("x", int_type, 0, 0);
+  const auto struct_type = graph.Add<stg::StructUnion>(
+      stg::StructUnion::Kind::STRUCT, "s", 4, std::vector<stg::Id>{},
+      std::vector<stg::Id>{}, std::vector<stg::Id>{member});
+  const auto function = graph.Add<stg::Function>(
+      int_type, stg::Ids{graph.Add<stg::PointerReference>(
+                    stg::PointerReference::Kind::POINTER, struct_type)});
+  const auto symbol = [&](const char* name, stg::ElfSymbol::SymbolType type,
+                          stg::Id id) {
+    return graph.Add<stg::ElfSymbol>(
+        name, std::nullopt, true, type, stg::ElfSymbol::Binding::GLOBAL,
+        stg::ElfSymbol::Visibility::DEFAULT, std::nullopt, std::nullopt, id,
+        std::nullopt);
+  };
+  std::map<std::string, stg::Id> symbols = {
+      {"f", symbol("f", stg::ElfSymbol::SymbolType::FUNCTION, function)}};
+  if (with_g) {
+    const auto long_type = graph.Add<stg::Primitive>(
+        "long", stg::Primitive::Encoding::SIGNED_INTEGER, 8);
+    symbols.emplace("g",
+                    symbol("g", stg::ElfSymbol::SymbolType::OBJECT, long_type));
+  }
+  return graph.Add<stg::Interface>(
+      std::move(symbols), std::map<std::string, stg::Id>{{"struct s",
+                                                           struct_type}});
+}
+
+TEST_CASE("indexed reading") {
+  std::string directory = std::filesystem::temp_directory_path() / "stg-XXXXXX";
+  REQUIRE(mkdtemp(directory.data()) != nullptr);
+  stg::Graph graph;
+  const auto root = IndexedInterface(graph, true);
+  stg::Graph expected_graph;
+  const auto expected_root = IndexedInterface(expected_graph, false);
+  const auto expected =
+      Write(expected_graph, expected_root, stg::proto::Format::TEXT);
+
+  for (const auto format :
+       {stg::proto::Format::BINARY, stg::proto::Format::SHARDED}) {
+    const auto path = std::filesystem::path(directory) / "indexed.stg";
+    {
+      std::ofstream os(path, std::ios::binary);
+      std::ofstream index(path.string() + std::string(stg::proto::kIndexSuffix),
+                          std::ios::binary);
+      stg::proto::Writer writer(graph);
+      writer.Index(index);
+      writer.Write(root, os, format);
+    }
+    stg::Graph other;
+    const auto other_root =
+        stg::proto::ReadIndexed(other, path, {"f"}, {"struct s"});
+    CHECK(Write(other, other_root, stg::proto::Format::TEXT) == expected);
+    // nothing of g is read
+    CHECK(other.Limit().ix_ == expected_graph.Limit().ix_);
+    CHECK_THROWS_AS(stg::proto::ReadIndexed(other, path, {"h"}),
+                    stg::Exception);
+    CHECK_THROWS_AS(stg::proto::ReadIndexed(other, path, {}, {"struct t"}),
+                    stg::Exception);
+  }
+
+  std::ostringstream os;
+  std::ostringstream index;
+  stg::proto::Writer writer(graph);
+  writer.Index(index);
+  CHECK_THROWS_AS(writer.Write(root, os, stg::proto::Format::TEXT),
+                  stg::Exception);
+  std::filesystem::remove_all(directory);
+}
+
+TEST_CASE("symbol filter") {
+  stg::Graph graph;
+  const auto root = IndexedInterface(graph, true);
+  stg::Graph expected_graph;
+  const auto expected_root = IndexedInterface(expected_graph, false);
+  const auto expected =
+      Write(expected_graph, expected_root, stg::proto::Format::TEXT);
+  const auto filter = stg::MakeFilter("f");
+
+  for (const auto format : {stg::proto::Format::TEXT,
+                            stg::proto::Format::BINARY,
+                            stg::proto::Format::SHARDED}) {
+    for (const auto id_mapping :
+         {stg::proto::IdMapping::HASHED, stg::proto::IdMapping::SORTED}) {
+      const auto input = Write(graph, root, format, true);
+      stg::Graph other;
+      stg::StableHashCache stable_hashes;
+      stg::Metrics metrics;
+      const auto other_root = stg::proto::ReadFromString(
+          other, input, &stable_hashes, id_mapping, 1, nullptr, filter.get(),
+          &metrics);
+      CHECK(Write(other, other_root, stg::proto::Format::TEXT) == expected);
+      // neither g nor its type is built
+      CHECK(other.Limit().ix_ == expected_graph.Limit().ix_);
+      REQUIRE(metrics.size() == 1);
+      CHECK(std::string(metrics[0].name) == "proto.skipped_nodes");
+      CHECK(std::get<size_t>(metrics[0].value) == 2);
+      CHECK(stable_hashes.size() == other.Limit().ix_);
+    }
+  }
+}
+
+}  // namespace Test
@@ -20,20 +20,33 @@
 #include "proto_writer.h"
 
 #include <algorithm>
+#include <cstddef>
 #include <cstdint>
 #include <functional>
-#include <iomanip>
-#include <ios>
 #include <ostream>
+#include <span>
 #include <sstream>
+#include <streambuf>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 #include <unordered_set>
+#include <utility>
 #include <vector>
 
+#include <google/protobuf/arena.h>
+#include <google/protobuf/io/coded_stream.h>
+#include <google/protobuf/io/gzip_stream.h>
+#include <google/protobuf/io/zero_copy_stream.h>
+#include <google/protobuf/io/zero_copy_stream_impl.h>
+#include <google/protobuf/io/zero_copy_stream_impl_lite.h>
 #include <google/protobuf/repeated_ptr_field.h>
-#include <google/protobuf/text_format.h>
+#include "error.h"
+#include "flat_map.h"
 #include "graph.h"
+#include "parallel.h"
+#include "proto_index.h"
+#include "proto_shards.h"
 #include "stable_hash.h"
 #include "stg.pb.h"
 
@@ -44,7 +57,8 @@ namespace {
 
 class StableId {
  public:
-  explicit StableId(const Graph& graph) : stable_hash_(graph) {}
+  StableId(const Graph& graph, const StableHashCache& stable_hashes)
+      : stable_hash_(graph, stable_hashes) {}
 
   uint32_t operator()(Id id) {
     return stable_hash_(id).value;
@@ -54,6 +68,151 @@ class StableId {
   StableHash stable_hash_;
 };
 
+// Allocates unique external ids, probing upwards from the mapped id of each
+// node. Probing for a repeated mapped id resumes where the last probe for it
+// stopped, so that many nodes with one mapped id, as in graphs that still
+// have duplicates, do not cost quadratic time. The ids are the same as those
+// found by probing from the start.
+class ExternalIds {
+ public:
+  uint32_t operator()(uint32_t mapped_id) {
+    if (used_.insert(mapped_id).second) {
+      return mapped_id;
+    }
+    auto& resume = resume_.emplace(mapped_id, mapped_id + 1).first->second;
+    uint32_t id = resume;
+    while (!used_.insert(id).second) {
+      ++id;
+    }
+    resume = id + 1;
+    return id;
+  }
+
+  // Marks an id as taken, by a node written before.
+  void Take(uint32_t id) {
+    used_.insert(id);
+  }
+
+ private:
+  std::unordered_set<uint32_t> used_;
+  std::unordered_map<uint32_t, uint32_t> resume_;
+};
+
+PointerReference::Kind ToProto(stg::PointerReference::Kind x) {
+  switch (x) {
+    case stg::PointerReference::Kind::POINTER:
+      return PointerReference::POINTER;
+    case stg::PointerReference::Kind::LVALUE_REFERENCE:
+      return PointerReference::LVALUE_REFERENCE;
+    case stg::PointerReference::Kind::RVALUE_REFERENCE:
+      return PointerReference::RVALUE_REFERENCE;
+  }
+}
+
+Special::Kind ToProto(stg::Special::Kind x) {
+  switch (x) {
+    case stg::Special::Kind::VOID:
+      return Special::VOID;
+    case stg::Special::Kind::VARIADIC:
+      return Special::VARIADIC;
+    case stg::Special::Kind::NULLPTR:
+      return Special::NULLPTR;
+  }
+}
+
+Qualified::Qualifier ToProto(stg::Qualifier x) {
+  switch (x) {
+    case stg::Qualifier::CONST:
+      return Qualified::CONST;
+    case stg::Qualifier::VOLATILE:
+      return Qualified::VOLATILE;
+    case stg::Qualifier::RESTRICT:
+      return Qualified::RESTRICT;
+    case stg::Qualifier::ATOMIC:
+      return Qualified::ATOMIC;
+  }
+}
+
+Primitive::Encoding ToProto(stg::Primitive::Encoding x) {
+  switch (x) {
+    case stg::Primitive::Encoding::BOOLEAN:
+      return Primitive::BOOLEAN;
+    case stg::Primitive::Encoding::SIGNED_INTEGER:
+      return Primitive::SIGNED_INTEGER;
+    case stg::Primitive::Encoding::UNSIGNED_INTEGER:
+      return Primitive::UNSIGNED_INTEGER;
+    case stg::Primitive::Encoding::SIGNED_CHARACTER:
+      return Primitive::SIGNED_CHARACTER;
+    case stg::Primitive::Encoding::UNSIGNED_CHARACTER:
+      return Primitive::UNSIGNED_CHARACTER;
+    case stg::Primitive::Encoding::REAL_NUMBER:
+      return Primitive::REAL_NUMBER;
+    case stg::Primitive::Encoding::COMPLEX_NUMBER:
+      return Primitive::COMPLEX_NUMBER;
+    case stg::Primitive::Encoding::UTF:
+      return Primitive::UTF;
+  }
+}
+
+BaseClass::Inheritance ToProto(stg::BaseClass::Inheritance x) {
+  switch (x) {
+    case stg::BaseClass::Inheritance::NON_VIRTUAL:
+      return BaseClass::NON_VIRTUAL;
+    case stg::BaseClass::Inheritance::VIRTUAL:
+      return BaseClass::VIRTUAL;
+  }
+}
+
+StructUnion::Kind ToProto(stg::StructUnion::Kind x) {
+  switch (x) {
+    case stg::StructUnion::Kind::STRUCT:
+      return StructUnion::STRUCT;
+    case stg::StructUnion::Kind::UNION:
+      return StructUnion::UNION;
+  }
+}
+
+ElfSymbol::SymbolType ToProto(stg::ElfSymbol::SymbolType x) {
+  switch (x) {
+    case stg::ElfSymbol::SymbolType::OBJECT:
+      return ElfSymbol::OBJECT;
+    case stg::ElfSymbol::SymbolType::FUNCTION:
+      return ElfSymbol::FUNCTION;
+    case stg::ElfSymbol::SymbolType::COMMON:
+      return ElfSymbol::COMMON;
+    case stg::ElfSymbol::SymbolType::TLS:
+      return ElfSymbol::TLS;
+    case stg::ElfSymbol::SymbolType::GNU_IFUNC:
+      return ElfSymbol::GNU_IFUNC;
+  }
+}
+
+ElfSymbol::Binding ToProto(stg::ElfSymbol::Binding x) {
+  switch (x) {
+    case stg::ElfSymbol::Binding::GLOBAL:
+      return ElfSymbol::GLOBAL;
+    case stg::ElfSymbol::Binding::LOCAL:
+      return ElfSymbol::LOCAL;
+    case stg::ElfSymbol::Binding::WEAK:
+      return ElfSymbol::WEAK;
+    case stg::ElfSymbol::Binding::GNU_UNIQUE:
+      return ElfSymbol::GNU_UNIQUE;
+  }
+}
+
+ElfSymbol::Visibility ToProto(stg::ElfSymbol::Visibility x) {
+  switch (x) {
+    case stg::ElfSymbol::Visibility::DEFAULT:
+      return ElfSymbol::DEFAULT;
+    case stg::ElfSymbol::Visibility::PROTECTED:
+      return ElfSymbol::PROTECTED;
+    case stg::ElfSymbol::Visibility::HIDDEN:
+      return ElfSymbol::HIDDEN;
+    case stg::ElfSymbol::Visibility::INTERNAL:
+      return ElfSymbol::INTERNAL;
+  }
+}
+
 template <typename MapId>
 struct Transform {
   Transform(const Graph& graph, proto::STG& stg, MapId& map_id)
@@ -77,20 +236,20 @@ struct Transform {
   void operator()(const stg::ElfSymbol&, uint32_t);
   void operator()(const stg::Interface&, uint32_t);
 
-  Special::Kind operator()(stg::Special::Kind);
-  PointerReference::Kind operator()(stg::PointerReference::Kind);
-  Qualified::Qualifier operator()(stg::Qualifier);
-  Primitive::Encoding operator()(stg::Primitive::Encoding);
-  BaseClass::Inheritance operator()(stg::BaseClass::Inheritance);
-  StructUnion::Kind operator()(stg::StructUnion::Kind);
-  ElfSymbol::SymbolType operator()(stg::ElfSymbol::SymbolType);
-  ElfSymbol::Binding operator()(stg::ElfSymbol::Binding);
-  ElfSymbol::Visibility operator()(stg::ElfSymbol::Visibility);
+  // Nodes already written are referred to by their external ids.
+  void Extend(const std::unordered_map<Id, uint32_t>& written) {
+    for (const auto& [id, external] : written) {
+      external_id.emplace(id, external);
+      external_ids.Take(external);
+    }
+  }
 
   const Graph& graph;
   proto::STG& stg;
   std::unordered_map<Id, uint32_t> external_id;
-  std::unordered_set<uint32_t> used_ids;
+  ExternalIds external_ids;
+  // if set, external ids that differ from their mapped ids are recorded here
+  StableHashes* stable_hashes = nullptr;
 
   // Function object: Id -> uint32_t
   MapId& map_id;
@@ -100,13 +259,16 @@ template <typename MapId>
 uint32_t Transform<MapId>::operator()(Id id) {
   auto [it, inserted] = external_id.emplace(id, 0);
   if (inserted) {
-    uint32_t mapped_id = map_id(id);
+    const uint32_t hash = map_id(id);
 
     // Ensure uniqueness of external ids. It is best to probe here since id
     // generators will not in general guarantee that the mapping from internal
     // ids to external ids will be injective.
-    while (!used_ids.insert(mapped_id).second) {
-      ++mapped_id;
+    const uint32_t mapped_id = external_ids(hash);
+    if (stable_hashes != nullptr && mapped_id != hash) {
+      auto& collision = *stable_hashes->add_collision();
+      collision.set_id(mapped_id);
+      collision.set_hash(hash);
     }
     it->second = mapped_id;
     graph.Apply<void>(*this, id, mapped_id);
@@ -118,14 +280,14 @@ template <typename MapId>
 void Transform<MapId>::operator()(const stg::Special& x, uint32_t id) {
   auto& special = *stg.add_special();
   special.set_id(id);
-  special.set_kind((*this)(x.kind));
+  special.set_kind(ToProto(x.kind));
 }
 
 template <typename MapId>
 void Transform<MapId>::operator()(const stg::PointerReference& x, uint32_t id) {
   auto& pointer_reference = *stg.add_pointer_reference();
   pointer_reference.set_id(id);
-  pointer_reference.set_kind((*this)(x.kind));
+  pointer_reference.set_kind(ToProto(x.kind));
   pointer_reference.set_pointee_type_id((*this)(x.pointee_type_id));
 }
 
@@ -141,7 +303,7 @@ template <typename MapId>
 void Transform<MapId>::operator()(const stg::Typedef& x, uint32_t id) {
   auto& typedef_ = *stg.add_typedef_();
   typedef_.set_id(id);
-  typedef_.set_name(x.name);
+  typedef_.set_name(std::string(x.name));
   typedef_.set_referred_type_id((*this)(x.referred_type_id));
 }
 
@@ -149,7 +311,7 @@ template <typename MapId>
 void Transform<MapId>::operator()(const stg::Qualified& x, uint32_t id) {
   auto& qualified = *stg.add_qualified();
   qualified.set_id(id);
-  qualified.set_qualifier((*this)(x.qualifier));
+  qualified.set_qualifier(ToProto(x.qualifier));
   qualified.set_qualified_type_id((*this)(x.qualified_type_id));
 }
 
@@ -157,9 +319,9 @@ template <typename MapId>
 void Transform<MapId>::operator()(const stg::Primitive& x, uint32_t id) {
   auto& primitive = *stg.add_primitive();
   primitive.set_id(id);
-  primitive.set_name(x.name);
+  primitive.set_name(std::string(x.name));
   if (x.encoding) {
-    primitive.set_encoding((*this)(*x.encoding));
+    primitive.set_encoding(ToProto(*x.encoding));
   }
   primitive.set_bytesize(x.bytesize);
 }
@@ -178,15 +340,15 @@ void Transform<MapId>::operator()(const stg::BaseClass& x, uint32_t id) {
   base_class.set_id(id);
   base_class.set_type_id((*this)(x.type_id));
   base_class.set_offset(x.offset);
-  base_class.set_inheritance((*this)(x.inheritance));
+  base_class.set_inheritance(ToProto(x.inheritance));
 }
 
 template <typename MapId>
 void Transform<MapId>::operator()(const stg::Method& x, uint32_t id) {
   auto& method = *stg.add_method();
   method.set_id(id);
-  method.set_mangled_name(x.mangled_name);
-  method.set_name(x.name);
+  method.set_mangled_name(std::string(x.mangled_name));
+  method.set_name(std::string(x.name));
   method.set_vtable_offset(x.vtable_offset);
   method.set_type_id((*this)(x.type_id));
 }
@@ -195,7 +357,7 @@ template <typename MapId>
 void Transform<MapId>::operator()(const stg::Member& x, uint32_t id) {
   auto& member = *stg.add_member();
   member.set_id(id);
-  member.set_name(x.name);
+  member.set_name(std::string(x.name));
   member.set_type_id((*this)(x.type_id));
   member.set_offset(x.offset);
   member.set_bitsize(x.bitsize);
@@ -205,8 +367,8 @@ template <typename MapId>
 void Transform<MapId>::operator()(const stg::StructUnion& x, uint32_t id) {
   auto& struct_union = *stg.add_struct_union();
   struct_union.set_id(id);
-  struct_union.set_kind((*this)(x.kind));
-  struct_union.set_name(x.name);
+  struct_union.set_kind(ToProto(x.kind));
+  struct_union.set_name(std::string(x.name));
   if (x.definition) {
     auto& definition = *struct_union.mutable_definition();
     definition.set_bytesize(x.definition->bytesize);
@@ -226,14 +388,14 @@ template <typename MapId>
 void Transform<MapId>::operator()(const stg::Enumeration& x, uint32_t id) {
   auto& enumeration = *stg.add_enumeration();
   enumeration.set_id(id);
-  enumeration.set_name(x.name);
+  enumeration.set_name(std::string(x.name));
   if (x.definition) {
     auto& definition = *enumeration.mutable_definition();
     definition.set_underlying_type_id(
         (*this)(x.definition->underlying_type_id));
     for (const auto& [name, value] : x.definition->enumerators) {
       auto& enumerator = *definition.add_enumerator();
-      enumerator.set_name(name);
+      enumerator.set_name(std::string(name));
       enumerator.set_value(value);
     }
   }
@@ -253,16 +415,16 @@ template <typename MapId>
 void Transform<MapId>::operator()(const stg::ElfSymbol& x, uint32_t id) {
   auto& elf_symbol = *stg.add_elf_symbol();
   elf_symbol.set_id(id);
-  elf_symbol.set_name(x.symbol_name);
+  elf_symbol.set_name(std::string(x.symbol_name));
   if (x.version_info) {
     auto& version_info = *elf_symbol.mutable_version_info();
     version_info.set_is_default(x.version_info->is_default);
     version_info.set_name(x.version_info->name);
   }
   elf_symbol.set_is_defined(x.is_defined);
-  elf_symbol.set_symbol_type((*this)(x.symbol_type));
-  elf_symbol.set_binding((*this)(x.binding));
-  elf_symbol.set_visibility((*this)(x.visibility));
+  elf_symbol.set_symbol_type(ToProto(x.symbol_type));
+  elf_symbol.set_binding(ToProto(x.binding));
+  elf_symbol.set_visibility(ToProto(x.visibility));
   if (x.crc) {
     elf_symbol.set_crc(x.crc->number);
   }
@@ -289,134 +451,552 @@ void Transform<MapId>::operator()(const stg::Interface& x, uint32_t id) {
   }
 }
 
+const uint32_t kWrittenFormatVersion = 2;
+
+// Writes protobuf text format directly from the graph, without building a
+// proto::STG message. The output is byte-for-byte what TextFormat::Printer,
+// with hexadecimal 32-bit fields, prints for the message built by Transform:
+// external ids are assigned in the same traversal order, nodes are sorted as by
+// SortNodes and proto3 fields without presence are omitted when zero.
 template <typename MapId>
-PointerReference::Kind Transform<MapId>::operator()(
-    stg::PointerReference::Kind x) {
-  switch (x) {
-    case stg::PointerReference::Kind::POINTER:
-      return PointerReference::POINTER;
-    case stg::PointerReference::Kind::LVALUE_REFERENCE:
-      return PointerReference::LVALUE_REFERENCE;
-    case stg::PointerReference::Kind::RVALUE_REFERENCE:
-      return PointerReference::RVALUE_REFERENCE;
+class TextWriter {
+ public:
+  TextWriter(const Graph& graph, MapId& map_id, std::ostream& os)
+      : graph_(graph), map_id_(map_id), os_(os) {}
+
+  void Write(Id root, bool record_stable_hashes, bool canonical, size_t jobs) {
+    record_stable_hashes_ = record_stable_hashes;
+    const uint32_t root_id = (*this)(root);
+    Hex("version", kWrittenFormatVersion);
+    MaybeHex("root_id", root_id);
+    // the same sort orders as SortNodes, the kinds sorted independently
+    const std::vector<std::pair<Kind, bool>> sorts = {
+      {POINTER_REFERENCE, false}, {POINTER_TO_MEMBER, false},
+      {TYPEDEF, true}, {QUALIFIED, false}, {PRIMITIVE, false}, {ARRAY, false},
+      {BASE_CLASS, false}, {METHOD, false}, {MEMBER, true},
+      {STRUCT_UNION, true}, {ENUMERATION, true}, {FUNCTION, false},
+      {ELF_SYMBOL, true},
+    };
+    ForEachIndex(jobs, sorts.size(), [&](size_t, size_t ix) {
+      const auto& [kind, by_name] = sorts[ix];
+      if (by_name) {
+        SortByName(nodes_[kind]);
+      } else {
+        SortById(nodes_[kind]);
+      }
+    });
+    // fields in field number order
+    Print("special", nodes_[SPECIAL]);
+    Print("pointer_reference", nodes_[POINTER_REFERENCE]);
+    Print("pointer_to_member", nodes_[POINTER_TO_MEMBER]);
+    Print("typedef", nodes_[TYPEDEF]);
+    Print("qualified", nodes_[QUALIFIED]);
+    Print("primitive", nodes_[PRIMITIVE]);
+    Print("array", nodes_[ARRAY]);
+    Print("base_class", nodes_[BASE_CLASS]);
+    Print("method", nodes_[METHOD]);
+    Print("member", nodes_[MEMBER]);
+    Print("struct_union", nodes_[STRUCT_UNION]);
+    Print("enumeration", nodes_[ENUMERATION]);
+    Print("function", nodes_[FUNCTION]);
+    Print("elf_symbol", nodes_[ELF_SYMBOL]);
+    Print("interface", nodes_[INTERFACE]);
+    if (record_stable_hashes_) {
+      std::sort(collisions_.begin(), collisions_.end());
+      Open("stable_hashes");
+      for (const auto& [id, hash] : collisions_) {
+        Open("collision");
+        MaybeHex("id", id);
+        MaybeHex("hash", hash);
+        Close();
+      }
+      Close();
+    }
+    if (canonical) {
+      Field("canonical") << "true\n";
+    }
   }
-}
 
-template <typename MapId>
-Special::Kind Transform<MapId>::operator()(
-    stg::Special::Kind x) {
-  switch (x) {
-    case stg::Special::Kind::VOID:
-      return Special::VOID;
-    case stg::Special::Kind::VARIADIC:
-      return Special::VARIADIC;
-    case stg::Special::Kind::NULLPTR:
-      return Special::NULLPTR;
+  // As Transform::Extend.
+  void Extend(const std::unordered_map<Id, uint32_t>& written) {
+    for (const auto& [id, external] : written) {
+      external_id_.emplace(id, external);
+      external_ids_.Take(external);
+    }
   }
-}
 
-template <typename MapId>
-Qualified::Qualifier Transform<MapId>::operator()(stg::Qualifier x) {
-  switch (x) {
-    case stg::Qualifier::CONST:
-      return Qualified::CONST;
-    case stg::Qualifier::VOLATILE:
-      return Qualified::VOLATILE;
-    case stg::Qualifier::RESTRICT:
-      return Qualified::RESTRICT;
-    case stg::Qualifier::ATOMIC:
-      return Qualified::ATOMIC;
+  // Adds the external ids given to the nodes written.
+  void Written(std::unordered_map<Id, uint32_t>& written) const {
+    written.insert(external_id_.begin(), external_id_.end());
   }
-}
 
-template <typename MapId>
-Primitive::Encoding Transform<MapId>::operator()(stg::Primitive::Encoding x) {
-  switch (x) {
-    case stg::Primitive::Encoding::BOOLEAN:
-      return Primitive::BOOLEAN;
-    case stg::Primitive::Encoding::SIGNED_INTEGER:
-      return Primitive::SIGNED_INTEGER;
-    case stg::Primitive::Encoding::UNSIGNED_INTEGER:
-      return Primitive::UNSIGNED_INTEGER;
-    case stg::Primitive::Encoding::SIGNED_CHARACTER:
-      return Primitive::SIGNED_CHARACTER;
-    case stg::Primitive::Encoding::UNSIGNED_CHARACTER:
-      return Primitive::UNSIGNED_CHARACTER;
-    case stg::Primitive::Encoding::REAL_NUMBER:
-      return Primitive::REAL_NUMBER;
-    case stg::Primitive::Encoding::COMPLEX_NUMBER:
-      return Primitive::COMPLEX_NUMBER;
-    case stg::Primitive::Encoding::UTF:
-      return Primitive::UTF;
+  // Assigns external ids, exactly as Transform does, recording the nodes.
+  uint32_t operator()(Id id) {
+    auto [it, inserted] = external_id_.emplace(id, 0);
+    if (inserted) {
+      const uint32_t hash = map_id_(id);
+      const uint32_t mapped_id = external_ids_(hash);
+      if (record_stable_hashes_ && mapped_id != hash) {
+        collisions_.emplace_back(mapped_id, hash);
+      }
+      it->second = mapped_id;
+      graph_.Apply<void>(*this, id, id, mapped_id);
+    }
+    return it->second;
   }
-}
 
-template <typename MapId>
-BaseClass::Inheritance Transform<MapId>::operator()(
-    stg::BaseClass::Inheritance x) {
-  switch (x) {
-    case stg::BaseClass::Inheritance::NON_VIRTUAL:
-      return BaseClass::NON_VIRTUAL;
-    case stg::BaseClass::Inheritance::VIRTUAL:
-      return BaseClass::VIRTUAL;
+  void operator()(const Ids& ids) {
+    for (const auto id : ids) {
+      (*this)(id);
+    }
   }
-}
 
-template <typename MapId>
-StructUnion::Kind Transform<MapId>::operator()(stg::StructUnion::Kind x) {
-  switch (x) {
-    case stg::StructUnion::Kind::STRUCT:
-      return StructUnion::STRUCT;
-    case stg::StructUnion::Kind::UNION:
-      return StructUnion::UNION;
+  void operator()(const FlatMap<std::string, Id>& ids) {
+    for (const auto& [_, id] : ids) {
+      (*this)(id);
+    }
   }
-}
 
-template <typename MapId>
-ElfSymbol::SymbolType Transform<MapId>::operator()(
-    stg::ElfSymbol::SymbolType x) {
-  switch (x) {
-    case stg::ElfSymbol::SymbolType::OBJECT:
-      return ElfSymbol::OBJECT;
-    case stg::ElfSymbol::SymbolType::FUNCTION:
-      return ElfSymbol::FUNCTION;
-    case stg::ElfSymbol::SymbolType::COMMON:
-      return ElfSymbol::COMMON;
-    case stg::ElfSymbol::SymbolType::TLS:
-      return ElfSymbol::TLS;
-    case stg::ElfSymbol::SymbolType::GNU_IFUNC:
-      return ElfSymbol::GNU_IFUNC;
+  void operator()(const stg::Special&, Id id, uint32_t mapped_id) {
+    nodes_[SPECIAL].emplace_back(mapped_id, id);
   }
-}
 
-template <typename MapId>
-ElfSymbol::Binding Transform<MapId>::operator()(stg::ElfSymbol::Binding x) {
-  switch (x) {
-    case stg::ElfSymbol::Binding::GLOBAL:
-      return ElfSymbol::GLOBAL;
-    case stg::ElfSymbol::Binding::LOCAL:
-      return ElfSymbol::LOCAL;
-    case stg::ElfSymbol::Binding::WEAK:
-      return ElfSymbol::WEAK;
-    case stg::ElfSymbol::Binding::GNU_UNIQUE:
-      return ElfSymbol::GNU_UNIQUE;
+  void operator()(const stg::PointerReference& x, Id id, uint32_t mapped_id) {
+    nodes_[POINTER_REFERENCE].emplace_back(mapped_id, id);
+    (*this)(x.pointee_type_id);
   }
-}
 
-template <typename MapId>
-ElfSymbol::Visibility Transform<MapId>::operator()(
-    stg::ElfSymbol::Visibility x) {
-  switch (x) {
-    case stg::ElfSymbol::Visibility::DEFAULT:
-      return ElfSymbol::DEFAULT;
-    case stg::ElfSymbol::Visibility::PROTECTED:
-      return ElfSymbol::PROTECTED;
-    case stg::ElfSymbol::Visibility::HIDDEN:
-      return ElfSymbol::HIDDEN;
-    case stg::ElfSymbol::Visibility::INTERNAL:
-      return ElfSymbol::INTERNAL;
+  void operator()(const stg::PointerToMember& x, Id id, uint32_t mapped_id) {
+    nodes_[POINTER_TO_MEMBER].emplace_back(mapped_id, id);
+    (*this)(x.containing_type_id);
+    (*this)(x.pointee_type_id);
   }
-}
+
+  void operator()(const stg::Typedef& x, Id id, uint32_t mapped_id) {
+    nodes_[TYPEDEF].emplace_back(mapped_id, id);
+    (*this)(x.referred_type_id);
+  }
+
+  void operator()(const stg::Qualified& x, Id id, uint32_t mapped_id) {
+    nodes_[QUALIFIED].emplace_back(mapped_id, id);
+    (*this)(x.qualified_type_id);
+  }
+
+  void operator()(const stg::Primitive&, Id id, uint32_t mapped_id) {
+    nodes_[PRIMITIVE].emplace_back(mapped_id, id);
+  }
+
+  void operator()(const stg::Array& x, Id id, uint32_t mapped_id) {
+    nodes_[ARRAY].emplace_back(mapped_id, id);
+    (*this)(x.element_type_id);
+  }
+
+  void operator()(const stg::BaseClass& x, Id id, uint32_t mapped_id) {
+    nodes_[BASE_CLASS].emplace_back(mapped_id, id);
+    (*this)(x.type_id);
+  }
+
+  void operator()(const stg::Method& x, Id id, uint32_t mapped_id) {
+    nodes_[METHOD].emplace_back(mapped_id, id);
+    (*this)(x.type_id);
+  }
+
+  void operator()(const stg::Member& x, Id id, uint32_t mapped_id) {
+    nodes_[MEMBER].emplace_back(mapped_id, id);
+    (*this)(x.type_id);
+  }
+
+  void operator()(const stg::StructUnion& x, Id id, uint32_t mapped_id) {
+    nodes_[STRUCT_UNION].emplace_back(mapped_id, id);
+    if (x.definition) {
+      (*this)(x.definition->base_classes);
+      (*this)(x.definition->methods);
+      (*this)(x.definition->members);
+    }
+  }
+
+  void operator()(const stg::Enumeration& x, Id id, uint32_t mapped_id) {
+    nodes_[ENUMERATION].emplace_back(mapped_id, id);
+    if (x.definition) {
+      (*this)(x.definition->underlying_type_id);
+    }
+  }
+
+  void operator()(const stg::Function& x, Id id, uint32_t mapped_id) {
+    nodes_[FUNCTION].emplace_back(mapped_id, id);
+    (*this)(x.return_type_id);
+    (*this)(x.parameters);
+  }
+
+  void operator()(const stg::ElfSymbol& x, Id id, uint32_t mapped_id) {
+    nodes_[ELF_SYMBOL].emplace_back(mapped_id, id);
+    if (x.type_id) {
+      (*this)(*x.type_id);
+    }
+  }
+
+  void operator()(const stg::Interface& x, Id id, uint32_t mapped_id) {
+    nodes_[INTERFACE].emplace_back(mapped_id, id);
+    (*this)(x.symbols);
+    (*this)(x.types);
+  }
+
+  // Printing, given the external id of the node.
+
+  void operator()(const stg::Special& x, uint32_t id) {
+    MaybeHex("id", id);
+    Enum("kind", Special::Kind_Name(ToProto(x.kind)));
+  }
+
+  void operator()(const stg::PointerReference& x, uint32_t id) {
+    MaybeHex("id", id);
+    Enum("kind", PointerReference::Kind_Name(ToProto(x.kind)));
+    MaybeHex("pointee_type_id", Lookup(x.pointee_type_id));
+  }
+
+  void operator()(const stg::PointerToMember& x, uint32_t id) {
+    MaybeHex("id", id);
+    MaybeHex("containing_type_id", Lookup(x.containing_type_id));
+    MaybeHex("pointee_type_id", Lookup(x.pointee_type_id));
+  }
+
+  void operator()(const stg::Typedef& x, uint32_t id) {
+    MaybeHex("id", id);
+    MaybeString("name", x.name);
+    MaybeHex("referred_type_id", Lookup(x.referred_type_id));
+  }
+
+  void operator()(const stg::Qualified& x, uint32_t id) {
+    MaybeHex("id", id);
+    Enum("qualifier", Qualified::Qualifier_Name(ToProto(x.qualifier)));
+    MaybeHex("qualified_type_id", Lookup(x.qualified_type_id));
+  }
+
+  void operator()(const stg::Primitive& x, uint32_t id) {
+    MaybeHex("id", id);
+    MaybeString("name", x.name);
+    if (x.encoding) {
+      Enum("encoding", Primitive::Encoding_Name(ToProto(*x.encoding)));
+    }
+    MaybeHex("bytesize", x.bytesize);
+  }
+
+  void operator()(const stg::Array& x, uint32_t id) {
+    MaybeHex("id", id);
+    MaybeDecimal("number_of_elements", x.number_of_elements);
+    MaybeHex("element_type_id", Lookup(x.element_type_id));
+  }
+
+  void operator()(const stg::BaseClass& x, uint32_t id) {
+    MaybeHex("id", id);
+    MaybeHex("type_id", Lookup(x.type_id));
+    MaybeDecimal("offset", x.offset);
+    Enum("inheritance", BaseClass::Inheritance_Name(ToProto(x.inheritance)));
+  }
+
+  void operator()(const stg::Method& x, uint32_t id) {
+    MaybeHex("id", id);
+    MaybeString("mangled_name", x.mangled_name);
+    MaybeString("name", x.name);
+    MaybeDecimal("vtable_offset", x.vtable_offset);
+    MaybeHex("type_id", Lookup(x.type_id));
+  }
+
+  void operator()(const stg::Member& x, uint32_t id) {
+    MaybeHex("id", id);
+    MaybeString("name", x.name);
+    MaybeHex("type_id", Lookup(x.type_id));
+    MaybeDecimal("offset", x.offset);
+    MaybeDecimal("bitsize", x.bitsize);
+  }
+
+  void operator()(const stg::StructUnion& x, uint32_t id) {
+    MaybeHex("id", id);
+    Enum("kind", StructUnion::Kind_Name(ToProto(x.kind)));
+    MaybeString("name", x.name);
+    if (x.definition) {
+      Open("definition");
+      MaybeDecimal("bytesize", x.definition->bytesize);
+      for (const auto id : x.definition->base_classes) {
+        Hex("base_class_id", Lookup(id));
+      }
+      for (const auto id : x.definition->methods) {
+        Hex("method_id", Lookup(id));
+      }
+      for (const auto id : x.definition->members) {
+        Hex("member_id", Lookup(id));
+      }
+      Close();
+    }
+  }
+
+  void operator()(const stg::Enumeration& x, uint32_t id) {
+    MaybeHex("id", id);
+    MaybeString("name", x.name);
+    if (x.definition) {
+      Open("definition");
+      MaybeHex("underlying_type_id", Lookup(x.definition->underlying_type_id));
+      for (const auto& [name, value] : x.definition->enumerators) {
+        Open("enumerator");
+        MaybeString("name", name);
+        MaybeDecimal("value", value);
+        Close();
+      }
+      Close();
+    }
+  }
+
+  void operator()(const stg::Function& x, uint32_t id) {
+    MaybeHex("id", id);
+    MaybeHex("return_type_id", Lookup(x.return_type_id));
+    for (const auto id : x.parameters) {
+      Hex("parameter_id", Lookup(id));
+    }
+  }
+
+  void operator()(const stg::ElfSymbol& x, uint32_t id) {
+    MaybeHex("id", id);
+    MaybeString("name", x.symbol_name);
+    if (x.version_info) {
+      Open("version_info");
+      if (x.version_info->is_default) {
+        Field("is_default") << "true\n";
+      }
+      MaybeString("name", x.version_info->name);
+      Close();
+    }
+    if (x.is_defined) {
+      Field("is_defined") << "true\n";
+    }
+    Enum("symbol_type", ElfSymbol::SymbolType_Name(ToProto(x.symbol_type)));
+    const auto binding = ToProto(x.binding);
+    if (binding != ElfSymbol::GLOBAL) {
+      Enum("binding", ElfSymbol::Binding_Name(binding));
+    }
+    const auto visibility = ToProto(x.visibility);
+    if (visibility != ElfSymbol::DEFAULT) {
+      Enum("visibility", ElfSymbol::Visibility_Name(visibility));
+    }
+    if (x.crc) {
+      Hex("crc", x.crc->number);
+    }
+    if (x.ns) {
+      String("namespace", *x.ns);
+    }
+    if (x.type_id) {
+      Hex("type_id", Lookup(*x.type_id));
+    }
+    if (x.full_name) {
+      String("full_name", *x.full_name);
+    }
+  }
+
+  void operator()(const stg::Interface& x, uint32_t id) {
+    MaybeHex("id", id);
+    for (const auto& [_, id] : x.symbols) {
+      Hex("symbol_id", Lookup(id));
+    }
+    for (const auto& [_, id] : x.types) {
+      Hex("type_id", Lookup(id));
+    }
+  }
+
+ private:
+  enum Kind {
+    SPECIAL,
+    POINTER_REFERENCE,
+    POINTER_TO_MEMBER,
+    TYPEDEF,
+    QUALIFIED,
+    PRIMITIVE,
+    ARRAY,
+    BASE_CLASS,
+    METHOD,
+    MEMBER,
+    STRUCT_UNION,
+    ENUMERATION,
+    FUNCTION,
+    ELF_SYMBOL,
+    INTERFACE,
+    KINDS,
+  };
+
+  // external id and node
+  using Nodes = std::vector<std::pair<uint32_t, Id>>;
+
+  struct GetName {
+    std::string_view operator()(const stg::Typedef& x) {
+      return x.name;
+    }
+    std::string_view operator()(const stg::Member& x) {
+      return x.name;
+    }
+    std::string_view operator()(const stg::StructUnion& x) {
+      return x.name;
+    }
+    std::string_view operator()(const stg::Enumeration& x) {
+      return x.name;
+    }
+    std::string_view operator()(const stg::ElfSymbol& x) {
+      return x.symbol_name;
+    }
+    template <typename Node>
+    std::string_view operator()(const Node&) {
+      Die() << "internal error: sorting unnamed nodes by name";
+    }
+  };
+
+  static Nodes& SortById(Nodes& nodes) {
+    std::sort(nodes.begin(), nodes.end(), [](const auto& a, const auto& b) {
+      return a.first < b.first;
+    });
+    return nodes;
+  }
+
+  Nodes& SortByName(Nodes& nodes) const {
+    GetName get_name;
+    std::vector<std::pair<std::string_view, size_t>> keys;
+    keys.reserve(nodes.size());
+    for (size_t ix = 0; ix < nodes.size(); ++ix) {
+      keys.emplace_back(graph_.Apply<std::string_view>(
+          get_name, nodes[ix].second), ix);
+    }
+    std::sort(keys.begin(), keys.end(), [&](const auto& a, const auto& b) {
+      const int comparison = a.first.compare(b.first);
+      return comparison < 0
+          || (comparison == 0 && nodes[a.second].first < nodes[b.second].first);
+    });
+    Nodes sorted;
+    sorted.reserve(nodes.size());
+    for (const auto& [_, ix] : keys) {
+      sorted.push_back(nodes[ix]);
+    }
+    nodes = std::move(sorted);
+    return nodes;
+  }
+
+  void Print(const char* field, const Nodes& nodes) {
+    for (const auto& [mapped_id, id] : nodes) {
+      Open(field);
+      graph_.Apply<void>(*this, id, mapped_id);
+      Close();
+    }
+  }
+
+  uint32_t Lookup(Id id) const {
+    return external_id_.at(id);
+  }
+
+  std::ostream& Field(const char* field) {
+    for (size_t i = 0; i < depth_; ++i) {
+      os_ << "  ";
+    }
+    return os_ << field << ": ";
+  }
+
+  void Open(const char* field) {
+    for (size_t i = 0; i < depth_; ++i) {
+      os_ << "  ";
+    }
+    os_ << field << " {\n";
+    ++depth_;
+  }
+
+  void Close() {
+    --depth_;
+    for (size_t i = 0; i < depth_; ++i) {
+      os_ << "  ";
+    }
+    os_ << "}\n";
+  }
+
+  // As HexPrinter did: 0x01234567, but 0 is printed without the base.
+  void Hex(const char* field, uint32_t value) {
+    static constexpr char kDigits[] = "0123456789abcdef";
+    char text[11] = "0000000000";
+    if (value != 0) {
+      text[1] = 'x';
+    }
+    for (size_t i = 9; value != 0; --i) {
+      text[i] = kDigits[value & 0xf];
+      value >>= 4;
+    }
+    Field(field) << std::string_view(text, 10) << '\n';
+  }
+
+  void MaybeHex(const char* field, uint32_t value) {
+    if (value != 0) {
+      Hex(field, value);
+    }
+  }
+
+  template <typename Integer>
+  void MaybeDecimal(const char* field, Integer value) {
+    if (value != 0) {
+      Field(field) << value << '\n';
+    }
+  }
+
+  void Enum(const char* field, const std::string& name) {
+    Field(field) << name << '\n';
+  }
+
+  // C escaping, as used by TextFormat.
+  void String(const char* field, std::string_view value) {
+    static constexpr char kOctal[] = "01234567";
+    auto& os = Field(field) << '"';
+    for (const char c : value) {
+      switch (c) {
+        case '\n':
+          os << "\\n";
+          break;
+        case '\r':
+          os << "\\r";
+          break;
+        case '\t':
+          os << "\\t";
+          break;
+        case '"':
+          os << "\\\"";
+          break;
+        case '\'':
+          os << "\\'";
+          break;
+        case '\\':
+          os << "\\\\";
+          break;
+        default: {
+          const auto u = static_cast<unsigned char>(c);
+          if (u < 0x20 || u >= 0x7f) {
+            const char escape[] = {
+                '\\', kOctal[u >> 6], kOctal[(u >> 3) & 7], kOctal[u & 7]};
+            os << std::string_view(escape, sizeof(escape));
+          } else {
+            os << c;
+          }
+        }
+      }
+    }
+    os << "\"\n";
+  }
+
+  void MaybeString(const char* field, std::string_view value) {
+    if (!value.empty()) {
+      String(field, value);
+    }
+  }
+
+  const Graph& graph_;
+  MapId& map_id_;
+  std::ostream& os_;
+  bool record_stable_hashes_ = false;
+  std::unordered_map<Id, uint32_t> external_id_;
+  ExternalIds external_ids_;
+  // external id and hash, where these differ
+  std::vector<std::pair<uint32_t, uint32_t>> collisions_;
+  Nodes nodes_[KINDS];
+  size_t depth_ = 0;
+};
 
 template <typename ProtoNode>
 void SortNodesById(google::protobuf::RepeatedPtrField<ProtoNode>& nodes) {
@@ -434,55 +1014,305 @@ void SortNodesByName(google::protobuf::RepeatedPtrField<ProtoNode>& nodes) {
   std::sort(nodes.pointer_begin(), nodes.pointer_end(), compare);
 }
 
-void SortNodes(STG& stg) {
-  SortNodesById(*stg.mutable_void_());
-  SortNodesById(*stg.mutable_variadic());
-  SortNodesById(*stg.mutable_pointer_reference());
-  SortNodesById(*stg.mutable_pointer_to_member());
-  SortNodesByName(*stg.mutable_typedef_());
-  SortNodesById(*stg.mutable_qualified());
-  SortNodesById(*stg.mutable_primitive());
-  SortNodesById(*stg.mutable_array());
-  SortNodesById(*stg.mutable_base_class());
-  SortNodesById(*stg.mutable_method());
-  SortNodesByName(*stg.mutable_member());
-  SortNodesByName(*stg.mutable_struct_union());
-  SortNodesByName(*stg.mutable_enumeration());
-  SortNodesById(*stg.mutable_function());
-  SortNodesByName(*stg.mutable_elf_symbol());
-}
-
-class HexPrinter : public google::protobuf::TextFormat::FastFieldValuePrinter {
-  void PrintUInt32(
-      uint32_t value,
-      google::protobuf::TextFormat::BaseTextGenerator* generator) const override {
-    std::ostringstream os;
-    // 0x01234567
-    os << std::showbase << std::hex << std::setfill('0') << std::internal
-       << std::setw(10) << value;
-    generator->PrintString(os.str());
+void SortNodes(STG& stg, size_t jobs) {
+  // the repeated fields are independent and can be sorted concurrently
+  const std::vector<std::function<void()>> sorts = {
+    [&] { SortNodesById(*stg.mutable_void_()); },
+    [&] { SortNodesById(*stg.mutable_variadic()); },
+    [&] { SortNodesById(*stg.mutable_pointer_reference()); },
+    [&] { SortNodesById(*stg.mutable_pointer_to_member()); },
+    [&] { SortNodesByName(*stg.mutable_typedef_()); },
+    [&] { SortNodesById(*stg.mutable_qualified()); },
+    [&] { SortNodesById(*stg.mutable_primitive()); },
+    [&] { SortNodesById(*stg.mutable_array()); },
+    [&] { SortNodesById(*stg.mutable_base_class()); },
+    [&] { SortNodesById(*stg.mutable_method()); },
+    [&] { SortNodesByName(*stg.mutable_member()); },
+    [&] { SortNodesByName(*stg.mutable_struct_union()); },
+    [&] { SortNodesByName(*stg.mutable_enumeration()); },
+    [&] { SortNodesById(*stg.mutable_function()); },
+    [&] { SortNodesByName(*stg.mutable_elf_symbol()); },
+    [&] {
+      if (stg.has_stable_hashes()) {
+        SortNodesById(*stg.mutable_stable_hashes()->mutable_collision());
+      }
+    },
+  };
+  ForEachIndex(jobs, sorts.size(), [&](size_t, size_t ix) {
+    sorts[ix]();
+  });
+}
+
+// Moves the nodes into the last shard, starting a new one whenever it is full.
+// The shards share the arena of the nodes, so moving a node is a swap.
+template <typename ProtoNode, typename GetField>
+void Distribute(google::protobuf::RepeatedPtrField<ProtoNode>& nodes,
+                GetField get_field, std::vector<STG*>& shards, size_t& count) {
+  for (auto& node : nodes) {
+    if (count == kNodesPerShard) {
+      shards.push_back(
+          google::protobuf::Arena::Create<STG>(nodes.GetArena()));
+      count = 0;
+    }
+    get_field(*shards.back()).Add()->Swap(&node);
+    ++count;
+  }
+  nodes.Clear();
+}
+
+std::vector<STG*> Shard(STG& stg) {
+  std::vector<STG*> shards{
+      google::protobuf::Arena::Create<STG>(stg.GetArena())};
+  auto& first = *shards.front();
+  first.set_version(stg.version());
+  first.set_root_id(stg.root_id());
+  first.mutable_special()->Swap(stg.mutable_special());
+  first.mutable_interface()->Swap(stg.mutable_interface());
+  if (stg.has_stable_hashes()) {
+    first.mutable_stable_hashes()->Swap(stg.mutable_stable_hashes());
+  }
+  first.set_canonical(stg.canonical());
+  // the first shard is small, so start the nodes in a shard of their own
+  size_t count = kNodesPerShard;
+  Distribute(*stg.mutable_pointer_reference(),
+             [](STG& x) -> auto& { return *x.mutable_pointer_reference(); },
+             shards, count);
+  Distribute(*stg.mutable_pointer_to_member(),
+             [](STG& x) -> auto& { return *x.mutable_pointer_to_member(); },
+             shards, count);
+  Distribute(*stg.mutable_typedef_(),
+             [](STG& x) -> auto& { return *x.mutable_typedef_(); },
+             shards, count);
+  Distribute(*stg.mutable_qualified(),
+             [](STG& x) -> auto& { return *x.mutable_qualified(); },
+             shards, count);
+  Distribute(*stg.mutable_primitive(),
+             [](STG& x) -> auto& { return *x.mutable_primitive(); },
+             shards, count);
+  Distribute(*stg.mutable_array(),
+             [](STG& x) -> auto& { return *x.mutable_array(); },
+             shards, count);
+  Distribute(*stg.mutable_base_class(),
+             [](STG& x) -> auto& { return *x.mutable_base_class(); },
+             shards, count);
+  Distribute(*stg.mutable_method(),
+             [](STG& x) -> auto& { return *x.mutable_method(); },
+             shards, count);
+  Distribute(*stg.mutable_member(),
+             [](STG& x) -> auto& { return *x.mutable_member(); },
+             shards, count);
+  Distribute(*stg.mutable_struct_union(),
+             [](STG& x) -> auto& { return *x.mutable_struct_union(); },
+             shards, count);
+  Distribute(*stg.mutable_enumeration(),
+             [](STG& x) -> auto& { return *x.mutable_enumeration(); },
+             shards, count);
+  Distribute(*stg.mutable_function(),
+             [](STG& x) -> auto& { return *x.mutable_function(); },
+             shards, count);
+  Distribute(*stg.mutable_elf_symbol(),
+             [](STG& x) -> auto& { return *x.mutable_elf_symbol(); },
+             shards, count);
+  return shards;
+}
+
+std::string SerialiseToString(const STG& stg) {
+  std::string result;
+  {
+    google::protobuf::io::StringOutputStream stream(&result);
+    google::protobuf::io::CodedOutputStream coded(&stream);
+    coded.SetSerializationDeterministic(true);
+    Check(stg.SerializeToCodedStream(&coded)) << "failed to serialise STG";
+  }
+  return result;
+}
+
+void SerialiseShards(STG& stg, std::ostream& os, size_t jobs) {
+  const auto shards = Shard(stg);
+  std::vector<std::string> serialised(shards.size());
+  ForEachIndex(jobs, shards.size(), [&](size_t, size_t ix) {
+    serialised[ix] = SerialiseToString(*shards[ix]);
+  });
+  os << kShardsMagic;
+  google::protobuf::io::OstreamOutputStream stream(&os);
+  google::protobuf::io::CodedOutputStream coded(&stream);
+  coded.WriteVarint64(serialised.size());
+  for (const auto& shard : serialised) {
+    coded.WriteVarint64(shard.size());
+  }
+  for (const auto& shard : serialised) {
+    coded.WriteString(shard);
   }
+  Check(!coded.HadError()) << "failed to write STG shards";
+}
+
+// An output stream buffer that writes directly into the buffers of a
+// ZeroCopyOutputStream, returning any unused space when destroyed.
+class ZeroCopyStreamBuffer : public std::streambuf {
+ public:
+  explicit ZeroCopyStreamBuffer(
+      google::protobuf::io::ZeroCopyOutputStream& stream)
+      : stream_(stream) {}
+
+  ZeroCopyStreamBuffer(const ZeroCopyStreamBuffer&) = delete;
+  ZeroCopyStreamBuffer& operator=(const ZeroCopyStreamBuffer&) = delete;
+
+  ~ZeroCopyStreamBuffer() override {
+    stream_.BackUp(static_cast<int>(epptr() - pptr()));
+  }
+
+ protected:
+  int_type overflow(int_type c) override {
+    void* data;
+    int size = 0;
+    while (size == 0) {
+      if (!stream_.Next(&data, &size)) {
+        setp(nullptr, nullptr);
+        return traits_type::eof();
+      }
+    }
+    char* begin = static_cast<char*>(data);
+    setp(begin, begin + size);
+    if (!traits_type::eq_int_type(c, traits_type::eof())) {
+      *pptr() = traits_type::to_char_type(c);
+      pbump(1);
+    }
+    return traits_type::not_eof(c);
+  }
+
+ private:
+  google::protobuf::io::ZeroCopyOutputStream& stream_;
 };
 
-const uint32_t kWrittenFormatVersion = 2;
+struct GetInterface {
+  const stg::Interface& operator()(const stg::Interface& x) const {
+    return x;
+  }
+
+  template <typename Node>
+  const stg::Interface& operator()(const Node&) const {
+    Die() << "only STG with an interface root can be indexed";
+  }
+};
+
+// The names of an interface's nodes and their external ids.
+template <typename MapId>
+std::vector<std::pair<std::string, uint32_t>> IndexNames(
+    const FlatMap<std::string, Id>& nodes, const Transform<MapId>& transform) {
+  std::vector<std::pair<std::string, uint32_t>> result;
+  result.reserve(nodes.size());
+  for (const auto& [name, id] : nodes) {
+    result.emplace_back(name, transform.external_id.at(id));
+  }
+  return result;
+}
 
 }  // namespace
 
-void Print(const STG& stg, std::ostream& os) {
-  google::protobuf::TextFormat::Printer printer;
-  printer.SetDefaultFieldValuePrinter(new HexPrinter());
-  std::string output;
-  printer.PrintToString(stg, &output);
-  os << output;
+void Serialise(const STG& stg, std::ostream& os) {
+  google::protobuf::io::OstreamOutputStream stream(&os);
+  google::protobuf::io::CodedOutputStream coded(&stream);
+  coded.SetSerializationDeterministic(true);
+  Check(stg.SerializeToCodedStream(&coded)) << "failed to serialise STG";
 }
 
-void Writer::Write(const Id& root, std::ostream& os) {
-  proto::STG stg;
-  StableId stable_id(graph_);
-  stg.set_root_id(Transform<StableId>(graph_, stg, stable_id)(root));
-  SortNodes(stg);
+void Writer::Write(const Id& root, std::ostream& os, Format format,
+                   bool record_stable_hashes, Compression compression,
+                   bool canonical) {
+  Check(index_ == nullptr
+        || (format != Format::TEXT && compression == Compression::NONE))
+      << "only uncompressed binary or sharded STG can be indexed";
+  if (compression == Compression::GZIP) {
+    Check(format != Format::SHARDED) << "sharded STG cannot be compressed";
+    google::protobuf::io::OstreamOutputStream stream(&os);
+    google::protobuf::io::GzipOutputStream::Options options;
+    options.format = google::protobuf::io::GzipOutputStream::GZIP;
+    google::protobuf::io::GzipOutputStream gzip(&stream, options);
+    {
+      ZeroCopyStreamBuffer buffer(gzip);
+      std::ostream compressed(&buffer);
+      Write(root, compressed, format, record_stable_hashes, Compression::NONE,
+            canonical);
+      Check(compressed.flush().good()) << "failed to compress STG";
+    }
+    Check(gzip.Close()) << "failed to compress STG";
+    return;
+  }
+  // with several workers, hash every node up front rather than on demand
+  StableId stable_id(
+      graph_, jobs_ > 1 ? ComputeStableHashes(graph_, stable_hashes_, jobs_)
+                        : stable_hashes_);
+  if (format == Format::TEXT) {
+    TextWriter<StableId> writer(graph_, stable_id, os);
+    if (written_ != nullptr) {
+      writer.Extend(*written_);
+    }
+    writer.Write(root, record_stable_hashes, canonical, jobs_);
+    if (written_ != nullptr) {
+      writer.Written(*written_);
+    }
+    return;
+  }
+  // The message is built in an arena, so that its many sub-messages and strings
+  // are cheap to allocate and are all freed at once.
+  google::protobuf::Arena arena;
+  auto& stg = *google::protobuf::Arena::Create<proto::STG>(&arena);
+  Transform<StableId> transform(graph_, stg, stable_id);
+  if (written_ != nullptr) {
+    transform.Extend(*written_);
+  }
+  if (record_stable_hashes) {
+    transform.stable_hashes = stg.mutable_stable_hashes();
+  }
+  stg.set_root_id(transform(root));
+  if (written_ != nullptr) {
+    written_->insert(transform.external_id.begin(),
+                     transform.external_id.end());
+  }
+  SortNodes(stg, jobs_);
   stg.set_version(kWrittenFormatVersion);
-  Print(stg, os);
+  stg.set_canonical(canonical);
+  if (index_ != nullptr) {
+    // the index locates nodes within the serialised output
+    std::ostringstream buffer;
+    if (format == Format::SHARDED) {
+      SerialiseShards(stg, buffer, jobs_);
+    } else {
+      Serialise(stg, buffer);
+    }
+    const std::string bytes = std::move(buffer).str();
+    os.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+    const GetInterface get;
+    const auto& interface = graph_.Apply<const stg::Interface&>(get, root);
+    WriteIndex(bytes, IndexNames(interface.symbols, transform),
+               IndexNames(interface.types, transform), *index_);
+    return;
+  }
+  if (format == Format::SHARDED) {
+    SerialiseShards(stg, os, jobs_);
+    return;
+  }
+  Serialise(stg, os);
+}
+
+void Writer::Write(const Id& root, std::span<std::ostream* const> outputs,
+                   Format format, bool record_stable_hashes,
+                   Compression compression, bool canonical) {
+  if (outputs.size() == 1) {
+    Write(root, *outputs[0], format, record_stable_hashes, compression,
+          canonical);
+    return;
+  }
+  if (outputs.empty()) {
+    return;
+  }
+  std::ostringstream buffer;
+  Write(root, buffer, format, record_stable_hashes, compression, canonical);
+  const std::string bytes = std::move(buffer).str();
+  ForEachIndex(jobs_, outputs.size(), [&](size_t, size_t ix) {
+    outputs[ix]->write(bytes.data(),
+                       static_cast<std::streamsize>(bytes.size()));
+  });
 }
 
 }  // namespace proto
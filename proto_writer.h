@@ -20,21 +20,70 @@
 #ifndef STG_PROTO_WRITER_H_
 #define STG_PROTO_WRITER_H_
 
+#include <cstddef>
+#include <cstdint>
 #include <ostream>
+#include <span>
+#include <unordered_map>
 
 #include "graph.h"
+#include "stable_hash.h"
 
 namespace stg {
 namespace proto {
 
+// TEXT is protobuf text format, suitable for review and checking in. BINARY is
+// protobuf wire format, which is much faster to read back. SHARDED is wire
+// format split into shards that can be parsed in parallel, see proto_shards.h.
+enum class Format { TEXT, BINARY, SHARDED };
+
+// GZIP output is decompressed transparently by proto::Read. Sharded output
+// cannot be compressed, as its shards are located by offset.
+enum class Compression { NONE, GZIP };
+
 class Writer {
  public:
   explicit Writer(const stg::Graph& graph)
       : graph_(graph) {}
-  void Write(const Id&, std::ostream&);
+  // Known stable hashes, for example from proto::Read, are used instead of
+  // being computed again. Stable hashing and sorting use at most jobs workers.
+  Writer(const stg::Graph& graph, const StableHashCache& stable_hashes,
+         size_t jobs = 1)
+      : graph_(graph), stable_hashes_(stable_hashes), jobs_(jobs) {}
+  // If record_stable_hashes is set, the output also carries what is needed to
+  // recover the stable hashes on reading. If canonical is set, the output
+  // claims that the graph has been resolved and deduplicated.
+  void Write(const Id&, std::ostream&, Format format = Format::TEXT,
+             bool record_stable_hashes = false,
+             Compression compression = Compression::NONE,
+             bool canonical = false);
+  // As above, but to each of several streams. The output is produced only
+  // once, then copied to the streams concurrently.
+  void Write(const Id&, std::span<std::ostream* const> outputs,
+             Format format = Format::TEXT, bool record_stable_hashes = false,
+             Compression compression = Compression::NONE,
+             bool canonical = false);
+
+  // Nodes given external ids here have already been written. References to
+  // them use those ids, they are not written again and no other node is given
+  // one of their ids. The output extends what was written before, see
+  // proto::ReadExtension, and the ids given to the nodes written are added.
+  void Extend(std::unordered_map<Id, uint32_t>& written) {
+    written_ = &written;
+  }
+
+  // An index of the output is also written here, see proto_index.h. This needs
+  // binary or sharded, uncompressed output with an interface root.
+  void Index(std::ostream& index) {
+    index_ = &index;
+  }
 
  private:
   const stg::Graph& graph_;
+  StableHashCache stable_hashes_;
+  size_t jobs_ = 1;
+  std::unordered_map<Id, uint32_t>* written_ = nullptr;
+  std::ostream* index_ = nullptr;
 };
 
 }  // namespace proto
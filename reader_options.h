@@ -20,15 +20,46 @@
 #ifndef STG_READER_OPTIONS_H_
 #define STG_READER_OPTIONS_H_
 
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
 #include <type_traits>
 
+#include "filter.h"
+
 namespace stg {
 
+// Progress through the DWARF of an input, counted in compilation units and in
+// bytes of the section holding them, for split units that of the skeleton.
+struct ReadProgress {
+  size_t units = 0;
+  size_t total_units = 0;
+  uint64_t bytes = 0;
+  uint64_t total_bytes = 0;
+};
+
+// Progress reporting and cooperative cancellation, both between DWARF
+// compilation units. Progress calls for one input are never concurrent, but
+// inputs read at the same time share the callback. Once the cancellation flag
+// is set, reading stops with an error.
+struct ReadMonitor {
+  std::function<void(const ReadProgress&)> progress;
+  const std::atomic<bool>* cancel = nullptr;
+};
+
 struct ReadOptions {
   enum Value {
     INFO = 1 << 0,
     SKIP_DWARF = 1 << 1,
     TYPE_ROOTS = 1 << 2,
+    LAZY_DWARF = 1 << 3,
+    // share identical nodes as they are read, see HashConsing
+    HASH_CONS = 1 << 4,
+    // deduplicate DWARF types as compilation units are processed
+    DEDUPLICATE_DWARF = 1 << 5,
+    // skip DWARF compilation units identical to earlier ones
+    SKIP_DUPLICATE_UNITS = 1 << 6,
   };
 
   using Bitset = std::underlying_type_t<Value>;
@@ -50,6 +81,12 @@ struct ReadOptions {
   }
 
   Bitset bitset = 0;
+  // maximum number of threads to use for reading, where supported
+  size_t jobs = 1;
+  ReadMonitor monitor;
+  // if set, only the symbols it accepts are read, with the types they need,
+  // where the input format allows
+  const Filter* symbol_filter = nullptr;
 };
 
 }  // namespace stg
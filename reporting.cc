@@ -20,9 +20,15 @@
 
 #include "reporting.h"
 
+#include <algorithm>
 #include <array>
 #include <cstddef>
+#include <cstdint>
 #include <deque>
+#include <functional>
+#include <iomanip>
+#include <ios>
+#include <map>
 #include <optional>
 #include <ostream>
 #include <sstream>
@@ -32,13 +38,17 @@
 #include <unordered_map>
 #include <unordered_set>
 #include <utility>
+#include <variant>
 #include <vector>
 
 #include "comparison.h"
 #include "error.h"
 #include "fidelity.h"
 #include "graph.h"
+#include "naming.h"
+#include "parallel.h"
 #include "post_processing.h"
+#include "scc.h"
 
 namespace stg {
 namespace reporting {
@@ -48,12 +58,14 @@ struct FormatDescriptor {
   OutputFormat value;
 };
 
-static constexpr std::array<FormatDescriptor, 5> kFormats{{
-  {"plain", OutputFormat::PLAIN},
-  {"flat",  OutputFormat::FLAT },
-  {"small", OutputFormat::SMALL},
-  {"short", OutputFormat::SHORT},
-  {"viz",   OutputFormat::VIZ  },
+static constexpr std::array<FormatDescriptor, 7> kFormats{{
+  {"plain",  OutputFormat::PLAIN },
+  {"flat",   OutputFormat::FLAT  },
+  {"small",  OutputFormat::SMALL },
+  {"short",  OutputFormat::SHORT },
+  {"viz",    OutputFormat::VIZ   },
+  {"impact", OutputFormat::IMPACT},
+  {"json",   OutputFormat::JSON  },
 }};
 
 std::optional<OutputFormat> ParseOutputFormat(std::string_view format) {
@@ -75,12 +87,109 @@ std::ostream& operator<<(std::ostream& os, OutputFormatUsage) {
 
 namespace {
 
+void PrintValue(std::ostream& os, const DiffDetail::Value& value) {
+  std::visit([&os](const auto& x) {
+    if constexpr (!std::is_same_v<std::decay_t<decltype(x)>, std::monostate>) {
+      os << x;
+    }
+  }, value);
+}
+
+// Renders a diff detail as text.
+std::string Text(const DiffDetail& detail) {
+  using Kind = DiffDetail::Kind;
+  const auto& before = detail.before_;
+  const auto& after = detail.after_;
+  std::ostringstream os;
+  switch (detail.kind_) {
+    case Kind::TEXT:
+      os << detail.label_;
+      break;
+    case Kind::CHANGED:
+      os << detail.label_ << " changed from ";
+      PrintValue(os, before);
+      os << " to ";
+      PrintValue(os, after);
+      break;
+    case Kind::REMOVED:
+      os << detail.label_ << ' ';
+      PrintValue(os, before);
+      os << " was removed";
+      break;
+    case Kind::ADDED:
+      os << detail.label_ << ' ';
+      PrintValue(os, after);
+      os << " was added";
+      break;
+    case Kind::QUALIFIER_REMOVED:
+      os << "qualifier ";
+      PrintValue(os, before);
+      os << " removed";
+      break;
+    case Kind::QUALIFIER_ADDED:
+      os << "qualifier ";
+      PrintValue(os, after);
+      os << " added";
+      break;
+    case Kind::DEFINITION: {
+      const auto describe = [](const DiffDetail::Value& defined) {
+        return std::get<bool>(defined) ? "fully defined" : "only declared";
+      };
+      os << "was " << describe(before) << ", is now " << describe(after);
+      break;
+    }
+    case Kind::BIT_FIELD: {
+      const auto describe = [](const DiffDetail::Value& bitfield) {
+        return std::get<bool>(bitfield) ? "a bit-field" : "not a bit-field";
+      };
+      os << "was " << describe(before) << ", is now " << describe(after);
+      break;
+    }
+    case Kind::ENUMERATOR_REMOVED:
+      os << "enumerator '" << detail.name_ << "' (";
+      PrintValue(os, before);
+      os << ") was removed";
+      break;
+    case Kind::ENUMERATOR_ADDED:
+      os << "enumerator '" << detail.name_ << "' (";
+      PrintValue(os, after);
+      os << ") was added";
+      break;
+    case Kind::ENUMERATOR_CHANGED:
+      os << "enumerator '" << detail.name_ << "' value changed from ";
+      PrintValue(os, before);
+      os << " to ";
+      PrintValue(os, after);
+      break;
+    case Kind::PARAMETER:
+      os << "parameter ";
+      PrintValue(os, before);
+      break;
+    case Kind::PARAMETER_OF:
+      os << "parameter ";
+      PrintValue(os, before);
+      os << " of";
+      break;
+  }
+  return os.str();
+}
+
 std::string GetResolvedDescription(
-    const Graph& graph, NameCache& names, Id id) {
+    const Graph& graph, const ResolutionTable* resolutions, NameCache& names,
+    Id id) {
   std::ostringstream os;
-  const auto [resolved, typedefs] = ResolveTypedefs(graph, id);
-  for (const auto& td : typedefs) {
-    os << '\'' << td << "' = ";
+  Id resolved = id;
+  if (resolutions != nullptr) {
+    resolutions->ForEachTypedef(id, [&](const Typedef& x) {
+      os << '\'' << x.name << "' = ";
+    });
+    resolved = resolutions->Resolved(id);
+  } else {
+    const auto [target, typedefs] = ResolveTypedefs(graph, id);
+    for (const auto& td : typedefs) {
+      os << '\'' << td << "' = ";
+    }
+    resolved = target;
   }
   os << '\'' << Describe(graph, names)(resolved) << '\''
      << DescribeExtra(graph)(resolved);
@@ -92,9 +201,9 @@ std::string GetResolvedDescription(
 // empty.
 //
 // It returns true if the comparison denotes addition or removal of a node.
-bool PrintComparison(const Reporting& reporting, const Comparison& comparison,
-                     std::ostream& os, size_t indent,
-                     const std::string& prefix) {
+bool PrintComparison(const Descriptions& descriptions,
+                     const Comparison& comparison, std::ostream& os,
+                     size_t indent, const std::string& prefix) {
   os << std::string(indent, ' ');
   if (!prefix.empty()) {
     os << prefix << ' ';
@@ -106,27 +215,25 @@ bool PrintComparison(const Reporting& reporting, const Comparison& comparison,
       << "internal error: Attempt to print comparison with nothing to compare.";
 
   if (!id2) {
-    os << DescribeKind(reporting.graph)(*id1) << " '"
-       << Describe(reporting.graph, reporting.names)(*id1)
+    os << descriptions.Kind(*id1) << " '"
+       << descriptions.Name(*id1)
        << "'"
-       << DescribeExtra(reporting.graph)(*id1)
+       << descriptions.Extra(*id1)
        << " was removed\n";
     return true;
   }
   if (!id1) {
-    os << DescribeKind(reporting.graph)(*id2) << " '"
-       << Describe(reporting.graph, reporting.names)(*id2)
+    os << descriptions.Kind(*id2) << " '"
+       << descriptions.Name(*id2)
        << "'"
-       << DescribeExtra(reporting.graph)(*id2)
+       << descriptions.Extra(*id2)
        << " was added\n";
     return true;
   }
 
-  const auto description1 =
-      GetResolvedDescription(reporting.graph, reporting.names, *id1);
-  const auto description2 =
-      GetResolvedDescription(reporting.graph, reporting.names, *id2);
-  os << DescribeKind(reporting.graph)(*id1) << ' ';
+  const auto& description1 = descriptions.Resolved(*id1);
+  const auto& description2 = descriptions.Resolved(*id2);
+  os << descriptions.Kind(*id1) << ' ';
   if (description1 == description2) {
     os << description1 << " changed\n";
   } else {
@@ -137,39 +244,73 @@ bool PrintComparison(const Reporting& reporting, const Comparison& comparison,
 
 static constexpr size_t INDENT_INCREMENT = 2;
 
+// results rendered concurrently, but not yet consumed, per job
+static constexpr size_t kRenderBatchPerJob = 64;
+
+// Calls render(index) for each index in [0, count), spread over the configured
+// number of jobs, and passes the results to consume in index order. Results are
+// rendered in batches, so only a bounded number are held at once.
+template <typename Result, typename Render, typename Consume>
+void RenderConcurrently(const Reporting& reporting, size_t count,
+                        Render&& render, Consume&& consume) {
+  ForEachIndexInOrder<Result>(reporting.options.jobs, count,
+                              kRenderBatchPerJob, std::forward<Render>(render),
+                              std::forward<Consume>(consume));
+}
+
 class Plain {
   // unvisited (absent) -> started (false) -> finished (true)
   using Seen = std::unordered_map<Comparison, bool, HashComparison>;
+  // diff-holding node -> index of the top-level diff that first reaches it
+  using Owners = ComparisonMap<size_t>;
 
  public:
-  Plain(const Reporting& reporting, std::ostream& output)
-      : reporting_(reporting), output_(output) {}
+  Plain(const Reporting& reporting, const Descriptions& descriptions,
+        std::ostream& output)
+      : reporting_(reporting), descriptions_(descriptions), output_(output) {}
 
   void Report(const Comparison&);
 
  private:
+  Plain(const Reporting& reporting, const Descriptions& descriptions,
+        std::ostream& output, const Owners& owners, size_t index)
+      : reporting_(reporting), descriptions_(descriptions), output_(output),
+        owners_(&owners), index_(index) {}
+
   const Reporting& reporting_;
+  const Descriptions& descriptions_;
   std::ostream& output_;
   Seen seen_;
+  // if set, diff-holding nodes owned by earlier top-level diffs have already
+  // been reported
+  const Owners* owners_ = nullptr;
+  size_t index_ = 0;
 
   void Print(const Comparison&, size_t, const std::string&);
+  void ReportConcurrently(const Diff&);
+  static void Own(const Outcomes&, const Comparison&, size_t, Owners&);
 };
 
 void Plain::Print(const Comparison& comparison, size_t indent,
            const std::string& prefix) {
-  if (PrintComparison(reporting_, comparison, output_, indent, prefix)) {
+  if (PrintComparison(descriptions_, comparison, output_, indent, prefix)) {
     return;
   }
 
   indent += INDENT_INCREMENT;
-  const auto it = reporting_.outcomes.find(comparison);
-  Check(it != reporting_.outcomes.end())
-      << "internal error: missing comparison";
-  const auto& diff = it->second;
+  const auto& diff = reporting_.outcomes.At(comparison);
 
   const bool holds_changes = diff.holds_changes;
   std::pair<Seen::iterator, bool> insertion;
 
+  if (holds_changes && owners_ != nullptr
+      && owners_->At(comparison) < index_) {
+    if (!diff.details.empty()) {
+      output_ << std::string(indent, ' ') << "(already reported)\n";
+    }
+    return;
+  }
+
   if (holds_changes) {
     insertion = seen_.insert({comparison, false});
   }
@@ -185,9 +326,9 @@ void Plain::Print(const Comparison& comparison, size_t indent,
 
   for (const auto& detail : diff.details) {
     if (!detail.edge_) {
-      output_ << std::string(indent, ' ') << detail.text_ << '\n';
+      output_ << std::string(indent, ' ') << Text(detail) << '\n';
     } else {
-      Print(*detail.edge_, indent, detail.text_);
+      Print(*detail.edge_, indent, Text(detail));
     }
   }
 
@@ -198,7 +339,11 @@ void Plain::Print(const Comparison& comparison, size_t indent,
 
 void Plain::Report(const Comparison& comparison) {
   // unpack then print - want symbol diff forest rather than symbols diff tree
-  const auto& diff = reporting_.outcomes.at(comparison);
+  const auto& diff = reporting_.outcomes.At(comparison);
+  if (reporting_.options.jobs > 1) {
+    ReportConcurrently(diff);
+    return;
+  }
   for (const auto& detail : diff.details) {
     Print(*detail.edge_, 0, {});
     // paragraph spacing
@@ -206,48 +351,116 @@ void Plain::Report(const Comparison& comparison) {
   }
 }
 
-// Print the subtree of a diff graph starting at a given node and stopping at
+// Records the index of the top-level diff whose printing would first reach
+// each diff-holding node, following the same paths as Print.
+void Plain::Own(const Outcomes& outcomes, const Comparison& comparison,
+                size_t index, Owners& owners) {
+  if (!comparison.first || !comparison.second) {
+    // addition or removal
+    return;
+  }
+  const auto& diff = outcomes.At(comparison);
+  if (diff.holds_changes && !owners.Insert(comparison, index).second) {
+    return;
+  }
+  for (const auto& detail : diff.details) {
+    if (detail.edge_) {
+      Own(outcomes, *detail.edge_, index, owners);
+    }
+  }
+}
+
+// Given the owners of all diff-holding nodes, each top-level diff can be
+// printed independently of the others, with the same result.
+void Plain::ReportConcurrently(const Diff& diff) {
+  Owners owners;
+  for (size_t index = 0; index < diff.details.size(); ++index) {
+    Own(reporting_.outcomes, *diff.details[index].edge_, index, owners);
+  }
+  RenderConcurrently<std::string>(
+      reporting_, diff.details.size(),
+      [&](size_t index) {
+        std::ostringstream os;
+        Plain(reporting_, descriptions_, os, owners, index)
+            .Print(*diff.details[index].edge_, 0, {});
+        // paragraph spacing
+        os << '\n';
+        return std::move(os).str();
+      },
+      [&](std::string buffer) { output_ << buffer; });
+}
+
+// Collect the subtree of a diff graph starting at a given node and stopping at
 // nodes that can themselves hold diffs, queuing such nodes for subsequent
-// printing. Optionally, avoid printing "uninteresting" nodes - those that have
-// no diff and no path to a diff that does not pass through a node that can hold
-// diffs. Return whether the diff node's tree was intrinisically interesting.
+// collection. Mark "uninteresting" subtrees - those that have no diff and no
+// path to a diff that does not pass through a node that can hold diffs - as
+// not part of the SMALL report. Return whether the diff node's tree was
+// intrinisically interesting.
+//
+// The FLAT, SMALL and SHORT reports are all written from the same items, which
+// are passed on in report order as soon as they are complete.
 class Flat {
  public:
-  Flat(const Reporting& reporting, bool full, std::ostream& output)
-      : reporting_(reporting), full_(full), output_(output) {}
+  using Emit = std::function<void(FlatItem)>;
 
-  void Report(const Comparison&);
+  Flat(const Reporting& reporting, const Descriptions& descriptions,
+       const Compaction* compaction)
+      : reporting_(reporting), descriptions_(descriptions),
+        compaction_(compaction) {}
+
+  void Report(const Comparison&, const Emit&);
 
  private:
+  friend class reporting::Compaction;
+
   const Reporting& reporting_;
-  const bool full_;
-  std::ostream& output_;
+  const Descriptions& descriptions_;
+  // if set, shared diff nodes are copied from here rather than printed
+  const Compaction* compaction_;
+  // whether Print queues newly seen diff-holding nodes
+  bool queue_ = true;
   std::unordered_set<Comparison, HashComparison> seen_;
   std::deque<Comparison> todo_;
 
-  bool Print(const Comparison&, bool, std::ostream&, size_t,
+  bool Print(const Comparison&, bool, std::vector<FlatLine>&, size_t,
              const std::string&);
+  bool PrintDetails(const Diff&, std::vector<FlatLine>&, size_t);
+  void Enqueue(const Comparison&);
+  FlatItem Item(const Comparison&, bool);
+  void Queue(const Comparison&, bool);
+  void ReportConcurrently(const Diff&, const Emit&);
 };
 
-bool Flat::Print(const Comparison& comparison, bool stop, std::ostream& os,
-                 size_t indent, const std::string& prefix) {
+void Flat::Enqueue(const Comparison& comparison) {
+  if (seen_.insert(comparison).second) {
+    todo_.push_back(comparison);
+  }
+}
+
+bool Flat::Print(const Comparison& comparison, bool stop,
+                 std::vector<FlatLine>& lines, size_t indent,
+                 const std::string& prefix) {
   // Nodes that represent additions or removal are always interesting and no
   // recursion is possible.
-  if (PrintComparison(reporting_, comparison, os, indent, prefix)) {
+  std::ostringstream os;
+  const bool added_or_removed =
+      PrintComparison(descriptions_, comparison, os, indent, prefix);
+  std::string line = std::move(os).str();
+  // drop the newline
+  line.pop_back();
+  lines.push_back({std::move(line), true});
+  if (added_or_removed) {
     return true;
   }
 
   // Look up the diff (including node and edge changes).
-  const auto it = reporting_.outcomes.find(comparison);
-  Check(it != reporting_.outcomes.end())
-      << "internal error: missing comparison";
-  const auto& diff = it->second;
+  const auto& diff = reporting_.outcomes.At(comparison);
 
   // Check the stopping condition.
   if (diff.holds_changes && stop) {
     // If it's a new diff-holding node, queue it.
-    if (seen_.insert(comparison).second) {
-      todo_.push_back(comparison);
+    if (queue_) {
+      Enqueue(comparison);
     }
     return false;
   }
@@ -257,23 +470,47 @@ bool Flat::Print(const Comparison& comparison, bool stop, std::ostream& os,
     Die() << "internal error: FlatPrint called on inappropriate node";
   }
 
+  // A shared diff node has already been printed once and for all.
+  if (compaction_ != nullptr) {
+    if (const auto* block = compaction_->Find(comparison)) {
+      const std::string spaces(indent, ' ');
+      for (const auto& [text, small] : block->lines) {
+        lines.push_back({spaces + text, small});
+      }
+      if (queue_) {
+        for (const auto& holder : block->holders) {
+          Enqueue(holder);
+        }
+      }
+      return block->interesting;
+    }
+  }
+
+  return PrintDetails(diff, lines, indent);
+}
+
+// Prints the details of a diff below its header line.
+bool Flat::PrintDetails(const Diff& diff, std::vector<FlatLine>& lines,
+                        size_t indent) {
   // Indent before describing diff details.
   indent += INDENT_INCREMENT;
   bool interesting = diff.has_changes;
   for (const auto& detail : diff.details) {
     if (!detail.edge_) {
-      os << std::string(indent, ' ') << detail.text_ << '\n';
+      lines.push_back({std::string(indent, ' ') + Text(detail), true});
       // Node changes may not be interesting, if we allow non-change diff
       // details at some point. Just trust the has_changes flag.
     } else {
       // Edge changes are interesting if the target diff node is.
-      std::ostringstream sub_os;
+      const size_t start = lines.size();
       // Set the stop flag to prevent recursion past diff-holding nodes.
       bool sub_interesting =
-          Print(*detail.edge_, true, sub_os, indent, detail.text_);
-      // If the sub-tree was interesting, add it.
-      if (sub_interesting || full_) {
-        os << sub_os.str();
+          Print(*detail.edge_, true, lines, indent, Text(detail));
+      // If the sub-tree was not interesting, leave it out of SMALL reports.
+      if (!sub_interesting) {
+        for (size_t ix = start; ix < lines.size(); ++ix) {
+          lines[ix].small = false;
+        }
       }
       interesting |= sub_interesting;
     }
@@ -281,42 +518,229 @@ bool Flat::Print(const Comparison& comparison, bool stop, std::ostream& os,
   return interesting;
 }
 
-void Flat::Report(const Comparison& comparison) {
+FlatItem Flat::Item(const Comparison& comparison, bool stop) {
+  FlatItem item;
+  item.interesting = Print(comparison, stop, item.lines, 0, {});
+  return item;
+}
+
+void Flat::Report(const Comparison& comparison, const Emit& emit) {
   // We want a symbol diff forest rather than a symbol table diff tree, so
   // unpack the symbol table and then print the symbols specially.
-  const auto& diff = reporting_.outcomes.at(comparison);
+  const auto& diff = reporting_.outcomes.At(comparison);
+  if (reporting_.options.jobs > 1) {
+    ReportConcurrently(diff, emit);
+    return;
+  }
   for (const auto& detail : diff.details) {
-    std::ostringstream os;
-    const bool interesting = Print(*detail.edge_, true, os, 0, {});
-    if (interesting || full_) {
-      output_ << os.str() << '\n';
+    emit(Item(*detail.edge_, true));
+  }
+  while (!todo_.empty()) {
+    auto comp = todo_.front();
+    todo_.pop_front();
+    emit(Item(comp, false));
+  }
+}
+
+// Queues the diff-holding nodes that printing the given node would reach,
+// following the same paths as Print.
+void Flat::Queue(const Comparison& comparison, bool stop) {
+  if (!comparison.first || !comparison.second) {
+    // addition or removal
+    return;
+  }
+  const auto& diff = reporting_.outcomes.At(comparison);
+  if (diff.holds_changes && stop) {
+    Enqueue(comparison);
+    return;
+  }
+  if (compaction_ != nullptr) {
+    if (const auto* block = compaction_->Find(comparison)) {
+      for (const auto& holder : block->holders) {
+        Enqueue(holder);
+      }
+      return;
+    }
+  }
+  for (const auto& detail : diff.details) {
+    if (detail.edge_) {
+      Queue(*detail.edge_, true);
     }
   }
+}
+
+// Once everything to be printed is known, and in what order, each item can be
+// printed independently of the others.
+void Flat::ReportConcurrently(const Diff& diff, const Emit& emit) {
+  // top-level diffs, then diff-holding nodes in the order they are reached
+  std::vector<std::pair<Comparison, bool>> items;
+  for (const auto& detail : diff.details) {
+    items.emplace_back(*detail.edge_, true);
+    Queue(*detail.edge_, true);
+  }
   while (!todo_.empty()) {
     auto comp = todo_.front();
     todo_.pop_front();
-    std::ostringstream os;
-    const bool interesting = Print(comp, false, os, 0, {});
-    if (interesting || full_) {
-      output_ << os.str() << '\n';
+    items.emplace_back(comp, false);
+    Queue(comp, false);
+  }
+  RenderConcurrently<FlatItem>(
+      reporting_, items.size(),
+      [&](size_t index) {
+        const auto& [comparison, stop] = items[index];
+        Flat flat(reporting_, descriptions_, compaction_);
+        flat.queue_ = false;
+        return flat.Item(comparison, stop);
+      },
+      emit);
+}
+
+}  // namespace
+
+Compaction::Compaction(const Reporting& reporting,
+                       const Descriptions& descriptions,
+                       const Comparison& comparison) {
+  // Count the edges to each diff node that cannot hold diffs, noting the order
+  // in which nodes are finished, so that a node's descendants are (unless it is
+  // part of a cycle) finished before it.
+  const auto& outcomes = reporting.outcomes;
+  ComparisonMap<size_t> references;
+  std::vector<Comparison> finished;
+  const std::function<void(const Comparison&)> visit =
+      [&](const Comparison& from) {
+        for (const auto& detail : outcomes.At(from).details) {
+          if (!detail.edge_) {
+            continue;
+          }
+          const auto& to = *detail.edge_;
+          if (!to.first || !to.second) {
+            // addition or removal
+            continue;
+          }
+          const auto& diff = outcomes.At(to);
+          if (diff.holds_changes) {
+            if (references.Insert(to, 0).second) {
+              visit(to);
+            }
+          } else {
+            const auto [count, inserted] = references.Insert(to, 0);
+            ++*count;
+            if (inserted) {
+              visit(to);
+              finished.push_back(to);
+            }
+          }
+        }
+      };
+  visit(comparison);
+
+  // Print the shared ones, descendants first, reusing the blocks already
+  // printed and merging identical blocks.
+  std::unordered_map<std::string, size_t> merged;
+  for (const auto& shared : finished) {
+    if (*references.Find(shared) < 2) {
+      continue;
+    }
+    ++shared_;
+    Flat flat(reporting, descriptions, this);
+    Block block;
+    block.interesting =
+        flat.PrintDetails(outcomes.At(shared), block.lines, 0);
+    block.holders.assign(flat.todo_.begin(), flat.todo_.end());
+    std::ostringstream key;
+    for (const auto& [text, small] : block.lines) {
+      key << small << text << '\n';
+    }
+    key << block.interesting;
+    for (const auto& [id1, id2] : block.holders) {
+      key << ' ' << *id1 << ' ' << *id2;
+    }
+    const auto [it, inserted] =
+        merged.emplace(std::move(key).str(), blocks_.size());
+    if (inserted) {
+      blocks_.push_back(std::move(block));
     }
+    index_.Insert(shared, it->second);
   }
 }
 
-size_t VizId(std::unordered_map<Comparison, size_t, HashComparison>& ids,
-             const Comparison& comparison) {
-  return ids.insert({comparison, ids.size()}).first->second;
+const Compaction::Block* Compaction::Find(const Comparison& comparison) const {
+  const size_t* index = index_.Find(comparison);
+  return index != nullptr ? &blocks_[*index] : nullptr;
 }
 
-void VizPrint(const Reporting& reporting, const Comparison& comparison,
-              std::unordered_set<Comparison, HashComparison>& seen,
-              std::unordered_map<Comparison, size_t, HashComparison>& ids,
-              std::ostream& os) {
-  if (!seen.insert(comparison).second) {
-    return;
+namespace {
+
+// Writes the lines of an item that belong in a FLAT or (if not full) SMALL
+// report. A SHORT report is a post-processed SMALL report.
+void WriteItem(const FlatItem& item, bool full, LineSink& output) {
+  if (item.interesting || full) {
+    for (const auto& line : item.lines) {
+      if (line.small || full) {
+        output.Push(line.text);
+      }
+    }
+    // paragraph spacing
+    output.Push({});
   }
+}
 
-  const auto node = VizId(ids, comparison);
+// Writes a Graphviz rendering of the diff graph. Nodes are numbered in the
+// order they are first reached, in a packed comparison table, and the graph is
+// walked depth-first with an explicit stack, so that deep diffs need neither
+// deep recursion nor node-based hash tables. If the output would exceed the
+// configured size, the remaining nodes and edges are omitted and a comment
+// marks the truncation.
+class Viz {
+ public:
+  Viz(const Reporting& reporting, const Descriptions& descriptions,
+      std::ostream& output)
+      : reporting_(reporting), descriptions_(descriptions), output_(output),
+        limit_(reporting.options.max_viz_bytes) {}
+
+  void Report(const Comparison& comparison);
+
+ private:
+  struct Frame {
+    Comparison comparison;
+    size_t node;
+    // the next detail to be printed and whether its target has been visited
+    size_t detail = 0;
+    bool returning = false;
+    // the number of attribute changes printed
+    size_t attributes = 0;
+  };
+
+  bool Emit(const std::string& text);
+  bool Visit(const Comparison& comparison);
+
+  const Reporting& reporting_;
+  const Descriptions& descriptions_;
+  std::ostream& output_;
+  const size_t limit_;
+  size_t bytes_ = 0;
+  ComparisonMap<size_t> ids_;
+  std::vector<Frame> stack_;
+};
+
+// Writes some text, unless that would exceed the size limit.
+bool Viz::Emit(const std::string& text) {
+  if (limit_ != 0 && bytes_ + text.size() > limit_) {
+    return false;
+  }
+  bytes_ += text.size();
+  output_ << text;
+  return true;
+}
+
+// Numbers and describes a node, if not already seen, and pushes a frame to
+// print its details, if it has any. Returns false if the output is full.
+bool Viz::Visit(const Comparison& comparison) {
+  const auto [id, inserted] = ids_.Insert(comparison, ids_.Size());
+  if (!inserted) {
+    return true;
+  }
+  const size_t node = *id;
 
   const auto id1 = comparison.first;
   const auto id2 = comparison.second;
@@ -324,30 +748,27 @@ void VizPrint(const Reporting& reporting, const Comparison& comparison,
   Check(id1.has_value() || id2.has_value())
       << "internal error: Attempt to print comparison with nothing to compare.";
 
+  std::ostringstream os;
   if (!id2) {
     os << "  \"" << node << "\" [color=red, label=\"" << "removed("
-       << Describe(reporting.graph, reporting.names)(*id1)
-       << DescribeExtra(reporting.graph)(*id1)
+       << descriptions_.Name(*id1)
+       << descriptions_.Extra(*id1)
        << ")\"]\n";
-    return;
+    return Emit(std::move(os).str());
   }
   if (!id1) {
     os << "  \"" << node << "\" [color=red, label=\"" << "added("
-       << Describe(reporting.graph, reporting.names)(*id2)
-       << DescribeExtra(reporting.graph)(*id2)
+       << descriptions_.Name(*id2)
+       << descriptions_.Extra(*id2)
        << ")\"]\n";
-    return;
+    return Emit(std::move(os).str());
   }
 
-  const auto it = reporting.outcomes.find(comparison);
-  Check(it != reporting.outcomes.end()) << "internal error: missing comparison";
-  const auto& diff = it->second;
+  const auto& diff = reporting_.outcomes.At(comparison);
   const char* colour = diff.has_changes ? "color=red, " : "";
   const char* shape = diff.holds_changes ? "shape=rectangle, " : "";
-  const auto description1 =
-      GetResolvedDescription(reporting.graph, reporting.names, *id1);
-  const auto description2 =
-      GetResolvedDescription(reporting.graph, reporting.names, *id2);
+  const auto& description1 = descriptions_.Resolved(*id1);
+  const auto& description2 = descriptions_.Resolved(*id2);
   if (description1 == description2) {
     os << "  \"" << node << "\" [" << colour << shape << "label=\""
        << description1 << "\"]\n";
@@ -355,31 +776,449 @@ void VizPrint(const Reporting& reporting, const Comparison& comparison,
     os << "  \"" << node << "\" [" << colour << shape << "label=\""
        << description1 << " -> " << description2 << "\"]\n";
   }
+  if (!Emit(std::move(os).str())) {
+    return false;
+  }
+  stack_.push_back({comparison, node});
+  return true;
+}
 
-  size_t index = 0;
-  for (const auto& detail : diff.details) {
+void Viz::Report(const Comparison& comparison) {
+  output_ << "digraph \"ABI diff\" {\n";
+  bool full = !Visit(comparison);
+  while (!full && !stack_.empty()) {
+    const size_t top = stack_.size() - 1;
+    const auto& details =
+        reporting_.outcomes.At(stack_[top].comparison).details;
+    if (stack_[top].detail == details.size()) {
+      stack_.pop_back();
+      continue;
+    }
+    const auto& detail = details[stack_[top].detail];
+    const size_t node = stack_[top].node;
+    std::ostringstream os;
     if (!detail.edge_) {
       // attribute change, create an implicit edge and node
+      const size_t index = stack_[top].attributes++;
       os << "  \"" << node << "\" -> \"" << node << ':' << index << "\"\n"
          << "  \"" << node << ':' << index << "\" [color=red, label=\""
-         << detail.text_ << "\"]\n";
-      ++index;
+         << Text(detail) << "\"]\n";
+    } else if (!stack_[top].returning) {
+      // describe the target (and what it reaches) before the edge to it
+      stack_[top].returning = true;
+      full = !Visit(*detail.edge_);
+      continue;
     } else {
-      const auto& to = *detail.edge_;
-      VizPrint(reporting, to, seen, ids, os);
-      os << "  \"" << node << "\" -> \"" << VizId(ids, to) << "\" [label=\""
-         << detail.text_ << "\"]\n";
+      os << "  \"" << node << "\" -> \"" << *ids_.Find(*detail.edge_)
+         << "\" [label=\"" << Text(detail) << "\"]\n";
+      stack_[top].returning = false;
     }
+    full = !Emit(std::move(os).str());
+    ++stack_[top].detail;
   }
+  if (full) {
+    output_ << "  // truncated: output limit of " << limit_
+            << " bytes reached\n";
+  }
+  output_ << "}\n";
 }
 
-void ReportViz(const Reporting& reporting, const Comparison& comparison,
-               std::ostream& output) {
-  output << "digraph \"ABI diff\" {\n";
-  std::unordered_set<Comparison, HashComparison> seen;
-  std::unordered_map<Comparison, size_t, HashComparison> ids;
-  VizPrint(reporting, comparison, seen, ids, output);
-  output << "}\n";
+struct JsonString {
+  std::string_view string;
+};
+
+std::ostream& operator<<(std::ostream& os, JsonString value) {
+  os << '"';
+  for (const char c : value.string) {
+    if (c == '"' || c == '\\') {
+      os << '\\' << c;
+    } else if (static_cast<unsigned char>(c) < 0x20) {
+      os << "\\u" << std::hex << std::setfill('0') << std::setw(4)
+         << static_cast<int>(c) << std::setfill(' ') << std::dec;
+    } else {
+      os << c;
+    }
+  }
+  return os << '"';
+}
+
+// Writes a diff detail value as a JSON value: booleans and integers as
+// themselves and anything else as the string it would be printed as.
+void PrintJsonValue(std::ostream& os, const DiffDetail::Value& value) {
+  std::visit([&os](const auto& x) {
+    using T = std::decay_t<decltype(x)>;
+    if constexpr (std::is_same_v<T, std::monostate>) {
+      os << "null";
+    } else if constexpr (std::is_same_v<T, bool>) {
+      os << (x ? "true" : "false");
+    } else if constexpr (std::is_same_v<T, int64_t>
+                         || std::is_same_v<T, uint64_t>) {
+      os << x;
+    } else if constexpr (std::is_same_v<T, std::string>) {
+      os << JsonString{x};
+    } else {
+      std::ostringstream text;
+      text << x;
+      os << JsonString{text.str()};
+    }
+  }, value);
+}
+
+std::string_view JsonKind(DiffDetail::Kind kind) {
+  using Kind = DiffDetail::Kind;
+  switch (kind) {
+    case Kind::TEXT:
+      return "text";
+    case Kind::CHANGED:
+      return "changed";
+    case Kind::REMOVED:
+      return "removed";
+    case Kind::ADDED:
+      return "added";
+    case Kind::QUALIFIER_REMOVED:
+      return "qualifier_removed";
+    case Kind::QUALIFIER_ADDED:
+      return "qualifier_added";
+    case Kind::DEFINITION:
+      return "definition";
+    case Kind::BIT_FIELD:
+      return "bit_field";
+    case Kind::ENUMERATOR_REMOVED:
+      return "enumerator_removed";
+    case Kind::ENUMERATOR_ADDED:
+      return "enumerator_added";
+    case Kind::ENUMERATOR_CHANGED:
+      return "enumerator_changed";
+    case Kind::PARAMETER:
+      return "parameter";
+    case Kind::PARAMETER_OF:
+      return "parameter_of";
+  }
+}
+
+// Writes the diff graph as a single JSON object, holding the nodes in the order
+// they are first reached, breadth-first, each numbered by its position. Edges
+// refer to these numbers, so shared and recursive diffs are written once. Each
+// node is written as soon as it is reached, straight from the outcomes and the
+// node descriptions, and the structured details are written as they are, not
+// as the text of other reports.
+class Json {
+ public:
+  Json(const Reporting& reporting, const Descriptions& descriptions,
+       std::ostream& output)
+      : reporting_(reporting), descriptions_(descriptions), output_(output) {}
+
+  void Report(const Comparison& comparison);
+
+ private:
+  size_t Number(const Comparison& comparison);
+  void Write(const Comparison& comparison, size_t node);
+
+  const Reporting& reporting_;
+  const Descriptions& descriptions_;
+  std::ostream& output_;
+  ComparisonMap<size_t> ids_;
+  std::deque<Comparison> queue_;
+};
+
+// Returns the number of a node, queuing it to be written if it is new.
+size_t Json::Number(const Comparison& comparison) {
+  const auto [id, inserted] = ids_.Insert(comparison, ids_.Size());
+  if (inserted) {
+    queue_.push_back(comparison);
+  }
+  return *id;
+}
+
+void Json::Write(const Comparison& comparison, size_t node) {
+  const auto id1 = comparison.first;
+  const auto id2 = comparison.second;
+
+  Check(id1.has_value() || id2.has_value())
+      << "internal error: Attempt to print comparison with nothing to compare.";
+
+  output_ << R"({"id":)" << node;
+  if (!id1 || !id2) {
+    const Id id = id1 ? *id1 : *id2;
+    output_ << R"(,"status":)" << (id1 ? R"("removed")" : R"("added")")
+            << R"(,"kind":)" << JsonString{descriptions_.Kind(id)}
+            << R"(,"name":)" << JsonString{descriptions_.Name(id)};
+    const auto& extra = descriptions_.Extra(id);
+    if (!extra.empty()) {
+      output_ << R"(,"extra":)" << JsonString{extra};
+    }
+    output_ << '}';
+    return;
+  }
+
+  const auto& diff = reporting_.outcomes.At(comparison);
+  output_ << R"(,"status":"changed","kind":)"
+          << JsonString{descriptions_.Kind(*id1)}
+          << R"(,"before":)" << JsonString{descriptions_.Resolved(*id1)}
+          << R"(,"after":)" << JsonString{descriptions_.Resolved(*id2)}
+          << R"(,"has_changes":)" << (diff.has_changes ? "true" : "false")
+          << R"(,"holds_changes":)" << (diff.holds_changes ? "true" : "false")
+          << R"(,"details":[)";
+  const char* separator = "";
+  for (const auto& detail : diff.details) {
+    output_ << separator << R"({"kind":")" << JsonKind(detail.kind_) << '"';
+    separator = ",";
+    if (!detail.label_.empty()) {
+      output_ << R"(,"label":)" << JsonString{detail.label_};
+    }
+    if (!detail.name_.empty()) {
+      output_ << R"(,"name":)" << JsonString{detail.name_};
+    }
+    if (!std::holds_alternative<std::monostate>(detail.before_)) {
+      output_ << R"(,"before":)";
+      PrintJsonValue(output_, detail.before_);
+    }
+    if (!std::holds_alternative<std::monostate>(detail.after_)) {
+      output_ << R"(,"after":)";
+      PrintJsonValue(output_, detail.after_);
+    }
+    if (detail.edge_) {
+      output_ << R"(,"node":)" << Number(*detail.edge_);
+    }
+    output_ << '}';
+  }
+  output_ << "]}";
+}
+
+void Json::Report(const Comparison& comparison) {
+  output_ << R"({"root":)" << Number(comparison) << R"(,"nodes":[)";
+  const char* separator = "\n";
+  for (size_t node = 0; !queue_.empty(); ++node) {
+    const auto next = queue_.front();
+    queue_.pop_front();
+    output_ << separator;
+    separator = ",\n";
+    Write(next, node);
+  }
+  output_ << "\n]}\n";
+}
+
+// Lists each change, as a SMALL report would find it, with the top-level
+// symbols (or types) whose diffs reach it. The pieces of the diff graph that a
+// FLAT report would print are linked by the diff-holding nodes each reaches,
+// and the top-level symbols reaching each piece are found in a single pass
+// over the strongly-connected components of these links, rather than by
+// searching from each symbol or each change.
+class Impact {
+ public:
+  Impact(const Reporting& reporting, const Descriptions& descriptions)
+      : reporting_(reporting), descriptions_(descriptions) {}
+
+  void Report(const Comparison& comparison, std::ostream& output);
+
+ private:
+  struct Item {
+    Comparison comparison;
+    // whether the piece has changes of its own
+    bool interesting = false;
+    // the pieces it links to
+    std::vector<size_t> links;
+    // the top-level pieces which reach it, in order
+    std::vector<size_t> impacted;
+  };
+
+  size_t Add(const Comparison& comparison);
+  bool Walk(const Diff& diff, size_t from);
+  void Visit(size_t index);
+  void Propagate();
+
+  const Reporting& reporting_;
+  const Descriptions& descriptions_;
+  std::unordered_map<Comparison, size_t, HashComparison> index_;
+  std::vector<Item> items_;
+  size_t roots_ = 0;
+  SCC<size_t> scc_;
+  std::vector<bool> visited_;
+  // strongly-connected components of pieces, in topological order, leaves
+  // first
+  std::vector<std::vector<size_t>> components_;
+};
+
+size_t Impact::Add(const Comparison& comparison) {
+  const auto [it, inserted] = index_.emplace(comparison, items_.size());
+  if (inserted) {
+    items_.push_back({comparison, false, {}, {}});
+  }
+  return it->second;
+}
+
+// Follows the edges of a diff, within a piece, noting links to other pieces.
+// Returns whether there were any changes.
+bool Impact::Walk(const Diff& diff, size_t from) {
+  bool interesting = diff.has_changes;
+  for (const auto& detail : diff.details) {
+    if (!detail.edge_) {
+      continue;
+    }
+    const auto& comparison = *detail.edge_;
+    if (!comparison.first || !comparison.second) {
+      // addition or removal
+      interesting = true;
+      continue;
+    }
+    const auto& child = reporting_.outcomes.At(comparison);
+    if (child.holds_changes) {
+      const size_t to = Add(comparison);
+      items_[from].links.push_back(to);
+    } else {
+      interesting |= Walk(child, from);
+    }
+  }
+  return interesting;
+}
+
+void Impact::Visit(size_t index) {
+  if (visited_[index]) {
+    return;
+  }
+  const auto handle = scc_.Open(index);
+  if (!handle) {
+    return;
+  }
+  for (const auto to : items_[index].links) {
+    Visit(to);
+  }
+  const auto nodes = scc_.Close(*handle);
+  if (!nodes.empty()) {
+    for (const auto node : nodes) {
+      visited_[node] = true;
+    }
+    components_.emplace_back(nodes.begin(), nodes.end());
+  }
+}
+
+// Visits the components from the top-level pieces down, so that all the pieces
+// linking to a component are done before it.
+void Impact::Propagate() {
+  std::vector<size_t> component_of(items_.size());
+  for (size_t ix = 0; ix < components_.size(); ++ix) {
+    for (const auto node : components_[ix]) {
+      component_of[node] = ix;
+    }
+  }
+  std::vector<std::vector<size_t>> incoming(components_.size());
+  for (size_t ix = components_.size(); ix > 0; --ix) {
+    const auto& nodes = components_[ix - 1];
+    auto& impacted = incoming[ix - 1];
+    for (const auto node : nodes) {
+      if (node < roots_) {
+        impacted.push_back(node);
+      }
+    }
+    std::sort(impacted.begin(), impacted.end());
+    impacted.erase(std::unique(impacted.begin(), impacted.end()),
+                   impacted.end());
+    for (const auto node : nodes) {
+      for (const auto to : items_[node].links) {
+        const size_t component = component_of[to];
+        if (component != ix - 1) {
+          auto& target = incoming[component];
+          target.insert(target.end(), impacted.begin(), impacted.end());
+        }
+      }
+    }
+    for (const auto node : nodes) {
+      items_[node].impacted = impacted;
+    }
+    impacted.clear();
+    impacted.shrink_to_fit();
+  }
+}
+
+void Impact::Report(const Comparison& comparison, std::ostream& output) {
+  // The top-level pieces are the symbols (and types) of the interface, the
+  // rest are found as they are linked to.
+  for (const auto& detail : reporting_.outcomes.At(comparison).details) {
+    Add(*detail.edge_);
+  }
+  roots_ = items_.size();
+  for (size_t ix = 0; ix < items_.size(); ++ix) {
+    const auto& [id1, id2] = items_[ix].comparison;
+    items_[ix].interesting =
+        !id1 || !id2 || Walk(reporting_.outcomes.At({id1, id2}), ix);
+  }
+
+  visited_.assign(items_.size(), false);
+  for (size_t ix = 0; ix < roots_; ++ix) {
+    Visit(ix);
+  }
+  Check(scc_.Empty()) << "internal error: SCC state broken";
+  Propagate();
+
+  for (size_t ix = 0; ix < items_.size(); ++ix) {
+    const auto& item = items_[ix];
+    if (!item.interesting) {
+      continue;
+    }
+    PrintComparison(descriptions_, item.comparison, output, 0, {});
+    if (ix >= roots_) {
+      for (const auto root : item.impacted) {
+        const Id id = *items_[root].comparison.first;
+        output << std::string(INDENT_INCREMENT, ' ') << "impacts "
+               << descriptions_.Kind(id) << ' ' << descriptions_.Resolved(id)
+               << '\n';
+      }
+    }
+    output << '\n';
+  }
+}
+
+struct InterfaceMemberKind {
+  std::string_view operator()(const ElfSymbol& x) const {
+    switch (x.symbol_type) {
+      case ElfSymbol::SymbolType::OBJECT:
+        return "object";
+      case ElfSymbol::SymbolType::FUNCTION:
+        return "function";
+      case ElfSymbol::SymbolType::COMMON:
+        return "common";
+      case ElfSymbol::SymbolType::TLS:
+        return "tls";
+      case ElfSymbol::SymbolType::GNU_IFUNC:
+        return "gnu_ifunc";
+    }
+  }
+
+  template <typename Node>
+  std::string_view operator()(const Node&) const {
+    return "type";
+  }
+};
+
+struct IsNamedType {
+  bool operator()(const StructUnion&) const {
+    return true;
+  }
+
+  bool operator()(const Enumeration&) const {
+    return true;
+  }
+
+  bool operator()(const Typedef&) const {
+    return true;
+  }
+
+  template <typename Node>
+  bool operator()(const Node&) const {
+    return false;
+  }
+};
+
+void WriteCounts(const char* name,
+                 const std::map<std::string_view, size_t>& counts,
+                 std::ostream& output) {
+  output << '"' << name << "\":{";
+  const char* separator = "";
+  for (const auto& [kind, count] : counts) {
+    output << separator << '"' << kind << "\":" << count;
+    separator = ",";
+  }
+  output << '}';
 }
 
 template <typename T>
@@ -395,41 +1234,147 @@ void PrintFidelityReportBucket(T transition,
 
 }  // namespace
 
-void Report(const Reporting& reporting, const Comparison& comparison,
-            std::ostream& output) {
-  switch (reporting.options.format) {
+Descriptions::Descriptions(const Reporting& reporting,
+                           const Comparison& comparison) {
+  // Collect the nodes in the order that a PLAIN report reaches them, noting
+  // which descriptions each needs: the name of an added or removed node or the
+  // resolved description of a changed one.
+  enum : uint8_t { NAME = 1, RESOLVED = 2 };
+  std::vector<uint8_t> wanted;
+  const auto want = [&](Id id, uint8_t what) {
+    const auto [it, inserted] = index_.emplace(id, descriptions_.size());
+    if (inserted) {
+      descriptions_.emplace_back();
+      wanted.push_back(0);
+    }
+    wanted[it->second] |= what;
+  };
+  std::unordered_set<Comparison, HashComparison> seen;
+  std::vector<Comparison> todo{comparison};
+  while (!todo.empty()) {
+    const auto next = todo.back();
+    todo.pop_back();
+    if (!seen.insert(next).second) {
+      continue;
+    }
+    const auto& [id1, id2] = next;
+    if (!id1 || !id2) {
+      // addition or removal
+      want(id1 ? *id1 : *id2, NAME);
+      continue;
+    }
+    want(*id1, RESOLVED);
+    want(*id2, RESOLVED);
+    const auto& details = reporting.outcomes.At(next).details;
+    for (auto it = details.rbegin(); it != details.rend(); ++it) {
+      if (it->edge_) {
+        todo.push_back(*it->edge_);
+      }
+    }
+  }
+
+  // Describe them.
+  const size_t jobs = reporting.options.jobs;
+  std::vector<Id> ids(descriptions_.size(), Id(0));
+  for (const auto& [id, index] : index_) {
+    ids[index] = id;
+  }
+  std::vector<NameCache> names(jobs > 1 ? jobs : 0);
+  ForEachIndex(jobs, descriptions_.size(), [&](size_t worker, size_t index) {
+    const Graph& graph = reporting.graph;
+    NameCache& cache = jobs > 1 ? names[worker] : reporting.names;
+    const Id id = ids[index];
+    auto& description = descriptions_[index];
+    description.kind = DescribeKind(graph)(id);
+    if (wanted[index] & NAME) {
+      description.name = Describe(graph, cache)(id).ToString();
+      description.extra = DescribeExtra(graph)(id);
+    }
+    if (wanted[index] & RESOLVED) {
+      description.resolved =
+          GetResolvedDescription(graph, reporting.resolutions, cache, id);
+    }
+  });
+}
+
+const Descriptions::Description& Descriptions::At(Id id) const {
+  const auto it = index_.find(id);
+  Check(it != index_.end()) << "internal error: node " << id
+                            << " has no description";
+  return descriptions_[it->second];
+}
+
+void Reports::Write(OutputFormat format, std::ostream& output) {
+  if (!descriptions_) {
+    descriptions_.emplace(reporting_, comparison_);
+  }
+  switch (format) {
     case OutputFormat::PLAIN: {
-      Plain(reporting, output).Report(comparison);
+      Plain(reporting_, *descriptions_, output).Report(comparison_);
       break;
     }
     case OutputFormat::FLAT:
     case OutputFormat::SMALL: {
-      bool full = reporting.options.format == OutputFormat::FLAT;
-      Flat(reporting, full, output).Report(comparison);
+      const bool full = format == OutputFormat::FLAT;
+      StreamLines lines(output);
+      WriteFlat(full, lines);
       break;
     }
     case OutputFormat::SHORT: {
-      std::stringstream report;
-      Flat(reporting, false, report).Report(comparison);
-      std::vector<std::string> report_lines;
-      std::string line;
-      while (std::getline(report, line)) {
-        report_lines.push_back(line);
-      }
-      report_lines = stg::PostProcess(report_lines,
-                                      reporting.options.max_crc_only_changes);
-      for (const auto& line : report_lines) {
-        output << line << '\n';
-      }
+      StreamLines lines(output);
+      PostProcessor post_processor(reporting_.options.max_crc_only_changes,
+                                   lines);
+      WriteFlat(false, post_processor);
       break;
     }
     case OutputFormat::VIZ: {
-      ReportViz(reporting, comparison, output);
+      Viz(reporting_, *descriptions_, output).Report(comparison_);
+      break;
+    }
+    case OutputFormat::IMPACT: {
+      Impact(reporting_, *descriptions_).Report(comparison_, output);
+      break;
+    }
+    case OutputFormat::JSON: {
+      Json(reporting_, *descriptions_, output).Report(comparison_);
       break;
     }
   }
 }
 
+void Reports::WriteFlat(bool full, LineSink& output) {
+  if (flat_) {
+    for (const auto& item : *flat_) {
+      WriteItem(item, full, output);
+    }
+  } else {
+    // only retain the items if they will be written again
+    const bool retain = flat_writes_ > 1;
+    if (retain) {
+      flat_.emplace();
+    }
+    if (!compaction_) {
+      compaction_.emplace(reporting_, *descriptions_, comparison_);
+    }
+    Flat(reporting_, *descriptions_, &*compaction_)
+        .Report(comparison_, [&](FlatItem item) {
+          WriteItem(item, full, output);
+          if (retain) {
+            flat_->push_back(std::move(item));
+          }
+        });
+  }
+  output.Finish();
+  if (flat_writes_ > 0 && --flat_writes_ == 0) {
+    flat_.reset();
+  }
+}
+
+void Report(const Reporting& reporting, const Comparison& comparison,
+            std::ostream& output) {
+  Reports(reporting, comparison).Write(reporting.options.format, output);
+}
+
 bool FidelityDiff(const stg::FidelityDiff& diff, std::ostream& output) {
   bool diffs_reported = false;
   auto print_bucket = [&diff, &output, &diffs_reported](auto&& from,
@@ -461,5 +1406,40 @@ bool FidelityDiff(const stg::FidelityDiff& diff, std::ostream& output) {
   return diffs_reported;
 }
 
+void ChangeCounts(const Graph& graph, const Outcomes& outcomes,
+                  const Known& known,
+                  const std::optional<Comparison>& comparison,
+                  std::ostream& output) {
+  const InterfaceMemberKind member_kind;
+  const IsNamedType is_named_type;
+  std::map<std::string_view, size_t> removed;
+  std::map<std::string_view, size_t> added;
+  std::map<std::string_view, size_t> changed;
+  if (comparison) {
+    for (const auto& detail : outcomes.At(*comparison).details) {
+      if (!detail.edge_) {
+        continue;
+      }
+      const auto& [id1, id2] = *detail.edge_;
+      auto& counts = !id2 ? removed : !id1 ? added : changed;
+      ++counts[graph.Apply<std::string_view>(member_kind, id1 ? *id1 : *id2)];
+    }
+  }
+  size_t changed_types = 0;
+  known.ForEach([&](const Comparison& key, bool equals) {
+    if (!equals && key.first && key.second
+        && graph.Apply<bool>(is_named_type, *key.first)) {
+      ++changed_types;
+    }
+  });
+  output << "{\"equal\":" << (comparison ? "false" : "true") << ',';
+  WriteCounts("removed", removed, output);
+  output << ',';
+  WriteCounts("added", added, output);
+  output << ',';
+  WriteCounts("changed", changed, output);
+  output << ",\"changed_types\":" << changed_types << "}\n";
+}
+
 }  // namespace reporting
 }  // namespace stg
@@ -23,17 +23,21 @@
 #include <cstddef>
 #include <optional>
 #include <ostream>
+#include <string>
 #include <string_view>
+#include <unordered_map>
+#include <vector>
 
 #include "comparison.h"
 #include "fidelity.h"
 #include "graph.h"
 #include "naming.h"
+#include "post_processing.h"
 
 namespace stg {
 namespace reporting {
 
-enum class OutputFormat { PLAIN, FLAT, SMALL, SHORT, VIZ };
+enum class OutputFormat { PLAIN, FLAT, SMALL, SHORT, VIZ, IMPACT, JSON };
 
 std::optional<OutputFormat> ParseOutputFormat(std::string_view format);
 
@@ -43,6 +47,13 @@ std::ostream& operator<<(std::ostream&, OutputFormatUsage);
 struct Options {
   const OutputFormat format;
   const size_t max_crc_only_changes;  // only for SHORT
+  // If more than 1, the top-level diffs of PLAIN, FLAT, SMALL and SHORT reports
+  // are rendered concurrently, each worker with its own NameCache, and output
+  // in the usual order.
+  const size_t jobs = 1;
+  // If not 0, VIZ reports are truncated to at most this many bytes, not
+  // counting the enclosing graph statement and a truncation comment.
+  const size_t max_viz_bytes = 0;
 };
 
 struct Reporting {
@@ -50,12 +61,127 @@ struct Reporting {
   const Outcomes& outcomes;
   const Options& options;
   NameCache& names;
+  // if set, used to resolve typedefs
+  const ResolutionTable* resolutions = nullptr;
 };
 
 void Report(const Reporting&, const Comparison&, std::ostream&);
 
+// Descriptions of the nodes of a diff graph, as they appear in reports. These
+// are all computed up front, in the order a PLAIN report would first need them
+// and spread over the configured number of jobs (each of more than one with its
+// own NameCache), so that writing a report needs no further graph traversal.
+class Descriptions {
+ public:
+  Descriptions(const Reporting& reporting, const Comparison& comparison);
+
+  // kind, name and any extra detail of a node
+  const std::string& Kind(Id id) const { return At(id).kind; }
+  const std::string& Name(Id id) const { return At(id).name; }
+  const std::string& Extra(Id id) const { return At(id).extra; }
+  // quoted name of a node after typedef resolution, preceded by the typedefs
+  const std::string& Resolved(Id id) const { return At(id).resolved; }
+
+ private:
+  struct Description {
+    std::string kind;
+    std::string name;
+    std::string extra;
+    std::string resolved;
+  };
+
+  std::unordered_map<Id, size_t> index_;
+  std::vector<Description> descriptions_;
+
+  const Description& At(Id id) const;
+};
+
+// A line of a FLAT report and whether it is also part of SMALL and SHORT
+// reports.
+struct FlatLine {
+  std::string text;
+  bool small;
+};
+
+// A paragraph of a FLAT report, for a symbol or a diff-holding node, and
+// whether it is also part of SMALL and SHORT reports.
+struct FlatItem {
+  std::vector<FlatLine> lines;
+  bool interesting;
+};
+
+// A compacted view of a diff graph, computed once before FLAT, SMALL or SHORT
+// reports are written. Diff nodes that cannot hold diffs themselves but are
+// reached along more than one edge are rendered just once, as blocks of lines
+// below their headers together with the diff-holding nodes they reach, so that
+// writing a report is linear in the distinct diff nodes rather than in the
+// paths to them. Identical blocks are merged.
+class Compaction {
+ public:
+  struct Block {
+    // indented relative to the header line, which is not included
+    std::vector<FlatLine> lines;
+    bool interesting;
+    // in the order they are first reached
+    std::vector<Comparison> holders;
+  };
+
+  Compaction(const Reporting& reporting, const Descriptions& descriptions,
+             const Comparison& comparison);
+
+  // the block of a shared diff node, if any
+  const Block* Find(const Comparison& comparison) const;
+
+  size_t Shared() const { return shared_; }
+  size_t Blocks() const { return blocks_.size(); }
+
+ private:
+  ComparisonMap<size_t> index_;
+  std::vector<Block> blocks_;
+  size_t shared_ = 0;
+};
+
+// Reports of a single comparison, in any number of formats. The format in the
+// Options is not used. Reports are written as they are produced, without
+// holding the whole report in memory.
+//
+// FLAT, SMALL and SHORT reports are all written from the same items. If more
+// than one such report is expected, the items are retained until the last one
+// has been written, so they need only be collected from the diff graph once.
+// Any further such report collects them again, from the same Compaction. The
+// node descriptions are computed once, for all reports.
+class Reports {
+ public:
+  Reports(const Reporting& reporting, const Comparison& comparison,
+          size_t flat_writes = 1)
+      : reporting_(reporting), comparison_(comparison),
+        flat_writes_(flat_writes) {}
+
+  void Write(OutputFormat format, std::ostream& output);
+
+ private:
+  const Reporting& reporting_;
+  const Comparison comparison_;
+  size_t flat_writes_;
+  std::optional<Descriptions> descriptions_;
+  std::optional<Compaction> compaction_;
+  std::optional<std::vector<FlatItem>> flat_;
+
+  void WriteFlat(bool full, LineSink& output);
+};
+
 bool FidelityDiff(const stg::FidelityDiff&, std::ostream&);
 
+// Writes a one-line JSON summary of a comparison made with Compare::count_only:
+// whether there were any differences; the Interface symbols and types removed,
+// added and changed, counted by symbol type or as "type"; and the number of
+// changed struct, union, enum and typedef types. Nothing is named, so this is
+// far cheaper than any report.
+void ChangeCounts(const Graph& graph, const Outcomes& outcomes,
+                  const Known& known,
+                  const std::optional<Comparison>& comparison,
+                  std::ostream& output);
+
 }  // namespace reporting
 }  // namespace stg
 
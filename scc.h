@@ -20,15 +20,16 @@
 #ifndef STG_SCC_H_
 #define STG_SCC_H_
 
+#include <algorithm>
 #include <cstddef>
-#include <iterator>
-#include <memory>
+#include <functional>
+#include <limits>
 #include <optional>
-#include <unordered_map>
-#include <utility>
+#include <span>
 #include <vector>
 
 #include "error.h"
+#include "graph.h"
 
 namespace stg {
 
@@ -69,30 +70,112 @@ namespace stg {
  * returned and the node will be recorded as waiting to be assigned to an SCC.
  *
  * Now examine the node, making recursive calls to follow edges to other nodes.
+ * The recursion may instead be managed with an explicit stack, as in Equals.
  * Information about the node can be stored provisionally, but must NOT be used
  * to make decisions about whether to revisit it - that is Open's job.
  *
  * Once the examination is done, call Close, passing in the handle. If the node
  * has been identified as the "root" of an SCC, the whole SCC will be returned
- * as a vector of nodes. If any processing needs to be done (such as recording
- * the nodes as visited), this should be done now. Otherwise, an empty vector
- * will be returned.
+ * as a span of nodes. If any processing needs to be done (such as recording
+ * the nodes as visited), this should be done now, as the span is only valid
+ * until the next call to Open or Close. Otherwise, an empty span will be
+ * returned.
+ *
+ * The handle of an open node is its depth in the stack of open nodes and a
+ * closed SCC holds the nodes with handles from that of its root upwards, in
+ * order. Provisional information can therefore be kept on a stack of its own,
+ * pushed on Open and popped back to the root's handle when its SCC is closed.
  *
  * After a top-level DFS has completed, the SCC finder should be carrying no
  * state. This can be verified by calling Empty.
+ *
+ * IMPLEMENTATION
+ *
+ * Open nodes are held in a single vector, which doubles as the storage for
+ * closed SCCs. The node to index map is an open-addressing table of indices
+ * into that vector, using linear probing. As nodes are always closed in the
+ * reverse order of opening, entries can be removed just by clearing their
+ * slots, latest first. None of the storage is released, so that repeated
+ * searches do not allocate once the buffers have grown.
+ *
+ * For Id nodes, the map is instead an array indexed by id, so no hashing or
+ * probing is needed. It grows to cover the largest id opened.
  */
+
+// Maps open nodes to slots holding 1 + their index in the vector of open
+// nodes, or kEmpty.
+template <typename Node, typename Hash>
+class SCCTable {
+ public:
+  static constexpr size_t kEmpty = 0;
+
+  // Returns the slot holding the node or the empty slot where it belongs.
+  size_t& Slot(const Node& node, const std::vector<Node>& open) {
+    const size_t mask = table_.size() - 1;
+    // Fibonacci hashing, as the given hash may be the identity
+    size_t position = (Hash()(node) * size_t{0x9e3779b97f4a7c15}) >> shift_;
+    while (true) {
+      size_t& slot = table_[position];
+      if (slot == kEmpty || open[slot - 1] == node) {
+        return slot;
+      }
+      position = (position + 1) & mask;
+    }
+  }
+
+  // Called after a node is opened, as the table may need to grow.
+  void Opened(const std::vector<Node>& open) {
+    if (2 * open.size() > table_.size()) {
+      table_.assign(2 * table_.size(), kEmpty);
+      --shift_;
+      for (size_t ix = 0; ix < open.size(); ++ix) {
+        Slot(open[ix], open) = ix + 1;
+      }
+    }
+  }
+
+ private:
+  static constexpr unsigned kInitialBits = 6;
+  static constexpr size_t kInitialSize = size_t{1} << kInitialBits;
+
+  std::vector<size_t> table_ = std::vector<size_t>(kInitialSize, kEmpty);
+  // table_ index from hash
+  unsigned shift_ = std::numeric_limits<size_t>::digits - kInitialBits;
+};
+
+template <typename Hash>
+class SCCTable<Id, Hash> {
+ public:
+  static constexpr size_t kEmpty = 0;
+
+  size_t& Slot(Id id, const std::vector<Id>&) {
+    const size_t ix = id.ix_;
+    if (ix >= slots_.size()) {
+      slots_.resize(std::max(ix + 1, 2 * slots_.size()), kEmpty);
+    }
+    return slots_[ix];
+  }
+
+  void Opened(const std::vector<Id>&) {}
+
+ private:
+  std::vector<size_t> slots_;
+};
+
 template <typename Node, typename Hash = std::hash<Node>>
 class SCC {
  public:
   bool Empty() const {
-    return open_.empty() && is_open_.empty() && root_index_.empty();
+    // closed_ is also the number of open nodes
+    return closed_ == 0 && root_index_.empty();
   }
 
   std::optional<size_t> Open(const Node& node) {
+    Release();
     // Insertion will fail if the node is already open.
-    auto [it, inserted] = is_open_.insert({node, is_open_.size()});
-    auto ix = it->second;
-    if (!inserted) {
+    size_t& slot = table_.Slot(node, open_);
+    if (slot != kEmpty) {
+      const size_t ix = slot - 1;
       // Pop indices to nodes which cannot be the root of their SCC.
       while (root_index_.back() > ix) {
         root_index_.pop_back();
@@ -100,32 +183,45 @@ class SCC {
       return {};
     }
     // Unvisited, record open node and record root index.
+    const size_t ix = open_.size();
+    slot = ix + 1;
     open_.push_back(node);
+    closed_ = open_.size();
     root_index_.push_back(ix);
+    table_.Opened(open_);
     return {ix};
   }
 
-  std::vector<Node> Close(size_t ix) {
-    std::vector<Node> scc;
+  std::span<const Node> Close(size_t ix) {
+    Release();
     Check(ix < open_.size()) << "internal error: illegal SCC node index";
-    if (ix == root_index_.back()) {
-      // Close SCC.
-      root_index_.pop_back();
-      const auto begin = open_.begin() + ix;
-      const auto end = open_.end();
-      for (auto it = begin; it != end; ++it) {
-        is_open_.erase(*it);
-      }
-      scc.reserve(end - begin);
-      std::move(begin, end, std::back_inserter(scc));
-      open_.erase(begin, end);
+    if (ix != root_index_.back()) {
+      return {};
+    }
+    // Close SCC.
+    root_index_.pop_back();
+    // clear slots in reverse order of insertion, to keep probe sequences intact
+    for (size_t i = open_.size(); i > ix; --i) {
+      table_.Slot(open_[i - 1], open_) = kEmpty;
     }
-    return scc;
+    // the nodes are released on the next call
+    closed_ = ix;
+    return {open_.data() + ix, open_.size() - ix};
   }
 
  private:
-  std::vector<Node> open_;  // index to node
-  std::unordered_map<Node, size_t, Hash> is_open_;  // node to index
+  static constexpr size_t kEmpty = SCCTable<Node, Hash>::kEmpty;
+
+  // Drops the nodes of the last closed SCC.
+  void Release() {
+    if (closed_ < open_.size()) {
+      open_.erase(open_.begin() + closed_, open_.end());
+    }
+  }
+
+  std::vector<Node> open_;  // index to node, followed by the last closed SCC
+  size_t closed_ = 0;  // start of the last closed SCC
+  SCCTable<Node, Hash> table_;
   std::vector<size_t> root_index_;
 };
 
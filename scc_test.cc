@@ -32,6 +32,7 @@
 #include <vector>
 
 #include <catch2/catch.hpp>
+#include "graph.h"
 
 namespace Test {
 
@@ -202,4 +203,80 @@ TEST_CASE("randomly-generated graphs") {
   }
 }
 
+TEST_CASE("large SCCs with a reused finder") {
+  // blocks of nodes forming cycles, each block pointing to the next
+  const size_t blocks = 30;
+  const size_t size = 100;
+  const size_t n = blocks * size;
+  Graph g(n);
+  for (size_t o = 0; o < n; ++o) {
+    g[o].insert(o % size == size - 1 ? o + 1 - size : o + 1);
+    if (o % size == 0 && o + size < n) {
+      g[o].insert(o + size);
+    }
+  }
+  std::set<size_t> visited;
+  std::vector<std::set<size_t>> sccs;
+  SCC<size_t> scc;
+  for (size_t o = n; o > 0; --o) {
+    dfs(visited, scc, g, o - 1, sccs);
+    CHECK(scc.Empty());
+  }
+  CHECK(sccs.size() == blocks);
+  for (size_t ix = 0; ix < sccs.size(); ++ix) {
+    // leaves first
+    CHECK(sccs[ix].size() == size);
+    CHECK(*sccs[ix].begin() == (blocks - 1 - ix) * size);
+  }
+  CHECK(visited.size() == n);
+}
+
+struct CollidingHash {
+  size_t operator()(size_t) const {
+    return 0;
+  }
+};
+
+TEST_CASE("colliding hashes") {
+  SCC<size_t, CollidingHash> scc;
+  for (size_t round = 0; round < 1000; ++round) {
+    // 0 -> 1 -> 2 -> 0
+    const auto h0 = scc.Open(0);
+    const auto h1 = scc.Open(1);
+    const auto h2 = scc.Open(2);
+    REQUIRE(h0);
+    REQUIRE(h1);
+    REQUIRE(h2);
+    CHECK(!scc.Open(0));
+    CHECK(scc.Close(*h2).empty());
+    CHECK(scc.Close(*h1).empty());
+    const auto nodes = scc.Close(*h0);
+    CHECK(std::vector<size_t>(nodes.begin(), nodes.end())
+          == std::vector<size_t>{0, 1, 2});
+    CHECK(scc.Empty());
+  }
+}
+
+TEST_CASE("id nodes") {
+  using stg::Id;
+  stg::SCC<Id> scc;
+  for (size_t round = 0; round < 10; ++round) {
+    // 5000 -> 7 -> 5000, 7 -> 0
+    const auto h5000 = scc.Open(Id(5000));
+    const auto h7 = scc.Open(Id(7));
+    REQUIRE(h5000);
+    REQUIRE(h7);
+    CHECK(!scc.Open(Id(5000)));
+    const auto h0 = scc.Open(Id(0));
+    REQUIRE(h0);
+    const auto leaf = scc.Close(*h0);
+    CHECK(std::vector<Id>(leaf.begin(), leaf.end()) == std::vector<Id>{Id(0)});
+    CHECK(scc.Close(*h7).empty());
+    const auto nodes = scc.Close(*h5000);
+    CHECK(std::vector<Id>(nodes.begin(), nodes.end())
+          == std::vector<Id>{Id(5000), Id(7)});
+    CHECK(scc.Empty());
+  }
+}
+
 }  // namespace Test
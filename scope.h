@@ -23,15 +23,26 @@
 
 #include <cstddef>
 #include <string>
+#include <string_view>
+#include <utility>
 
 namespace stg {
 
 using Scope = std::string;
 
+// Qualifies a name by a scope, allocating only the result.
+inline std::string ScopedName(const Scope& scope, std::string_view name) {
+  std::string result;
+  result.reserve(scope.size() + name.size());
+  result += scope;
+  result += name;
+  return result;
+}
+
 class PushScopeName {
  public:
   template <typename Kind>
-  PushScopeName(Scope& scope_, Kind&& kind, const std::string& name)
+  PushScopeName(Scope& scope_, Kind&& kind, std::string_view name)
       : scope_name_(scope_), old_size_(scope_name_.size()) {
     if (name.empty()) {
       scope_name_ += "<unnamed ";
@@ -54,6 +65,23 @@ class PushScopeName {
   const size_t old_size_;
 };
 
+// Replaces the scope for its lifetime.
+class ReplaceScope {
+ public:
+  ReplaceScope(Scope& scope, Scope replacement)
+      : scope_(scope), saved_(std::exchange(scope, std::move(replacement))) {}
+
+  ReplaceScope(const ReplaceScope& other) = delete;
+  ReplaceScope& operator=(const ReplaceScope& other) = delete;
+  ~ReplaceScope() {
+    scope_ = std::move(saved_);
+  }
+
+ private:
+  Scope& scope_;
+  Scope saved_;
+};
+
 }  // namespace stg
 
 #endif  // STG_SCOPE_H_
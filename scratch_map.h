@@ -0,0 +1,129 @@
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+// -*- mode: C++ -*-
+//
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License v2.0 with LLVM Exceptions (the
+// "License"); you may not use this file except in compliance with the
+// License.  You may obtain a copy of the License at
+//
+//     https://llvm.org/LICENSE.txt
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef STG_SCRATCH_MAP_H_
+#define STG_SCRATCH_MAP_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <vector>
+
+namespace stg {
+
+// A map from 64-bit keys to 32-bit values, for working state that is built up
+// and thrown away many times over, such as that of each unification.
+//
+// Each slot is stamped with the generation in which it was filled and slots of
+// earlier generations count as empty. Clearing just starts a new generation,
+// so it takes constant time and keeps the storage for the next use. The table
+// uses linear probing with Fibonacci hashing and is kept at most half full.
+class ScratchMap {
+ public:
+  ScratchMap() = default;
+  ScratchMap(const ScratchMap&) = delete;
+  ScratchMap& operator=(const ScratchMap&) = delete;
+
+  size_t Size() const {
+    return size_;
+  }
+
+  void Clear() {
+    size_ = 0;
+    if (++generation_ == 0) {
+      // the stamps have wrapped around, so they are reset
+      for (auto& slot : slots_) {
+        slot.generation = 0;
+      }
+      generation_ = 1;
+    }
+  }
+
+  std::optional<uint32_t> Find(uint64_t key) const {
+    if (size_ == 0) {
+      return {};
+    }
+    const Slot& slot = slots_[Position(key)];
+    if (slot.generation != generation_) {
+      return {};
+    }
+    return {slot.value};
+  }
+
+  // Inserts the value unless the key is already present. Returns whether it
+  // was inserted.
+  bool Insert(uint64_t key, uint32_t value) {
+    if (2 * (size_ + 1) > slots_.size()) {
+      Grow();
+    }
+    Slot& slot = slots_[Position(key)];
+    if (slot.generation == generation_) {
+      return false;
+    }
+    slot = {key, value, generation_};
+    ++size_;
+    return true;
+  }
+
+ private:
+  struct Slot {
+    uint64_t key = 0;
+    uint32_t value = 0;
+    uint32_t generation = 0;
+  };
+
+  static constexpr unsigned kInitialBits = 6;
+
+  // Returns the position of the key or of the empty slot where it belongs.
+  size_t Position(uint64_t key) const {
+    const size_t mask = slots_.size() - 1;
+    size_t position = (key * uint64_t{0x9e3779b97f4a7c15}) >> shift_;
+    while (true) {
+      const Slot& slot = slots_[position];
+      if (slot.generation != generation_ || slot.key == key) {
+        return position;
+      }
+      position = (position + 1) & mask;
+    }
+  }
+
+  void Grow() {
+    std::vector<Slot> old;
+    old.swap(slots_);
+    const unsigned bits =
+        old.empty() ? kInitialBits
+                    : std::numeric_limits<uint64_t>::digits - shift_ + 1;
+    slots_.resize(size_t{1} << bits);
+    shift_ = std::numeric_limits<uint64_t>::digits - bits;
+    for (const auto& slot : old) {
+      if (slot.generation == generation_) {
+        slots_[Position(slot.key)] = slot;
+      }
+    }
+  }
+
+  std::vector<Slot> slots_;
+  unsigned shift_ = std::numeric_limits<uint64_t>::digits;
+  // never 0, so that new slots are empty
+  uint32_t generation_ = 1;
+  size_t size_ = 0;
+};
+
+}  // namespace stg
+
+#endif  // STG_SCRATCH_MAP_H_
@@ -0,0 +1,62 @@
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+// -*- mode: C++ -*-
+//
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License v2.0 with LLVM Exceptions (the
+// "License"); you may not use this file except in compliance with the
+// License.  You may obtain a copy of the License at
+//
+//     https://llvm.org/LICENSE.txt
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "scratch_map.h"
+
+#include <cstdint>
+#include <map>
+#include <optional>
+
+#include <catch2/catch.hpp>
+
+namespace Test {
+
+TEST_CASE("matches std::map across clears") {
+  stg::ScratchMap map;
+  CHECK(map.Find(0) == std::nullopt);
+  for (uint32_t round = 0; round < 4; ++round) {
+    // enough keys for the table to grow in the first round
+    std::map<uint64_t, uint32_t> expected;
+    for (uint64_t ix = 0; ix < 1000; ++ix) {
+      const uint64_t key = (ix * 7919 + round) << (ix % 40);
+      const uint32_t value = static_cast<uint32_t>(ix);
+      CHECK(map.Insert(key, value) == expected.emplace(key, value).second);
+    }
+    CHECK(map.Size() == expected.size());
+    for (const auto& [key, value] : expected) {
+      CHECK(map.Find(key) == std::optional<uint32_t>(value));
+    }
+    CHECK(map.Find(~uint64_t{0}) == std::nullopt);
+    map.Clear();
+    CHECK(map.Size() == 0);
+    for (const auto& [key, _] : expected) {
+      CHECK(map.Find(key) == std::nullopt);
+    }
+  }
+}
+
+TEST_CASE("inserting keeps the first value") {
+  stg::ScratchMap map;
+  CHECK(map.Insert(42, 1));
+  CHECK(!map.Insert(42, 2));
+  CHECK(map.Find(42) == std::optional<uint32_t>(1));
+  map.Clear();
+  CHECK(map.Insert(42, 3));
+  CHECK(map.Find(42) == std::optional<uint32_t>(3));
+}
+
+}  // namespace Test
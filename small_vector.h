@@ -0,0 +1,294 @@
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+// -*- mode: C++ -*-
+//
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License v2.0 with LLVM Exceptions (the
+// "License"); you may not use this file except in compliance with the
+// License.  You may obtain a copy of the License at
+//
+//     https://llvm.org/LICENSE.txt
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef STG_SMALL_VECTOR_H_
+#define STG_SMALL_VECTOR_H_
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "error.h"
+
+namespace stg {
+
+// A vector which holds up to N items inline, only allocating beyond that.
+//
+// This is for the child lists of graph nodes, most of which are short, so that
+// a node is usually a single allocation. The API is the subset of std::vector
+// that the node visitors and readers use. Iterators are plain pointers and are
+// invalidated by anything that may grow the vector or by moving it.
+template <typename T, size_t N>
+class SmallVector {
+ public:
+  using value_type = T;
+  using size_type = size_t;
+  using reference = T&;
+  using const_reference = const T&;
+  using iterator = T*;
+  using const_iterator = const T*;
+  using reverse_iterator = std::reverse_iterator<iterator>;
+  using const_reverse_iterator = std::reverse_iterator<const_iterator>;
+
+  SmallVector() = default;
+  SmallVector(std::initializer_list<T> items) {
+    Append(items.begin(), items.end());
+  }
+  template <typename Iterator, typename = typename std::iterator_traits<
+                                   Iterator>::iterator_category>
+  SmallVector(Iterator first, Iterator last) {
+    Append(first, last);
+  }
+  // These are implicit so that a std::vector can be built and then handed over.
+  SmallVector(const std::vector<T>& items) {
+    Append(items.begin(), items.end());
+  }
+  SmallVector(std::vector<T>&& items) {
+    Append(std::make_move_iterator(items.begin()),
+           std::make_move_iterator(items.end()));
+  }
+  SmallVector(const SmallVector& other) {
+    Append(other.begin(), other.end());
+  }
+  SmallVector(SmallVector&& other) noexcept {
+    Steal(other);
+  }
+  SmallVector& operator=(const SmallVector& other) {
+    if (this != &other) {
+      clear();
+      Append(other.begin(), other.end());
+    }
+    return *this;
+  }
+  SmallVector& operator=(SmallVector&& other) noexcept {
+    if (this != &other) {
+      Release();
+      Steal(other);
+    }
+    return *this;
+  }
+  ~SmallVector() {
+    Release();
+  }
+
+  iterator begin() {
+    return data_;
+  }
+  iterator end() {
+    return data_ + size_;
+  }
+  const_iterator begin() const {
+    return data_;
+  }
+  const_iterator end() const {
+    return data_ + size_;
+  }
+  reverse_iterator rbegin() {
+    return reverse_iterator(end());
+  }
+  reverse_iterator rend() {
+    return reverse_iterator(begin());
+  }
+  const_reverse_iterator rbegin() const {
+    return const_reverse_iterator(end());
+  }
+  const_reverse_iterator rend() const {
+    return const_reverse_iterator(begin());
+  }
+  const_reverse_iterator crbegin() const {
+    return rbegin();
+  }
+  const_reverse_iterator crend() const {
+    return rend();
+  }
+  T* data() {
+    return data_;
+  }
+  const T* data() const {
+    return data_;
+  }
+  size_t size() const {
+    return size_;
+  }
+  size_t capacity() const {
+    return capacity_;
+  }
+  bool empty() const {
+    return size_ == 0;
+  }
+  // Whether the items are held inline, without a heap allocation.
+  bool IsInline() const {
+    return data_ == Inline();
+  }
+  T& operator[](size_t ix) {
+    return data_[ix];
+  }
+  const T& operator[](size_t ix) const {
+    return data_[ix];
+  }
+  T& at(size_t ix) {
+    Check(ix < size_) << "SmallVector index " << ix << " out of range";
+    return data_[ix];
+  }
+  const T& at(size_t ix) const {
+    Check(ix < size_) << "SmallVector index " << ix << " out of range";
+    return data_[ix];
+  }
+  T& front() {
+    return data_[0];
+  }
+  const T& front() const {
+    return data_[0];
+  }
+  T& back() {
+    return data_[size_ - 1];
+  }
+  const T& back() const {
+    return data_[size_ - 1];
+  }
+
+  void reserve(size_t capacity) {
+    if (capacity > capacity_) {
+      Reallocate(capacity);
+    }
+  }
+  void shrink_to_fit() {
+    if (!IsInline() && size_ < capacity_) {
+      Reallocate(size_);
+    }
+  }
+  template <typename... Args>
+  T& emplace_back(Args&&... args) {
+    if (size_ == capacity_) {
+      // the arguments may refer to existing items
+      T item(std::forward<Args>(args)...);
+      Reallocate(capacity_ * 2);
+      return *new (data_ + size_++) T(std::move(item));
+    }
+    return *new (data_ + size_++) T(std::forward<Args>(args)...);
+  }
+  void push_back(const T& item) {
+    emplace_back(item);
+  }
+  void push_back(T&& item) {
+    emplace_back(std::move(item));
+  }
+  void pop_back() {
+    --size_;
+    std::destroy_at(data_ + size_);
+  }
+  iterator erase(const_iterator first, const_iterator last) {
+    T* const target = data_ + (first - data_);
+    T* const source = data_ + (last - data_);
+    T* const new_end = std::move(source, end(), target);
+    std::destroy(new_end, end());
+    size_ = static_cast<uint32_t>(new_end - data_);
+    return target;
+  }
+  iterator erase(const_iterator position) {
+    return erase(position, position + 1);
+  }
+  void clear() {
+    std::destroy(begin(), end());
+    size_ = 0;
+  }
+
+  bool operator==(const SmallVector& other) const {
+    return std::equal(begin(), end(), other.begin(), other.end());
+  }
+  bool operator!=(const SmallVector& other) const {
+    return !(*this == other);
+  }
+
+ private:
+  T* Inline() {
+    return std::launder(reinterpret_cast<T*>(inline_));
+  }
+  const T* Inline() const {
+    return std::launder(reinterpret_cast<const T*>(inline_));
+  }
+
+  template <typename Iterator>
+  void Append(Iterator first, Iterator last) {
+    using Category = typename std::iterator_traits<Iterator>::iterator_category;
+    if constexpr (std::is_base_of_v<std::forward_iterator_tag, Category>) {
+      reserve(size_ + std::distance(first, last));
+    }
+    for (; first != last; ++first) {
+      emplace_back(*first);
+    }
+  }
+
+  void Reallocate(size_t capacity) {
+    capacity = std::max(capacity, size_t{N});
+    Check(capacity <= UINT32_MAX) << "SmallVector capacity overflow";
+    T* const items = capacity == N
+                     ? Inline()
+                     : static_cast<T*>(::operator new(capacity * sizeof(T)));
+    if (items != data_) {
+      std::uninitialized_move(begin(), end(), items);
+      std::destroy(begin(), end());
+      if (!IsInline()) {
+        ::operator delete(data_);
+      }
+    }
+    data_ = items;
+    capacity_ = static_cast<uint32_t>(capacity);
+  }
+
+  void Release() {
+    std::destroy(begin(), end());
+    if (!IsInline()) {
+      ::operator delete(data_);
+    }
+    data_ = Inline();
+    size_ = 0;
+    capacity_ = N;
+  }
+
+  // Takes the items of the other vector, which is left empty. This vector
+  // must be empty and inline.
+  void Steal(SmallVector& other) {
+    if (other.IsInline()) {
+      std::uninitialized_move(other.begin(), other.end(), Inline());
+      size_ = other.size_;
+      other.clear();
+    } else {
+      data_ = std::exchange(other.data_, other.Inline());
+      size_ = std::exchange(other.size_, 0);
+      capacity_ = std::exchange(other.capacity_, N);
+    }
+  }
+
+  static_assert(N > 0, "SmallVector needs some inline capacity");
+
+  T* data_ = Inline();
+  uint32_t size_ = 0;
+  uint32_t capacity_ = N;
+  alignas(T) std::byte inline_[N * sizeof(T)];
+};
+
+}  // namespace stg
+
+#endif  // STG_SMALL_VECTOR_H_
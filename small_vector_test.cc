@@ -0,0 +1,82 @@
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+// -*- mode: C++ -*-
+//
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License v2.0 with LLVM Exceptions (the
+// "License"); you may not use this file except in compliance with the
+// License.  You may obtain a copy of the License at
+//
+//     https://llvm.org/LICENSE.txt
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "flat_map.h"
+
+#include "small_vector.h"
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <catch2/catch.hpp>
+
+namespace Test {
+
+using Vector = stg::SmallVector<std::string, 2>;
+using Items = std::vector<std::string>;
+
+Items Contents(const Vector& vector) {
+  return {vector.begin(), vector.end()};
+}
+
+TEST_CASE("short vectors are inline") {
+  Vector vector;
+  CHECK(vector.IsInline());
+  vector.push_back("a");
+  vector.emplace_back("b");
+  CHECK(vector.IsInline());
+  CHECK(vector.capacity() == 2);
+  CHECK(Contents(vector) == Items{"a", "b"});
+}
+
+TEST_CASE("long vectors spill") {
+  Vector vector = {"a", "b"};
+  vector.push_back(vector.front());
+  CHECK(!vector.IsInline());
+  CHECK(vector.capacity() >= 3);
+  CHECK(Contents(vector) == Items{"a", "b", "a"});
+  vector.erase(vector.begin());
+  vector.pop_back();
+  vector.shrink_to_fit();
+  CHECK(vector.IsInline());
+  CHECK(Contents(vector) == Items{"b"});
+}
+
+TEST_CASE("copy and move") {
+  for (const Items& items : {Items{"x"}, Items{"x", "y", "z"}}) {
+    Vector source(items);
+    const Vector copied(source);
+    const Vector moved(std::move(source));
+    CHECK(source.empty());
+    CHECK(copied == moved);
+    CHECK(Contents(moved) == items);
+    Vector assigned;
+    assigned = moved;
+    CHECK(assigned == moved);
+    assigned = Vector();
+    CHECK(assigned.empty());
+    CHECK(assigned.IsInline());
+  }
+}
+
+TEST_CASE("reverse iteration") {
+  const Vector vector = {"a", "b", "c"};
+  CHECK(Items(vector.rbegin(), vector.rend()) == Items{"c", "b", "a"});
+}
+
+}  // namespace Test
@@ -20,6 +20,8 @@
 #include "stable_hash.h"
 
 #include <algorithm>
+#include <atomic>
+#include <cstddef>
 #include <cstdint>
 #include <sstream>
 #include <string>
@@ -48,9 +50,8 @@ constexpr HashValue DecayHashCombine(HashValue a, HashValue b) {
 // Decaying hashes are combined in reverse since the each successive hashable
 // should be decayed 1 more time than the previous hashable and the last
 // hashable should receieve the most decay.
-template <uint8_t decay, typename Type, typename Hash>
-HashValue DecayHashCombineInReverse(const std::vector<Type>& hashables,
-                                    Hash& hash) {
+template <uint8_t decay, typename Hashables, typename Hash>
+HashValue DecayHashCombineInReverse(const Hashables& hashables, Hash& hash) {
   HashValue result(0);
   for (auto it = hashables.crbegin(); it != hashables.crend(); ++it) {
     result = DecayHashCombine<decay>(hash(*it), result);
@@ -61,9 +62,19 @@ HashValue DecayHashCombineInReverse(const std::vector<Type>& hashables,
 }  // namespace
 
 HashValue StableHash::operator()(Id id) {
+  if (shared_ != nullptr) {
+    const uint64_t word = (*shared_)[id.ix_].load(std::memory_order_relaxed);
+    if (word & kShared) {
+      return HashValue(static_cast<uint32_t>(word));
+    }
+  }
   auto [it, inserted] = cache_.emplace(id, 0);
   if (inserted) {
     it->second = graph_.Apply<HashValue>(*this, id);
+    if (shared_ != nullptr) {
+      (*shared_)[id.ix_].store(kShared | it->second.value,
+                               std::memory_order_relaxed);
+    }
   }
   return it->second;
 }
@@ -144,7 +155,7 @@ HashValue StableHash::operator()(const Enumeration& x) {
     return hash;
   }
 
-  auto hash_enum = [this](const std::pair<std::string, int64_t>& e) {
+  auto hash_enum = [this](const std::pair<std::string_view, int64_t>& e) {
     return hash_(e.first, e.second);
   };
   return DecayHashCombine<2>(
@@ -169,4 +180,31 @@ HashValue StableHash::operator()(const Interface&) {
   return hash_("interface");
 }
 
+StableHashCache ComputeStableHashes(const Graph& graph,
+                                    const StableHashCache& known, size_t jobs) {
+  const Id limit = graph.Limit();
+  StableHash::Shared shared(limit.ix_);
+  for (const auto& [id, hash] : known) {
+    shared[id.ix_].store(StableHash::kShared | hash.value,
+                         std::memory_order_relaxed);
+  }
+  {
+    std::vector<StableHash> hashers;
+    hashers.reserve(std::max<size_t>(1, jobs));
+    for (size_t worker = 0; worker < std::max<size_t>(1, jobs); ++worker) {
+      hashers.emplace_back(graph, shared);
+    }
+    graph.ParallelForEach(jobs, Id(0), limit, [&](size_t worker, Id id) {
+      hashers[worker](id);
+    });
+  }
+  StableHashCache result;
+  result.reserve(limit.ix_);
+  graph.ForEach(Id(0), limit, [&](Id id) {
+    result.emplace(id, static_cast<uint32_t>(
+        shared[id.ix_].load(std::memory_order_relaxed)));
+  });
+  return result;
+}
+
 }  // namespace stg
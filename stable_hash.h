@@ -20,9 +20,12 @@
 #ifndef STG_STABLE_HASH_H_
 #define STG_STABLE_HASH_H_
 
+#include <atomic>
+#include <cstddef>
 #include <cstdint>
 #include <iostream>
 #include <unordered_map>
+#include <utility>
 #include <vector>
 
 #include "graph.h"
@@ -30,9 +33,25 @@
 
 namespace stg {
 
+// Stable hashes of nodes, keyed by node id.
+using StableHashCache = std::unordered_map<Id, HashValue>;
+
 class StableHash {
  public:
+  // Completed hashes shared between concurrent hashers, indexed by node id.
+  // Each word holds kShared | hash once the hash is known, and zero before.
+  using Shared = std::vector<std::atomic<uint64_t>>;
+  static constexpr uint64_t kShared = uint64_t{1} << 32;
+
   explicit StableHash(const Graph& graph) : graph_(graph) {}
+  // The cache may be seeded with known values, such as those recorded in an STG
+  // file. These must be the stable hashes of the nodes as they are now.
+  StableHash(const Graph& graph, StableHashCache cache)
+      : graph_(graph), cache_(std::move(cache)) {}
+  // Hashes already in shared are used instead of being computed again and new
+  // ones are published there. Nodes still being hashed stay private.
+  StableHash(const Graph& graph, Shared& shared)
+      : graph_(graph), shared_(&shared) {}
 
   HashValue operator()(Id);
   HashValue operator()(const Special&);
@@ -53,12 +72,19 @@ class StableHash {
 
  private:
   const Graph& graph_;
-  std::unordered_map<Id, HashValue> cache_;
+  StableHashCache cache_;
+  Shared* shared_ = nullptr;
 
   // Function object: (Args...) -> HashValue
   Hash hash_;
 };
 
+// Returns the stable hashes of all the nodes in the graph, suitable for seeding
+// StableHash, spreading the work over at most jobs workers. Known hashes are
+// kept as they are.
+StableHashCache ComputeStableHashes(const Graph& graph,
+                                    const StableHashCache& known, size_t jobs);
+
 }  // namespace stg
 
 #endif  // STG_STABLE_HASH_H_
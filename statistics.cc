@@ -0,0 +1,299 @@
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+// -*- mode: C++ -*-
+//
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License v2.0 with LLVM Exceptions (the
+// "License"); you may not use this file except in compliance with the
+// License.  You may obtain a copy of the License at
+//
+//     https://llvm.org/LICENSE.txt
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "statistics.h"
+
+#include <cstddef>
+#include <deque>
+#include <map>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "flat_map.h"
+#include "graph.h"
+#include "scc.h"
+
+namespace stg {
+
+namespace {
+
+// Tallies each node's kind, strings and child lists and collects its edges.
+struct Census {
+  explicit Census(Statistics& statistics) : statistics(statistics) {}
+
+  void operator()(const Special&, std::vector<Id>&) {
+    Node("special");
+  }
+
+  void operator()(const PointerReference& x, std::vector<Id>& edges) {
+    Node("pointer_reference");
+    edges.push_back(x.pointee_type_id);
+  }
+
+  void operator()(const PointerToMember& x, std::vector<Id>& edges) {
+    Node("pointer_to_member");
+    edges.push_back(x.containing_type_id);
+    edges.push_back(x.pointee_type_id);
+  }
+
+  void operator()(const Typedef& x, std::vector<Id>& edges) {
+    Node("typedef");
+    String(x.name);
+    edges.push_back(x.referred_type_id);
+  }
+
+  void operator()(const Qualified& x, std::vector<Id>& edges) {
+    Node("qualified");
+    edges.push_back(x.qualified_type_id);
+  }
+
+  void operator()(const Primitive& x, std::vector<Id>&) {
+    Node("primitive");
+    String(x.name);
+  }
+
+  void operator()(const Array& x, std::vector<Id>& edges) {
+    Node("array");
+    edges.push_back(x.element_type_id);
+  }
+
+  void operator()(const BaseClass& x, std::vector<Id>& edges) {
+    Node("base_class");
+    edges.push_back(x.type_id);
+  }
+
+  void operator()(const Method& x, std::vector<Id>& edges) {
+    Node("method");
+    String(x.mangled_name);
+    String(x.name);
+    edges.push_back(x.type_id);
+  }
+
+  void operator()(const Member& x, std::vector<Id>& edges) {
+    Node("member");
+    String(x.name);
+    edges.push_back(x.type_id);
+  }
+
+  void operator()(const StructUnion& x, std::vector<Id>& edges) {
+    Node("struct_union");
+    String(x.name);
+    if (x.definition.has_value()) {
+      const auto& definition = *x.definition;
+      List(definition.base_classes, edges);
+      List(definition.methods, edges);
+      List(definition.members, edges);
+    }
+  }
+
+  void operator()(const Enumeration& x, std::vector<Id>& edges) {
+    Node("enumeration");
+    String(x.name);
+    // enumerator names are interned
+    if (x.definition.has_value()) {
+      edges.push_back(x.definition->underlying_type_id);
+    }
+  }
+
+  void operator()(const Function& x, std::vector<Id>& edges) {
+    Node("function");
+    edges.push_back(x.return_type_id);
+    List(x.parameters, edges);
+  }
+
+  void operator()(const ElfSymbol& x, std::vector<Id>& edges) {
+    Node("elf_symbol");
+    String(x.symbol_name);
+    if (x.version_info) {
+      String(x.version_info->name);
+    }
+    if (x.ns) {
+      String(*x.ns);
+    }
+    if (x.full_name) {
+      String(*x.full_name);
+    }
+    if (x.type_id) {
+      edges.push_back(*x.type_id);
+    }
+  }
+
+  void operator()(const Interface& x, std::vector<Id>& edges) {
+    Node("interface");
+    List(x.symbols, edges);
+    List(x.types, edges);
+  }
+
+  void Node(std::string_view kind) {
+    ++statistics.nodes[kind];
+  }
+
+  void String(const std::string& string) {
+    ++statistics.node_strings;
+    statistics.node_string_characters += string.size();
+    // short strings are stored inline
+    if (string.capacity() > kInlineCapacity) {
+      statistics.node_string_heap_bytes += string.capacity() + 1;
+    }
+  }
+
+  // names are interned, so their bytes are counted with the interned strings
+  void String(std::string_view string) {
+    ++statistics.node_strings;
+    statistics.node_string_characters += string.size();
+  }
+
+  void List(const Ids& ids, std::vector<Id>& edges) {
+    ++statistics.child_lists;
+    statistics.child_entries += ids.size();
+    if (!ids.IsInline()) {
+      ++statistics.child_heap_lists;
+      statistics.child_bytes += ids.capacity() * sizeof(Id);
+    }
+    edges.insert(edges.end(), ids.begin(), ids.end());
+  }
+
+  // map node overheads are implementation specific and are not counted
+  void List(const FlatMap<std::string, Id>& ids, std::vector<Id>& edges) {
+    ++statistics.child_lists;
+    statistics.child_entries += ids.size();
+    for (const auto& [name, id] : ids) {
+      String(name);
+      edges.push_back(id);
+    }
+  }
+
+  static inline const size_t kInlineCapacity = std::string().capacity();
+
+  Statistics& statistics;
+};
+
+// Finds the SCCs of the nodes reachable from a root.
+struct Components {
+  Components(const std::vector<std::vector<Id>>& edges,
+             std::map<size_t, size_t>& sizes)
+      : edges(edges), sizes(sizes), assigned(edges.size(), false) {}
+
+  void operator()(Id id) {
+    if (assigned[id.ix_]) {
+      return;
+    }
+    const auto handle = scc.Open(id);
+    if (!handle) {
+      return;
+    }
+    for (const auto& target : edges[id.ix_]) {
+      (*this)(target);
+    }
+    const auto ids = scc.Close(*handle);
+    if (!ids.empty()) {
+      ++sizes[ids.size()];
+      for (const auto& node : ids) {
+        assigned[node.ix_] = true;
+      }
+    }
+  }
+
+  const std::vector<std::vector<Id>>& edges;
+  std::map<size_t, size_t>& sizes;
+  std::vector<bool> assigned;
+  SCC<Id> scc;
+};
+
+void Frequencies(std::ostream& os,
+                 const std::map<size_t, size_t>& frequencies) {
+  for (const auto& [item, frequency] : frequencies) {
+    os << " [" << item << "]=" << frequency;
+  }
+}
+
+}  // namespace
+
+Statistics GetStatistics(const Graph& graph, Id root) {
+  Statistics statistics;
+  statistics.storage = graph.Usage();
+  statistics.interned_strings = graph.Strings().Size();
+  statistics.interned_bytes = graph.Strings().Bytes();
+
+  const size_t limit = graph.Limit().ix_;
+  std::vector<std::vector<Id>> edges(limit);
+  Census census(statistics);
+  graph.ForEach(Id(0), graph.Limit(), [&](Id id) {
+    graph.Apply<void>(census, id, edges[id.ix_]);
+  });
+
+  // shortest distances from the root, breadth first
+  std::vector<std::optional<size_t>> depth(limit);
+  std::deque<Id> queue;
+  depth[root.ix_] = 0;
+  queue.push_back(root);
+  while (!queue.empty()) {
+    const Id id = queue.front();
+    queue.pop_front();
+    const size_t next = *depth[id.ix_] + 1;
+    ++statistics.reachable;
+    ++statistics.depths[next - 1];
+    for (const auto& target : edges[id.ix_]) {
+      if (!depth[target.ix_]) {
+        depth[target.ix_] = next;
+        queue.push_back(target);
+      }
+    }
+  }
+
+  Components components(edges, statistics.scc_sizes);
+  components(root);
+  return statistics;
+}
+
+std::ostream& operator<<(std::ostream& os, const Statistics& statistics) {
+  size_t nodes = 0;
+  for (const auto& [_, count] : statistics.nodes) {
+    nodes += count;
+  }
+  os << "nodes: " << nodes << '\n';
+  for (const auto& [kind, count] : statistics.nodes) {
+    os << "  " << kind << ": " << count << '\n';
+  }
+  size_t bytes = 0;
+  os << "storage:\n";
+  for (const auto& [kind, count, size] : statistics.storage) {
+    os << "  " << kind << ": " << count << " entries, " << size << " bytes\n";
+    bytes += size;
+  }
+  os << "  total: " << bytes << " bytes\n"
+     << "child lists: " << statistics.child_lists << " lists, "
+     << statistics.child_entries << " entries, "
+     << statistics.child_heap_lists << " on heap, "
+     << statistics.child_bytes << " heap bytes\n"
+     << "interned strings: " << statistics.interned_strings << " strings, "
+     << statistics.interned_bytes << " bytes\n"
+     << "node strings: " << statistics.node_strings << " strings, "
+     << statistics.node_string_characters << " characters, "
+     << statistics.node_string_heap_bytes << " heap bytes\n"
+     << "reachable: " << statistics.reachable << '\n'
+     << "SCC sizes:";
+  Frequencies(os, statistics.scc_sizes);
+  os << "\ndepths:";
+  Frequencies(os, statistics.depths);
+  return os << '\n';
+}
+
+}  // namespace stg
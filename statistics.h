@@ -0,0 +1,64 @@
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+// -*- mode: C++ -*-
+//
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License v2.0 with LLVM Exceptions (the
+// "License"); you may not use this file except in compliance with the
+// License.  You may obtain a copy of the License at
+//
+//     https://llvm.org/LICENSE.txt
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef STG_STATISTICS_H_
+#define STG_STATISTICS_H_
+
+#include <cstddef>
+#include <map>
+#include <ostream>
+#include <string_view>
+#include <vector>
+
+#include "graph.h"
+
+namespace stg {
+
+// Summary statistics of a graph, used to inform decisions about graph layout
+// and to estimate the memory needed to process an ABI.
+struct Statistics {
+  // live nodes, by kind
+  std::map<std::string_view, size_t> nodes;
+  // storage of the graph's node vectors
+  std::vector<Graph::Storage> storage;
+  // the vectors and maps of node ids held by nodes, and the vectors too long to
+  // be held inline along with the heap bytes they allocated
+  size_t child_lists = 0;
+  size_t child_entries = 0;
+  size_t child_heap_lists = 0;
+  size_t child_bytes = 0;
+  // distinct interned strings and their bytes
+  size_t interned_strings = 0;
+  size_t interned_bytes = 0;
+  // strings held by nodes, their total length and the bytes they allocated
+  size_t node_strings = 0;
+  size_t node_string_characters = 0;
+  size_t node_string_heap_bytes = 0;
+  // nodes reachable from the root, SCC size frequencies and frequencies of
+  // shortest distance from the root
+  size_t reachable = 0;
+  std::map<size_t, size_t> scc_sizes;
+  std::map<size_t, size_t> depths;
+};
+
+Statistics GetStatistics(const Graph& graph, Id root);
+
+std::ostream& operator<<(std::ostream& os, const Statistics& statistics);
+
+}  // namespace stg
+
+#endif  // STG_STATISTICS_H_
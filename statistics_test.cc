@@ -0,0 +1,57 @@
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+// -*- mode: C++ -*-
+//
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License v2.0 with LLVM Exceptions (the
+// "License"); you may not use this file except in compliance with the
+// License.  You may obtain a copy of the License at
+//
+//     https://llvm.org/LICENSE.txt
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "statistics.h"
+
+#include <cstddef>
+#include <map>
+#include <string_view>
+#include <vector>
+
+#include <catch2/catch.hpp>
+#include "graph.h"
+
+namespace Test {
+
+TEST_CASE("statistics") {
+  stg::Graph graph;
+  const auto v = graph.Add<stg::Special>(stg::Special::Kind::VOID);
+  const auto p = graph.Allocate();
+  const auto f = graph.Add<stg::Function>(v, std::vector<stg::Id>{p, v});
+  graph.Set<stg::PointerReference>(p, stg::PointerReference::Kind::POINTER, f);
+  const auto t = graph.Add<stg::Typedef>("t", p);
+  // unreachable from the root
+  (void)graph.Add<stg::Typedef>("u", v);
+
+  const auto statistics = stg::GetStatistics(graph, t);
+  CHECK(statistics.nodes == std::map<std::string_view, size_t>{
+      {"function", 1}, {"pointer_reference", 1}, {"special", 1},
+      {"typedef", 2}});
+  CHECK(statistics.storage.front().kind == "ids");
+  CHECK(statistics.storage.front().count == 5);
+  CHECK(statistics.child_lists == 1);
+  CHECK(statistics.child_entries == 2);
+  CHECK(statistics.child_heap_lists == 0);
+  CHECK(statistics.node_strings == 2);
+  CHECK(statistics.node_string_characters == 2);
+  CHECK(statistics.reachable == 4);
+  CHECK(statistics.scc_sizes == std::map<size_t, size_t>{{1, 2}, {2, 1}});
+  CHECK(statistics.depths
+        == std::map<size_t, size_t>{{0, 1}, {1, 1}, {2, 1}, {3, 1}});
+}
+
+}  // namespace Test
@@ -19,156 +19,174 @@
 
 #include <getopt.h>
 
+#include <charconv>
+#include <chrono>
+#include <cstddef>
 #include <cstring>
-#include <fstream>
+#include <filesystem>
 #include <iostream>
-#include <map>
 #include <memory>
+#include <mutex>
+#include <optional>
 #include <ostream>
+#include <sstream>
 #include <string>
+#include <system_error>
 #include <utility>
 #include <vector>
 
-#include "deduplication.h"
+#include "btf_reader.h"
 #include "error.h"
 #include "filter.h"
-#include "fingerprint.h"
 #include "graph.h"
 #include "input.h"
 #include "metrics.h"
+#include "pipeline.h"
 #include "proto_writer.h"
 #include "reader_options.h"
-#include "type_resolution.h"
-#include "unification.h"
-
-namespace stg {
-namespace {
-
-struct GetInterface {
-  Interface& operator()(Interface& x) const {
-    return x;
-  }
-
-  template <typename Node>
-  Interface& operator()(Node&) const {
-    Die() << "expected an Interface root node";
-  }
-};
-
-Id Merge(Graph& graph, const std::vector<Id>& roots, Metrics& metrics) {
-  bool failed = false;
-  // this rewrites the graph on destruction
-  Unification unification(graph, Id(0), metrics);
-  unification.Reserve(graph.Limit());
-  std::map<std::string, Id> symbols;
-  std::map<std::string, Id> types;
-  const GetInterface get;
-  for (auto root : roots) {
-    const auto& interface = graph.Apply<Interface&>(get, root);
-    for (const auto& x : interface.symbols) {
-      if (!symbols.insert(x).second) {
-        Warn() << "duplicate symbol during merge: " << x.first;
-        failed = true;
-      }
-    }
-    // TODO: test type roots merge
-    for (const auto& x : interface.types) {
-      const auto [it, inserted] = types.insert(x);
-      if (!inserted && !unification.Unify(x.second, it->second)) {
-        Warn() << "type conflict during merge: " << x.first;
-        failed = true;
-      }
-    }
-    graph.Remove(root);
-  }
-  if (failed) {
-    Die() << "merge failed";
-  }
-  return graph.Add<Interface>(symbols, types);
-}
-
-void FilterSymbols(Graph& graph, Id root, const Filter& filter) {
-  std::map<std::string, Id> symbols;
-  GetInterface get;
-  auto& interface = graph.Apply<Interface&>(get, root);
-  for (const auto& x : interface.symbols) {
-    if (filter(x.first)) {
-      symbols.insert(x);
-    }
-  }
-  std::swap(interface.symbols, symbols);
-}
-
-void Write(const Graph& graph, Id root, const char* output, Metrics& metrics) {
-  std::ofstream os(output);
-  {
-    Time x(metrics, "write");
-    proto::Writer writer(graph);
-    writer.Write(root, os);
-    os << std::flush;
-  }
-  if (!os) {
-    Die() << "error writing to " << '\'' << output << '\'';
-  }
-}
-
-}  // namespace
-}  // namespace stg
+#include "stable_hash.h"
+#include "trace.h"
+#include "type_store.h"
 
 int main(int argc, char* argv[]) {
   enum LongOptions {
     kSkipDwarf = 256,
+    kLazyDwarf,
+    kDedupDwarf,
+    kDedupUnits,
+    kFormat,
+    kCompress,
+    kDedup,
+    kStableHashes,
+    kVerifyCanonical,
+    kMetricsFormat,
+    kTrace,
+    kProgress,
+    kStored,
+    kStore,
+    kSnapshot,
+    kIndex,
+    kCheckpoint,
+    kResume,
   };
   // Process arguments.
   bool opt_metrics = false;
+  stg::MetricsFormat opt_metrics_format = stg::MetricsFormat::TEXT;
+  std::optional<const char*> opt_trace;
   bool opt_keep_duplicates = false;
+  bool opt_refine = false;
+  bool opt_stable_hashes = false;
+  bool opt_verify_canonical = false;
+  bool opt_progress = false;
   std::unique_ptr<stg::Filter> opt_file_filter;
   std::unique_ptr<stg::Filter> opt_symbol_filter;
+  // the filters as given, to describe checkpoints
+  std::string opt_file_filter_text;
+  std::string opt_symbol_filter_text;
   stg::ReadOptions opt_read_options;
   stg::InputFormat opt_input_format = stg::InputFormat::ABI;
+  stg::proto::Format opt_output_format = stg::proto::Format::TEXT;
+  bool opt_btf_output = false;
+  bool opt_edges_output = false;
+  stg::proto::Compression opt_compression = stg::proto::Compression::NONE;
+  bool opt_index = false;
+  std::optional<const char*> opt_store;
+  std::optional<const char*> opt_snapshot;
+  std::optional<const char*> opt_checkpoint;
+  bool opt_resume = false;
   std::vector<const char*> inputs;
   std::vector<const char*> outputs;
   static option opts[] = {
-      {"metrics",         no_argument,       nullptr, 'm'       },
-      {"info",            no_argument,       nullptr, 'i'       },
-      {"keep-duplicates", no_argument,       nullptr, 'd'       },
-      {"types",           no_argument,       nullptr, 't'       },
-      {"files",           required_argument, nullptr, 'F'       },
-      {"file-filter",     required_argument, nullptr, 'F'       },
-      {"symbols",         required_argument, nullptr, 'S'       },
-      {"symbol-filter",   required_argument, nullptr, 'S'       },
-      {"abi",             no_argument,       nullptr, 'a'       },
-      {"btf",             no_argument,       nullptr, 'b'       },
-      {"elf",             no_argument,       nullptr, 'e'       },
-      {"stg",             no_argument,       nullptr, 's'       },
-      {"output",          required_argument, nullptr, 'o'       },
-      {"skip-dwarf",      no_argument,       nullptr, kSkipDwarf},
-      {nullptr,           0,                 nullptr, 0         },
+      {"metrics",          optional_argument, nullptr, 'm'             },
+      {"metrics-format",   required_argument, nullptr, kMetricsFormat  },
+      {"trace",            required_argument, nullptr, kTrace          },
+      {"progress",         no_argument,       nullptr, kProgress       },
+      {"info",             no_argument,       nullptr, 'i'             },
+      {"keep-duplicates",  no_argument,       nullptr, 'd'             },
+      {"dedup",            required_argument, nullptr, kDedup          },
+      {"types",            no_argument,       nullptr, 't'             },
+      {"files",            required_argument, nullptr, 'F'             },
+      {"file-filter",      required_argument, nullptr, 'F'             },
+      {"symbols",          required_argument, nullptr, 'S'             },
+      {"symbol-filter",    required_argument, nullptr, 'S'             },
+      {"abi",              no_argument,       nullptr, 'a'             },
+      {"btf",              no_argument,       nullptr, 'b'             },
+      {"elf",              no_argument,       nullptr, 'e'             },
+      {"stg",              no_argument,       nullptr, 's'             },
+      {"stored",           no_argument,       nullptr, kStored         },
+      {"store",            required_argument, nullptr, kStore          },
+      {"snapshot",         required_argument, nullptr, kSnapshot       },
+      {"checkpoint",       required_argument, nullptr, kCheckpoint     },
+      {"resume",           no_argument,       nullptr, kResume         },
+      {"output",           required_argument, nullptr, 'o'             },
+      {"format",           required_argument, nullptr, kFormat         },
+      {"compress",         no_argument,       nullptr, kCompress       },
+      {"index",            no_argument,       nullptr, kIndex          },
+      {"stable-hashes",    no_argument,       nullptr, kStableHashes   },
+      {"verify-canonical", no_argument,       nullptr, kVerifyCanonical},
+      {"jobs",             required_argument, nullptr, 'j'             },
+      {"skip-dwarf",       no_argument,       nullptr, kSkipDwarf      },
+      {"lazy-dwarf",       no_argument,       nullptr, kLazyDwarf      },
+      {"dedup-dwarf",      no_argument,       nullptr, kDedupDwarf     },
+      {"dedup-units",      no_argument,       nullptr, kDedupUnits     },
+      {nullptr,            0,                 nullptr, 0               },
   };
   auto usage = [&]() {
     std::cerr << "usage: " << argv[0] << '\n'
-              << "  [-m|--metrics]\n"
+              << "  [-m|--metrics[=hw]]\n"
+              << "  [--metrics-format {text|json}]\n"
+              << "  [--trace <file>]\n"
+              << "  [--progress]\n"
               << "  [-i|--info]\n"
               << "  [-d|--keep-duplicates]\n"
+              << "  [--dedup {fingerprint|refine}]\n"
               << "  [-t|--types]\n"
               << "  [-F|--files|--file-filter <filter>]\n"
               << "  [-S|--symbols|--symbol-filter <filter>]\n"
+              << "  [-j|--jobs <jobs>]\n"
               << "  [--skip-dwarf]\n"
-              << "  [-a|--abi|-b|--btf|-e|--elf|-s|--stg] [file] ...\n"
+              << "  [--lazy-dwarf]\n"
+              << "  [--dedup-dwarf]\n"
+              << "  [--dedup-units]\n"
+              << "  [-a|--abi|-b|--btf|-e|--elf|-s|--stg|--stored] [file] ...\n"
+              << "  [--format {text|binary|sharded|btf|edges}]\n"
+              << "  [--compress]\n"
+              << "  [--index]\n"
+              << "  [--stable-hashes]\n"
+              << "  [--verify-canonical]\n"
               << "  [{-o|--output} {filename|-}] ...\n"
-              << "implicit defaults: --abi\n";
+              << "  [--store <directory> --snapshot <name>]\n"
+              << "  [--checkpoint <directory> [--resume]]\n"
+              << "implicit defaults: --abi\n"
+              << "--stored files are type store manifests,"
+              << " <directory>/snapshots/<name>\n"
+              << "--store adds the result to a type store and cannot be"
+              << " combined with\n"
+              << "  --keep-duplicates\n"
+              << "--index writes <output>.idx alongside each binary or sharded"
+              << " output, for\n"
+              << "  stginfo --symbol\n"
+              << "--resume starts from the latest checkpoint, if any, instead"
+              << " of the inputs\n";
     stg::FilterUsage(std::cerr);
     return 1;
   };
   while (true) {
     int ix;
-    const int c = getopt_long(argc, argv, "-midtS:F:abeso:", opts, &ix);
+    const int c = getopt_long(argc, argv, "-midtS:F:abeso:j:", opts, &ix);
     if (c == -1) {
       break;
     }
     const char* argument = optarg;
     switch (c) {
       case 'm':
+        if (argument != nullptr) {
+          if (strcmp(argument, "hw") != 0) {
+            std::cerr << "unknown metrics option: " << argument << '\n';
+            return usage();
+          }
+          stg::EnableHardwareCounters();
+        }
         opt_metrics = true;
         break;
       case 'i':
@@ -182,9 +200,11 @@ int main(int argc, char* argv[]) {
         break;
       case 'F':
         opt_file_filter = stg::MakeFilter(argument);
+        opt_file_filter_text = argument;
         break;
       case 'S':
         opt_symbol_filter = stg::MakeFilter(argument);
+        opt_symbol_filter_text = argument;
         break;
       case 'a':
         opt_input_format = stg::InputFormat::ABI;
@@ -198,6 +218,21 @@ int main(int argc, char* argv[]) {
       case 's':
         opt_input_format = stg::InputFormat::STG;
         break;
+      case kStored:
+        opt_input_format = stg::InputFormat::STORED;
+        break;
+      case kStore:
+        opt_store = argument;
+        break;
+      case kSnapshot:
+        opt_snapshot = argument;
+        break;
+      case kCheckpoint:
+        opt_checkpoint = argument;
+        break;
+      case kResume:
+        opt_resume = true;
+        break;
       case 1:
         inputs.push_back(argument);
         break;
@@ -207,44 +242,298 @@ int main(int argc, char* argv[]) {
         }
         outputs.push_back(argument);
         break;
+      case 'j': {
+        const auto end = argument + strlen(argument);
+        const auto [ptr, ec] =
+            std::from_chars(argument, end, opt_read_options.jobs);
+        if (ec != std::errc() || ptr != end || opt_read_options.jobs == 0) {
+          std::cerr << "invalid number of jobs: " << argument << '\n';
+          return usage();
+        }
+        break;
+      }
       case kSkipDwarf:
         opt_read_options.Set(stg::ReadOptions::SKIP_DWARF);
         break;
+      case kLazyDwarf:
+        opt_read_options.Set(stg::ReadOptions::LAZY_DWARF);
+        break;
+      case kDedupDwarf:
+        opt_read_options.Set(stg::ReadOptions::DEDUPLICATE_DWARF);
+        break;
+      case kDedupUnits:
+        opt_read_options.Set(stg::ReadOptions::SKIP_DUPLICATE_UNITS);
+        break;
+      case kDedup:
+        if (strcmp(argument, "fingerprint") == 0) {
+          opt_refine = false;
+        } else if (strcmp(argument, "refine") == 0) {
+          opt_refine = true;
+        } else {
+          std::cerr << "unknown deduplication method: " << argument << '\n';
+          return usage();
+        }
+        break;
+      case kStableHashes:
+        opt_stable_hashes = true;
+        break;
+      case kVerifyCanonical:
+        opt_verify_canonical = true;
+        break;
+      case kTrace:
+        opt_trace = argument;
+        break;
+      case kProgress:
+        opt_progress = true;
+        break;
+      case kMetricsFormat:
+        if (const auto format = stg::ParseMetricsFormat(argument)) {
+          opt_metrics = true;
+          opt_metrics_format = format.value();
+        } else {
+          std::cerr << "unknown metrics format: " << argument << '\n';
+          return usage();
+        }
+        break;
+      case kFormat:
+        if (strcmp(argument, "text") == 0) {
+          opt_output_format = stg::proto::Format::TEXT;
+        } else if (strcmp(argument, "binary") == 0) {
+          opt_output_format = stg::proto::Format::BINARY;
+        } else if (strcmp(argument, "sharded") == 0) {
+          opt_output_format = stg::proto::Format::SHARDED;
+        } else if (strcmp(argument, "btf") == 0) {
+          opt_btf_output = true;
+        } else if (strcmp(argument, "edges") == 0) {
+          opt_edges_output = true;
+        } else {
+          std::cerr << "unknown output format: " << argument << '\n';
+          return usage();
+        }
+        break;
+      case kCompress:
+        opt_compression = stg::proto::Compression::GZIP;
+        break;
+      case kIndex:
+        opt_index = true;
+        break;
       default:
         return usage();
     }
   }
 
+  if (opt_compression != stg::proto::Compression::NONE
+      && opt_output_format == stg::proto::Format::SHARDED) {
+    std::cerr << "sharded output cannot be compressed\n";
+    return usage();
+  }
+  if (opt_btf_output
+      && (opt_compression != stg::proto::Compression::NONE
+          || opt_stable_hashes)) {
+    std::cerr << "BTF output cannot be compressed or carry stable hashes\n";
+    return usage();
+  }
+  if (opt_edges_output
+      && (opt_compression != stg::proto::Compression::NONE
+          || opt_stable_hashes)) {
+    std::cerr << "edge list output cannot be compressed or carry stable "
+              << "hashes\n";
+    return usage();
+  }
+  if (opt_index
+      && (opt_btf_output || opt_edges_output
+          || opt_output_format == stg::proto::Format::TEXT
+          || opt_compression != stg::proto::Compression::NONE)) {
+    std::cerr << "only uncompressed binary or sharded output can be indexed\n";
+    return usage();
+  }
+  if (opt_store.has_value() != opt_snapshot.has_value()
+      || (opt_store && opt_keep_duplicates)
+      || (opt_resume && !opt_checkpoint)) {
+    return usage();
+  }
+
+  if (opt_trace) {
+    stg::trace::Enable();
+  }
+  // Sharing identical nodes while reading saves deduplication some work.
+  if (!opt_keep_duplicates) {
+    opt_read_options.Set(stg::ReadOptions::HASH_CONS);
+  }
+
+  // Readers drop filtered symbols early and so never read what only they need.
+  opt_read_options.symbol_filter = opt_symbol_filter.get();
+
+  // Report DWARF progress at most once a second, and on completion.
+  std::mutex progress_mutex;
+  std::chrono::steady_clock::time_point progress_time;
+  if (opt_progress) {
+    opt_read_options.monitor.progress =
+        [&](const stg::ReadProgress& progress) {
+          const auto now = std::chrono::steady_clock::now();
+          const std::lock_guard<std::mutex> lock(progress_mutex);
+          if (progress.units < progress.total_units
+              && now - progress_time < std::chrono::seconds(1)) {
+            return;
+          }
+          progress_time = now;
+          std::cerr << "DWARF: " << progress.units << '/'
+                    << progress.total_units << " compilation units, "
+                    << progress.bytes << '/' << progress.total_bytes
+                    << " bytes\n";
+        };
+  }
+
+  // The stages after which checkpoints are taken, in order.
+  constexpr size_t kRead = 0;
+  constexpr size_t kDeduplicated = 1;
+
   try {
     stg::Graph graph;
     stg::Metrics metrics;
-    std::vector<stg::Id> roots;
-    roots.reserve(inputs.size());
-    for (auto input : inputs) {
-      roots.push_back(stg::Read(graph, opt_input_format, input,
-                                opt_read_options, opt_file_filter,
-                                metrics));
+    // Stable hashes recorded in a single STG input can be reused for output.
+    // They stay valid under deduplication, which only substitutes equal nodes,
+    // but not if merging or type resolution unify anything.
+    stg::StableHashCache stable_hashes;
+    // A single STG input may claim to be resolved and deduplicated already.
+    // Symbol filtering only drops nodes, so the claim survives it.
+    bool canonical = false;
+    // A checkpoint, if resumed from, stands in for reading and merging the
+    // inputs and, if it was taken after deduplication, is canonical.
+    std::optional<stg::Checkpoints> checkpoints;
+    std::optional<std::string> checkpoint;
+    if (opt_checkpoint) {
+      // Checkpoints are only resumed from with the same inputs, unchanged, and
+      // the same options for reading them and, after deduplication, for that.
+      std::ostringstream read;
+      read << "format " << static_cast<int>(opt_input_format) << '\n'
+           << "read options " << opt_read_options.bitset << '\n'
+           << "keep duplicates " << opt_keep_duplicates << '\n'
+           << "file filter " << opt_file_filter_text << '\n'
+           << "symbol filter " << opt_symbol_filter_text << '\n';
+      for (const auto* input : inputs) {
+        read << "input " << input;
+        std::error_code error;
+        const auto size = std::filesystem::file_size(input, error);
+        if (!error) {
+          read << " size " << size;
+        }
+        const auto time = std::filesystem::last_write_time(input, error);
+        if (!error) {
+          read << " time " << time.time_since_epoch().count();
+        }
+        read << '\n';
+      }
+      const std::string description = read.str();
+      checkpoints.emplace(
+          *opt_checkpoint,
+          std::vector<stg::Checkpoints::Stage>{
+              {"read", description},
+              {"deduplicated",
+               description + "refine " + std::to_string(opt_refine) + '\n'}});
+      if (opt_resume) {
+        checkpoint = checkpoints->Latest();
+      }
+    }
+    stg::Id root = stg::Id::kInvalid;
+    if (checkpoint) {
+      root = stg::Read(graph, stg::InputFormat::STG, checkpoint->c_str(),
+                       opt_read_options, opt_file_filter, metrics,
+                       &stable_hashes, &canonical);
+    } else {
+      std::vector<stg::Id> roots;
+      roots.reserve(inputs.size());
+      if (opt_input_format == stg::InputFormat::BTF && inputs.size() > 1) {
+        // The first BTF is the base of any split BTF that follows, such as that
+        // of vmlinux and kernel modules; its types are read only once.
+        stg::Time read(metrics, "read BTF");
+        stg::btf::Base base(graph, inputs[0], opt_read_options);
+        roots.push_back(base.Root());
+        for (size_t ix = 1; ix < inputs.size(); ++ix) {
+          roots.push_back(base.Read(inputs[ix]));
+        }
+      } else if (inputs.size() == 1
+                 && !stg::IsMultiObject(opt_input_format, inputs[0])) {
+        roots.push_back(stg::Read(graph, opt_input_format, inputs[0],
+                                  opt_read_options, opt_file_filter, metrics,
+                                  &stable_hashes, &canonical));
+      } else {
+        std::vector<std::pair<stg::InputFormat, const char*>> formatted_inputs;
+        formatted_inputs.reserve(inputs.size());
+        for (auto input : inputs) {
+          formatted_inputs.emplace_back(opt_input_format, input);
+        }
+        if (opt_keep_duplicates) {
+          roots = stg::Read(graph, formatted_inputs, opt_read_options,
+                            opt_file_filter, metrics);
+        } else {
+          // Merging in a tree deduplicates as it goes.
+          auto separate = stg::ReadSeparately(
+              formatted_inputs, opt_read_options, opt_file_filter);
+          roots.push_back(
+              stg::Merge(graph, separate, metrics, opt_read_options.jobs));
+        }
+      }
+      root = roots.size() == 1
+                 ? roots[0]
+                 : stg::Merge(graph, roots, metrics, opt_read_options.jobs);
+      // Nodes reachable only from filtered symbols or from merged interfaces
+      // would otherwise be carried through every later pass.
+      if (roots.size() > 1 || opt_read_options.symbol_filter != nullptr) {
+        root = stg::RemoveUnreachable(graph, root, stable_hashes, metrics);
+      }
+      if (checkpoints) {
+        checkpoints->Write(kRead, graph, root, stable_hashes, false, canonical,
+                           metrics, opt_read_options.jobs);
+      }
     }
-    stg::Id root =
-        roots.size() == 1 ? roots[0] : stg::Merge(graph, roots, metrics);
-    if (opt_symbol_filter) {
-      stg::FilterSymbols(graph, root, *opt_symbol_filter);
+    if (!opt_keep_duplicates && (!canonical || opt_verify_canonical)) {
+      auto count_nodes = [&graph]() {
+        size_t count = 0;
+        graph.ForEach(stg::Id(0), graph.Limit(), [&](stg::Id) { ++count; });
+        return count;
+      };
+      const size_t before = canonical ? count_nodes() : 0;
+      root = stg::ResolveAndDeduplicate(graph, root, opt_refine, stable_hashes,
+                                        metrics, opt_read_options.jobs);
+      if (canonical) {
+        const size_t after = count_nodes();
+        stg::Check(after == before)
+            << "input claimed to be canonical, but resolution and "
+            << "deduplication removed " << (before - after) << " nodes";
+      }
+      if (checkpoints && !canonical) {
+        checkpoints->Write(kDeduplicated, graph, root, stable_hashes,
+                           opt_stable_hashes, true, metrics,
+                           opt_read_options.jobs);
+      }
     }
-    if (!opt_keep_duplicates) {
-      {
-        stg::Unification unification(graph, stg::Id(0), metrics);
-        unification.Reserve(graph.Limit());
-        stg::ResolveTypes(graph, unification, {root}, metrics);
-        unification.Update(root);
+    if (opt_btf_output) {
+      for (auto output : outputs) {
+        stg::WriteBtf(graph, root, output, metrics);
       }
-      const auto hashes = stg::Fingerprint(graph, root, metrics);
-      root = stg::Deduplicate(graph, root, hashes, metrics);
+    } else if (opt_edges_output) {
+      for (auto output : outputs) {
+        stg::WriteEdges(graph, root, output, metrics);
+      }
+    } else {
+      stg::Write(graph, root, outputs, opt_output_format, opt_compression,
+                 stable_hashes, opt_stable_hashes,
+                 canonical || !opt_keep_duplicates, metrics,
+                 opt_read_options.jobs, opt_index);
+    }
+    if (opt_store) {
+      // the graph is moved into the store's own
+      stg::Graph store_graph;
+      stg::TypeStore store(store_graph, *opt_store, metrics,
+                           opt_read_options.jobs);
+      store.Add(*opt_snapshot, graph, root);
     }
-    for (auto output : outputs) {
-      stg::Write(graph, root, output, metrics);
+    if (opt_trace) {
+      stg::trace::Write(*opt_trace);
     }
     if (opt_metrics) {
-      stg::Report(metrics, std::cerr);
+      stg::Report(metrics, std::cerr, opt_metrics_format);
     }
     return 0;
   } catch (const stg::Exception& e) {
@@ -0,0 +1,610 @@
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+// -*- mode: C++ -*-
+//
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License v2.0 with LLVM Exceptions (the
+// "License"); you may not use this file except in compliance with the
+// License.  You may obtain a copy of the License at
+//
+//     https://llvm.org/LICENSE.txt
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <getopt.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <filesystem>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+#include "abigail_reader.h"
+#include "btf_reader.h"
+#include "comparison.h"
+#include "deduplication.h"
+#include "elf_reader.h"
+#include "error.h"
+#include "fingerprint.h"
+#include "graph.h"
+#include "hashing.h"
+#include "metrics.h"
+#include "naming.h"
+#include "post_processing.h"
+#include "proto_reader.h"
+#include "proto_writer.h"
+#include "reader_options.h"
+#include "reporting.h"
+#include "synthetic.h"
+#include "type_resolution.h"
+#include "unification.h"
+
+namespace stg {
+namespace {
+
+// Synthetic graph sizes, in number of symbols.
+const std::vector<int64_t> kSizes = {1 << 8, 1 << 10, 1 << 12, 1 << 14};
+
+// A way of populating a fresh graph, returning the root.
+using Source = std::function<Id(Graph&, Metrics&)>;
+
+// Builds an ABI with the given number of function symbols. Function i takes a
+// pointer to struct i, which has an int member, a pointer to itself and a
+// pointer to struct i / 2. All struct types are built twice, as if they came
+// from two translation units, and odd-numbered functions see only a
+// declaration of their struct. This gives type resolution and deduplication
+// some work to do. If changed is set, every 64th struct has an extra member.
+Id BuildSynthetic(Graph& graph, size_t size, bool changed) {
+  const Id int_type = graph.Add<Primitive>(
+      "int", Primitive::Encoding::SIGNED_INTEGER, 4);
+  std::vector<Id> pointers[2];
+  for (auto& copy : pointers) {
+    std::vector<Id> structs;
+    structs.reserve(size);
+    copy.reserve(size);
+    for (size_t i = 0; i < size; ++i) {
+      const Id id = graph.Allocate();
+      structs.push_back(id);
+      copy.push_back(
+          graph.Add<PointerReference>(PointerReference::Kind::POINTER, id));
+    }
+    for (size_t i = 0; i < size; ++i) {
+      std::vector<Id> members = {
+          graph.Add<Member>("value", int_type, 0, 0),
+          graph.Add<Member>("self", copy[i], 64, 0),
+          graph.Add<Member>("parent", copy[i / 2], 128, 0),
+      };
+      uint64_t bytesize = 24;
+      if (changed && i % 64 == 0) {
+        members.push_back(graph.Add<Member>("extra", int_type, 192, 0));
+        bytesize += 8;
+      }
+      graph.Set<StructUnion>(structs[i], StructUnion::Kind::STRUCT,
+                             "struct_" + std::to_string(i), bytesize,
+                             std::vector<Id>{}, std::vector<Id>{}, members);
+    }
+  }
+  std::map<std::string, Id> symbols;
+  for (size_t i = 0; i < size; ++i) {
+    Id parameter = pointers[i % 2][i];
+    if (i % 2) {
+      const Id declaration = graph.Add<StructUnion>(
+          StructUnion::Kind::STRUCT, "struct_" + std::to_string(i));
+      parameter = graph.Add<PointerReference>(
+          PointerReference::Kind::POINTER, declaration);
+    }
+    const Id function =
+        graph.Add<Function>(int_type, std::vector<Id>{parameter});
+    const std::string name = "function_" + std::to_string(i);
+    symbols.emplace(name, graph.Add<ElfSymbol>(
+        name, std::nullopt, true, ElfSymbol::SymbolType::FUNCTION,
+        ElfSymbol::Binding::GLOBAL, ElfSymbol::Visibility::DEFAULT,
+        std::nullopt, std::nullopt, function, std::nullopt));
+  }
+  return graph.Add<Interface>(symbols);
+}
+
+void Resolve(Graph& graph, Id& root, Metrics& metrics) {
+  Unification unification(graph, Id(0), metrics);
+  unification.Reserve(graph.Limit());
+  ResolveTypes(graph, unification, {root}, metrics);
+  unification.Update(root);
+}
+
+void SetNodes(benchmark::State& state, const Graph& graph) {
+  state.counters["nodes"] = static_cast<double>(graph.Limit().ix_);
+}
+
+// Times a reader. Each iteration reads into a fresh graph.
+void BenchmarkRead(benchmark::State& state, const Source& source) {
+  for (auto _ : state) {
+    state.PauseTiming();
+    auto graph = std::make_unique<Graph>();
+    Metrics metrics;
+    state.ResumeTiming();
+    benchmark::DoNotOptimize(source(*graph, metrics));
+    state.PauseTiming();
+    SetNodes(state, *graph);
+    graph.reset();
+    state.ResumeTiming();
+  }
+}
+
+// Times type resolution, including the graph rewrite it causes.
+void BenchmarkResolveTypes(benchmark::State& state, const Source& source) {
+  for (auto _ : state) {
+    state.PauseTiming();
+    auto graph = std::make_unique<Graph>();
+    Metrics metrics;
+    Id root = source(*graph, metrics);
+    SetNodes(state, *graph);
+    state.ResumeTiming();
+    Resolve(*graph, root, metrics);
+    benchmark::DoNotOptimize(root);
+    state.PauseTiming();
+    graph.reset();
+    state.ResumeTiming();
+  }
+}
+
+// Times fingerprinting of a type-resolved graph.
+void BenchmarkFingerprint(benchmark::State& state, const Source& source) {
+  Graph graph;
+  Metrics metrics;
+  Id root = source(graph, metrics);
+  Resolve(graph, root, metrics);
+  SetNodes(state, graph);
+  for (auto _ : state) {
+    Metrics iteration;
+    benchmark::DoNotOptimize(Fingerprint(graph, root, iteration));
+  }
+}
+
+// Identifiers of the given length, typical of C names (short) and C++ mangled
+// names (long).
+std::vector<std::string> Names(size_t length) {
+  std::vector<std::string> names;
+  for (size_t i = 0; i < 1024; ++i) {
+    auto name = "_ZN" + std::to_string(i) + "_";
+    name.resize(length, "abcdefghijklmnopqrstuvwxyz"[i % 26]);
+    names.push_back(std::move(name));
+  }
+  return names;
+}
+
+// Times hashing of names with one of the hashers.
+template <typename Hasher>
+void BenchmarkHashNames(benchmark::State& state) {
+  const auto names = Names(state.range(0));
+  const Hasher hash;
+  for (auto _ : state) {
+    for (const auto& name : names) {
+      benchmark::DoNotOptimize(hash(name));
+    }
+  }
+  state.SetBytesProcessed(state.iterations() * names.size() * state.range(0));
+}
+
+// Times equality of names which differ only in their last byte.
+void BenchmarkEqualNames(benchmark::State& state) {
+  const auto names1 = Names(state.range(0));
+  auto names2 = names1;
+  for (auto& name : names2) {
+    ++name.back();
+  }
+  for (auto _ : state) {
+    for (size_t i = 0; i < names1.size(); ++i) {
+      benchmark::DoNotOptimize(names1[i] == names2[i]);
+    }
+  }
+  state.SetBytesProcessed(state.iterations() * names1.size() * state.range(0));
+}
+
+// Times deduplication of a type-resolved and fingerprinted graph.
+void BenchmarkDeduplicate(benchmark::State& state, const Source& source) {
+  for (auto _ : state) {
+    state.PauseTiming();
+    auto graph = std::make_unique<Graph>();
+    Metrics metrics;
+    Id root = source(*graph, metrics);
+    Resolve(*graph, root, metrics);
+    const auto hashes = Fingerprint(*graph, root, metrics);
+    SetNodes(state, *graph);
+    state.ResumeTiming();
+    benchmark::DoNotOptimize(Deduplicate(*graph, root, hashes, metrics));
+    state.PauseTiming();
+    graph.reset();
+    state.ResumeTiming();
+  }
+}
+
+// Times deduplication of a type-resolved graph by partition refinement.
+void BenchmarkRefine(benchmark::State& state, const Source& source) {
+  for (auto _ : state) {
+    state.PauseTiming();
+    auto graph = std::make_unique<Graph>();
+    Metrics metrics;
+    Id root = source(*graph, metrics);
+    Resolve(*graph, root, metrics);
+    SetNodes(state, *graph);
+    state.ResumeTiming();
+    benchmark::DoNotOptimize(DeduplicateByRefinement(*graph, root, metrics));
+    state.PauseTiming();
+    graph.reset();
+    state.ResumeTiming();
+  }
+}
+
+// Times comparison of two graphs, as done by stgdiff.
+void BenchmarkCompare(benchmark::State& state, const Source& source1,
+                      const Source& source2) {
+  Graph graph;
+  Metrics metrics;
+  const Id root1 = source1(graph, metrics);
+  const Id root2 = source2(graph, metrics);
+  SetNodes(state, graph);
+  for (auto _ : state) {
+    Metrics iteration;
+    Compare compare{graph, Ignore(), iteration};
+    benchmark::DoNotOptimize(compare(root1, root2));
+  }
+}
+
+// Times reporting of the differences between two graphs, with a fresh name
+// cache for each report.
+void BenchmarkReport(benchmark::State& state, const Source& source1,
+                     const Source& source2,
+                     reporting::OutputFormat format, size_t jobs) {
+  Graph graph;
+  Metrics metrics;
+  const Id root1 = source1(graph, metrics);
+  const Id root2 = source2(graph, metrics);
+  SetNodes(state, graph);
+  Compare compare{graph, Ignore(), metrics};
+  const auto [equals, comparison] = compare(root1, root2);
+  if (!comparison) {
+    state.SkipWithError("no differences to report");
+    return;
+  }
+  const reporting::Options options{format, 3, jobs};
+  for (auto _ : state) {
+    NameCache names;
+    const reporting::Reporting reporting{graph, compare.outcomes, options,
+                                         names, compare.resolutions};
+    std::ostringstream output;
+    Report(reporting, *comparison, output);
+    benchmark::DoNotOptimize(output.tellp());
+  }
+}
+
+// Builds a SMALL report with the given number of symbols, mixing each kind
+// of line that the SHORT report post-processing summarises.
+std::vector<std::string> BuildReport(size_t size) {
+  std::vector<std::string> report;
+  for (size_t i = 0; i < size; ++i) {
+    const auto name = "'int function_" + std::to_string(i) + "(int)'";
+    switch (i % 4) {
+      case 0:
+        report.push_back("function symbol " + name + " was removed");
+        break;
+      case 1:
+        report.push_back("function symbol " + name + " was added");
+        break;
+      case 2:
+        report.push_back("function symbol " + name + " changed");
+        report.push_back("  CRC changed from 0x" + std::to_string(i) +
+                         " to 0x" + std::to_string(i + 1));
+        break;
+      case 3:
+        report.push_back("type 'struct struct_" + std::to_string(i) +
+                         "' changed");
+        for (size_t member = 0; member < 8; ++member) {
+          const auto offset = 64 * (member + 1);
+          report.push_back("  member 'int member_" + std::to_string(member) +
+                           "' changed");
+          report.push_back("    offset changed from " + std::to_string(offset) +
+                           " to " + std::to_string(offset + 32));
+        }
+        break;
+    }
+    report.emplace_back();
+  }
+  return report;
+}
+
+// Times summarising a SMALL report as a SHORT report.
+void BenchmarkPostProcess(benchmark::State& state) {
+  const auto report = BuildReport(state.range(0));
+  size_t bytes = 0;
+  for (const auto& line : report) {
+    bytes += line.size() + 1;
+  }
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(PostProcess(report, 3));
+  }
+  state.SetBytesProcessed(state.iterations() * bytes);
+}
+
+// Runs a source once, returning false if it fails. This keeps inputs that
+// exist only to test error handling out of the benchmark set.
+bool Readable(const Source& source) {
+  try {
+    Graph graph;
+    Metrics metrics;
+    (void)source(graph, metrics);
+    return true;
+  } catch (const Exception&) {
+    return false;
+  }
+}
+
+template <typename Function, typename... Args>
+void Register(const std::string& name, Function function, Args&&... args) {
+  benchmark::RegisterBenchmark(name.c_str(), function,
+                               std::forward<Args>(args)...)
+      ->Unit(benchmark::kMicrosecond);
+}
+
+template <typename Function, typename... Args>
+void RegisterSynthetic(const std::string& name, Function function,
+                       Args&&... args) {
+  auto* benchmark = benchmark::RegisterBenchmark(
+      name.c_str(), [=](benchmark::State& state) {
+        const size_t size = state.range(0);
+        function(state, args(size)...);
+      });
+  benchmark->Unit(benchmark::kMicrosecond);
+  for (const auto size : kSizes) {
+    benchmark->Arg(size);
+  }
+}
+
+void RegisterPipeline(const std::string& name, const Source& source) {
+  Register("ResolveTypes/" + name, BenchmarkResolveTypes, source);
+  Register("Fingerprint/" + name, BenchmarkFingerprint, source);
+  Register("Deduplicate/" + name, BenchmarkDeduplicate, source);
+  Register("DeduplicateByRefinement/" + name, BenchmarkRefine, source);
+}
+
+void RegisterDiff(const std::string& name, const Source& source1,
+                  const Source& source2) {
+  Register("Compare/" + name, BenchmarkCompare, source1, source2);
+  Register("Report/" + name, BenchmarkReport, source1, source2,
+           reporting::OutputFormat::SMALL, size_t{1});
+}
+
+// Registers benchmarks for every readable XML and STG file in the corpus,
+// using the file name stem as the benchmark name suffix. Files named *_0.ext
+// and *_1.ext are also compared.
+void RegisterCorpus(const std::filesystem::path& directory) {
+  std::vector<std::filesystem::path> paths;
+  for (const auto& entry : std::filesystem::directory_iterator(directory)) {
+    if (entry.is_regular_file()) {
+      paths.push_back(entry.path());
+    }
+  }
+  std::sort(paths.begin(), paths.end());
+
+  std::map<std::string, Source> sources;
+  for (const auto& path : paths) {
+    const auto extension = path.extension();
+    const auto file = path.filename().string();
+    Source source;
+    std::string reader;
+    if (extension == ".xml") {
+      reader = "abixml::Read/";
+      source = [=](Graph& graph, Metrics& metrics) {
+        return abixml::Read(graph, path, metrics);
+      };
+    } else if (extension == ".stg") {
+      reader = "proto::Read/";
+      source = [=](Graph& graph, Metrics&) {
+        return proto::Read(graph, path);
+      };
+    } else {
+      continue;
+    }
+    if (!Readable(source)) {
+      continue;
+    }
+    Register(reader + file, BenchmarkRead, source);
+    RegisterPipeline(file, source);
+    sources.emplace(file, source);
+  }
+
+  for (const auto& [file, source1] : sources) {
+    const auto suffix = file.rfind("_0.");
+    if (suffix == std::string::npos) {
+      continue;
+    }
+    auto other = file;
+    other[suffix + 1] = '1';
+    const auto it = sources.find(other);
+    if (it != sources.end()) {
+      RegisterDiff(file.substr(0, suffix), source1, it->second);
+    }
+  }
+}
+
+// ELF and BTF inputs are not part of the corpus and must be given explicitly.
+void RegisterBinary(const std::string& reader, const std::string& path,
+                    const Source& source) {
+  const auto file = std::filesystem::path(path).filename().string();
+  Register(reader + file, BenchmarkRead, source);
+  RegisterPipeline(file, source);
+}
+
+void RegisterNames() {
+  for (auto* benchmark : {
+           benchmark::RegisterBenchmark("HashNames/Hash",
+                                        BenchmarkHashNames<Hash>),
+           benchmark::RegisterBenchmark("HashNames/Hash64",
+                                        BenchmarkHashNames<Hash64>),
+           benchmark::RegisterBenchmark("EqualNames", BenchmarkEqualNames)}) {
+    benchmark->RangeMultiplier(2)->Range(4, 64);
+  }
+}
+
+void RegisterSynthetics() {
+  const auto original = [](size_t size) -> Source {
+    return [=](Graph& graph, Metrics&) {
+      return BuildSynthetic(graph, size, false);
+    };
+  };
+  const auto changed = [](size_t size) -> Source {
+    return [=](Graph& graph, Metrics&) {
+      return BuildSynthetic(graph, size, true);
+    };
+  };
+  // the generator's default shape, which has larger SCCs and more typedefs
+  const auto shaped = [](size_t size) -> Source {
+    return [=](Graph& graph, Metrics&) {
+      SyntheticOptions options;
+      options.symbols = size;
+      return Synthesise(graph, options);
+    };
+  };
+  // the synthetic ABI written in the given format and read back
+  const auto written = [](proto::Format format, proto::IdMapping id_mapping) {
+    return [=](size_t size) -> Source {
+      Graph graph;
+      const Id root = BuildSynthetic(graph, size, false);
+      std::ostringstream os;
+      proto::Writer(graph).Write(root, os, format);
+      const auto input = std::make_shared<const std::string>(os.str());
+      return [=](Graph& graph, Metrics&) {
+        return proto::ReadFromString(graph, *input, nullptr, id_mapping);
+      };
+    };
+  };
+  RegisterSynthetic("proto::ReadFromString/binary/hashed/synthetic",
+                    BenchmarkRead,
+                    written(proto::Format::BINARY, proto::IdMapping::HASHED));
+  RegisterSynthetic("proto::ReadFromString/binary/sorted/synthetic",
+                    BenchmarkRead,
+                    written(proto::Format::BINARY, proto::IdMapping::SORTED));
+  RegisterSynthetic("proto::ReadFromString/text/synthetic", BenchmarkRead,
+                    written(proto::Format::TEXT, proto::IdMapping::SORTED));
+  RegisterSynthetic("ResolveTypes/synthetic", BenchmarkResolveTypes,
+                    original);
+  RegisterSynthetic("Fingerprint/synthetic", BenchmarkFingerprint, original);
+  RegisterSynthetic("Deduplicate/synthetic", BenchmarkDeduplicate, original);
+  RegisterSynthetic("DeduplicateByRefinement/synthetic", BenchmarkRefine,
+                    original);
+  RegisterSynthetic("Compare/synthetic", BenchmarkCompare, original, changed);
+  RegisterSynthetic("ResolveTypes/shaped", BenchmarkResolveTypes, shaped);
+  RegisterSynthetic("Fingerprint/shaped", BenchmarkFingerprint, shaped);
+  RegisterSynthetic("Deduplicate/shaped", BenchmarkDeduplicate, shaped);
+  RegisterSynthetic("DeduplicateByRefinement/shaped", BenchmarkRefine,
+                    shaped);
+  RegisterSynthetic("Compare/shaped", BenchmarkCompare, shaped, shaped);
+  RegisterSynthetic("Report/synthetic",
+                    [](benchmark::State& state, const Source& source1,
+                       const Source& source2) {
+                      BenchmarkReport(state, source1, source2,
+                                      reporting::OutputFormat::SMALL, 1);
+                    },
+                    original, changed);
+  RegisterSynthetic("ReportConcurrently/synthetic",
+                    [](benchmark::State& state, const Source& source1,
+                       const Source& source2) {
+                      BenchmarkReport(state, source1, source2,
+                                      reporting::OutputFormat::SMALL, 4);
+                    },
+                    original, changed);
+  auto* post_process = benchmark::RegisterBenchmark("PostProcess/synthetic",
+                                                    BenchmarkPostProcess);
+  post_process->Unit(benchmark::kMicrosecond);
+  for (const auto size : kSizes) {
+    post_process->Arg(size);
+  }
+}
+
+}  // namespace
+}  // namespace stg
+
+int main(int argc, char* argv[]) {
+  // Google Benchmark consumes its own --benchmark_* arguments.
+  benchmark::Initialize(&argc, argv);
+  std::filesystem::path opt_testdata = "testdata";
+  std::vector<const char*> opt_btf;
+  std::vector<const char*> opt_elf;
+  static option opts[] = {
+      {"testdata", required_argument, nullptr, 't'},
+      {"btf",      required_argument, nullptr, 'b'},
+      {"elf",      required_argument, nullptr, 'e'},
+      {nullptr,    0,                 nullptr, 0  },
+  };
+  auto usage = [&]() {
+    std::cerr << "usage: " << argv[0] << '\n'
+              << "  [--benchmark_...]\n"
+              << "  [-t|--testdata <directory>]\n"
+              << "  [-b|--btf <file>] ...\n"
+              << "  [-e|--elf <file>] ...\n"
+              << "implicit defaults: --testdata testdata\n";
+    return 1;
+  };
+  while (true) {
+    int ix;
+    const int c = getopt_long(argc, argv, "t:b:e:", opts, &ix);
+    if (c == -1) {
+      break;
+    }
+    const char* argument = optarg;
+    switch (c) {
+      case 't':
+        opt_testdata = argument;
+        break;
+      case 'b':
+        opt_btf.push_back(argument);
+        break;
+      case 'e':
+        opt_elf.push_back(argument);
+        break;
+      default:
+        return usage();
+    }
+  }
+  if (optind != argc) {
+    return usage();
+  }
+
+  try {
+    stg::RegisterCorpus(opt_testdata);
+    for (const std::string path : opt_btf) {
+      stg::RegisterBinary("btf::ReadFile/", path,
+                          [=](stg::Graph& graph, stg::Metrics&) {
+                            return stg::btf::ReadFile(graph, path,
+                                                      stg::ReadOptions());
+                          });
+    }
+    for (const std::string path : opt_elf) {
+      stg::RegisterBinary("elf::Read/", path,
+                          [=](stg::Graph& graph, stg::Metrics& metrics) {
+                            return stg::elf::Read(graph, path,
+                                                  stg::ReadOptions(), nullptr,
+                                                  metrics);
+                          });
+    }
+    stg::RegisterSynthetics();
+    stg::RegisterNames();
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+  } catch (const std::exception& e) {
+    std::cerr << e.what() << '\n';
+    return 1;
+  }
+}
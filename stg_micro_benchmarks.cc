@@ -0,0 +1,541 @@
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+// -*- mode: C++ -*-
+//
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License v2.0 with LLVM Exceptions (the
+// "License"); you may not use this file except in compliance with the
+// License.  You may obtain a copy of the License at
+//
+//     https://llvm.org/LICENSE.txt
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <memory>
+#include <new>
+#include <numeric>
+#include <optional>
+#include <random>
+#include <span>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+#include "equality.h"
+#include "equality_cache.h"
+#include "graph.h"
+#include "hashing.h"
+#include "metrics.h"
+#include "node_hashes.h"
+#include "order.h"
+#include "scc.h"
+#include "unification.h"
+
+// Every heap allocation is counted, so that benchmarks can report allocations
+// per operation alongside time per operation. The replacements are not inlined,
+// so that the compiler does not see new paired with free.
+namespace {
+std::atomic<size_t> allocations{0};
+}  // namespace
+
+[[gnu::noinline]] void* operator new(size_t size) {
+  allocations.fetch_add(1, std::memory_order_relaxed);
+  if (void* pointer = std::malloc(size == 0 ? 1 : size)) {
+    return pointer;
+  }
+  throw std::bad_alloc();
+}
+
+[[gnu::noinline]] void operator delete(void* pointer) noexcept {
+  std::free(pointer);
+}
+
+[[gnu::noinline]] void operator delete(void* pointer, size_t) noexcept {
+  std::free(pointer);
+}
+
+namespace stg {
+namespace {
+
+const std::vector<int64_t> kSizes = {1 << 10, 1 << 14, 1 << 18};
+
+// Counts the allocations made while timing. Each benchmark times ops
+// operations per iteration.
+class Operations {
+ public:
+  Operations(benchmark::State& state, size_t ops) : state_(state), ops_(ops) {}
+
+  ~Operations() {
+    const double total = static_cast<double>(state_.iterations() * ops_);
+    state_.SetItemsProcessed(state_.iterations() * ops_);
+    state_.counters["time/op"] = benchmark::Counter(
+        static_cast<double>(ops_),
+        benchmark::Counter::kIsIterationInvariantRate
+            | benchmark::Counter::kInvert);
+    state_.counters["allocs/op"] =
+        total == 0 ? 0 : static_cast<double>(allocations_) / total;
+  }
+
+  // Call at the start and end of each timed section.
+  void Start() {
+    start_ = allocations.load(std::memory_order_relaxed);
+  }
+
+  void Stop() {
+    allocations_ += allocations.load(std::memory_order_relaxed) - start_;
+  }
+
+ private:
+  benchmark::State& state_;
+  const size_t ops_;
+  size_t start_ = 0;
+  size_t allocations_ = 0;
+};
+
+// Nodes are [0, n), the vectors are the out-edges.
+using Edges = std::vector<std::vector<size_t>>;
+
+// A single SCC of all the nodes.
+Edges Ring(size_t n) {
+  Edges edges(n);
+  for (size_t i = 0; i < n; ++i) {
+    edges[i].push_back((i + 1) % n);
+  }
+  return edges;
+}
+
+// A path, each node being an SCC of its own.
+Edges Chain(size_t n) {
+  Edges edges(n);
+  for (size_t i = 0; i + 1 < n; ++i) {
+    edges[i].push_back(i + 1);
+  }
+  return edges;
+}
+
+// Random edges of high fan-out, mostly forming one large SCC.
+Edges Fan(size_t n) {
+  const size_t fan_out = 32;
+  std::mt19937_64 engine(n);
+  Edges edges(n);
+  for (auto& out : edges) {
+    for (size_t j = 0; j < fan_out; ++j) {
+      out.push_back(engine() % n);
+    }
+  }
+  return edges;
+}
+
+// Runs a depth-first search with an explicit stack over all the nodes,
+// returning the number of SCCs found.
+size_t FindSCCs(const Edges& edges, SCC<size_t>& scc, std::vector<bool>& done) {
+  struct Frame {
+    size_t node;
+    size_t handle;
+    size_t next;
+  };
+  std::vector<Frame> stack;
+  size_t count = 0;
+  auto open = [&](size_t node) {
+    if (!done[node]) {
+      if (const auto handle = scc.Open(node)) {
+        stack.push_back({node, *handle, 0});
+      }
+    }
+  };
+  for (size_t root = 0; root < edges.size(); ++root) {
+    open(root);
+    while (!stack.empty()) {
+      auto& frame = stack.back();
+      const auto& out = edges[frame.node];
+      if (frame.next < out.size()) {
+        open(out[frame.next++]);
+        continue;
+      }
+      const size_t handle = frame.handle;
+      stack.pop_back();
+      const auto nodes = scc.Close(handle);
+      for (const auto node : nodes) {
+        done[node] = true;
+      }
+      if (!nodes.empty()) {
+        ++count;
+      }
+    }
+  }
+  return count;
+}
+
+// Times SCC finding, with one finder reused across iterations, as Equals does.
+void BenchmarkSCC(benchmark::State& state, Edges (*shape)(size_t)) {
+  const auto edges = shape(state.range(0));
+  size_t edge_count = 0;
+  for (const auto& out : edges) {
+    edge_count += out.size();
+  }
+  SCC<size_t> scc;
+  std::vector<bool> done;
+  Operations operations(state, edges.size() + edge_count);
+  for (auto _ : state) {
+    state.PauseTiming();
+    done.assign(edges.size(), false);
+    state.ResumeTiming();
+    operations.Start();
+    benchmark::DoNotOptimize(FindSCCs(edges, scc, done));
+    operations.Stop();
+  }
+}
+
+// Random pairs of ids in [0, n). Pairs with the same residue modulo 7 are
+// taken to be equal.
+std::vector<Pair> RandomPairs(size_t n) {
+  std::mt19937_64 engine(n);
+  std::vector<Pair> pairs;
+  pairs.reserve(n);
+  for (size_t i = 0; i < n; ++i) {
+    pairs.emplace_back(Id(engine() % n), Id(engine() % n));
+  }
+  return pairs;
+}
+
+// Makes an empty equality cache covering ids [0, n).
+template <typename Cache>
+std::unique_ptr<Cache> MakeCache(size_t n, Metrics& metrics);
+
+template <>
+std::unique_ptr<EqualityCache> MakeCache(size_t, Metrics& metrics) {
+  static const NodeHashes kNoHashes;
+  return std::make_unique<EqualityCache>(kNoHashes, metrics);
+}
+
+template <>
+std::unique_ptr<DenseEqualityCache> MakeCache(size_t n, Metrics& metrics) {
+  return std::make_unique<DenseEqualityCache>(
+      NodeHashes(), Id(0), Id(n), metrics);
+}
+
+// Times a mix of queries, unions and disunions, as made by Equals.
+template <typename Cache>
+void BenchmarkEqualityCache(benchmark::State& state) {
+  const size_t n = state.range(0);
+  const auto pairs = RandomPairs(n);
+  Operations operations(state, n);
+  for (auto _ : state) {
+    state.PauseTiming();
+    Metrics metrics;
+    auto cache = MakeCache<Cache>(n, metrics);
+    state.ResumeTiming();
+    operations.Start();
+    for (const auto& pair : pairs) {
+      if (!cache->Query(pair)) {
+        const std::span<const Pair> comparisons(&pair, 1);
+        if (pair.first.ix_ % 7 == pair.second.ix_ % 7) {
+          cache->AllSame(comparisons);
+        } else {
+          cache->AllDifferent(comparisons);
+        }
+      }
+    }
+    operations.Stop();
+    state.PauseTiming();
+    cache.reset();
+    state.ResumeTiming();
+  }
+}
+
+// Times Unification::Find on random nodes, after unions that leave either one
+// long path (chain) or random trees (random). Unification rewrites the graph
+// when it is done, so each iteration has a fresh graph.
+void BenchmarkFind(benchmark::State& state, bool chain) {
+  const size_t n = state.range(0);
+  std::mt19937_64 engine(n);
+  std::vector<Pair> unions;
+  std::vector<Id> queries;
+  for (size_t i = 0; i + 1 < n; ++i) {
+    unions.emplace_back(Id(i), chain ? Id(i + 1) : Id(engine() % n));
+    queries.emplace_back(engine() % n);
+  }
+  Operations operations(state, queries.size());
+  for (auto _ : state) {
+    state.PauseTiming();
+    auto graph = std::make_unique<Graph>();
+    for (size_t i = 0; i < n; ++i) {
+      graph->Add<Primitive>("p" + std::to_string(i), std::nullopt, 0);
+    }
+    Metrics metrics;
+    auto unification = std::make_unique<Unification>(*graph, Id(0), metrics);
+    unification->Reserve(graph->Limit());
+    for (const auto& [id1, id2] : unions) {
+      unification->Union(id1, id2);
+    }
+    state.ResumeTiming();
+    operations.Start();
+    for (const auto id : queries) {
+      benchmark::DoNotOptimize(unification->Find(id));
+    }
+    operations.Stop();
+    state.PauseTiming();
+    unification.reset();
+    graph.reset();
+    state.ResumeTiming();
+  }
+}
+
+// Times many short unifications, as made by type resolution, each of a pair of
+// pointers to typedefs of a shared struct.
+void BenchmarkUnify(benchmark::State& state) {
+  const size_t n = state.range(0);
+  Operations operations(state, n);
+  for (auto _ : state) {
+    state.PauseTiming();
+    auto graph = std::make_unique<Graph>();
+    const Id int_type =
+        graph->Add<Primitive>("int", Primitive::Encoding::SIGNED_INTEGER, 4);
+    std::vector<Pair> pairs;
+    for (size_t i = 0; i < n; ++i) {
+      const auto name = "t" + std::to_string(i);
+      const Id member = graph->Add<Member>("x", int_type, 0, 0);
+      const Id shared = graph->Add<StructUnion>(
+          StructUnion::Kind::STRUCT, name, 4, std::vector<Id>{},
+          std::vector<Id>{}, std::vector<Id>{member});
+      const auto pointer = [&] {
+        return graph->Add<PointerReference>(
+            PointerReference::Kind::POINTER,
+            graph->Add<Typedef>(name, shared));
+      };
+      const Id first = pointer();
+      pairs.emplace_back(first, pointer());
+    }
+    Metrics metrics;
+    auto unification = std::make_unique<Unification>(*graph, Id(0), metrics);
+    unification->Reserve(graph->Limit());
+    state.ResumeTiming();
+    operations.Start();
+    for (const auto& [id1, id2] : pairs) {
+      benchmark::DoNotOptimize(unification->Unify(id1, id2));
+    }
+    operations.Stop();
+    state.PauseTiming();
+    unification.reset();
+    graph.reset();
+    state.ResumeTiming();
+  }
+}
+
+// Graph shapes for Equals, each added twice and returning the two roots.
+
+// struct node_i { struct node_i+1* next; }, ending in a struct with an int
+Id BuildChain(Graph& graph, size_t length) {
+  Id next = graph.Add<Primitive>("int", Primitive::Encoding::SIGNED_INTEGER, 4);
+  for (size_t i = length; i > 0; --i) {
+    const Id pointer =
+        graph.Add<PointerReference>(PointerReference::Kind::POINTER, next);
+    const Id member = graph.Add<Member>("next", pointer, 0, 0);
+    next = graph.Add<StructUnion>(
+        StructUnion::Kind::STRUCT, "node_" + std::to_string(i), 8,
+        std::vector<Id>{}, std::vector<Id>{}, std::vector<Id>{member});
+  }
+  return next;
+}
+
+// the same, but with the last struct pointing back to the first
+Id BuildRing(Graph& graph, size_t length) {
+  const Id first = graph.Allocate();
+  Id next = first;
+  for (size_t i = length; i > 1; --i) {
+    const Id pointer =
+        graph.Add<PointerReference>(PointerReference::Kind::POINTER, next);
+    const Id member = graph.Add<Member>("next", pointer, 0, 0);
+    next = graph.Add<StructUnion>(
+        StructUnion::Kind::STRUCT, "node_" + std::to_string(i), 8,
+        std::vector<Id>{}, std::vector<Id>{}, std::vector<Id>{member});
+  }
+  const Id pointer =
+      graph.Add<PointerReference>(PointerReference::Kind::POINTER, next);
+  const Id member = graph.Add<Member>("next", pointer, 0, 0);
+  graph.Set<StructUnion>(first, StructUnion::Kind::STRUCT, "node_1", 8,
+                         std::vector<Id>{}, std::vector<Id>{},
+                         std::vector<Id>{member});
+  return first;
+}
+
+// one struct with a member pointing to each of width leaf structs
+Id BuildFan(Graph& graph, size_t width) {
+  const Id int_type =
+      graph.Add<Primitive>("int", Primitive::Encoding::SIGNED_INTEGER, 4);
+  std::vector<Id> members;
+  members.reserve(width);
+  for (size_t i = 0; i < width; ++i) {
+    const Id value = graph.Add<Member>("value", int_type, 0, 0);
+    const Id leaf = graph.Add<StructUnion>(
+        StructUnion::Kind::STRUCT, "leaf_" + std::to_string(i), 4,
+        std::vector<Id>{}, std::vector<Id>{}, std::vector<Id>{value});
+    const Id pointer =
+        graph.Add<PointerReference>(PointerReference::Kind::POINTER, leaf);
+    members.push_back(
+        graph.Add<Member>("member_" + std::to_string(i), pointer, 64 * i, 0));
+  }
+  return graph.Add<StructUnion>(StructUnion::Kind::STRUCT, "root", 8 * width,
+                                std::vector<Id>{}, std::vector<Id>{}, members);
+}
+
+// A binary tree of length structs, each with members pointing to its children,
+// whose ids and storage are both in random order, as after reading a large
+// input, rather than in the order a traversal visits them.
+Id BuildScattered(Graph& graph, size_t length) {
+  const Id int_type =
+      graph.Add<Primitive>("int", Primitive::Encoding::SIGNED_INTEGER, 4);
+  const Id first = graph.Allocate(length);
+  std::vector<size_t> order(length);
+  std::iota(order.begin(), order.end(), 0);
+  std::shuffle(order.begin(), order.end(), std::mt19937_64(length));
+  const auto node = [&](size_t i) { return Id(first.ix_ + order[i]); };
+  std::vector<size_t> storage = order;
+  std::shuffle(storage.begin(), storage.end(), std::mt19937_64(length + 1));
+  for (const size_t i : storage) {
+    std::vector<Id> members;
+    for (const size_t child : {2 * i + 1, 2 * i + 2}) {
+      const Id pointer = graph.Add<PointerReference>(
+          PointerReference::Kind::POINTER,
+          child < length ? node(child) : int_type);
+      members.push_back(graph.Add<Member>("child", pointer, 0, 0));
+    }
+    graph.Set<StructUnion>(node(i), StructUnion::Kind::STRUCT,
+                           "node_" + std::to_string(i), 16, std::vector<Id>{},
+                           std::vector<Id>{}, members);
+  }
+  return node(0);
+}
+
+// Times equality of two copies of a shape, with a fresh cache each time.
+template <typename Cache>
+void BenchmarkEquals(benchmark::State& state, Id (*shape)(Graph&, size_t)) {
+  Graph graph;
+  const Id root1 = shape(graph, state.range(0));
+  const Id root2 = shape(graph, state.range(0));
+  Operations operations(state, graph.Limit().ix_ / 2);
+  for (auto _ : state) {
+    state.PauseTiming();
+    Metrics metrics;
+    auto cache = MakeCache<Cache>(graph.Limit().ix_, metrics);
+    {
+      Equals<Cache> equals(graph, *cache);
+      state.ResumeTiming();
+      operations.Start();
+      if (!equals(root1, root2)) {
+        state.SkipWithError("copies differ");
+      }
+      operations.Stop();
+      state.PauseTiming();
+    }
+    cache.reset();
+    state.ResumeTiming();
+  }
+}
+
+// Matched members of two versions of a struct with n members, in matching key
+// order, as made by PairUp. The second version drops every 8th member, adds a
+// new member after every 8th and swaps some neighbouring members.
+std::vector<std::pair<std::optional<size_t>, std::optional<size_t>>>
+MatchedMembers(size_t n) {
+  std::vector<size_t> members2;
+  members2.reserve(n + n / 8);
+  for (size_t i = 0; i < n; ++i) {
+    if (i % 8 == 3) {
+      continue;
+    }
+    members2.push_back(i);
+    if (i % 8 == 5) {
+      members2.push_back(n + i);
+    }
+  }
+  for (size_t i = 16; i < members2.size(); i += 16) {
+    std::swap(members2[i - 1], members2[i]);
+  }
+  // the key of each member is its number
+  std::vector<std::optional<size_t>> positions2(n + n);
+  for (size_t position = 0; position < members2.size(); ++position) {
+    positions2[members2[position]] = {position};
+  }
+  std::vector<std::pair<std::optional<size_t>, std::optional<size_t>>> pairs;
+  pairs.reserve(n + n / 8);
+  for (size_t key = 0; key < n + n; ++key) {
+    if (key < n || positions2[key]) {
+      pairs.emplace_back(key < n ? std::make_optional(key) : std::nullopt,
+                         positions2[key]);
+    }
+  }
+  std::shuffle(pairs.begin(), pairs.end(), std::mt19937_64(n));
+  return pairs;
+}
+
+// Times the reordering of matched struct members.
+void BenchmarkReorder(benchmark::State& state) {
+  const auto pairs = MatchedMembers(state.range(0));
+  Operations operations(state, pairs.size());
+  for (auto _ : state) {
+    state.PauseTiming();
+    auto copy = pairs;
+    state.ResumeTiming();
+    operations.Start();
+    Reorder(copy);
+    operations.Stop();
+    benchmark::DoNotOptimize(copy.data());
+  }
+}
+
+template <typename Function, typename... Args>
+void Register(const std::string& name, Function function, Args&&... args) {
+  auto* benchmark = benchmark::RegisterBenchmark(
+      name.c_str(), function, std::forward<Args>(args)...);
+  benchmark->Unit(benchmark::kMicrosecond);
+  for (const auto size : kSizes) {
+    benchmark->Arg(size);
+  }
+}
+
+void RegisterAll() {
+  Register("SCC/ring", BenchmarkSCC, Ring);
+  Register("SCC/chain", BenchmarkSCC, Chain);
+  Register("SCC/fan", BenchmarkSCC, Fan);
+  Register("EqualityCache/sparse", BenchmarkEqualityCache<EqualityCache>);
+  Register("EqualityCache/dense", BenchmarkEqualityCache<DenseEqualityCache>);
+  Register("Unification::Find/chain", BenchmarkFind, true);
+  Register("Unification::Find/random", BenchmarkFind, false);
+  Register("Unification::Unify/short", BenchmarkUnify);
+  Register("Reorder/members", BenchmarkReorder);
+  const std::vector<std::pair<std::string, Id (*)(Graph&, size_t)>> shapes = {
+      {"chain", BuildChain}, {"ring", BuildRing}, {"fan", BuildFan},
+      {"scattered", BuildScattered}};
+  for (const auto& [name, shape] : shapes) {
+    Register("Equals/sparse/" + name, BenchmarkEquals<EqualityCache>, shape);
+    Register("Equals/dense/" + name, BenchmarkEquals<DenseEqualityCache>,
+             shape);
+  }
+}
+
+}  // namespace
+}  // namespace stg
+
+int main(int argc, char* argv[]) {
+  // Google Benchmark consumes its own --benchmark_* arguments.
+  benchmark::Initialize(&argc, argv);
+  if (benchmark::ReportUnrecognizedArguments(argc, argv)) {
+    return 1;
+  }
+  stg::RegisterAll();
+  benchmark::RunSpecifiedBenchmarks();
+  benchmark::Shutdown();
+  return 0;
+}
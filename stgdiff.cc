@@ -20,129 +20,275 @@
 // Author: Siddharth Nayyar
 
 #include <getopt.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 
+#include <charconv>
+#include <array>
+#include <cerrno>
+#include <chrono>
 #include <cstddef>
 #include <cstring>
-#include <fstream>
 #include <iostream>
+#include <map>
+#include <memory>
 #include <optional>
 #include <ostream>
-#include <unordered_set>
+#include <sstream>
+#include <string>
+#include <string_view>
 #include <utility>
 #include <vector>
 
+#include "async_output.h"
 #include "equality.h"
+#include "equality_cache.h"
 #include "error.h"
 #include "fidelity.h"
+#include "file_descriptor.h"
+#include "filter.h"
+#include "fingerprint.h"
 #include "graph.h"
 #include "input.h"
 #include "metrics.h"
+#include "node_hashes.h"
+#include "pipeline.h"
 #include "reader_options.h"
 #include "reporting.h"
+#include "trace.h"
 
 namespace {
 
 const int kAbiChange = 4;
 const int kFidelityChange = 8;
-const size_t kMaxCrcOnlyChanges = 3;
+const int kIncomplete = 16;
 
 using Inputs = std::vector<std::pair<stg::InputFormat, const char*>>;
 using Outputs =
     std::vector<std::pair<stg::reporting::OutputFormat, const char*>>;
 
-std::vector<stg::Id> Read(const Inputs& inputs, stg::Graph& graph,
-                          stg::ReadOptions options, stg::Metrics& metrics) {
-  std::vector<stg::Id> roots;
-  for (const auto& [format, filename] : inputs) {
-    roots.push_back(stg::Read(graph, format, filename, options, nullptr,
-                              metrics));
-  }
-  return roots;
-}
-
-int RunFidelity(const char* filename, const stg::Graph& graph,
-                const std::vector<stg::Id>& roots) {
-  std::ofstream output(filename);
-  const auto fidelity_diff =
-      stg::GetFidelityTransitions(graph, roots[0], roots[1]);
+int RunFidelity(const char* filename, const stg::FidelityDiff& fidelity_diff) {
+  stg::AsyncOutput output(filename);
   const bool diffs_reported =
       stg::reporting::FidelityDiff(fidelity_diff, output);
-  output << std::flush;
-  if (!output) {
-    stg::Die() << "error writing to " << '\'' << filename << '\'';
-  }
+  output.Close();
   return diffs_reported ? kFidelityChange : 0;
 }
 
 int RunExact(const Inputs& inputs, stg::ReadOptions options,
              stg::Metrics& metrics) {
   stg::Graph graph;
-  const auto roots = Read(inputs, graph, options, metrics);
+  const auto roots = stg::Read(graph, inputs, options, nullptr, metrics);
 
-  struct PairCache {
-    std::optional<bool> Query(const stg::Pair& comparison) const {
-      return equalities.find(comparison) != equalities.end()
-          ? std::make_optional(true)
-          : std::nullopt;
-    }
-    void AllSame(const std::vector<stg::Pair>& comparisons) {
-      for (const auto& comparison : comparisons) {
-        equalities.insert(comparison);
-      }
-    }
-    void AllDifferent(const std::vector<stg::Pair>&) {}
-    std::unordered_set<stg::Pair> equalities;
-  };
+  // Fingerprints let the cache reject most unequal pairs without traversal.
+  stg::NodeHashes hashes;
+  {
+    stg::Time x(metrics, "fingerprint");
+    stg::Fingerprint(graph, roots, metrics, options.jobs, hashes);
+  }
 
   stg::Time compute(metrics, "equality check");
-  PairCache equalities;
-  return stg::Equals<PairCache>(graph, equalities)(roots[0], roots[1])
-             ? 0
-             : kAbiChange;
+  stg::EqualityCache cache(hashes, metrics);
+  stg::Equals<stg::EqualityCache> equals(graph, cache);
+  for (size_t ix = 1; ix < roots.size(); ++ix) {
+    if (!equals(roots[0], roots[ix])) {
+      return kAbiChange;
+    }
+  }
+  return 0;
+}
+
+// With more than one candidate, output file names (other than the standard
+// output) are suffixed with the candidate number, counting from 1.
+std::string OutputName(const char* filename, size_t candidate,
+                       size_t candidates) {
+  std::string name(filename);
+  if (candidates > 1 && name != "/dev/stdout") {
+    name += '.';
+    name += std::to_string(candidate);
+  }
+  return name;
 }
 
 int Run(const Inputs& inputs, const Outputs& outputs, stg::Ignore ignore,
-        stg::ReadOptions options, std::optional<const char*> fidelity,
+        stg::ReadOptions options, const stg::Filter* symbol_filter,
+        bool fail_fast, std::optional<const char*> cache_directory,
+        stg::DiffDeduplication deduplication, size_t max_viz_bytes,
+        size_t max_diff_bytes,
+        std::optional<std::chrono::steady_clock::time_point> deadline,
+        bool count_only, std::optional<const char*> fidelity,
         stg::Metrics& metrics) {
-  // Read inputs.
-  stg::Graph graph;
-  const auto roots = Read(inputs, graph, options, metrics);
+  // The first input is the baseline and is compared with each of the others.
+  // With more than one job, the first candidate is read concurrently with the
+  // baseline, each into its own graph.
+  std::vector<stg::SeparateInput> first;
+  if (options.jobs > 1) {
+    first = stg::ReadSeparately({inputs[0], inputs[1]}, options, nullptr);
+  }
+  const auto& [baseline_format, baseline_filename] = inputs[0];
+  stg::Differ differ =
+      first.empty()
+          ? stg::Differ(baseline_format, baseline_filename, ignore, options,
+                        symbol_filter, fail_fast, cache_directory,
+                        deduplication, max_viz_bytes, max_diff_bytes,
+                        metrics)
+          : stg::Differ(std::move(first[0]), ignore, options, symbol_filter,
+                        fail_fast, cache_directory, deduplication,
+                        max_viz_bytes, max_diff_bytes, metrics);
+  if (deadline) {
+    differ.SetDeadline(*deadline);
+  }
+  if (count_only) {
+    differ.SetCountOnly();
+  }
+  const size_t candidates = inputs.size() - 1;
+  int status = 0;
+  for (size_t candidate = 1; candidate <= candidates; ++candidate) {
+    const auto& [format, filename] = inputs[candidate];
+    // Reports are written out while the rest are produced. Reports to the
+    // same file, such as the standard output, share its stream, so that they
+    // are written in order.
+    std::vector<std::unique_ptr<stg::AsyncOutput>> files;
+    std::map<std::string, stg::AsyncOutput*> streams;
+    stg::Reports reports;
+    for (size_t ix = 0; ix < outputs.size(); ++ix) {
+      const auto name = OutputName(outputs[ix].second, candidate, candidates);
+      auto& stream = streams[name];
+      if (stream == nullptr) {
+        stream = files.emplace_back(std::make_unique<stg::AsyncOutput>(name))
+                     .get();
+      }
+      reports.emplace_back(outputs[ix].first, stream);
+    }
+    std::optional<stg::FidelityDiff> fidelity_diff;
+    auto* fidelity_output = fidelity ? &fidelity_diff : nullptr;
+    const bool differs =
+        candidate == 1 && !first.empty()
+            ? differ.Diff(std::move(first[1]), reports, fidelity_output,
+                          metrics)
+            : differ.Diff(format, filename, reports, fidelity_output, metrics);
+    if (differs) {
+      status |= kAbiChange;
+    }
+    if (const auto& skipped = differ.Skipped(); !skipped.empty()) {
+      std::cerr << "deadline reached comparing " << filename << ": "
+                << differ.Completed() << " symbols and types compared, "
+                << skipped.size() << " skipped:\n";
+      for (const auto& name : skipped) {
+        std::cerr << "  " << name << '\n';
+      }
+      status |= kIncomplete;
+    }
 
-  // Compute differences.
-  stg::Compare compare{graph, ignore, metrics};
-  std::pair<bool, std::optional<stg::Comparison>> result;
-  {
-    stg::Time compute(metrics, "compute diffs");
-    result = compare(roots[0], roots[1]);
+    // Finish writing reports.
+    for (auto& file : files) {
+      file->Close();
+    }
+
+    // Write fidelity diff if requested.
+    if (fidelity) {
+      const auto name = OutputName(*fidelity, candidate, candidates);
+      status |= RunFidelity(name.c_str(), *fidelity_diff);
+    }
   }
-  stg::Check(compare.scc.Empty()) << "internal error: SCC state broken";
-  const auto& [equals, comparison] = result;
-  int status = equals ? 0 : kAbiChange;
+  differ.WriteCache(metrics);
+  return status;
+}
 
-  // Write reports.
-  stg::NameCache names;
-  for (const auto& [format, filename] : outputs) {
-    std::ofstream output(filename);
-    if (comparison) {
-      stg::Time report(metrics, "report diffs");
-      stg::reporting::Options options{format, kMaxCrcOnlyChanges};
-      stg::reporting::Reporting reporting{graph, compare.outcomes, options,
-        names};
-      Report(reporting, *comparison, output);
-      output << std::flush;
+// Reads a request line, without its terminating newline.
+std::string ReadRequest(int fd) {
+  constexpr size_t kMaxRequest = 1 << 16;
+  std::string request;
+  std::array<char, 4096> buffer;
+  while (request.size() <= kMaxRequest) {
+    const ssize_t count = recv(fd, buffer.data(), buffer.size(), 0);
+    if (count < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      stg::Die() << "error reading request: " << stg::Error(errno);
     }
-    if (!output) {
-      stg::Die() << "error writing to " << '\'' << filename << '\'';
+    request.append(buffer.data(), count);
+    if (const auto end = request.find('\n'); end != std::string::npos) {
+      request.resize(end);
+      return request;
+    }
+    if (count == 0) {
+      return request;
     }
   }
+  stg::Die() << "request too long";
+}
 
-  // Compute fidelity diff if requested.
-  if (fidelity) {
-    const stg::Time report(metrics, "fidelity");
-    status |= RunFidelity(*fidelity, graph, roots);
+void WriteResponse(int fd, std::string_view response) {
+  while (!response.empty()) {
+    const ssize_t count =
+        send(fd, response.data(), response.size(), MSG_NOSIGNAL);
+    if (count < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      stg::Die() << "error writing response: " << stg::Error(errno);
+    }
+    response.remove_prefix(count);
   }
+}
 
-  return status;
+// Compares candidates with the resident baseline on request, forever. Clients
+// connect to a Unix domain socket and send a line naming a candidate file. The
+// response is a line with the exit status stgdiff would have had, followed by
+// the report or an error message.
+int Serve(const char* path, stg::Differ& differ, stg::InputFormat format,
+          stg::reporting::OutputFormat output_format,
+          std::optional<stg::MetricsFormat> metrics_format) {
+  sockaddr_un address{};
+  address.sun_family = AF_UNIX;
+  stg::Check(strlen(path) < sizeof(address.sun_path))
+      << "socket path too long: " << path;
+  strcpy(address.sun_path, path);
+  const int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  stg::Check(fd >= 0) << "socket failed: " << stg::Error(errno);
+  const stg::FileDescriptor listener(fd);
+  stg::Check(bind(listener.Value(), reinterpret_cast<sockaddr*>(&address),
+                  sizeof(address)) == 0)
+      << "bind failed: '" << path << "': " << stg::Error(errno);
+  stg::Check(listen(listener.Value(), SOMAXCONN) == 0)
+      << "listen failed: " << stg::Error(errno);
+  // Requests are handled one at a time, as they share the graph.
+  while (true) {
+    const int client = accept4(listener.Value(), nullptr, nullptr,
+                               SOCK_CLOEXEC);
+    if (client < 0) {
+      stg::Check(errno == EINTR || errno == ECONNABORTED)
+          << "accept failed: " << stg::Error(errno);
+      continue;
+    }
+    const stg::FileDescriptor connection(client);
+    int status = 0;
+    std::ostringstream report;
+    try {
+      const auto candidate = ReadRequest(connection.Value());
+      stg::Metrics metrics;
+      if (differ.Diff(format, candidate.c_str(), {{output_format, &report}},
+                      nullptr, metrics)) {
+        status |= kAbiChange;
+      }
+      differ.WriteCache(metrics);
+      if (metrics_format) {
+        stg::Report(metrics, std::cerr, *metrics_format);
+      }
+    } catch (const stg::Exception& e) {
+      status = 1;
+      report.str({});
+      report << e.what() << '\n';
+    }
+    try {
+      WriteResponse(connection.Value(),
+                    std::to_string(status) + '\n' + report.str());
+    } catch (const stg::Exception& e) {
+      stg::Warn() << e.what();
+    }
+  }
 }
 
 }  // namespace
@@ -150,12 +296,36 @@ int Run(const Inputs& inputs, const Outputs& outputs, stg::Ignore ignore,
 int main(int argc, char* argv[]) {
   enum LongOptions {
     kSkipDwarf = 256,
+    kLazyDwarf,
+    kCache,
+    kFailFast,
+    kDedup,
+    kDedupJointly,
+    kServe,
+    kMaxVizSize,
+    kMaxDiffSize,
+    kDeadline,
+    kStats,
+    kMetricsFormat,
+    kTrace,
+    kStored,
   };
   // Process arguments.
   bool opt_metrics = false;
+  stg::MetricsFormat opt_metrics_format = stg::MetricsFormat::TEXT;
+  std::optional<const char*> opt_trace;
   bool opt_exact = false;
+  bool opt_fail_fast = false;
+  stg::DiffDeduplication opt_deduplication = stg::DiffDeduplication::NONE;
+  size_t opt_max_viz_bytes = 0;
+  size_t opt_max_diff_bytes = 0;
+  std::optional<std::chrono::steady_clock::time_point> opt_deadline;
+  bool opt_stats = false;
   stg::ReadOptions opt_read_options;
+  std::unique_ptr<stg::Filter> opt_symbol_filter;
+  std::optional<const char*> opt_cache = std::nullopt;
   std::optional<const char*> opt_fidelity = std::nullopt;
+  std::optional<const char*> opt_serve = std::nullopt;
   stg::Ignore opt_ignore;
   stg::InputFormat opt_input_format = stg::InputFormat::ABI;
   stg::reporting::OutputFormat opt_output_format =
@@ -163,47 +333,98 @@ int main(int argc, char* argv[]) {
   Inputs inputs;
   Outputs outputs;
   static option opts[] = {
-      {"metrics",        no_argument,       nullptr, 'm'       },
-      {"abi",            no_argument,       nullptr, 'a'       },
-      {"btf",            no_argument,       nullptr, 'b'       },
-      {"elf",            no_argument,       nullptr, 'e'       },
-      {"stg",            no_argument,       nullptr, 's'       },
-      {"exact",          no_argument,       nullptr, 'x'       },
-      {"types",          no_argument,       nullptr, 't'       },
-      {"ignore",         required_argument, nullptr, 'i'       },
-      {"format",         required_argument, nullptr, 'f'       },
-      {"output",         required_argument, nullptr, 'o'       },
-      {"fidelity",       required_argument, nullptr, 'F'       },
-      {"skip-dwarf",     no_argument,       nullptr, kSkipDwarf},
-      {nullptr,          0,                 nullptr, 0         },
+      {"metrics",        optional_argument, nullptr, 'm'           },
+      {"metrics-format", required_argument, nullptr, kMetricsFormat},
+      {"trace",          required_argument, nullptr, kTrace        },
+      {"abi",            no_argument,       nullptr, 'a'           },
+      {"btf",            no_argument,       nullptr, 'b'           },
+      {"elf",            no_argument,       nullptr, 'e'           },
+      {"stg",            no_argument,       nullptr, 's'           },
+      {"stored",         no_argument,       nullptr, kStored       },
+      {"exact",          no_argument,       nullptr, 'x'           },
+      {"types",          no_argument,       nullptr, 't'           },
+      {"symbols",        required_argument, nullptr, 'S'           },
+      {"symbol-filter",  required_argument, nullptr, 'S'           },
+      {"ignore",         required_argument, nullptr, 'i'           },
+      {"format",         required_argument, nullptr, 'f'           },
+      {"output",         required_argument, nullptr, 'o'           },
+      {"fidelity",       required_argument, nullptr, 'F'           },
+      {"jobs",           required_argument, nullptr, 'j'           },
+      {"skip-dwarf",     no_argument,       nullptr, kSkipDwarf    },
+      {"lazy-dwarf",     no_argument,       nullptr, kLazyDwarf    },
+      {"cache",          required_argument, nullptr, kCache        },
+      {"fail-fast",      no_argument,       nullptr, kFailFast     },
+      {"dedup",          no_argument,       nullptr, kDedup        },
+      {"dedup-jointly",  no_argument,       nullptr, kDedupJointly },
+      {"serve",          required_argument, nullptr, kServe        },
+      {"max-viz-size",   required_argument, nullptr, kMaxVizSize   },
+      {"max-diff-size",  required_argument, nullptr, kMaxDiffSize  },
+      {"deadline",       required_argument, nullptr, kDeadline     },
+      {"stats",          no_argument,       nullptr, kStats        },
+      {nullptr,          0,                 nullptr, 0             },
   };
   auto usage = [&]() {
     std::cerr << "usage: " << argv[0] << '\n'
-              << "  [-m|--metrics]\n"
-              << "  [-a|--abi|-b|--btf|-e|--elf|-s|--stg] file1\n"
-              << "  [-a|--abi|-b|--btf|-e|--elf|-s|--stg] file2\n"
+              << "  [-m|--metrics[=hw]]\n"
+              << "  [--metrics-format {text|json}]\n"
+              << "  [--trace <file>]\n"
+              << "  [-a|--abi|-b|--btf|-e|--elf|-s|--stg|--stored] file1\n"
+              << "  [-a|--abi|-b|--btf|-e|--elf|-s|--stg|--stored] file2 ...\n"
               << "  [-x|--exact]\n"
               << "  [-t|--types]\n"
+              << "  [-S|--symbols|--symbol-filter <filter>]\n"
+              << "  [-j|--jobs <jobs>]\n"
               << "  [--skip-dwarf]\n"
+              << "  [--lazy-dwarf]\n"
+              << "  [--cache <directory>]\n"
+              << "  [--fail-fast]\n"
+              << "  [--dedup|--dedup-jointly]\n"
               << "  [{-i|--ignore} <ignore-option>] ...\n"
               << "  [{-f|--format} <output-format>] ...\n"
               << "  [{-o|--output} {filename|-}] ...\n"
               << "  [{-F|--fidelity} {filename|-}]\n"
+              << "  [--max-viz-size <bytes>]\n"
+              << "  [--max-diff-size <bytes>]\n"
+              << "  [--deadline <seconds>]\n"
+              << "  [--stats]\n"
+              << "  [--serve <socket>]\n"
               << "implicit defaults: --abi --format plain\n"
+              << "file1 is compared with each of the other files in turn\n"
+              << "--stored files are type store manifests,"
+              << " <directory>/snapshots/<name>\n"
+              << "--serve compares file1 with files named by clients\n"
+              << "--serve cannot be combined with other files, --exact,\n"
+              << "  --output or --fidelity\n"
               << "--exact (node equality) cannot be combined with --output\n"
+              << "--exact (node equality) cannot be combined with --symbols\n"
+              << "--exact (node equality) cannot be combined with --fail-fast\n"
+              << "--exact (node equality) cannot be combined with --dedup\n"
+              << "--deadline cannot be combined with --serve, --exact or\n"
+              << "  --fail-fast\n"
+              << "--stats writes JSON change counts to each output (default\n"
+              << "  standard output), whatever its format, and cannot be\n"
+              << "  combined with --serve or --exact\n"
               << stg::reporting::OutputFormatUsage()
               << stg::IgnoreUsage();
+    stg::FilterUsage(std::cerr);
     return 1;
   };
   while (true) {
     int ix;
-    const int c = getopt_long(argc, argv, "-mabesxti:f:o:F:", opts, &ix);
+    const int c = getopt_long(argc, argv, "-mabesxtS:i:f:o:F:j:", opts, &ix);
     if (c == -1) {
       break;
     }
     const char* argument = optarg;
     switch (c) {
       case 'm':
+        if (argument != nullptr) {
+          if (strcmp(argument, "hw") != 0) {
+            std::cerr << "unknown metrics option: " << argument << '\n';
+            return usage();
+          }
+          stg::EnableHardwareCounters();
+        }
         opt_metrics = true;
         break;
       case 'a':
@@ -218,12 +439,18 @@ int main(int argc, char* argv[]) {
       case 's':
         opt_input_format = stg::InputFormat::STG;
         break;
+      case kStored:
+        opt_input_format = stg::InputFormat::STORED;
+        break;
       case 'x':
         opt_exact = true;
         break;
       case 't':
         opt_read_options.Set(stg::ReadOptions::TYPE_ROOTS);
         break;
+      case 'S':
+        opt_symbol_filter = stg::MakeFilter(argument);
+        break;
       case 1:
         inputs.emplace_back(opt_input_format, argument);
         break;
@@ -257,24 +484,145 @@ int main(int argc, char* argv[]) {
         }
         opt_fidelity.emplace(argument);
         break;
+      case 'j': {
+        const auto end = argument + strlen(argument);
+        const auto [ptr, ec] =
+            std::from_chars(argument, end, opt_read_options.jobs);
+        if (ec != std::errc() || ptr != end || opt_read_options.jobs == 0) {
+          std::cerr << "invalid number of jobs: " << argument << '\n';
+          return usage();
+        }
+        break;
+      }
       case kSkipDwarf:
         opt_read_options.Set(stg::ReadOptions::SKIP_DWARF);
         break;
+      case kLazyDwarf:
+        opt_read_options.Set(stg::ReadOptions::LAZY_DWARF);
+        break;
+      case kCache:
+        opt_cache.emplace(argument);
+        break;
+      case kFailFast:
+        opt_fail_fast = true;
+        break;
+      case kDedup:
+        opt_deduplication = stg::DiffDeduplication::SEPARATELY;
+        break;
+      case kDedupJointly:
+        opt_deduplication = stg::DiffDeduplication::JOINTLY;
+        break;
+      case kServe:
+        opt_serve.emplace(argument);
+        break;
+      case kMaxVizSize: {
+        const auto end = argument + strlen(argument);
+        const auto [ptr, ec] =
+            std::from_chars(argument, end, opt_max_viz_bytes);
+        if (ec != std::errc() || ptr != end) {
+          std::cerr << "invalid VIZ size limit: " << argument << '\n';
+          return usage();
+        }
+        break;
+      }
+      case kDeadline: {
+        double seconds;
+        const auto end = argument + strlen(argument);
+        const auto [ptr, ec] = std::from_chars(argument, end, seconds);
+        if (ec != std::errc() || ptr != end || seconds < 0) {
+          std::cerr << "invalid deadline: " << argument << '\n';
+          return usage();
+        }
+        opt_deadline = std::chrono::steady_clock::now()
+                       + std::chrono::duration_cast<
+                           std::chrono::steady_clock::duration>(
+                           std::chrono::duration<double>(seconds));
+        break;
+      }
+      case kStats:
+        opt_stats = true;
+        break;
+      case kMaxDiffSize: {
+        const auto end = argument + strlen(argument);
+        const auto [ptr, ec] =
+            std::from_chars(argument, end, opt_max_diff_bytes);
+        if (ec != std::errc() || ptr != end) {
+          std::cerr << "invalid diff memory budget: " << argument << '\n';
+          return usage();
+        }
+        break;
+      }
+      case kTrace:
+        opt_trace = argument;
+        break;
+      case kMetricsFormat:
+        if (const auto format = stg::ParseMetricsFormat(argument)) {
+          opt_metrics = true;
+          opt_metrics_format = format.value();
+        } else {
+          std::cerr << "unknown metrics format: " << argument << '\n';
+          return usage();
+        }
+        break;
       default:
         return usage();
     }
   }
-  if (inputs.size() != 2 || opt_exact > outputs.empty()) {
+  if (opt_serve) {
+    if (inputs.size() != 1 || opt_exact || !outputs.empty() || opt_fidelity) {
+      return usage();
+    }
+  } else if (inputs.size() < 2 || opt_exact > outputs.empty()
+             || (opt_exact
+                 && (opt_symbol_filter || opt_fail_fast
+                     || opt_deduplication != stg::DiffDeduplication::NONE))) {
+    return usage();
+  }
+  if (opt_deadline && (opt_serve || opt_exact || opt_fail_fast)) {
     return usage();
   }
+  if (opt_stats) {
+    if (opt_serve || opt_exact) {
+      return usage();
+    }
+    if (outputs.empty()) {
+      outputs.emplace_back(opt_output_format, "/dev/stdout");
+    }
+  }
+
+  if (opt_trace) {
+    stg::trace::Enable();
+  }
 
   try {
     stg::Metrics metrics;
+    if (opt_serve) {
+      // Candidates are read in the last input format given.
+      const auto& [baseline_format, baseline_filename] = inputs[0];
+      stg::Differ differ(baseline_format, baseline_filename, opt_ignore,
+                    opt_read_options, opt_symbol_filter.get(), opt_fail_fast,
+                    opt_cache, opt_deduplication, opt_max_viz_bytes,
+                    opt_max_diff_bytes, metrics);
+      if (opt_metrics) {
+        stg::Report(metrics, std::cerr, opt_metrics_format);
+      }
+      return Serve(*opt_serve, differ, opt_input_format, opt_output_format,
+                   opt_metrics ? std::make_optional(opt_metrics_format)
+                               : std::nullopt);
+    }
     const int status = opt_exact ? RunExact(inputs, opt_read_options, metrics)
                                  : Run(inputs, outputs, opt_ignore,
-                                       opt_read_options, opt_fidelity, metrics);
+                                       opt_read_options,
+                                       opt_symbol_filter.get(), opt_fail_fast,
+                                       opt_cache, opt_deduplication,
+                                       opt_max_viz_bytes, opt_max_diff_bytes,
+                                       opt_deadline, opt_stats, opt_fidelity,
+                                       metrics);
+    if (opt_trace) {
+      stg::trace::Write(*opt_trace);
+    }
     if (opt_metrics) {
-      stg::Report(metrics, std::cerr);
+      stg::Report(metrics, std::cerr, opt_metrics_format);
     }
     return status;
   } catch (const stg::Exception& e) {
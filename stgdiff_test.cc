@@ -17,18 +17,28 @@
 //
 // Author: Siddharth Nayyar
 
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
 #include <filesystem>
 #include <fstream>
 #include <iostream>
 #include <ostream>
 #include <sstream>
 #include <string>
+#include <variant>
+#include <vector>
 
 #include <catch2/catch.hpp>
 #include "comparison.h"
+#include "error.h"
+#include "filter.h"
+#include "fingerprint.h"
 #include "graph.h"
 #include "input.h"
 #include "metrics.h"
+#include "naming.h"
+#include "node_hashes.h"
 #include "reader_options.h"
 #include "reporting.h"
 
@@ -184,6 +194,24 @@ TEST_CASE("ignore") {
            stg::Ignore(stg::Ignore::SYMBOL_CRC),
            "empty",
            true}),
+      IgnoreTestCase(
+          {"CRC and type change",
+           stg::InputFormat::STG,
+           "crc_type_0.stg",
+           stg::InputFormat::STG,
+           "crc_type_1.stg",
+           stg::Ignore(),
+           "crc_type_small_diff",
+           false}),
+      IgnoreTestCase(
+          {"type change under same CRC ignored",
+           stg::InputFormat::STG,
+           "crc_type_0.stg",
+           stg::InputFormat::STG,
+           "crc_type_1.stg",
+           stg::Ignore(stg::Ignore::SYMBOL_TYPE_SAME_CRC),
+           "crc_type_same_crc_small_diff",
+           false}),
       IgnoreTestCase(
           {"interface addition",
            stg::InputFormat::STG,
@@ -239,6 +267,7 @@ TEST_CASE("ignore") {
            "empty",
            true})
       );
+  const size_t jobs = GENERATE(1, 4);
 
   SECTION(test.name) {
     stg::Metrics metrics;
@@ -249,14 +278,15 @@ TEST_CASE("ignore") {
     const auto id1 = Read(graph, test.format1, test.file1, metrics);
 
     // Compute differences.
-    stg::Compare compare{graph, test.ignore, metrics};
+    stg::Compare compare{graph, test.ignore, metrics, jobs};
     const auto& [equals, comparison] = compare(id0, id1);
 
     // Write SMALL reports.
     std::ostringstream output;
     if (comparison) {
       stg::NameCache names;
-      stg::reporting::Options options{stg::reporting::OutputFormat::SMALL, 0};
+      stg::reporting::Options options{stg::reporting::OutputFormat::SMALL, 0,
+                                      jobs};
       stg::reporting::Reporting reporting{graph, compare.outcomes, options,
                                           names};
       Report(reporting, *comparison, output);
@@ -293,6 +323,7 @@ TEST_CASE("short report") {
                            "added_removed_symbols_only_0.xml",
                            "added_removed_symbols_only_1.xml",
                            "added_removed_symbols_only_short_diff"}));
+  const size_t jobs = GENERATE(1, 4);
 
   SECTION(test.name) {
     stg::Metrics metrics;
@@ -303,14 +334,15 @@ TEST_CASE("short report") {
     const auto id1 = Read(graph, stg::InputFormat::ABI, test.xml1, metrics);
 
     // Compute differences.
-    stg::Compare compare{graph, {}, metrics};
+    stg::Compare compare{graph, {}, metrics, jobs};
     const auto& [equals, comparison] = compare(id0, id1);
 
     // Write SHORT reports.
     std::stringstream output;
     if (comparison) {
       stg::NameCache names;
-      stg::reporting::Options options{stg::reporting::OutputFormat::SHORT, 2};
+      stg::reporting::Options options{stg::reporting::OutputFormat::SHORT, 2,
+                                      jobs};
       stg::reporting::Reporting reporting{graph, compare.outcomes, options,
                                           names};
       Report(reporting, *comparison, output);
@@ -325,6 +357,503 @@ TEST_CASE("short report") {
   }
 }
 
+TEST_CASE("symbol filter") {
+  const size_t jobs = GENERATE(1, 4);
+  stg::Metrics metrics;
+
+  // Read inputs.
+  stg::Graph graph;
+  const auto id0 = Read(graph, stg::InputFormat::ABI, "crc_0.xml", metrics);
+  const auto id1 = Read(graph, stg::InputFormat::ABI, "crc_1.xml", metrics);
+
+  // Compute differences of just some symbols.
+  const auto filter = stg::MakeFilter("b|c|missing");
+  stg::Compare compare{graph, {}, metrics, jobs};
+  compare.symbol_filter = filter.get();
+  const auto& [equals, comparison] = compare(id0, id1);
+
+  // Write SMALL reports.
+  std::ostringstream output;
+  if (comparison) {
+    stg::NameCache names;
+    stg::reporting::Options options{stg::reporting::OutputFormat::SMALL, 0};
+    stg::reporting::Reporting reporting{graph, compare.outcomes, options,
+                                        names};
+    Report(reporting, *comparison, output);
+  }
+
+  // Check comparison outcome and report output.
+  CHECK(!equals);
+  std::ifstream expected_output_file(
+      filename_to_path("crc_filtered_small_diff"));
+  std::ostringstream expected_output;
+  expected_output << expected_output_file.rdbuf();
+  CHECK(output.str() == expected_output.str());
+
+  // Nothing is compared if nothing matches.
+  stg::Compare nothing{graph, {}, metrics, jobs};
+  const auto none = stg::MakeFilter("missing");
+  nothing.symbol_filter = none.get();
+  CHECK(nothing(id0, id1).first);
+}
+
+struct HashTestCase {
+  const std::string name;
+  const std::string xml0;
+  const std::string xml1;
+};
+
+std::string SmallReport(const stg::Graph& graph, stg::Compare<>& compare,
+                        stg::Id id0, stg::Id id1) {
+  const auto& [equals, comparison] = compare(id0, id1);
+  std::ostringstream output;
+  output << equals << '\n';
+  if (comparison) {
+    stg::NameCache names;
+    stg::reporting::Options options{stg::reporting::OutputFormat::SMALL, 0};
+    stg::reporting::Reporting reporting{graph, compare.outcomes, options,
+                                        names};
+    Report(reporting, *comparison, output);
+  }
+  return output.str();
+}
+
+// Sums all the counters with the given name, including those of any workers.
+size_t Count(const stg::Metrics& metrics, const std::string& name) {
+  size_t count = 0;
+  for (const auto& metric : metrics) {
+    if (metric.name == name) {
+      count += std::get<size_t>(metric.value);
+    }
+  }
+  return count;
+}
+
+TEST_CASE("hash fast path") {
+  const auto test = GENERATE(
+      HashTestCase({"crc changes", "crc_0.xml", "crc_1.xml"}),
+      HashTestCase({"offset changes", "offset_0.xml", "offset_1.xml"}),
+      HashTestCase({"symbols added and removed", "added_removed_symbols_0.xml",
+                    "added_removed_symbols_1.xml"}),
+      HashTestCase({"no changes", "crc_0.xml", "crc_0.xml"}));
+  const size_t jobs = GENERATE(1, 4);
+
+  SECTION(test.name) {
+    stg::Metrics metrics;
+    stg::Graph graph;
+    const auto id0 = Read(graph, stg::InputFormat::ABI, test.xml0, metrics);
+    const auto id1 = Read(graph, stg::InputFormat::ABI, test.xml1, metrics);
+
+    stg::NodeHashes hashes;
+    hashes.Merge(stg::Fingerprint(graph, id0, metrics));
+    hashes.Merge(stg::Fingerprint(graph, id1, metrics));
+
+    // Check that skipping identical nodes does not change the report.
+    stg::Metrics metrics0;
+    stg::Metrics metrics1;
+    std::string expected;
+    std::string actual;
+    {
+      stg::Compare compare{graph, {}, metrics0, jobs};
+      expected = SmallReport(graph, compare, id0, id1);
+    }
+    CHECK(Count(metrics0, "compare.hash_skipped") == 0);
+    {
+      stg::Compare compare{graph, {}, metrics1, jobs};
+      compare.hashes = &hashes;
+      actual = SmallReport(graph, compare, id0, id1);
+    }
+    CHECK(actual == expected);
+    CHECK(Count(metrics1, "compare.hash_skipped") > 0);
+  }
+}
+
+TEST_CASE("spilled diffs") {
+  const auto test = GENERATE(
+      HashTestCase({"crc changes", "crc_0.xml", "crc_1.xml"}),
+      HashTestCase({"offset changes", "offset_0.xml", "offset_1.xml"}),
+      HashTestCase({"symbols added and removed", "added_removed_symbols_0.xml",
+                    "added_removed_symbols_1.xml"}));
+  const size_t jobs = GENERATE(1, 4);
+
+  SECTION(test.name) {
+    stg::Metrics metrics;
+    stg::Graph graph;
+    const auto id0 = Read(graph, stg::InputFormat::ABI, test.xml0, metrics);
+    const auto id1 = Read(graph, stg::InputFormat::ABI, test.xml1, metrics);
+
+    // Check that spilling every diff does not change the report.
+    stg::Metrics metrics0;
+    stg::Metrics metrics1;
+    std::string expected;
+    std::string actual;
+    {
+      stg::Compare compare{graph, {}, metrics0, jobs};
+      expected = SmallReport(graph, compare, id0, id1);
+    }
+    CHECK(Count(metrics0, "compare.outcomes.spilled_bytes") == 0);
+    {
+      stg::Compare compare{graph, {}, metrics1, jobs};
+      compare.outcomes.SetBudget(1);
+      actual = SmallReport(graph, compare, id0, id1);
+    }
+    CHECK(actual == expected);
+    CHECK(Count(metrics1, "compare.outcomes.spilled_bytes") > 0);
+  }
+}
+
+struct ChangeCountsTestCase {
+  const std::string name;
+  const std::string xml0;
+  const std::string xml1;
+  const std::string expected;
+};
+
+TEST_CASE("deadline") {
+  const size_t jobs = GENERATE(1, 4);
+  stg::Metrics metrics;
+  stg::Graph graph;
+  const auto id0 = Read(graph, stg::InputFormat::ABI, "crc_0.xml", metrics);
+  const auto id1 = Read(graph, stg::InputFormat::ABI, "crc_1.xml", metrics);
+
+  std::string expected;
+  {
+    stg::Compare compare{graph, {}, metrics, jobs};
+    expected = SmallReport(graph, compare, id0, id1);
+  }
+
+  // A distant deadline changes nothing.
+  {
+    stg::Compare compare{graph, {}, metrics, jobs};
+    compare.deadline = std::chrono::steady_clock::now() + std::chrono::hours(1);
+    CHECK(SmallReport(graph, compare, id0, id1) == expected);
+    CHECK(compare.skipped.empty());
+    CHECK(compare.completed > 0);
+  }
+
+  // A deadline already passed skips every symbol present in both.
+  {
+    stg::Compare compare{graph, {}, metrics, jobs};
+    compare.deadline = std::chrono::steady_clock::now();
+    CHECK(SmallReport(graph, compare, id0, id1) == "1\n");
+    CHECK(!compare.skipped.empty());
+    CHECK(compare.completed == 0);
+  }
+}
+
+TEST_CASE("change counts") {
+  const auto test = GENERATE(
+      ChangeCountsTestCase(
+          {"crc changes", "crc_0.xml", "crc_1.xml",
+           R"({"equal":false,"removed":{},"added":{},"changed":{"object":5},)"
+           R"("changed_types":1})" "\n"}),
+      ChangeCountsTestCase(
+          {"added removed symbols", "added_removed_symbols_0.xml",
+           "added_removed_symbols_1.xml",
+           R"({"equal":false,"removed":{"function":1,"object":1},)"
+           R"("added":{"function":1,"object":1},"changed":{"object":1},)"
+           R"("changed_types":1})" "\n"}),
+      ChangeCountsTestCase(
+          {"no changes", "crc_0.xml", "crc_0.xml",
+           R"({"equal":true,"removed":{},"added":{},"changed":{},)"
+           R"("changed_types":0})" "\n"}));
+  const size_t jobs = GENERATE(1, 4);
+
+  SECTION(test.name) {
+    stg::Metrics metrics;
+    stg::Graph graph;
+    const auto id0 = Read(graph, stg::InputFormat::ABI, test.xml0, metrics);
+    const auto id1 = Read(graph, stg::InputFormat::ABI, test.xml1, metrics);
+
+    stg::Compare compare{graph, {}, metrics, jobs};
+    compare.count_only = true;
+    const auto [equals, comparison] = compare(id0, id1);
+    // only the Interface diff is kept
+    CHECK(compare.outcomes.Size() == (equals ? 0 : 1));
+
+    std::ostringstream output;
+    stg::reporting::ChangeCounts(graph, compare.outcomes, compare.known,
+                                 comparison, output);
+    CHECK(output.str() == test.expected);
+  }
+}
+
+TEST_CASE("same node fast path") {
+  const std::string xml = GENERATE("crc_0.xml", "offset_0.xml",
+                                   "added_removed_symbols_0.xml");
+  const size_t jobs = GENERATE(1, 4);
+
+  SECTION(xml) {
+    stg::Metrics metrics;
+    stg::Graph graph;
+    const auto id = Read(graph, stg::InputFormat::ABI, xml, metrics);
+
+    // Check that a node is equal to itself without any real comparison.
+    stg::Metrics metrics0;
+    {
+      stg::Compare compare{graph, {}, metrics0, jobs};
+      CHECK(SmallReport(graph, compare, id, id) == "1\n");
+    }
+    CHECK(Count(metrics0, "compare.same_node") == 1);
+    CHECK(Count(metrics0, "compare.really_compared") == 0);
+  }
+}
+
+TEST_CASE("fail fast") {
+  const auto test = GENERATE(
+      HashTestCase({"crc changes", "crc_0.xml", "crc_1.xml"}),
+      HashTestCase({"offset changes", "offset_0.xml", "offset_1.xml"}),
+      HashTestCase({"symbols added and removed", "added_removed_symbols_0.xml",
+                    "added_removed_symbols_1.xml"}));
+  const size_t jobs = GENERATE(1, 4);
+
+  SECTION(test.name) {
+    stg::Metrics metrics;
+    stg::Graph graph;
+    const auto id0 = Read(graph, stg::InputFormat::ABI, test.xml0, metrics);
+    const auto id1 = Read(graph, stg::InputFormat::ABI, test.xml1, metrics);
+
+    // Only the first symbol difference is recorded.
+    stg::Compare all{graph, {}, metrics, jobs};
+    const auto& [all_equals, all_comparison] = all(id0, id1);
+    REQUIRE(all_comparison);
+    const auto& all_details = all.outcomes.At(*all_comparison).details;
+    REQUIRE(all_details.size() > 1);
+
+    stg::Compare compare{graph, {}, metrics, jobs};
+    compare.fail_fast = true;
+    const auto& [equals, comparison] = compare(id0, id1);
+    CHECK(!equals);
+    REQUIRE(comparison);
+    const auto& details = compare.outcomes.At(*comparison).details;
+    REQUIRE(details.size() == 1);
+    const auto& edge = details[0].edge_;
+    REQUIRE(edge);
+    // the difference is one of the full set
+    CHECK(std::any_of(all_details.begin(), all_details.end(),
+                      [&](const stg::DiffDetail& detail) {
+                        return detail.edge_ == edge;
+                      }));
+
+    // No differences, nothing to stop at.
+    stg::Compare same{graph, {}, metrics, jobs};
+    same.fail_fast = true;
+    CHECK(same(id0, id0).first);
+  }
+}
+
+struct ConcurrentReportTestCase {
+  const std::string name;
+  const stg::InputFormat format;
+  const std::string file0;
+  const std::string file1;
+};
+
+TEST_CASE("concurrent reports") {
+  const auto test = GENERATE(
+      ConcurrentReportTestCase({"crc changes", stg::InputFormat::ABI,
+                                "crc_0.xml", "crc_1.xml"}),
+      ConcurrentReportTestCase({"offset changes", stg::InputFormat::ABI,
+                                "offset_0.xml", "offset_1.xml"}),
+      ConcurrentReportTestCase({"symbols added and removed",
+                                stg::InputFormat::ABI,
+                                "added_removed_symbols_0.xml",
+                                "added_removed_symbols_1.xml"}),
+      ConcurrentReportTestCase({"fidelity changes", stg::InputFormat::STG,
+                                "fidelity_diff_0.stg", "fidelity_diff_1.stg"}),
+      ConcurrentReportTestCase({"shared types", stg::InputFormat::STG,
+                                "shared_types_0.stg", "shared_types_1.stg"}));
+  const auto format = GENERATE(
+      stg::reporting::OutputFormat::PLAIN, stg::reporting::OutputFormat::FLAT,
+      stg::reporting::OutputFormat::SMALL, stg::reporting::OutputFormat::SHORT,
+      stg::reporting::OutputFormat::VIZ, stg::reporting::OutputFormat::IMPACT,
+      stg::reporting::OutputFormat::JSON);
+
+  SECTION(test.name) {
+    stg::Metrics metrics;
+    stg::Graph graph;
+    const auto id0 = Read(graph, test.format, test.file0, metrics);
+    const auto id1 = Read(graph, test.format, test.file1, metrics);
+    stg::Compare compare{graph, {}, metrics};
+    const auto& [equals, comparison] = compare(id0, id1);
+    REQUIRE(comparison);
+
+    // Reports do not depend on the number of jobs.
+    const auto report = [&](size_t jobs) {
+      stg::NameCache names;
+      stg::reporting::Options options{format, 1, jobs};
+      stg::reporting::Reporting reporting{graph, compare.outcomes, options,
+                                          names};
+      std::ostringstream output;
+      Report(reporting, *comparison, output);
+      return output.str();
+    };
+    const auto expected = report(1);
+    CHECK(!expected.empty());
+    CHECK(report(2) == expected);
+    CHECK(report(8) == expected);
+  }
+}
+
+TEST_CASE("json report") {
+  stg::Metrics metrics;
+  stg::Graph graph;
+  const auto id0 = Read(graph, stg::InputFormat::ABI, "crc_0.xml", metrics);
+  const auto id1 = Read(graph, stg::InputFormat::ABI, "crc_1.xml", metrics);
+  stg::Compare compare{graph, {}, metrics};
+  const auto& [equals, comparison] = compare(id0, id1);
+  REQUIRE(comparison);
+
+  stg::NameCache names;
+  stg::reporting::Options options{stg::reporting::OutputFormat::JSON, 0};
+  stg::reporting::Reporting reporting{graph, compare.outcomes, options, names};
+  std::ostringstream output;
+  Report(reporting, *comparison, output);
+  const auto report = output.str();
+  CHECK(report.starts_with(R"({"root":0,"nodes":[)"));
+  CHECK(report.ends_with("]}\n"));
+  CHECK(report.find(R"({"id":2,"status":"changed","kind":"variable symbol",)"
+                    R"("before":"'int b'","after":"'int b'",)"
+                    R"("has_changes":true,"holds_changes":false,)"
+                    R"("details":[{"kind":"changed","label":"CRC",)"
+                    R"("before":"0xb70c2d59","after":"0xb7c5b6f1"}]})")
+        != std::string::npos);
+}
+
+TEST_CASE("multiple formats") {
+  const auto test = GENERATE(
+      ConcurrentReportTestCase({"crc changes", stg::InputFormat::ABI,
+                                "crc_0.xml", "crc_1.xml"}),
+      ConcurrentReportTestCase({"symbols added and removed",
+                                stg::InputFormat::ABI,
+                                "added_removed_symbols_0.xml",
+                                "added_removed_symbols_1.xml"}),
+      ConcurrentReportTestCase({"shared types", stg::InputFormat::STG,
+                                "shared_types_0.stg", "shared_types_1.stg"}));
+  const size_t jobs = GENERATE(1, 4);
+  // expected FLAT, SMALL and SHORT reports: fewer than written, or all of them
+  const size_t flat_writes = GENERATE(1, 2, 4);
+  const std::vector<stg::reporting::OutputFormat> formats = {
+      stg::reporting::OutputFormat::SHORT, stg::reporting::OutputFormat::PLAIN,
+      stg::reporting::OutputFormat::FLAT, stg::reporting::OutputFormat::VIZ,
+      stg::reporting::OutputFormat::SMALL, stg::reporting::OutputFormat::SHORT};
+
+  SECTION(test.name) {
+    stg::Metrics metrics;
+    stg::Graph graph;
+    const auto id0 = Read(graph, test.format, test.file0, metrics);
+    const auto id1 = Read(graph, test.format, test.file1, metrics);
+    stg::Compare compare{graph, {}, metrics};
+    const auto& [equals, comparison] = compare(id0, id1);
+    REQUIRE(comparison);
+
+    // Writing several reports from one Reports is the same as writing each
+    // separately.
+    stg::NameCache names;
+    stg::reporting::Options options{stg::reporting::OutputFormat::PLAIN, 1,
+                                    jobs};
+    stg::reporting::Reporting reporting{graph, compare.outcomes, options,
+                                        names};
+    stg::reporting::Reports reports(reporting, *comparison, flat_writes);
+    for (const auto format : formats) {
+      std::ostringstream output;
+      reports.Write(format, output);
+      stg::NameCache separate_names;
+      stg::reporting::Options separate_options{format, 1};
+      stg::reporting::Reporting separate{graph, compare.outcomes,
+                                         separate_options, separate_names};
+      std::ostringstream expected;
+      Report(separate, *comparison, expected);
+      CHECK(output.str() == expected.str());
+    }
+  }
+}
+
+TEST_CASE("descriptions") {
+  const size_t jobs = GENERATE(1, 4);
+  stg::Metrics metrics;
+  stg::Graph graph;
+  const auto id0 = Read(graph, stg::InputFormat::ABI,
+                        "added_removed_symbols_0.xml", metrics);
+  const auto id1 = Read(graph, stg::InputFormat::ABI,
+                        "added_removed_symbols_1.xml", metrics);
+  stg::Compare compare{graph, {}, metrics};
+  const auto& [equals, comparison] = compare(id0, id1);
+  REQUIRE(comparison);
+
+  stg::NameCache names;
+  stg::reporting::Options options{stg::reporting::OutputFormat::PLAIN, 1,
+                                  jobs};
+  stg::reporting::Reporting reporting{graph, compare.outcomes, options, names};
+  const stg::reporting::Descriptions descriptions(reporting, *comparison);
+
+  // Every symbol added or removed is described, as it would be on its own.
+  size_t count = 0;
+  for (const auto& detail : compare.outcomes.At(*comparison).details) {
+    const auto& [symbol1, symbol2] = *detail.edge_;
+    if (symbol1 && symbol2) {
+      continue;
+    }
+    ++count;
+    const auto id = symbol1 ? *symbol1 : *symbol2;
+    stg::NameCache fresh;
+    CHECK(descriptions.Kind(id) == stg::DescribeKind(graph)(id));
+    CHECK(descriptions.Name(id)
+          == stg::Describe(graph, fresh)(id).ToString());
+    CHECK(descriptions.Extra(id) == stg::DescribeExtra(graph)(id));
+  }
+  CHECK(count > 0);
+
+  // Nodes outside the diff graph are not described.
+  CHECK_THROWS_AS(descriptions.Kind(graph.Limit()), stg::Exception);
+}
+
+TEST_CASE("viz size limit") {
+  stg::Metrics metrics;
+  stg::Graph graph;
+  const auto id0 =
+      Read(graph, stg::InputFormat::STG, "shared_types_0.stg", metrics);
+  const auto id1 =
+      Read(graph, stg::InputFormat::STG, "shared_types_1.stg", metrics);
+  stg::Compare compare{graph, {}, metrics};
+  const auto& [equals, comparison] = compare(id0, id1);
+  REQUIRE(comparison);
+
+  const auto viz = [&](size_t max_viz_bytes) {
+    stg::NameCache names;
+    const stg::reporting::Options options{stg::reporting::OutputFormat::VIZ, 1,
+                                          1, max_viz_bytes};
+    const stg::reporting::Reporting reporting{graph, compare.outcomes,
+                                              options, names};
+    std::ostringstream report;
+    stg::reporting::Report(reporting, *comparison, report);
+    return report.str();
+  };
+
+  const std::string header = "digraph \"ABI diff\" {\n";
+  const std::string full = viz(0);
+  REQUIRE(full.starts_with(header));
+  REQUIRE(full.ends_with("}\n"));
+  const std::string body =
+      full.substr(header.size(), full.size() - header.size() - 2);
+  const size_t limit = GENERATE(1, 100, 500);
+  REQUIRE(limit < body.size());
+  const std::string truncated = viz(limit);
+
+  // The statements written are those of the full report, up to the limit.
+  const auto marker = truncated.find("  // truncated");
+  REQUIRE(marker != std::string::npos);
+  const std::string kept = truncated.substr(header.size(),
+                                            marker - header.size());
+  CHECK(kept.size() <= limit);
+  CHECK(body.starts_with(kept));
+  CHECK((kept.empty() || kept.back() == '\n'));
+  CHECK(truncated.ends_with("}\n"));
+
+  // A limit that is not reached changes nothing.
+  CHECK(viz(body.size()) == full);
+}
+
 TEST_CASE("fidelity diff") {
   stg::Metrics metrics;
 
@@ -19,55 +19,264 @@
 // Author: Giuliano Procida
 // Author: Aleksei Vetrov
 
+#include <fcntl.h>
 #include <getopt.h>
 
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <ios>
 #include <iostream>
+#include <map>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <string_view>
 #include <utility>
+#include <variant>
 #include <vector>
 
-#include "input.h"
+#include "deduplication.h"
 #include "error.h"
+#include "file_descriptor.h"
+#include "fingerprint.h"
 #include "graph.h"
+#include "input.h"
 #include "metrics.h"
+#include "proto_reader.h"
+#include "proto_writer.h"
 #include "reader_options.h"
+#include "statistics.h"
+#include "trace.h"
+#include "type_resolution.h"
+#include "unification.h"
 
 using Input = std::pair<stg::InputFormat, const char*>;
 
+namespace {
+
+// Asks the kernel to drop the file's cached pages, so that the next read comes
+// from storage. Only clean pages are dropped, which is enough for inputs.
+void DropCachedPages(const char* filename) {
+  const stg::FileDescriptor fd(filename, O_RDONLY);
+  const int error = posix_fadvise(fd.Value(), 0, 0, POSIX_FADV_DONTNEED);
+  if (error != 0) {
+    stg::Warn() << "could not drop cached pages of '" << filename << "': "
+                << stg::Error(error);
+  }
+}
+
+// Resets the process's peak resident set size, returning whether this was
+// possible.
+bool ResetPeakRss() {
+  std::ofstream clear_refs("/proc/self/clear_refs");
+  clear_refs << "5" << std::flush;
+  return static_cast<bool>(clear_refs);
+}
+
+// The process's peak resident set size, in bytes.
+uint64_t PeakRss() {
+  std::ifstream status("/proc/self/status");
+  std::string line;
+  while (std::getline(status, line)) {
+    constexpr std::string_view kKey = "VmHWM:";
+    if (line.starts_with(kKey)) {
+      // reported in kB
+      return std::stoull(line.substr(kKey.size())) * 1024;
+    }
+  }
+  return 0;
+}
+
+// The times of each run, in nanoseconds, by phase, keeping the order of the
+// phases' first appearance.
+class Runs {
+ public:
+  void Add(std::string_view phase, uint64_t ns) {
+    auto [it, inserted] = times_.try_emplace(std::string(phase));
+    if (inserted) {
+      order_.emplace_back(phase);
+    }
+    it->second.push_back(ns);
+  }
+
+  // Adds the times of the Time scopes recorded in the metrics.
+  void Add(const stg::Metrics& metrics) {
+    std::map<std::string_view, uint64_t> run;
+    std::vector<std::string_view> order;
+    for (const auto& metric : metrics) {
+      uint64_t ns;
+      if (const auto* time = std::get_if<stg::Nanoseconds>(&metric.value)) {
+        ns = time->ns;
+      } else if (const auto* durations =
+                     std::get_if<stg::Durations>(&metric.value)) {
+        ns = durations->total.ns;
+      } else {
+        continue;
+      }
+      const auto [it, inserted] = run.try_emplace(metric.name, 0);
+      if (inserted) {
+        order.push_back(metric.name);
+      }
+      // repeated scopes are summed
+      it->second += ns;
+    }
+    for (const auto phase : order) {
+      Add(phase, run[phase]);
+    }
+  }
+
+  // Writes the minimum, median and maximum of each phase.
+  void Report(std::ostream& os, uint64_t scale, std::string_view unit) {
+    for (const auto& phase : order_) {
+      auto& values = times_[phase];
+      std::sort(values.begin(), values.end());
+      os << phase << ':';
+      for (const auto value : {values.front(), values[values.size() / 2],
+                               values.back()}) {
+        os << ' ' << std::fixed << std::setprecision(3)
+           << static_cast<double>(value) / scale;
+      }
+      os << ' ' << unit << " (min median max over " << values.size()
+         << " runs)\n";
+    }
+  }
+
+ private:
+  std::vector<std::string> order_;
+  std::map<std::string, std::vector<uint64_t>> times_;
+};
+
+}  // namespace
+
 int main(int argc, char* const argv[]) {
   enum LongOptions {
     kSkipDwarf = 256,
+    kMetricsFormat,
+    kTrace,
+    kStatistics,
+    kBench,
+    kCold,
+    kSymbol,
   };
+  bool opt_metrics = false;
+  bool opt_statistics = false;
+  size_t opt_bench = 0;
+  bool opt_cold = false;
+  std::vector<std::string> opt_symbols;
+  stg::MetricsFormat opt_metrics_format = stg::MetricsFormat::TEXT;
+  std::optional<const char*> opt_trace;
   stg::ReadOptions opt_read_options(stg::ReadOptions::INFO);
   static option opts[] = {
-      {"btf",        required_argument, nullptr, 'b'       },
-      {"elf",        required_argument, nullptr, 'e'       },
-      {"skip-dwarf", no_argument,       nullptr, kSkipDwarf},
-      {nullptr,      0,                 nullptr, 0         },
+      {"metrics",        optional_argument, nullptr, 'm'           },
+      {"metrics-format", required_argument, nullptr, kMetricsFormat},
+      {"trace",          required_argument, nullptr, kTrace        },
+      {"abi",            required_argument, nullptr, 'a'           },
+      {"btf",            required_argument, nullptr, 'b'           },
+      {"elf",            required_argument, nullptr, 'e'           },
+      {"stg",            required_argument, nullptr, 's'           },
+      {"jobs",           required_argument, nullptr, 'j'           },
+      {"skip-dwarf",     no_argument,       nullptr, kSkipDwarf    },
+      {"statistics",     no_argument,       nullptr, kStatistics   },
+      {"bench",          required_argument, nullptr, kBench        },
+      {"cold",           no_argument,       nullptr, kCold         },
+      {"symbol",         required_argument, nullptr, kSymbol       },
+      {nullptr,          0,                 nullptr, 0             },
   };
   auto usage = [&]() {
-    std::cerr << "Parse BTF or ELF with verbose logging.\n"
+    std::cerr << "Parse ABI, BTF, ELF or STG with verbose logging.\n"
               << "usage: " << argv[0]
-              << " [--skip-dwarf] -b|--btf|-e|--elf file\n";
+              << " [-m|--metrics[=hw]] [--metrics-format {text|json}]"
+              << " [--trace <file>]"
+              << " [--skip-dwarf] [-j|--jobs <jobs>] [--statistics]"
+              << " [--bench <runs> [--cold]] [--symbol <name>] ..."
+              << " -a|--abi|-b|--btf|-e|--elf|-s|--stg file\n"
+              << "--bench reads the file repeatedly and reports the minimum,\n"
+              << "  median and maximum time of each phase and peak RSS\n"
+              << "--cold drops the file's cached pages before each run\n"
+              << "--symbol reads just the named symbols of STG written with\n"
+              << "  stg --index, and the types they use, and prints them\n";
     return 1;
   };
 
   std::vector<Input> inputs;
   while (true) {
-    int c = getopt_long(argc, argv, "-b:e:", opts, nullptr);
+    int c = getopt_long(argc, argv, "-ma:b:e:s:j:", opts, nullptr);
     if (c == -1) {
       break;
     }
     const char* argument = optarg;
     switch (c) {
+      case 'm':
+        if (argument != nullptr) {
+          if (strcmp(argument, "hw") != 0) {
+            std::cerr << "unknown metrics option: " << argument << '\n';
+            return usage();
+          }
+          stg::EnableHardwareCounters();
+        }
+        opt_metrics = true;
+        break;
+      case 'a':
+        inputs.emplace_back(stg::InputFormat::ABI, argument);
+        break;
       case 'b':
         inputs.emplace_back(stg::InputFormat::BTF, argument);
         break;
       case 'e':
         inputs.emplace_back(stg::InputFormat::ELF, argument);
         break;
+      case 's':
+        inputs.emplace_back(stg::InputFormat::STG, argument);
+        break;
+      case 'j': {
+        const auto end = argument + strlen(argument);
+        const auto [ptr, ec] =
+            std::from_chars(argument, end, opt_read_options.jobs);
+        if (ec != std::errc() || ptr != end || opt_read_options.jobs == 0) {
+          std::cerr << "invalid number of jobs: " << argument << '\n';
+          return usage();
+        }
+        break;
+      }
       case kSkipDwarf:
         opt_read_options.Set(stg::ReadOptions::SKIP_DWARF);
         break;
+      case kTrace:
+        opt_trace = argument;
+        break;
+      case kStatistics:
+        opt_statistics = true;
+        break;
+      case kBench: {
+        const auto end = argument + strlen(argument);
+        const auto [ptr, ec] = std::from_chars(argument, end, opt_bench);
+        if (ec != std::errc() || ptr != end || opt_bench == 0) {
+          std::cerr << "invalid number of runs: " << argument << '\n';
+          return usage();
+        }
+        break;
+      }
+      case kCold:
+        opt_cold = true;
+        break;
+      case kSymbol:
+        opt_symbols.emplace_back(argument);
+        break;
+      case kMetricsFormat:
+        if (const auto format = stg::ParseMetricsFormat(argument)) {
+          opt_metrics = true;
+          opt_metrics_format = format.value();
+        } else {
+          std::cerr << "unknown metrics format: " << argument << '\n';
+          return usage();
+        }
+        break;
       default:
         return usage();
     }
@@ -77,14 +286,91 @@ int main(int argc, char* const argv[]) {
   if (inputs.size() != 1) {
     return usage();
   }
+  if (opt_bench != 0 ? opt_statistics || opt_trace : opt_cold) {
+    return usage();
+  }
 
   const auto& [format, filename] = inputs[0];
+  if (!opt_symbols.empty()
+      && (format != stg::InputFormat::STG || opt_bench != 0)) {
+    return usage();
+  }
+
+  if (opt_trace) {
+    stg::trace::Enable();
+  }
 
   try {
+    if (opt_bench != 0) {
+      // Each run reads into a fresh graph, with fresh metrics. Those of the
+      // last run are reported with --metrics.
+      Runs times;
+      Runs memory;
+      bool reset = true;
+      stg::Metrics metrics;
+      for (size_t run = 0; run < opt_bench; ++run) {
+        if (opt_cold) {
+          DropCachedPages(filename);
+        }
+        reset &= ResetPeakRss();
+        metrics.clear();
+        const auto start = std::chrono::steady_clock::now();
+        {
+          stg::Graph graph;
+          stg::Read(graph, format, filename, opt_read_options, nullptr,
+                    metrics);
+        }
+        const auto finish = std::chrono::steady_clock::now();
+        times.Add(metrics);
+        times.Add("elapsed", std::chrono::duration_cast<
+                                 std::chrono::nanoseconds>(finish - start)
+                                 .count());
+        memory.Add("peak RSS", PeakRss());
+      }
+      times.Report(std::cout, 1'000'000, "ms");
+      memory.Report(std::cout, 1 << 20, "MiB");
+      if (!reset) {
+        std::cout << "peak RSS could not be reset between runs\n";
+      }
+      if (opt_metrics) {
+        stg::Report(metrics, std::cerr, opt_metrics_format);
+      }
+      return 0;
+    }
     stg::Graph graph;
     stg::Metrics metrics;
-    (void)stg::Read(graph, format, filename, opt_read_options, nullptr,
-                    metrics);
+    stg::Id root = [&] {
+      if (opt_symbols.empty()) {
+        return stg::Read(graph, format, filename, opt_read_options, nullptr,
+                         metrics);
+      }
+      stg::Time x(metrics, "read indexed STG");
+      return stg::proto::ReadIndexed(graph, filename, opt_symbols);
+    }();
+    if (!opt_symbols.empty()) {
+      stg::proto::Writer(graph).Write(root, std::cout);
+    }
+    if (opt_statistics) {
+      std::cout << "read\n" << stg::GetStatistics(graph, root);
+      // the same processing as stg does by default
+      const auto jobs = opt_read_options.jobs;
+      {
+        stg::Unification unification(graph, stg::Id(0), metrics, jobs);
+        unification.Reserve(graph.Limit());
+        stg::ResolveTypes(graph, unification, {root}, metrics, jobs);
+        unification.Update(root);
+      }
+      const auto hashes = stg::Fingerprint(graph, root, metrics, jobs);
+      root = stg::Deduplicate(graph, root, hashes, metrics, jobs);
+      root = graph.Compact()[root.ix_];
+      std::cout << "deduplicated\n" << stg::GetStatistics(graph, root);
+    }
+    if (opt_trace) {
+      stg::trace::Write(*opt_trace);
+    }
+    if (opt_metrics) {
+      stg::Report(metrics, std::cerr, opt_metrics_format);
+    }
   } catch (const stg::Exception& e) {
     std::cerr << e.what() << '\n';
     return 1;
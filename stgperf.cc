@@ -0,0 +1,312 @@
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+// -*- mode: C++ -*-
+//
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License v2.0 with LLVM Exceptions (the
+// "License"); you may not use this file except in compliance with the
+// License.  You may obtain a copy of the License at
+//
+//     https://llvm.org/LICENSE.txt
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <getopt.h>
+
+#include <algorithm>
+#include <charconv>
+#include <cstddef>
+#include <cstring>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "comparison.h"
+#include "error.h"
+#include "filter.h"
+#include "graph.h"
+#include "input.h"
+#include "metrics.h"
+#include "performance_gate.h"
+#include "pipeline.h"
+#include "proto_writer.h"
+#include "reader_options.h"
+#include "reporting.h"
+#include "stable_hash.h"
+
+namespace {
+
+using Corpus = std::map<std::string, std::pair<stg::InputFormat, std::string>>;
+
+// Collects the XML and STG files in the corpus, keyed by file name.
+Corpus GetCorpus(const std::filesystem::path& directory) {
+  Corpus corpus;
+  for (const auto& entry : std::filesystem::directory_iterator(directory)) {
+    if (!entry.is_regular_file()) {
+      continue;
+    }
+    const auto& path = entry.path();
+    const auto extension = path.extension();
+    if (extension == ".xml") {
+      corpus.emplace(path.filename(),
+                     std::make_pair(stg::InputFormat::ABI, path.string()));
+    } else if (extension == ".stg") {
+      corpus.emplace(path.filename(),
+                     std::make_pair(stg::InputFormat::STG, path.string()));
+    }
+  }
+  return corpus;
+}
+
+// Runs the stg pipeline, reading, resolving, deduplicating and writing.
+void RunStg(stg::InputFormat format, const char* input,
+            stg::ReadOptions options, stg::Metrics& metrics) {
+  stg::Graph graph;
+  stg::StableHashCache stable_hashes;
+  stg::Id root = stg::Read(graph, format, input, options, nullptr, metrics,
+                           &stable_hashes);
+  root = stg::ResolveAndDeduplicate(graph, root, false, stable_hashes, metrics,
+                                    options.jobs);
+  stg::Write(graph, root, "/dev/null", stg::proto::Format::TEXT,
+             stg::proto::Compression::NONE, stable_hashes, false, true,
+             metrics, options.jobs);
+}
+
+// Runs the stgdiff pipeline, comparing the inputs and reporting differences.
+void RunStgdiff(stg::InputFormat format1, const char* input1,
+                stg::InputFormat format2, const char* input2,
+                stg::ReadOptions options, stg::Metrics& metrics) {
+  stg::Differ differ(format1, input1, stg::Ignore(), options, nullptr, false,
+                     std::nullopt, stg::DiffDeduplication::NONE, 0, 0,
+                     metrics);
+  std::ostringstream report;
+  const stg::Reports reports = {{stg::reporting::OutputFormat::PLAIN,
+                                 &report}};
+  (void)differ.Diff(format2, input2, reports, nullptr, metrics);
+}
+
+// Runs each pipeline over the corpus the given number of times, keeping the
+// minimum of each time. Inputs that fail to be processed, such as those that
+// exist only to test error handling, are skipped.
+stg::Measurements MeasureCorpus(const Corpus& corpus,
+                                stg::ReadOptions options, size_t repeats) {
+  std::vector<std::pair<std::string, std::function<void(stg::Metrics&)>>> runs;
+  for (const auto& [file, input] : corpus) {
+    const auto& [format, path] = input;
+    runs.emplace_back("stg/" + file, [&](stg::Metrics& metrics) {
+      RunStg(format, path.c_str(), options, metrics);
+    });
+    const auto suffix = file.rfind("_0.");
+    if (suffix == std::string::npos) {
+      continue;
+    }
+    auto other_file = file;
+    other_file[suffix + 1] = '1';
+    const auto it = corpus.find(other_file);
+    if (it == corpus.end()) {
+      continue;
+    }
+    const auto& [other_format, other_path] = it->second;
+    runs.emplace_back(
+        "stgdiff/" + file.substr(0, suffix), [&](stg::Metrics& metrics) {
+          RunStgdiff(format, path.c_str(), other_format, other_path.c_str(),
+                     options, metrics);
+        });
+  }
+
+  stg::Measurements measurements;
+  for (const auto& [name, run] : runs) {
+    std::optional<stg::Measurements> best;
+    for (size_t repeat = 0; repeat < repeats; ++repeat) {
+      stg::Metrics metrics;
+      try {
+        run(metrics);
+      } catch (const stg::Exception&) {
+        break;
+      }
+      stg::Measurements current;
+      stg::Measure(name, metrics, current);
+      if (!best) {
+        best = std::move(current);
+        continue;
+      }
+      stg::Check(best->counters == current.counters)
+          << "counters of run '" << name << "' are nondeterministic";
+      for (auto& [key, value] : best->times) {
+        value = std::min(value, current.times[key]);
+      }
+    }
+    if (best) {
+      measurements.counters.merge(best->counters);
+      measurements.times.merge(best->times);
+    }
+  }
+  return measurements;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  enum LongOptions {
+    kCounterThreshold = 256,
+    kTimeThreshold,
+    kMinimumTime,
+  };
+  // Process arguments.
+  std::filesystem::path opt_corpus = "testdata";
+  const char* opt_baseline = nullptr;
+  const char* opt_write = nullptr;
+  stg::Thresholds opt_thresholds;
+  std::unique_ptr<stg::Filter> opt_keys;
+  size_t opt_repeats = 1;
+  size_t opt_jobs = 1;
+  static option opts[] = {
+      {"corpus",            required_argument, nullptr, 'c'              },
+      {"baseline",          required_argument, nullptr, 'b'              },
+      {"write",             required_argument, nullptr, 'w'              },
+      {"counter-threshold", required_argument, nullptr, kCounterThreshold},
+      {"time-threshold",    required_argument, nullptr, kTimeThreshold   },
+      {"minimum-time",      required_argument, nullptr, kMinimumTime     },
+      {"gate",              required_argument, nullptr, 'g'              },
+      {"repeat",            required_argument, nullptr, 'r'              },
+      {"jobs",              required_argument, nullptr, 'j'              },
+      {nullptr,             0,                 nullptr, 0                },
+  };
+  auto usage = [&]() {
+    std::cerr << "Measure the stg and stgdiff pipelines over a corpus and "
+              << "compare with a baseline.\n"
+              << "usage: " << argv[0] << '\n'
+              << "  [-c|--corpus <directory>]\n"
+              << "  [-b|--baseline <filename>]\n"
+              << "  [-w|--write <filename>]\n"
+              << "  [--counter-threshold <percentage>]\n"
+              << "  [--time-threshold <percentage>]\n"
+              << "  [--minimum-time <milliseconds>]\n"
+              << "  [-g|--gate <filter>]\n"
+              << "  [-r|--repeat <count>]\n"
+              << "  [-j|--jobs <jobs>]\n"
+              << "implicit defaults: --corpus testdata --counter-threshold 0"
+              << " --minimum-time 1 --repeat 1 --jobs 1\n"
+              << "times are only gated if --time-threshold is given\n";
+    stg::FilterUsage(std::cerr);
+    return 1;
+  };
+  auto parse = [](const char* argument, auto& value) {
+    const auto end = argument + strlen(argument);
+    const auto [ptr, ec] = std::from_chars(argument, end, value);
+    return ec == std::errc() && ptr == end;
+  };
+  while (true) {
+    int ix;
+    const int c = getopt_long(argc, argv, "c:b:w:g:r:j:", opts, &ix);
+    if (c == -1) {
+      break;
+    }
+    const char* argument = optarg;
+    switch (c) {
+      case 'c':
+        opt_corpus = argument;
+        break;
+      case 'b':
+        opt_baseline = argument;
+        break;
+      case 'w':
+        opt_write = argument;
+        break;
+      case kCounterThreshold:
+        if (!parse(argument, opt_thresholds.counter_percent)
+            || opt_thresholds.counter_percent < 0) {
+          std::cerr << "invalid counter threshold: " << argument << '\n';
+          return usage();
+        }
+        break;
+      case kTimeThreshold: {
+        double percent;
+        if (!parse(argument, percent) || percent < 0) {
+          std::cerr << "invalid time threshold: " << argument << '\n';
+          return usage();
+        }
+        opt_thresholds.time_percent = percent;
+        break;
+      }
+      case kMinimumTime: {
+        double milliseconds;
+        if (!parse(argument, milliseconds) || milliseconds < 0) {
+          std::cerr << "invalid minimum time: " << argument << '\n';
+          return usage();
+        }
+        opt_thresholds.minimum_time =
+            static_cast<uint64_t>(milliseconds * 1'000'000);
+        break;
+      }
+      case 'g':
+        try {
+          opt_keys = stg::MakeFilter(argument);
+        } catch (const stg::Exception& e) {
+          std::cerr << e.what();
+          return usage();
+        }
+        opt_thresholds.keys = opt_keys.get();
+        break;
+      case 'r':
+        if (!parse(argument, opt_repeats) || opt_repeats == 0) {
+          std::cerr << "invalid number of repeats: " << argument << '\n';
+          return usage();
+        }
+        break;
+      case 'j':
+        if (!parse(argument, opt_jobs) || opt_jobs == 0) {
+          std::cerr << "invalid number of jobs: " << argument << '\n';
+          return usage();
+        }
+        break;
+      default:
+        return usage();
+    }
+  }
+  if (optind != argc) {
+    return usage();
+  }
+
+  try {
+    stg::ReadOptions options;
+    options.jobs = opt_jobs;
+    const auto measurements =
+        MeasureCorpus(GetCorpus(opt_corpus), options, opt_repeats);
+    if (opt_write) {
+      std::ofstream os(opt_write);
+      stg::WriteMeasurements(measurements, os);
+      stg::Check(os.flush().good())
+          << "error writing baseline '" << opt_write << "'";
+    }
+    if (opt_baseline) {
+      std::ifstream is(opt_baseline);
+      stg::Check(is.good()) << "error opening baseline '" << opt_baseline
+                            << "'";
+      const auto baseline = stg::ReadMeasurements(is);
+      const auto regressions = stg::CompareMeasurements(
+          baseline, measurements, opt_thresholds, std::cout);
+      if (regressions != 0) {
+        std::cout << regressions << " regressions\n";
+        return 1;
+      }
+    }
+    return 0;
+  } catch (const stg::Exception& e) {
+    std::cerr << e.what();
+    return 1;
+  }
+}
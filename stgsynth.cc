@@ -0,0 +1,215 @@
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+// -*- mode: C++ -*-
+//
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License v2.0 with LLVM Exceptions (the
+// "License"); you may not use this file except in compliance with the
+// License.  You may obtain a copy of the License at
+//
+//     https://llvm.org/LICENSE.txt
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <getopt.h>
+
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include "error.h"
+#include "graph.h"
+#include "metrics.h"
+#include "pipeline.h"
+#include "proto_writer.h"
+#include "stable_hash.h"
+#include "synthetic.h"
+
+int main(int argc, char* argv[]) {
+  enum LongOptions {
+    kSymbols = 256,
+    kFanOut,
+    kSccSize,
+    kTypedefChain,
+    kDuplicates,
+    kSeed,
+    kFormat,
+    kCompress,
+  };
+  // Process arguments.
+  bool opt_metrics = false;
+  size_t opt_jobs = 1;
+  stg::SyntheticOptions opt_synthetic;
+  stg::proto::Format opt_output_format = stg::proto::Format::TEXT;
+  stg::proto::Compression opt_compression = stg::proto::Compression::NONE;
+  std::vector<const char*> outputs;
+  static option opts[] = {
+      {"metrics",       optional_argument, nullptr, 'm'          },
+      {"symbols",       required_argument, nullptr, kSymbols     },
+      {"fan-out",       required_argument, nullptr, kFanOut      },
+      {"scc-size",      required_argument, nullptr, kSccSize     },
+      {"typedef-chain", required_argument, nullptr, kTypedefChain},
+      {"duplicates",    required_argument, nullptr, kDuplicates  },
+      {"seed",          required_argument, nullptr, kSeed        },
+      {"output",        required_argument, nullptr, 'o'          },
+      {"format",        required_argument, nullptr, kFormat      },
+      {"compress",      no_argument,       nullptr, kCompress    },
+      {"jobs",          required_argument, nullptr, 'j'          },
+      {nullptr,         0,                 nullptr, 0            },
+  };
+  auto usage = [&]() {
+    const stg::SyntheticOptions defaults;
+    std::cerr << "Generate a synthetic ABI in STG format, for benchmarking.\n"
+              << "usage: " << argv[0] << '\n'
+              << "  [-m|--metrics[=hw]]\n"
+              << "  [--symbols <count>]\n"
+              << "  [--fan-out <members>]\n"
+              << "  [--scc-size <maximum structs>]\n"
+              << "  [--typedef-chain <length>]\n"
+              << "  [--duplicates <percentage>]\n"
+              << "  [--seed <number>]\n"
+              << "  [-j|--jobs <jobs>]\n"
+              << "  [--format {text|binary|sharded}]\n"
+              << "  [--compress]\n"
+              << "  [{-o|--output} {filename|-}] ...\n"
+              << "implicit defaults: --symbols " << defaults.symbols
+              << " --fan-out " << defaults.fan_out
+              << " --scc-size " << defaults.max_scc_size
+              << " --typedef-chain " << defaults.typedef_chain
+              << " --duplicates " << defaults.duplicate_percent
+              << " --seed " << defaults.seed << '\n';
+    return 1;
+  };
+  auto parse = [](const char* argument, auto& value) {
+    const auto end = argument + strlen(argument);
+    const auto [ptr, ec] = std::from_chars(argument, end, value);
+    return ec == std::errc() && ptr == end;
+  };
+  while (true) {
+    int ix;
+    const int c = getopt_long(argc, argv, "mo:j:", opts, &ix);
+    if (c == -1) {
+      break;
+    }
+    const char* argument = optarg;
+    switch (c) {
+      case 'm':
+        if (argument != nullptr) {
+          if (strcmp(argument, "hw") != 0) {
+            std::cerr << "unknown metrics option: " << argument << '\n';
+            return usage();
+          }
+          stg::EnableHardwareCounters();
+        }
+        opt_metrics = true;
+        break;
+      case kSymbols:
+        if (!parse(argument, opt_synthetic.symbols)) {
+          std::cerr << "invalid number of symbols: " << argument << '\n';
+          return usage();
+        }
+        break;
+      case kFanOut:
+        if (!parse(argument, opt_synthetic.fan_out)
+            || opt_synthetic.fan_out < 2) {
+          std::cerr << "invalid fan-out: " << argument << '\n';
+          return usage();
+        }
+        break;
+      case kSccSize:
+        if (!parse(argument, opt_synthetic.max_scc_size)
+            || opt_synthetic.max_scc_size == 0) {
+          std::cerr << "invalid SCC size: " << argument << '\n';
+          return usage();
+        }
+        break;
+      case kTypedefChain:
+        if (!parse(argument, opt_synthetic.typedef_chain)) {
+          std::cerr << "invalid typedef chain length: " << argument << '\n';
+          return usage();
+        }
+        break;
+      case kDuplicates:
+        if (!parse(argument, opt_synthetic.duplicate_percent)
+            || opt_synthetic.duplicate_percent > 100) {
+          std::cerr << "invalid duplicate percentage: " << argument << '\n';
+          return usage();
+        }
+        break;
+      case kSeed:
+        if (!parse(argument, opt_synthetic.seed)) {
+          std::cerr << "invalid seed: " << argument << '\n';
+          return usage();
+        }
+        break;
+      case 'o':
+        if (strcmp(argument, "-") == 0) {
+          argument = "/dev/stdout";
+        }
+        outputs.push_back(argument);
+        break;
+      case 'j':
+        if (!parse(argument, opt_jobs) || opt_jobs == 0) {
+          std::cerr << "invalid number of jobs: " << argument << '\n';
+          return usage();
+        }
+        break;
+      case kFormat:
+        if (strcmp(argument, "text") == 0) {
+          opt_output_format = stg::proto::Format::TEXT;
+        } else if (strcmp(argument, "binary") == 0) {
+          opt_output_format = stg::proto::Format::BINARY;
+        } else if (strcmp(argument, "sharded") == 0) {
+          opt_output_format = stg::proto::Format::SHARDED;
+        } else {
+          std::cerr << "unknown output format: " << argument << '\n';
+          return usage();
+        }
+        break;
+      case kCompress:
+        opt_compression = stg::proto::Compression::GZIP;
+        break;
+      default:
+        return usage();
+    }
+  }
+  if (optind != argc) {
+    return usage();
+  }
+
+  if (opt_compression != stg::proto::Compression::NONE
+      && opt_output_format == stg::proto::Format::SHARDED) {
+    std::cerr << "sharded output cannot be compressed\n";
+    return usage();
+  }
+
+  try {
+    stg::Graph graph;
+    stg::Metrics metrics;
+    const stg::Id root = [&]() {
+      const stg::Time synthesise(metrics, "synthesise");
+      stg::Counter nodes(metrics, "synthesise.nodes");
+      const stg::Id id = stg::Synthesise(graph, opt_synthetic);
+      nodes = graph.Limit().ix_;
+      return id;
+    }();
+    // the output is deliberately left with its duplicates
+    const stg::StableHashCache stable_hashes;
+    stg::Write(graph, root, outputs, opt_output_format, opt_compression,
+               stable_hashes, false, false, metrics, opt_jobs);
+    if (opt_metrics) {
+      stg::Report(metrics, std::cerr);
+    }
+    return 0;
+  } catch (const stg::Exception& e) {
+    std::cerr << e.what() << '\n';
+    return 1;
+  }
+}
@@ -20,9 +20,9 @@
 #ifndef STG_SUBSTITUTION_H_
 #define STG_SUBSTITUTION_H_
 
-#include <map>
 #include <vector>
 
+#include "flat_map.h"
 #include "graph.h"
 
 namespace stg {
@@ -45,14 +45,14 @@ struct Substitute {
     updater(id);
   }
 
-  void Update(std::vector<Id>& ids) const {
+  void Update(Ids& ids) const {
     for (auto& id : ids) {
       Update(id);
     }
   }
 
   template <typename Key>
-  void Update(std::map<Key, Id>& ids) const {
+  void Update(FlatMap<Key, Id>& ids) const {
     for (auto& [key, id] : ids) {
       Update(id);
     }
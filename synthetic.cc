@@ -0,0 +1,176 @@
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+// -*- mode: C++ -*-
+//
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License v2.0 with LLVM Exceptions (the
+// "License"); you may not use this file except in compliance with the
+// License.  You may obtain a copy of the License at
+//
+//     https://llvm.org/LICENSE.txt
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "synthetic.h"
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <optional>
+#include <random>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include "error.h"
+#include "graph.h"
+
+namespace stg {
+
+namespace {
+
+// The engine's output is fully specified by the standard, unlike that of the
+// standard distributions, so values are taken from it directly.
+class Random {
+ public:
+  explicit Random(uint64_t seed) : engine_(seed) {}
+
+  // uniform in [0, bound)
+  size_t Below(size_t bound) {
+    return static_cast<size_t>(engine_() % bound);
+  }
+
+ private:
+  std::mt19937_64 engine_;
+};
+
+struct Synthesiser {
+  Synthesiser(Graph& graph, const SyntheticOptions& options)
+      : graph(graph), options(options), random(options.seed) {}
+
+  Id operator()() {
+    Check(options.fan_out > 1) << "synthetic structs need at least two members";
+    Check(options.max_scc_size > 0) << "synthetic SCCs need at least one node";
+    const size_t size = options.symbols;
+    structs.reserve(size);
+    pointers.reserve(size);
+    for (size_t i = 0; i < size; ++i) {
+      const Id id = graph.Allocate();
+      structs.push_back(id);
+      pointers.push_back(
+          graph.Add<PointerReference>(PointerReference::Kind::POINTER, id));
+    }
+    // each run of structs is a cycle, with references to earlier runs
+    std::vector<Id> used;
+    used.reserve(size);
+    for (size_t start = 0; start < size;) {
+      const size_t run =
+          std::min(1 + random.Below(options.max_scc_size), size - start);
+      for (size_t i = start; i < start + run; ++i) {
+        const size_t next = start + (i - start + 1) % run;
+        const auto targets = Targets(start, next);
+        Define(structs[i], i, targets);
+        Id definition = structs[i];
+        if (random.Below(100) < options.duplicate_percent) {
+          definition = graph.Allocate();
+          Define(definition, i, targets);
+        }
+        used.push_back(definition);
+      }
+      start += run;
+    }
+    std::map<std::string, Id> symbols;
+    for (size_t i = 0; i < size; ++i) {
+      Id type = used[i];
+      for (size_t link = 0; link < options.typedef_chain; ++link) {
+        type = graph.Add<Typedef>(
+            "struct_" + std::to_string(i) + "_t" + std::to_string(link), type);
+      }
+      const bool function = i % 2 == 0;
+      if (function) {
+        const Id pointer =
+            graph.Add<PointerReference>(PointerReference::Kind::POINTER, type);
+        type = graph.Add<Function>(GetPrimitive(0), Ids{pointer});
+      }
+      const std::string name =
+          (function ? "function_" : "variable_") + std::to_string(i);
+      symbols.emplace(name, graph.Add<ElfSymbol>(
+          name, std::nullopt, true,
+          function ? ElfSymbol::SymbolType::FUNCTION
+                   : ElfSymbol::SymbolType::OBJECT,
+          ElfSymbol::Binding::GLOBAL, ElfSymbol::Visibility::DEFAULT,
+          std::nullopt, std::nullopt, type, std::nullopt));
+    }
+    return graph.Add<Interface>(symbols);
+  }
+
+  // Primitive types are added on first use, so that none is unreachable.
+  Id GetPrimitive(size_t index) {
+    static const std::array<std::tuple<const char*, Primitive::Encoding,
+                                       uint32_t>, 4> kPrimitives = {{
+        {"int", Primitive::Encoding::SIGNED_INTEGER, 4},
+        {"long", Primitive::Encoding::SIGNED_INTEGER, 8},
+        {"char", Primitive::Encoding::SIGNED_CHARACTER, 1},
+        {"double", Primitive::Encoding::REAL_NUMBER, 8},
+    }};
+    auto& primitive = primitives[index];
+    if (!primitive) {
+      const auto& [name, encoding, bytesize] = kPrimitives[index];
+      primitive = graph.Add<Primitive>(name, encoding, bytesize);
+    }
+    return *primitive;
+  }
+
+  Id RandomPrimitive() {
+    return GetPrimitive(random.Below(primitives.size()));
+  }
+
+  // Chooses the member types of a struct in the run starting at start. The
+  // second member continues the cycle to next.
+  std::vector<Id> Targets(size_t start, size_t next) {
+    std::vector<Id> targets;
+    targets.reserve(options.fan_out);
+    targets.push_back(RandomPrimitive());
+    targets.push_back(pointers[next]);
+    for (size_t j = 2; j < options.fan_out; ++j) {
+      targets.push_back(start > 0 ? pointers[random.Below(start)]
+                                  : RandomPrimitive());
+    }
+    return targets;
+  }
+
+  void Define(Id id, size_t index, const std::vector<Id>& targets) {
+    Ids members;
+    members.reserve(targets.size());
+    for (size_t j = 0; j < targets.size(); ++j) {
+      members.push_back(graph.Add<Member>(
+          "member_" + std::to_string(j), targets[j], 64 * j, 0));
+    }
+    graph.Set<StructUnion>(id, StructUnion::Kind::STRUCT,
+                           "struct_" + std::to_string(index),
+                           8 * targets.size(), Ids{}, Ids{},
+                           std::move(members));
+  }
+
+  Graph& graph;
+  const SyntheticOptions& options;
+  Random random;
+  std::array<std::optional<Id>, 4> primitives;
+  std::vector<Id> structs;
+  std::vector<Id> pointers;
+};
+
+}  // namespace
+
+Id Synthesise(Graph& graph, const SyntheticOptions& options) {
+  return Synthesiser(graph, options)();
+}
+
+}  // namespace stg
@@ -0,0 +1,57 @@
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+// -*- mode: C++ -*-
+//
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License v2.0 with LLVM Exceptions (the
+// "License"); you may not use this file except in compliance with the
+// License.  You may obtain a copy of the License at
+//
+//     https://llvm.org/LICENSE.txt
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef STG_SYNTHETIC_H_
+#define STG_SYNTHETIC_H_
+
+#include <cstddef>
+#include <cstdint>
+
+#include "graph.h"
+
+namespace stg {
+
+// The size and shape of a synthetic ABI.
+//
+// Every symbol has a struct of its own, with fan_out members. The first member
+// has a primitive type and the rest are pointers to structs. The structs are
+// grouped into runs of between 1 and max_scc_size, each of which is made into a
+// cycle by its second members; other pointers only go to earlier runs. So each
+// run of n structs is an SCC of 3n nodes (struct, member and pointer). The
+// symbols refer to their structs through a chain of typedefs. Some structs are
+// defined twice, as if seen in two translation units, and the second
+// definition is used by the symbol, giving deduplication work to do. Every node
+// is reachable from the root.
+struct SyntheticOptions {
+  // half are functions taking a pointer to their type, half are variables
+  size_t symbols = 1024;
+  // at least 2
+  size_t fan_out = 4;
+  size_t max_scc_size = 8;
+  size_t typedef_chain = 1;
+  // percentage of structs that are defined twice
+  size_t duplicate_percent = 25;
+  // the same seed and options always give the same graph
+  uint64_t seed = 0;
+};
+
+// Adds a synthetic ABI to the graph, returning its root.
+Id Synthesise(Graph& graph, const SyntheticOptions& options);
+
+}  // namespace stg
+
+#endif  // STG_SYNTHETIC_H_
@@ -0,0 +1,115 @@
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+// -*- mode: C++ -*-
+//
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License v2.0 with LLVM Exceptions (the
+// "License"); you may not use this file except in compliance with the
+// License.  You may obtain a copy of the License at
+//
+//     https://llvm.org/LICENSE.txt
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "synthetic.h"
+
+#include <cstddef>
+#include <sstream>
+#include <string>
+
+#include <catch2/catch.hpp>
+#include "graph.h"
+#include "metrics.h"
+#include "pipeline.h"
+#include "proto_writer.h"
+#include "stable_hash.h"
+#include "statistics.h"
+
+namespace Test {
+
+std::string Write(const stg::Graph& graph, stg::Id root) {
+  std::ostringstream os;
+  stg::proto::Writer(graph).Write(root, os);
+  return os.str();
+}
+
+TEST_CASE("synthetic shape") {
+  const size_t max_scc_size = GENERATE(1, 2, 5);
+  const size_t typedef_chain = GENERATE(0, 3);
+  stg::SyntheticOptions options;
+  options.symbols = 200;
+  options.fan_out = 3;
+  options.max_scc_size = max_scc_size;
+  options.typedef_chain = typedef_chain;
+  stg::Graph graph;
+  const auto root = stg::Synthesise(graph, options);
+  const auto statistics = stg::GetStatistics(graph, root);
+  CHECK(statistics.nodes.at("elf_symbol") == 200);
+  CHECK(statistics.nodes.at("function") == 100);
+  if (typedef_chain > 0) {
+    CHECK(statistics.nodes.at("typedef") == 200 * typedef_chain);
+  } else {
+    CHECK(!statistics.nodes.contains("typedef"));
+  }
+  const size_t structs = statistics.nodes.at("struct_union");
+  CHECK(structs > 200);
+  CHECK(structs < 400);
+  CHECK(statistics.nodes.at("member") == 3 * structs);
+  CHECK(statistics.reachable == graph.Limit().ix_);
+  // the first definition of every struct is in a cycle of struct, member and
+  // pointer nodes
+  size_t in_cycles = 0;
+  for (const auto& [size, count] : statistics.scc_sizes) {
+    if (size > 1) {
+      CHECK(size % 3 == 0);
+      CHECK(size <= 3 * max_scc_size);
+      in_cycles += size / 3 * count;
+    }
+  }
+  CHECK(in_cycles == 200);
+}
+
+TEST_CASE("synthetic determinism") {
+  stg::SyntheticOptions options;
+  options.symbols = 100;
+  stg::Graph graph1;
+  const auto root1 = stg::Synthesise(graph1, options);
+  stg::Graph graph2;
+  const auto root2 = stg::Synthesise(graph2, options);
+  CHECK(Write(graph1, root1) == Write(graph2, root2));
+  options.seed = 1;
+  stg::Graph graph3;
+  const auto root3 = stg::Synthesise(graph3, options);
+  CHECK(Write(graph1, root1) != Write(graph3, root3));
+}
+
+TEST_CASE("synthetic duplicates") {
+  const size_t duplicate_percent = GENERATE(0, 50, 100);
+  stg::SyntheticOptions options;
+  options.symbols = 300;
+  options.duplicate_percent = duplicate_percent;
+  stg::Graph graph;
+  auto root = stg::Synthesise(graph, options);
+  const size_t structs =
+      stg::GetStatistics(graph, root).nodes.at("struct_union");
+  if (duplicate_percent == 0) {
+    CHECK(structs == 300);
+  } else if (duplicate_percent == 100) {
+    CHECK(structs == 600);
+  } else {
+    CHECK(structs > 300);
+    CHECK(structs < 600);
+  }
+  // every duplicate definition is found
+  stg::Metrics metrics;
+  stg::StableHashCache stable_hashes;
+  root = stg::ResolveAndDeduplicate(graph, root, false, stable_hashes, metrics,
+                                    1);
+  CHECK(stg::GetStatistics(graph, root).nodes.at("struct_union") == 300);
+}
+
+}  // namespace Test
@@ -0,0 +1,5 @@
+struct T;
+
+struct T *get(void) {
+  return 0;
+}
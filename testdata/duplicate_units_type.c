@@ -0,0 +1 @@
+struct T { long y; };
@@ -0,0 +1,5 @@
+struct S;
+
+struct S *get(void) {
+  return 0;
+}
@@ -0,0 +1,5 @@
+struct S {
+  int x;
+};
+
+__attribute__((used)) static struct S instance;
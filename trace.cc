@@ -0,0 +1,116 @@
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+// -*- mode: C++ -*-
+//
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License v2.0 with LLVM Exceptions (the
+// "License"); you may not use this file except in compliance with the
+// License.  You may obtain a copy of the License at
+//
+//     https://llvm.org/LICENSE.txt
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "trace.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <ostream>
+#include <vector>
+
+#include "error.h"
+
+namespace stg {
+namespace trace {
+
+namespace {
+
+struct Event {
+  const char* name;
+  uint64_t start;
+  uint64_t duration;
+  size_t thread;
+};
+
+std::atomic<bool> enabled = false;
+std::chrono::steady_clock::time_point epoch;
+std::mutex mutex;
+std::vector<Event> events;
+std::atomic<size_t> threads = 0;
+
+// Small, stable thread numbers, in order of first recorded span.
+size_t Thread() {
+  thread_local const size_t thread = threads++;
+  return thread;
+}
+
+void WriteString(std::ostream& os, const char* string) {
+  os << '"';
+  for (const char* c = string; *c; ++c) {
+    if (*c == '"' || *c == '\\') {
+      os << '\\';
+    }
+    os << *c;
+  }
+  os << '"';
+}
+
+}  // namespace
+
+void Enable() {
+  epoch = std::chrono::steady_clock::now();
+  enabled.store(true, std::memory_order_release);
+}
+
+bool Enabled() {
+  return enabled.load(std::memory_order_acquire);
+}
+
+uint64_t Now() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now() - epoch).count();
+}
+
+void Record(const char* name, uint64_t start, uint64_t finish) {
+  const size_t thread = Thread();
+  const std::lock_guard<std::mutex> lock(mutex);
+  events.push_back({name, start, finish - start, thread});
+}
+
+void Write(std::ostream& os) {
+  const std::lock_guard<std::mutex> lock(mutex);
+  os << R"({"displayTimeUnit":"ms","traceEvents":[)";
+  bool separate = false;
+  for (const auto& event : events) {
+    if (separate) {
+      os << ',';
+    } else {
+      separate = true;
+    }
+    os << R"({"name":)";
+    WriteString(os, event.name);
+    os << R"(,"ph":"X","pid":1,"tid":)" << event.thread
+       << R"(,"ts":)" << event.start << R"(,"dur":)" << event.duration << '}';
+  }
+  os << "]}\n";
+}
+
+void Write(const char* filename) {
+  std::ofstream os(filename);
+  Write(os);
+  os << std::flush;
+  if (!os) {
+    Die() << "error writing to " << '\'' << filename << '\'';
+  }
+}
+
+}  // namespace trace
+}  // namespace stg
@@ -0,0 +1,67 @@
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+// -*- mode: C++ -*-
+//
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License v2.0 with LLVM Exceptions (the
+// "License"); you may not use this file except in compliance with the
+// License.  You may obtain a copy of the License at
+//
+//     https://llvm.org/LICENSE.txt
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef STG_TRACE_H_
+#define STG_TRACE_H_
+
+#include <cstdint>
+#include <ostream>
+
+namespace stg {
+namespace trace {
+
+// Optional recording of spans, for viewing in Perfetto or chrome://tracing.
+//
+// Recording is off by default and, when off, a Span costs one atomic load.
+// Spans may be recorded from any thread. Names must outlive the recording, so
+// are normally string literals.
+
+// Starts recording spans.
+void Enable();
+
+bool Enabled();
+
+// Writes the spans recorded so far in Chrome trace event JSON format.
+void Write(std::ostream& os);
+void Write(const char* filename);
+
+// Microseconds since recording was enabled.
+uint64_t Now();
+
+void Record(const char* name, uint64_t start, uint64_t finish);
+
+// Records a span covering its lifetime, if recording is enabled.
+class Span {
+ public:
+  explicit Span(const char* name)
+      : name_(name), enabled_(Enabled()), start_(enabled_ ? Now() : 0) {}
+  ~Span() {
+    if (enabled_) {
+      Record(name_, start_, Now());
+    }
+  }
+
+ private:
+  const char* name_;
+  bool enabled_;
+  uint64_t start_;
+};
+
+}  // namespace trace
+}  // namespace stg
+
+#endif  // STG_TRACE_H_
@@ -0,0 +1,49 @@
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+// -*- mode: C++ -*-
+//
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License v2.0 with LLVM Exceptions (the
+// "License"); you may not use this file except in compliance with the
+// License.  You may obtain a copy of the License at
+//
+//     https://llvm.org/LICENSE.txt
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "trace.h"
+
+#include <sstream>
+#include <string>
+#include <thread>
+
+#include <catch2/catch.hpp>
+
+namespace Test {
+
+TEST_CASE("trace") {
+  // spans are only recorded once enabled
+  { const stg::trace::Span span("before"); }
+  CHECK(!stg::trace::Enabled());
+  stg::trace::Enable();
+  CHECK(stg::trace::Enabled());
+  { const stg::trace::Span span("main"); }
+  std::thread([]() { const stg::trace::Span span("other"); }).join();
+
+  std::ostringstream os;
+  stg::trace::Write(os);
+  const std::string trace = os.str();
+  CHECK(trace.find(R"("before")") == std::string::npos);
+  CHECK(trace.find(R"({"name":"main","ph":"X","pid":1,"tid":0,)")
+        != std::string::npos);
+  CHECK(trace.find(R"({"name":"other","ph":"X","pid":1,"tid":1,)")
+        != std::string::npos);
+  CHECK(trace.rfind(R"({"displayTimeUnit":"ms","traceEvents":[)", 0) == 0);
+  CHECK(trace.back() == '\n');
+}
+
+}  // namespace Test
@@ -19,13 +19,17 @@
 
 #include "type_normalisation.h"
 
-#include <map>
+#include <algorithm>
+#include <cstddef>
 #include <string>
 #include <unordered_map>
-#include <unordered_set>
 #include <vector>
 
+#include "error.h"
+#include "flat_map.h"
 #include "graph.h"
+#include "metrics.h"
+#include "parallel.h"
 
 namespace stg {
 
@@ -60,29 +64,32 @@ struct ResolveQualifiedChain {
 
 // Traverse rooted graph and produce mapping from qualified type to
 // non-qualified. Produced keys should not intersect with values.
-// It also collects all functions seen during traversal.
+// It also collects all functions seen during traversal, each once.
 struct FindQualifiedTypesAndFunctions {
   FindQualifiedTypesAndFunctions(const Graph& graph,
                                  std::unordered_map<Id, Id>& resolved,
-                                 std::unordered_set<Id>& functions)
+                                 std::vector<Id>& functions)
       : graph(graph),
         resolved(resolved),
         functions(functions),
-        resolve_qualified_chain(graph, resolved) {}
+        seen(Id(0)),
+        resolve_qualified_chain(graph, resolved) {
+    seen.Reserve(graph.Limit());
+  }
 
   void operator()(Id id) {
-    if (seen.insert(id).second) {
+    if (seen.Insert(id)) {
       graph.Apply<void>(*this, id, id);
     }
   }
 
-  void operator()(const std::vector<Id>& ids) {
+  void operator()(const Ids& ids) {
     for (const auto& id : ids) {
       (*this)(id);
     }
   }
 
-  void operator()(const std::map<std::string, Id>& x) {
+  void operator()(const FlatMap<std::string, Id>& x) {
     for (const auto& [_, id] : x) {
       (*this)(id);
     }
@@ -142,7 +149,7 @@ struct FindQualifiedTypesAndFunctions {
   }
 
   void operator()(const Function& x, Id node_id) {
-    functions.emplace(node_id);
+    functions.push_back(node_id);
     for (auto& id : x.parameters) {
       (*this)(id);
     }
@@ -162,14 +169,15 @@ struct FindQualifiedTypesAndFunctions {
 
   const Graph& graph;
   std::unordered_map<Id, Id>& resolved;
-  std::unordered_set<Id>& functions;
-  std::unordered_set<Id> seen;
+  std::vector<Id>& functions;
+  DenseIdSet seen;
   ResolveQualifiedChain resolve_qualified_chain;
 };
 
 // Remove qualifiers from function parameters and return type.
 // "resolved" mapping should have resolutions from qualified type to
-// non-qualified. Thus, keys and values should not intersect.
+// non-qualified. Thus, keys and values should not intersect. Distinct functions
+// may be rewritten concurrently as the mapping is only read.
 struct RemoveFunctionQualifiers {
   RemoveFunctionQualifiers(Graph& graph,
                            const std::unordered_map<Id, Id>& resolved)
@@ -203,17 +211,36 @@ struct RemoveFunctionQualifiers {
   const std::unordered_map<Id, Id>& resolved;
 };
 
+// Below this many functions per worker, threads are not worth starting.
+constexpr size_t kFunctionsPerShard = 1024;
+
 }  // namespace
 
-void RemoveUselessQualifiers(Graph& graph, Id root) {
+void RemoveUselessQualifiers(Graph& graph, Id root, Metrics& metrics,
+                             size_t jobs) {
+  Time time(metrics, "qualifiers.remove");
   std::unordered_map<Id, Id> resolved;
-  std::unordered_set<Id> functions;
+  std::vector<Id> functions;
   FindQualifiedTypesAndFunctions(graph, resolved, functions)(root);
+  Counter(metrics, "qualifiers.functions") = functions.size();
+
+  // Each worker takes a contiguous shard of the functions.
+  const size_t shards =
+      std::min(jobs, (functions.size() + kFunctionsPerShard - 1)
+                     / kFunctionsPerShard);
+  ForEachIndex(jobs, shards, [&](size_t, size_t shard) {
+    RemoveFunctionQualifiers remove_qualifiers(graph, resolved);
+    const size_t begin = shard * functions.size() / shards;
+    const size_t end = (shard + 1) * functions.size() / shards;
+    for (size_t ix = begin; ix < end; ++ix) {
+      remove_qualifiers(functions[ix]);
+    }
+  });
+}
 
-  RemoveFunctionQualifiers remove_qualifiers(graph, resolved);
-  for (const auto& id : functions) {
-    remove_qualifiers(id);
-  }
+void RemoveUselessQualifiers(Graph& graph, Id root) {
+  Metrics metrics;
+  RemoveUselessQualifiers(graph, root, metrics, 1);
 }
 
 }  // namespace stg
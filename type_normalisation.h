@@ -20,10 +20,19 @@
 #ifndef STG_TYPE_NORMALISATION_H_
 #define STG_TYPE_NORMALISATION_H_
 
+#include <cstddef>
+
 #include "graph.h"
+#include "metrics.h"
 
 namespace stg {
 
+// Removes qualifiers from function parameter and return types, where they have
+// no effect. The function rewrites are spread over at most jobs workers.
+void RemoveUselessQualifiers(Graph& graph, Id root, Metrics& metrics,
+                             size_t jobs);
+
+// As above, serially and without recording metrics.
 void RemoveUselessQualifiers(Graph& graph, Id root);
 
 }  // namespace stg
@@ -19,14 +19,26 @@
 
 #include "type_resolution.h"
 
+#include <algorithm>
+#include <atomic>
 #include <cstddef>
-#include <map>
+#include <cstdint>
+#include <memory_resource>
+#include <optional>
+#include <span>
 #include <string>
+#include <string_view>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
+#include "arena.h"
+#include "error.h"
+#include "flat_map.h"
 #include "graph.h"
+#include "hashing.h"
 #include "metrics.h"
+#include "parallel.h"
 #include "unification.h"
 
 namespace stg {
@@ -35,8 +47,10 @@ namespace {
 
 // Collect named type definition and declaration nodes.
 struct NamedTypes {
-  NamedTypes(const Graph& graph, Metrics& metrics)
+  NamedTypes(const Graph& graph, std::pmr::memory_resource* resource,
+             Metrics& metrics)
       : graph(graph),
+        type_info(resource),
         seen(Id(0)),
         nodes(metrics, "named_types.nodes"),
         types(metrics, "named_types.types"),
@@ -46,19 +60,29 @@ struct NamedTypes {
   }
 
   enum class Tag { STRUCT, UNION, ENUM, TYPEDEF };
-  using Type = std::pair<Tag, std::string>;
+  // names are interned by the graph, so views of them are kept
+  using Type = std::pair<Tag, std::string_view>;
+  struct TypeHash {
+    size_t operator()(const Type& type) const {
+      return Hash64()(static_cast<uint32_t>(type.first), type.second).value;
+    }
+  };
   struct Info {
-    std::vector<Id> definitions;
-    std::vector<Id> declarations;
+    using allocator_type = std::pmr::polymorphic_allocator<>;
+    explicit Info(const allocator_type& allocator)
+        : definitions(allocator), declarations(allocator) {}
+
+    std::pmr::vector<Id> definitions;
+    std::pmr::vector<Id> declarations;
   };
 
-  void operator()(const std::vector<Id>& ids) {
+  void operator()(const Ids& ids) {
     for (auto id : ids) {
       (*this)(id);
     }
   }
 
-  void operator()(const std::map<std::string, Id>& x) {
+  void operator()(const FlatMap<std::string, Id>& x) {
     for (const auto& [_, id] : x) {
       (*this)(id);
     }
@@ -72,8 +96,8 @@ struct NamedTypes {
     }
   }
 
-  Info& GetInfo(Tag tag, const std::string& name) {
-    auto [it, inserted] = type_info.insert({{tag, name}, {}});
+  Info& GetInfo(Tag tag, std::string_view name) {
+    auto [it, inserted] = type_info.try_emplace({tag, name});
     if (inserted) {
       ++types;
     }
@@ -173,8 +197,8 @@ struct NamedTypes {
   }
 
   const Graph& graph;
-  // ordered map for consistency and sequential processing of related types
-  std::map<Type, Info> type_info;
+  // sorted before processing, for consistency
+  std::pmr::unordered_map<Type, Info, TypeHash> type_info;
   DenseIdSet seen;
   Counter nodes;
   Counter types;
@@ -182,14 +206,221 @@ struct NamedTypes {
   Counter declarations;
 };
 
+// Fewer named types than this are resolved serially, as the trials would cost
+// more than they save.
+constexpr size_t kConcurrentTypes = 256;
+
+// Hashes the parts of a type definition that unification requires to be equal,
+// following edges to a limited depth. Beneath the definition itself, struct,
+// union and enum types are hashed only by kind and name, as a declaration
+// unifies with any definition, and typedefs only by name. Definitions that can
+// be unified therefore always have the same shape.
+struct Shape {
+  explicit Shape(const Graph& graph) : graph(graph) {}
+
+  // main entry point
+  HashValue64 operator()(Id id) {
+    return graph.Apply<HashValue64>(definition, id);
+  }
+
+  HashValue64 operator()(Id id, size_t depth) {
+    return depth == 0 ? HashValue64(0)
+                      : graph.Apply<HashValue64>(*this, id, depth - 1);
+  }
+
+  HashValue64 operator()(const Ids& ids, size_t depth) {
+    auto h = hash(ids.size());
+    for (const auto& id : ids) {
+      h = hash(h, (*this)(id, depth));
+    }
+    return h;
+  }
+
+  HashValue64 operator()(const Special& x, size_t) {
+    return hash('O', static_cast<uint32_t>(x.kind));
+  }
+
+  HashValue64 operator()(const PointerReference& x, size_t depth) {
+    return hash('P', static_cast<uint32_t>(x.kind),
+                (*this)(x.pointee_type_id, depth));
+  }
+
+  HashValue64 operator()(const PointerToMember& x, size_t depth) {
+    return hash('N', (*this)(x.containing_type_id, depth),
+                (*this)(x.pointee_type_id, depth));
+  }
+
+  HashValue64 operator()(const Typedef& x, size_t) {
+    return hash('T', x.name);
+  }
+
+  HashValue64 operator()(const Qualified& x, size_t depth) {
+    return hash('Q', static_cast<uint32_t>(x.qualifier),
+                (*this)(x.qualified_type_id, depth));
+  }
+
+  HashValue64 operator()(const Primitive& x, size_t) {
+    return hash('i', x.name, x.encoding.has_value(),
+                static_cast<uint32_t>(x.encoding.value_or(
+                    Primitive::Encoding::BOOLEAN)),
+                x.bytesize);
+  }
+
+  HashValue64 operator()(const Array& x, size_t depth) {
+    return hash('A', x.number_of_elements, (*this)(x.element_type_id, depth));
+  }
+
+  HashValue64 operator()(const BaseClass& x, size_t depth) {
+    return hash('B', x.offset, static_cast<uint32_t>(x.inheritance),
+                (*this)(x.type_id, depth));
+  }
+
+  HashValue64 operator()(const Method& x, size_t depth) {
+    return hash('M', x.mangled_name, x.name, x.vtable_offset,
+                (*this)(x.type_id, depth));
+  }
+
+  HashValue64 operator()(const Member& x, size_t depth) {
+    return hash('D', x.name, x.offset, x.bitsize, (*this)(x.type_id, depth));
+  }
+
+  HashValue64 operator()(const StructUnion& x, size_t) {
+    return hash('U', static_cast<uint32_t>(x.kind), x.name);
+  }
+
+  HashValue64 operator()(const Enumeration& x, size_t) {
+    return hash('E', x.name);
+  }
+
+  HashValue64 operator()(const Function& x, size_t depth) {
+    return hash('F', (*this)(x.return_type_id, depth),
+                (*this)(x.parameters, depth));
+  }
+
+  HashValue64 operator()(const ElfSymbol&, size_t) {
+    return hash('S');
+  }
+
+  HashValue64 operator()(const Interface&, size_t) {
+    return hash('Z');
+  }
+
+  // Graph function for the definitions themselves
+  struct Definition {
+    HashValue64 operator()(const Typedef& x) {
+      return shape(x.referred_type_id, kDepth);
+    }
+
+    HashValue64 operator()(const StructUnion& x) {
+      const auto& definition = *x.definition;
+      return shape.hash(definition.bytesize,
+                        shape(definition.base_classes, kDepth),
+                        shape(definition.methods, kDepth),
+                        shape(definition.members, kDepth));
+    }
+
+    HashValue64 operator()(const Enumeration& x) {
+      const auto& definition = *x.definition;
+      auto h = shape(definition.underlying_type_id, kDepth);
+      for (const auto& [name, value] : definition.enumerators) {
+        h = shape.hash(h, name, value);
+      }
+      return h;
+    }
+
+    template <typename Node>
+    HashValue64 operator()(const Node&) {
+      Die() << "shape of a node that is not a named type definition";
+    }
+
+    Shape& shape;
+  };
+
+  // deep enough to see the members' types and what they point to
+  static constexpr size_t kDepth = 3;
+
+  const Graph& graph;
+  Definition definition{*this};
+  Hash64 hash;
+};
+
+// Returns the definitions grouped by shape, in order of first appearance. Only
+// definitions within a group can possibly be unified.
+std::vector<std::vector<Id>> Bucket(Shape& shape,
+                                    std::span<const Id> definitions) {
+  std::vector<std::vector<Id>> buckets;
+  if (definitions.size() <= 1) {
+    if (!definitions.empty()) {
+      buckets.emplace_back(definitions.begin(), definitions.end());
+    }
+    return buckets;
+  }
+  std::unordered_map<HashValue64, size_t> index;
+  for (const auto& id : definitions) {
+    const auto [it, inserted] = index.emplace(shape(id), buckets.size());
+    if (inserted) {
+      buckets.emplace_back();
+    }
+    buckets[it->second].push_back(id);
+  }
+  return buckets;
+}
+
+// The outcomes of resolving one named type.
+struct Outcomes {
+  size_t definition_unified = 0;
+  size_t definition_not_unified = 0;
+  size_t declaration_unified = 0;
+  size_t definition_shapes = 0;
+};
+
+// Unifies the definitions of a named type, of the same shape, and maps all the
+// declarations to the definition, if there is only one. The target is either a
+// Unification or a trial of one.
+template <typename Target>
+Outcomes Resolve(Shape& shape, const NamedTypes::Info& info, Target& target) {
+  Outcomes outcomes;
+  std::vector<Id> distinct_definitions;
+  for (auto& definitions : Bucket(shape, info.definitions)) {
+    ++outcomes.definition_shapes;
+    while (!definitions.empty()) {
+      const Id candidate = definitions[0];
+      std::vector<Id> todo;
+      distinct_definitions.push_back(candidate);
+      for (size_t i = 1; i < definitions.size(); ++i) {
+        if (target.Unify(definitions[i], candidate)) {
+          // unification succeeded
+          ++outcomes.definition_unified;
+        } else {
+          // unification failed, conflicting definitions
+          todo.push_back(definitions[i]);
+          ++outcomes.definition_not_unified;
+        }
+      }
+      std::swap(todo, definitions);
+    }
+  }
+  // if no conflicts, map all declarations to the definition
+  if (distinct_definitions.size() == 1) {
+    const Id candidate = distinct_definitions[0];
+    for (auto id : info.declarations) {
+      target.Union(id, candidate);
+      ++outcomes.declaration_unified;
+    }
+  }
+  return outcomes;
+}
+
 }  // namespace
 
 void ResolveTypes(Graph& graph, Unification& unification,
-                  const std::vector<Id>& roots, Metrics& metrics) {
+                  const std::vector<Id>& roots, Metrics& metrics,
+                  size_t jobs) {
   const Time total(metrics, "resolve.total");
 
-  // collect named types
-  NamedTypes named_types(graph, metrics);
+  // collect named types, whose records all die with this phase
+  Arena arena(metrics, "resolve.arena_bytes");
+  NamedTypes named_types(graph, arena.Resource(), metrics);
   {
     const Time time(metrics, "resolve.collection");
     for (const Id& root : roots) {
@@ -202,34 +433,64 @@ void ResolveTypes(Graph& graph, Unification& unification,
     Counter definition_unified(metrics, "resolve.definition.unified");
     Counter definition_not_unified(metrics, "resolve.definition.not_unified");
     Counter declaration_unified(metrics, "resolve.declaration.unified");
-    for (auto& [_, info] : named_types.type_info) {
-      // try to unify the type definitions
-      auto& definitions = info.definitions;
-      std::vector<Id> distinct_definitions;
-      while (!definitions.empty()) {
-        const Id candidate = definitions[0];
-        std::vector<Id> todo;
-        distinct_definitions.push_back(candidate);
-        for (size_t i = 1; i < definitions.size(); ++i) {
-          if (unification.Unify(definitions[i], candidate)) {
-            // unification succeeded
-            ++definition_unified;
-          } else {
-            // unification failed, conflicting definitions
-            todo.push_back(definitions[i]);
-            ++definition_not_unified;
-          }
-        }
-        std::swap(todo, definitions);
+    Counter definition_shapes(metrics, "resolve.definition.shapes");
+    const auto record = [&](const Outcomes& outcomes) {
+      definition_unified += outcomes.definition_unified;
+      definition_not_unified += outcomes.definition_not_unified;
+      declaration_unified += outcomes.declaration_unified;
+      definition_shapes += outcomes.definition_shapes;
+    };
+    // process related types together, in a consistent order
+    std::vector<std::pair<const NamedTypes::Type*, NamedTypes::Info*>> infos;
+    infos.reserve(named_types.type_info.size());
+    for (auto& [type, info] : named_types.type_info) {
+      infos.emplace_back(&type, &info);
+    }
+    std::sort(infos.begin(), infos.end(), [](const auto& x, const auto& y) {
+      return *x.first < *y.first;
+    });
+    Shape shape(graph);
+    if (jobs <= 1 || infos.size() < kConcurrentTypes) {
+      for (const auto& [_, info] : infos) {
+        record(Resolve(shape, *info, unification));
       }
-      // if no conflicts, map all declarations to the definition
-      if (distinct_definitions.size() == 1) {
-        const Id candidate = distinct_definitions[0];
-        for (auto id : info.declarations) {
-          unification.Union(id, candidate);
-          ++declaration_unified;
+      return;
+    }
+
+    // resolve each type as a trial, concurrently, then commit the trials in
+    // order, resolving again any that have been invalidated by earlier ones
+    const size_t count = infos.size();
+    std::vector<std::optional<Unification::Trial>> trials(count);
+    std::vector<Outcomes> outcomes(count);
+    {
+      // worker metrics must outlive the workers
+      std::vector<Metrics> worker_metrics(jobs);
+      std::atomic<size_t> next = 0;
+      Workers utilisation(metrics, "resolve.unification.workers");
+      ForEachIndex(jobs, jobs, [&](size_t, size_t worker) {
+        const Time time(worker_metrics[worker], "resolve.unification.trials");
+        Shape shape(graph);
+        while (true) {
+          const size_t index = next++;
+          if (index >= count) {
+            break;
+          }
+          auto& trial = trials[index].emplace(unification);
+          outcomes[index] = Resolve(shape, *infos[index].second, trial);
         }
+      }, &utilisation);
+      MergeShards(worker_metrics, metrics);
+    }
+    const Time commit(metrics, "resolve.unification.commit");
+    Counter stale(metrics, "resolve.unification.stale");
+    for (size_t index = 0; index < count; ++index) {
+      if (trials[index]->Commit()) {
+        record(outcomes[index]);
+      } else {
+        ++stale;
+        record(Resolve(shape, *infos[index].second, unification));
       }
+      trials[index].reset();
     }
   }
 }
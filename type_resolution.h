@@ -20,6 +20,7 @@
 #ifndef STG_TYPE_RESOLUTION_H_
 #define STG_TYPE_RESOLUTION_H_
 
+#include <cstddef>
 #include <vector>
 
 #include "graph.h"
@@ -28,8 +29,16 @@
 
 namespace stg {
 
+// Unifies the definitions of each named type reachable from the roots and, if
+// they all agree, its declarations with the definition.
+//
+// With more than one job, the names are resolved concurrently as trials, which
+// are then committed in the same order as the serial resolution. A trial that
+// has been invalidated by an earlier one is resolved again, serially. The
+// result is identical.
 void ResolveTypes(Graph& graph, Unification& unification,
-                  const std::vector<Id>& roots, Metrics& metrics);
+                  const std::vector<Id>& roots, Metrics& metrics,
+                  size_t jobs = 1);
 
 }  // namespace stg
 
@@ -0,0 +1,151 @@
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+// -*- mode: C++ -*-
+//
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License v2.0 with LLVM Exceptions (the
+// "License"); you may not use this file except in compliance with the
+// License.  You may obtain a copy of the License at
+//
+//     https://llvm.org/LICENSE.txt
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "type_resolution.h"
+
+#include <cstddef>
+#include <map>
+#include <string>
+#include <variant>
+#include <vector>
+
+#include <catch2/catch.hpp>
+#include "graph.h"
+#include "metrics.h"
+#include "unification.h"
+
+namespace Test {
+
+using Kind = stg::StructUnion::Kind;
+
+std::map<std::string, size_t> Counts(const stg::Metrics& metrics) {
+  std::map<std::string, size_t> result;
+  for (const auto& metric : metrics) {
+    if (const auto* value = std::get_if<size_t>(&metric.value)) {
+      result[metric.name] = *value;
+    }
+  }
+  return result;
+}
+
+TEST_CASE("conflicting definitions") {
+  stg::Graph graph;
+  const auto i = graph.Add<stg::Primitive>(
+      "int", stg::Primitive::Encoding::SIGNED_INTEGER, 4);
+  const auto l = graph.Add<stg::Primitive>(
+      "long", stg::Primitive::Encoding::SIGNED_INTEGER, 8);
+  // struct u is declared in one place and defined in another
+  const auto u_declaration = graph.Add<stg::StructUnion>(Kind::STRUCT, "u");
+  const auto u_member = graph.Add<stg::Member>("x", i, 0, 0);
+  const auto u = graph.Add<stg::StructUnion>(
+      Kind::STRUCT, "u", 4, std::vector<stg::Id>{}, std::vector<stg::Id>{},
+      std::vector<stg::Id>{u_member});
+  const auto u_pointer = graph.Add<stg::PointerReference>(
+      stg::PointerReference::Kind::POINTER, u);
+  const auto u_declaration_pointer = graph.Add<stg::PointerReference>(
+      stg::PointerReference::Kind::POINTER, u_declaration);
+  // three definitions of struct s, two of which differ only in whether u is
+  // defined, and an incompatible one
+  const auto s = [&](stg::Id type, uint64_t bytesize) {
+    const auto member = graph.Add<stg::Member>("m", type, 0, 0);
+    return graph.Add<stg::StructUnion>(
+        Kind::STRUCT, "s", bytesize, std::vector<stg::Id>{},
+        std::vector<stg::Id>{}, std::vector<stg::Id>{member});
+  };
+  const auto s1 = s(u_pointer, 8);
+  const auto s2 = s(l, 8);
+  const auto s3 = s(u_declaration_pointer, 8);
+  const auto s_declaration = graph.Add<stg::StructUnion>(Kind::STRUCT, "s");
+  const auto root = graph.Add<stg::Interface>(
+      std::map<std::string, stg::Id>{},
+      std::map<std::string, stg::Id>{
+          {"s1", s1}, {"s2", s2}, {"s3", s3}, {"sd", s_declaration}});
+
+  stg::Metrics metrics;
+  stg::Unification unification(graph, stg::Id(0), metrics);
+  unification.Reserve(graph.Limit());
+  stg::ResolveTypes(graph, unification, {root}, metrics);
+  CHECK(unification.Find(s3) == unification.Find(s1));
+  CHECK(unification.Find(s2) != unification.Find(s1));
+  CHECK(unification.Find(u_declaration) == unification.Find(u));
+  // with conflicting definitions, the declaration is left alone
+  CHECK(unification.Find(s_declaration) == s_declaration);
+  const auto counts = Counts(metrics);
+  // s2 is never tried against s1, as its shape is different
+  CHECK(counts.at("resolve.definition.unified") == 1);
+  CHECK(counts.at("resolve.definition.not_unified") == 0);
+  CHECK(counts.at("resolve.definition.shapes") == 3);
+}
+
+TEST_CASE("concurrent resolution matches serial") {
+  // many names whose definitions are nested in each other's, so that some
+  // trials are invalidated by earlier ones
+  const size_t jobs = GENERATE(2, 3, 8);
+  const auto build = [](stg::Graph& graph) {
+    const auto i = graph.Add<stg::Primitive>(
+        "int", stg::Primitive::Encoding::SIGNED_INTEGER, 4);
+    // enough names to be resolved concurrently
+    const size_t names = 300;
+    const size_t copies = 4;
+    std::map<std::string, stg::Id> types;
+    for (size_t copy = 0; copy < copies; ++copy) {
+      stg::Id previous = i;
+      for (size_t n = 0; n < names; ++n) {
+        const auto name = "s" + std::to_string(n);
+        const auto declaration =
+            graph.Add<stg::StructUnion>(Kind::STRUCT, name);
+        const auto pointer = graph.Add<stg::PointerReference>(
+            stg::PointerReference::Kind::POINTER, previous);
+        // every third name has conflicting definitions
+        const auto member = graph.Add<stg::Member>(
+            "m", n % 3 == 0 && copy == 3 ? i : pointer, 0, 0);
+        previous = graph.Add<stg::StructUnion>(
+            Kind::STRUCT, name, 8, std::vector<stg::Id>{},
+            std::vector<stg::Id>{}, std::vector<stg::Id>{member});
+        types.emplace(name + "/" + std::to_string(copy), previous);
+        types.emplace(name + "/d" + std::to_string(copy), declaration);
+      }
+    }
+    return graph.Add<stg::Interface>(std::map<std::string, stg::Id>{}, types);
+  };
+  const auto resolve = [&](size_t jobs, stg::Metrics& metrics) {
+    stg::Graph graph;
+    const auto root = build(graph);
+    std::vector<stg::Id> representatives;
+    stg::Unification unification(graph, stg::Id(0), metrics);
+    unification.Reserve(graph.Limit());
+    stg::ResolveTypes(graph, unification, {root}, metrics, jobs);
+    for (size_t ix = 0; ix < graph.Limit().ix_; ++ix) {
+      representatives.push_back(unification.Find(stg::Id(ix)));
+    }
+    return representatives;
+  };
+  stg::Metrics serial_metrics;
+  stg::Metrics concurrent_metrics;
+  CHECK(resolve(1, serial_metrics) == resolve(jobs, concurrent_metrics));
+  const auto serial = Counts(serial_metrics);
+  const auto concurrent = Counts(concurrent_metrics);
+  for (const auto* name : {"resolve.definition.unified",
+                           "resolve.definition.not_unified",
+                           "resolve.declaration.unified"}) {
+    CHECK(serial.at(name) == concurrent.at(name));
+  }
+  CHECK(serial.at("resolve.definition.unified") > 0);
+  CHECK(concurrent.at("resolve.unification.stale") > 0);
+}
+
+}  // namespace Test
@@ -0,0 +1,259 @@
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+// -*- mode: C++ -*-
+//
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License v2.0 with LLVM Exceptions (the
+// "License"); you may not use this file except in compliance with the
+// License.  You may obtain a copy of the License at
+//
+//     https://llvm.org/LICENSE.txt
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "type_store.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <ios>
+#include <iterator>
+#include <ostream>
+#include <set>
+#include <string>
+#include <system_error>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "deduplication.h"
+#include "error.h"
+#include "fingerprint.h"
+#include "graph.h"
+#include "hashing.h"
+#include "input.h"
+#include "metrics.h"
+#include "proto_reader.h"
+#include "proto_writer.h"
+#include "substitution.h"
+
+namespace stg {
+
+namespace {
+
+void CheckName(const std::string& name) {
+  Check(!name.empty() && name != "." && name != ".."
+        && name.find('/') == std::string::npos)
+      << "invalid snapshot name: '" << name << "'";
+}
+
+// Writes a new file and moves it into place, so that readers never see a
+// partial one.
+void WriteFile(const std::filesystem::path& path,
+               const std::function<void(std::ostream&)>& write) {
+  const std::string temporary = path.string() + ".tmp";
+  {
+    std::ofstream output(temporary, std::ios::binary | std::ios::trunc);
+    write(output);
+    output.flush();
+    if (!output) {
+      Die() << "error writing type store file: '" << temporary << "'";
+    }
+  }
+  std::error_code error;
+  std::filesystem::rename(temporary, path, error);
+  if (error) {
+    Die() << "error renaming type store file: '" << temporary << "': "
+          << error.message();
+  }
+}
+
+}  // namespace
+
+TypeStore::TypeStore(Graph& graph, const std::string& directory,
+                     Metrics& metrics, size_t jobs)
+    : graph_(graph),
+      directory_(directory),
+      metrics_(metrics),
+      jobs_(jobs),
+      loaded_packs_(metrics, "type_store.loaded_packs"),
+      loaded_nodes_(metrics, "type_store.loaded_nodes"),
+      added_nodes_(metrics, "type_store.added_nodes") {}
+
+std::filesystem::path TypeStore::PackPath(size_t number,
+                                          const char* extension) const {
+  return directory_ / "packs" / (std::to_string(number) + extension);
+}
+
+std::filesystem::path TypeStore::ManifestPath(const std::string& name) const {
+  CheckName(name);
+  return directory_ / "snapshots" / name;
+}
+
+std::vector<size_t> TypeStore::ReadNeeds(size_t number) const {
+  const auto path = PackPath(number, ".needs");
+  std::ifstream input(path);
+  Check(input.good()) << "missing type store pack needs: '" << path.string()
+                      << "'";
+  const std::vector<size_t> needs{std::istream_iterator<size_t>(input),
+                                  std::istream_iterator<size_t>()};
+  Check(input.eof() && !needs.empty() && needs.back() == number
+        && std::is_sorted(needs.begin(), needs.end()))
+      << "bad type store pack needs: '" << path.string() << "'";
+  return needs;
+}
+
+// The packs needed are listed in ascending order and are closed under needing,
+// so each is loaded after all the packs it refers to.
+const TypeStore::Pack& TypeStore::Load(size_t number) {
+  if (const auto it = packs_.find(number); it != packs_.end()) {
+    return it->second;
+  }
+  auto needs = ReadNeeds(number);
+  for (const size_t need : needs) {
+    if (need != number) {
+      Load(need);
+    }
+  }
+  const Id start = graph_.Limit();
+  const Id root = proto::ReadExtension(
+      graph_, PackPath(number, ".stg").string(), ids_, jobs_);
+  const Id limit = graph_.Limit();
+  ++loaded_packs_;
+  loaded_nodes_ += limit.ix_ - start.ix_;
+  if (limit.ix_ > start.ix_) {
+    by_start_.emplace(start.ix_, number);
+  }
+  return packs_.emplace(number, Pack{start, limit, root, std::move(needs)})
+      .first->second;
+}
+
+const TypeStore::Pack& TypeStore::PackOf(Id id) const {
+  auto it = by_start_.upper_bound(id.ix_);
+  Check(it != by_start_.begin()) << "node not in type store: " << id;
+  const auto& pack = packs_.at(std::prev(it)->second);
+  Check(id.ix_ < pack.limit.ix_) << "node not in type store: " << id;
+  return pack;
+}
+
+Id TypeStore::Read(const std::string& name) {
+  Time time(metrics_, "type store read");
+  const auto path = ManifestPath(name);
+  std::ifstream input(path);
+  size_t number;
+  Check(static_cast<bool>(input >> number))
+      << "missing or bad type store snapshot: '" << path.string() << "'";
+  return Load(number).root;
+}
+
+Id TypeStore::Add(const std::string& name, Graph& snapshot, Id root) {
+  Time time(metrics_, "type store add");
+  const auto manifest = ManifestPath(name);
+  Check(!std::filesystem::exists(manifest))
+      << "snapshot already in type store: '" << name << "'";
+
+  // any node already stored may be shared
+  size_t number = 0;
+  while (std::filesystem::exists(PackPath(number, ".stg"))) {
+    Load(number);
+    ++number;
+  }
+  std::vector<Id> roots;
+  for (const auto& [_, pack] : packs_) {
+    roots.push_back(pack.root);
+  }
+
+  const Id start = graph_.Limit();
+  root = Move(snapshot, root, graph_);
+  snapshot = Graph();
+  roots.push_back(root);
+  {
+    Time x(metrics_, "type store fingerprint");
+    Fingerprint(graph_, roots, metrics_, jobs_, fingerprints_);
+  }
+  {
+    Time x(metrics_, "type store deduplicate");
+    root = DeduplicateAfter(graph_, start, root, fingerprints_, metrics_);
+  }
+  // Deduplication rewrote the new nodes, so their fingerprints are dropped.
+  // Those of the stored nodes are unaffected.
+  fingerprints_.EraseIf([&](Id id, HashValue64) {
+    return id.ix_ >= start.ix_;
+  });
+
+  // The pack needs the packs of the stored nodes the new ones refer to, and
+  // what those need.
+  std::set<size_t> needs = {number};
+  std::unordered_set<Id> seen;
+  std::vector<Id> todo;
+  const auto visit = [&](Id& id) {
+    if (id.ix_ < start.ix_) {
+      const auto& pack = PackOf(id);
+      needs.insert(pack.needs.begin(), pack.needs.end());
+    } else if (seen.insert(id).second) {
+      todo.push_back(id);
+    }
+  };
+  Id top = root;
+  visit(top);
+  Substitute substitute(graph_, visit);
+  while (!todo.empty()) {
+    const Id id = todo.back();
+    todo.pop_back();
+    substitute(id);
+  }
+
+  // write the pack, then what it needs, then the manifest naming it
+  std::unordered_map<Id, uint32_t> written;
+  written.reserve(ids_.size() + seen.size());
+  for (const auto& [external, id] : ids_) {
+    written.emplace(id, external);
+  }
+  std::filesystem::create_directories(directory_ / "packs");
+  std::filesystem::create_directories(directory_ / "snapshots");
+  {
+    Time x(metrics_, "type store write");
+    WriteFile(PackPath(number, ".stg"), [&](std::ostream& output) {
+      proto::Writer writer(graph_);
+      writer.Extend(written);
+      writer.Write(root, output, proto::Format::BINARY,
+                   /* record_stable_hashes = */ false,
+                   proto::Compression::NONE, /* canonical = */ true);
+    });
+  }
+  WriteFile(PackPath(number, ".needs"), [&](std::ostream& output) {
+    for (const size_t need : needs) {
+      output << need << '\n';
+    }
+  });
+  WriteFile(manifest, [&](std::ostream& output) {
+    output << number << '\n';
+  });
+
+  for (const Id id : seen) {
+    ids_.emplace(written.at(id), id);
+  }
+  added_nodes_ += seen.size();
+  by_start_.emplace(start.ix_, number);
+  packs_.emplace(number, Pack{start, graph_.Limit(), root,
+                              std::vector<size_t>(needs.begin(), needs.end())});
+  return root;
+}
+
+Id ReadStored(Graph& graph, const std::string& manifest, Metrics& metrics) {
+  const std::filesystem::path path(manifest);
+  Check(path.parent_path().filename() == "snapshots")
+      << "not a type store snapshot: '" << manifest << "'";
+  TypeStore store(graph, path.parent_path().parent_path().string(), metrics);
+  return store.Read(path.filename().string());
+}
+
+}  // namespace stg
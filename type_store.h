@@ -0,0 +1,104 @@
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+// -*- mode: C++ -*-
+//
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License v2.0 with LLVM Exceptions (the
+// "License"); you may not use this file except in compliance with the
+// License.  You may obtain a copy of the License at
+//
+//     https://llvm.org/LICENSE.txt
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef STG_TYPE_STORE_H_
+#define STG_TYPE_STORE_H_
+
+#include <cstddef>
+#include <filesystem>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "fingerprint.h"
+#include "graph.h"
+#include "metrics.h"
+#include "proto_reader.h"
+
+namespace stg {
+
+// A content-addressed store of ABI snapshots, which may share most of their
+// types.
+//
+// The store is a directory. Each snapshot added contributes a pack,
+// packs/<n>.stg, holding only the nodes the store did not already have, and a
+// manifest, snapshots/<name>, naming that pack. Throughout the store, nodes are
+// identified by their external ids, which are their stable hashes unless these
+// collide, and packs refer to the nodes of earlier packs by these ids. The
+// packs a pack needs, itself included, are listed in packs/<n>.needs, so that a
+// snapshot is loaded from just the packs it draws on.
+//
+// Snapshots must be resolved and deduplicated, as by ResolveAndDeduplicate,
+// and are deduplicated against the store as they are added, so that each
+// distinct node is written only once. Loading several snapshots into one graph
+// loads each pack only once: the nodes they have in common are the same nodes.
+//
+// A store has at most one writer at a time. Readers do not see a snapshot
+// until it has been completely added.
+class TypeStore {
+ public:
+  TypeStore(Graph& graph, const std::string& directory, Metrics& metrics,
+            size_t jobs = 1);
+  TypeStore(const TypeStore&) = delete;
+  TypeStore& operator=(const TypeStore&) = delete;
+
+  // Loads the named snapshot, returning its root.
+  Id Read(const std::string& name);
+  // Adds a snapshot under a new name, moving it out of its own graph. Returns
+  // its root, which shares nodes with the snapshots already in the store.
+  Id Add(const std::string& name, Graph& snapshot, Id root);
+
+ private:
+  struct Pack {
+    // the graph ids of the nodes read from the pack
+    Id start;
+    Id limit;
+    Id root;
+    // in ascending order
+    std::vector<size_t> needs;
+  };
+
+  std::filesystem::path PackPath(size_t number, const char* extension) const;
+  std::filesystem::path ManifestPath(const std::string& name) const;
+  std::vector<size_t> ReadNeeds(size_t number) const;
+  const Pack& Load(size_t number);
+  const Pack& PackOf(Id id) const;
+
+  Graph& graph_;
+  const std::filesystem::path directory_;
+  Metrics& metrics_;
+  const size_t jobs_;
+  // the external ids of the nodes loaded or added
+  proto::ExternalIdMap ids_;
+  // the packs loaded or added, by number
+  std::map<size_t, Pack> packs_;
+  // their numbers, by start id
+  std::map<size_t, size_t> by_start_;
+  // the fingerprints of the nodes in the packs, kept across additions
+  FingerprintCache fingerprints_;
+  Counter loaded_packs_;
+  Counter loaded_nodes_;
+  Counter added_nodes_;
+};
+
+// Reads a stored snapshot, given the path of its manifest,
+// <directory>/snapshots/<name>.
+Id ReadStored(Graph& graph, const std::string& manifest, Metrics& metrics);
+
+}  // namespace stg
+
+#endif  // STG_TYPE_STORE_H_
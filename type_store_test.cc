@@ -0,0 +1,166 @@
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+// -*- mode: C++ -*-
+//
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License v2.0 with LLVM Exceptions (the
+// "License"); you may not use this file except in compliance with the
+// License.  You may obtain a copy of the License at
+//
+//     https://llvm.org/LICENSE.txt
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "type_store.h"
+
+#include <cstddef>
+#include <filesystem>
+#include <map>
+#include <sstream>
+#include <string>
+#include <unistd.h>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include <catch2/catch.hpp>
+#include "error.h"
+#include "graph.h"
+#include "input.h"
+#include "metrics.h"
+#include "proto_writer.h"
+#include "reader_options.h"
+
+namespace Test {
+
+struct TemporaryDirectory {
+  TemporaryDirectory() {
+    std::string name = std::filesystem::temp_directory_path() / "stg-XXXXXX";
+    REQUIRE(mkdtemp(name.data()) != nullptr);
+    path = name;
+  }
+  ~TemporaryDirectory() {
+    std::filesystem::remove_all(path);
+  }
+  std::filesystem::path path;
+};
+
+size_t Count(const stg::Metrics& metrics, const std::string& name) {
+  size_t count = 0;
+  for (const auto& metric : metrics) {
+    if (metric.name == name) {
+      count += std::get<size_t>(metric.value);
+    }
+  }
+  return count;
+}
+
+// An interface with a linked list of int and a typedef of int, as well as a
+// typedef of long if wanted.
+stg::Id Snapshot(stg::Graph& graph, bool with_long) {
+  const auto int_type = graph.Add<stg::Primitive>(
+      "int", stg::Primitive::Encoding::SIGNED_INTEGER, 4);
+  const auto list = graph.Allocate();
+  const auto pointer = graph.Add<stg::PointerReference>(
+      stg::PointerReference::Kind::POINTER, list);
+  const auto next = graph.Add<stg::Member>("next", pointer, 0, 0);
+  const auto value = graph.Add<stg::Member>("value", int_type, 64, 0);
+  graph.Set<stg::StructUnion>(
+      list, stg::StructUnion::Kind::STRUCT, "list", 16, std::vector<stg::Id>{},
+      std::vector<stg::Id>{}, std::vector<stg::Id>{next, value});
+  std::map<std::string, stg::Id> types = {
+      {"struct list", list},
+      {"t", graph.Add<stg::Typedef>("t", int_type)}};
+  if (with_long) {
+    const auto long_type = graph.Add<stg::Primitive>(
+        "long", stg::Primitive::Encoding::SIGNED_INTEGER, 8);
+    types.emplace("u", graph.Add<stg::Typedef>("u", long_type));
+  }
+  return graph.Add<stg::Interface>(std::map<std::string, stg::Id>{},
+                                   std::move(types));
+}
+
+std::string Write(const stg::Graph& graph, stg::Id root) {
+  std::ostringstream os;
+  stg::proto::Writer writer(graph);
+  writer.Write(root, os);
+  return os.str();
+}
+
+TEST_CASE("type store") {
+  const TemporaryDirectory directory;
+  const std::string store = directory.path;
+  std::string expected1;
+  std::string expected2;
+
+  {
+    stg::Metrics metrics;
+    stg::Graph graph;
+    stg::TypeStore type_store(graph, store, metrics);
+    for (const auto& [name, with_long] :
+         {std::pair{"v1", false}, {"v2", true}, {"v3", false}}) {
+      stg::Graph snapshot;
+      const auto root = Snapshot(snapshot, with_long);
+      const auto text = Write(snapshot, root);
+      const auto added = type_store.Add(name, snapshot, root);
+      CHECK(Write(graph, added) == text);
+      (with_long ? expected2 : expected1) = text;
+    }
+    stg::Graph snapshot;
+    CHECK_THROWS_AS(
+        type_store.Add("v1", snapshot, Snapshot(snapshot, false)),
+        stg::Exception);
+  }
+
+  SECTION("nodes are stored once") {
+    // v2 adds a typedef, a primitive and its own interface, v3 adds nothing
+    stg::Metrics metrics;
+    {
+      stg::Graph graph;
+      stg::TypeStore type_store(graph, store, metrics);
+      stg::Graph snapshot;
+      const auto root =
+          type_store.Add("v4", snapshot, Snapshot(snapshot, true));
+      CHECK(Write(graph, root) == expected2);
+    }
+    CHECK(Count(metrics, "type_store.loaded_packs") == 3);
+    CHECK(Count(metrics, "type_store.loaded_nodes") == 10);
+    CHECK(Count(metrics, "type_store.added_nodes") == 0);
+  }
+
+  SECTION("snapshots share nodes") {
+    stg::Metrics metrics;
+    stg::Graph graph;
+    stg::TypeStore type_store(graph, store, metrics);
+    const auto v1 = type_store.Read("v1");
+    const auto v2 = type_store.Read("v2");
+    const auto v3 = type_store.Read("v3");
+    CHECK(Write(graph, v1) == expected1);
+    CHECK(Write(graph, v2) == expected2);
+    CHECK(v3 == v1);
+    // all that v2 has beyond v1 is a typedef, a primitive and an interface
+    CHECK(graph.Limit().ix_ == 10);
+    CHECK_THROWS_AS(type_store.Read("v5"), stg::Exception);
+  }
+
+  SECTION("snapshots load the packs they need") {
+    stg::Metrics metrics;
+    {
+      stg::Graph graph;
+      const auto manifest = directory.path / "snapshots" / "v3";
+      const auto root = stg::Read(graph, stg::InputFormat::STORED,
+                                  manifest.c_str(), stg::ReadOptions(),
+                                  nullptr, metrics);
+      CHECK(Write(graph, root) == expected1);
+    }
+    // v3 is v1 all over again, so its pack has only a root
+    CHECK(Count(metrics, "type_store.loaded_packs") == 2);
+    CHECK(Count(metrics, "type_store.loaded_nodes") == 7);
+  }
+}
+
+}  // namespace Test
@@ -19,10 +19,19 @@
 
 #include "unification.h"
 
+#include <algorithm>
 #include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <tuple>
 #include <utility>
+#include <vector>
 
+#include "flat_map.h"
 #include "graph.h"
+#include "metrics.h"
+#include "parallel.h"
+#include "substitution.h"
 
 namespace stg {
 
@@ -39,15 +48,23 @@ namespace {
 //
 // A declaration and definition of the same named type can be unified. This is
 // forward declaration resolution.
+//
+// The target supplies Find and Union; it is either a Unification or a trial.
+template <typename Target>
 struct Unifier {
   enum Winner { Neither, Right, Left };  // makes p ? Right : Neither a no-op
 
-  Unifier(const Graph& graph, Unification& unification)
-      : graph(graph), unification(unification) {}
+  Unifier(const Graph& graph, Target& unification,
+          UnificationScratch& scratch)
+      : graph(graph), unification(unification), scratch(scratch) {
+    scratch.Clear();
+  }
 
   bool operator()(Id id1, Id id2) {
-    Id fid1 = Find(id1);
-    Id fid2 = Find(id2);
+    if (id1 == id2) {
+      return true;
+    }
+    auto [fid1, fid2] = Find(id1, id2);
     if (fid1 == fid2) {
       return true;
     }
@@ -55,7 +72,7 @@ struct Unifier {
     // Check if the comparison has an already known result.
     //
     // Opportunistic as seen is unaware of new mappings.
-    if (!seen.emplace(fid1, fid2).second) {
+    if (!scratch.seen.Insert(Pack(fid1, fid2), 0)) {
       return true;
     }
 
@@ -65,8 +82,7 @@ struct Unifier {
     }
 
     // These will occasionally get substituted due to a recursive call.
-    fid1 = Find(fid1);
-    fid2 = Find(fid2);
+    std::tie(fid1, fid2) = Find(fid1, fid2);
     if (fid1 == fid2) {
       return true;
     }
@@ -74,12 +90,14 @@ struct Unifier {
     if (winner == Left) {
       std::swap(fid1, fid2);
     }
-    mapping.insert({fid1, fid2});
+    // fid1 is a representative, not yet substituted
+    scratch.mapping.Insert(fid1.ix_, fid2.ix_);
+    scratch.substitutions.emplace_back(fid1, fid2);
 
     return true;
   }
 
-  bool operator()(const std::vector<Id>& ids1, const std::vector<Id>& ids2) {
+  bool operator()(const Ids& ids1, const Ids& ids2) {
     bool result = ids1.size() == ids2.size();
     for (size_t ix = 0; result && ix < ids1.size(); ++ix) {
       result = (*this)(ids1[ix], ids2[ix]);
@@ -88,8 +106,8 @@ struct Unifier {
   }
 
   template <typename Key>
-  bool operator()(const std::map<Key, Id>& ids1,
-                  const std::map<Key, Id>& ids2) {
+  bool operator()(const FlatMap<Key, Id>& ids1,
+                  const FlatMap<Key, Id>& ids2) {
     bool result = ids1.size() == ids2.size();
     auto it1 = ids1.begin();
     auto it2 = ids2.begin();
@@ -231,37 +249,252 @@ struct Unifier {
     return Neither;
   }
 
-  Id Find(Id id) {
-    while (true) {
-      id = unification.Find(id);
-      auto it = mapping.find(id);
-      if (it != mapping.end()) {
-        id = it->second;
-        continue;
-      }
-      return id;
+  static uint64_t Pack(Id id1, Id id2) {
+    return (static_cast<uint64_t>(id1.ix_) << 32) | id2.ix_;
+  }
+
+  // Finds the representatives, taking tentative substitutions into account.
+  std::pair<Id, Id> Find(Id id1, Id id2) {
+    auto result = unification.Find(id1, id2);
+    if (scratch.mapping.Size() != 0) {
+      result.first = Substituted(result.first);
+      result.second = Substituted(result.second);
+    }
+    return result;
+  }
+
+  Id Substituted(Id id) {
+    while (const auto next = scratch.mapping.Find(id.ix_)) {
+      id = unification.Find(Id(*next));
     }
+    return id;
   }
 
   const Graph& graph;
-  Unification& unification;
-  std::unordered_set<Pair> seen;
-  std::unordered_map<Id, Id> mapping;
+  Target& unification;
+  UnificationScratch& scratch;
 };
 
-}  // namespace
-
-bool Unification::Unify(Id id1, Id id2) {
-  // TODO: Unifier only needs access to Unification::Find
-  Unifier unifier(graph_, *this);
+template <typename Target>
+bool Unify(const Graph& graph, Target& target, UnificationScratch& scratch,
+           Id id1, Id id2) {
+  Unifier<Target> unifier(graph, target, scratch);
   if (unifier(id1, id2)) {
     // commit
-    for (const auto& s : unifier.mapping) {
-      Union(s.first, s.second);
+    for (const auto& [from, to] : scratch.substitutions) {
+      target.Union(from, to);
+    }
+    return true;
+  }
+  return false;
+}
+
+// Whether a node has an edge to a node that has been unified away, according to
+// a flattened mapping. The graph is only read, so base nodes are not copied.
+struct Touched {
+  Touched(const Graph& graph, const DenseIdMapping& mapping)
+      : graph(graph), mapping(mapping) {}
+
+  bool operator()(Id id) const {
+    return graph.Apply<bool>(*this, id);
+  }
+
+  bool Edge(Id id) const {
+    return mapping.Get(id) != id;
+  }
+
+  bool Edges(const Ids& ids) const {
+    return std::any_of(ids.begin(), ids.end(),
+                       [&](Id id) { return Edge(id); });
+  }
+
+  template <typename Key>
+  bool Edges(const FlatMap<Key, Id>& ids) const {
+    return std::any_of(ids.begin(), ids.end(),
+                       [&](const auto& item) { return Edge(item.second); });
+  }
+
+  bool operator()(const Special&) const {
+    return false;
+  }
+
+  bool operator()(const PointerReference& x) const {
+    return Edge(x.pointee_type_id);
+  }
+
+  bool operator()(const PointerToMember& x) const {
+    return Edge(x.containing_type_id) || Edge(x.pointee_type_id);
+  }
+
+  bool operator()(const Typedef& x) const {
+    return Edge(x.referred_type_id);
+  }
+
+  bool operator()(const Qualified& x) const {
+    return Edge(x.qualified_type_id);
+  }
+
+  bool operator()(const Primitive&) const {
+    return false;
+  }
+
+  bool operator()(const Array& x) const {
+    return Edge(x.element_type_id);
+  }
+
+  bool operator()(const BaseClass& x) const {
+    return Edge(x.type_id);
+  }
+
+  bool operator()(const Member& x) const {
+    return Edge(x.type_id);
+  }
+
+  bool operator()(const Method& x) const {
+    return Edge(x.type_id);
+  }
+
+  bool operator()(const StructUnion& x) const {
+    if (!x.definition) {
+      return false;
+    }
+    const auto& definition = *x.definition;
+    return Edges(definition.base_classes) || Edges(definition.methods)
+        || Edges(definition.members);
+  }
+
+  bool operator()(const Enumeration& x) const {
+    return x.definition && Edge(x.definition->underlying_type_id);
+  }
+
+  bool operator()(const Function& x) const {
+    return Edges(x.parameters) || Edge(x.return_type_id);
+  }
+
+  bool operator()(const ElfSymbol& x) const {
+    return x.type_id && Edge(*x.type_id);
+  }
+
+  bool operator()(const Interface& x) const {
+    return Edges(x.symbols) || Edges(x.types);
+  }
+
+  const Graph& graph;
+  const DenseIdMapping& mapping;
+};
+
+}  // namespace
+
+Unification::~Unification() {
+  if (std::uncaught_exceptions() > 0) {
+    // abort unification
+    return;
+  }
+  const Time time(metrics_, "unification.rewrite");
+  Counter removed(metrics_, "unification.removed");
+  Counter scanned(metrics_, "unification.scanned");
+  Counter rewritten(metrics_, "unification.rewritten");
+  if (removed_.empty()) {
+    // nothing was unified, so there is nothing to rewrite
+    return;
+  }
+  // remove the nodes that have been substituted away
+  for (const auto id : removed_) {
+    graph_.Remove(id);
+    ++removed;
+  }
+  // point every id directly at its representative, so that the mapping is
+  // only read from now on, and can be read concurrently
+  const Id limit = graph_.Limit();
+  Flatten(limit);
+  // find the remaining nodes with edges to removed ones; this only reads the
+  // graph, as finding them without looking at every node would need a reverse
+  // edge index, whose construction reads the same edges
+  const size_t workers = std::max(jobs_, size_t{1});
+  std::vector<size_t> counts(workers);
+  std::vector<std::vector<Id>> touched(workers);
+  const Touched refers_to_removed(graph_, mapping_);
+  graph_.ParallelForEach(jobs_, start_, limit, [&](size_t worker, Id id) {
+    ++counts[worker];
+    if (refers_to_removed(id)) {
+      touched[worker].push_back(id);
     }
+  });
+  // rewrite just those
+  std::vector<Id> ids;
+  for (size_t worker = 0; worker < workers; ++worker) {
+    scanned += counts[worker];
+    ids.insert(ids.end(), touched[worker].begin(), touched[worker].end());
+  }
+  rewritten += ids.size();
+  auto remap = [&](Id& id) {
+    const Id fid = mapping_.Get(id);
+    if (fid != id) {
+      id = fid;
+    }
+  };
+  ForEachIndex(jobs_, ids.size(), [&](size_t, size_t index) {
+    ::stg::Substitute substitute(graph_, remap);
+    substitute(ids[index]);
+  });
+}
+
+bool Unification::Unify(Id id1, Id id2) {
+  const Id fid1 = Find(id1);
+  const Id fid2 = Find(id2);
+  if (fid1 == fid2) {
+    return true;
+  }
+  // failure is symmetric
+  const Pair key = fid1.ix_ < fid2.ix_ ? Pair{fid1, fid2} : Pair{fid2, fid1};
+  const Versions versions{Version(key.first), Version(key.second)};
+  const auto it = failures_.find(key);
+  if (it != failures_.end() && it->second == versions) {
+    ++unify_cached_failure_;
+    return false;
+  }
+  if (::stg::Unify(graph_, *this, scratch_, fid1, fid2)) {
     return true;
   }
+  failures_.insert_or_assign(key, versions);
   return false;
 }
 
+bool Unification::Trial::Unify(Id id1, Id id2) {
+  return ::stg::Unify(unification_.graph_, *this, scratch_, id1, id2);
+}
+
+Id Unification::Trial::Find(Id id) {
+  id = unification_.Representative(id);
+  reads_.push_back(id);
+  while (true) {
+    const auto it = overlay_.find(id);
+    if (it == overlay_.end()) {
+      return id;
+    }
+    id = it->second;
+  }
+}
+
+void Unification::Trial::Union(Id id1, Id id2) {
+  const Id fid1 = Find(id1);
+  const Id fid2 = Find(id2);
+  if (fid1 != fid2) {
+    overlay_.emplace(fid1, fid2);
+    unions_.emplace_back(fid1, fid2);
+  }
+}
+
+bool Unification::Trial::Commit() {
+  for (const auto& id : reads_) {
+    if (unification_.Representative(id) != id) {
+      return false;
+    }
+  }
+  for (const auto& [id1, id2] : unions_) {
+    unification_.Union(id1, id2);
+  }
+  return true;
+}
+
 }  // namespace stg
@@ -20,60 +20,108 @@
 #ifndef STG_UNIFICATION_H_
 #define STG_UNIFICATION_H_
 
-#include <exception>
+#include <cstddef>
 #include <unordered_map>
 #include <unordered_set>
+#include <utility>
+#include <vector>
 
 #include "graph.h"
 #include "metrics.h"
-#include "substitution.h"
+#include "scratch_map.h"
 
 namespace stg {
 
+// The working state of a single unification, kept by its owner and cleared for
+// each one, so that short unifications do not allocate.
+struct UnificationScratch {
+  void Clear() {
+    seen.Clear();
+    mapping.Clear();
+    substitutions.clear();
+  }
+
+  // pairs of representatives, packed, whose unification has been started
+  ScratchMap seen;
+  // tentative substitutions, from id to id
+  ScratchMap mapping;
+  // the same, in the order found
+  std::vector<std::pair<Id, Id>> substitutions;
+};
+
 // Keep track of which nodes are pending substitution and rewrite the graph on
-// destruction.
+// destruction. Only the nodes that were unified away are removed and, if there
+// were none, the graph is left untouched. Otherwise, the remaining nodes from
+// start are checked, without changing them, for edges to removed nodes and just
+// those nodes are rewritten, using up to the given number of jobs.
 class Unification {
  public:
-  Unification(Graph& graph, Id start, Metrics& metrics)
+  Unification(Graph& graph, Id start, Metrics& metrics, size_t jobs = 1)
       : graph_(graph),
         start_(start),
         mapping_(start),
         metrics_(metrics),
+        jobs_(jobs),
         find_query_(metrics, "unification.find_query"),
         find_halved_(metrics, "unification.find_halved"),
         union_known_(metrics, "unification.union_known"),
-        union_unknown_(metrics, "unification.union_unknown") {}
+        union_unknown_(metrics, "unification.union_unknown"),
+        unify_cached_failure_(metrics, "unification.unify_cached_failure") {}
 
-  ~Unification() {
-    if (std::uncaught_exceptions() > 0) {
-      // abort unification
-      return;
-    }
-    // apply substitutions to the entire graph
-    const Time time(metrics_, "unification.rewrite");
-    Counter removed(metrics_, "unification.removed");
-    Counter retained(metrics_, "unification.retained");
-    auto remap = [&](Id& id) {
-      Update(id);
-    };
-    ::stg::Substitute substitute(graph_, remap);
-    graph_.ForEach(start_, graph_.Limit(), [&](Id id) {
-      if (Find(id) != id) {
-        graph_.Remove(id);
-        ++removed;
-      } else {
-        substitute(id);
-        ++retained;
-      }
-    });
-  }
+  ~Unification();
 
   void Reserve(Id limit) {
     mapping_.Reserve(limit);
   }
 
+  // Whether any node has been unified away, so that the graph will change.
+  bool Unified() const {
+    return !removed_.empty();
+  }
+
+  // Failures are remembered, for as long as neither class changes.
   bool Unify(Id id1, Id id2);
 
+  // A tentative unification, made against the current state without changing
+  // it, so that trials may run concurrently while nothing else updates the
+  // Unification. Unions are recorded in the trial, along with the
+  // representatives it has seen. Committing replays the unions, provided that
+  // none of those representatives has since been unified away, which makes the
+  // result the same as if the trial had been run directly at that point.
+  class Trial {
+   public:
+    explicit Trial(Unification& unification) : unification_(unification) {}
+
+    bool Unify(Id id1, Id id2);
+    std::pair<Id, Id> Find(Id id1, Id id2) {
+      return {Find(id1), Find(id2)};
+    }
+    Id Find(Id id);
+    void Union(Id id1, Id id2);
+
+    // Returns false, changing nothing, if the trial is stale.
+    bool Commit();
+
+   private:
+    Unification& unification_;
+    UnificationScratch scratch_;
+    std::unordered_map<Id, Id> overlay_;
+    std::vector<std::pair<Id, Id>> unions_;
+    std::vector<Id> reads_;
+  };
+
+  // Finds the representatives of two ids at once. Most ids are their own
+  // representatives and this is checked first.
+  std::pair<Id, Id> Find(Id id1, Id id2) {
+    const Id parent1 = mapping_[id1];
+    const Id parent2 = mapping_[id2];
+    if (parent1 == id1 && parent2 == id2) {
+      find_query_ += 2;
+      return {id1, id2};
+    }
+    return {Find(id1), Find(id2)};
+  }
+
   Id Find(Id id) {
     ++find_query_;
     // path halving - tiny performance gain
@@ -102,6 +150,8 @@ class Unification {
       return;
     }
     mapping_[fid1] = fid2;
+    ++versions_[fid2];
+    removed_.push_back(fid1);
     ++union_unknown_;
   }
 
@@ -115,14 +165,58 @@ class Unification {
   }
 
  private:
+  // the number of times other classes have been merged into this one
+  size_t Version(Id id) const {
+    const auto it = versions_.find(id);
+    return it == versions_.end() ? 0 : it->second;
+  }
+
+  // Find without path halving or counting, safe to call concurrently with
+  // itself.
+  Id Representative(Id id) const {
+    while (true) {
+      const Id parent = mapping_.Get(id);
+      if (parent == id) {
+        return id;
+      }
+      id = parent;
+    }
+  }
+
+  void Flatten(Id limit) {
+    for (size_t ix = start_.ix_; ix < limit.ix_; ++ix) {
+      const Id id(ix);
+      Id root = id;
+      while (mapping_[root] != root) {
+        root = mapping_[root];
+      }
+      // path compression, so that each path is only walked once
+      Id next = id;
+      while (next != root) {
+        auto& parent = mapping_[next];
+        next = parent;
+        parent = root;
+      }
+    }
+  }
+
   Graph& graph_;
   Id start_;
   DenseIdMapping mapping_;
+  UnificationScratch scratch_;
+  // the nodes that are no longer representatives, in order of union
+  std::vector<Id> removed_;
+  // pairs of representatives that failed to unify, with their versions then
+  using Versions = std::pair<size_t, size_t>;
+  std::unordered_map<Pair, Versions> failures_;
+  std::unordered_map<Id, size_t> versions_;
   Metrics& metrics_;
-  Counter find_query_;
-  Counter find_halved_;
-  Counter union_known_;
-  Counter union_unknown_;
+  const size_t jobs_;
+  OperationCounter find_query_;
+  OperationCounter find_halved_;
+  OperationCounter union_known_;
+  OperationCounter union_unknown_;
+  OperationCounter unify_cached_failure_;
 };
 
 }  // namespace stg
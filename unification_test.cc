@@ -0,0 +1,115 @@
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+// -*- mode: C++ -*-
+//
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License v2.0 with LLVM Exceptions (the
+// "License"); you may not use this file except in compliance with the
+// License.  You may obtain a copy of the License at
+//
+//     https://llvm.org/LICENSE.txt
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "unification.h"
+
+#include <cstddef>
+#include <map>
+#include <string>
+#include <variant>
+#include <vector>
+
+#include <catch2/catch.hpp>
+#include "graph.h"
+#include "metrics.h"
+
+namespace Test {
+
+using Kind = stg::StructUnion::Kind;
+
+size_t Count(const stg::Metrics& metrics, const std::string& name) {
+  for (const auto& metric : metrics) {
+    if (metric.name == name) {
+      return std::get<size_t>(metric.value);
+    }
+  }
+  FAIL("missing metric " << name);
+  return 0;
+}
+
+TEST_CASE("failed unifications are cached") {
+  stg::Graph graph;
+  const auto i = graph.Add<stg::Primitive>(
+      "int", stg::Primitive::Encoding::SIGNED_INTEGER, 4);
+  const auto l = graph.Add<stg::Primitive>(
+      "long", stg::Primitive::Encoding::SIGNED_INTEGER, 8);
+  const auto s = [&](stg::Id type) {
+    const auto member = graph.Add<stg::Member>("m", type, 0, 0);
+    return graph.Add<stg::StructUnion>(
+        Kind::STRUCT, "s", 8, std::vector<stg::Id>{}, std::vector<stg::Id>{},
+        std::vector<stg::Id>{member});
+  };
+  const auto a = s(i);
+  const auto b = s(l);
+  const auto declaration = graph.Add<stg::StructUnion>(Kind::STRUCT, "s");
+
+  stg::Metrics metrics;
+  {
+    stg::Unification unification(graph, stg::Id(0), metrics);
+    unification.Reserve(graph.Limit());
+    CHECK(!unification.Unify(a, b));
+    CHECK(!unification.Unify(b, a));
+    // a's class changes, so the failure is no longer known
+    CHECK(unification.Unify(declaration, a));
+    CHECK(!unification.Unify(a, b));
+    CHECK(!unification.Unify(a, b));
+  }
+  CHECK(Count(metrics, "unification.unify_cached_failure") == 2);
+}
+
+struct GetPointee {
+  stg::Id operator()(const stg::PointerReference& x) {
+    return x.pointee_type_id;
+  }
+  template <typename Node>
+  stg::Id operator()(const Node&) {
+    return stg::Id::kInvalid;
+  }
+};
+
+TEST_CASE("only nodes referring to removed nodes are rewritten") {
+  const size_t jobs = GENERATE(1, 4);
+  stg::Graph graph;
+  const auto i = graph.Add<stg::Primitive>(
+      "int", stg::Primitive::Encoding::SIGNED_INTEGER, 4);
+  const auto member = graph.Add<stg::Member>("m", i, 0, 0);
+  const auto definition = graph.Add<stg::StructUnion>(
+      Kind::STRUCT, "s", 4, std::vector<stg::Id>{}, std::vector<stg::Id>{},
+      std::vector<stg::Id>{member});
+  const auto declaration = graph.Add<stg::StructUnion>(Kind::STRUCT, "s");
+  const auto to_declaration = graph.Add<stg::PointerReference>(
+      stg::PointerReference::Kind::POINTER, declaration);
+  const auto to_definition = graph.Add<stg::PointerReference>(
+      stg::PointerReference::Kind::POINTER, definition);
+  graph.Add<stg::Typedef>("t", i);
+
+  stg::Metrics metrics;
+  {
+    stg::Unification unification(graph, stg::Id(0), metrics, jobs);
+    unification.Reserve(graph.Limit());
+    CHECK(unification.Unify(declaration, definition));
+  }
+  CHECK(!graph.Is(declaration));
+  GetPointee get;
+  CHECK(graph.Apply<stg::Id>(get, to_declaration) == definition);
+  CHECK(graph.Apply<stg::Id>(get, to_definition) == definition);
+  CHECK(Count(metrics, "unification.removed") == 1);
+  CHECK(Count(metrics, "unification.scanned") == 6);
+  CHECK(Count(metrics, "unification.rewritten") == 1);
+}
+
+}  // namespace Test